@@ -584,6 +584,12 @@
 /** Internal processing error in the PGM physial page mapping code dealing
  * with MMIO2 pages. */
 #define VERR_PGM_PHYS_PAGE_MAP_MMIO2_IPE        (-1684)
+/** Cannot save the VM state while post-copy teleportation is still
+ * transferring guest memory. */
+#define VERR_PGM_POST_COPY_ACTIVE               (-1685)
+/** The saved state contains post-copy records (deferred RAM pages) the
+ * loading VM did not agree to. */
+#define VERR_PGM_POST_COPY_NOT_ACCEPTED         (-1686)
 /** @} */
 
 
@@ -135,8 +135,12 @@ typedef struct INTNETBUF
     STAMCOUNTER     cStatLost;
     /** Number of bad frames (both rings). */
     STAMCOUNTER     cStatBadFrames;
-    /** Reserved for future use. */
-    STAMCOUNTER     aStatReserved[2];
+    /** Number of times the receiver was woken up (signalled) because new
+     * frames arrived in the receive ring. */
+    STAMCOUNTER     cStatRecvWakeups;
+    /** Number of IntNetR0IfSend calls which found frames in the send ring,
+     * i.e. the number of send ring-0 transitions doing actual work. */
+    STAMCOUNTER     cStatSendBatches;
     /** Reserved for future send profiling. */
     STAMPROFILE     StatSend1;
     /** Reserved for future send profiling. */
@@ -49,6 +49,70 @@ RT_C_DECLS_BEGIN
 VMMDECL(int) DBGFR3TraceConfig(PVM pVM, const char *pszConfig);
 
 
+/** @name Binary Trace Rings
+ * @{ */
+
+/**
+ * Binary trace ring event types.
+ */
+typedef enum DBGFTRACEEVT
+{
+    /** Invalid / unused record. */
+    DBGFTRACEEVT_INVALID = 0,
+    /** I/O port read, uAddr is the port. */
+    DBGFTRACEEVT_IOPORT_READ,
+    /** I/O port write, uAddr is the port. */
+    DBGFTRACEEVT_IOPORT_WRITE,
+    /** MMIO read, uAddr is the guest physical address. */
+    DBGFTRACEEVT_MMIO_READ,
+    /** MMIO write, uAddr is the guest physical address. */
+    DBGFTRACEEVT_MMIO_WRITE,
+    /** Async I/O task completion, uAddr identifies the endpoint. */
+    DBGFTRACEEVT_ASYNC_IO,
+    /** The end of valid event types. */
+    DBGFTRACEEVT_END,
+    /** The usual 32-bit hack. */
+    DBGFTRACEEVT_32BIT_HACK = 0x7fffffff
+} DBGFTRACEEVT;
+
+/**
+ * Binary trace ring record.
+ *
+ * All events are recorded as completed spans so that one record suffices per
+ * event.  Timestamps are raw host TSC values.
+ */
+typedef struct DBGFTRACEREC
+{
+    /** The TSC when the event started. */
+    uint64_t        uTsc;
+    /** The port, address or other object identifier. */
+    uint64_t        uAddr;
+    /** The value transferred, if applicable. */
+    uint64_t        uValue;
+    /** The duration in TSC ticks (saturated). */
+    uint32_t        cTicks;
+    /** The event type (DBGFTRACEEVT). */
+    uint8_t         u8Evt;
+    /** The access size in bytes, 0 if not applicable. */
+    uint8_t         cbAccess;
+    /** The status code of the operation (INT16_MIN if it doesn't fit). */
+    int16_t         i16Rc;
+} DBGFTRACEREC;
+/** Pointer to a binary trace ring record. */
+typedef DBGFTRACEREC *PDBGFTRACEREC;
+/** Pointer to a const binary trace ring record. */
+typedef DBGFTRACEREC const *PCDBGFTRACEREC;
+
+VMM_INT_DECL(void)   DBGFTraceRingAdd(PVMCPU pVCpu, DBGFTRACEEVT enmEvt, uint64_t uTscStart, uint64_t uAddr,
+                                      uint64_t uValue, uint8_t cbAccess, int rc);
+#ifdef IN_RING3
+VMMR3_INT_DECL(void) DBGFR3TraceRingAddSpan(PVM pVM, DBGFTRACEEVT enmEvt, uint64_t cNsElapsed, uint64_t uAddr,
+                                            uint64_t uValue, int rc);
+VMMR3DECL(int)       DBGFR3TraceRingExport(PUVM pUVM, const char *pszFilename);
+#endif
+/** @} */
+
+
 /** @name VMM Internal Trace Macros
  * @remarks The user of these macros is responsible of including VBox/vmm/vm.h.
  * @{
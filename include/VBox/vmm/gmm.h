@@ -581,6 +581,29 @@ typedef GMMFREELARGEPAGEREQ *PGMMFREELARGEPAGEREQ;
 
 GMMR0DECL(int) GMMR0FreeLargePageReq(PVM pVM, VMCPUID idCpu, PGMMFREELARGEPAGEREQ pReq);
 
+
+/**
+ * Request buffer for GMMR0PromoteLargePageReq / VMMR0_DO_GMM_PROMOTE_LARGE_PAGE.
+ * @see GMMR0PromoteLargePageReq.
+ */
+typedef struct GMMPROMOTELARGEPAGEREQ
+{
+    /** The header. */
+    SUPVMMR0REQHDR  Hdr;
+    /** The page ID of the first page of the new large page. (OUT) */
+    uint32_t        idLargePage;
+    /** Alignment padding. */
+    uint32_t        u32Alignment;
+    /** The host physical address of the new large page. (OUT) */
+    RTHCPHYS        HCPhysLargePage;
+    /** The small pages to free, in guest physical order. (IN) */
+    GMMFREEPAGEDESC aPages[GMM_CHUNK_SIZE >> PAGE_SHIFT];
+} GMMPROMOTELARGEPAGEREQ;
+/** Pointer to a GMMR0PromoteLargePageReq / VMMR0_DO_GMM_PROMOTE_LARGE_PAGE request buffer. */
+typedef GMMPROMOTELARGEPAGEREQ *PGMMPROMOTELARGEPAGEREQ;
+
+GMMR0DECL(int) GMMR0PromoteLargePageReq(PVM pVM, VMCPUID idCpu, PGMMPROMOTELARGEPAGEREQ pReq);
+
 /** Maximum length of the shared module name string, terminator included. */
 #define GMM_SHARED_MODULE_MAX_NAME_STRING       128
 /** Maximum length of the shared module version string, terminator included. */
@@ -703,6 +726,41 @@ typedef GMMUNREGISTERSHAREDMODULEREQ *PGMMUNREGISTERSHAREDMODULEREQ;
 
 GMMR0DECL(int) GMMR0UnregisterSharedModuleReq(PVM pVM, VMCPUID idCpu, PGMMUNREGISTERSHAREDMODULEREQ pReq);
 
+/** The max number of pages a single GMMR0DedupScanReq call will examine.
+ * This bounds the time the other EMTs of the VM are stalled; the GMM
+ * semaphore is dropped more frequently than this. */
+#define GMM_DEDUP_MAX_PAGES_PER_SCAN    _16K
+
+/**
+ * Request buffer for GMMR0DedupScanReq / VMMR0_DO_GMM_DEDUP_SCAN.
+ * @see GMMR0DedupScanReq.
+ */
+typedef struct GMMDEDUPSCANREQ
+{
+    /** The header. */
+    SUPVMMR0REQHDR              Hdr;
+    /** Where to start scanning (in) and where to continue next time (out).
+     * Set to zero when the scan has wrapped around the end of guest RAM. */
+    RTGCPHYS                    GCPhysCursor;
+    /** The number of pages to examine (in), max GMM_DEDUP_MAX_PAGES_PER_SCAN. */
+    uint32_t                    cPagesToScan;
+    /** The number of pages examined (out). */
+    uint32_t                    cScannedPages;
+    /** The number of pages replaced by an identical shared page (out). */
+    uint32_t                    cMergedPages;
+    /** The number of pages converted into new shared pages (out). */
+    uint32_t                    cNewSharedPages;
+    /** The number of hash hits with different page content (out). */
+    uint32_t                    cMismatches;
+    /** Align at 8 byte boundary. */
+    uint32_t                    u32Alignment;
+} GMMDEDUPSCANREQ;
+/** Pointer to a GMMR0DedupScanReq / VMMR0_DO_GMM_DEDUP_SCAN request buffer. */
+typedef GMMDEDUPSCANREQ *PGMMDEDUPSCANREQ;
+
+GMMR0DECL(int) GMMR0DedupScanReq(PVM pVM, VMCPUID idCpu, PGMMDEDUPSCANREQ pReq);
+GMMR0DECL(int) GMMR0DedupCheckPage(PGVM pGVM, PGMMSHAREDPAGEDESC pPageDesc);
+
 #if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
 /**
  * Request buffer for GMMR0FindDuplicatePageReq / VMMR0_DO_GMM_FIND_DUPLICATE_PAGE.
@@ -784,6 +842,7 @@ GMMR3DECL(void) GMMR3FreePagesCleanup(PGMMFREEPAGESREQ pReq);
 GMMR3DECL(void) GMMR3FreeAllocatedPages(PVM pVM, GMMALLOCATEPAGESREQ const *pAllocReq);
 GMMR3DECL(int)  GMMR3AllocateLargePage(PVM pVM,  uint32_t cbPage);
 GMMR3DECL(int)  GMMR3FreeLargePage(PVM pVM,  uint32_t idPage);
+GMMR3DECL(int)  GMMR3PromoteLargePage(PVM pVM, PGMMPROMOTELARGEPAGEREQ pReq);
 GMMR3DECL(int)  GMMR3MapUnmapChunk(PVM pVM, uint32_t idChunkMap, uint32_t idChunkUnmap, PRTR3PTR ppvR3);
 GMMR3DECL(int)  GMMR3SeedChunk(PVM pVM, RTR3PTR pvR3);
 GMMR3DECL(int)  GMMR3QueryHypervisorMemoryStats(PVM pVM, uint64_t *pcTotalAllocPages, uint64_t *pcTotalFreePages, uint64_t *pcTotalBalloonPages, uint64_t *puTotalBalloonSize);
@@ -793,6 +852,7 @@ GMMR3DECL(int)  GMMR3RegisterSharedModule(PVM pVM, PGMMREGISTERSHAREDMODULEREQ p
 GMMR3DECL(int)  GMMR3UnregisterSharedModule(PVM pVM, PGMMUNREGISTERSHAREDMODULEREQ pReq);
 GMMR3DECL(int)  GMMR3CheckSharedModules(PVM pVM);
 GMMR3DECL(int)  GMMR3ResetSharedModules(PVM pVM);
+GMMR3DECL(int)  GMMR3DedupScan(PVM pVM, PGMMDEDUPSCANREQ pReq);
 
 # if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
 GMMR3DECL(bool) GMMR3IsDuplicatePage(PVM pVM, uint32_t idPage);
@@ -216,9 +216,11 @@ VMM_INT_DECL(int)               HMInvalidatePageOnAllVCpus(PVM pVM, RTGCPTR GCVi
 VMM_INT_DECL(int)               HMInvalidatePhysPage(PVM pVM, RTGCPHYS GCPhys);
 VMM_INT_DECL(bool)              HMIsNestedPagingActive(PVM pVM);
 VMM_INT_DECL(PGMMODE)           HMGetShwPagingMode(PVM pVM);
+VMM_INT_DECL(uint32_t)          HMGetWorldSwitchExits(PVMCPU pVCpu);
 #else /* Nops in RC: */
 # define HMFlushTLB(pVCpu)                  do { } while (0)
 # define HMIsNestedPagingActive(pVM)        false
+# define HMGetWorldSwitchExits(pVCpu)       0
 # define HMFlushTLBOnAllVCpus(pVM)          do { } while (0)
 #endif
 
@@ -218,6 +218,52 @@ typedef DECLCALLBACK(int) FNIOMIOPORTOUTSTRING(PPDMDEVINS pDevIns, void *pvUser,
 /** Pointer to a FNIOMIOPORTOUTSTRING(). */
 typedef FNIOMIOPORTOUTSTRING *PFNIOMIOPORTOUTSTRING;
 
+/**
+ * Port I/O Handler for buffered string IN operations.
+ *
+ * Unlike FNIOMIOPORTINSTRING the caller has already mapped the guest memory,
+ * so the device only has to copy the data and doesn't need to bother with
+ * guest address translation.  This makes it usable in ring-0 as well.
+ *
+ * @returns VINF_SUCCESS or VINF_EM_*.
+ *
+ * @param   pDevIns     The device instance.
+ * @param   pvUser      User argument.
+ * @param   uPort       Port number used for the IN operation.
+ * @param   pvDst       Where to store the data.
+ * @param   pcTransfers Pointer to the number of transfer units to read, on
+ *                      return remaining transfer units.  The device may
+ *                      leave any number of units for the caller to do one
+ *                      by one.
+ * @param   cb          Size of the transfer unit (1, 2 or 4 bytes).
+ * @remarks Caller enters the device critical section.
+ * @remarks Nothing may be transferred when deferring to ring-3.
+ */
+typedef DECLCALLBACK(int) FNIOMIOPORTINSTRBUF(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void *pvDst, uint32_t *pcTransfers, unsigned cb);
+/** Pointer to a FNIOMIOPORTINSTRBUF(). */
+typedef FNIOMIOPORTINSTRBUF *PFNIOMIOPORTINSTRBUF;
+
+/**
+ * Port I/O Handler for buffered string OUT operations.
+ *
+ * @returns VINF_SUCCESS or VINF_EM_*.
+ *
+ * @param   pDevIns     The device instance.
+ * @param   pvUser      User argument.
+ * @param   uPort       Port number used for the OUT operation.
+ * @param   pvSrc       The data to write.
+ * @param   pcTransfers Pointer to the number of transfer units to write, on
+ *                      return remaining transfer units.  The device may
+ *                      leave any number of units for the caller to do one
+ *                      by one.
+ * @param   cb          Size of the transfer unit (1, 2 or 4 bytes).
+ * @remarks Caller enters the device critical section.
+ * @remarks Nothing may be transferred when deferring to ring-3.
+ */
+typedef DECLCALLBACK(int) FNIOMIOPORTOUTSTRBUF(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void const *pvSrc, uint32_t *pcTransfers, unsigned cb);
+/** Pointer to a FNIOMIOPORTOUTSTRBUF(). */
+typedef FNIOMIOPORTOUTSTRBUF *PFNIOMIOPORTOUTSTRBUF;
+
 
 /**
  * Memory mapped I/O Handler for read operations.
@@ -274,6 +320,10 @@ VMMDECL(VBOXSTRICTRC)   IOMInterpretOUT(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pReg
 VMMDECL(VBOXSTRICTRC)   IOMInterpretIN(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pRegFrame, PDISCPUSTATE pCpu);
 VMMDECL(VBOXSTRICTRC)   IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, PRTGCPTR pGCPtrDst, PRTGCUINTREG pcTransfers, unsigned cb);
 VMMDECL(VBOXSTRICTRC)   IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, PRTGCPTR pGCPtrSrc, PRTGCUINTREG pcTransfers, unsigned cb);
+#ifndef IN_RC
+VMMDECL(VBOXSTRICTRC)   IOMIOPortReadStringBuf(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, void *pvDst, uint32_t *pcTransfers, unsigned cb);
+VMMDECL(VBOXSTRICTRC)   IOMIOPortWriteStringBuf(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, void const *pvSrc, uint32_t *pcTransfers, unsigned cb);
+#endif
 VMMDECL(VBOXSTRICTRC)   IOMInterpretINS(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pRegFrame, PDISCPUSTATE pCpu);
 VMMDECL(VBOXSTRICTRC)   IOMInterpretINSEx(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pRegFrame, uint32_t uPort, uint32_t uPrefix, DISCPUMODE enmAddrMode, uint32_t cbTransfer);
 VMMDECL(VBOXSTRICTRC)   IOMInterpretOUTS(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pRegFrame, PDISCPUSTATE pCpu);
@@ -319,6 +369,12 @@ VMMR3_INT_DECL(int)  IOMR3IOPortRegisterR0(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                                            R0PTRTYPE(PFNIOMIOPORTOUT) pfnOutCallback, R0PTRTYPE(PFNIOMIOPORTIN) pfnInCallback,
                                            R0PTRTYPE(PFNIOMIOPORTOUTSTRING) pfnOutStrCallback, R0PTRTYPE(PFNIOMIOPORTINSTRING) pfnInStrCallback,
                                            const char *pszDesc);
+VMMR3_INT_DECL(int)  IOMR3IOPortRegisterStrBufR3(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT PortStart, RTUINT cPorts,
+                                                 R3PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnOutStrBufCallback,
+                                                 R3PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnInStrBufCallback);
+VMMR3_INT_DECL(int)  IOMR3IOPortRegisterStrBufR0(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT PortStart, RTUINT cPorts,
+                                                 R0PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnOutStrBufCallback,
+                                                 R0PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnInStrBufCallback);
 VMMR3_INT_DECL(int)  IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT PortStart, RTUINT cPorts);
 
 VMMR3_INT_DECL(int)  IOMR3MmioRegisterR3(PVM pVM, PPDMDEVINS pDevIns, RTGCPHYS GCPhysStart, uint32_t cbRange, RTHCPTR pvUser,
@@ -335,6 +391,7 @@ VMMR3_INT_DECL(int)  IOMR3MmioRegisterRC(PVM pVM, PPDMDEVINS pDevIns, RTGCPHYS G
                                          RCPTRTYPE(PFNIOMMMIOREAD)  pfnReadCallback,
                                          RCPTRTYPE(PFNIOMMMIOFILL)  pfnFillCallback);
 VMMR3_INT_DECL(int)  IOMR3MmioDeregister(PVM pVM, PPDMDEVINS pDevIns, RTGCPHYS GCPhysStart, uint32_t cbRange);
+VMMR3_INT_DECL(int)  IOMR3QueryRangeDesc(PVM pVM, bool fMmio, RTGCPHYS uAddr, char *pszDesc, size_t cbDesc);
 
 /** @} */
 #endif /* IN_RING3 */
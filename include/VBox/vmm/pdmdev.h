@@ -3458,11 +3458,50 @@ typedef struct PDMDEVHLPR3
      */
     DECLR3CALLBACKMEMBER(VMRESUMEREASON, pfnVMGetResumeReason,(PPDMDEVINS pDevIns));
 
+    /**
+     * Adds buffered string I/O callbacks to I/O ports registered with
+     * pfnIOPortRegister.
+     *
+     * The buffered callbacks are used for REP INS/OUTS when the caller has the
+     * guest memory mapped already, moving a whole page worth of transfer units
+     * in a single call.  The ports must be covered by ranges previously
+     * registered by the device that lie entirely within the given range.
+     *
+     * @returns VBox status.
+     * @param   pDevIns             The device instance owning the ports.
+     * @param   Port                First port number in the range.
+     * @param   cPorts              Number of ports.
+     * @param   pfnOutStrBuf        Pointer to function which is gonna handle
+     *                              buffered string OUT operations.  Optional.
+     * @param   pfnInStrBuf         Pointer to function which is gonna handle
+     *                              buffered string IN operations.  Optional.
+     * @remarks Caller enters the device critical section prior to invoking the
+     *          registered callback methods.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnIOPortRegisterStrBuf,(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts,
+                                                       PFNIOMIOPORTOUTSTRBUF pfnOutStrBuf, PFNIOMIOPORTINSTRBUF pfnInStrBuf));
+
+    /**
+     * Adds ring-0 buffered string I/O callbacks to I/O ports registered with
+     * pfnIOPortRegisterR0.
+     *
+     * @returns VBox status.
+     * @param   pDevIns             The device instance owning the ports.
+     * @param   Port                First port number in the range.
+     * @param   cPorts              Number of ports.
+     * @param   pszOutStrBuf        Name of the R0 function which is gonna handle
+     *                              buffered string OUT operations.  Optional.
+     * @param   pszInStrBuf         Name of the R0 function which is gonna handle
+     *                              buffered string IN operations.  Optional.
+     * @remarks Caller enters the device critical section prior to invoking the
+     *          registered callback methods.
+     */
+    DECLR3CALLBACKMEMBER(int, pfnIOPortRegisterStrBufR0,(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts,
+                                                         const char *pszOutStrBuf, const char *pszInStrBuf));
+
 
     /** Space reserved for future members.
      * @{ */
-    DECLR3CALLBACKMEMBER(void, pfnReserved1,(void));
-    DECLR3CALLBACKMEMBER(void, pfnReserved2,(void));
     DECLR3CALLBACKMEMBER(void, pfnReserved3,(void));
     DECLR3CALLBACKMEMBER(void, pfnReserved4,(void));
     DECLR3CALLBACKMEMBER(void, pfnReserved5,(void));
@@ -3645,7 +3684,7 @@ typedef R3PTRTYPE(struct PDMDEVHLPR3 *) PPDMDEVHLPR3;
 typedef R3PTRTYPE(const struct PDMDEVHLPR3 *) PCPDMDEVHLPR3;
 
 /** Current PDMDEVHLPR3 version number. */
-#define PDM_DEVHLPR3_VERSION                    PDM_VERSION_MAKE(0xffe7, 12, 1)
+#define PDM_DEVHLPR3_VERSION                    PDM_VERSION_MAKE(0xffe7, 12, 2)
 
 
 /**
@@ -4324,6 +4363,24 @@ DECLINLINE(int) PDMDevHlpIOPortRegisterR0(PPDMDEVINS pDevIns, RTIOPORT Port, RTI
     return pDevIns->pHlpR3->pfnIOPortRegisterR0(pDevIns, Port, cPorts, pvUser, pszOut, pszIn, pszOutStr, pszInStr, pszDesc);
 }
 
+/**
+ * @copydoc PDMDEVHLPR3::pfnIOPortRegisterStrBuf
+ */
+DECLINLINE(int) PDMDevHlpIOPortRegisterStrBuf(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts,
+                                              PFNIOMIOPORTOUTSTRBUF pfnOutStrBuf, PFNIOMIOPORTINSTRBUF pfnInStrBuf)
+{
+    return pDevIns->pHlpR3->pfnIOPortRegisterStrBuf(pDevIns, Port, cPorts, pfnOutStrBuf, pfnInStrBuf);
+}
+
+/**
+ * @copydoc PDMDEVHLPR3::pfnIOPortRegisterStrBufR0
+ */
+DECLINLINE(int) PDMDevHlpIOPortRegisterStrBufR0(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts,
+                                                const char *pszOutStrBuf, const char *pszInStrBuf)
+{
+    return pDevIns->pHlpR3->pfnIOPortRegisterStrBufR0(pDevIns, Port, cPorts, pszOutStrBuf, pszInStrBuf);
+}
+
 /**
  * @copydoc PDMDEVHLPR3::pfnIOPortDeregister
  */
@@ -756,6 +756,28 @@ typedef struct PDMDRVHLPR0
 
 #ifdef IN_RING3
 
+/**
+ * Construction work callback, see PDMDRVHLPR3::pfnConstructWorkQueue.
+ *
+ * @returns VBox status code.  A failure status will fail VM creation.
+ * @param   pDrvIns         The driver instance.
+ * @param   pvUser          User argument given when queueing the work.
+ * @thread  Any.  This is typically a PDM worker thread and not an EMT, so
+ *          helpers restricted to EMT must not be called.
+ */
+typedef DECLCALLBACK(int) FNPDMDRVCONSTRUCTWORK(PPDMDRVINS pDrvIns, void *pvUser);
+/** Pointer to a FNPDMDRVCONSTRUCTWORK() function. */
+typedef FNPDMDRVCONSTRUCTWORK *PFNPDMDRVCONSTRUCTWORK;
+
+/** @name PDMDRVHLPR3::pfnConstructWorkQueue flags.
+ * @{ */
+/** Only queue the work if it can be executed in parallel, i.e. don't execute
+ * it synchronously.  For work which is merely an optimization. */
+#define PDM_CONSTRUCT_WORK_F_PARALLEL_ONLY      RT_BIT_32(0)
+/** Valid flags. */
+#define PDM_CONSTRUCT_WORK_F_VALID_MASK         UINT32_C(0x00000001)
+/** @} */
+
 /**
  * PDM Driver API.
  */
@@ -1315,10 +1337,43 @@ typedef struct PDMDRVHLPR3
      */
     DECLR3CALLBACKMEMBER(VMRESUMEREASON, pfnVMGetResumeReason,(PPDMDRVINS pDrvIns));
 
+    /**
+     * Queues construction work which doesn't depend on the EMT or on other
+     * devices and drivers.
+     *
+     * When parallel construction is enabled (PDM/ParallelConstruct), the work is
+     * executed on a PDM worker pool while the construction of the other devices
+     * and drivers continues on EMT(0).  Otherwise it is executed synchronously
+     * before this call returns.  All queued work has completed before any
+     * PDMDEVREG::pfnInitComplete callback is invoked, and before the driver is
+     * destroyed.
+     *
+     * @returns VBox status code.  When executed synchronously, this is the status
+     *          of the work callback.
+     * @retval  VERR_NOT_AVAILABLE if PDM_CONSTRUCT_WORK_F_PARALLEL_ONLY was
+     *          specified and the work cannot be executed in parallel.  The
+     *          callback is not called.
+     * @param   pDrvIns             The driver instance.
+     * @param   pfnWork             The work callback.
+     * @param   pvUser              User argument for the callback.  Must stay
+     *                              valid until the work has completed.
+     * @param   fFlags              PDM_CONSTRUCT_WORK_F_XXX.
+     * @thread  EMT(0)
+     */
+    DECLR3CALLBACKMEMBER(int, pfnConstructWorkQueue,(PPDMDRVINS pDrvIns, PFNPDMDRVCONSTRUCTWORK pfnWork, void *pvUser,
+                                                     uint32_t fFlags));
+
+    /**
+     * Waits for all construction work queued by this driver instance.
+     *
+     * @returns VBox status code, the first failure status of the work callbacks.
+     * @param   pDrvIns             The driver instance.
+     * @thread  EMT(0)
+     */
+    DECLR3CALLBACKMEMBER(int, pfnConstructWorkWait,(PPDMDRVINS pDrvIns));
+
     /** @name Space reserved for minor interface changes.
      * @{ */
-    DECLR3CALLBACKMEMBER(void, pfnReserved0,(PPDMDRVINS pDrvIns));
-    DECLR3CALLBACKMEMBER(void, pfnReserved1,(PPDMDRVINS pDrvIns));
     DECLR3CALLBACKMEMBER(void, pfnReserved2,(PPDMDRVINS pDrvIns));
     DECLR3CALLBACKMEMBER(void, pfnReserved3,(PPDMDRVINS pDrvIns));
     DECLR3CALLBACKMEMBER(void, pfnReserved4,(PPDMDRVINS pDrvIns));
@@ -1333,7 +1388,7 @@ typedef struct PDMDRVHLPR3
     uint32_t                        u32TheEnd;
 } PDMDRVHLPR3;
 /** Current DRVHLP version number. */
-#define PDM_DRVHLPR3_VERSION                    PDM_VERSION_MAKE(0xf0fb, 3, 0)
+#define PDM_DRVHLPR3_VERSION                    PDM_VERSION_MAKE(0xf0fb, 3, 1)
 
 #endif /* IN_RING3 */
 
@@ -1824,6 +1879,22 @@ DECLINLINE(VMRESUMEREASON) PDMDrvHlpVMGetResumeReason(PPDMDRVINS pDrvIns)
     return pDrvIns->pHlpR3->pfnVMGetResumeReason(pDrvIns);
 }
 
+/**
+ * @copydoc PDMDRVHLP::pfnConstructWorkQueue
+ */
+DECLINLINE(int) PDMDrvHlpConstructWorkQueue(PPDMDRVINS pDrvIns, PFNPDMDRVCONSTRUCTWORK pfnWork, void *pvUser, uint32_t fFlags)
+{
+    return pDrvIns->pHlpR3->pfnConstructWorkQueue(pDrvIns, pfnWork, pvUser, fFlags);
+}
+
+/**
+ * @copydoc PDMDRVHLP::pfnConstructWorkWait
+ */
+DECLINLINE(int) PDMDrvHlpConstructWorkWait(PPDMDRVINS pDrvIns)
+{
+    return pDrvIns->pHlpR3->pfnConstructWorkWait(pDrvIns);
+}
+
 
 /** Pointer to callbacks provided to the VBoxDriverRegister() call. */
 typedef struct PDMDRVREGCB *PPDMDRVREGCB;
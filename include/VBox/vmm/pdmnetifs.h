@@ -164,9 +164,25 @@ typedef struct PDMINETWORKDOWN
      */
     DECLR3CALLBACKMEMBER(void, pfnXmitPending,(PPDMINETWORKDOWN pInterface));
 
+    /**
+     * Gets the GSO types pfnReceiveGso currently takes.
+     *
+     * This usually depends on what the guest driver negotiated and may thus
+     * change at runtime.  Drivers below use it to find out whether building
+     * large frames for pfnReceiveGso is worth it before doing the work.
+     *
+     * Optional, NULL if there is no pfnReceiveGso or it never takes GSO frames.
+     *
+     * @returns The GSO capability bit mask.  The bits corresponds to the GSO type
+     *          with the same value.
+     * @param   pInterface      Pointer to this interface.
+     * @thread  Non-EMT.
+     */
+    DECLR3CALLBACKMEMBER(uint32_t, pfnGetRecvGsoCapabilities,(PPDMINETWORKDOWN pInterface));
+
 } PDMINETWORKDOWN;
 /** PDMINETWORKDOWN interface ID. */
-#define PDMINETWORKDOWN_IID                     "52b8cdbb-a087-493b-baa7-81ec3b803e06"
+#define PDMINETWORKDOWN_IID                     "a2c5a2d4-9b1e-4e6d-9a3f-3f0c7f2b6d41"
 
 
 /**
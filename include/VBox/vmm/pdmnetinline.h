@@ -640,6 +640,267 @@ DECLINLINE(void) PDMNetGsoPrepForDirectUse(PCPDMNETWORKGSO pGso, void *pvFrame,
 }
 
 
+/** @name Receive side coalescing (GRO)
+ *
+ * Helpers for merging consecutive in-order TCP segments of a flow into one
+ * GSO frame before passing them up to a device that can hand large frames to
+ * the guest, e.g. virtio-net with VNET_F_GUEST_TSO4/6.  This saves the guest
+ * most of the descriptors and interrupts of a bulk inbound transfer.
+ * @{ */
+
+/** The max size of a coalesced frame: ethernet header + 64KB IP packet. */
+#define PDMNETGRO_MAX_FRAME     (sizeof(RTNETETHERHDR) + UINT16_MAX)
+
+/**
+ * Receive coalescing state.
+ */
+typedef struct PDMNETGRO
+{
+    /** The GSO context describing the frame being built.  cbMaxSeg is the
+     * payload size of the first segment. */
+    PDMNETWORKGSO   Gso;
+    /** Number of segments in the frame, 0 if empty. */
+    uint32_t        cSegs;
+    /** The size of the frame in abFrame. */
+    uint32_t        cbFrame;
+    /** The TCP sequence number the next segment must start with (host endian). */
+    uint32_t        uNextSeq;
+    /** Set when the frame cannot grow any further. */
+    bool            fClosed;
+    /** The frame being built. */
+    uint8_t         abFrame[PDMNETGRO_MAX_FRAME];
+} PDMNETGRO;
+/** Pointer to receive coalescing state. */
+typedef PDMNETGRO *PPDMNETGRO;
+
+
+/**
+ * Checks whether a frame is a TCP segment that may be coalesced.
+ *
+ * Only TCP over IPv4 without options or fragmentation and over IPv6 without
+ * extension headers qualifies, and only segments carrying payload with no
+ * flags but ACK and PSH.  The checksums must be correct as the guest will not
+ * verify them again once the frame has been passed up with a partial one.
+ *
+ * @returns true if eligible, false if not.
+ * @param   pbFrame             The frame.
+ * @param   cbFrame             The frame size.
+ * @param   pGso                Where to return the GSO context describing the
+ *                              segment.  cbMaxSeg is set to the payload size.
+ * @internal
+ */
+DECLINLINE(bool) pdmNetGroParseSegment(uint8_t const *pbFrame, size_t cbFrame, PPDMNETWORKGSO pGso)
+{
+    PCRTNETETHERHDR pEthHdr = (PCRTNETETHERHDR)pbFrame;
+    PCRTNETTCP      pTcpHdr;
+    uint32_t        u32PseudoSum;
+    uint32_t        cbIpPayload;
+    uint32_t        cbTcpHdr;
+
+    if (RT_UNLIKELY(cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN))
+        return false;
+
+    pGso->offHdr1 = sizeof(RTNETETHERHDR);
+    if (pEthHdr->EtherType == RT_H2N_U16_C(RTNET_ETHERTYPE_IPV4))
+    {
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pEthHdr + 1);
+        if (   pIpHdr->ip_v  != 4
+            || pIpHdr->ip_hl != RTNETIPV4_MIN_LEN / 4
+            || pIpHdr->ip_p  != RTNETIPV4_PROT_TCP
+            || (RT_N2H_U16(pIpHdr->ip_off) & ~RTNETIPV4_FLAGS_DF)
+            || RT_N2H_U16(pIpHdr->ip_len) < RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN
+            || RT_N2H_U16(pIpHdr->ip_len) > cbFrame - sizeof(RTNETETHERHDR)
+            || RTNetIPv4HdrChecksum(pIpHdr) != pIpHdr->ip_sum)
+            return false;
+        cbIpPayload   = RT_N2H_U16(pIpHdr->ip_len) - RTNETIPV4_MIN_LEN;
+        u32PseudoSum  = RTNetIPv4PseudoChecksum(pIpHdr);
+        pGso->u8Type  = PDMNETWORKGSOTYPE_IPV4_TCP;
+        pGso->offHdr2 = sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN;
+    }
+    else if (pEthHdr->EtherType == RT_H2N_U16_C(RTNET_ETHERTYPE_IPV6))
+    {
+        PCRTNETIPV6 pIpHdr = (PCRTNETIPV6)(pEthHdr + 1);
+        if (   cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV6_MIN_LEN + RTNETTCP_MIN_LEN
+            || (pbFrame[sizeof(RTNETETHERHDR)] >> 4) != 6
+            || pIpHdr->ip6_nxt != RTNETIPV4_PROT_TCP
+            || RT_N2H_U16(pIpHdr->ip6_plen) < RTNETTCP_MIN_LEN
+            || RT_N2H_U16(pIpHdr->ip6_plen) > cbFrame - sizeof(RTNETETHERHDR) - RTNETIPV6_MIN_LEN)
+            return false;
+        cbIpPayload   = RT_N2H_U16(pIpHdr->ip6_plen);
+        u32PseudoSum  = RTNetIPv6PseudoChecksum(pIpHdr);
+        pGso->u8Type  = PDMNETWORKGSOTYPE_IPV6_TCP;
+        pGso->offHdr2 = sizeof(RTNETETHERHDR) + RTNETIPV6_MIN_LEN;
+    }
+    else
+        return false;
+
+    pTcpHdr  = (PCRTNETTCP)&pbFrame[pGso->offHdr2];
+    cbTcpHdr = pTcpHdr->th_off * 4;
+    if (   cbTcpHdr < RTNETTCP_MIN_LEN
+        || cbTcpHdr >= cbIpPayload
+        || (pTcpHdr->th_flags & ~RTNETTCP_F_PSH) != RTNETTCP_F_ACK
+        || RTNetTCPChecksum(u32PseudoSum, pTcpHdr, (uint8_t const *)pTcpHdr + cbTcpHdr, cbIpPayload - cbTcpHdr)
+           != pTcpHdr->th_sum)
+        return false;
+
+    pGso->cbHdrsTotal = (uint8_t)(pGso->offHdr2 + cbTcpHdr);
+    pGso->cbHdrsSeg   = pGso->cbHdrsTotal;
+    pGso->cbMaxSeg    = (uint16_t)(cbIpPayload - cbTcpHdr);
+    pGso->u8Unused    = 0;
+    return true;
+}
+
+
+/**
+ * Resets the coalescing state, discarding any frame being built.
+ *
+ * @param   pGro                The coalescing state.
+ */
+DECLINLINE(void) PDMNetGroReset(PPDMNETGRO pGro)
+{
+    pGro->cSegs   = 0;
+    pGro->cbFrame = 0;
+    pGro->fClosed = false;
+}
+
+
+/**
+ * Starts a new coalesced frame with the given segment.
+ *
+ * @returns true if the segment was taken, false if it cannot be coalesced and
+ *          should be passed on as it is.
+ * @param   pGro                The coalescing state, must be empty.
+ * @param   pvFrame             The frame.
+ * @param   cbFrame             The frame size.
+ */
+DECLINLINE(bool) PDMNetGroStart(PPDMNETGRO pGro, const void *pvFrame, size_t cbFrame)
+{
+    uint8_t const *pbFrame = (uint8_t const *)pvFrame;
+    PCRTNETTCP     pTcpHdr;
+
+    Assert(!pGro->cSegs);
+    if (!pdmNetGroParseSegment(pbFrame, cbFrame, &pGro->Gso))
+        return false;
+
+    /* A pushed segment would have to go up on its own right away anyway. */
+    pTcpHdr = (PCRTNETTCP)&pbFrame[pGro->Gso.offHdr2];
+    if (pTcpHdr->th_flags & RTNETTCP_F_PSH)
+        return false;
+
+    pGro->cbFrame  = pGro->Gso.cbHdrsTotal + pGro->Gso.cbMaxSeg; /* drops ethernet padding */
+    pGro->cSegs    = 1;
+    pGro->uNextSeq = RT_N2H_U32(pTcpHdr->th_seq) + pGro->Gso.cbMaxSeg;
+    pGro->fClosed  = false;
+    memcpy(pGro->abFrame, pbFrame, pGro->cbFrame);
+    return true;
+}
+
+
+/**
+ * Tries to append a segment to the frame being coalesced.
+ *
+ * The segment must continue the flow in sequence, have the same headers apart
+ * from lengths, IPv4 ID, TCP window and checksums, and must not be larger than
+ * the first segment.  A shorter segment or one with PSH set closes the frame.
+ *
+ * @returns true if the segment was appended, false if the caller should pass
+ *          up the current frame and then try PDMNetGroStart with the segment.
+ * @param   pGro                The coalescing state.
+ * @param   pvFrame             The frame.
+ * @param   cbFrame             The frame size.
+ */
+DECLINLINE(bool) PDMNetGroAppend(PPDMNETGRO pGro, const void *pvFrame, size_t cbFrame)
+{
+    uint8_t const *pbFrame = (uint8_t const *)pvFrame;
+    PDMNETWORKGSO  Gso;
+    PCRTNETTCP     pTcpHdr;
+    PRTNETTCP      pGroTcpHdr;
+
+    if (!pGro->cSegs || pGro->fClosed)
+        return false;
+    if (!pdmNetGroParseSegment(pbFrame, cbFrame, &Gso))
+        return false;
+    if (   Gso.u8Type      != pGro->Gso.u8Type
+        || Gso.cbHdrsTotal != pGro->Gso.cbHdrsTotal
+        || Gso.cbMaxSeg    >  pGro->Gso.cbMaxSeg
+        || pGro->cbFrame + Gso.cbMaxSeg > PDMNETGRO_MAX_FRAME
+        || memcmp(pbFrame, pGro->abFrame, sizeof(RTNETETHERHDR)))
+        return false;
+
+    if (Gso.u8Type == PDMNETWORKGSOTYPE_IPV4_TCP)
+    {
+        PCRTNETIPV4 pIpHdr    = (PCRTNETIPV4)&pbFrame[Gso.offHdr1];
+        PCRTNETIPV4 pGroIpHdr = (PCRTNETIPV4)&pGro->abFrame[Gso.offHdr1];
+        if (   pIpHdr->ip_tos   != pGroIpHdr->ip_tos
+            || pIpHdr->ip_off   != pGroIpHdr->ip_off
+            || pIpHdr->ip_ttl   != pGroIpHdr->ip_ttl
+            || pIpHdr->ip_src.u != pGroIpHdr->ip_src.u
+            || pIpHdr->ip_dst.u != pGroIpHdr->ip_dst.u)
+            return false;
+    }
+    else
+    {
+        PCRTNETIPV6 pIpHdr    = (PCRTNETIPV6)&pbFrame[Gso.offHdr1];
+        PCRTNETIPV6 pGroIpHdr = (PCRTNETIPV6)&pGro->abFrame[Gso.offHdr1];
+        if (   pIpHdr->ip6_vfc  != pGroIpHdr->ip6_vfc
+            || pIpHdr->ip6_hlim != pGroIpHdr->ip6_hlim
+            || memcmp(&pIpHdr->ip6_src, &pGroIpHdr->ip6_src, sizeof(pIpHdr->ip6_src) + sizeof(pIpHdr->ip6_dst)))
+            return false;
+    }
+
+    pTcpHdr    = (PCRTNETTCP)&pbFrame[Gso.offHdr2];
+    pGroTcpHdr = (PRTNETTCP)&pGro->abFrame[Gso.offHdr2];
+    if (   pTcpHdr->th_sport != pGroTcpHdr->th_sport
+        || pTcpHdr->th_dport != pGroTcpHdr->th_dport
+        || pTcpHdr->th_ack   != pGroTcpHdr->th_ack
+        || RT_N2H_U32(pTcpHdr->th_seq) != pGro->uNextSeq
+        || memcmp(pTcpHdr + 1, pGroTcpHdr + 1, Gso.cbHdrsTotal - Gso.offHdr2 - RTNETTCP_MIN_LEN) /* options */)
+        return false;
+
+    /*
+     * Append the payload, taking over the latest window and PSH.
+     */
+    memcpy(&pGro->abFrame[pGro->cbFrame], &pbFrame[Gso.cbHdrsTotal], Gso.cbMaxSeg);
+    pGro->cbFrame  += Gso.cbMaxSeg;
+    pGro->uNextSeq += Gso.cbMaxSeg;
+    pGro->cSegs++;
+    pGroTcpHdr->th_win = pTcpHdr->th_win;
+    if (   Gso.cbMaxSeg < pGro->Gso.cbMaxSeg
+        || (pTcpHdr->th_flags & RTNETTCP_F_PSH)
+        || pGro->cbFrame + pGro->Gso.cbMaxSeg > PDMNETGRO_MAX_FRAME)
+    {
+        pGroTcpHdr->th_flags |= pTcpHdr->th_flags & RTNETTCP_F_PSH;
+        pGro->fClosed = true;
+    }
+    return true;
+}
+
+
+/**
+ * Finalizes the frame being coalesced so it can be passed up.
+ *
+ * A frame made of several segments gets its IP length and checksum updated
+ * and the TCP checksum set to the pseudo header one, ready for
+ * PDMINETWORKDOWN::pfnReceiveGso.  Use PDMNetGsoCarveSegmentQD on it if the
+ * device above refuses it.  Call PDMNetGroReset once done with the frame.
+ *
+ * @returns The GSO context if more than one segment was coalesced, NULL if
+ *          abFrame holds a single unmodified segment to be passed up as a
+ *          normal frame.
+ * @param   pGro                The coalescing state, must not be empty.
+ */
+DECLINLINE(PCPDMNETWORKGSO) PDMNetGroFinish(PPDMNETGRO pGro)
+{
+    Assert(pGro->cSegs);
+    if (pGro->cSegs < 2)
+        return NULL;
+    PDMNetGsoPrepForDirectUse(&pGro->Gso, pGro->abFrame, pGro->cbFrame, PDMNETCSUMTYPE_PSEUDO);
+    return &pGro->Gso;
+}
+
+/** @} */
+
+
 /**
  * Gets the GSO type name string.
  *
@@ -29,6 +29,7 @@
 #include <VBox/types.h>
 #include <VBox/err.h>
 #include <VBox/vmm/pdmnetifs.h>
+#include <VBox/vmm/stam.h>
 #include <iprt/assert.h>
 #include <iprt/sg.h>
 
@@ -58,6 +59,18 @@ typedef struct PDMNSFILTER
     bool                                afPadding[HC_ARCH_BITS == 32 ? 3 : 7];
     /** The driver this filter is aggregated into (ring-3). */
     R3PTRTYPE(PPDMINETWORKDOWN)         pIDrvNetR3;
+    /** Deficit round robin: number of bytes the filter may transmit while the
+     * bandwidth group is contended. */
+    uint32_t                            cbDeficit;
+    /** Aligment padding. */
+    uint32_t                            au32Padding[HC_ARCH_BITS == 32 ? 2 : 1];
+    /** Timestamp of the first denial since bandwidth was last granted, 0 if
+     * the filter is not waiting. */
+    uint64_t                            tsChoked;
+    /** Number of times bandwidth was denied to give other filters their share. */
+    STAMCOUNTER                         StatDeniedFairness;
+    /** Time spent waiting for bandwidth (ns). */
+    STAMPROFILE                         StatDelay;
 } PDMNSFILTER;
 
 /** Pointer to a PDM filter handle. */
@@ -67,8 +80,8 @@ typedef struct PDMNETSHAPER *PPDMNETSHAPER;
 
 
 VMMDECL(bool)       PDMNsAllocateBandwidth(PPDMNSFILTER pFilter, size_t cbTransfer);
-VMMR3_INT_DECL(int) PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *pcszBwGroup, PPDMNSFILTER pFilter);
-VMMR3_INT_DECL(int) PDMR3NsDetach(PUVM pUVM, PPDMDRVINS pDrvIns, PPDMNSFILTER pFilter);
+VMMR3DECL(int)      PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *pcszBwGroup, PPDMNSFILTER pFilter);
+VMMR3DECL(int)      PDMR3NsDetach(PUVM pUVM, PPDMDRVINS pDrvIns, PPDMNSFILTER pFilter);
 VMMR3DECL(int)      PDMR3NsBwGroupSetLimit(PUVM pUVM, const char *pszBwGroup, uint64_t cbPerSecMax);
 
 /** @} */
@@ -432,6 +432,7 @@ VMMR0_INT_DECL(int) PGMR0PhysFlushHandyPages(PVM pVM, PVMCPU pVCpu);
 VMMR0_INT_DECL(int) PGMR0PhysAllocateLargeHandyPage(PVM pVM, PVMCPU pVCpu);
 VMMR0_INT_DECL(int) PGMR0PhysSetupIommu(PVM pVM);
 VMMR0DECL(int)      PGMR0SharedModuleCheck(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMSHAREDMODULE pModule, PCRTGCPTR64 paRegionsGCPtrs);
+VMMR0DECL(int)      PGMR0DedupScan(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMDEDUPSCANREQ pReq);
 VMMR0DECL(int)      PGMR0Trap0eHandlerNestedPaging(PVM pVM, PVMCPU pVCpu, PGMMODE enmShwPagingMode, RTGCUINT uErr, PCPUMCTXCORE pRegFrame, RTGCPHYS pvFault);
 VMMR0DECL(VBOXSTRICTRC) PGMR0Trap0eHandlerNPMisconfig(PVM pVM, PVMCPU pVCpu, PGMMODE enmShwPagingMode, PCPUMCTXCORE pRegFrame, RTGCPHYS GCPhysFault, uint32_t uErr);
 # ifdef VBOX_WITH_2X_4GB_ADDR_SPACE
@@ -581,6 +582,40 @@ VMMR3DECL(int)     PGMR3SharedModuleCheckAll(PVM pVM);
 VMMR3DECL(int)     PGMR3SharedModuleGetPageState(PVM pVM, RTGCPTR GCPtrPage, bool *pfShared, uint64_t *pfPageFlags);
 /** @} */
 
+/** @name Post-copy teleportation
+ * @{ */
+/** The shift count of the post-copy transfer unit (2 MB). */
+#define PGM_POSTCOPY_CHUNK_SHIFT        21
+/** The size of the post-copy transfer unit. */
+#define PGM_POSTCOPY_CHUNK_SIZE         RT_BIT_32(PGM_POSTCOPY_CHUNK_SHIFT)
+/** The number of pages in a post-copy transfer unit. */
+#define PGM_POSTCOPY_CHUNK_PAGES        (PGM_POSTCOPY_CHUNK_SIZE >> PAGE_SHIFT)
+
+/**
+ * Callback for requesting a post-copy chunk from the source ahead of the
+ * others (demand fetch).
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhysChunk     The chunk address.
+ * @param   pvUser          User argument.
+ * @remarks Calls are serialized, but may come from any thread.
+ */
+typedef DECLCALLBACK(int) FNPGMPOSTCOPYFETCH(PUVM pUVM, RTGCPHYS GCPhysChunk, void *pvUser);
+/** Pointer to a FNPGMPOSTCOPYFETCH() function. */
+typedef FNPGMPOSTCOPYFETCH *PFNPGMPOSTCOPYFETCH;
+
+VMMR3DECL(int)      PGMR3PostCopyEnable(PUVM pUVM, uint32_t cPrePasses);
+VMMR3DECL(int)      PGMR3PostCopyAccept(PUVM pUVM);
+VMMR3DECL(int)      PGMR3PostCopyEnd(PUVM pUVM, int rcStatus);
+VMMR3DECL(uint32_t) PGMR3PostCopyPendingChunks(PUVM pUVM);
+VMMR3DECL(int)      PGMR3PostCopyNextChunk(PUVM pUVM, PRTGCPHYS pGCPhysChunk);
+VMMR3DECL(int)      PGMR3PostCopyReadChunk(PUVM pUVM, RTGCPHYS GCPhysChunk, uint64_t *pbmPages, void *pvPages, uint32_t *pcPages);
+VMMR3DECL(int)      PGMR3PostCopySetFetcher(PUVM pUVM, PFNPGMPOSTCOPYFETCH pfnFetch, void *pvUser);
+VMMR3DECL(int)      PGMR3PostCopyDeliverChunk(PUVM pUVM, RTGCPHYS GCPhysChunk, uint64_t const *pbmPages,
+                                              void const *pvPages, uint32_t cPages);
+/** @} */
+
 /** @} */
 #endif /* IN_RING3 */
 
@@ -28,6 +28,7 @@
 
 #include <VBox/types.h>
 #include <iprt/stdarg.h>
+#include <iprt/asm.h>
 #ifdef _MSC_VER
 # if _MSC_VER >= 1400
 #  include <intrin.h>
@@ -156,6 +157,8 @@ typedef enum STAMTYPE
     STAMTYPE_BOOL,
     /** Generic boolean value. Reset to false. */
     STAMTYPE_BOOL_RESET,
+    /** Log-linear histogram (STAMHISTOGRAM). Reset to empty. */
+    STAMTYPE_HISTOGRAM,
     /** The end (exclusive). */
     STAMTYPE_END
 } STAMTYPE;
@@ -1094,6 +1097,176 @@ typedef STAMRATIOU32 *PSTAMRATIOU32;
 typedef const STAMRATIOU32 *PCSTAMRATIOU32;
 
 
+/** The number of linear sub-buckets per power of two in a STAMHISTOGRAM. */
+#define STAMHISTOGRAM_SUB_BUCKETS   4
+/** The number of buckets in a STAMHISTOGRAM, covering the full 64-bit range. */
+#define STAMHISTOGRAM_BUCKETS       256
+
+/**
+ * Log-linear histogram sample - STAMTYPE_HISTOGRAM.
+ *
+ * Values below STAMHISTOGRAM_SUB_BUCKETS get their own buckets, above that
+ * each power of two is split into STAMHISTOGRAM_SUB_BUCKETS equally sized
+ * buckets, bounding the relative bucket width to 25%.  Recording is lock-free
+ * and can be done concurrently from all contexts.  Use STAMR3HistogramPercentile
+ * to get at the distribution.
+ */
+typedef struct STAMHISTOGRAM
+{
+    /** Number of recorded values. */
+    volatile uint64_t   cValues;
+    /** The sum of all recorded values. */
+    volatile uint64_t   uTotal;
+    /** The largest value recorded. */
+    volatile uint64_t   uMax;
+    /** The smallest value recorded. */
+    volatile uint64_t   uMin;
+    /** The value counts per bucket, see STAMHistogramValueToBucket. */
+    volatile uint32_t   acBuckets[STAMHISTOGRAM_BUCKETS];
+} STAMHISTOGRAM;
+/** Pointer to a histogram sample. */
+typedef STAMHISTOGRAM *PSTAMHISTOGRAM;
+/** Pointer to a const histogram sample. */
+typedef const STAMHISTOGRAM *PCSTAMHISTOGRAM;
+
+/**
+ * Calculates the STAMHISTOGRAM bucket index of a value.
+ *
+ * @returns Bucket index.
+ * @param   uValue      The value.
+ */
+DECLINLINE(unsigned) STAMHistogramValueToBucket(uint64_t uValue)
+{
+    if (uValue < STAMHISTOGRAM_SUB_BUCKETS)
+        return (unsigned)uValue;
+    unsigned const iBit = (uValue >> 32)
+                        ? ASMBitLastSetU32((uint32_t)(uValue >> 32)) + 31
+                        : ASMBitLastSetU32((uint32_t)uValue) - 1;
+    return (iBit - 1) * STAMHISTOGRAM_SUB_BUCKETS + (unsigned)((uValue >> (iBit - 2)) & (STAMHISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Empties a histogram sample.
+ *
+ * uMin starts out at UINT64_MAX so the first value recorded replaces it.
+ * Registering and resetting a sample does this, it's only needed for
+ * histograms that aren't registered with STAM.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ */
+DECLINLINE(void) STAMHistogramInit(PSTAMHISTOGRAM pHist)
+{
+    ASMAtomicWriteU64(&pHist->cValues, 0);
+    ASMAtomicWriteU64(&pHist->uTotal, 0);
+    ASMAtomicWriteU64(&pHist->uMax, 0);
+    ASMAtomicWriteU64(&pHist->uMin, UINT64_MAX);
+    for (unsigned i = 0; i < RT_ELEMENTS(pHist->acBuckets); i++)
+        ASMAtomicWriteU32(&pHist->acBuckets[i], 0);
+}
+
+/**
+ * Records a value in a histogram sample.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   uValue      The value to record.
+ */
+DECLINLINE(void) STAMHistogramAdd(PSTAMHISTOGRAM pHist, uint64_t uValue)
+{
+    ASMAtomicIncU32(&pHist->acBuckets[STAMHistogramValueToBucket(uValue)]);
+    ASMAtomicIncU64(&pHist->cValues);
+    ASMAtomicAddU64(&pHist->uTotal, uValue);
+    uint64_t uOld;
+    while (   (uOld = ASMAtomicUoReadU64(&pHist->uMax)) < uValue
+           && !ASMAtomicCmpXchgU64(&pHist->uMax, uValue, uOld))
+    { /* retry */ }
+    while (   (uOld = ASMAtomicUoReadU64(&pHist->uMin)) > uValue
+           && !ASMAtomicCmpXchgU64(&pHist->uMin, uValue, uOld))
+    { /* retry */ }
+}
+
+/** @def STAM_REL_HISTOGRAM_ADD
+ * Records a value in a histogram sample.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   uValue      The value to record.
+ */
+#ifndef VBOX_WITHOUT_RELEASE_STATISTICS
+# define STAM_REL_HISTOGRAM_ADD(pHist, uValue)  STAMHistogramAdd(pHist, uValue)
+#else
+# define STAM_REL_HISTOGRAM_ADD(pHist, uValue)  do { } while (0)
+#endif
+/** @def STAM_HISTOGRAM_ADD
+ * Records a value in a histogram sample.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   uValue      The value to record.
+ */
+#ifdef VBOX_WITH_STATISTICS
+# define STAM_HISTOGRAM_ADD(pHist, uValue)      STAM_REL_HISTOGRAM_ADD(pHist, uValue)
+#else
+# define STAM_HISTOGRAM_ADD(pHist, uValue)      do { } while (0)
+#endif
+
+/** @def STAM_REL_HISTOGRAM_START
+ * Samples the start time of a period to be recorded in a histogram.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   Prefix      Identifier prefix used to internal variables.
+ *
+ * @remarks Declears a stack variable that will be used by related macros.
+ */
+#ifndef VBOX_WITHOUT_RELEASE_STATISTICS
+# define STAM_REL_HISTOGRAM_START(pHist, Prefix) \
+    uint64_t Prefix##_tsStart; \
+    STAM_GET_TS(Prefix##_tsStart)
+#else
+# define STAM_REL_HISTOGRAM_START(pHist, Prefix) do { } while (0)
+#endif
+/** @def STAM_HISTOGRAM_START
+ * Samples the start time of a period to be recorded in a histogram.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   Prefix      Identifier prefix used to internal variables.
+ *
+ * @remarks Declears a stack variable that will be used by related macros.
+ */
+#ifdef VBOX_WITH_STATISTICS
+# define STAM_HISTOGRAM_START(pHist, Prefix) STAM_REL_HISTOGRAM_START(pHist, Prefix)
+#else
+# define STAM_HISTOGRAM_START(pHist, Prefix) do { } while (0)
+#endif
+
+/** @def STAM_REL_HISTOGRAM_STOP
+ * Samples the stop time of a period and records the number of ticks elapsed
+ * in the histogram.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   Prefix      Identifier prefix used to internal variables.
+ */
+#ifndef VBOX_WITHOUT_RELEASE_STATISTICS
+# define STAM_REL_HISTOGRAM_STOP(pHist, Prefix) \
+    do { \
+        uint64_t Prefix##_cTicks; \
+        STAM_GET_TS(Prefix##_cTicks); \
+        STAMHistogramAdd(pHist, Prefix##_cTicks - Prefix##_tsStart); \
+    } while (0)
+#else
+# define STAM_REL_HISTOGRAM_STOP(pHist, Prefix) do { } while (0)
+#endif
+/** @def STAM_HISTOGRAM_STOP
+ * Samples the stop time of a period and records the number of ticks elapsed
+ * in the histogram.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   Prefix      Identifier prefix used to internal variables.
+ */
+#ifdef VBOX_WITH_STATISTICS
+# define STAM_HISTOGRAM_STOP(pHist, Prefix) STAM_REL_HISTOGRAM_STOP(pHist, Prefix)
+#else
+# define STAM_HISTOGRAM_STOP(pHist, Prefix) do { } while (0)
+#endif
+
+
 
 
 /** @defgroup grp_stam_r3   The STAM Host Context Ring 3 API
@@ -1232,6 +1405,184 @@ typedef FNSTAMR3ENUM *PFNSTAMR3ENUM;
 
 VMMR3DECL(int)  STAMR3Enum(PUVM pUVM, const char *pszPat, PFNSTAMR3ENUM pfnEnum, void *pvUser);
 VMMR3DECL(const char *) STAMR3GetUnit(STAMUNIT enmUnit);
+VMMR3DECL(uint64_t) STAMR3HistogramPercentile(PCSTAMHISTOGRAM pHist, unsigned uPerMille);
+
+
+/** @defgroup grp_stam_delta    Binary Delta Snapshots
+ * @ingroup grp_stam
+ *
+ * A delta cursor produces compact binary packets containing only the samples
+ * that changed since the previous packet produced by the same cursor.  Each
+ * sample is identified by an index which stays the same for as long as the
+ * sample is registered and is never reused for another sample, so consumers
+ * only need the name and description once (STAMDELTAKIND_DEFINE).
+ *
+ * A packet consists of a STAMDELTAHDR followed by STAMDELTAHDR::cRecords
+ * records.  Each record starts with a STAMDELTAREC, is followed by
+ * STAMDELTAREC::cbData bytes of payload and is 8 byte aligned.  All fields
+ * are in host byte order.
+ *
+ * @{
+ */
+
+/** STAMDELTAHDR::u32Magic value ('STMD'). */
+#define STAMDELTA_MAGIC             UINT32_C(0x444d5453)
+/** STAMDELTAHDR::u16Version value. */
+#define STAMDELTA_VERSION           UINT16_C(1)
+
+/**
+ * Binary delta packet header.
+ */
+typedef struct STAMDELTAHDR
+{
+    /** Magic value (STAMDELTA_MAGIC). */
+    uint32_t        u32Magic;
+    /** The format version (STAMDELTA_VERSION). */
+    uint16_t        u16Version;
+    /** Reserved, MBZ. */
+    uint16_t        u16Reserved;
+    /** The size of the packet including this header. */
+    uint32_t        cbPacket;
+    /** The number of records following the header. */
+    uint32_t        cRecords;
+    /** The RTTimeNanoTS timestamp of when the values were sampled. */
+    uint64_t        u64NanoTS;
+} STAMDELTAHDR;
+/** Pointer to a binary delta packet header. */
+typedef STAMDELTAHDR *PSTAMDELTAHDR;
+/** Pointer to a const binary delta packet header. */
+typedef STAMDELTAHDR const *PCSTAMDELTAHDR;
+
+/**
+ * Binary delta record kinds.
+ */
+typedef enum STAMDELTAKIND
+{
+    /** Invalid. */
+    STAMDELTAKIND_INVALID = 0,
+    /** New sample definition, the payload is a STAMDELTADEF. */
+    STAMDELTAKIND_DEFINE,
+    /** New sample values, the payload is STAMDELTAREC::cValues uint64_t's. */
+    STAMDELTAKIND_VALUES,
+    /** The sample has been deregistered, no payload. */
+    STAMDELTAKIND_REMOVE,
+    /** The end of valid kinds. */
+    STAMDELTAKIND_END
+} STAMDELTAKIND;
+
+/**
+ * Binary delta record header.
+ */
+typedef struct STAMDELTAREC
+{
+    /** The sample index. */
+    uint32_t        iSample;
+    /** The record kind (STAMDELTAKIND). */
+    uint8_t         u8Kind;
+    /** The number of values for STAMDELTAKIND_VALUES. */
+    uint8_t         cValues;
+    /** The size of the payload following this header (multiple of 8). */
+    uint16_t        cbData;
+} STAMDELTAREC;
+/** Pointer to a binary delta record header. */
+typedef STAMDELTAREC *PSTAMDELTAREC;
+/** Pointer to a const binary delta record header. */
+typedef STAMDELTAREC const *PCSTAMDELTAREC;
+
+/**
+ * The payload of a STAMDELTAKIND_DEFINE record.
+ *
+ * It is followed by the zero terminated name and then the zero terminated
+ * description (empty if none).
+ *
+ * The values of the sample are encoded as follows, depending on the type:
+ *      - STAMTYPE_COUNTER, STAMTYPE_U*, STAMTYPE_X* and STAMTYPE_BOOL*: one
+ *        value.
+ *      - STAMTYPE_PROFILE and STAMTYPE_PROFILE_ADV: cPeriods, cTicks,
+ *        cTicksMax and cTicksMin.
+ *      - STAMTYPE_RATIO_U32*: u32A and u32B.
+ *      - STAMTYPE_HISTOGRAM: cValues and the 50th, 99th and 100th
+ *        percentiles (the latter being the max).
+ *      - STAMTYPE_CALLBACK: no values are ever sent.
+ */
+typedef struct STAMDELTADEF
+{
+    /** The sample type (STAMTYPE). */
+    uint8_t         u8Type;
+    /** The sample unit (STAMUNIT). */
+    uint8_t         u8Unit;
+    /** The length of the name, excluding the terminator. */
+    uint16_t        cchName;
+    /** The length of the description, excluding the terminator. */
+    uint16_t        cchDesc;
+    /** Reserved, MBZ. */
+    uint16_t        u16Reserved;
+} STAMDELTADEF;
+/** Pointer to the payload of a STAMDELTAKIND_DEFINE record. */
+typedef STAMDELTADEF *PSTAMDELTADEF;
+/** Pointer to the const payload of a STAMDELTAKIND_DEFINE record. */
+typedef STAMDELTADEF const *PCSTAMDELTADEF;
+
+/** The max number of values per sample in a STAMDELTAKIND_VALUES record. */
+#define STAMDELTA_MAX_VALUES        4
+
+/** Opaque delta cursor. */
+typedef struct STAMDELTA *PSTAMDELTA;
+
+VMMR3DECL(int)  STAMR3DeltaCreate(PUVM pUVM, const char *pszPat, PSTAMDELTA *ppDelta);
+VMMR3DECL(int)  STAMR3DeltaCollect(PSTAMDELTA pDelta, void const **ppvPacket, size_t *pcbPacket);
+VMMR3DECL(void) STAMR3DeltaDestroy(PSTAMDELTA pDelta);
+
+/**
+ * A sample as seen by a delta reader (STAMR3DeltaReaderApply).
+ */
+typedef struct STAMDELTASAMPLE
+{
+    /** The sample index. */
+    uint32_t        iSample;
+    /** The sample type. */
+    STAMTYPE        enmType;
+    /** The sample unit. */
+    STAMUNIT        enmUnit;
+    /** The number of valid entries in au64Values, 0 until values arrived. */
+    uint32_t        cValues;
+    /** The sample name. */
+    const char     *pszName;
+    /** The sample description, empty if none. */
+    const char     *pszDesc;
+    /** The timestamp of the packet which last changed the values. */
+    uint64_t        u64NanoTS;
+    /** The values, encoded as described at STAMDELTADEF. */
+    uint64_t        au64Values[STAMDELTA_MAX_VALUES];
+} STAMDELTASAMPLE;
+/** Pointer to a const delta reader sample. */
+typedef STAMDELTASAMPLE const *PCSTAMDELTASAMPLE;
+
+/**
+ * Callback for STAMR3DeltaReaderEnum.
+ *
+ * @returns VINF_SUCCESS to continue, anything else stops the enumeration
+ *          and is returned by STAMR3DeltaReaderEnum.
+ * @param   pSample     The sample.
+ * @param   pvUser      The user argument.
+ */
+typedef DECLCALLBACK(int) FNSTAMDELTAREADERENUM(PCSTAMDELTASAMPLE pSample, void *pvUser);
+/** Pointer to a FNSTAMDELTAREADERENUM function. */
+typedef FNSTAMDELTAREADERENUM *PFNSTAMDELTAREADERENUM;
+
+/** Opaque delta reader. */
+typedef struct STAMDELTAREADER *PSTAMDELTAREADER;
+
+VMMR3DECL(int)  STAMR3DeltaReaderCreate(PSTAMDELTAREADER *ppReader);
+VMMR3DECL(void) STAMR3DeltaReaderDestroy(PSTAMDELTAREADER pReader);
+VMMR3DECL(int)  STAMR3DeltaReaderApply(PSTAMDELTAREADER pReader, void const *pvPacket, size_t cbPacket);
+VMMR3DECL(PCSTAMDELTASAMPLE) STAMR3DeltaReaderGetSample(PSTAMDELTAREADER pReader, uint32_t iSample);
+VMMR3DECL(PCSTAMDELTASAMPLE) STAMR3DeltaReaderFindSample(PSTAMDELTAREADER pReader, const char *pszName);
+VMMR3DECL(int)  STAMR3DeltaReaderEnum(PSTAMDELTAREADER pReader, PFNSTAMDELTAREADERENUM pfnEnum, void *pvUser);
+
+VMMR3_INT_DECL(int)  STAMR3StreamInit(PUVM pUVM);
+VMMR3_INT_DECL(void) STAMR3StreamTerm(PUVM pUVM);
+/** @} */
 
 /** @} */
 
@@ -53,7 +53,7 @@ typedef struct UVMCPU
 #ifdef ___VMInternal_h
         struct VMINTUSERPERVMCPU    s;
 #endif
-        uint8_t                     padding[512];
+        uint8_t                     padding[1536];
     } vm;
 
     /** The DBGF data. */
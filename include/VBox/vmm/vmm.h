@@ -475,6 +475,12 @@ typedef enum VMMR0OPERATION
     /** Test the 32->64 bits switcher. */
     VMMR0_DO_TEST_SWITCHER3264,
 
+    /** Call GMMR0DedupScanReq.  (Added at the end so the numbers of the
+     * existing operations don't change.) */
+    VMMR0_DO_GMM_DEDUP_SCAN,
+    /** Call GMMR0PromoteLargePageReq().  (Appended like the above.) */
+    VMMR0_DO_GMM_PROMOTE_LARGE_PAGE,
+
     /** The usual 32-bit type blow up. */
     VMMR0_DO_32BIT_HACK = 0x7fffffff
 } VMMR0OPERATION;
@@ -21,6 +21,7 @@
 #define LOG_GROUP LOG_GROUP_DBGC
 #include <VBox/dbg.h>
 #include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/dbgftrace.h>
 #include <VBox/vmm/vm.h>
 #include <VBox/param.h>
 #include <VBox/err.h>
@@ -73,6 +74,7 @@ static FNDBGCCMD dbgcCmdHarakiri;
 static FNDBGCCMD dbgcCmdEcho;
 static FNDBGCCMD dbgcCmdRunScript;
 static FNDBGCCMD dbgcCmdWriteCore;
+static FNDBGCCMD dbgcCmdWriteTrace;
 
 
 /*******************************************************************************
@@ -219,6 +221,13 @@ static const DBGCVARDESC    g_aArgWriteCore[] =
     {  1,           1,          DBGCVAR_CAT_STRING,     0,                              "path",         "Filename string." },
 };
 
+/** writetrace arguments. */
+static const DBGCVARDESC    g_aArgWriteTrace[] =
+{
+    /* cTimesMin,   cTimesMax,  enmCategory,            fFlags,                         pszName,        pszDescription */
+    {  1,           1,          DBGCVAR_CAT_STRING,     0,                              "path",         "Filename string." },
+};
+
 
 
 /** Command descriptors for the basic commands. */
@@ -263,6 +272,7 @@ const DBGCCMD    g_aDbgcCmds[] =
     { "unloadplugin", 1,     ~0U,       &g_aArgPlugIn[0],    RT_ELEMENTS(g_aArgPlugIn),    0, dbgcCmdUnloadPlugIn, "<plugin1> [plugin2..N]", "Unloads one or more plugins." },
     { "unset",      1,       ~0U,       &g_aArgUnset[0],     RT_ELEMENTS(g_aArgUnset),     0, dbgcCmdUnset,     "<var1> [var1..[varN]]",  "Unsets (delete) one or more global variables." },
     { "writecore",  1,        1,        &g_aArgWriteCore[0], RT_ELEMENTS(g_aArgWriteCore), 0, dbgcCmdWriteCore,   "<filename>",           "Write core to file." },
+    { "writetrace", 1,        1,        &g_aArgWriteTrace[0], RT_ELEMENTS(g_aArgWriteTrace), 0, dbgcCmdWriteTrace, "<filename>",          "Write the binary trace rings to a Chrome trace event (JSON) file." },
 };
 /** The number of native commands. */
 const uint32_t      g_cDbgcCmds = RT_ELEMENTS(g_aDbgcCmds);
@@ -2142,6 +2152,35 @@ static DECLCALLBACK(int) dbgcCmdWriteCore(PCDBGCCMD pCmd, PDBGCCMDHLP pCmdHlp, P
 }
 
 
+/**
+ * @interface_method_impl{FNDBCCMD, The 'writetrace' command.}
+ */
+static DECLCALLBACK(int) dbgcCmdWriteTrace(PCDBGCCMD pCmd, PDBGCCMDHLP pCmdHlp, PUVM pUVM, PCDBGCVAR paArgs, unsigned cArgs)
+{
+    /*
+     * Validate input.
+     */
+    if (    cArgs != 1
+        ||  paArgs[0].enmType != DBGCVAR_TYPE_STRING)
+    {
+        AssertMsgFailed(("Expected one string exactly!\n"));
+        return VERR_DBGC_PARSE_INCORRECT_ARG_TYPE;
+    }
+
+    const char *pszPath = paArgs[0].u.pszString;
+    if (!pszPath)
+        return DBGCCmdHlpFail(pCmdHlp, pCmd, "Missing file path.\n");
+
+    int rc = DBGFR3TraceRingExport(pUVM, pszPath);
+    if (rc == VERR_DBGF_NO_TRACE_BUFFER)
+        return DBGCCmdHlpFail(pCmdHlp, pCmd, "The binary trace rings are not enabled (DBGF/TraceRing).\n");
+    if (RT_FAILURE(rc))
+        return DBGCCmdHlpFail(pCmdHlp, pCmd, "DBGFR3TraceRingExport failed. rc=%Rrc\n", rc);
+
+    return VINF_SUCCESS;
+}
+
+
 
 /**
  * @callback_method_impl{The randu32() function implementation.}
@@ -1036,9 +1036,35 @@ VBoxDbgStatsModel::resetNode(PDBGGUISTATSNODE pNode)
 }
 
 
+/**
+ * Presents histogram samples as profile samples (average, min and max) since
+ * the model columns have no room for percentiles.
+ *
+ * @returns The type to use.
+ * @param   enmType     The sample type.
+ * @param   ppvSample   The sample pointer, updated if converted.
+ * @param   pTmp        The profile structure to convert into.
+ */
+static STAMTYPE dbgGuiStatsHistogramAsProfile(STAMTYPE enmType, void **ppvSample, PSTAMPROFILE pTmp)
+{
+    if (enmType != STAMTYPE_HISTOGRAM)
+        return enmType;
+    PCSTAMHISTOGRAM pHist = (PCSTAMHISTOGRAM)*ppvSample;
+    pTmp->cPeriods  = pHist->cValues;
+    pTmp->cTicks    = pHist->uTotal;
+    pTmp->cTicksMax = pHist->uMax;
+    pTmp->cTicksMin = pHist->uMin;
+    *ppvSample = pTmp;
+    return STAMTYPE_PROFILE;
+}
+
+
 /*static*/ int
 VBoxDbgStatsModel::initNode(PDBGGUISTATSNODE pNode, STAMTYPE enmType, void *pvSample, STAMUNIT enmUnit, const char *pszDesc)
 {
+    STAMPROFILE HistProfile;
+    enmType = dbgGuiStatsHistogramAsProfile(enmType, &pvSample, &HistProfile);
+
     /*
      * Copy the data.
      */
@@ -1118,6 +1144,8 @@ VBoxDbgStatsModel::initNode(PDBGGUISTATSNODE pNode, STAMTYPE enmType, void *pvSa
 /*static*/ void
 VBoxDbgStatsModel::updateNode(PDBGGUISTATSNODE pNode, STAMTYPE enmType, void *pvSample, STAMUNIT enmUnit, const char *pszDesc)
 {
+    STAMPROFILE HistProfile;
+    enmType = dbgGuiStatsHistogramAsProfile(enmType, &pvSample, &HistProfile);
 
     /*
      * Reset and init the node if the type changed.
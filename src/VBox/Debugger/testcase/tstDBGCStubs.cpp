@@ -22,6 +22,7 @@
 
 
 #include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/dbgftrace.h>
 VMMR3DECL(PDBGFADDRESS) DBGFR3AddrFromFlat(PUVM pUVM, PDBGFADDRESS pAddress, RTGCUINTPTR FlatPtr)
 {
     return NULL;
@@ -317,6 +318,11 @@ VMMR3DECL(int) DBGFR3CoreWrite(PUVM pUVM, const char *pszFilename, bool fReplace
     return VERR_INTERNAL_ERROR;
 }
 
+VMMR3DECL(int) DBGFR3TraceRingExport(PUVM pUVM, const char *pszFilename)
+{
+    return VERR_INTERNAL_ERROR;
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 // The rest should eventually be replaced by DBGF calls and eliminated. //
@@ -2552,6 +2552,77 @@ PDMBOTHCBDECL(int) vgaIOPortRead(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port
     return rc;
 }
 
+#ifndef IN_RC
+
+/**
+ * @callback_method_impl{FNIOMIOPORTOUTSTRBUF,Generic VGA buffered OUTS dispatcher.}
+ *
+ * Saves an IOM round trip per unit for the REP OUTSB/OUTSW sequences used to
+ * load the DAC palette and the sequencer, graphics and CRTC registers.
+ */
+PDMBOTHCBDECL(int) vgaIOPortWriteStrBuf(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void const *pvSrc,
+                                        uint32_t *pcTransfers, unsigned cb)
+{
+    PVGASTATE pThis = PDMINS_2_DATA(pDevIns, PVGASTATE);
+    Assert(PDMCritSectIsOwner(pDevIns->CTX_SUFF(pCritSectRo)));
+    NOREF(pvUser);
+
+    uint8_t const *pb = (uint8_t const *)pvSrc;
+    uint32_t cTransfers = *pcTransfers;
+    if (cb == 1)
+    {
+        while (cTransfers-- > 0)
+            vga_ioport_write(pThis, Port, *pb++);
+        *pcTransfers = 0;
+    }
+    else if (cb == 2)
+    {
+        while (cTransfers-- > 0)
+        {
+            vga_ioport_write(pThis, Port, pb[0]);
+            vga_ioport_write(pThis, Port + 1, pb[1]);
+            pb += 2;
+        }
+        *pcTransfers = 0;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNIOMIOPORTINSTRBUF,Generic VGA buffered INS dispatcher.}
+ */
+PDMBOTHCBDECL(int) vgaIOPortReadStrBuf(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void *pvDst,
+                                       uint32_t *pcTransfers, unsigned cb)
+{
+    PVGASTATE pThis = PDMINS_2_DATA(pDevIns, PVGASTATE);
+    Assert(PDMCritSectIsOwner(pDevIns->CTX_SUFF(pCritSectRo)));
+    NOREF(pvUser);
+
+    uint8_t *pb = (uint8_t *)pvDst;
+    uint32_t cTransfers = *pcTransfers;
+    if (cb == 1)
+    {
+        while (cTransfers-- > 0)
+            *pb++ = (uint8_t)vga_ioport_read(pThis, Port);
+        *pcTransfers = 0;
+    }
+    else if (cb == 2)
+    {
+        while (cTransfers-- > 0)
+        {
+            pb[0] = (uint8_t)vga_ioport_read(pThis, Port);
+            pb[1] = (uint8_t)vga_ioport_read(pThis, Port + 1);
+            pb += 2;
+        }
+        *pcTransfers = 0;
+    }
+    /* Dword accesses are left to vgaIOPortRead. */
+    return VINF_SUCCESS;
+}
+
+#endif /* !IN_RC */
+
 
 /**
  * @callback_method_impl{FNIOMIOPORTOUT,VBE Data Port OUT handler.}
@@ -5639,6 +5710,15 @@ static DECLCALLBACK(int)   vgaR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
     rc = PDMDevHlpIOPortRegister(pDevIns,  0x3da,  1, NULL, vgaIOPortWrite,       vgaIOPortRead, NULL, NULL,      "VGA - 3da");
     if (RT_FAILURE(rc))
         return rc;
+    rc = PDMDevHlpIOPortRegisterStrBuf(pDevIns, 0x3c0, 16, vgaIOPortWriteStrBuf, vgaIOPortReadStrBuf);
+    if (RT_FAILURE(rc))
+        return rc;
+    rc = PDMDevHlpIOPortRegisterStrBuf(pDevIns, 0x3b4,  2, vgaIOPortWriteStrBuf, vgaIOPortReadStrBuf);
+    if (RT_FAILURE(rc))
+        return rc;
+    rc = PDMDevHlpIOPortRegisterStrBuf(pDevIns, 0x3d4,  2, vgaIOPortWriteStrBuf, vgaIOPortReadStrBuf);
+    if (RT_FAILURE(rc))
+        return rc;
 #ifdef VBOX_WITH_HGSMI
     /* Use reserved VGA IO ports for HGSMI. */
     rc = PDMDevHlpIOPortRegister(pDevIns,  VGA_PORT_HGSMI_HOST,  4, NULL, vgaR3IOPortHGSMIWrite, vgaR3IOPortHGSMIRead, NULL, NULL, "VGA - 3b0 (HGSMI host)");
@@ -5704,6 +5784,15 @@ static DECLCALLBACK(int)   vgaR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
         rc = PDMDevHlpIOPortRegisterR0(pDevIns,  0x3da,  1, 0, "vgaIOPortWrite",       "vgaIOPortRead", NULL, NULL,     "VGA - 3da (GC)");
         if (RT_FAILURE(rc))
             return rc;
+        rc = PDMDevHlpIOPortRegisterStrBufR0(pDevIns, 0x3c0, 16, "vgaIOPortWriteStrBuf", "vgaIOPortReadStrBuf");
+        if (RT_FAILURE(rc))
+            return rc;
+        rc = PDMDevHlpIOPortRegisterStrBufR0(pDevIns, 0x3b4,  2, "vgaIOPortWriteStrBuf", "vgaIOPortReadStrBuf");
+        if (RT_FAILURE(rc))
+            return rc;
+        rc = PDMDevHlpIOPortRegisterStrBufR0(pDevIns, 0x3d4,  2, "vgaIOPortWriteStrBuf", "vgaIOPortReadStrBuf");
+        if (RT_FAILURE(rc))
+            return rc;
 #ifdef CONFIG_BOCHS_VBE
         rc = PDMDevHlpIOPortRegisterR0(pDevIns,  0x1ce,  1, 0, "vgaIOPortWriteVBEIndex", "vgaIOPortReadVBEIndex", NULL, NULL, "VGA/VBE - Index (GC)");
         if (RT_FAILURE(rc))
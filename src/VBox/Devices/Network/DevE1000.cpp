@@ -130,8 +130,11 @@
  * in the state structure. It limits the amount of descriptors loaded in one
  * batch read. For example, Linux guest may use up to 20 descriptors per
  * TSE packet. The largest TSE packet seen (Windows guest) was 45 descriptors.
+ * The cache is large enough to hold a couple of such packets so that a guest
+ * queueing several TSE packets at once is served by a single ring read.
+ * Note that nTxDFetched and iTxDCurrent are 8-bit, so it must not exceed 255.
  */
-# define E1K_TXD_CACHE_SIZE 64u
+# define E1K_TXD_CACHE_SIZE 128u
 #endif /* E1K_WITH_TXD_CACHE */
 
 #ifdef E1K_WITH_RXD_CACHE
@@ -982,6 +985,11 @@ AssertCompileSize(struct E1kTcpHeader, 20);
 # define E1K_SAVEDSTATE_VERSION         4
 /** Saved state version for VirtualBox 4.2 with VLAN tag fields.  */
 # define E1K_SAVEDSTATE_VERSION_VBOX_42_VTAG  3
+/** The maximum number of cached TX descriptors a version 4 saved state may
+ * contain.  This is the cache size of the hosts which introduced the format,
+ * storing more requires a new saved state version so these hosts don't
+ * overflow their cache when loading it. */
+# define E1K_SAVEDSTATE_TXD_MAX         64
 #else /* !E1K_WITH_TXD_CACHE */
 /** The current Saved state version. */
 # define E1K_SAVEDSTATE_VERSION         3
@@ -1215,6 +1223,8 @@ struct E1kState_st
     STAMPROFILEADV                      StatTransmitR3;
     STAMPROFILE                         StatTransmitSendRZ;
     STAMPROFILE                         StatTransmitSendR3;
+    STAMHISTOGRAM                       StatReceiveLatency;
+    STAMHISTOGRAM                       StatTransmitSendLatency;
     STAMPROFILE                         StatRxOverflow;
     STAMCOUNTER                         StatRxOverflowWakeup;
     STAMCOUNTER                         StatTxDescCtxNormal;
@@ -1662,19 +1672,37 @@ static void e1kHardReset(PE1KSTATE pThis)
  */
 static uint16_t e1kCSum16(const void *pvBuf, size_t cb)
 {
-    uint32_t  csum = 0;
-    uint16_t *pu16 = (uint16_t *)pvBuf;
+    /*
+     * Sum 32-bit words into a 64-bit accumulator, four at a time. Since
+     * 2^16 == 1 (mod 0xFFFF) folding the result down to 16 bits yields the
+     * same one's complement sum as adding up 16-bit words, at a quarter of
+     * the iterations. No SSE here as this runs in R0 and RC as well.
+     */
+    uint64_t        csum = 0;
+    const uint32_t *pu32 = (const uint32_t *)pvBuf;
 
-    while (cb > 1)
+    while (cb >= 16)
+    {
+        csum += (uint64_t)pu32[0] + pu32[1] + pu32[2] + pu32[3];
+        pu32 += 4;
+        cb   -= 16;
+    }
+    while (cb >= 4)
+    {
+        csum += *pu32++;
+        cb   -= 4;
+    }
+    const uint16_t *pu16 = (const uint16_t *)pu32;
+    if (cb >= 2)
     {
         csum += *pu16++;
-        cb -= 2;
+        cb   -= 2;
     }
     if (cb)
-        csum += *(uint8_t*)pu16;
+        csum += *(const uint8_t *)pu16;
     while (csum >> 16)
         csum = (csum >> 16) + (csum & 0xFFFF);
-    return ~csum;
+    return ~(uint16_t)csum;
 }
 
 /**
@@ -3820,7 +3848,9 @@ static void e1kTransmitFrame(PE1KSTATE pThis, bool fOnWorkerThread)
             /* Release critical section to avoid deadlock in CanReceive */
             //e1kCsLeave(pThis);
             STAM_PROFILE_START(&pThis->CTX_SUFF_Z(StatTransmitSend), a);
+            STAM_HISTOGRAM_START(&pThis->StatTransmitSendLatency, b);
             rc = pDrv->pfnSendBuf(pDrv, pSg, fOnWorkerThread);
+            STAM_HISTOGRAM_STOP(&pThis->StatTransmitSendLatency, b);
             STAM_PROFILE_STOP(&pThis->CTX_SUFF_Z(StatTransmitSend), a);
             //e1kCsEnter(pThis, RT_SRC_POS);
         }
@@ -4013,62 +4043,79 @@ static void e1kFallbackAddSegment(PE1KSTATE pThis, RTGCPHYS PhysAddr, uint16_t u
 static int e1kFallbackAddSegment(PE1KSTATE pThis, RTGCPHYS PhysAddr, uint16_t u16Len, bool fSend, bool fOnWorkerThread)
 {
     int rc = VINF_SUCCESS;
-    /* TCP header being transmitted */
+    /* TCP header prototype */
     struct E1kTcpHeader *pTcpHdr = (struct E1kTcpHeader *)
             (pThis->aTxPacketFallback + pThis->contextTSE.tu.u8CSS);
-    /* IP header being transmitted */
+    /* IP header prototype */
     struct E1kIpHeader *pIpHdr = (struct E1kIpHeader *)
             (pThis->aTxPacketFallback + pThis->contextTSE.ip.u8CSS);
+    /*
+     * The headers are kept in the fallback buffer while the payload is read
+     * directly into the buffer going to the driver, so the segment does not
+     * have to be copied once more before it is sent.
+     */
+    PPDMSCATTERGATHER pTxSg = pThis->CTX_SUFF(pTxSg);
+    uint8_t *pbSeg = pTxSg ? (uint8_t *)pTxSg->aSegs[0].pvSeg : pThis->aTxPacketFallback;
 
     E1kLog3(("%s e1kFallbackAddSegment: Length=%x, remaining payload=%x, header=%x, send=%RTbool\n",
              pThis->szPrf, u16Len, pThis->u32PayRemain, pThis->u16HdrRemain, fSend));
     Assert(pThis->u32PayRemain + pThis->u16HdrRemain > 0);
 
-    PDMDevHlpPhysRead(pThis->CTX_SUFF(pDevIns), PhysAddr,
-                      pThis->aTxPacketFallback + pThis->u16TxPktLen, u16Len);
-    E1kLog3(("%s Dump of the segment:\n"
-            "%.*Rhxd\n"
-            "%s --- End of dump ---\n",
-            pThis->szPrf, u16Len, pThis->aTxPacketFallback + pThis->u16TxPktLen, pThis->szPrf));
-    pThis->u16TxPktLen += u16Len;
-    E1kLog3(("%s e1kFallbackAddSegment: pThis->u16TxPktLen=%x\n",
-            pThis->szPrf, pThis->u16TxPktLen));
     if (pThis->u16HdrRemain > 0)
     {
-        /* The header was not complete, check if it is now */
-        if (u16Len >= pThis->u16HdrRemain)
-        {
-            /* The rest is payload */
-            u16Len -= pThis->u16HdrRemain;
-            pThis->u16HdrRemain = 0;
-            /* Save partial checksum and flags */
-            pThis->u32SavedCsum = pTcpHdr->chksum;
-            pThis->u16SavedFlags = pTcpHdr->hdrlen_flags;
-            /* Clear FIN and PSH flags now and set them only in the last segment */
-            pTcpHdr->hdrlen_flags &= ~htons(E1K_TCP_FIN | E1K_TCP_PSH);
-        }
-        else
+        /* The header was not complete, read as much of it as we have */
+        uint16_t cbHdr = RT_MIN(u16Len, pThis->u16HdrRemain);
+        PDMDevHlpPhysRead(pThis->CTX_SUFF(pDevIns), PhysAddr,
+                          pThis->aTxPacketFallback + pThis->u16TxPktLen, cbHdr);
+        pThis->u16TxPktLen  += cbHdr;
+        pThis->u16HdrRemain -= cbHdr;
+        PhysAddr            += cbHdr;
+        u16Len              -= cbHdr;
+        if (pThis->u16HdrRemain > 0)
         {
             /* Still not */
-            pThis->u16HdrRemain -= u16Len;
             E1kLog3(("%s e1kFallbackAddSegment: Header is still incomplete, 0x%x bytes remain.\n",
                     pThis->szPrf, pThis->u16HdrRemain));
             return rc;
         }
+        /* Save partial checksum and flags */
+        pThis->u32SavedCsum = pTcpHdr->chksum;
+        pThis->u16SavedFlags = pTcpHdr->hdrlen_flags;
+        /* Clear FIN and PSH flags now and set them only in the last segment */
+        pTcpHdr->hdrlen_flags &= ~htons(E1K_TCP_FIN | E1K_TCP_PSH);
     }
 
-    pThis->u32PayRemain -= u16Len;
+    /* The rest is payload */
+    if (u16Len)
+    {
+        PDMDevHlpPhysRead(pThis->CTX_SUFF(pDevIns), PhysAddr,
+                          pbSeg + pThis->u16TxPktLen, u16Len);
+        E1kLog3(("%s Dump of the segment:\n"
+                "%.*Rhxd\n"
+                "%s --- End of dump ---\n",
+                pThis->szPrf, u16Len, pbSeg + pThis->u16TxPktLen, pThis->szPrf));
+        pThis->u16TxPktLen  += u16Len;
+        pThis->u32PayRemain -= u16Len;
+    }
+    E1kLog3(("%s e1kFallbackAddSegment: pThis->u16TxPktLen=%x\n",
+            pThis->szPrf, pThis->u16TxPktLen));
 
     if (fSend)
     {
+        /* Put the headers in front of the payload */
+        if (pbSeg != pThis->aTxPacketFallback)
+            memcpy(pbSeg, pThis->aTxPacketFallback, pThis->contextTSE.dw3.u8HDRLEN);
+        struct E1kTcpHeader *pSegTcpHdr = (struct E1kTcpHeader *)(pbSeg + pThis->contextTSE.tu.u8CSS);
+        struct E1kIpHeader  *pSegIpHdr  = (struct E1kIpHeader *)(pbSeg + pThis->contextTSE.ip.u8CSS);
+
         /* Leave ethernet header intact */
         /* IP Total Length = payload + headers - ethernet header */
-        pIpHdr->total_len = htons(pThis->u16TxPktLen - pThis->contextTSE.ip.u8CSS);
+        pSegIpHdr->total_len = htons(pThis->u16TxPktLen - pThis->contextTSE.ip.u8CSS);
         E1kLog3(("%s e1kFallbackAddSegment: End of packet, pIpHdr->total_len=%x\n",
-                pThis->szPrf, ntohs(pIpHdr->total_len)));
+                pThis->szPrf, ntohs(pSegIpHdr->total_len)));
         /* Update IP Checksum */
-        pIpHdr->chksum = 0;
-        e1kInsertChecksum(pThis, pThis->aTxPacketFallback, pThis->u16TxPktLen,
+        pSegIpHdr->chksum = 0;
+        e1kInsertChecksum(pThis, pbSeg, pThis->u16TxPktLen,
                           pThis->contextTSE.ip.u8CSO,
                           pThis->contextTSE.ip.u8CSS,
                           pThis->contextTSE.ip.u16CSE);
@@ -4077,7 +4124,7 @@ static int e1kFallbackAddSegment(PE1KSTATE pThis, RTGCPHYS PhysAddr, uint16_t u1
         /* Restore original FIN and PSH flags for the last segment */
         if (pThis->u32PayRemain == 0)
         {
-            pTcpHdr->hdrlen_flags = pThis->u16SavedFlags;
+            pSegTcpHdr->hdrlen_flags = pThis->u16SavedFlags;
             E1K_INC_CNT32(TSCTC);
         }
         /* Add TCP length to partial pseudo header sum */
@@ -4085,9 +4132,9 @@ static int e1kFallbackAddSegment(PE1KSTATE pThis, RTGCPHYS PhysAddr, uint16_t u1
                 + htons(pThis->u16TxPktLen - pThis->contextTSE.tu.u8CSS);
         while (csum >> 16)
             csum = (csum >> 16) + (csum & 0xFFFF);
-        pTcpHdr->chksum = csum;
+        pSegTcpHdr->chksum = csum;
         /* Compute final checksum */
-        e1kInsertChecksum(pThis, pThis->aTxPacketFallback, pThis->u16TxPktLen,
+        e1kInsertChecksum(pThis, pbSeg, pThis->u16TxPktLen,
                           pThis->contextTSE.tu.u8CSO,
                           pThis->contextTSE.tu.u8CSS,
                           pThis->contextTSE.tu.u16CSE);
@@ -4095,14 +4142,12 @@ static int e1kFallbackAddSegment(PE1KSTATE pThis, RTGCPHYS PhysAddr, uint16_t u1
         /*
          * Transmit it.
          */
-        if (pThis->CTX_SUFF(pTxSg))
+        if (pTxSg)
         {
-            Assert(pThis->u16TxPktLen <= pThis->CTX_SUFF(pTxSg)->cbAvailable);
-            Assert(pThis->CTX_SUFF(pTxSg)->cSegs == 1);
-            if (pThis->CTX_SUFF(pTxSg)->aSegs[0].pvSeg != pThis->aTxPacketFallback)
-                memcpy(pThis->CTX_SUFF(pTxSg)->aSegs[0].pvSeg, pThis->aTxPacketFallback, pThis->u16TxPktLen);
-            pThis->CTX_SUFF(pTxSg)->cbUsed         = pThis->u16TxPktLen;
-            pThis->CTX_SUFF(pTxSg)->aSegs[0].cbSeg = pThis->u16TxPktLen;
+            Assert(pThis->u16TxPktLen <= pTxSg->cbAvailable);
+            Assert(pTxSg->cSegs == 1);
+            pTxSg->cbUsed         = pThis->u16TxPktLen;
+            pTxSg->aSegs[0].cbSeg = pThis->u16TxPktLen;
         }
         e1kTransmitFrame(pThis, fOnWorkerThread);
 
@@ -4197,8 +4242,9 @@ static bool e1kFallbackAddToFrame(PE1KSTATE pThis, E1KTXDESC* pDesc, uint32_t cb
  * TCP segmentation offloading fallback: Add descriptor's buffer to transmit
  * frame.
  *
- * We construct the frame in the fallback buffer first and the copy it to the SG
- * buffer before passing it down to the network driver code.
+ * The headers are assembled in the fallback buffer while the payload goes
+ * directly to the SG buffer, each segment gets a copy of the headers just
+ * before it is passed down to the network driver code.
  *
  * @returns error code
  *
@@ -6346,6 +6392,7 @@ static DECLCALLBACK(int) e1kR3NetworkDown_Receive(PPDMINETWORKDOWN pInterface, c
     }
 
     STAM_PROFILE_ADV_START(&pThis->StatReceive, a);
+    STAM_HISTOGRAM_START(&pThis->StatReceiveLatency, b);
 
     //if (!e1kCsEnter(pThis, RT_SRC_POS))
     //    return VERR_PERMISSION_DENIED;
@@ -6369,6 +6416,7 @@ static DECLCALLBACK(int) e1kR3NetworkDown_Receive(PPDMINETWORKDOWN pInterface, c
         rc = e1kHandleRxPacket(pThis, pvBuf, cb, status);
     }
     //e1kCsLeave(pThis);
+    STAM_HISTOGRAM_STOP(&pThis->StatReceiveLatency, b);
     STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
 
     return rc;
@@ -6578,6 +6626,7 @@ static DECLCALLBACK(int) e1kSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     SSMR3PutU16(pSSM, pThis->u16VTagTCI);
 #ifdef E1K_WITH_TXD_CACHE
 #if 0
+    AssertCompile(E1K_TXD_CACHE_SIZE <= E1K_SAVEDSTATE_TXD_MAX); /* Bump the version otherwise! */
     SSMR3PutU8(pSSM, pThis->nTxDFetched);
     SSMR3PutMem(pSSM, pThis->aTxDescriptors,
                 pThis->nTxDFetched * sizeof(pThis->aTxDescriptors[0]));
@@ -6704,6 +6753,10 @@ static DECLCALLBACK(int) e1kLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32
         {
             rc = SSMR3GetU8(pSSM, &pThis->nTxDFetched);
             AssertRCReturn(rc, rc);
+            AssertLogRelMsgReturn(   pThis->nTxDFetched <= E1K_TXD_CACHE_SIZE
+                                  && pThis->nTxDFetched <= E1K_SAVEDSTATE_TXD_MAX,
+                                  ("nTxDFetched=%u\n", pThis->nTxDFetched),
+                                  VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
             if (pThis->nTxDFetched)
                 SSMR3GetMem(pSSM, pThis->aTxDescriptors,
                             pThis->nTxDFetched * sizeof(pThis->aTxDescriptors[0]));
@@ -7701,6 +7754,8 @@ static DECLCALLBACK(int) e1kR3Construct(PPDMDEVINS pDevIns, int iInstance, PCFGM
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitR3,         STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling transmits in R3",          "/Devices/E1k%d/Transmit/TotalR3", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitSendRZ,     STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling send transmit in RZ",      "/Devices/E1k%d/Transmit/SendRZ", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitSendR3,     STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling send transmit in R3",      "/Devices/E1k%d/Transmit/SendR3", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReceiveLatency,     STAMTYPE_HISTOGRAM, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS,      "Receive latency distribution",       "/Devices/E1k%d/Receive/Latency", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitSendLatency, STAMTYPE_HISTOGRAM, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS,      "Send transmit latency distribution", "/Devices/E1k%d/Transmit/SendLatency", iInstance);
 
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTxDescCtxNormal,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of normal context descriptors","/Devices/E1k%d/TxDesc/ContexNormal", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTxDescCtxTSE,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of TSE context descriptors",  "/Devices/E1k%d/TxDesc/ContextTSE", iInstance);
@@ -23,9 +23,11 @@
 #define VNET_GC_SUPPORT
 #define VNET_WITH_GSO
 #define VNET_WITH_MERGEABLE_RX_BUFS
+#define VNET_WITH_TX_THREADS
 
 #include <VBox/vmm/pdmdev.h>
 #include <VBox/vmm/pdmnetifs.h>
+#include <VBox/msi.h>
 #include <iprt/asm.h>
 #include <iprt/net.h>
 #include <iprt/semaphore.h>
@@ -49,7 +51,6 @@
 
 #define VNET_PCI_SUBSYSTEM_ID        1 + VIRTIO_NET_ID
 #define VNET_PCI_CLASS               0x0200
-#define VNET_N_QUEUES                3
 #define VNET_NAME_FMT                "VNet%d"
 
 #if 0
@@ -66,6 +67,7 @@
 
 
 #define VNET_TX_DELAY           150   /**< 150 microseconds */
+#define VNET_MAX_QUEUE_PAIRS    8     /**< Upper limit for the QueuePairs setting. */
 #define VNET_MAX_FRAME_SIZE     65535 + 18  /**< Max IP packet size + Ethernet header with VLAN tag */
 #define VNET_MAC_FILTER_LEN     32
 #define VNET_MAX_VID            (1 << 12)
@@ -89,6 +91,7 @@
 #define VNET_F_CTRL_VQ    0x00020000  /**< Control channel available */
 #define VNET_F_CTRL_RX    0x00040000  /**< Control channel RX mode support */
 #define VNET_F_CTRL_VLAN  0x00080000  /**< Control channel VLAN filtering */
+#define VNET_F_MQ         0x00400000  /**< Multiple RX/TX queue pairs with receive steering */
 /** @} */
 
 #define VNET_S_LINK_UP    1
@@ -105,8 +108,36 @@ struct __attribute__ ((__packed__)) VNetPCIConfig /** @todo r=bird: Use #pragma
 {
     RTMAC    mac;
     uint16_t uStatus;
+    uint16_t uMaxVirtqueuePairs;
 };
 AssertCompileMemberOffset(struct VNetPCIConfig, uStatus, 6);
+AssertCompileMemberOffset(struct VNetPCIConfig, uMaxVirtqueuePairs, 8);
+
+/**
+ * The state of an RX/TX queue pair.
+ */
+typedef struct VNetQueuePair
+{
+    /** The receive queue. */
+    R3PTRTYPE(PVQUEUE)      pRxQueue;
+    /** The transmit queue. */
+    R3PTRTYPE(PVQUEUE)      pTxQueue;
+    /** The thread transmitting the frames the guest puts into pTxQueue. */
+    R3PTRTYPE(PPDMTHREAD)   pTxThread;
+    /** The buffer frames are assembled in before taking the xmit lock, only
+     * allocated with more than one queue pair. */
+    R3PTRTYPE(uint8_t *)    pbTxBuf;
+    /** EMT: Gets signalled when the guest kicks pTxQueue. */
+    RTSEMEVENT              hTxEvent;
+    /** Indicates transmission in progress -- only one thread is allowed. */
+    uint32_t volatile       uIsTransmitting;
+    /** Set when pfnBeginXmit failed, the lock holder signals hTxEvent after
+     * pfnEndXmit. */
+    bool volatile           fXmitBusy;
+    bool                    afAlignment[3];
+} VNETQUEUEPAIR;
+/** Pointer to the state of an RX/TX queue pair. */
+typedef VNETQUEUEPAIR *PVNETQUEUEPAIR;
 
 /**
  * Device state structure. Holds the current state of device.
@@ -156,9 +187,6 @@ typedef struct VNetState_st
     uint64_t                u64NanoTS;
 #endif /* VNET_TX_DELAY */
 
-    /** Indicates transmission in progress -- only one thread is allowed. */
-    uint32_t                uIsTransmitting;
-
     /** PCI config area holding MAC address as well as TBD. */
     struct VNetPCIConfig    config;
     /** MAC address obtained from the configuration. */
@@ -168,7 +196,10 @@ typedef struct VNetState_st
     /** Link up delay (in milliseconds). */
     uint32_t                cMsLinkUpDelay;
 
-    uint32_t                alignment;
+    /** Number of queue pairs the device was configured with. */
+    uint16_t                cMaxQueuePairs;
+    /** Number of queue pairs currently used by the guest. */
+    uint16_t                cCurQueuePairs;
 
     /** Number of packet being sent/received to show in debug log. */
     uint32_t                u32PktNo;
@@ -187,8 +218,8 @@ typedef struct VNetState_st
     /** Bit array of VLAN filter, one bit per VLAN ID. */
     uint8_t                 aVlanFilter[VNET_MAX_VID / sizeof(uint8_t)];
 
-    R3PTRTYPE(PVQUEUE)      pRxQueue;
-    R3PTRTYPE(PVQUEUE)      pTxQueue;
+    /** RX/TX queue pairs, only the first cMaxQueuePairs entries are used. */
+    VNETQUEUEPAIR           aQueuePairs[VNET_MAX_QUEUE_PAIRS];
     R3PTRTYPE(PVQUEUE)      pCtlQueue;
     /* Receive-blocking-related fields ***************************************/
 
@@ -265,6 +296,9 @@ typedef uint8_t VNETCTLACK;
 #define VNET_CTRL_CMD_VLAN_ADD         0
 #define VNET_CTRL_CMD_VLAN_DEL         1
 
+#define VNET_CTRL_CLS_MQ               4
+#define VNET_CTRL_CMD_MQ_VQ_PAIRS_SET  0
+
 
 struct VNetCtlHdr
 {
@@ -275,6 +309,9 @@ typedef struct VNetCtlHdr VNETCTLHDR;
 typedef VNETCTLHDR *PVNETCTLHDR;
 AssertCompileSize(VNETCTLHDR, 2);
 
+AssertCompile(2 * VNET_MAX_QUEUE_PAIRS + 1 <= VIRTIO_MAX_NQUEUES);
+AssertCompile(2 * VNET_MAX_QUEUE_PAIRS + 2 <= VBOX_MSIX_MAX_ENTRIES);
+
 /** Returns true if large packets are written into several RX buffers. */
 DECLINLINE(bool) vnetMergeableRxBuffers(PVNETSTATE pThis)
 {
@@ -354,7 +391,10 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
         { VNET_F_STATUS,     "virtio_net_config.status available" },
         { VNET_F_CTRL_VQ,    "control channel available" },
         { VNET_F_CTRL_RX,    "control channel RX mode support" },
-        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" }
+        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" },
+        { VNET_F_MQ,         "multiple queue pairs with receive steering" },
+        { VPCI_F_RING_INDIRECT_DESC, "indirect descriptors" },
+        { VPCI_F_RING_EVENT_IDX,     "used_event/avail_event notification suppression" }
     };
 
     Log3(("%s %s:\n", INSTANCE(pThis), pcszText));
@@ -368,6 +408,7 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
 
 static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
 {
+    PVNETSTATE pThis = (PVNETSTATE)pvState;
     /* We support:
      * - Host-provided MAC address
      * - Link status reporting in config space
@@ -375,8 +416,10 @@ static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
      * - RX mode setting
      * - MAC filter table
      * - VLAN filter
+     * - Multiple queue pairs, if configured
      */
-    return VNET_F_MAC
+    return (pThis->cMaxQueuePairs > 1 ? VNET_F_MQ : 0)
+        | VNET_F_MAC
         | VNET_F_STATUS
         | VNET_F_CTRL_VQ
         | VNET_F_CTRL_RX
@@ -471,7 +514,10 @@ static DECLCALLBACK(int) vnetIoCb_Reset(void *pvState)
     pThis->nMacFilterEntries = 0;
     memset(pThis->aMacFilter,  0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
     memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
-    pThis->uIsTransmitting   = 0;
+    /* The guest has to ask for more queue pairs with VNET_CTRL_CMD_MQ_VQ_PAIRS_SET. */
+    pThis->cCurQueuePairs    = 1;
+    for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+        pThis->aQueuePairs[i].uIsTransmitting = 0;
 #ifndef IN_RING3
     return VINF_IOM_R3_IOPORT_WRITE;
 #else
@@ -582,7 +628,7 @@ PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port
 #ifdef IN_RING3
 
 /**
- * Check if the device can receive data now.
+ * Check if the device can receive data into the given queue pair now.
  * This must be called before the pfnRecieve() method is called.
  *
  * @remarks As a side effect this function enables queue notification
@@ -590,10 +636,11 @@ PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port
  *          It disables notification if it can receive.
  *
  * @returns VERR_NET_NO_BUFFER_SPACE if it cannot.
- * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair to check the receive queue of.
  * @thread  RX
  */
-static int vnetCanReceive(PVNETSTATE pThis)
+static int vnetCanReceive(PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
 {
     int rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
     AssertRCReturn(rc, rc);
@@ -601,16 +648,16 @@ static int vnetCanReceive(PVNETSTATE pThis)
     LogFlow(("%s vnetCanReceive\n", INSTANCE(pThis)));
     if (!(pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK))
         rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (!vqueueIsReady(&pThis->VPCI, pThis->pRxQueue))
+    else if (!vqueueIsReady(&pThis->VPCI, pPair->pRxQueue))
         rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (vqueueIsEmpty(&pThis->VPCI, pThis->pRxQueue))
+    else if (vqueueIsEmpty(&pThis->VPCI, pPair->pRxQueue))
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, true);
+        vqueueSetNotification(&pThis->VPCI, pPair->pRxQueue, true);
         rc = VERR_NET_NO_BUFFER_SPACE;
     }
     else
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, false);
+        vqueueSetNotification(&pThis->VPCI, pPair->pRxQueue, false);
         rc = VINF_SUCCESS;
     }
 
@@ -619,6 +666,28 @@ static int vnetCanReceive(PVNETSTATE pThis)
     return rc;
 }
 
+/**
+ * Finds a queue pair the device can receive data into right now.
+ *
+ * @returns Pointer to the queue pair, NULL if all active receive queues are
+ *          full.
+ * @param   pThis           The device state structure.
+ * @param   pPreferred      The queue pair to try first, optional.
+ * @thread  RX
+ */
+static PVNETQUEUEPAIR vnetFindRxQueuePair(PVNETSTATE pThis, PVNETQUEUEPAIR pPreferred)
+{
+    if (pPreferred && RT_SUCCESS(vnetCanReceive(pThis, pPreferred)))
+        return pPreferred;
+
+    uint16_t cPairs = pThis->cCurQueuePairs;
+    for (unsigned i = 0; i < cPairs; i++)
+        if (   &pThis->aQueuePairs[i] != pPreferred
+            && RT_SUCCESS(vnetCanReceive(pThis, &pThis->aQueuePairs[i])))
+            return &pThis->aQueuePairs[i];
+    return NULL;
+}
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnWaitReceiveAvail}
  */
@@ -626,9 +695,9 @@ static DECLCALLBACK(int) vnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInte
 {
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
     LogFlow(("%s vnetNetworkDown_WaitReceiveAvail(cMillies=%u)\n", INSTANCE(pThis), cMillies));
-    int rc = vnetCanReceive(pThis);
+    int rc;
 
-    if (RT_SUCCESS(rc))
+    if (vnetFindRxQueuePair(pThis, NULL))
         return VINF_SUCCESS;
     if (RT_UNLIKELY(cMillies == 0))
         return VERR_NET_NO_BUFFER_SPACE;
@@ -641,8 +710,7 @@ static DECLCALLBACK(int) vnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInte
     while (RT_LIKELY(   (enmVMState = PDMDevHlpVMState(pThis->VPCI.CTX_SUFF(pDevIns))) == VMSTATE_RUNNING
                      ||  enmVMState == VMSTATE_RUNNING_LS))
     {
-        int rc2 = vnetCanReceive(pThis);
-        if (RT_SUCCESS(rc2))
+        if (vnetFindRxQueuePair(pThis, NULL))
         {
             rc = VINF_SUCCESS;
             break;
@@ -740,6 +808,67 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
     return false;
 }
 
+/**
+ * Selects the queue pair an incoming frame should be delivered to.
+ *
+ * The source and destination addresses and, for TCP and UDP, ports are hashed
+ * so that all frames of a flow end up in the same receive queue and thus get
+ * processed by the same guest CPU.
+ *
+ * @returns Pointer to the queue pair.
+ * @param   pThis           The device state structure.
+ * @param   pvBuf           The ethernet frame.
+ * @param   cb              Number of bytes available in the frame.
+ * @thread  RX
+ */
+static PVNETQUEUEPAIR vnetRxSteer(PVNETSTATE pThis, const void *pvBuf, size_t cb)
+{
+    uint16_t cPairs = pThis->cCurQueuePairs;
+    if (cPairs <= 1)
+        return &pThis->aQueuePairs[0];
+
+    const uint8_t *pbFrame    = (const uint8_t *)pvBuf;
+    size_t         offIpHdr   = sizeof(RTNETETHERHDR);
+    size_t         offL4Hdr   = 0;
+    uint32_t       uHash      = 0;
+    uint8_t        bProtocol  = 0;
+    if (cb < offIpHdr)
+        return &pThis->aQueuePairs[0];
+
+    uint16_t uEtherType = RT_BE2H_U16(((PCRTNETETHERHDR)pbFrame)->EtherType);
+    if (uEtherType == RTNET_ETHERTYPE_VLAN && cb >= offIpHdr + 4)
+    {
+        uEtherType = RT_BE2H_U16(*(uint16_t *)(pbFrame + offIpHdr + 2));
+        offIpHdr  += 4;
+    }
+
+    if (uEtherType == RTNET_ETHERTYPE_IPV4 && cb >= offIpHdr + RTNETIPV4_MIN_LEN)
+    {
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pbFrame + offIpHdr);
+        uHash     = pIpHdr->ip_src.u ^ pIpHdr->ip_dst.u;
+        bProtocol = pIpHdr->ip_p;
+        /* Only the first fragment carries the ports. */
+        if (!(RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | 0x1fff)))
+            offL4Hdr = offIpHdr + pIpHdr->ip_hl * 4;
+    }
+    else if (uEtherType == RTNET_ETHERTYPE_IPV6 && cb >= offIpHdr + sizeof(RTNETIPV6))
+    {
+        PCRTNETIPV6 pIpHdr = (PCRTNETIPV6)(pbFrame + offIpHdr);
+        for (unsigned i = 0; i < RT_ELEMENTS(pIpHdr->ip6_src.au32); i++)
+            uHash ^= pIpHdr->ip6_src.au32[i] ^ pIpHdr->ip6_dst.au32[i];
+        bProtocol = pIpHdr->ip6_nxt;
+        offL4Hdr  = offIpHdr + sizeof(RTNETIPV6);
+    }
+
+    if (   (bProtocol == RTNETIPV4_PROT_TCP || bProtocol == RTNETIPV4_PROT_UDP)
+        && offL4Hdr
+        && cb >= offL4Hdr + sizeof(uint32_t))
+        uHash ^= *(uint32_t *)(pbFrame + offL4Hdr); /* Source and destination ports. */
+
+    /* Fibonacci hashing, the low bits of addresses tend to be rather similar. */
+    return &pThis->aQueuePairs[((uHash * UINT32_C(0x9e3779b9)) >> 16) % cPairs];
+}
+
 /**
  * Pad and store received packet.
  *
@@ -748,11 +877,12 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
  *
  * @returns VBox status code.
  * @param   pThis          The device state structure.
+ * @param   pRxQueue        The receive queue to store the packet in.
  * @param   pvBuf           The available data.
  * @param   cb              Number of bytes available in the buffer.
  * @thread  RX
  */
-static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
+static int vnetHandleRxPacket(PVNETSTATE pThis, PVQUEUE pRxQueue, const void *pvBuf, size_t cb,
                               PCPDMNETWORKGSO pGso)
 {
     VNETHDRMRX   Hdr;
@@ -807,7 +937,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
         VQUEUEELEM elem;
         unsigned int nSeg = 0, uElemSize = 0, cbReserved = 0;
 
-        if (!vqueueGet(&pThis->VPCI, pThis->pRxQueue, &elem))
+        if (!vqueueGet(&pThis->VPCI, pRxQueue, &elem))
         {
             /*
              * @todo: It is possible to run out of RX buffers if only a few
@@ -851,7 +981,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             uElemSize += uSize;
         }
         STAM_PROFILE_START(&pThis->StatReceiveStore, a);
-        vqueuePut(&pThis->VPCI, pThis->pRxQueue, &elem, uElemSize, cbReserved);
+        vqueuePut(&pThis->VPCI, pRxQueue, &elem, uElemSize, cbReserved);
         STAM_PROFILE_STOP(&pThis->StatReceiveStore, a);
         if (!vnetMergeableRxBuffers(pThis))
             break;
@@ -869,7 +999,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             return rc;
         }
     }
-    vqueueSync(&pThis->VPCI, pThis->pRxQueue);
+    vqueueSync(&pThis->VPCI, pRxQueue);
     if (uOffset < cb)
     {
         Log(("%s vnetHandleRxPacket: Packet did not fit into RX queue (packet size=%u)!\n",
@@ -880,6 +1010,24 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
     return VINF_SUCCESS;
 }
 
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnGetRecvGsoCapabilities}
+ */
+static DECLCALLBACK(uint32_t) vnetNetworkDown_GetRecvGsoCapabilities(PPDMINETWORKDOWN pInterface)
+{
+    PVNETSTATE pThis     = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
+    uint32_t   uFeatures = pThis->VPCI.uGuestFeatures;
+    uint32_t   fGsoCaps  = 0;
+
+    if (uFeatures & VNET_F_GUEST_TSO4)
+        fGsoCaps |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_TCP);
+    if (uFeatures & VNET_F_GUEST_TSO6)
+        fGsoCaps |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV6_TCP);
+    if (uFeatures & VNET_F_GUEST_UFO)
+        fGsoCaps |= RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_UDP) | RT_BIT_32(PDMNETWORKGSOTYPE_IPV6_UDP);
+    return fGsoCaps;
+}
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveGso}
  */
@@ -889,39 +1037,24 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
 {
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
 
-    if (pGso)
+    if (   pGso
+        && !(vnetNetworkDown_GetRecvGsoCapabilities(pInterface) & RT_BIT_32(pGso->u8Type)))
     {
-        uint32_t uFeatures = pThis->VPCI.uGuestFeatures;
-
-        switch (pGso->u8Type)
-        {
-            case PDMNETWORKGSOTYPE_IPV4_TCP:
-                uFeatures &= VNET_F_GUEST_TSO4;
-                break;
-            case PDMNETWORKGSOTYPE_IPV6_TCP:
-                uFeatures &= VNET_F_GUEST_TSO6;
-                break;
-            case PDMNETWORKGSOTYPE_IPV4_UDP:
-            case PDMNETWORKGSOTYPE_IPV6_UDP:
-                uFeatures &= VNET_F_GUEST_UFO;
-                break;
-            default:
-                uFeatures = 0;
-                break;
-        }
-        if (!uFeatures)
-        {
-            Log2(("%s vnetNetworkDown_ReceiveGso: GSO type (0x%x) not supported\n",
-                  INSTANCE(pThis), pGso->u8Type));
-            return VERR_NOT_SUPPORTED;
-        }
+        Log2(("%s vnetNetworkDown_ReceiveGso: GSO type (0x%x) not supported\n",
+              INSTANCE(pThis), pGso->u8Type));
+        return VERR_NOT_SUPPORTED;
     }
 
     Log2(("%s vnetNetworkDown_ReceiveGso: pvBuf=%p cb=%u pGso=%p\n",
           INSTANCE(pThis), pvBuf, cb, pGso));
-    int rc = vnetCanReceive(pThis);
-    if (RT_FAILURE(rc))
-        return rc;
+    /*
+     * Keep flows on their queue, but rather fall back to another queue than
+     * drop the frame when the guest has not refilled it yet.
+     */
+    PVNETQUEUEPAIR pPair = vnetFindRxQueuePair(pThis, vnetRxSteer(pThis, pvBuf, cb));
+    if (!pPair)
+        return VERR_NET_NO_BUFFER_SPACE;
+    int rc = VINF_SUCCESS;
 
     /* Drop packets if VM is not running or cable is disconnected. */
     VMSTATE enmVMState = PDMDevHlpVMState(pThis->VPCI.CTX_SUFF(pDevIns));
@@ -937,7 +1070,7 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
         rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
         if (RT_SUCCESS(rc))
         {
-            rc = vnetHandleRxPacket(pThis, pvBuf, cb, pGso);
+            rc = vnetHandleRxPacket(pThis, pPair->pRxQueue, pvBuf, cb, pGso);
             STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
             vnetCsRxLeave(pThis);
         }
@@ -1103,32 +1236,158 @@ DECLINLINE(void) vnetCompleteChecksum(uint8_t *pBuf, unsigned cbSize, uint16_t u
     *(uint16_t*)(pBuf + uStart + uOffset) = vnetCSum16(pBuf + uStart, cbSize - uStart);
 }
 
-static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fOnWorkerThread)
+/**
+ * Completes a frame assembled from the guest's descriptors.
+ *
+ * Fixes up the header lengths of a GSO frame or completes the checksum the
+ * guest left to us.
+ *
+ * @param   pThis           The device state structure.
+ * @param   pHdr            The virtio-net header of the frame.
+ * @param   pGso            The GSO context of the frame, NULL if not GSO.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The size of the frame.
+ */
+static void vnetTxCompleteFrame(PVNETSTATE pThis, VNETHDR const *pHdr, PPDMNETWORKGSO pGso,
+                                uint8_t *pbFrame, unsigned cbFrame)
+{
+    if (pGso)
+    {
+        /* Some guests (RHEL) may report HdrLen excluding transport layer header! */
+        /*
+         * We cannot use cdHdrs provided by the guest because of different ways
+         * it gets filled out by different versions of kernels.
+         */
+        //if (pGso->cbHdrs < pHdr->u16CSumStart + pHdr->u16CSumOffset + 2)
+        {
+            Log4(("%s vnetTransmitPendingPackets: HdrLen before adjustment %d.\n",
+                  INSTANCE(pThis), pGso->cbHdrsTotal));
+            switch (pGso->u8Type)
+            {
+                case PDMNETWORKGSOTYPE_IPV4_TCP:
+                case PDMNETWORKGSOTYPE_IPV6_TCP:
+                    pGso->cbHdrsTotal = pHdr->u16CSumStart +
+                        ((PRTNETTCP)(pbFrame + pHdr->u16CSumStart))->th_off * 4;
+                    pGso->cbHdrsSeg   = pGso->cbHdrsTotal;
+                    break;
+                case PDMNETWORKGSOTYPE_IPV4_UDP:
+                    pGso->cbHdrsTotal = (uint8_t)(pHdr->u16CSumStart + sizeof(RTNETUDP));
+                    pGso->cbHdrsSeg   = pHdr->u16CSumStart;
+                    break;
+            }
+            Log4(("%s vnetTransmitPendingPackets: adjusted HdrLen to %d.\n",
+                  INSTANCE(pThis), pGso->cbHdrsTotal));
+        }
+        Log2(("%s vnetTransmitPendingPackets: gso type=%x cbHdrsTotal=%u cbHdrsSeg=%u mss=%u"
+              " off1=0x%x off2=0x%x\n", INSTANCE(pThis), pGso->u8Type,
+              pGso->cbHdrsTotal, pGso->cbHdrsSeg, pGso->cbMaxSeg, pGso->offHdr1, pGso->offHdr2));
+        STAM_REL_COUNTER_INC(&pThis->StatTransmitGSO);
+    }
+    else if (pHdr->u8Flags & VNETHDR_F_NEEDS_CSUM)
+    {
+        STAM_REL_COUNTER_INC(&pThis->StatTransmitCSum);
+        /*
+         * This is not GSO frame but checksum offloading is requested.
+         */
+        vnetCompleteChecksum(pbFrame, cbFrame, pHdr->u16CSumStart, pHdr->u16CSumOffset);
+    }
+}
+
+/**
+ * Takes the xmit lock of the driver below for a queue pair.
+ *
+ * @returns VINF_SUCCESS or VERR_TRY_AGAIN.
+ * @param   pThis           The device state structure.
+ * @param   pDrv            The driver below.
+ * @param   pPair           The queue pair wishing to transmit.
+ * @param   fOnWorkerThread Whether we're on the worker thread of the driver below.
+ */
+static int vnetTxBeginXmit(PVNETSTATE pThis, PPDMINETWORKUP pDrv, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
+{
+    int rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
+    Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
+#ifdef VNET_WITH_TX_THREADS
+    if (rc == VERR_TRY_AGAIN && pThis->cMaxQueuePairs > 1)
+    {
+        /*
+         * Another queue holds the xmit lock.  Ask it to kick our TX thread
+         * when it's done and retry in case it left before seeing the flag.
+         */
+        ASMAtomicWriteBool(&pPair->fXmitBusy, true);
+        rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
+        if (rc == VINF_SUCCESS)
+            ASMAtomicWriteBool(&pPair->fXmitBusy, false);
+    }
+#else
+    NOREF(pThis); NOREF(pPair);
+#endif
+    return rc;
+}
+
+/**
+ * Releases the xmit lock taken by vnetTxBeginXmit.
+ *
+ * @param   pThis           The device state structure.
+ * @param   pDrv            The driver below.
+ */
+static void vnetTxEndXmit(PVNETSTATE pThis, PPDMINETWORKUP pDrv)
+{
+    pDrv->pfnEndXmit(pDrv);
+#ifdef VNET_WITH_TX_THREADS
+    /* Kick the TX threads which failed to get the xmit lock while we held it. */
+    if (pThis->cMaxQueuePairs > 1)
+        for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+            if (ASMAtomicXchgBool(&pThis->aQueuePairs[i].fXmitBusy, false))
+                RTSemEventSignal(pThis->aQueuePairs[i].hTxEvent);
+#else
+    NOREF(pThis);
+#endif
+}
+
+/**
+ * Transmits the frames pending in the transmit queue of a queue pair.
+ *
+ * With a single queue pair the xmit lock of the driver below is held across
+ * the whole batch, which lets the driver push the frames on in one go.  With
+ * several pairs each frame is first gathered into the pair's bounce buffer and
+ * the lock is only taken to hand it to the driver, so the pairs read guest
+ * memory and walk their rings in parallel.
+ *
+ * @returns Number of descriptor chains consumed.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair to transmit from.
+ * @param   fOnWorkerThread Whether we're on the worker thread of the driver below.
+ */
+static unsigned vnetTransmitPendingPackets(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
 {
+    PVQUEUE  pQueue = pPair->pTxQueue;
+    unsigned cChains = 0;
+
     /*
      * Only one thread is allowed to transmit at a time, others should skip
      * transmission as the packets will be picked up by the transmitting
      * thread.
      */
-    if (!ASMAtomicCmpXchgU32(&pThis->uIsTransmitting, 1, 0))
-        return;
+    if (!ASMAtomicCmpXchgU32(&pPair->uIsTransmitting, 1, 0))
+        return 0;
 
     if ((pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK) == 0)
     {
         Log(("%s Ignoring transmit requests from non-existent driver (status=0x%x).\n",
              INSTANCE(pThis), pThis->VPCI.uStatus));
-        return;
+        ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+        return 0;
     }
 
-    PPDMINETWORKUP pDrv = pThis->pDrv;
-    if (pDrv)
+    uint8_t * const pbBounce = pPair->pbTxBuf;
+    PPDMINETWORKUP  pDrv     = pThis->pDrv;
+    if (pDrv && !pbBounce)
     {
-        int rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
-        Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
+        int rc = vnetTxBeginXmit(pThis, pDrv, pPair, fOnWorkerThread);
         if (rc == VERR_TRY_AGAIN)
         {
-            ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
-            return;
+            ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+            return 0;
         }
     }
 
@@ -1139,7 +1398,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         uHdrLen = sizeof(VNETHDR);
 
     Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets\n", INSTANCE(pThis),
-          vringReadAvailIndex(&pThis->VPCI, &pThis->pTxQueue->VRing) - pThis->pTxQueue->uNextAvailIndex));
+          vringReadAvailIndex(&pThis->VPCI, &pQueue->VRing) - pQueue->uNextAvailIndex));
 
     vpciSetWriteLed(&pThis->VPCI, true);
 
@@ -1167,7 +1426,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
             Log5(("%s vnetTransmitPendingPackets: complete frame is %u bytes.\n",
                   INSTANCE(pThis), uSize));
             Assert(uSize <= VNET_MAX_FRAME_SIZE);
-            if (pThis->pDrv)
+            if (pDrv)
             {
                 VNETHDR Hdr;
                 PDMNETWORKGSO Gso, *pGso;
@@ -1180,70 +1439,74 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                 STAM_PROFILE_START(&pThis->StatTransmitSend, a);
 
                 pGso = vnetSetupGsoCtx(&Gso, &Hdr);
-                /** @todo Optimize away the extra copying! (lazy bird) */
+                int rc;
                 PPDMSCATTERGATHER pSgBuf;
-                int rc = pThis->pDrv->pfnAllocBuf(pThis->pDrv, uSize, pGso, &pSgBuf);
-                if (RT_SUCCESS(rc))
+                if (pbBounce)
                 {
-                    Assert(pSgBuf->cSegs == 1);
-                    /* Assemble a complete frame. */
+                    /*
+                     * Assemble the frame in the bounce buffer without holding
+                     * anything, then take the xmit lock just for handing it over.
+                     */
                     for (unsigned int i = 1; i < elem.nOut; i++)
                     {
                         PDMDevHlpPhysRead(pThis->VPCI.CTX_SUFF(pDevIns), elem.aSegsOut[i].addr,
-                                          ((uint8_t*)pSgBuf->aSegs[0].pvSeg) + uOffset,
-                                          elem.aSegsOut[i].cb);
+                                          pbBounce + uOffset, elem.aSegsOut[i].cb);
                         uOffset += elem.aSegsOut[i].cb;
                     }
-                    pSgBuf->cbUsed = uSize;
-                    vnetPacketDump(pThis, (uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize, "--> Outgoing");
-                    if (pGso)
+                    vnetPacketDump(pThis, pbBounce, uSize, "--> Outgoing");
+                    vnetTxCompleteFrame(pThis, &Hdr, pGso, pbBounce, uSize);
+
+                    rc = vnetTxBeginXmit(pThis, pDrv, pPair, fOnWorkerThread);
+                    if (rc == VINF_SUCCESS)
                     {
-                        /* Some guests (RHEL) may report HdrLen excluding transport layer header! */
-                        /*
-                         * We cannot use cdHdrs provided by the guest because of different ways
-                         * it gets filled out by different versions of kernels.
-                         */
-                        //if (pGso->cbHdrs < Hdr.u16CSumStart + Hdr.u16CSumOffset + 2)
+                        rc = pDrv->pfnAllocBuf(pDrv, uSize, pGso, &pSgBuf);
+                        if (RT_SUCCESS(rc))
                         {
-                            Log4(("%s vnetTransmitPendingPackets: HdrLen before adjustment %d.\n",
-                                  INSTANCE(pThis), pGso->cbHdrsTotal));
-                            switch (pGso->u8Type)
-                            {
-                                case PDMNETWORKGSOTYPE_IPV4_TCP:
-                                case PDMNETWORKGSOTYPE_IPV6_TCP:
-                                    pGso->cbHdrsTotal = Hdr.u16CSumStart +
-                                        ((PRTNETTCP)(((uint8_t*)pSgBuf->aSegs[0].pvSeg) + Hdr.u16CSumStart))->th_off * 4;
-                                    pGso->cbHdrsSeg   = pGso->cbHdrsTotal;
-                                    break;
-                                case PDMNETWORKGSOTYPE_IPV4_UDP:
-                                    pGso->cbHdrsTotal = (uint8_t)(Hdr.u16CSumStart + sizeof(RTNETUDP));
-                                    pGso->cbHdrsSeg   = Hdr.u16CSumStart;
-                                    break;
-                            }
-                            /* Update GSO structure embedded into the frame */
-                            ((PPDMNETWORKGSO)pSgBuf->pvUser)->cbHdrsTotal = pGso->cbHdrsTotal;
-                            ((PPDMNETWORKGSO)pSgBuf->pvUser)->cbHdrsSeg   = pGso->cbHdrsSeg;
-                            Log4(("%s vnetTransmitPendingPackets: adjusted HdrLen to %d.\n",
-                                  INSTANCE(pThis), pGso->cbHdrsTotal));
+                            Assert(pSgBuf->cSegs == 1);
+                            memcpy(pSgBuf->aSegs[0].pvSeg, pbBounce, uSize);
+                            pSgBuf->cbUsed = uSize;
+                            pDrv->pfnSendBuf(pDrv, pSgBuf, false);
                         }
-                        Log2(("%s vnetTransmitPendingPackets: gso type=%x cbHdrsTotal=%u cbHdrsSeg=%u mss=%u"
-                              " off1=0x%x off2=0x%x\n", INSTANCE(pThis), pGso->u8Type,
-                              pGso->cbHdrsTotal, pGso->cbHdrsSeg, pGso->cbMaxSeg, pGso->offHdr1, pGso->offHdr2));
-                        STAM_REL_COUNTER_INC(&pThis->StatTransmitGSO);
+                        vnetTxEndXmit(pThis, pDrv);
                     }
-                    else if (Hdr.u8Flags & VNETHDR_F_NEEDS_CSUM)
+                    else
                     {
-                        STAM_REL_COUNTER_INC(&pThis->StatTransmitCSum);
-                        /*
-                         * This is not GSO frame but checksum offloading is requested.
-                         */
-                        vnetCompleteChecksum((uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize,
-                                             Hdr.u16CSumStart, Hdr.u16CSumOffset);
+                        /* The lock holder kicks our TX thread when it's done. */
+                        Log4(("virtio-net: xmit lock busy, leaving the frame in the queue\n"));
+                        STAM_PROFILE_STOP(&pThis->StatTransmitSend, a);
+                        STAM_PROFILE_ADV_STOP(&pThis->StatTransmit, a);
+                        break;
                     }
-
-                    rc = pThis->pDrv->pfnSendBuf(pThis->pDrv, pSgBuf, false);
                 }
                 else
+                {
+                    /** @todo Optimize away the extra copying! (lazy bird) */
+                    rc = pDrv->pfnAllocBuf(pDrv, uSize, pGso, &pSgBuf);
+                    if (RT_SUCCESS(rc))
+                    {
+                        Assert(pSgBuf->cSegs == 1);
+                        /* Assemble a complete frame. */
+                        for (unsigned int i = 1; i < elem.nOut; i++)
+                        {
+                            PDMDevHlpPhysRead(pThis->VPCI.CTX_SUFF(pDevIns), elem.aSegsOut[i].addr,
+                                              ((uint8_t*)pSgBuf->aSegs[0].pvSeg) + uOffset,
+                                              elem.aSegsOut[i].cb);
+                            uOffset += elem.aSegsOut[i].cb;
+                        }
+                        pSgBuf->cbUsed = uSize;
+                        vnetPacketDump(pThis, (uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize, "--> Outgoing");
+                        vnetTxCompleteFrame(pThis, &Hdr, pGso, (uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize);
+                        if (pGso)
+                        {
+                            /* Update GSO structure embedded into the frame */
+                            ((PPDMNETWORKGSO)pSgBuf->pvUser)->cbHdrsTotal = pGso->cbHdrsTotal;
+                            ((PPDMNETWORKGSO)pSgBuf->pvUser)->cbHdrsSeg   = pGso->cbHdrsSeg;
+                        }
+
+                        pDrv->pfnSendBuf(pDrv, pSgBuf, false);
+                    }
+                }
+                if (RT_FAILURE(rc))
                 {
                     Log4(("virtio-net: failed to allocate SG buffer: size=%u rc=%Rrc\n", uSize, rc));
                     STAM_PROFILE_STOP(&pThis->StatTransmitSend, a);
@@ -1261,12 +1524,14 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         vqueuePut(&pThis->VPCI, pQueue, &elem, sizeof(VNETHDR) + uOffset);
         vqueueSync(&pThis->VPCI, pQueue);
         STAM_PROFILE_ADV_STOP(&pThis->StatTransmit, a);
+        cChains++;
     }
     vpciSetWriteLed(&pThis->VPCI, false);
 
-    if (pDrv)
-        pDrv->pfnEndXmit(pDrv);
-    ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
+    if (pDrv && !pbBounce)
+        vnetTxEndXmit(pThis, pDrv);
+    ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+    return cChains;
 }
 
 /**
@@ -1275,36 +1540,48 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
 static DECLCALLBACK(void) vnetNetworkDown_XmitPending(PPDMINETWORKDOWN pInterface)
 {
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
+#ifdef VNET_WITH_TX_THREADS
+    /* The driver has buffers again, let the TX threads pick up what they had to leave behind. */
+    if (pThis->cMaxQueuePairs > 1)
+    {
+        for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+            if (vqueueIsReady(&pThis->VPCI, pThis->aQueuePairs[i].pTxQueue))
+                RTSemEventSignal(pThis->aQueuePairs[i].hTxEvent);
+        return;
+    }
+#endif
+    vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[0], false /*fOnWorkerThread*/);
 }
 
 #ifdef VNET_TX_DELAY
 
-static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
+/**
+ * Handles a TX queue kick when there is only one queue pair: transmission is
+ * delayed a little so more frames get queued before we go through the ring.
+ */
+static void vnetTxDelayKick(PVNETSTATE pThis, PVQUEUE pQueue)
 {
-    PVNETSTATE pThis = (PVNETSTATE)pvState;
-
     if (TMTimerIsActive(pThis->CTX_SUFF(pTxTimer)))
     {
         int rc = TMTimerStop(pThis->CTX_SUFF(pTxTimer));
-        Log3(("%s vnetQueueTransmit: Got kicked with notification disabled, "
+        Log3(("%s vnetTxDelayKick: Got kicked with notification disabled, "
               "re-enable notification and flush TX queue\n", INSTANCE(pThis)));
-        vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
+        vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[0], false /*fOnWorkerThread*/);
         if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-            LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
+            LogRel(("vnetTxDelayKick: Failed to enter critical section!/n"));
         else
         {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
+            vqueueSetNotification(&pThis->VPCI, pQueue, true);
             vnetCsLeave(pThis);
         }
     }
     else
     {
         if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-            LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
+            LogRel(("vnetTxDelayKick: Failed to enter critical section!/n"));
         else
         {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, false);
+            vqueueSetNotification(&pThis->VPCI, pQueue, false);
             TMTimerSetMicro(pThis->CTX_SUFF(pTxTimer), VNET_TX_DELAY);
             pThis->u64NanoTS = RTTimeNanoTS();
             vnetCsLeave(pThis);
@@ -1330,27 +1607,137 @@ static DECLCALLBACK(void) vnetTxTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void
             u32MicroDiff, pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
 
 //    Log3(("%s vnetTxTimer: Expired\n", INSTANCE(pThis)));
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
+    vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[0], false /*fOnWorkerThread*/);
     if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
     {
         LogRel(("vnetTxTimer: Failed to enter critical section!/n"));
         return;
     }
-    vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
+    vqueueSetNotification(&pThis->VPCI, pThis->aQueuePairs[0].pTxQueue, true);
+    vnetCsLeave(pThis);
+}
+
+#endif /* VNET_TX_DELAY */
+
+#ifdef VNET_WITH_TX_THREADS
+
+/**
+ * Gets the queue pair a virtqueue belongs to.
+ *
+ * The queues are laid out as RX0, TX0, RX1, TX1, ..., CTL.
+ */
+DECLINLINE(PVNETQUEUEPAIR) vnetQueuePairFromQueue(PVNETSTATE pThis, PVQUEUE pQueue)
+{
+    return &pThis->aQueuePairs[(pQueue - &pThis->VPCI.Queues[0]) / 2];
+}
+
+/**
+ * Enables or disables the TX notification of a queue pair from its TX thread.
+ *
+ * Done in the device critical section like the TX delay timer does it, so it
+ * doesn't race the guest resetting or reconfiguring the queues.
+ *
+ * @returns true if the TX queue is empty, also when the critical section could
+ *          not be entered.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair.
+ * @param   fEnabled        Whether the guest should kick the TX queue.
+ */
+static bool vnetTxThreadSetNotification(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, bool fEnabled)
+{
+    if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
+    {
+        LogRel(("vnetTxThread: Failed to enter critical section!\n"));
+        return true;
+    }
+    vqueueSetNotification(&pThis->VPCI, pPair->pTxQueue, fEnabled);
+    bool const fEmpty = vqueueIsEmpty(&pThis->VPCI, pPair->pTxQueue);
     vnetCsLeave(pThis);
+    return fEmpty;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADDEV, Transmits the frames of one queue pair.}
+ *
+ * Only used with more than one queue pair.  The guest is asked not to kick
+ * the queue while we are draining it, the notification is re-enabled once the
+ * queue has been found empty or we cannot make progress.
+ */
+static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVNETSTATE     pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        RTSemEventWait(pPair->hTxEvent, RT_INDEFINITE_WAIT);
+        if (RT_UNLIKELY(pThread->enmState != PDMTHREADSTATE_RUNNING))
+            break;
+
+        if (   !(pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK)
+            || !vqueueIsReady(&pThis->VPCI, pPair->pTxQueue))
+            continue;
+
+        vnetTxThreadSetNotification(pThis, pPair, false);
+        for (;;)
+        {
+            if (   !vnetTransmitPendingPackets(pThis, pPair, false /*fOnWorkerThread*/)
+                && !vqueueIsEmpty(&pThis->VPCI, pPair->pTxQueue))
+            {
+                /*
+                 * The driver below is busy or out of buffers.  The xmit lock
+                 * holder kicks us after pfnEndXmit, the driver calls
+                 * pfnXmitPending once it has buffers again.  Until then the
+                 * guest may kick us as well.
+                 */
+                vnetTxThreadSetNotification(pThis, pPair, true);
+                break;
+            }
+            /* Catch frames queued after the last peek but before re-enabling the notification. */
+            if (vnetTxThreadSetNotification(pThis, pPair, true))
+                break;
+            vnetTxThreadSetNotification(pThis, pPair, false);
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDEV}
+ */
+static DECLCALLBACK(int) vnetTxThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+    return RTSemEventSignal(pPair->hTxEvent);
 }
 
-#else /* !VNET_TX_DELAY */
+#endif /* VNET_WITH_TX_THREADS */
 
 static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
 {
     PVNETSTATE pThis = (PVNETSTATE)pvState;
 
-    vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
+#ifdef VNET_WITH_TX_THREADS
+    if (pThis->cMaxQueuePairs > 1)
+    {
+        PVNETQUEUEPAIR pPair = vnetQueuePairFromQueue(pThis, pQueue);
+        Log3(("%s vnetQueueTransmit: Kicking TX thread of %s\n", INSTANCE(pThis), pQueue->pcszName));
+        int rc = RTSemEventSignal(pPair->hTxEvent);
+        AssertRC(rc);
+        return;
+    }
+#endif
+#ifdef VNET_TX_DELAY
+    vnetTxDelayKick(pThis, pQueue);
+#else
+    vnetTransmitPendingPackets(pThis, &pThis->aQueuePairs[0], false /*fOnWorkerThread*/);
+#endif
 }
 
-#endif /* !VNET_TX_DELAY */
-
 static uint8_t vnetControlRx(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
 {
     uint8_t u8Ack = VNET_OK;
@@ -1504,6 +1891,37 @@ static uint8_t vnetControlVlan(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELE
     return u8Ack;
 }
 
+static uint8_t vnetControlMq(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
+{
+    uint16_t cPairs;
+
+    if (   pCtlHdr->u8Command != VNET_CTRL_CMD_MQ_VQ_PAIRS_SET
+        || !(pThis->VPCI.uGuestFeatures & VNET_F_MQ)
+        || pElem->nOut != 2
+        || pElem->aSegsOut[1].cb != sizeof(cPairs))
+    {
+        Log(("%s vnetControlMq: Segment layout is wrong or MQ not negotiated "
+             "(u8Command=%u nOut=%u cb=%u)\n", INSTANCE(pThis),
+             pCtlHdr->u8Command, pElem->nOut, pElem->aSegsOut[1].cb));
+        return VNET_ERROR;
+    }
+
+    PDMDevHlpPhysRead(pThis->VPCI.CTX_SUFF(pDevIns),
+                      pElem->aSegsOut[1].addr,
+                      &cPairs, sizeof(cPairs));
+
+    if (cPairs < 1 || cPairs > pThis->cMaxQueuePairs)
+    {
+        Log(("%s vnetControlMq: Number of queue pairs is out of range "
+             "(cPairs=%u max=%u)\n", INSTANCE(pThis), cPairs, pThis->cMaxQueuePairs));
+        return VNET_ERROR;
+    }
+
+    Log(("%s vnetControlMq: Using %u queue pairs\n", INSTANCE(pThis), cPairs));
+    pThis->cCurQueuePairs = cPairs;
+    return VNET_OK;
+}
+
 
 static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 {
@@ -1546,6 +1964,9 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
                 case VNET_CTRL_CLS_VLAN:
                     u8Ack = vnetControlVlan(pThis, &CtlHdr, &elem);
                     break;
+                case VNET_CTRL_CLS_MQ:
+                    u8Ack = vnetControlMq(pThis, &CtlHdr, &elem);
+                    break;
                 default:
                     u8Ack = VNET_ERROR;
             }
@@ -1628,6 +2049,8 @@ static DECLCALLBACK(int) vnetSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     AssertRCReturn(rc, rc);
     rc = SSMR3PutMem( pSSM, pThis->aVlanFilter, sizeof(pThis->aVlanFilter));
     AssertRCReturn(rc, rc);
+    rc = SSMR3PutU16( pSSM, pThis->cCurQueuePairs);
+    AssertRCReturn(rc, rc);
     Log(("%s State has been saved\n", INSTANCE(pThis)));
     return VINF_SUCCESS;
 }
@@ -1689,7 +2112,7 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
         && (uPass == 0 || !PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns)))
         LogRel(("%s: The mac address differs: config=%RTmac saved=%RTmac\n", INSTANCE(pThis), &pThis->macConfigured, &macConfigured));
 
-    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, VNET_N_QUEUES);
+    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, 2 * pThis->cMaxQueuePairs + 1);
     AssertRCReturn(rc, rc);
 
     if (uPass == SSM_PASS_FINAL)
@@ -1718,6 +2141,16 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             rc = SSMR3GetMem(pSSM, pThis->aVlanFilter,
                              sizeof(pThis->aVlanFilter));
             AssertRCReturn(rc, rc);
+            if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX)
+            {
+                rc = SSMR3GetU16(pSSM, &pThis->cCurQueuePairs);
+                AssertRCReturn(rc, rc);
+                if (pThis->cCurQueuePairs < 1 || pThis->cCurQueuePairs > pThis->cMaxQueuePairs)
+                    return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Invalid number of queue pairs in use: %u"),
+                                            pThis->cCurQueuePairs);
+            }
+            else
+                pThis->cCurQueuePairs = 1;
         }
         else
         {
@@ -1726,6 +2159,7 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             pThis->nMacFilterEntries = 0;
             memset(pThis->aMacFilter, 0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
             memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
+            pThis->cCurQueuePairs = 1;
             if (pThis->pDrv)
                 pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv, true);
         }
@@ -1753,6 +2187,16 @@ static DECLCALLBACK(int) vnetLoadDone(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     if (!PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns))
         vnetTempLinkDown(pThis);
 
+#ifdef VNET_WITH_TX_THREADS
+    /*
+     * A TX thread may have been draining its queue with notifications
+     * disabled when the state was saved, have them look at the queues again.
+     */
+    if (pThis->cMaxQueuePairs > 1)
+        for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+            RTSemEventSignal(pThis->aQueuePairs[i].hTxEvent);
+#endif
+
     return VINF_SUCCESS;
 }
 
@@ -1925,8 +2369,10 @@ static DECLCALLBACK(int) vnetDestruct(PPDMDEVINS pDevIns)
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
     PDMDEV_CHECK_VERSIONS_RETURN_QUIET(pDevIns);
 
+#ifdef VNET_TX_DELAY
     LogRel(("TxTimer stats (avg/min/max): %7d usec %7d usec %7d usec\n",
             pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
+#endif
     Log(("%s Destroying instance\n", INSTANCE(pThis)));
     if (pThis->hEventMoreRxDescAvail != NIL_RTSEMEVENT)
     {
@@ -1934,6 +2380,16 @@ static DECLCALLBACK(int) vnetDestruct(PPDMDEVINS pDevIns)
         RTSemEventDestroy(pThis->hEventMoreRxDescAvail);
         pThis->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
     }
+    for (unsigned i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+    {
+        if (pThis->aQueuePairs[i].hTxEvent != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pThis->aQueuePairs[i].hTxEvent);
+            pThis->aQueuePairs[i].hTxEvent = NIL_RTSEMEVENT;
+        }
+        RTMemFree(pThis->aQueuePairs[i].pbTxBuf);
+        pThis->aQueuePairs[i].pbTxBuf = NULL;
+    }
 
     // if (PDMCritSectIsInitialized(&pThis->csRx))
     //     PDMR3CritSectDelete(&pThis->csRx);
@@ -1953,18 +2409,48 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
 
     /* Initialize the instance data suffiencently for the destructor not to blow up. */
     pThis->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+    for (unsigned i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+        pThis->aQueuePairs[i].hTxEvent = NIL_RTSEMEVENT;
 
     /* Do our own locking. */
     rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
     AssertRCReturn(rc, rc);
 
-    /* Initialize PCI part. */
+    /** @cfgm{QueuePairs, uint16_t, 1}
+     * The number of RX/TX queue pairs offered to the guest.  Each pair gets its
+     * own MSI-X vectors and TX thread (a single pair transmits from the TX
+     * delay timer as before), more than one pair requires a guest driver
+     * supporting VNET_F_MQ to make any difference. */
+    rc = CFGMR3QueryU16Def(pCfg, "QueuePairs", &pThis->cMaxQueuePairs, 1);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'QueuePairs'"));
+#ifdef VNET_WITH_TX_THREADS
+    if (pThis->cMaxQueuePairs < 1 || pThis->cMaxQueuePairs > VNET_MAX_QUEUE_PAIRS)
+#else
+    if (pThis->cMaxQueuePairs != 1)
+#endif
+        return PDMDevHlpVMSetError(pDevIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: 'QueuePairs' must be between 1 and %u"),
+                                   VNET_MAX_QUEUE_PAIRS);
+    pThis->cCurQueuePairs = 1;
+
+    /* Initialize PCI part. Additional queue pairs are only useful with one MSI-X vector per queue. */
+    uint32_t const cQueues = 2 * pThis->cMaxQueuePairs + 1;
     pThis->VPCI.IBase.pfnQueryInterface    = vnetQueryInterface;
     rc = vpciConstruct(pDevIns, &pThis->VPCI, iInstance,
                        VNET_NAME_FMT, VNET_PCI_SUBSYSTEM_ID,
-                       VNET_PCI_CLASS, VNET_N_QUEUES);
-    pThis->pRxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  "RX ");
-    pThis->pTxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, "TX ");
+                       VNET_PCI_CLASS, cQueues,
+                       pThis->cMaxQueuePairs > 1 ? cQueues + 1 : 0 /* config change vector */);
+    if (RT_FAILURE(rc))
+        return rc;
+    static const char * const s_apszRxNames[VNET_MAX_QUEUE_PAIRS] = { "RX ", "RX1", "RX2", "RX3", "RX4", "RX5", "RX6", "RX7" };
+    static const char * const s_apszTxNames[VNET_MAX_QUEUE_PAIRS] = { "TX ", "TX1", "TX2", "TX3", "TX4", "TX5", "TX6", "TX7" };
+    for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        pThis->aQueuePairs[i].pRxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  s_apszRxNames[i]);
+        pThis->aQueuePairs[i].pTxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, s_apszTxNames[i]);
+    }
     pThis->pCtlQueue = vpciAddQueue(&pThis->VPCI, 16,  vnetQueueControl,  "CTL");
 
     Log(("%s Constructing new instance\n", INSTANCE(pThis)));
@@ -1972,7 +2458,7 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     /*
      * Validate configuration.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0" "QueuePairs\0"))
                     return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                             N_("Invalid configuration for VirtioNet device"));
 
@@ -2005,6 +2491,7 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     /* Initialize PCI config space */
     memcpy(pThis->config.mac.au8, pThis->macConfigured.au8, sizeof(pThis->config.mac.au8));
     pThis->config.uStatus = 0;
+    pThis->config.uMaxVirtqueuePairs = pThis->cMaxQueuePairs;
 
     /* Initialize state structure */
     pThis->u32PktNo     = 1;
@@ -2014,6 +2501,7 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     pThis->INetworkDown.pfnReceive          = vnetNetworkDown_Receive;
     pThis->INetworkDown.pfnReceiveGso       = vnetNetworkDown_ReceiveGso;
     pThis->INetworkDown.pfnXmitPending      = vnetNetworkDown_XmitPending;
+    pThis->INetworkDown.pfnGetRecvGsoCapabilities = vnetNetworkDown_GetRecvGsoCapabilities;
 
     pThis->INetworkConfig.pfnGetMac         = vnetGetMac;
     pThis->INetworkConfig.pfnGetLinkState   = vnetGetLinkState;
@@ -2028,7 +2516,8 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
 
     /* Map our ports to IO space. */
     rc = PDMDevHlpPCIIORegionRegister(pDevIns, 0,
-                                      VPCI_CONFIG + sizeof(VNetPCIConfig),
+                                      (pThis->VPCI.cMsixVectors ? VPCI_CONFIG_MSIX : VPCI_CONFIG)
+                                      + sizeof(VNetPCIConfig),
                                       PCI_ADDRESS_SPACE_IO, vnetMap);
     if (RT_FAILURE(rc))
         return rc;
@@ -2096,6 +2585,28 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     if (RT_FAILURE(rc))
         return rc;
 
+#ifdef VNET_WITH_TX_THREADS
+    /* Create the TX threads, one per queue pair.  A single pair uses the TX delay timer. */
+    for (unsigned i = 0; pThis->cMaxQueuePairs > 1 && i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        rc = RTSemEventCreate(&pPair->hTxEvent);
+        if (RT_FAILURE(rc))
+            return rc;
+        pPair->pbTxBuf = (uint8_t *)RTMemAlloc(VNET_MAX_FRAME_SIZE);
+        if (!pPair->pbTxBuf)
+            return VERR_NO_MEMORY;
+
+        char szName[16];
+        RTStrPrintf(szName, sizeof(szName), "%sTx%u", INSTANCE(pThis), i);
+        rc = PDMDevHlpThreadCreate(pDevIns, &pPair->pTxThread, pPair, vnetTxThread,
+                                   vnetTxThreadWakeUp, 0, RTTHREADTYPE_IO, szName);
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("VirtioNet: Failed to create TX thread %s"), szName);
+    }
+#endif /* VNET_WITH_TX_THREADS */
+
     rc = vnetIoCb_Reset(pThis);
     AssertRC(rc);
 
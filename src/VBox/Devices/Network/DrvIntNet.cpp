@@ -34,6 +34,7 @@
 #include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
+#include <iprt/mem.h>
 #include <iprt/memcache.h>
 #include <iprt/net.h>
 #include <iprt/semaphore.h>
@@ -142,6 +143,14 @@ typedef struct DRVINTNET
     bool                            fActivateEarlyDeactivateLate;
     /** Padding. */
     bool                            afReserved[HC_ARCH_BITS == 64 ? 3 : 3];
+    /** Number of frames committed to the send ring in ring-3 which haven't
+     * been pushed thru the switch yet.  Owned by the XmitLock. */
+    uint32_t                        cXmitBatched;
+    /** Max number of frames to batch up in ring-3 before calling ring-0
+     * (MaxXmitBatch). */
+    uint32_t                        cMaxXmitBatch;
+    /** Receive coalescing state, NULL if disabled.  Receive thread only. */
+    R3PTRTYPE(PPDMNETGRO)           pGroR3;
     /** Scratch space for holding the ring-0 scatter / gather descriptor.
      * The PDMSCATTERGATHER::fFlags member is used to indicate whether it is in
      * use or not.  Always accessed while owning the XmitLock. */
@@ -157,6 +166,10 @@ typedef struct DRVINTNET
     STAMCOUNTER                     StatSentGso;
     /** Number of GSO packets received. */
     STAMCOUNTER                     StatReceivedGso;
+    /** Number of coalesced frames passed up. */
+    STAMCOUNTER                     StatReceivedGro;
+    /** Number of received segments that went into coalesced frames. */
+    STAMCOUNTER                     StatReceivedGroSegs;
     /** Number of packets send from ring-0. */
     STAMCOUNTER                     StatSentR0;
     /** The number of times we've had to wake up the xmit thread to continue the
@@ -291,6 +304,8 @@ DECLINLINE(int) drvIntNetProcessXmit(PDRVINTNET pThis)
     Assert(PDMCritSectIsOwner(&pThis->XmitLock));
 
 #ifdef IN_RING3
+    pThis->cXmitBatched = 0;
+
     INTNETIFSENDREQ SendReq;
     SendReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
     SendReq.Hdr.cbReq = sizeof(SendReq);
@@ -503,7 +518,16 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
      */
     PINTNETHDR pHdr = (PINTNETHDR)pSgBuf->pvAllocator;
     IntNetRingCommitFrameEx(&pThis->CTX_SUFF(pBuf)->Send, pHdr, pSgBuf->cbUsed);
+#ifdef IN_RING3
+    /* Calling ring-0 is expensive, so let the frames of a burst pile up and
+       push them all thru the switch in one go when the batch is full or
+       in drvIntNetUp_EndXmit. */
+    int rc = VINF_SUCCESS;
+    if (++pThis->cXmitBatched >= pThis->cMaxXmitBatch)
+        rc = drvIntNetProcessXmit(pThis);
+#else
     int rc = drvIntNetProcessXmit(pThis);
+#endif
     STAM_PROFILE_STOP(&pThis->StatTransmit, a);
 
     /*
@@ -525,6 +549,11 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
 PDMBOTHCBDECL(void) drvIntNetUp_EndXmit(PPDMINETWORKUP pInterface)
 {
     PDRVINTNET pThis = RT_FROM_MEMBER(pInterface, DRVINTNET, CTX_SUFF(INetworkUp));
+#ifdef IN_RING3
+    /* Flush frames batched up by drvIntNetUp_SendBuf. */
+    if (pThis->cXmitBatched)
+        drvIntNetProcessXmit(pThis);
+#endif
     ASMAtomicUoWriteBool(&pThis->fXmitOnXmitThread, false);
     PDMCritSectLeave(&pThis->XmitLock);
 }
@@ -665,6 +694,115 @@ static int drvR3IntNetRecvWaitForSpace(PDRVINTNET pThis)
 }
 
 
+/**
+ * Segments a GSO frame and passes the segments up one by one.
+ *
+ * This is where we do the offloading for devices which do not support large
+ * receive offload (LRO).
+ *
+ * @param   pThis       The driver instance data.
+ * @param   pGso        The GSO context.
+ * @param   pbFrame     The GSO frame.  This is trashed.
+ * @param   cbFrame     The size of the GSO frame.
+ */
+static void drvR3IntNetRecvSegmentGso(PDRVINTNET pThis, PCPDMNETWORKGSO pGso, uint8_t *pbFrame, uint32_t cbFrame)
+{
+    uint8_t         abHdrScratch[256];
+    uint32_t const  cSegs = PDMNetGsoCalcSegmentCount(pGso, cbFrame);
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+    {
+        uint32_t cbSegFrame;
+        void    *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, pbFrame, cbFrame, abHdrScratch,
+                                                      iSeg, cSegs, &cbSegFrame);
+        int rc = drvR3IntNetRecvWaitForSpace(pThis);
+        if (RT_FAILURE(rc))
+        {
+            Log(("drvR3IntNetRecvSegmentGso: drvR3IntNetRecvWaitForSpace -> %Rrc; iSeg=%u cSegs=%u\n", rc, iSeg, cSegs));
+            break; /* we drop the rest. */
+        }
+        rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvSegFrame, cbSegFrame);
+        AssertRC(rc);
+    }
+}
+
+
+/**
+ * Passes up the frame being coalesced, if any.
+ *
+ * The frame is dropped if there is no room for it (or waiting for space
+ * fails), the caller will run into the same condition with the next frame and
+ * deal with it.
+ *
+ * @param   pThis       The driver instance data.
+ * @param   fMayWait    Whether to wait for the device above to make room.  The
+ *                      receive thread must not block when the state changes.
+ */
+static void drvR3IntNetRecvGroFlush(PDRVINTNET pThis, bool fMayWait)
+{
+    PPDMNETGRO pGro = pThis->pGroR3;
+    if (!pGro || !pGro->cSegs)
+        return;
+
+    int rc = pThis->pIAboveNet->pfnWaitReceiveAvail(pThis->pIAboveNet, 0);
+    if (rc != VINF_SUCCESS && fMayWait)
+        rc = drvR3IntNetRecvWaitForSpace(pThis);
+    if (RT_SUCCESS(rc))
+    {
+        PCPDMNETWORKGSO pGso = PDMNetGroFinish(pGro);
+        if (!pGso)
+            rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pGro->abFrame, pGro->cbFrame);
+        else
+        {
+            STAM_COUNTER_INC(&pThis->StatReceivedGro);
+            STAM_COUNTER_ADD(&pThis->StatReceivedGroSegs, pGro->cSegs);
+            rc = pThis->pIAboveNet->pfnReceiveGso(pThis->pIAboveNet, pGro->abFrame, pGro->cbFrame, pGso);
+            if (RT_FAILURE(rc))
+            {
+                /* The guest turned off large receive since we last asked. */
+                drvR3IntNetRecvSegmentGso(pThis, pGso, pGro->abFrame, pGro->cbFrame);
+                rc = VINF_SUCCESS;
+            }
+        }
+        AssertRC(rc);
+    }
+    else
+        Log(("drvR3IntNetRecvGroFlush: no room (%Rrc); dropping %u segments\n", rc, pGro->cSegs));
+    PDMNetGroReset(pGro);
+}
+
+
+/**
+ * Tries to coalesce a received frame with the ones before it.
+ *
+ * @returns true if the frame was taken, false if it should be passed up as it
+ *          is (nothing is pending then).
+ * @param   pThis       The driver instance data.
+ * @param   fGsoCaps    What PDMINETWORKDOWN::pfnGetRecvGsoCapabilities
+ *                      returned, not 0.
+ * @param   pvFrame     The frame.
+ * @param   cbFrame     The frame size.
+ */
+static bool drvR3IntNetRecvGro(PDRVINTNET pThis, uint32_t fGsoCaps, void const *pvFrame, uint32_t cbFrame)
+{
+    PPDMNETGRO pGro = pThis->pGroR3;
+    if (PDMNetGroAppend(pGro, pvFrame, cbFrame))
+    {
+        if (pGro->fClosed)
+            drvR3IntNetRecvGroFlush(pThis, true /*fMayWait*/);
+        return true;
+    }
+    drvR3IntNetRecvGroFlush(pThis, true /*fMayWait*/);
+    if (!PDMNetGroStart(pGro, pvFrame, cbFrame))
+        return false;
+
+    /* E.g. a TCPv6 flow when the guest only takes large TCPv4 frames. */
+    if (fGsoCaps & RT_BIT_32(pGro->Gso.u8Type))
+        return true;
+    PDMNetGroReset(pGro);
+    return false;
+}
+
+
 /**
  * Executes async I/O (RUNNING mode).
  *
@@ -685,6 +823,16 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
     PINTNETRINGBUF  pRingBuf = &pBuf->Recv;
     for (;;)
     {
+        /*
+         * Only coalesce if the guest currently takes large frames, it's a
+         * waste of copying and checksumming otherwise.  This can change
+         * whenever the guest driver resets the device, so ask each round.
+         */
+        uint32_t const fGsoCaps = pThis->pGroR3
+                                ? pThis->pIAboveNet->pfnGetRecvGsoCapabilities(pThis->pIAboveNet)
+                                  & (RT_BIT_32(PDMNETWORKGSOTYPE_IPV4_TCP) | RT_BIT_32(PDMNETWORKGSOTYPE_IPV6_TCP))
+                                : 0;
+
         /*
          * Process the receive buffer.
          */
@@ -696,6 +844,7 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
              */
             if (pThis->enmRecvState != RECVSTATE_RUNNING)
             {
+                drvR3IntNetRecvGroFlush(pThis, false /*fMayWait*/);
                 STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
                 LogFlow(("drvR3IntNetRecvRun: returns VERR_STATE_CHANGED (state changed - #0)\n"));
                 return VERR_STATE_CHANGED;
@@ -707,6 +856,23 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
                      || u8Type == INTNETHDR_TYPE_GSO)
                 &&  !pThis->fLinkDown)
             {
+                /*
+                 * Coalesce TCP segments if the device above takes large frames.
+                 */
+                if (pThis->pGroR3)
+                {
+                    if (u8Type == INTNETHDR_TYPE_FRAME && fGsoCaps)
+                    {
+                        if (drvR3IntNetRecvGro(pThis, fGsoCaps, IntNetHdrGetFramePtr(pHdr, pBuf), pHdr->cbFrame))
+                        {
+                            IntNetRingSkipFrame(pRingBuf);
+                            continue;
+                        }
+                    }
+                    else
+                        drvR3IntNetRecvGroFlush(pThis, true /*fMayWait*/);
+                }
+
                 /*
                  * Check if there is room for the frame and pass it up.
                  */
@@ -752,21 +918,14 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
                                                                             pHdr->cbFrame - sizeof(PDMNETWORKGSO),
                                                                             pGso)))
                             {
-                                /*
-                                 *
-                                 * This is where we do the offloading since this NIC
-                                 * does not support large receive offload (LRO).
-                                 */
                                 cbFrame -= sizeof(PDMNETWORKGSO);
-
-                                uint8_t         abHdrScratch[256];
-                                uint32_t const  cSegs = PDMNetGsoCalcSegmentCount(pGso, cbFrame);
 #ifdef LOG_ENABLED
                                 if (LogIsEnabled())
                                 {
                                     uint64_t u64Now = RTTimeProgramNanoTS();
                                     LogFlow(("drvR3IntNetRecvRun: %-4d bytes at %llu ns  deltas: r=%llu t=%llu; GSO - %u segs\n",
-                                             cbFrame, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS, cSegs));
+                                             cbFrame, u64Now, u64Now - pThis->u64LastReceiveTS, u64Now - pThis->u64LastTransferTS,
+                                             PDMNetGsoCalcSegmentCount(pGso, cbFrame)));
                                     pThis->u64LastReceiveTS = u64Now;
                                     Log2(("drvR3IntNetRecvRun: cbFrame=%#x type=%d cbHdrsTotal=%#x cbHdrsSeg=%#x Hdr1=%#x Hdr2=%#x MMS=%#x\n"
                                           "%.*Rhxd\n",
@@ -774,20 +933,7 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
                                           cbFrame - sizeof(*pGso), pGso + 1));
                                 }
 #endif
-                                for (size_t iSeg = 0; iSeg < cSegs; iSeg++)
-                                {
-                                    uint32_t cbSegFrame;
-                                    void    *pvSegFrame = PDMNetGsoCarveSegmentQD(pGso, (uint8_t *)(pGso + 1), cbFrame, abHdrScratch,
-                                                                                  iSeg, cSegs, &cbSegFrame);
-                                    rc = drvR3IntNetRecvWaitForSpace(pThis);
-                                    if (RT_FAILURE(rc))
-                                    {
-                                        Log(("drvR3IntNetRecvRun: drvR3IntNetRecvWaitForSpace -> %Rrc; iSeg=%u cSegs=%u\n", iSeg, cSegs));
-                                        break; /* we drop the rest. */
-                                    }
-                                    rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvSegFrame, cbSegFrame);
-                                    AssertRC(rc);
-                                }
+                                drvR3IntNetRecvSegmentGso(pThis, pGso, (uint8_t *)(pGso + 1), (uint32_t)cbFrame);
                             }
                         }
                         else
@@ -828,14 +974,21 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
             else
             {
                 /*
-                 * Link down or unknown frame - skip to the next frame.
+                 * Link down or unknown frame - skip to the next frame.  The
+                 * segments coalesced so far are still passed up first.
                  */
+                drvR3IntNetRecvGroFlush(pThis, true /*fMayWait*/);
                 AssertMsg(IntNetIsValidFrameType(pHdr->u8Type), ("Unknown frame type %RX16! offRead=%#x\n", pHdr->u8Type, pRingBuf->offReadX));
                 IntNetRingSkipFrame(pRingBuf);
                 STAM_REL_COUNTER_INC(&pBuf->cStatBadFrames);
             }
         } /* while more received data */
 
+        /*
+         * Pass up what we've coalesced before blocking.
+         */
+        drvR3IntNetRecvGroFlush(pThis, true /*fMayWait*/);
+
         /*
          * Wait for data, checking the state before we block.
          */
@@ -1218,11 +1371,15 @@ static DECLCALLBACK(void) drvR3IntNetDestruct(PPDMDRVINS pDrvIns)
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatYieldsNok);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatLost);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatBadFrames);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatRecvWakeups);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->cStatSendBatches);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatSend1);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatSend2);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatRecv1);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatRecv2);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceivedGso);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceivedGro);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceivedGroSegs);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatSentGso);
 #ifdef VBOX_WITH_STATISTICS
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceive);
@@ -1261,6 +1418,9 @@ static DECLCALLBACK(void) drvR3IntNetDestruct(PPDMDRVINS pDrvIns)
     RTMemCacheDestroy(pThis->hSgCache);
     pThis->hSgCache = NIL_RTMEMCACHE;
 
+    RTMemFree(pThis->pGroR3);
+    pThis->pGroR3 = NULL;
+
     if (PDMCritSectIsInitialized(&pThis->XmitLock))
         PDMR3CritSectDelete(&pThis->XmitLock);
 }
@@ -1382,6 +1542,8 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
                                   "|TrunkType"
                                   "|ReceiveBufferSize"
                                   "|SendBufferSize"
+                                  "|MaxXmitBatch"
+                                  "|ReceiveCoalescing"
                                   "|SharedMacOnWire"
                                   "|RestrictAccess"
                                   "|RequireExactPolicyMatch"
@@ -1641,6 +1803,39 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     if (OpenReq.cbSend < VBOX_MAX_GSO_SIZE * 3)
         LogRel(("DrvIntNet: Warning! SendBufferSize=%u, Recommended minimum size %u butes.\n", OpenReq.cbSend, VBOX_MAX_GSO_SIZE * 4));
 
+    /** @cfgm{MaxXmitBatch, uint32_t, 32}
+     * The max number of frames sent from ring-3 that are batched up before
+     * calling ring-0 to push them thru the switch.  The batch is also
+     * flushed at the end of each transmit run.  1 disables batching.
+     */
+    rc = CFGMR3QueryU32Def(pCfg, "MaxXmitBatch", &pThis->cMaxXmitBatch, 32);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"MaxXmitBatch\" value"));
+    if (pThis->cMaxXmitBatch < 1)
+        return PDMDRV_SET_ERROR(pDrvIns, VERR_INVALID_PARAMETER,
+                                N_("Configuration error: The \"MaxXmitBatch\" value must be at least 1"));
+
+    /** @cfgm{ReceiveCoalescing, boolean, true}
+     * Whether to coalesce received TCP segments into GSO frames for devices
+     * that can pass those on to the guest (PDMINETWORKDOWN::pfnReceiveGso).
+     * Only done while PDMINETWORKDOWN::pfnGetRecvGsoCapabilities says so.
+     */
+    bool fReceiveCoalescing;
+    rc = CFGMR3QueryBoolDef(pCfg, "ReceiveCoalescing", &fReceiveCoalescing, true);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"ReceiveCoalescing\" value"));
+    if (   fReceiveCoalescing
+        && pThis->pIAboveNet->pfnReceiveGso
+        && pThis->pIAboveNet->pfnGetRecvGsoCapabilities)
+    {
+        pThis->pGroR3 = (PPDMNETGRO)RTMemAlloc(sizeof(PDMNETGRO));
+        if (!pThis->pGroR3)
+            return VERR_NO_MEMORY;
+        PDMNetGroReset(pThis->pGroR3);
+    }
+
     /** @cfgm{IsService, boolean, true}
      * This alterns the way the thread is suspended and resumed. When it's being used by
      * a service such as LWIP/iSCSI it shouldn't suspend immediately like for a NIC.
@@ -1785,6 +1980,8 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->Recv.cStatFrames,   "Packets/Received",     "Number of received packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->Send.cStatFrames,   "Packets/Sent",         "Number of sent packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatReceivedGso,            "Packets/Received-Gso", "The GSO portion of the received packets.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatReceivedGro,            "Packets/Received-Gro", "Number of coalesced frames passed up.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatReceivedGroSegs,        "Packets/Received-GroSegs", "Number of received segments that went into coalesced frames.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatSentGso,                "Packets/Sent-Gso",     "The GSO portion of the sent packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatSentR0,                 "Packets/Sent-R0",      "The ring-0 portion of the sent packets.");
 
@@ -1792,6 +1989,8 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatYieldsNok,     "YieldOk",              "Number of times yielding helped fix an overflow.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatYieldsOk,      "YieldNok",             "Number of times yielding didn't help fix an overflow.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatBadFrames,     "BadFrames",            "Number of bad frames seed by the consumers.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatRecvWakeups,   "RecvWakeups",          "Number of times the receive thread was signalled about new frames.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->pBufR3->cStatSendBatches,   "SendBatches",          "Number of ring-0 send calls that found frames to send.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatSend1,          "Send1",                "Profiling IntNetR0IfSend.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatSend2,          "Send2",                "Profiling sending to the trunk.");
     PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->pBufR3->StatRecv1,          "Recv1",                "Reserved for future receive profiling.");
@@ -237,6 +237,18 @@ static DECLCALLBACK(int) drvR3NetShaperDown_ReceiveGso(PPDMINETWORKDOWN pInterfa
 }
 
 
+/**
+ * @interface_method_impl{PDMINETWORKDOWN,pfnGetRecvGsoCapabilities}
+ */
+static DECLCALLBACK(uint32_t) drvR3NetShaperDown_GetRecvGsoCapabilities(PPDMINETWORKDOWN pInterface)
+{
+    PDRVNETSHAPER pThis = RT_FROM_MEMBER(pInterface, DRVNETSHAPER, INetworkDown);
+    if (pThis->pIAboveNet->pfnGetRecvGsoCapabilities)
+        return pThis->pIAboveNet->pfnGetRecvGsoCapabilities(pThis->pIAboveNet);
+    return 0;
+}
+
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnXmitPending}
  */
@@ -436,6 +448,7 @@ static DECLCALLBACK(int) drvR3NetShaperConstruct(PPDMDRVINS pDrvIns, PCFGMNODE p
     pThis->INetworkDown.pfnReceive                  = drvR3NetShaperDown_Receive;
     pThis->INetworkDown.pfnReceiveGso               = drvR3NetShaperDown_ReceiveGso;
     pThis->INetworkDown.pfnXmitPending              = drvR3NetShaperDown_XmitPending;
+    pThis->INetworkDown.pfnGetRecvGsoCapabilities   = drvR3NetShaperDown_GetRecvGsoCapabilities;
     /* INetworkConfig */
     pThis->INetworkConfig.pfnGetMac                 = drvR3NetShaperDownCfg_GetMac;
     pThis->INetworkConfig.pfnGetLinkState           = drvR3NetShaperDownCfg_GetLinkState;
@@ -535,6 +548,9 @@ static DECLCALLBACK(int) drvR3NetShaperConstruct(PPDMDRVINS pDrvIns, PCFGMNODE p
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitPktsGranted,    "Packets/Tx/Granted",   "Number of granted TX packets.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitPendingCalled,  "Tx/WakeUp",            "Number of wakeup TX calls.");
 
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->Filter.StatDeniedFairness, "Tx/DeniedFairness", "Number of times TX was denied to let other filters in the group have their share.");
+    PDMDrvHlpSTAMRegProfileEx(pDrvIns, &pThis->Filter.StatDelay, "Tx/Delay", STAMUNIT_NS_PER_OCCURENCE, "Time TX spent waiting for bandwidth.");
+
     return VINF_SUCCESS;
 }
 
@@ -60,6 +60,13 @@
 /** The wakeup bit in the INTNETIF::cBusy and INTNETRUNKIF::cBusy counters. */
 #define INTNET_BUSY_WAKEUP_MASK     RT_BIT_32(30)
 
+/** The number of bits in the MAC address hash (INTNETMACTAB::aiHash). */
+#define INTNET_MACTAB_HASH_BITS     8
+/** The number of buckets in the MAC address hash. */
+#define INTNET_MACTAB_HASH_SIZE     RT_BIT_32(INTNET_MACTAB_HASH_BITS)
+/** Chain terminator for INTNETMACTAB::aiHash and INTNETMACTABENTRY::iHashNext. */
+#define INTNET_MACTAB_HASH_NIL      UINT32_MAX
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -82,6 +89,9 @@ typedef struct INTNETMACTABENTRY
     bool                    fActive;
     /** Pointer to the network interface. */
     struct INTNETIF        *pIf;
+    /** The index of the next entry in the same hash bucket,
+     * INTNET_MACTAB_HASH_NIL if last. */
+    uint32_t                iHashNext;
 } INTNETMACTABENTRY;
 /** Pointer to a MAC address lookup table entry. */
 typedef INTNETMACTABENTRY *PINTNETMACTABENTRY;
@@ -127,6 +137,15 @@ typedef struct INTNETMACTAB
 
     /** Pointer to the trunk interface. */
     struct INTNETTRUNKIF   *pTrunk;
+
+    /** The number of entries with a dummy MAC address.  These are not
+     * hashed and will see all unicast traffic. */
+    uint32_t                cDummyEntries;
+    /** MAC address hash, index of the first entry in each bucket.
+     * Rebuilt by intnetR0MacTabRehash whenever entries are added, removed or
+     * change their address, so unicast lookups can skip the linear scan when
+     * there are no promiscuous or dummy entries. */
+    uint32_t                aiHash[INTNET_MACTAB_HASH_SIZE];
 } INTNETMACTAB;
 /** Pointer to a MAC address .  */
 typedef INTNETMACTAB *PINTNETMACTAB;
@@ -256,6 +275,9 @@ typedef struct INTNETIF
     RTSEMEVENT volatile     hRecvEvent;
     /** Number of threads sleeping on the event semaphore. */
     uint32_t                cSleepers;
+    /** Set when hRecvEvent has been signalled for new frames and the receiver
+     * hasn't returned from IntNetR0IfWait since.  See intnetR0IfNotifyRecv. */
+    bool volatile           fRecvSignalled;
     /** The interface handle.
      * When this is INTNET_HANDLE_INVALID a sleeper which is waking up
      * should return with the appropriate error condition. */
@@ -1438,6 +1460,89 @@ DECL_FORCE_INLINE(bool) intnetR0AreMacAddrsEqual(PCRTMAC pDstAddr1, PCRTMAC pDst
 }
 
 
+/**
+ * Calculates the MAC address hash bucket.
+ *
+ * @returns Index into INTNETMACTAB::aiHash.
+ * @param   pMacAddr            The address.
+ */
+DECL_FORCE_INLINE(uint32_t) intnetR0MacTabHash(PCRTMAC pMacAddr)
+{
+    /* The OUI is usually the same for all interfaces, so only use the NIC
+       specific part of the address. */
+    uint32_t u = ((uint32_t)pMacAddr->au8[3] << 16) | ((uint32_t)pMacAddr->au8[4] << 8) | pMacAddr->au8[5];
+    return (u * UINT32_C(0x9e3779b1)) >> (32 - INTNET_MACTAB_HASH_BITS);
+}
+
+
+/**
+ * Rebuilds the MAC address hash of the table.
+ *
+ * Must be called with the network spinlock held after any change to the set
+ * of entries (add, remove, reallocation) or to the address of an entry.
+ *
+ * @param   pTab                The MAC address table.
+ */
+static void intnetR0MacTabRehash(PINTNETMACTAB pTab)
+{
+    for (uint32_t i = 0; i < RT_ELEMENTS(pTab->aiHash); i++)
+        pTab->aiHash[i] = INTNET_MACTAB_HASH_NIL;
+
+    uint32_t cDummy = 0;
+    uint32_t iIfMac = pTab->cEntries;
+    while (iIfMac-- > 0)
+    {
+        PINTNETMACTABENTRY pEntry = &pTab->paEntries[iIfMac];
+        if (intnetR0IsMacAddrDummy(&pEntry->MacAddr))
+        {
+            pEntry->iHashNext = INTNET_MACTAB_HASH_NIL;
+            cDummy++;
+            continue;
+        }
+        uint32_t const iBucket = intnetR0MacTabHash(&pEntry->MacAddr);
+        pEntry->iHashNext      = pTab->aiHash[iBucket];
+        pTab->aiHash[iBucket]  = iIfMac;
+    }
+    pTab->cDummyEntries = cDummy;
+}
+
+
+/**
+ * Checks whether unicast switching can use the MAC address hash instead of
+ * scanning all entries.
+ *
+ * @returns true if only exact address matches can receive the frame.
+ * @param   pTab                The MAC address table.
+ */
+DECL_FORCE_INLINE(bool) intnetR0MacTabCanUseHash(PINTNETMACTAB pTab)
+{
+    return pTab->cPromiscuousEntries == 0
+        && pTab->cDummyEntries       == 0;
+}
+
+
+/**
+ * Looks up the first active entry with the given MAC address using the hash.
+ *
+ * @returns Entry index, INTNET_MACTAB_HASH_NIL if not found.
+ * @param   pTab                The MAC address table.
+ * @param   pMacAddr            The address to look for.
+ */
+DECL_FORCE_INLINE(uint32_t) intnetR0MacTabLookup(PINTNETMACTAB pTab, PCRTMAC pMacAddr)
+{
+    uint32_t iIfMac = pTab->aiHash[intnetR0MacTabHash(pMacAddr)];
+    while (iIfMac != INTNET_MACTAB_HASH_NIL)
+    {
+        Assert(iIfMac < pTab->cEntries);
+        if (   pTab->paEntries[iIfMac].fActive
+            && intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pMacAddr))
+            break;
+        iIfMac = pTab->paEntries[iIfMac].iHashNext;
+    }
+    return iIfMac;
+}
+
+
 /**
  * Switch a unicast frame based on the network layer address (OSI level 3) and
  * return a destination table.
@@ -1570,33 +1675,46 @@ static INTNETSWDECISION intnetR0NetworkPreSwitchUnicast(PINTNETNETWORK pNetwork,
     PINTNETMACTAB       pTab            = &pNetwork->MacTab;
     RTSpinlockAcquire(pNetwork->hAddrSpinlock);
 
-    /* Iterate the internal network interfaces and look for matching source and
-       destination addresses. */
-    uint32_t iIfMac = pTab->cEntries;
-    while (iIfMac-- > 0)
+    if (intnetR0MacTabCanUseHash(pTab))
     {
-        if (pTab->paEntries[iIfMac].fActive)
+        /* No dummy or promiscuous entries, so only the address matches count. */
+        if (   (   !pSrcAddr
+                || intnetR0MacTabLookup(pTab, pSrcAddr) == INTNET_MACTAB_HASH_NIL)
+            && intnetR0MacTabLookup(pTab, pDstAddr) != INTNET_MACTAB_HASH_NIL)
+            enmSwDecision = pTab->fHostPromiscuousEff && fSrc == INTNETTRUNKDIR_WIRE
+                          ? INTNETSWDECISION_BROADCAST
+                          : INTNETSWDECISION_INTNET;
+    }
+    else
+    {
+        /* Iterate the internal network interfaces and look for matching source and
+           destination addresses. */
+        uint32_t iIfMac = pTab->cEntries;
+        while (iIfMac-- > 0)
         {
-            /* Unknown interface address? */
-            if (intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr))
-                break;
+            if (pTab->paEntries[iIfMac].fActive)
+            {
+                /* Unknown interface address? */
+                if (intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr))
+                    break;
 
-            /* Promiscuous mode? */
-            if (pTab->paEntries[iIfMac].fPromiscuousSeeTrunk)
-                break;
+                /* Promiscuous mode? */
+                if (pTab->paEntries[iIfMac].fPromiscuousSeeTrunk)
+                    break;
 
-            /* Paranoia - this shouldn't happen, right? */
-            if (    pSrcAddr
-                &&  intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pSrcAddr))
-                break;
+                /* Paranoia - this shouldn't happen, right? */
+                if (    pSrcAddr
+                    &&  intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pSrcAddr))
+                    break;
 
-            /* Exact match? */
-            if (intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr))
-            {
-                enmSwDecision = pTab->fHostPromiscuousEff && fSrc == INTNETTRUNKDIR_WIRE
-                              ? INTNETSWDECISION_BROADCAST
-                              : INTNETSWDECISION_INTNET;
-                break;
+                /* Exact match? */
+                if (intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr))
+                {
+                    enmSwDecision = pTab->fHostPromiscuousEff && fSrc == INTNETTRUNKDIR_WIRE
+                                  ? INTNETSWDECISION_BROADCAST
+                                  : INTNETSWDECISION_INTNET;
+                    break;
+                }
             }
         }
     }
@@ -1636,19 +1754,18 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
 
     /* Find exactly matching or promiscuous interfaces. */
     uint32_t cExactHits = 0;
-    uint32_t iIfMac     = pTab->cEntries;
-    while (iIfMac-- > 0)
+    uint32_t iIfMac;
+    if (intnetR0MacTabCanUseHash(pTab))
     {
-        if (pTab->paEntries[iIfMac].fActive)
+        /* Only exact matches, walk the hash chain. */
+        iIfMac = pTab->aiHash[intnetR0MacTabHash(pDstAddr)];
+        while (iIfMac != INTNET_MACTAB_HASH_NIL)
         {
-            bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
-            if (   fExact
-                || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
-                || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
-                    || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
-               )
+            Assert(iIfMac < pTab->cEntries);
+            if (   pTab->paEntries[iIfMac].fActive
+                && intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr))
             {
-                cExactHits += fExact;
+                cExactHits++;
 
                 PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;        AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
                 if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
@@ -1659,6 +1776,35 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
                     intnetR0BusyIncIf(pIf);
                 }
             }
+            iIfMac = pTab->paEntries[iIfMac].iHashNext;
+        }
+    }
+    else
+    {
+        iIfMac = pTab->cEntries;
+        while (iIfMac-- > 0)
+        {
+            if (pTab->paEntries[iIfMac].fActive)
+            {
+                bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
+                if (   fExact
+                    || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
+                    || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
+                        || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
+                   )
+                {
+                    cExactHits += fExact;
+
+                    PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;    AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+                    if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
+                    {
+                        uint32_t iIfDst = pDstTab->cIfs++;
+                        pDstTab->aIfs[iIfDst].pIf            = pIf;
+                        pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
+                        intnetR0BusyIncIf(pIf);
+                    }
+                }
+            }
         }
     }
 
@@ -2599,6 +2745,27 @@ static int intnetR0RingWriteFrame(PINTNETRINGBUF pRingBuf, PCINTNETSG pSG, PCRTM
 }
 
 
+/**
+ * Notifies the receiver of an interface that there are new frames in its
+ * receive ring.
+ *
+ * The event semaphore is only signalled for the first frame after the
+ * receiver last woke up in IntNetR0IfWait.  Until it gets back there, it will
+ * find any further frames in the ring anyway, so signalling the semaphore
+ * for each of them is just overhead.
+ *
+ * @param   pIf             The interface.
+ */
+DECLINLINE(void) intnetR0IfNotifyRecv(PINTNETIF pIf)
+{
+    if (!ASMAtomicXchgBool(&pIf->fRecvSignalled, true))
+    {
+        STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatRecvWakeups);
+        RTSemEventSignal(pIf->hRecvEvent);
+    }
+}
+
+
 /**
  * Sends a frame to a specific interface.
  *
@@ -2618,7 +2785,7 @@ static void intnetR0IfSend(PINTNETIF pIf, PINTNETIF pIfSender, PINTNETSG pSG, PC
     if (RT_SUCCESS(rc))
     {
         pIf->cYields = 0;
-        RTSemEventSignal(pIf->hRecvEvent);
+        intnetR0IfNotifyRecv(pIf);
         return;
     }
 
@@ -3644,7 +3811,10 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
 
         PINTNETMACTABENTRY pIfEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIfSender);
         if (pIfEntry)
+        {
             pIfEntry->MacAddr = EthHdr.SrcMac;
+            intnetR0MacTabRehash(&pNetwork->MacTab);
+        }
         pIfSender->MacAddr    = EthHdr.SrcMac;
 
         RTSpinlockReleaseNoInts(pNetwork->hAddrSpinlock);
@@ -3741,6 +3911,7 @@ INTNETR0DECL(int) IntNetR0IfSend(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession)
              * Process the send buffer.
              */
             INTNETSWDECISION    enmSwDecision = INTNETSWDECISION_BROADCAST;
+            uint32_t            cFrames       = 0;
             INTNETSG            Sg; /** @todo this will have to be changed if we're going to use async sending
                                      * with buffer sharing for some OS or service. Darwin copies everything so
                                      * I won't bother allocating and managing SGs right now. Sorry. */
@@ -3791,7 +3962,10 @@ INTNETR0DECL(int) IntNetR0IfSend(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession)
 
                 /* Skip to the next frame. */
                 IntNetRingSkipFrame(&pIf->pIntBuf->Send);
+                cFrames++;
             }
+            if (cFrames)
+                STAM_REL_COUNTER_INC(&pIf->pIntBuf->cStatSendBatches);
 
             /*
              * Put back the destination table.
@@ -4092,7 +4266,10 @@ INTNETR0DECL(int) IntNetR0IfSetMacAddress(INTNETIFHANDLE hIf, PSUPDRVSESSION pSe
             /* Update the two copies. */
             PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf); Assert(pEntry);
             if (RT_LIKELY(pEntry))
+            {
                 pEntry->MacAddr = *pMac;
+                intnetR0MacTabRehash(&pNetwork->MacTab);
+            }
             pIf->MacAddr        = *pMac;
             pIf->fMacSet        = true;
 
@@ -4350,6 +4527,10 @@ INTNETR0DECL(int) IntNetR0IfWait(INTNETIFHANDLE hIf, PSUPDRVSESSION pSession, ui
      */
     ASMAtomicIncU32(&pIf->cSleepers);
     int rc = RTSemEventWaitNoResume(hRecvEvent, cMillies);
+
+    /* Re-arm the receive notification before the caller drains the ring,
+       see intnetR0IfNotifyRecv. */
+    ASMAtomicWriteBool(&pIf->fRecvSignalled, false);
     if (pIf->hRecvEvent == hRecvEvent)
     {
         ASMAtomicDecU32(&pIf->cSleepers);
@@ -4586,6 +4767,7 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
                             &pNetwork->MacTab.paEntries[iIf + 1],
                             (pNetwork->MacTab.cEntries - iIf - 1) * sizeof(pNetwork->MacTab.paEntries[0]));
                 pNetwork->MacTab.cEntries--;
+                intnetR0MacTabRehash(&pNetwork->MacTab);
                 break;
             }
 
@@ -4759,6 +4941,7 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
     //pIf->pIntBufDefaultR3 = NIL_RTR3PTR;
     pIf->hRecvEvent         = NIL_RTSEMEVENT;
     //pIf->cSleepers        = 0;
+    //pIf->fRecvSignalled   = false;
     pIf->hIf                = INTNET_HANDLE_INVALID;
     pIf->pNetwork           = pNetwork;
     pIf->pSession           = pSession;
@@ -4820,8 +5003,10 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
                     pNetwork->MacTab.paEntries[iIf].fPromiscuousEff      = false;
                     pNetwork->MacTab.paEntries[iIf].fPromiscuousSeeTrunk = false;
                     pNetwork->MacTab.paEntries[iIf].pIf                  = pIf;
+                    pNetwork->MacTab.paEntries[iIf].iHashNext            = INTNET_MACTAB_HASH_NIL;
 
                     pNetwork->MacTab.cEntries = iIf + 1;
+                    intnetR0MacTabRehash(&pNetwork->MacTab);
                     pIf->pNetwork = pNetwork;
 
                     /*
@@ -5494,6 +5679,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
         {
             pIf->pNetwork = NULL;
             pNetwork->MacTab.cEntries--;
+            intnetR0MacTabRehash(&pNetwork->MacTab);
         }
     }
 
@@ -5886,6 +6072,8 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     pNetwork->MacTab.fWirePromiscuousEff    = false;
     pNetwork->MacTab.fWireActive            = false;
     pNetwork->MacTab.pTrunk                 = NULL;
+    //pNetwork->MacTab.cDummyEntries        = 0;
+    intnetR0MacTabRehash(&pNetwork->MacTab);
     pNetwork->hEvtBusyIf                    = NIL_RTSEMEVENT;
     pNetwork->pIntNet                       = pIntNet;
     //pNetwork->pvObj                       = NULL;
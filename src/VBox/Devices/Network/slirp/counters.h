@@ -70,6 +70,8 @@ COUNTING_COUNTER(TCP, "TCP sockets");
 COUNTING_COUNTER(TCPHot, "TCP sockets active");
 COUNTING_COUNTER(UDP, "UDP sockets");
 COUNTING_COUNTER(UDPHot, "UDP sockets active");
+COUNTING_COUNTER(EpollCtl, "epoll registration changes");
+COUNTING_COUNTER(EpollReady, "Sockets reported ready by epoll");
 
 COUNTING_COUNTER(IORead_in_1, "SB IORead_in_1");
 COUNTING_COUNTER(IORead_in_1_bytes, "SB IORead_in_1_bytes");
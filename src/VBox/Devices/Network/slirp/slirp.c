@@ -105,14 +105,17 @@
  * gcc warns about attempts to log POLLNVAL so construction in a last to lines
  * used to catch POLLNVAL while logging and return false in case of error while
  * normal usage.
+ * With epoll the events of the socket are in so_revents, see slirpEpollDispatch.
  */
 #  define DO_CHECK_FD_SET(so, events, fdset)                        \
-      (   ((so)->so_poll_index != -1)                               \
-       && ((so)->so_poll_index <= ndfs)                             \
-       && ((so)->s == polls[so->so_poll_index].fd)                  \
-       && (polls[(so)->so_poll_index].revents & N_(fdset ## _poll)) \
-       && (   N_(fdset ## _poll) == POLLNVAL                        \
-           || !(polls[(so)->so_poll_index].revents & POLLNVAL)))
+      (  SLIRP_EPOLL_ACTIVE(pData)                                  \
+       ? ((so)->so_revents & N_(fdset ## _poll)) != 0               \
+       : (   ((so)->so_poll_index != -1)                            \
+          && ((so)->so_poll_index <= ndfs)                          \
+          && ((so)->s == polls[so->so_poll_index].fd)               \
+          && (polls[(so)->so_poll_index].revents & N_(fdset ## _poll)) \
+          && (   N_(fdset ## _poll) == POLLNVAL                     \
+              || !(polls[(so)->so_poll_index].revents & POLLNVAL))))
 
   /* specific for Windows Winsock API */
 # define DO_WIN_CHECK_FD_SET(so, events, fdset) 0
@@ -338,6 +341,16 @@ int slirp_init(PNATState *ppData, uint32_t u32NetAddr, uint32_t u32Netmask,
         *ppData = NULL;
         return rc;
     }
+#ifdef RT_OS_LINUX
+    /* Persistent registrations instead of rebuilding the poll array every
+     * round; fall back to poll() if the kernel doesn't cooperate. */
+    pData->iEpollFd = epoll_create(128);
+    if (pData->iEpollFd == -1)
+        LogRel(("NAT: epoll_create failed (%s), using poll\n", strerror(errno)));
+    else
+        fcntl(pData->iEpollFd, F_SETFD, FD_CLOEXEC);
+    LIST_INIT(&pData->epoll_touched);
+#endif
     debug_init(pData);
     if_init(pData);
     ip_init(pData);
@@ -553,6 +566,10 @@ void slirp_term(PNATState pData)
          "\n"
          "\n"));
 #endif
+#endif
+#ifdef RT_OS_LINUX
+    if (pData->iEpollFd != -1)
+        close(pData->iEpollFd);
 #endif
     RTMemFree(pData);
 }
@@ -583,6 +600,196 @@ static void updtime(PNATState pData)
 #endif
 }
 
+#ifdef RT_OS_LINUX
+/**
+ * Works out the events a socket has to be registered for; these are the
+ * conditions slirp_select_fill() engages sockets in the poll() array on.
+ */
+static uint32_t slirpEpollWanted(PNATState pData, struct socket *so)
+{
+    uint32_t fWant = 0;
+
+    if (so->s == -1)
+        return 0;
+    if (so == &pData->icmp_socket)
+        return N_(readfds_poll);
+
+    if (so->so_type == IPPROTO_TCP)
+    {
+        if (so->so_state & SS_NOFDREF)
+            return 0;
+        if (so->so_state & SS_FACCEPTCONN)
+            return N_(readfds_poll);
+        if (so->so_state & SS_ISFCONNECTING)
+            fWant |= N_(writefds_poll);
+        if (CONN_CANFSEND(so) && SBUF_LEN(&so->so_rcv))
+            fWant |= N_(writefds_poll);
+        if (   CONN_CANFRCV(so)
+            && (SBUF_LEN(&so->so_snd) < (SBUF_SIZE(&so->so_snd)/2)))
+            fWant |= N_(readfds_poll) | N_(xfds_poll);
+        return fWant;
+    }
+
+#ifdef VBOX_WITH_NAT_UDP_SOCKET_CLONE
+    if (so->so_cloneOf)
+        return 0;
+#endif
+    if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4)
+        fWant = N_(readfds_poll);
+    return fWant;
+}
+
+/**
+ * Brings the epoll registration of a socket in line with its state.
+ * Sockets without any wanted events are removed so that POLLHUP/POLLERR
+ * are not reported for them, matching what the poll() array would do.
+ */
+static void slirpEpollUpdate(PNATState pData, struct socket *so)
+{
+    struct epoll_event Event;
+    uint32_t fWant = slirpEpollWanted(pData, so);
+    int rc;
+
+    /* the registered descriptor was closed (and thus dropped by the kernel) */
+    if (so->so_epoll_events && so->so_epoll_fd != so->s)
+        so->so_epoll_events = 0;
+
+    if (fWant == so->so_epoll_events)
+        return;
+
+    STAM_COUNTER_INC(&pData->StatEpollCtl);
+    if (!fWant)
+    {
+        epoll_ctl(pData->iEpollFd, EPOLL_CTL_DEL, so->so_epoll_fd, &Event);
+        so->so_epoll_events = 0;
+        return;
+    }
+
+    RT_ZERO(Event);
+    Event.events = fWant;
+    Event.data.ptr = so;
+    if (so->so_epoll_events)
+    {
+        rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_MOD, so->s, &Event);
+        if (rc < 0 && errno == ENOENT)
+            rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_ADD, so->s, &Event);
+    }
+    else
+    {
+        rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_ADD, so->s, &Event);
+        if (rc < 0 && errno == EEXIST)
+            rc = epoll_ctl(pData->iEpollFd, EPOLL_CTL_MOD, so->s, &Event);
+    }
+    if (rc == 0)
+    {
+        so->so_epoll_fd = so->s;
+        so->so_epoll_events = fWant;
+    }
+    else
+    {
+        LogRel(("NAT: epoll_ctl(%d) failed for %R[natsock]: %s\n", so->s, so, strerror(errno)));
+        so->so_epoll_events = 0;
+    }
+}
+
+/*
+ * Queue a socket for slirpEpollUpdate() in the next slirp_select_fill().
+ * Called wherever the state, the buffers or the descriptor of a socket
+ * may have changed: tcp_input, udp_input, new listeners and every socket
+ * slirp_select_poll() handles.
+ */
+void
+soepoll_touch(PNATState pData, struct socket *so)
+{
+    if (   !SLIRP_EPOLL_ACTIVE(pData)
+        || so->so_epoll_touched)
+        return;
+    LIST_INSERT_HEAD(&pData->epoll_touched, so, so_epoll_link);
+    so->so_epoll_touched = 1;
+}
+
+/*
+ * Forget a socket which is about to be freed: drop its registration and
+ * any event of the current ready list still pointing at it.
+ */
+void
+soepoll_remove(PNATState pData, struct socket *so)
+{
+    int i;
+
+    if (!SLIRP_EPOLL_ACTIVE(pData))
+        return;
+
+    if (so->so_epoll_touched)
+    {
+        LIST_REMOVE(so, so_epoll_link);
+        so->so_epoll_touched = 0;
+    }
+
+    /* Closed descriptors drop out of epoll by themselves, only open ones
+     * need explicit removal before the socket memory goes away. */
+    if (   so->so_epoll_events
+        && so->s != -1
+        && so->s == so->so_epoll_fd)
+        epoll_ctl(pData->iEpollFd, EPOLL_CTL_DEL, so->s, NULL);
+    so->so_epoll_events = 0;
+
+    for (i = pData->iEpollReady; i < pData->cEpollReady; i++)
+        if (pData->aEpollEvents[i].data.ptr == so)
+            pData->aEpollEvents[i].data.ptr = NULL;
+}
+
+/**
+ * The epoll flavour of slirp_select_fill(): only the sockets touched since
+ * the last round are looked at, the registrations of all others persist.
+ * UDP sockets don't change by themselves but expire, the udb list is
+ * walked for that with the slow timer's period.
+ */
+static void slirpEpollFill(PNATState pData)
+{
+    struct socket *so, *so_next;
+
+    slirpEpollUpdate(pData, &pData->icmp_socket);
+
+    if ((curtime - pData->last_epoll_expire) >= 499)
+    {
+        pData->last_epoll_expire = curtime;
+        QSOCKET_FOREACH(so, so_next, udp)
+        /* { */
+            if (   so->so_expire
+                && so->so_expire <= curtime)
+            {
+                Log2(("NAT: %R[natsock] expired\n", so));
+                if (so->so_timeout != NULL)
+                {
+                    so->so_timeout(pData, so, so->so_timeout_arg);
+                    if (   so_next->so_prev != so /* so_timeout freed the socket */
+                        || so->so_timeout)  /* so_timeout just freed so_timeout */
+                      CONTINUE_NO_UNLOCK(udp);
+                }
+                UDP_DETACH(pData, so, so_next);
+            }
+            LOOP_LABEL(udp, so, so_next);
+        }
+    }
+
+    while ((so = LIST_FIRST(&pData->epoll_touched)) != NULL)
+    {
+        LIST_REMOVE(so, so_epoll_link);
+        so->so_epoll_touched = 0;
+
+        /* See if we need a tcp_fasttimo */
+        if (    so->so_type == IPPROTO_TCP
+            &&  time_fasttimo == 0
+            &&  so->so_tcpcb != NULL
+            &&  so->so_tcpcb->t_flags & TF_DELACK)
+            time_fasttimo = curtime; /* Flag when we want a fasttimo */
+
+        slirpEpollUpdate(pData, so);
+    }
+}
+#endif /* RT_OS_LINUX */
+
 #ifdef RT_OS_WINDOWS
 void slirp_select_fill(PNATState pData, int *pnfds)
 #else /* RT_OS_WINDOWS */
@@ -629,6 +836,23 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
             }
         }
     }
+#ifdef RT_OS_LINUX
+    /*
+     * With epoll the caller only has to wait on the epoll descriptor,
+     * the socket registrations persist between rounds.
+     */
+    if (SLIRP_EPOLL_ACTIVE(pData))
+    {
+        slirpEpollFill(pData);
+        AssertRelease(nfds >= 1);
+        polls[0].fd = pData->iEpollFd;
+        polls[0].events = POLLIN;
+        polls[0].revents = 0;
+        poll_index = 1;
+        goto done;
+    }
+#endif
+
     /* always add the ICMP socket */
 #ifndef RT_OS_WINDOWS
     pData->icmp_socket.so_poll_index = -1;
@@ -779,6 +1003,7 @@ void slirp_select_fill(PNATState pData, int *pnfds, struct pollfd *polls)
         }
         LOOP_LABEL(udp, so, so_next);
     }
+
 done:
 
 #if defined(RT_OS_WINDOWS)
@@ -851,13 +1076,16 @@ static bool slirpConnectOrWrite(PNATState pData, struct socket *so, bool fConnec
     return true;
 }
 
+/**
+ * Handles the events of a TCP socket for slirp_select_poll().
+ */
 #if defined(RT_OS_WINDOWS)
-void slirp_select_poll(PNATState pData, int fTimeout, int fIcmp)
-#else /* RT_OS_WINDOWS */
-void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
-#endif /* !RT_OS_WINDOWS */
+static void slirpPollTcpSocket(PNATState pData, struct socket *so)
+#else
+static void slirpPollTcpSocket(PNATState pData, struct socket *so, struct pollfd *polls, int ndfs)
+#endif
 {
-    struct socket *so, *so_next;
+    struct socket *so_next = so->so_next;
     int ret;
 #if defined(RT_OS_WINDOWS)
     WSANETWORKEVENTS NetworkEvents;
@@ -865,293 +1093,382 @@ void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
     int error;
 #endif
 
-    STAM_PROFILE_START(&pData->StatPoll, a);
-
-    /* Update time */
-    updtime(pData);
-
+    /* TCP socket can't be cloned */
+#ifdef VBOX_WITH_NAT_UDP_SOCKET_CLONE
+    Assert((!so->so_cloneOf));
+#endif
+    Assert(!so->fUnderPolling);
+    so->fUnderPolling = 1;
+    if (slirpVerifyAndFreeSocket(pData, so))
+        return;
     /*
-     * See if anything has timed out
+     * FD_ISSET is meaningless on these sockets
+     * (and they can crash the program)
      */
-    if (link_up)
+    if (so->so_state & SS_NOFDREF || so->s == -1)
     {
-        if (time_fasttimo && ((curtime - time_fasttimo) >= 2))
-        {
-            STAM_PROFILE_START(&pData->StatFastTimer, b);
-            tcp_fasttimo(pData);
-            time_fasttimo = 0;
-            STAM_PROFILE_STOP(&pData->StatFastTimer, b);
-        }
-        if (do_slowtimo && ((curtime - last_slowtimo) >= 499))
-        {
-            STAM_PROFILE_START(&pData->StatSlowTimer, c);
-            ip_slowtimo(pData);
-            tcp_slowtimo(pData);
-            last_slowtimo = curtime;
-            STAM_PROFILE_STOP(&pData->StatSlowTimer, c);
-        }
+        so->fUnderPolling = 0;
+        return;
     }
-#if defined(RT_OS_WINDOWS)
-    if (fTimeout)
-        return; /* only timer update */
-#endif
 
-    /*
-     * Check sockets
-     */
-    if (!link_up)
-        goto done;
-#if defined(RT_OS_WINDOWS)
-    /*XXX: before renaming please make see define
-     * fIcmp in slirp_state.h
-     */
-    if (fIcmp)
-        sorecvfrom(pData, &pData->icmp_socket);
-#else
-    if (   (pData->icmp_socket.s != -1)
-        && CHECK_FD_SET(&pData->icmp_socket, ignored, readfds))
-        sorecvfrom(pData, &pData->icmp_socket);
-#endif
-    /*
-     * Check TCP sockets
-     */
-    QSOCKET_FOREACH(so, so_next, tcp)
-    /* { */
-        /* TCP socket can't be cloned */
-#ifdef VBOX_WITH_NAT_UDP_SOCKET_CLONE
-        Assert((!so->so_cloneOf));
-#endif
-        Assert(!so->fUnderPolling);
-        so->fUnderPolling = 1;
-        if (slirpVerifyAndFreeSocket(pData, so))
-            CONTINUE(tcp);
-        /*
-         * FD_ISSET is meaningless on these sockets
-         * (and they can crash the program)
-         */
-        if (so->so_state & SS_NOFDREF || so->s == -1)
-        {
-            so->fUnderPolling = 0;
-            CONTINUE(tcp);
-        }
+    POLL_TCP_EVENTS(rc, error, so, &NetworkEvents);
 
-        POLL_TCP_EVENTS(rc, error, so, &NetworkEvents);
+    LOG_NAT_SOCK(so, TCP, &NetworkEvents, readfds, writefds, xfds);
 
-        LOG_NAT_SOCK(so, TCP, &NetworkEvents, readfds, writefds, xfds);
 
+    /*
+     * Check for URG data
+     * This will soread as well, so no need to
+     * test for readfds below if this succeeds
+     */
 
-        /*
-         * Check for URG data
-         * This will soread as well, so no need to
-         * test for readfds below if this succeeds
-         */
-
-        /* out-of-band data */
-        if (    CHECK_FD_SET(so, NetworkEvents, xfds)
+    /* out-of-band data */
+    if (    CHECK_FD_SET(so, NetworkEvents, xfds)
 #ifdef RT_OS_DARWIN
-            /* Darwin and probably BSD hosts generates POLLPRI|POLLHUP event on receiving TCP.flags.{ACK|URG|FIN} this
-             * combination on other Unixs hosts doesn't enter to this branch
-             */
-            &&  !CHECK_FD_SET(so, NetworkEvents, closefds)
+        /* Darwin and probably BSD hosts generates POLLPRI|POLLHUP event on receiving TCP.flags.{ACK|URG|FIN} this
+         * combination on other Unixs hosts doesn't enter to this branch
+         */
+        &&  !CHECK_FD_SET(so, NetworkEvents, closefds)
 #endif
 #ifdef RT_OS_WINDOWS
-            /**
-             * In some cases FD_CLOSE comes with FD_OOB, that confuse tcp processing.
-             */
-            && !WIN_CHECK_FD_SET(so, NetworkEvents, closefds)
+        /**
+         * In some cases FD_CLOSE comes with FD_OOB, that confuse tcp processing.
+         */
+        && !WIN_CHECK_FD_SET(so, NetworkEvents, closefds)
 #endif
-        )
+    )
+    {
+        sorecvoob(pData, so);
+        if (slirpVerifyAndFreeSocket(pData, so))
+            return;
+    }
+
+    /*
+     * Check sockets for reading
+     */
+    else if (   CHECK_FD_SET(so, NetworkEvents, readfds)
+             || WIN_CHECK_FD_SET(so, NetworkEvents, acceptds))
+    {
+
+#ifdef RT_OS_WINDOWS
+        if (WIN_CHECK_FD_SET(so, NetworkEvents, connectfds))
         {
-            sorecvoob(pData, so);
+            /* Finish connection first */
+            /* should we ignore return value? */
+            bool fRet = slirpConnectOrWrite(pData, so, true);
+            LogFunc(("fRet:%RTbool\n", fRet));
             if (slirpVerifyAndFreeSocket(pData, so))
-                CONTINUE(tcp);
+                return;
         }
-
+#endif
         /*
-         * Check sockets for reading
+         * Check for incoming connections
          */
-        else if (   CHECK_FD_SET(so, NetworkEvents, readfds)
-                 || WIN_CHECK_FD_SET(so, NetworkEvents, acceptds))
+        if (so->so_state & SS_FACCEPTCONN)
         {
-
-#ifdef RT_OS_WINDOWS
-            if (WIN_CHECK_FD_SET(so, NetworkEvents, connectfds))
-            {
-                /* Finish connection first */
-                /* should we ignore return value? */
-                bool fRet = slirpConnectOrWrite(pData, so, true);
-                LogFunc(("fRet:%RTbool\n", fRet));
-                if (slirpVerifyAndFreeSocket(pData, so))
-                    CONTINUE(tcp);
-            }
-#endif
-            /*
-             * Check for incoming connections
-             */
-            if (so->so_state & SS_FACCEPTCONN)
+            TCP_CONNECT(pData, so);
+            if (slirpVerifyAndFreeSocket(pData, so))
+                return;
+            if (!CHECK_FD_SET(so, NetworkEvents, closefds))
             {
-                TCP_CONNECT(pData, so);
-                if (slirpVerifyAndFreeSocket(pData, so))
-                    CONTINUE(tcp);
-                if (!CHECK_FD_SET(so, NetworkEvents, closefds))
-                {
-                    so->fUnderPolling = 0;
-                    CONTINUE(tcp);
-                }
+                so->fUnderPolling = 0;
+                return;
             }
+        }
 
-            ret = soread(pData, so);
-            if (slirpVerifyAndFreeSocket(pData, so))
-                CONTINUE(tcp);
-            /* Output it if we read something */
-            if (RT_LIKELY(ret > 0))
-                TCP_OUTPUT(pData, sototcpcb(so));
+        ret = soread(pData, so);
+        if (slirpVerifyAndFreeSocket(pData, so))
+            return;
+        /* Output it if we read something */
+        if (RT_LIKELY(ret > 0))
+            TCP_OUTPUT(pData, sototcpcb(so));
 
-            if (slirpVerifyAndFreeSocket(pData, so))
-                CONTINUE(tcp);
-        }
+        if (slirpVerifyAndFreeSocket(pData, so))
+            return;
+    }
 
+    /*
+     * Check for FD_CLOSE events.
+     * in some cases once FD_CLOSE engaged on socket it could be flashed latter (for some reasons)
+     */
+    if (   CHECK_FD_SET(so, NetworkEvents, closefds)
+        || (so->so_close == 1))
+    {
         /*
-         * Check for FD_CLOSE events.
-         * in some cases once FD_CLOSE engaged on socket it could be flashed latter (for some reasons)
+         * drain the socket
          */
-        if (   CHECK_FD_SET(so, NetworkEvents, closefds)
-            || (so->so_close == 1))
+        for (;   so_next->so_prev == so
+              && !slirpVerifyAndFreeSocket(pData, so);)
         {
-            /*
-             * drain the socket
-             */
-            for (;   so_next->so_prev == so
-                  && !slirpVerifyAndFreeSocket(pData, so);)
-            {
-                ret = soread(pData, so);
-                if (slirpVerifyAndFreeSocket(pData, so))
-                    break;
+            ret = soread(pData, so);
+            if (slirpVerifyAndFreeSocket(pData, so))
+                break;
 
-                if (ret > 0)
-                    TCP_OUTPUT(pData, sototcpcb(so));
-                else if (so_next->so_prev == so)
-                {
-                    Log2(("%R[natsock] errno %d (%s)\n", so, errno, strerror(errno)));
-                    break;
-                }
+            if (ret > 0)
+                TCP_OUTPUT(pData, sototcpcb(so));
+            else if (so_next->so_prev == so)
+            {
+                Log2(("%R[natsock] errno %d (%s)\n", so, errno, strerror(errno)));
+                break;
             }
+        }
 
-            /* if socket freed ''so'' is PHANTOM and next socket isn't points on it */
-            if (so_next->so_prev == so)
-            {
-                /* mark the socket for termination _after_ it was drained */
-                so->so_close = 1;
-                /* No idea about Windows but on Posix, POLLHUP means that we can't send more.
-                 * Actually in the specific error scenario, POLLERR is set as well. */
+        /* if socket freed ''so'' is PHANTOM and next socket isn't points on it */
+        if (so_next->so_prev == so)
+        {
+            /* mark the socket for termination _after_ it was drained */
+            so->so_close = 1;
+            /* No idea about Windows but on Posix, POLLHUP means that we can't send more.
+             * Actually in the specific error scenario, POLLERR is set as well. */
 #ifndef RT_OS_WINDOWS
-                if (CHECK_FD_SET(so, NetworkEvents, rderr))
-                    sofcantsendmore(so);
+            if (CHECK_FD_SET(so, NetworkEvents, rderr))
+                sofcantsendmore(so);
 #endif
-            }
-            if (so_next->so_prev == so)
-                so->fUnderPolling = 0;
-            CONTINUE(tcp);
         }
+        if (so_next->so_prev == so)
+            so->fUnderPolling = 0;
+        return;
+    }
 
-        /*
-         * Check sockets for writing
-         */
-        if (    CHECK_FD_SET(so, NetworkEvents, writefds)
+    /*
+     * Check sockets for writing
+     */
+    if (    CHECK_FD_SET(so, NetworkEvents, writefds)
 #ifdef RT_OS_WINDOWS
-            ||  WIN_CHECK_FD_SET(so, NetworkEvents, connectfds)
+        ||  WIN_CHECK_FD_SET(so, NetworkEvents, connectfds)
 #endif
-            )
+        )
+    {
+        int fConnectOrWriteSuccess = slirpConnectOrWrite(pData, so, false);
+        /* slirpConnectOrWrite could return true even if tcp_input called tcp_drop,
+         * so we should be ready to such situations.
+         */
+        if (slirpVerifyAndFreeSocket(pData, so))
+            return;
+        else if (!fConnectOrWriteSuccess)
         {
-            int fConnectOrWriteSuccess = slirpConnectOrWrite(pData, so, false);
-            /* slirpConnectOrWrite could return true even if tcp_input called tcp_drop,
-             * so we should be ready to such situations.
-             */
-            if (slirpVerifyAndFreeSocket(pData, so))
-                CONTINUE(tcp);
-            else if (!fConnectOrWriteSuccess)
-            {
-                so->fUnderPolling = 0;
-                CONTINUE(tcp);
-            }
-            /* slirpConnectionOrWrite succeeded and socket wasn't dropped */
+            so->fUnderPolling = 0;
+            return;
         }
+        /* slirpConnectionOrWrite succeeded and socket wasn't dropped */
+    }
 
-        /*
-         * Probe a still-connecting, non-blocking socket
-         * to check if it's still alive
-         */
+    /*
+     * Probe a still-connecting, non-blocking socket
+     * to check if it's still alive
+     */
 #ifdef PROBE_CONN
-        if (so->so_state & SS_ISFCONNECTING)
+    if (so->so_state & SS_ISFCONNECTING)
+    {
+        ret = recv(so->s, (char *)&ret, 0, 0);
+
+        if (ret < 0)
         {
-            ret = recv(so->s, (char *)&ret, 0, 0);
+            /* XXX */
+            if (   soIgnorableErrorCode(errno)
+                || errno == ENOTCONN)
+            {
+                return; /* Still connecting, continue */
+            }
 
+            /* else failed */
+            so->so_state = SS_NOFDREF;
+
+            /* tcp_input will take care of it */
+        }
+        else
+        {
+            ret = send(so->s, &ret, 0, 0);
             if (ret < 0)
             {
                 /* XXX */
                 if (   soIgnorableErrorCode(errno)
                     || errno == ENOTCONN)
                 {
-                    CONTINUE(tcp); /* Still connecting, continue */
+                    return;
                 }
-
                 /* else failed */
                 so->so_state = SS_NOFDREF;
-
-                /* tcp_input will take care of it */
             }
             else
-            {
-                ret = send(so->s, &ret, 0, 0);
-                if (ret < 0)
-                {
-                    /* XXX */
-                    if (   soIgnorableErrorCode(errno)
-                        || errno == ENOTCONN)
-                    {
-                        CONTINUE(tcp);
-                    }
-                    /* else failed */
-                    so->so_state = SS_NOFDREF;
-                }
-                else
-                    so->so_state &= ~SS_ISFCONNECTING;
+                so->so_state &= ~SS_ISFCONNECTING;
 
-            }
-            TCP_INPUT((struct mbuf *)NULL, sizeof(struct ip),so);
-        } /* SS_ISFCONNECTING */
+        }
+        TCP_INPUT((struct mbuf *)NULL, sizeof(struct ip),so);
+    } /* SS_ISFCONNECTING */
+#endif
+    if (!slirpVerifyAndFreeSocket(pData, so))
+        so->fUnderPolling = 0;
+}
+
+/**
+ * Handles the events of a UDP socket for slirp_select_poll().
+ */
+#if defined(RT_OS_WINDOWS)
+static void slirpPollUdpSocket(PNATState pData, struct socket *so)
+#else
+static void slirpPollUdpSocket(PNATState pData, struct socket *so, struct pollfd *polls, int ndfs)
+#endif
+{
+#if defined(RT_OS_WINDOWS)
+    WSANETWORKEVENTS NetworkEvents;
+    int rc;
+    int error;
 #endif
-        if (!slirpVerifyAndFreeSocket(pData, so))
-            so->fUnderPolling = 0;
-        LOOP_LABEL(tcp, so, so_next);
-    }
 
-    /*
-     * Now UDP sockets.
-     * Incoming packets are sent straight away, they're not buffered.
-     * Incoming UDP data isn't buffered either.
-     */
-     QSOCKET_FOREACH(so, so_next, udp)
-     /* { */
 #ifdef VBOX_WITH_NAT_UDP_SOCKET_CLONE
-        if (so->so_cloneOf)
-            CONTINUE_NO_UNLOCK(udp);
+    if (so->so_cloneOf)
+        return;
 #endif
 #if 0
-        so->fUnderPolling = 1;
-        if(slirpVerifyAndFreeSocket(pData, so));
-            CONTINUE(udp);
-        so->fUnderPolling = 0;
+    so->fUnderPolling = 1;
+    if(slirpVerifyAndFreeSocket(pData, so));
+        return;
+    so->fUnderPolling = 0;
 #endif
 
-        POLL_UDP_EVENTS(rc, error, so, &NetworkEvents);
+    POLL_UDP_EVENTS(rc, error, so, &NetworkEvents);
+
+    LOG_NAT_SOCK(so, UDP, &NetworkEvents, readfds, writefds, xfds);
 
-        LOG_NAT_SOCK(so, UDP, &NetworkEvents, readfds, writefds, xfds);
+    if (so->s != -1 && CHECK_FD_SET(so, NetworkEvents, readfds))
+    {
+        SORECVFROM(pData, so);
+    }
+}
+
+#if defined(RT_OS_WINDOWS)
+# define SLIRP_POLL_TCP_SOCKET(pData, so) slirpPollTcpSocket((pData), (so))
+# define SLIRP_POLL_UDP_SOCKET(pData, so) slirpPollUdpSocket((pData), (so))
+#else
+# define SLIRP_POLL_TCP_SOCKET(pData, so) slirpPollTcpSocket((pData), (so), polls, ndfs)
+# define SLIRP_POLL_UDP_SOCKET(pData, so) slirpPollUdpSocket((pData), (so), polls, ndfs)
+#endif
+
+#ifdef RT_OS_LINUX
+/**
+ * Handles the sockets epoll reports ready, the others are not looked at.
+ * Level triggered epoll returns ready entries round robin, so one batch per
+ * round is fair; whatever is left makes the epoll descriptor poll ready
+ * again right away.
+ */
+static void slirpEpollDispatch(PNATState pData)
+{
+    pData->cEpollReady = epoll_wait(pData->iEpollFd, pData->aEpollEvents, NAT_EPOLL_EVENTS, 0);
+    if (pData->cEpollReady <= 0)
+    {
+        pData->cEpollReady = 0;
+        return;
+    }
+    STAM_COUNTER_ADD(&pData->StatEpollReady, pData->cEpollReady);
+
+    for (pData->iEpollReady = 0; pData->iEpollReady < pData->cEpollReady; pData->iEpollReady++)
+    {
+        struct epoll_event *pEvent = &pData->aEpollEvents[pData->iEpollReady];
+        struct socket *so = (struct socket *)pEvent->data.ptr;
+        if (!so) /* freed while handling an earlier entry */
+            continue;
+
+        /* Whatever happens below may change what the socket waits for. */
+        soepoll_touch(pData, so);
+        so->so_revents = pEvent->events;
+        if (so == &pData->icmp_socket)
+        {
+            if (so->s != -1 && (so->so_revents & N_(readfds_poll)))
+                sorecvfrom(pData, so);
+        }
+        else if (so->so_type == IPPROTO_TCP)
+            slirpPollTcpSocket(pData, so, NULL /*polls*/, 0 /*ndfs*/);
+        else
+            slirpPollUdpSocket(pData, so, NULL /*polls*/, 0 /*ndfs*/);
+    }
+    pData->iEpollReady = pData->cEpollReady = 0;
+}
+#endif /* RT_OS_LINUX */
 
-        if (so->s != -1 && CHECK_FD_SET(so, NetworkEvents, readfds))
+#if defined(RT_OS_WINDOWS)
+void slirp_select_poll(PNATState pData, int fTimeout, int fIcmp)
+#else /* RT_OS_WINDOWS */
+void slirp_select_poll(PNATState pData, struct pollfd *polls, int ndfs)
+#endif /* !RT_OS_WINDOWS */
+{
+    struct socket *so, *so_next;
+
+    STAM_PROFILE_START(&pData->StatPoll, a);
+
+    /* Update time */
+    updtime(pData);
+
+    /*
+     * See if anything has timed out
+     */
+    if (link_up)
+    {
+        if (time_fasttimo && ((curtime - time_fasttimo) >= 2))
+        {
+            STAM_PROFILE_START(&pData->StatFastTimer, b);
+            tcp_fasttimo(pData);
+            time_fasttimo = 0;
+            STAM_PROFILE_STOP(&pData->StatFastTimer, b);
+        }
+        if (do_slowtimo && ((curtime - last_slowtimo) >= 499))
         {
-            SORECVFROM(pData, so);
+            STAM_PROFILE_START(&pData->StatSlowTimer, c);
+            ip_slowtimo(pData);
+            tcp_slowtimo(pData);
+            last_slowtimo = curtime;
+            STAM_PROFILE_STOP(&pData->StatSlowTimer, c);
         }
+    }
+#if defined(RT_OS_WINDOWS)
+    if (fTimeout)
+        return; /* only timer update */
+#endif
+
+    /*
+     * Check sockets
+     */
+    if (!link_up)
+        goto done;
+#if defined(RT_OS_WINDOWS)
+    /*XXX: before renaming please make see define
+     * fIcmp in slirp_state.h
+     */
+    if (fIcmp)
+        sorecvfrom(pData, &pData->icmp_socket);
+#else
+# ifdef RT_OS_LINUX
+    if (SLIRP_EPOLL_ACTIVE(pData))
+    {
+        /* Only the sockets epoll reported ready. Dispatch after the timers
+         * ran, they may free sockets. */
+        if (   ndfs >= 1
+            && (polls[0].revents & POLLIN))
+            slirpEpollDispatch(pData);
+        goto done;
+    }
+# endif
+    if (   (pData->icmp_socket.s != -1)
+        && CHECK_FD_SET(&pData->icmp_socket, ignored, readfds))
+        sorecvfrom(pData, &pData->icmp_socket);
+#endif
+    /*
+     * Check TCP sockets
+     */
+    QSOCKET_FOREACH(so, so_next, tcp)
+    /* { */
+        SLIRP_POLL_TCP_SOCKET(pData, so);
+        LOOP_LABEL(tcp, so, so_next);
+    }
+
+    /*
+     * Now UDP sockets.
+     * Incoming packets are sent straight away, they're not buffered.
+     * Incoming UDP data isn't buffered either.
+     */
+    QSOCKET_FOREACH(so, so_next, udp)
+    /* { */
+        SLIRP_POLL_UDP_SOCKET(pData, so);
         LOOP_LABEL(udp, so, so_next);
     }
 
@@ -1649,6 +1966,9 @@ unsigned int slirp_get_timeout_ms(PNATState pData)
 #ifndef RT_OS_WINDOWS
 int slirp_get_nsock(PNATState pData)
 {
+    /* only the epoll descriptor is handed out to poll() */
+    if (SLIRP_EPOLL_ACTIVE(pData))
+        return 1;
     return pData->nsock;
 }
 #endif
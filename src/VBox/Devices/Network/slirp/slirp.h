@@ -221,6 +221,10 @@ int inet_aton (const char *cp, struct in_addr *ia);
 # include <sys/select.h>
 #endif
 
+#ifdef RT_OS_LINUX
+# include <sys/epoll.h>
+#endif
+
 #ifdef HAVE_SYS_WAIT_H
 # include <sys/wait.h>
 #endif
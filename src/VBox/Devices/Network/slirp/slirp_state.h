@@ -99,6 +99,10 @@ LIST_HEAD(port_forward_rule_list, port_forward_rule);
 /* forward declaration */
 struct proto_handler;
 
+/** Number of buckets in the tcb/udb socket lookup hashes (power of two). */
+#define SOHASH_SIZE 1024
+LIST_HEAD(sohashhead, socket);
+
 /** Main state/configuration structure for slirp NAT. */
 typedef struct NATState
 {
@@ -177,6 +181,9 @@ typedef struct NATState
     struct udpstat_t udpstat;
     struct socket udb;
     struct socket *udp_last_so;
+    /* Socket lookup hashes: tcb by 4-tuple, udb by guest address/port */
+    struct sohashhead tcb_hash[SOHASH_SIZE];
+    struct sohashhead udb_hash[SOHASH_SIZE];
     struct socket icmp_socket;
     struct icmp_storage icmp_msg_head;
 # ifndef RT_OS_WINDOWS
@@ -191,6 +198,24 @@ typedef struct NATState
 #  define NSOCK_DEC() do {pData->nsock--;} while (0)
 #  define NSOCK_INC_EX(ex) do {ex->pData->nsock++;} while (0)
 #  define NSOCK_DEC_EX(ex) do {ex->pData->nsock--;} while (0)
+#  ifdef RT_OS_LINUX
+    /* epoll descriptor keeping persistent socket registrations; -1 if
+     * slirp_select_fill() falls back to rebuilding the poll array. */
+    int iEpollFd;
+#   define NAT_EPOLL_EVENTS 256
+    struct epoll_event aEpollEvents[NAT_EPOLL_EVENTS];
+    /* The ready list being dispatched: entry iEpollReady is being handled,
+     * cEpollReady is the number of entries. */
+    int iEpollReady;
+    int cEpollReady;
+    /* Sockets whose registration has to be looked at, see soepoll_touch() */
+    struct sohashhead epoll_touched;
+    /* When the UDP sockets were last checked for expiry */
+    uint32_t last_epoll_expire;
+#   define SLIRP_EPOLL_ACTIVE(pData) ((pData)->iEpollFd != -1)
+#  else
+#   define SLIRP_EPOLL_ACTIVE(pData) 0
+#  endif
 # else
 #  define NSOCK_INC() do {} while (0)
 #  define NSOCK_DEC() do {} while (0)
@@ -439,7 +464,7 @@ typedef struct NATState
 # define DO_SORECFROM(data, so) sorecvfrom((data), (so))
 # define SOLOOKUP(so, label, src, sport, dst, dport)                                      \
     do {                                                                                  \
-        (so) = solookup(&VBOX_X2(queue_ ## label ## _label), (src), (sport), (dst), (dport)); \
+        (so) = solookup(pData, &VBOX_X2(queue_ ## label ## _label), (src), (sport), (dst), (dport)); \
     } while (0)
 # define DO_UDP_DETACH(data, so, ignored) udp_detach((data), (so))
 
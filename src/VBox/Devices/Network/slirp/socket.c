@@ -70,6 +70,7 @@ struct socket * soCloneUDPSocketWithForegnAddr(PNATState pData, bool fBindSocket
     pNewSocket->so_lport = pSo->so_lport;
     pNewSocket->so_faddr.s_addr = u32ForeignAddr;
     pNewSocket->so_fport = pSo->so_fport;
+    sohash_update(pData, pNewSocket);
     pSo->so_cCloneCounter++;
     LogFlowFunc(("Leave: %R[natsock]\n", pNewSocket));
     return pNewSocket;
@@ -134,12 +135,84 @@ so_init()
 {
 }
 
+/*
+ * Bucket of the tcb hash, keyed by the full 4-tuple (ports in network order).
+ */
+static unsigned
+sohash_tcp(struct in_addr laddr, u_int lport, struct in_addr faddr, u_int fport)
+{
+    uint32_t u32 = laddr.s_addr ^ faddr.s_addr ^ ((lport << 16) | (fport & 0xffff));
+    u32 ^= u32 >> 16;
+    u32 *= UINT32_C(0x45d9f3b);
+    u32 ^= u32 >> 16;
+    return u32 & (SOHASH_SIZE - 1);
+}
+
+/*
+ * Bucket of the udb hash; UDP sockets are found by the guest side only.
+ */
+static unsigned
+sohash_udp(struct in_addr laddr, u_int lport)
+{
+    uint32_t u32 = laddr.s_addr ^ (lport & 0xffff);
+    u32 ^= u32 >> 16;
+    u32 *= UINT32_C(0x45d9f3b);
+    u32 ^= u32 >> 16;
+    return u32 & (SOHASH_SIZE - 1);
+}
+
+/*
+ * (Re)link a socket into the lookup hash matching its current addresses.
+ * Must be called whenever so_laddr/so_lport (and for TCP so_faddr/so_fport)
+ * of a socket in tcb or udb change.
+ */
+void
+sohash_update(PNATState pData, struct socket *so)
+{
+    struct sohashhead *pHead;
+
+    sohash_remove(pData, so);
+    if (so->so_type == IPPROTO_TCP)
+        pHead = &pData->tcb_hash[sohash_tcp(so->so_laddr, so->so_lport, so->so_faddr, so->so_fport)];
+    else
+    {
+        Assert(so->so_type == IPPROTO_UDP || so->so_type == 0);
+        pHead = &pData->udb_hash[sohash_udp(so->so_laddr, so->so_lport)];
+    }
+    LIST_INSERT_HEAD(pHead, so, so_hash);
+    so->so_hashed = 1;
+}
+
+void
+sohash_remove(PNATState pData, struct socket *so)
+{
+    NOREF(pData);
+    if (so->so_hashed)
+    {
+        LIST_REMOVE(so, so_hash);
+        so->so_hashed = 0;
+    }
+}
+
 struct socket *
-solookup(struct socket *head, struct in_addr laddr,
+solookup(PNATState pData, struct socket *head, struct in_addr laddr,
          u_int lport, struct in_addr faddr, u_int fport)
 {
     struct socket *so;
 
+    if (head == &tcb)
+    {
+        LIST_FOREACH(so, &pData->tcb_hash[sohash_tcp(laddr, lport, faddr, fport)], so_hash)
+        {
+            if (   so->so_lport        == lport
+                && so->so_laddr.s_addr == laddr.s_addr
+                && so->so_faddr.s_addr == faddr.s_addr
+                && so->so_fport        == fport)
+                return so;
+        }
+        return (struct socket *)NULL;
+    }
+
     for (so = head->so_next; so != head; so = so->so_next)
     {
         if (   so->so_lport        == lport
@@ -152,6 +225,24 @@ solookup(struct socket *head, struct in_addr laddr,
     return (struct socket *)NULL;
 }
 
+/*
+ * Find the UDP socket bound to the guest address/port.
+ */
+struct socket *
+solookup_udp(PNATState pData, struct in_addr laddr, u_int lport)
+{
+    struct socket *so;
+
+    LIST_FOREACH(so, &pData->udb_hash[sohash_udp(laddr, lport)], so_hash)
+    {
+        if (   so->so_lport        == lport
+            && so->so_laddr.s_addr == laddr.s_addr)
+            return so;
+    }
+
+    return (struct socket *)NULL;
+}
+
 /*
  * Create a new socket, initialise the fields
  * It is the responsibility of the caller to
@@ -213,6 +304,9 @@ sofree(PNATState pData, struct socket *so)
         so->so_m = NULL;
     }
 
+    sohash_remove(pData, so);
+    soepoll_remove(pData, so);
+
     if (so->so_next && so->so_prev)
     {
         remque(pData, so);  /* crashes if so is not in a queue */
@@ -1110,6 +1204,7 @@ solisten(PNATState pData, u_int32_t bind_addr, u_int port, u_int32_t laddr, u_in
     so->so_state = (SS_FACCEPTCONN|flags);
     so->so_lport = lport; /* Kept in network format */
     so->so_laddr.s_addr = laddr; /* Ditto */
+    soepoll_touch(pData, so);
 
     memset(&addr, 0, sizeof(addr));
 #ifdef RT_OS_DARWIN
@@ -1174,6 +1269,7 @@ no_sockopt:
         so->so_faddr = alias_addr;
     else
         so->so_faddr = addr.sin_addr;
+    sohash_update(pData, so);
 
     so->s = s;
     SOCKET_UNLOCK(so);
@@ -40,6 +40,8 @@ struct socket
 {
     struct socket   *so_next;
     struct socket   *so_prev;    /* For a linked list of sockets */
+    LIST_ENTRY(socket) so_hash;  /* Lookup hash chain (tcb/udb hash) */
+    int             so_hashed;   /* Set if so_hash is linked into a chain */
 
 #if !defined(RT_OS_WINDOWS)
     int s;                       /* The actual socket */
@@ -83,6 +85,13 @@ struct socket
     struct sbuf     so_snd;      /* Send buffer */
 #ifndef RT_OS_WINDOWS
     int so_poll_index;
+    /* Persistent epoll registration, see slirp_select_fill(). The socket
+     * is registered iff so_epoll_events != 0. */
+    int so_epoll_fd;             /* descriptor registered with epoll */
+    uint32_t so_epoll_events;    /* registered event mask */
+    uint32_t so_revents;         /* events reported by epoll */
+    LIST_ENTRY(socket) so_epoll_link; /* NATState::epoll_touched chain */
+    int so_epoll_touched;        /* Set if so_epoll_link is linked */
 #endif /* !RT_OS_WINDOWS */
     /*
      * FD_CLOSE/POLLHUP event has been occurred on socket
@@ -165,7 +174,17 @@ struct iovec
 #endif
 
 void so_init (void);
-struct socket * solookup (struct socket *, struct in_addr, u_int, struct in_addr, u_int);
+struct socket * solookup (PNATState, struct socket *, struct in_addr, u_int, struct in_addr, u_int);
+struct socket * solookup_udp (PNATState, struct in_addr, u_int);
+void sohash_update (PNATState, struct socket *);
+void sohash_remove (PNATState, struct socket *);
+#ifdef RT_OS_LINUX
+void soepoll_touch (PNATState, struct socket *);
+void soepoll_remove (PNATState, struct socket *);
+#else
+# define soepoll_touch(pData, so)  do {} while (0)
+# define soepoll_remove(pData, so) do {} while (0)
+#endif
 struct socket * socreate (void);
 void sofree (PNATState, struct socket *);
 int soread (PNATState, struct socket *);
@@ -461,7 +461,7 @@ findso:
     {
         QSOCKET_UNLOCK(tcb);
         /* @todo fix SOLOOKUP macrodefinition to be usable here */
-        so = solookup(&tcb, ti->ti_src, ti->ti_sport,
+        so = solookup(pData, &tcb, ti->ti_src, ti->ti_sport,
                       ti->ti_dst, ti->ti_dport);
         if (so)
         {
@@ -524,6 +524,7 @@ findso:
         so->so_lport = ti->ti_sport;
         so->so_faddr = ti->ti_dst;
         so->so_fport = ti->ti_dport;
+        sohash_update(pData, so);
 
         so->so_iptos = ((struct ip *)ti)->ip_tos;
 
@@ -531,6 +532,9 @@ findso:
         TCP_STATE_SWITCH_TO(tp, TCPS_LISTEN);
     }
 
+    /* The segment may change what the host socket has to wait for. */
+    soepoll_touch(pData, so);
+
     /*
      * If this is a still-connecting socket, this probably
      * a retransmit of the SYN.  Whether it's a retransmit SYN
@@ -299,7 +299,10 @@ tcp_close(PNATState pData, register struct tcpcb *tp)
     if (so == tcp_last_so)
         tcp_last_so = &tcb;
     if (so->s != -1)
+    {
         closesocket(so->s);
+        so->s = -1;
+    }
     /* Avoid double free if the socket is listening and therefore doesn't have
      * any sbufs reserved. */
     if (!(so->so_state & SS_FACCEPTCONN))
@@ -568,6 +571,7 @@ tcp_connect(PNATState pData, struct socket *inso)
     /* Translate connections from localhost to the real hostname */
     if (so->so_faddr.s_addr == 0 || so->so_faddr.s_addr == loopback_addr.s_addr)
         so->so_faddr = alias_addr;
+    sohash_update(pData, so);
 
     /* Close the accept() socket, set right state */
     if (inso->so_state & SS_FACCEPTONCE)
@@ -577,6 +581,7 @@ tcp_connect(PNATState pData, struct socket *inso)
                                    /* if it's not FACCEPTONCE, it's already NOFDREF */
     }
     so->s = s;
+    soepoll_touch(pData, so);
 
     tp = sototcpcb(so);
 
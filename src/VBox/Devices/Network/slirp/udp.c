@@ -215,20 +215,8 @@ udp_input(PNATState pData, register struct mbuf *m, int iphlen)
     if (   so->so_lport != uh->uh_sport
         || so->so_laddr.s_addr != ip->ip_src.s_addr)
     {
-        struct socket *tmp;
-
-        for (tmp = udb.so_next; tmp != &udb; tmp = tmp->so_next)
-        {
-            if (   tmp->so_lport        == uh->uh_sport
-                && tmp->so_laddr.s_addr == ip->ip_src.s_addr)
-            {
-                so = tmp;
-                break;
-            }
-        }
-        if (tmp == &udb)
-            so = NULL;
-        else
+        so = solookup_udp(pData, ip->ip_src, uh->uh_sport);
+        if (so)
         {
             udpstat.udpps_pcbcachemiss++;
             udp_last_so = so;
@@ -260,6 +248,7 @@ udp_input(PNATState pData, register struct mbuf *m, int iphlen)
         /* udp_last_so = so; */
         so->so_laddr = ip->ip_src;
         so->so_lport = uh->uh_sport;
+        sohash_update(pData, so);
 
         so->so_iptos = ip->ip_tos;
 
@@ -272,6 +261,7 @@ udp_input(PNATState pData, register struct mbuf *m, int iphlen)
     so->so_faddr = ip->ip_dst;   /* XXX */
     so->so_fport = uh->uh_dport; /* XXX */
     Assert(so->so_type == IPPROTO_UDP);
+    soepoll_touch(pData, so);
 
     /*
      * DNS proxy
@@ -616,10 +606,12 @@ udp_listen(PNATState pData, u_int32_t bind_addr, u_int port, u_int32_t laddr, u_
 
     so->so_lport = lport;
     so->so_laddr.s_addr = laddr;
+    sohash_update(pData, so);
     if (flags != SS_FACCEPTONCE)
         so->so_expire = 0;
 
     so->so_state = SS_ISFCONNECTED;
+    soepoll_touch(pData, so);
 
     LogFlowFunc(("LEAVE: %R[natsock]\n", so));
     return so;
@@ -662,6 +662,96 @@ static void doUnicastTest(PTSTSTATE pThis, bool fHeadGuard)
                       cb, pvBuf, sizeof(s_au16Frame), s_au16Frame);
 }
 
+/**
+ * Measures the cost of the unicast switching decision vs. the number of
+ * interfaces on the network.
+ *
+ * @param   cbSend              The send buffer size.
+ * @param   cbRecv              The receive buffer size.
+ */
+static void doSwitchBenchmark(uint32_t cbSend, uint32_t cbRecv)
+{
+    static uint32_t const s_acIfs[] = { 2, 8, 32, 128, 512 };
+    uint32_t const        cMaxIfs   = s_acIfs[RT_ELEMENTS(s_acIfs) - 1];
+    uint32_t const        cIterations = _128K;
+
+    INTNETIFHANDLE *pahIfs = (INTNETIFHANDLE *)RTMemAllocZ(sizeof(pahIfs[0]) * cMaxIfs);
+    RTTESTI_CHECK_RETV(pahIfs);
+
+    for (unsigned iTest = 0; iTest < RT_ELEMENTS(s_acIfs); iTest++)
+    {
+        uint32_t const cIfs = s_acIfs[iTest];
+        RTTestISubF("unicast switching decision, %u interfaces", cIfs);
+
+        /*
+         * Open the interfaces, give them distinct MAC addresses and
+         * activate them.
+         */
+        uint32_t cOpened = 0;
+        while (cOpened < cIfs)
+        {
+            RTMAC Mac = { { 0x08, 0x00, 0x27, 0x00, (uint8_t)(cOpened >> 8), (uint8_t)cOpened } };
+            pahIfs[cOpened] = INTNET_HANDLE_INVALID;
+            int rc = IntNetR0Open(g_pSession, "switchbench", kIntNetTrunkType_None, "",
+                                  0/*fFlags*/, cbSend, cbRecv, &pahIfs[cOpened]);
+            if (RT_FAILURE(rc))
+            {
+                RTTestIFailed("IntNetR0Open failed for interface #%u: %Rrc\n", cOpened, rc);
+                break;
+            }
+            cOpened++;
+
+            rc = IntNetR0IfSetMacAddress(pahIfs[cOpened - 1], g_pSession, &Mac);
+            if (RT_SUCCESS(rc))
+                rc = IntNetR0IfSetActive(pahIfs[cOpened - 1], g_pSession, true);
+            if (RT_FAILURE(rc))
+            {
+                RTTestIFailed("Setting up interface #%u failed: %Rrc\n", cOpened - 1, rc);
+                break;
+            }
+        }
+
+        if (!RTTestIErrorCount())
+        {
+            PINTNETIF       pIfSender = (PINTNETIF)RTHandleTableLookupWithCtx(g_pIntNet->hHtIfs, pahIfs[cIfs - 1], g_pSession);
+            PINTNETDSTTAB   pDstTab   = NULL;
+            RTTESTI_CHECK(pIfSender != NULL);
+            RTTESTI_CHECK_RC_OK(intnetR0AllocDstTab(cIfs, &pDstTab));
+            if (pIfSender && pDstTab)
+            {
+                /* The first interface is the last one a linear scan gets to. */
+                RTMAC const DstMac = { { 0x08, 0x00, 0x27, 0x00, 0x00, 0x00 } };
+                PINTNETNETWORK pNetwork = pIfSender->pNetwork;
+
+                uint64_t const nsStart = RTTimeNanoTS();
+                for (uint32_t i = 0; i < cIterations; i++)
+                {
+                    INTNETSWDECISION enmSwDecision;
+                    enmSwDecision = intnetR0NetworkSwitchUnicast(pNetwork, 0 /*fSrc*/, pIfSender, &DstMac, pDstTab);
+                    if (RT_UNLIKELY(enmSwDecision != INTNETSWDECISION_INTNET || pDstTab->cIfs != 1))
+                    {
+                        RTTestIFailed("enmSwDecision=%d cIfs=%u\n", enmSwDecision, pDstTab->cIfs);
+                        break;
+                    }
+                    intnetR0BusyDecIf(pDstTab->aIfs[0].pIf);
+                }
+                uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+
+                RTTestIValueF(cNsElapsed / cIterations, RTTESTUNIT_NS_PER_CALL, "%u interfaces", cIfs);
+            }
+            RTMemFree(pDstTab);
+            if (pIfSender)
+                intnetR0IfRelease(pIfSender, g_pSession);
+        }
+
+        while (cOpened-- > 0)
+            RTTESTI_CHECK_RC_OK(IntNetR0IfClose(pahIfs[cOpened], g_pSession));
+        RTTESTI_CHECK(IntNetR0GetNetworkCount() == 0);
+    }
+
+    RTMemFree(pahIfs);
+}
+
 static void doTest(PTSTSTATE pThis, uint32_t cbRecv, uint32_t cbSend)
 {
 
@@ -724,9 +814,15 @@ static void doTest(PTSTSTATE pThis, uint32_t cbRecv, uint32_t cbSend)
     }
 
     /*
-     * Destroy the service.
+     * Close the two interfaces and measure the switching decision cost.
      */
     tstCloseInterfaces(pThis);
+    if (!RTTestIErrorCount())
+        doSwitchBenchmark(cbSend, cbRecv);
+
+    /*
+     * Destroy the service.
+     */
     IntNetR0Term();
 }
 
@@ -0,0 +1,468 @@
+/* $Id$ */
+/** @file
+ * NAT - Testcase for the socket polling of slirp with many connections.
+ *
+ * A fake guest opens a large number of TCP connections through slirp to a
+ * listener on the host loopback and leaves them idle.  The testcase then
+ * measures what a round of slirp_select_fill / poll / slirp_select_poll
+ * costs and checks that data still flows in both directions on one of them.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include "slirp/libslirp.h"
+
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/net.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The number of connections we aim for. */
+#define TST_CONNECTIONS         10000
+/** The first guest port, connection i uses TST_GUEST_PORT_BASE + i. */
+#define TST_GUEST_PORT_BASE     20000
+/** Max number of handshakes in flight, keeps the host listen backlog happy. */
+#define TST_MAX_CONNECTING      256
+/** The initial sequence number of the guest. */
+#define TST_GUEST_ISS           UINT32_C(1000)
+/** The number of idle rounds to time. */
+#define TST_ROUNDS              1000
+/** The max number of descriptors we hand to poll(). */
+#define TST_MAX_POLLS           (TST_CONNECTIONS + 64)
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * The guest side of a connection.
+ */
+typedef struct TSTCONN
+{
+    /** The next sequence number the guest sends. */
+    uint32_t        uSeqGuest;
+    /** The next sequence number the guest expects. */
+    uint32_t        uSeqHost;
+    /** Set when the guest has sent the SYN. */
+    bool            fSynSent;
+    /** Set when the SYN+ACK was answered. */
+    bool            fEstablished;
+    /** Set when data from the host arrived. */
+    bool            fGotData;
+    /** The host side socket once accepted, -1 before. */
+    int             hHostSocket;
+} TSTCONN;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The test handle. */
+static RTTEST       g_hTest;
+/** The NAT instance. */
+static PNATState    g_pNATState;
+/** The guest side of the connections. */
+static TSTCONN     *g_paConns;
+/** The number of connections in use. */
+static unsigned     g_cConns;
+/** The number of established connections. */
+static unsigned     g_cEstablished;
+/** The number of connections the host listener accepted. */
+static unsigned     g_cAccepted;
+/** The port of the host listener (network order). */
+static uint16_t     g_uListenPort;
+/** The MAC of the fake guest. */
+static const RTMAC  g_GuestMac = { { 0x08, 0x00, 0x27, 0x01, 0x02, 0x03 } };
+/** The MAC slirp uses. */
+static const RTMAC  g_NatMac   = { { 0x52, 0x54, 0x00, 0x12, 0x35, 0x00 } };
+/** The poll array. */
+static struct pollfd g_aPolls[TST_MAX_POLLS];
+
+
+/**
+ * Sends a TCP segment from the guest through slirp.
+ */
+static void tstGuestSend(unsigned iConn, uint8_t fFlags, const void *pvData, size_t cbData)
+{
+    TSTCONN *pConn = &g_paConns[iConn];
+    size_t const cbFrame = sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN + cbData;
+    void  *pvBuf;
+    size_t cbBuf;
+    struct mbuf *m = slirp_ext_m_get(g_pNATState, cbFrame, &pvBuf, &cbBuf);
+    if (!m)
+    {
+        RTTestFailed(g_hTest, "slirp_ext_m_get(%zu) failed\n", cbFrame);
+        return;
+    }
+
+    uint8_t *pbFrame = (uint8_t *)pvBuf;
+    RT_BZERO(pbFrame, cbFrame);
+    PRTNETETHERHDR pEth = (PRTNETETHERHDR)pbFrame;
+    pEth->DstMac    = g_NatMac;
+    pEth->SrcMac    = g_GuestMac;
+    pEth->EtherType = RT_H2BE_U16(RTNET_ETHERTYPE_IPV4);
+
+    PRTNETIPV4 pIp = (PRTNETIPV4)(pEth + 1);
+    pIp->ip_v         = 4;
+    pIp->ip_hl        = RTNETIPV4_MIN_LEN / 4;
+    pIp->ip_len       = RT_H2BE_U16((uint16_t)(RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN + cbData));
+    pIp->ip_id        = RT_H2BE_U16((uint16_t)iConn);
+    pIp->ip_ttl       = 64;
+    pIp->ip_p         = RTNETIPV4_PROT_TCP;
+    pIp->ip_src.u     = RT_H2BE_U32_C(0x0a00020f);  /* 10.0.2.15, the guest */
+    pIp->ip_dst.u     = RT_H2BE_U32_C(0x0a000202);  /* 10.0.2.2, the host loopback */
+    pIp->ip_sum       = RTNetIPv4HdrChecksum(pIp);
+
+    PRTNETTCP pTcp = (PRTNETTCP)((uint8_t *)pIp + RTNETIPV4_MIN_LEN);
+    pTcp->th_sport = RT_H2BE_U16((uint16_t)(TST_GUEST_PORT_BASE + iConn));
+    pTcp->th_dport = g_uListenPort;
+    pTcp->th_seq   = RT_H2BE_U32(pConn->uSeqGuest);
+    pTcp->th_ack   = fFlags & RTNETTCP_F_ACK ? RT_H2BE_U32(pConn->uSeqHost) : 0;
+    pTcp->th_off   = RTNETTCP_MIN_LEN / 4;
+    pTcp->th_flags = fFlags;
+    pTcp->th_win   = RT_H2BE_U16(0xffff);
+    if (cbData)
+        memcpy(pTcp + 1, pvData, cbData);
+    pTcp->th_sum   = RTNetIPv4TCPChecksum(pIp, pTcp, NULL);
+
+    pConn->uSeqGuest += (uint32_t)cbData + (fFlags & RTNETTCP_F_SYN ? 1 : 0);
+    slirp_input(g_pNATState, m, cbFrame);
+}
+
+
+/**
+ * A pending answer of the guest; slirp must not be reentered from its
+ * output callbacks.
+ */
+static uint32_t     g_cPendingAcks;
+static uint32_t    *g_paPendingAcks;
+
+/**
+ * Looks at a frame slirp sends to the guest.
+ */
+static void tstGuestRecv(const uint8_t *pbFrame, int cbFrame)
+{
+    if (cbFrame < (int)(sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN))
+        return;
+    PCRTNETETHERHDR pEth = (PCRTNETETHERHDR)pbFrame;
+    if (pEth->EtherType != RT_H2BE_U16(RTNET_ETHERTYPE_IPV4))
+        return;
+    PCRTNETIPV4 pIp = (PCRTNETIPV4)(pEth + 1);
+    if (pIp->ip_p != RTNETIPV4_PROT_TCP)
+        return;
+    PCRTNETTCP pTcp = (PCRTNETTCP)((const uint8_t *)pIp + pIp->ip_hl * 4);
+    unsigned iConn = RT_BE2H_U16(pTcp->th_dport) - TST_GUEST_PORT_BASE;
+    if (iConn >= g_cConns)
+        return;
+    TSTCONN *pConn = &g_paConns[iConn];
+    uint32_t cbData = RT_BE2H_U16(pIp->ip_len) - pIp->ip_hl * 4 - pTcp->th_off * 4;
+
+    if (pTcp->th_flags & RTNETTCP_F_RST)
+        RTTestFailed(g_hTest, "connection #%u got reset\n", iConn);
+    else if ((pTcp->th_flags & (RTNETTCP_F_SYN | RTNETTCP_F_ACK)) == (RTNETTCP_F_SYN | RTNETTCP_F_ACK))
+    {
+        if (!pConn->fEstablished)
+        {
+            pConn->uSeqHost = RT_BE2H_U32(pTcp->th_seq) + 1;
+            g_paPendingAcks[g_cPendingAcks++] = iConn;
+        }
+    }
+    else if (cbData)
+    {
+        pConn->uSeqHost = RT_BE2H_U32(pTcp->th_seq) + cbData;
+        pConn->fGotData = true;
+        g_paPendingAcks[g_cPendingAcks++] = iConn;
+    }
+}
+
+/* The callbacks slirp expects from DrvNAT. */
+void slirp_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    NOREF(pvUser);
+    if (g_cPendingAcks < g_cConns)
+        tstGuestRecv(pu8Buf, cb);
+    slirp_ext_m_free(g_pNATState, m, (uint8_t *)pu8Buf);
+}
+
+void slirp_urg_output(void *pvUser, struct mbuf *m, const uint8_t *pu8Buf, int cb)
+{
+    slirp_output(pvUser, m, pu8Buf, cb);
+}
+
+void slirp_output_pending(void *pvUser)
+{
+    NOREF(pvUser);
+}
+
+
+/**
+ * Runs one round of the NAT thread loop of DrvNAT and answers what the
+ * guest has to.
+ *
+ * @returns The number of descriptors slirp handed out.
+ */
+static int tstRound(RTMSINTERVAL cMsTimeout)
+{
+    int cFds = slirp_get_nsock(g_pNATState);
+    AssertRelease(cFds <= TST_MAX_POLLS);
+    slirp_select_fill(g_pNATState, &cFds, g_aPolls);
+    unsigned cMsSlirp = slirp_get_timeout_ms(g_pNATState);
+    int rc = poll(g_aPolls, cFds, RT_MIN(cMsSlirp, cMsTimeout));
+    if (rc < 0 && errno != EINTR)
+        RTTestFailed(g_hTest, "poll failed: errno=%d\n", errno);
+    slirp_select_poll(g_pNATState, g_aPolls, cFds);
+
+    uint32_t const cAcks = g_cPendingAcks;
+    g_cPendingAcks = 0;
+    for (uint32_t i = 0; i < cAcks; i++)
+    {
+        unsigned iConn = g_paPendingAcks[i];
+        if (!g_paConns[iConn].fEstablished)
+        {
+            g_paConns[iConn].fEstablished = true;
+            g_cEstablished++;
+        }
+        tstGuestSend(iConn, RTNETTCP_F_ACK, NULL, 0);
+    }
+    return cFds;
+}
+
+/**
+ * Accepts the connections slirp made to the host listener.
+ */
+static void tstAccept(int hListen)
+{
+    for (;;)
+    {
+        struct sockaddr_in Addr;
+        socklen_t cbAddr = sizeof(Addr);
+        int hSocket = accept(hListen, (struct sockaddr *)&Addr, &cbAddr);
+        if (hSocket < 0)
+            break;
+        fcntl(hSocket, F_SETFL, O_NONBLOCK);
+
+        /* Slirp connects from an ephemeral port, so we can't tell which guest
+           connection this is.  It doesn't matter, they are interchangeable. */
+        if (g_cAccepted < g_cConns)
+            g_paConns[g_cAccepted++].hHostSocket = hSocket;
+        else
+            close(hSocket);
+    }
+}
+
+
+/**
+ * Opens the connections.
+ */
+static void tstConnect(int hListen)
+{
+    RTTestSubF(g_hTest, "%u connections", g_cConns);
+    uint64_t const msStart = RTTimeMilliTS();
+    unsigned       iNext   = 0;
+    while (g_cEstablished < g_cConns)
+    {
+        while (iNext < g_cConns && iNext - g_cEstablished < TST_MAX_CONNECTING)
+        {
+            g_paConns[iNext].fSynSent = true;
+            tstGuestSend(iNext++, RTNETTCP_F_SYN, NULL, 0);
+        }
+        tstRound(1);
+        tstAccept(hListen);
+        if (RTTimeMilliTS() - msStart > 120 * RT_MS_1SEC)
+        {
+            RTTestFailed(g_hTest, "only %u of %u connections established after 120s\n", g_cEstablished, g_cConns);
+            break;
+        }
+    }
+    RTTestValue(g_hTest, "Connection setup", RTTimeMilliTS() - msStart, RTTESTUNIT_MS);
+}
+
+
+/**
+ * Times rounds with all connections idle.
+ */
+static void tstIdleRounds(void)
+{
+    RTTestSubF(g_hTest, "idle rounds, %u connections", g_cEstablished);
+    int      cFdsMax = 0;
+    uint64_t nsStart = RTTimeNanoTS();
+    for (unsigned i = 0; i < TST_ROUNDS; i++)
+    {
+        int cFds = tstRound(0);
+        cFdsMax = RT_MAX(cFdsMax, cFds);
+    }
+    uint64_t cNsElapsed = RTTimeNanoTS() - nsStart;
+    RTTestValue(g_hTest, "Idle round", cNsElapsed / TST_ROUNDS, RTTESTUNIT_NS_PER_CALL);
+    RTTestValue(g_hTest, "Descriptors polled", cFdsMax, RTTESTUNIT_OCCURRENCES);
+}
+
+
+/**
+ * Checks that data gets through in both directions on one connection.
+ */
+static void tstData(void)
+{
+    RTTestSub(g_hTest, "data on one connection");
+    unsigned iConn = g_cConns / 2;
+    TSTCONN *pConn = &g_paConns[iConn];
+    if (!pConn->fEstablished || pConn->hHostSocket == -1)
+    {
+        RTTestFailed(g_hTest, "connection #%u isn't up\n", iConn);
+        return;
+    }
+
+    /* Guest to host: the host socket must become writable for slirp. */
+    static const char s_szPing[] = "ping";
+    tstGuestSend(iConn, RTNETTCP_F_ACK | RTNETTCP_F_PSH, s_szPing, sizeof(s_szPing) - 1);
+    char     szBuf[16];
+    ssize_t  cbRead = -1;
+    uint64_t nsStart = RTTimeNanoTS();
+    for (unsigned i = 0; i < 1000 && cbRead <= 0; i++)
+    {
+        tstRound(1);
+        /* Whoever accepted it, the connections are interchangeable. */
+        for (unsigned j = 0; j < g_cConns && cbRead <= 0; j++)
+            if (g_paConns[j].hHostSocket != -1)
+                cbRead = recv(g_paConns[j].hHostSocket, szBuf, sizeof(szBuf), 0);
+    }
+    if (cbRead != (ssize_t)sizeof(s_szPing) - 1 || memcmp(szBuf, s_szPing, cbRead))
+        RTTestFailed(g_hTest, "guest to host: cbRead=%zd\n", cbRead);
+    else
+        RTTestValue(g_hTest, "Guest to host latency", RTTimeNanoTS() - nsStart, RTTESTUNIT_NS);
+
+    /* Host to guest, on every host socket so whichever is ours answers. */
+    static const char s_szPong[] = "pong";
+    for (unsigned j = 0; j < g_cConns; j++)
+        g_paConns[j].fGotData = false;
+    for (unsigned j = 0; j < g_cConns; j++)
+        if (g_paConns[j].hHostSocket != -1)
+            send(g_paConns[j].hHostSocket, s_szPong, sizeof(s_szPong) - 1, 0);
+    nsStart = RTTimeNanoTS();
+    unsigned cGotData = 0;
+    for (unsigned i = 0; i < 5000 && cGotData < g_cEstablished; i++)
+    {
+        tstRound(1);
+        cGotData = 0;
+        for (unsigned j = 0; j < g_cConns; j++)
+            cGotData += g_paConns[j].fGotData;
+    }
+    if (cGotData < g_cEstablished)
+        RTTestFailed(g_hTest, "host to guest: only %u of %u connections delivered data\n", cGotData, g_cEstablished);
+    else
+        RTTestValue(g_hTest, "Host to guest, all connections", RTTimeNanoTS() - nsStart, RTTESTUNIT_NS);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNATSockets", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    /*
+     * Each connection costs a descriptor on either side.
+     */
+    struct rlimit Limit;
+    g_cConns = TST_CONNECTIONS;
+    if (getrlimit(RLIMIT_NOFILE, &Limit) == 0)
+    {
+        Limit.rlim_cur = Limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &Limit);
+        getrlimit(RLIMIT_NOFILE, &Limit);
+        if (Limit.rlim_cur < 2 * TST_CONNECTIONS + 64)
+        {
+            g_cConns = Limit.rlim_cur > 128 ? (unsigned)(Limit.rlim_cur - 64) / 2 : 32;
+            RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "RLIMIT_NOFILE is %u, using %u connections only\n",
+                         (unsigned)Limit.rlim_cur, g_cConns);
+        }
+    }
+    g_paConns       = (TSTCONN *)RTMemAllocZ(sizeof(TSTCONN) * g_cConns);
+    g_paPendingAcks = (uint32_t *)RTMemAllocZ(sizeof(uint32_t) * g_cConns);
+    RTTESTI_CHECK_RET(g_paConns && g_paPendingAcks, RTEXITCODE_FAILURE);
+    for (unsigned i = 0; i < g_cConns; i++)
+    {
+        g_paConns[i].uSeqGuest   = TST_GUEST_ISS;
+        g_paConns[i].hHostSocket = -1;
+    }
+
+    /*
+     * The host listener.
+     */
+    int hListen = socket(AF_INET, SOCK_STREAM, 0);
+    RTTESTI_CHECK_RET(hListen >= 0, RTEXITCODE_FAILURE);
+    struct sockaddr_in Addr;
+    RT_ZERO(Addr);
+    Addr.sin_family      = AF_INET;
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t cbAddr = sizeof(Addr);
+    RTTESTI_CHECK_RET(bind(hListen, (struct sockaddr *)&Addr, sizeof(Addr)) == 0, RTEXITCODE_FAILURE);
+    RTTESTI_CHECK_RET(getsockname(hListen, (struct sockaddr *)&Addr, &cbAddr) == 0, RTEXITCODE_FAILURE);
+    RTTESTI_CHECK_RET(listen(hListen, 4096) == 0, RTEXITCODE_FAILURE);
+    fcntl(hListen, F_SETFL, O_NONBLOCK);
+    g_uListenPort = Addr.sin_port;
+
+    /*
+     * The NAT instance; small socket buffers to keep the memory use sane.
+     */
+    int rc = slirp_init(&g_pNATState, RT_H2N_U32_C(0x0a000200), RT_H2N_U32_C(0xffffff00),
+                        false /*fPassDomain*/, false /*fUseHostResolver*/, 0 /*i32AliasMode*/,
+                        100 /*iIcmpCacheLimit*/, NULL /*pvUser*/);
+    if (RT_SUCCESS(rc))
+    {
+        slirp_set_tcp_rcvspace(g_pNATState, 8);
+        slirp_set_tcp_sndspace(g_pNATState, 8);
+        slirp_set_ethaddr_and_activate_port_forwarding(g_pNATState, &g_GuestMac.au8[0], RT_H2N_U32_C(0x0a00020f));
+        slirp_link_up(g_pNATState);
+
+        tstConnect(hListen);
+        if (g_cEstablished == g_cConns)
+        {
+            tstIdleRounds();
+            tstData();
+        }
+
+        slirp_term(g_pNATState);
+    }
+    else
+        RTTestFailed(g_hTest, "slirp_init failed: %Rrc\n", rc);
+
+    for (unsigned i = 0; i < g_cConns; i++)
+        if (g_paConns[i].hHostSocket != -1)
+            close(g_paConns[i].hHostSocket);
+    close(hListen);
+    RTMemFree(g_paPendingAcks);
+    RTMemFree(g_paConns);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
@@ -0,0 +1,413 @@
+/* $Id$ */
+/** @file
+ * Network - Testcase for the receive side TCP coalescing helpers (GRO) in
+ *           pdmnetinline.h.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/pdmnetinline.h>
+
+#include <iprt/net.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The max number of segments a test feeds in. */
+#define TST_MAX_SEGS        64
+/** The payload size of a full segment. */
+#define TST_MSS             1448
+/** The max size of a test frame: ethernet + IPv6 + TCP with options. */
+#define TST_MAX_FRAME       (sizeof(RTNETETHERHDR) + RTNETIPV6_MIN_LEN + 60 + TST_MSS)
+/** The initial sequence number of the flow. */
+#define TST_ISS             UINT32_C(0xfffff000) /* wraps around */
+/** The size of the TCP timestamp option we put in, padding included. */
+#define TST_TS_OPT_SIZE     12
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * A segment of the test flow.
+ */
+typedef struct TSTSEG
+{
+    /** The size of the frame. */
+    uint32_t    cbFrame;
+    /** The frame. */
+    uint8_t     abFrame[TST_MAX_FRAME];
+} TSTSEG;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The coalescing state, too big for the stack. */
+static PDMNETGRO    g_Gro;
+/** The segments fed in by the current test. */
+static TSTSEG       g_aSegs[TST_MAX_SEGS];
+/** Scratch space for carving. */
+static uint8_t      g_abHdrScratch[256];
+
+
+/**
+ * Builds a TCP segment of the test flow with correct checksums.
+ *
+ * The payload bytes are derived from the sequence number, so merged frames
+ * can be checked for having everything in the right place.
+ *
+ * @param   pSeg        Where to build the segment.
+ * @param   fIPv6       IPv6 instead of IPv4.
+ * @param   uSeq        The TCP sequence number.
+ * @param   cbPayload   The payload size.
+ * @param   fFlags      The TCP flags.
+ * @param   uTsVal      The TSval of the timestamp option, 0 for no options.
+ * @param   uIpId       The IPv4 ID.
+ */
+static void tstMakeSeg(TSTSEG *pSeg, bool fIPv6, uint32_t uSeq, uint32_t cbPayload, uint8_t fFlags,
+                       uint32_t uTsVal, uint16_t uIpId)
+{
+    uint8_t *pbFrame = pSeg->abFrame;
+    memset(pbFrame, 0, sizeof(pSeg->abFrame));
+
+    PRTNETETHERHDR pEthHdr = (PRTNETETHERHDR)pbFrame;
+    static RTMAC const s_DstMac = {{ 0x08, 0x00, 0x27, 0x01, 0x02, 0x03 }};
+    static RTMAC const s_SrcMac = {{ 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 }};
+    pEthHdr->DstMac    = s_DstMac;
+    pEthHdr->SrcMac    = s_SrcMac;
+    pEthHdr->EtherType = RT_H2N_U16(fIPv6 ? RTNET_ETHERTYPE_IPV6 : RTNET_ETHERTYPE_IPV4);
+
+    uint32_t const cbTcpHdr = RTNETTCP_MIN_LEN + (uTsVal ? TST_TS_OPT_SIZE : 0);
+    uint32_t const offTcp   = sizeof(RTNETETHERHDR) + (fIPv6 ? RTNETIPV6_MIN_LEN : RTNETIPV4_MIN_LEN);
+    PRTNETTCP      pTcpHdr  = (PRTNETTCP)&pbFrame[offTcp];
+    pTcpHdr->th_sport = RT_H2N_U16_C(80);
+    pTcpHdr->th_dport = RT_H2N_U16_C(49152);
+    pTcpHdr->th_seq   = RT_H2N_U32(uSeq);
+    pTcpHdr->th_ack   = RT_H2N_U32_C(0x10000);
+    pTcpHdr->th_off   = cbTcpHdr / 4;
+    pTcpHdr->th_flags = fFlags;
+    pTcpHdr->th_win   = RT_H2N_U16_C(0x8000);
+    if (uTsVal)
+    {
+        uint8_t *pbOpt = (uint8_t *)(pTcpHdr + 1);
+        pbOpt[0] = 1;                   /* NOP */
+        pbOpt[1] = 1;                   /* NOP */
+        pbOpt[2] = 8;                   /* timestamps */
+        pbOpt[3] = 10;
+        uint32_t const u32TsVal = RT_H2N_U32(uTsVal);
+        uint32_t const u32TsEcr = RT_H2N_U32_C(0x12345678);
+        memcpy(&pbOpt[4], &u32TsVal, sizeof(u32TsVal));
+        memcpy(&pbOpt[8], &u32TsEcr, sizeof(u32TsEcr));
+    }
+
+    uint8_t *pbPayload = (uint8_t *)pTcpHdr + cbTcpHdr;
+    for (uint32_t off = 0; off < cbPayload; off++)
+        pbPayload[off] = (uint8_t)(uSeq + off);
+
+    uint32_t u32PseudoSum;
+    if (fIPv6)
+    {
+        PRTNETIPV6 pIpHdr = (PRTNETIPV6)(pEthHdr + 1);
+        pIpHdr->ip6_vfc  = RT_H2N_U32_C(0x60000000);
+        pIpHdr->ip6_plen = RT_H2N_U16((uint16_t)(cbTcpHdr + cbPayload));
+        pIpHdr->ip6_nxt  = RTNETIPV4_PROT_TCP;
+        pIpHdr->ip6_hlim = 64;
+        pIpHdr->ip6_src.au8[0]  = 0xfe; pIpHdr->ip6_src.au8[1]  = 0x80; pIpHdr->ip6_src.au8[15] = 1;
+        pIpHdr->ip6_dst.au8[0]  = 0xfe; pIpHdr->ip6_dst.au8[1]  = 0x80; pIpHdr->ip6_dst.au8[15] = 2;
+        u32PseudoSum = RTNetIPv6PseudoChecksum(pIpHdr);
+    }
+    else
+    {
+        PRTNETIPV4 pIpHdr = (PRTNETIPV4)(pEthHdr + 1);
+        pIpHdr->ip_v   = 4;
+        pIpHdr->ip_hl  = RTNETIPV4_MIN_LEN / 4;
+        pIpHdr->ip_len = RT_H2N_U16((uint16_t)(RTNETIPV4_MIN_LEN + cbTcpHdr + cbPayload));
+        pIpHdr->ip_id  = RT_H2N_U16(uIpId);
+        pIpHdr->ip_off = RT_H2N_U16_C(RTNETIPV4_FLAGS_DF);
+        pIpHdr->ip_ttl = 64;
+        pIpHdr->ip_p   = RTNETIPV4_PROT_TCP;
+        pIpHdr->ip_src.u = RT_H2N_U32_C(0x0a000202);
+        pIpHdr->ip_dst.u = RT_H2N_U32_C(0x0a00020f);
+        pIpHdr->ip_sum = RTNetIPv4HdrChecksum(pIpHdr);
+        u32PseudoSum = RTNetIPv4PseudoChecksum(pIpHdr);
+    }
+    pTcpHdr->th_sum = RTNetTCPChecksum(u32PseudoSum, pTcpHdr, pbPayload, cbPayload);
+
+    pSeg->cbFrame = offTcp + cbTcpHdr + cbPayload;
+}
+
+
+/**
+ * Builds the segments of an in-order flow of full sized segments.
+ *
+ * @param   cSegs       The number of segments.
+ * @param   fIPv6       IPv6 instead of IPv4.
+ * @param   uTsVal      The TSval of all segments, 0 for no options.
+ */
+static void tstMakeFlow(unsigned cSegs, bool fIPv6, uint32_t uTsVal)
+{
+    for (unsigned i = 0; i < cSegs; i++)
+        tstMakeSeg(&g_aSegs[i], fIPv6, TST_ISS + i * TST_MSS, TST_MSS, RTNETTCP_F_ACK, uTsVal, (uint16_t)(0x4242 + i));
+}
+
+
+/**
+ * Feeds segments into a fresh coalescing state, expecting all to be taken.
+ */
+static void tstFeed(unsigned cSegs)
+{
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK_RETV(PDMNetGroStart(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+    for (unsigned i = 1; i < cSegs; i++)
+        RTTESTI_CHECK_MSG_RETV(PDMNetGroAppend(&g_Gro, g_aSegs[i].abFrame, g_aSegs[i].cbFrame), ("i=%u\n", i));
+    RTTESTI_CHECK(g_Gro.cSegs == cSegs);
+}
+
+
+/**
+ * Finishes the coalesced frame, checks its headers and then carves it up
+ * again, expecting to get back exactly the segments fed in.
+ */
+static void tstFinishAndCarve(unsigned cSegs)
+{
+    uint32_t cbPayload = 0;
+    for (unsigned i = 0; i < cSegs; i++)
+        cbPayload += g_aSegs[i].cbFrame - g_Gro.Gso.cbHdrsTotal;
+
+    PCPDMNETWORKGSO pGso = PDMNetGroFinish(&g_Gro);
+    RTTESTI_CHECK_RETV(pGso);
+    RTTESTI_CHECK(pGso->cbMaxSeg == g_aSegs[0].cbFrame - pGso->cbHdrsTotal);
+    RTTESTI_CHECK(g_Gro.cbFrame == pGso->cbHdrsTotal + cbPayload);
+    RTTESTI_CHECK_RETV(PDMNetGsoIsValid(pGso, sizeof(*pGso), g_Gro.cbFrame));
+    RTTESTI_CHECK_RETV(PDMNetGsoCalcSegmentCount(pGso, g_Gro.cbFrame) == cSegs);
+
+    /* The IP header of the big frame must be consistent, the TCP checksum is
+       left partial (pseudo header only) for the guest. */
+    if (pGso->u8Type == PDMNETWORKGSOTYPE_IPV4_TCP)
+    {
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)&g_Gro.abFrame[pGso->offHdr1];
+        RTTESTI_CHECK(RT_N2H_U16(pIpHdr->ip_len) == g_Gro.cbFrame - pGso->offHdr1);
+        RTTESTI_CHECK(RTNetIPv4HdrChecksum(pIpHdr) == pIpHdr->ip_sum);
+    }
+    else
+    {
+        PCRTNETIPV6 pIpHdr = (PCRTNETIPV6)&g_Gro.abFrame[pGso->offHdr1];
+        RTTESTI_CHECK(RT_N2H_U16(pIpHdr->ip6_plen) == g_Gro.cbFrame - pGso->offHdr1 - RTNETIPV6_MIN_LEN);
+    }
+
+    /* The payload went in in sequence. */
+    uint8_t const  *pbPayload = &g_Gro.abFrame[pGso->cbHdrsTotal];
+    PCRTNETTCP      pTcpHdr   = (PCRTNETTCP)&g_Gro.abFrame[pGso->offHdr2];
+    uint32_t const  uSeq      = RT_N2H_U32(pTcpHdr->th_seq);
+    uint32_t        offBad    = UINT32_MAX;
+    for (uint32_t off = 0; off < cbPayload && offBad == UINT32_MAX; off++)
+        if (pbPayload[off] != (uint8_t)(uSeq + off))
+            offBad = off;
+    RTTESTI_CHECK_MSG(offBad == UINT32_MAX, ("offBad=%#x\n", offBad));
+
+    /* Carving must give back the original segments, complete checksums and all. */
+    PDMNETWORKGSO const Gso = *pGso;
+    for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+    {
+        uint32_t cbSegFrame;
+        uint8_t *pbSegFrame = (uint8_t *)PDMNetGsoCarveSegmentQD(&Gso, g_Gro.abFrame, g_Gro.cbFrame, g_abHdrScratch,
+                                                                 iSeg, cSegs, &cbSegFrame);
+        RTTESTI_CHECK_MSG(cbSegFrame == g_aSegs[iSeg].cbFrame,
+                          ("iSeg=%u cbSegFrame=%#x expected %#x\n", iSeg, cbSegFrame, g_aSegs[iSeg].cbFrame));
+        if (cbSegFrame == g_aSegs[iSeg].cbFrame)
+            RTTESTI_CHECK_MSG(!memcmp(pbSegFrame, g_aSegs[iSeg].abFrame, cbSegFrame),
+                              ("iSeg=%u: %.*Rhxs\nexpected: %.*Rhxs\n", iSeg, Gso.cbHdrsTotal, pbSegFrame,
+                               Gso.cbHdrsTotal, g_aSegs[iSeg].abFrame));
+    }
+}
+
+
+static void tstInOrder(void)
+{
+    RTTestISub("in-order merge");
+
+    /* IPv4 without options. */
+    tstMakeFlow(8, false /*fIPv6*/, 0 /*uTsVal*/);
+    tstFeed(8);
+    RTTESTI_CHECK(!g_Gro.fClosed);
+    tstFinishAndCarve(8);
+
+    /* IPv4 with timestamps, ending in a short pushed segment. */
+    tstMakeFlow(5, false /*fIPv6*/, 1000);
+    tstMakeSeg(&g_aSegs[5], false /*fIPv6*/, TST_ISS + 5 * TST_MSS, 100, RTNETTCP_F_ACK | RTNETTCP_F_PSH, 1000, 0x4242 + 5);
+    tstFeed(6);
+    RTTESTI_CHECK(g_Gro.fClosed);
+    tstFinishAndCarve(6);
+
+    /* IPv6 with timestamps. */
+    tstMakeFlow(6, true /*fIPv6*/, 2000);
+    tstFeed(6);
+    tstFinishAndCarve(6);
+
+    /* A single segment goes up unmodified. */
+    tstMakeFlow(1, false /*fIPv6*/, 0 /*uTsVal*/);
+    tstFeed(1);
+    RTTESTI_CHECK(PDMNetGroFinish(&g_Gro) == NULL);
+    RTTESTI_CHECK(g_Gro.cbFrame == g_aSegs[0].cbFrame);
+    RTTESTI_CHECK(!memcmp(g_Gro.abFrame, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+
+    /* Growing until there is no room for another full segment. */
+    tstMakeFlow(TST_MAX_SEGS, false /*fIPv6*/, 1000);
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK_RETV(PDMNetGroStart(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+    unsigned cSegs = 1;
+    while (cSegs < TST_MAX_SEGS && PDMNetGroAppend(&g_Gro, g_aSegs[cSegs].abFrame, g_aSegs[cSegs].cbFrame))
+        cSegs++;
+    RTTESTI_CHECK(g_Gro.fClosed);
+    RTTESTI_CHECK(g_Gro.cbFrame <= PDMNETGRO_MAX_FRAME);
+    RTTESTI_CHECK(g_Gro.cbFrame + g_Gro.Gso.cbMaxSeg > PDMNETGRO_MAX_FRAME);
+    RTTESTI_CHECK(cSegs == (PDMNETGRO_MAX_FRAME - g_Gro.Gso.cbHdrsTotal) / TST_MSS);
+    tstFinishAndCarve(cSegs);
+}
+
+
+static void tstSeqGaps(void)
+{
+    RTTestISub("sequence gaps");
+    tstMakeFlow(4, false /*fIPv6*/, 1000);
+
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK_RETV(PDMNetGroStart(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+
+    /* A lost segment, a retransmission and an old segment are refused
+       without touching the frame. */
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[2].abFrame, g_aSegs[2].cbFrame));
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+    RTTESTI_CHECK(g_Gro.cSegs == 1);
+    RTTESTI_CHECK(g_Gro.cbFrame == g_aSegs[0].cbFrame);
+
+    /* The next one in sequence is still welcome. */
+    RTTESTI_CHECK(PDMNetGroAppend(&g_Gro, g_aSegs[1].abFrame, g_aSegs[1].cbFrame));
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[3].abFrame, g_aSegs[3].cbFrame));
+    RTTESTI_CHECK(PDMNetGroAppend(&g_Gro, g_aSegs[2].abFrame, g_aSegs[2].cbFrame));
+    RTTESTI_CHECK(PDMNetGroAppend(&g_Gro, g_aSegs[3].abFrame, g_aSegs[3].cbFrame));
+    tstFinishAndCarve(4);
+}
+
+
+static void tstClose(void)
+{
+    RTTestISub("PSH and short segments");
+
+    /* A pushed segment is not worth starting with. */
+    tstMakeSeg(&g_aSegs[0], false /*fIPv6*/, TST_ISS, TST_MSS, RTNETTCP_F_ACK | RTNETTCP_F_PSH, 0, 0x4242);
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK(!PDMNetGroStart(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+    RTTESTI_CHECK(g_Gro.cSegs == 0);
+
+    /* A pushed full segment closes the frame and the PSH goes up with it. */
+    tstMakeFlow(3, false /*fIPv6*/, 0 /*uTsVal*/);
+    tstMakeSeg(&g_aSegs[2], false /*fIPv6*/, TST_ISS + 2 * TST_MSS, TST_MSS, RTNETTCP_F_ACK | RTNETTCP_F_PSH, 0, 0x4242 + 2);
+    tstFeed(3);
+    RTTESTI_CHECK(g_Gro.fClosed);
+    RTTESTI_CHECK(((PCRTNETTCP)&g_Gro.abFrame[g_Gro.Gso.offHdr2])->th_flags & RTNETTCP_F_PSH);
+    tstMakeSeg(&g_aSegs[3], false /*fIPv6*/, TST_ISS + 3 * TST_MSS, TST_MSS, RTNETTCP_F_ACK, 0, 0x4242 + 3);
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[3].abFrame, g_aSegs[3].cbFrame));
+    tstFinishAndCarve(3);
+
+    /* A short segment closes it too. */
+    tstMakeFlow(2, false /*fIPv6*/, 0 /*uTsVal*/);
+    tstMakeSeg(&g_aSegs[2], false /*fIPv6*/, TST_ISS + 2 * TST_MSS, 512, RTNETTCP_F_ACK, 0, 0x4242 + 2);
+    tstFeed(3);
+    RTTESTI_CHECK(g_Gro.fClosed);
+    tstFinishAndCarve(3);
+
+    /* A segment larger than the first one doesn't fit the GSO context. */
+    tstMakeSeg(&g_aSegs[0], false /*fIPv6*/, TST_ISS, 1000, RTNETTCP_F_ACK, 0, 0x4242);
+    tstMakeSeg(&g_aSegs[1], false /*fIPv6*/, TST_ISS + 1000, 1001, RTNETTCP_F_ACK, 0, 0x4242 + 1);
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK_RETV(PDMNetGroStart(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[1].abFrame, g_aSegs[1].cbFrame));
+}
+
+
+static void tstMismatch(void)
+{
+    RTTestISub("header mismatches");
+    tstMakeFlow(2, false /*fIPv6*/, 1000);
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK_RETV(PDMNetGroStart(&g_Gro, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+
+    /* Different TSval. */
+    tstMakeSeg(&g_aSegs[1], false /*fIPv6*/, TST_ISS + TST_MSS, TST_MSS, RTNETTCP_F_ACK, 1001, 0x4243);
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[1].abFrame, g_aSegs[1].cbFrame));
+
+    /* No options at all. */
+    tstMakeSeg(&g_aSegs[1], false /*fIPv6*/, TST_ISS + TST_MSS, TST_MSS, RTNETTCP_F_ACK, 0, 0x4243);
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[1].abFrame, g_aSegs[1].cbFrame));
+
+    /* Another ACK number, with the checksum fixed up. */
+    tstMakeSeg(&g_aSegs[1], false /*fIPv6*/, TST_ISS + TST_MSS, TST_MSS, RTNETTCP_F_ACK, 1000, 0x4243);
+    PRTNETIPV4 pIpHdr  = (PRTNETIPV4)&g_aSegs[1].abFrame[sizeof(RTNETETHERHDR)];
+    PRTNETTCP  pTcpHdr = (PRTNETTCP)(pIpHdr + 1);
+    pTcpHdr->th_ack = RT_H2N_U32_C(0x20000);
+    pTcpHdr->th_sum = RTNetTCPChecksum(RTNetIPv4PseudoChecksum(pIpHdr), pTcpHdr,
+                                       (uint8_t *)pTcpHdr + RTNETTCP_MIN_LEN + TST_TS_OPT_SIZE, TST_MSS);
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[1].abFrame, g_aSegs[1].cbFrame));
+
+    /* IPv6 segment of an IPv4 flow. */
+    tstMakeSeg(&g_aSegs[1], true /*fIPv6*/, TST_ISS + TST_MSS, TST_MSS, RTNETTCP_F_ACK, 1000, 0);
+    RTTESTI_CHECK(!PDMNetGroAppend(&g_Gro, g_aSegs[1].abFrame, g_aSegs[1].cbFrame));
+
+    /* None of that must have changed the frame. */
+    RTTESTI_CHECK(g_Gro.cSegs == 1);
+    RTTESTI_CHECK(!memcmp(g_Gro.abFrame, g_aSegs[0].abFrame, g_aSegs[0].cbFrame));
+
+    /* Bad checksums and other flags aren't coalesced at all. */
+    tstMakeSeg(&g_aSegs[2], false /*fIPv6*/, TST_ISS, TST_MSS, RTNETTCP_F_ACK, 0, 0x4242);
+    g_aSegs[2].abFrame[g_aSegs[2].cbFrame - 1] ^= 0x55;
+    PDMNetGroReset(&g_Gro);
+    RTTESTI_CHECK(!PDMNetGroStart(&g_Gro, g_aSegs[2].abFrame, g_aSegs[2].cbFrame));
+
+    tstMakeSeg(&g_aSegs[2], false /*fIPv6*/, TST_ISS, TST_MSS, RTNETTCP_F_ACK, 0, 0x4242);
+    pIpHdr = (PRTNETIPV4)&g_aSegs[2].abFrame[sizeof(RTNETETHERHDR)];
+    pIpHdr->ip_ttl--;
+    RTTESTI_CHECK(!PDMNetGroStart(&g_Gro, g_aSegs[2].abFrame, g_aSegs[2].cbFrame));
+
+    tstMakeSeg(&g_aSegs[2], false /*fIPv6*/, TST_ISS, TST_MSS, RTNETTCP_F_ACK | RTNETTCP_F_FIN, 0, 0x4242);
+    RTTESTI_CHECK(!PDMNetGroStart(&g_Gro, g_aSegs[2].abFrame, g_aSegs[2].cbFrame));
+
+    tstMakeSeg(&g_aSegs[2], false /*fIPv6*/, TST_ISS, 0, RTNETTCP_F_ACK, 0, 0x4242);
+    RTTESTI_CHECK(!PDMNetGroStart(&g_Gro, g_aSegs[2].abFrame, g_aSegs[2].cbFrame));
+    RTTESTI_CHECK(g_Gro.cSegs == 0);
+}
+
+
+int main()
+{
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstNetGro", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(hTest);
+
+    tstInOrder();
+    tstSeqGaps();
+    tstClose();
+    tstMismatch();
+
+    return RTTestSummaryAndDestroy(hTest);
+}
@@ -893,6 +893,58 @@ PDMBOTHCBDECL(int) serialIOPortRead(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT P
 
 #ifdef IN_RING3
 
+/**
+ * @callback_method_impl{FNIOMIOPORTOUTSTRBUF}
+ *
+ * Feeds a REP OUTSB to the transmit holding register (or any other register)
+ * in one go instead of one IOM call per byte.
+ */
+static DECLCALLBACK(int) serialIOPortWriteStrBuf(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void const *pvSrc,
+                                                 uint32_t *pcTransfers, unsigned cb)
+{
+    PDEVSERIAL pThis = PDMINS_2_DATA(pDevIns, PDEVSERIAL);
+    Assert(PDMCritSectIsOwner(&pThis->CritSect));
+    NOREF(pvUser);
+
+    int rc = VINF_SUCCESS;
+    if (cb == 1)
+    {
+        uint8_t const *pb = (uint8_t const *)pvSrc;
+        Log2(("%s: port %#06x cb %#x\n", __FUNCTION__, Port, *pcTransfers));
+        while (*pcTransfers > 0 && rc == VINF_SUCCESS)
+        {
+            rc = serial_ioport_write(pThis, Port, *pb++);
+            *pcTransfers -= 1;
+        }
+    }
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNIOMIOPORTINSTRBUF}
+ */
+static DECLCALLBACK(int) serialIOPortReadStrBuf(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void *pvDst,
+                                                uint32_t *pcTransfers, unsigned cb)
+{
+    PDEVSERIAL pThis = PDMINS_2_DATA(pDevIns, PDEVSERIAL);
+    Assert(PDMCritSectIsOwner(&pThis->CritSect));
+    NOREF(pvUser);
+
+    int rc = VINF_SUCCESS;
+    if (cb == 1)
+    {
+        uint8_t *pb = (uint8_t *)pvDst;
+        Log2(("%s: port %#06x cb %#x\n", __FUNCTION__, Port, *pcTransfers));
+        while (*pcTransfers > 0 && rc == VINF_SUCCESS)
+        {
+            *pb++ = (uint8_t)serial_ioport_read(pThis, Port, &rc);
+            *pcTransfers -= 1;
+        }
+    }
+    return rc;
+}
+
 /* -=-=-=-=-=-=-=-=- Saved State -=-=-=-=-=-=-=-=- */
 
 /**
@@ -1301,6 +1353,9 @@ static DECLCALLBACK(int) serialConstruct(PPDMDEVINS pDevIns, int iInstance, PCFG
                                  NULL, NULL, "SERIAL");
     if (RT_FAILURE(rc))
         return rc;
+    rc = PDMDevHlpIOPortRegisterStrBuf(pDevIns, io_base, 8, serialIOPortWriteStrBuf, serialIOPortReadStrBuf);
+    if (RT_FAILURE(rc))
+        return rc;
 
     if (pThis->fGCEnabled)
     {
@@ -518,6 +518,8 @@ PDMBOTHCBDECL(int) ataIOPortWrite1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Po
 PDMBOTHCBDECL(int) ataIOPortRead1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, uint32_t *u32, unsigned cb);
 PDMBOTHCBDECL(int) ataIOPortWriteStr1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, RTGCPTR *pGCPtrSrc, PRTGCUINTREG pcTransfer, unsigned cb);
 PDMBOTHCBDECL(int) ataIOPortReadStr1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, RTGCPTR *pGCPtrDst, PRTGCUINTREG pcTransfer, unsigned cb);
+PDMBOTHCBDECL(int) ataIOPortWriteStrBuf1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void const *pvSrc, uint32_t *pcTransfers, unsigned cb);
+PDMBOTHCBDECL(int) ataIOPortReadStrBuf1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void *pvDst, uint32_t *pcTransfers, unsigned cb);
 PDMBOTHCBDECL(int) ataIOPortWrite2(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, uint32_t u32, unsigned cb);
 PDMBOTHCBDECL(int) ataIOPortRead2(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, uint32_t *u32, unsigned cb);
 PDMBOTHCBDECL(int) ataBMDMAIOPortWrite(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, uint32_t u32, unsigned cb);
@@ -6048,6 +6050,99 @@ PDMBOTHCBDECL(int) ataIOPortWriteStr1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT
 }
 #endif /* !IN_RING0 */
 
+#ifndef IN_RC
+/**
+ * Port I/O Handler for primary port range buffered IN string operations.
+ * @see FNIOMIOPORTINSTRBUF for details.
+ */
+PDMBOTHCBDECL(int) ataIOPortReadStrBuf1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void *pvDst, uint32_t *pcTransfers, unsigned cb)
+{
+    uint32_t       i = (uint32_t)(uintptr_t)pvUser;
+    PCIATAState   *pThis = PDMINS_2_DATA(pDevIns, PCIATAState *);
+    PATACONTROLLER pCtl = &pThis->aCts[i];
+
+    Assert(i < 2);
+
+    int rc = PDMCritSectEnter(&pCtl->lock, VINF_IOM_R3_IOPORT_READ);
+    if (rc != VINF_SUCCESS)
+        return rc;
+    if (Port == pCtl->IOPortBase1 && (cb == 2 || cb == 4))
+    {
+        ATADevState *s = &pCtl->aIfs[pCtl->iSelectedIf];
+        uint32_t cTransAvailable = (s->iIOBufferPIODataEnd - s->iIOBufferPIODataStart) / cb;
+# ifndef IN_RING3
+        /* The last transfer unit cannot be handled in R0, as it involves
+           thread communication.  Leave that to the single unit path. */
+        if (cTransAvailable)
+            cTransAvailable--;
+# endif
+        /* Do not handle the dummy transfer stuff here either. */
+        if (cTransAvailable > *pcTransfers)
+            cTransAvailable = *pcTransfers;
+        uint32_t cbTransfer = cTransAvailable * cb;
+        if (cbTransfer)
+        {
+            memcpy(pvDst, s->CTX_SUFF(pbIOBuffer) + s->iIOBufferPIODataStart, cbTransfer);
+            Log3(("%s: addr=%#x val=%.*Rhxs\n", __FUNCTION__, Port, cbTransfer, s->CTX_SUFF(pbIOBuffer) + s->iIOBufferPIODataStart));
+            s->iIOBufferPIODataStart += cbTransfer;
+            *pcTransfers -= cTransAvailable;
+# ifdef IN_RING3
+            if (s->iIOBufferPIODataStart >= s->iIOBufferPIODataEnd)
+                ataPIOTransferFinish(pCtl, s);
+# endif
+        }
+    }
+    PDMCritSectLeave(&pCtl->lock);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Port I/O Handler for primary port range buffered OUT string operations.
+ * @see FNIOMIOPORTOUTSTRBUF for details.
+ */
+PDMBOTHCBDECL(int) ataIOPortWriteStrBuf1(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT Port, void const *pvSrc, uint32_t *pcTransfers, unsigned cb)
+{
+    uint32_t       i = (uint32_t)(uintptr_t)pvUser;
+    PCIATAState   *pThis = PDMINS_2_DATA(pDevIns, PCIATAState *);
+    PATACONTROLLER pCtl = &pThis->aCts[i];
+
+    Assert(i < 2);
+
+    int rc = PDMCritSectEnter(&pCtl->lock, VINF_IOM_R3_IOPORT_WRITE);
+    if (rc != VINF_SUCCESS)
+        return rc;
+    if (Port == pCtl->IOPortBase1 && (cb == 2 || cb == 4))
+    {
+        ATADevState *s = &pCtl->aIfs[pCtl->iSelectedIf];
+        uint32_t cTransAvailable = (s->iIOBufferPIODataEnd - s->iIOBufferPIODataStart) / cb;
+# ifndef IN_RING3
+        /* The last transfer unit cannot be handled in R0, as it involves
+           thread communication.  Leave that to the single unit path. */
+        if (cTransAvailable)
+            cTransAvailable--;
+# endif
+        /* Do not handle the dummy transfer stuff here either. */
+        if (cTransAvailable > *pcTransfers)
+            cTransAvailable = *pcTransfers;
+        uint32_t cbTransfer = cTransAvailable * cb;
+        if (cbTransfer)
+        {
+            memcpy(s->CTX_SUFF(pbIOBuffer) + s->iIOBufferPIODataStart, pvSrc, cbTransfer);
+            Log3(("%s: addr=%#x val=%.*Rhxs\n", __FUNCTION__, Port, cbTransfer, s->CTX_SUFF(pbIOBuffer) + s->iIOBufferPIODataStart));
+            s->iIOBufferPIODataStart += cbTransfer;
+            *pcTransfers -= cTransAvailable;
+# ifdef IN_RING3
+            if (s->iIOBufferPIODataStart >= s->iIOBufferPIODataEnd)
+                ataPIOTransferFinish(pCtl, s);
+# endif
+        }
+    }
+    PDMCritSectLeave(&pCtl->lock);
+    return VINF_SUCCESS;
+}
+#endif /* !IN_RC */
+
 /**
  * Port I/O Handler for secondary port range OUT operations.
  * @see FNIOMIOPORTOUT for details.
@@ -7267,6 +7362,9 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
                                      ataIOPortWrite1, ataIOPortRead1, ataIOPortWriteStr1, ataIOPortReadStr1, "ATA I/O Base 1");
         if (RT_FAILURE(rc))
             return PDMDEV_SET_ERROR(pDevIns, rc, N_("PIIX3 cannot register I/O handlers"));
+        rc = PDMDevHlpIOPortRegisterStrBuf(pDevIns, pThis->aCts[i].IOPortBase1, 8, ataIOPortWriteStrBuf1, ataIOPortReadStrBuf1);
+        if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("PIIX3 cannot register buffered string I/O handlers"));
 
         if (fGCEnabled)
         {
@@ -7287,6 +7385,9 @@ static DECLCALLBACK(int)   ataR3Construct(PPDMDEVINS pDevIns, int iInstance, PCF
 #endif
             if (RT_FAILURE(rc))
                 return PDMDEV_SET_ERROR(pDevIns, rc, "PIIX3 cannot register I/O handlers (R0).");
+            rc = PDMDevHlpIOPortRegisterStrBufR0(pDevIns, pThis->aCts[i].IOPortBase1, 8, "ataIOPortWriteStrBuf1", "ataIOPortReadStrBuf1");
+            if (RT_FAILURE(rc))
+                return PDMDEV_SET_ERROR(pDevIns, rc, "PIIX3 cannot register buffered string I/O handlers (R0).");
         }
 
         rc = PDMDevHlpIOPortRegister(pDevIns, pThis->aCts[i].IOPortBase2, 1, (RTHCPTR)(uintptr_t)i,
@@ -36,6 +36,7 @@
 #include <iprt/poll.h>
 #include <iprt/pipe.h>
 #include <iprt/system.h>
+#include <iprt/time.h>
 
 #ifdef VBOX_WITH_INIP
 /* All lwip header files are not C++ safe. So hack around this. */
@@ -185,8 +186,30 @@ typedef struct VBOXDISK
 
     /** The block cache handle if configured. */
     PPDMBLKCACHE             pBlkCache;
+
+    /** Latency distribution of synchronous reads (ns). */
+    STAMHISTOGRAM            StatReadLatency;
+    /** Latency distribution of synchronous writes (ns). */
+    STAMHISTOGRAM            StatWriteLatency;
+    /** Latency distribution of synchronous flushes (ns). */
+    STAMHISTOGRAM            StatFlushLatency;
 } VBOXDISK, *PVBOXDISK;
 
+/**
+ * Parent image pre-open request, see drvvdPreOpenParent.
+ */
+typedef struct DRVVDPREOPEN
+{
+    /** The disk type. */
+    VDTYPE          enmType;
+    /** The image format (points into the same allocation). */
+    char           *pszFormat;
+    /** The image path. */
+    char            szPath[1];
+} DRVVDPREOPEN;
+/** Pointer to a parent image pre-open request. */
+typedef DRVVDPREOPEN *PDRVVDPREOPEN;
+
 
 /*******************************************************************************
 *   Internal Functions                                                         *
@@ -1498,6 +1521,7 @@ static DECLCALLBACK(int) drvvdRead(PPDMIMEDIA pInterface,
 
     LogFlowFunc(("off=%#llx pvBuf=%p cbRead=%d\n", off, pvBuf, cbRead));
     PVBOXDISK pThis = PDMIMEDIA_2_VBOXDISK(pInterface);
+    uint64_t const nsStart = RTTimeNanoTS();
 
     if (!pThis->fBootAccelActive)
         rc = VDRead(pThis->pDisk, off, pvBuf, cbRead);
@@ -1533,6 +1557,8 @@ static DECLCALLBACK(int) drvvdRead(PPDMIMEDIA pInterface,
         }
     }
 
+    STAM_REL_HISTOGRAM_ADD(&pThis->StatReadLatency, RTTimeNanoTS() - nsStart);
+
     if (RT_SUCCESS(rc))
         Log2(("%s: off=%#llx pvBuf=%p cbRead=%d\n%.*Rhxd\n", __FUNCTION__,
               off, pvBuf, cbRead, cbRead, pvBuf));
@@ -1557,7 +1583,9 @@ static DECLCALLBACK(int) drvvdWrite(PPDMIMEDIA pInterface,
         pThis->offDisk     = 0;
     }
 
+    uint64_t const nsStart = RTTimeNanoTS();
     int rc = VDWrite(pThis->pDisk, off, pvBuf, cbWrite);
+    STAM_REL_HISTOGRAM_ADD(&pThis->StatWriteLatency, RTTimeNanoTS() - nsStart);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1567,7 +1595,9 @@ static DECLCALLBACK(int) drvvdFlush(PPDMIMEDIA pInterface)
 {
     LogFlowFunc(("\n"));
     PVBOXDISK pThis = PDMIMEDIA_2_VBOXDISK(pInterface);
+    uint64_t const nsStart = RTTimeNanoTS();
     int rc = VDFlush(pThis->pDisk);
+    STAM_REL_HISTOGRAM_ADD(&pThis->StatFlushLatency, RTTimeNanoTS() - nsStart);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -2075,6 +2105,95 @@ static DECLCALLBACK(void) drvvdReset(PPDMDRVINS pDrvIns)
     }
 }
 
+/**
+ * @callback_method_impl{FNPDMDRVCONSTRUCTWORK,
+ *      Opens a read-only image of the chain in a private container while the
+ *      images below it are being opened by the driver.}
+ *
+ * This runs the backend's open code (header parsing, loading the block tables
+ * and the consistency checks) for each image concurrently, so the driver's own
+ * sequential VDOpen calls find the metadata in the host cache.  The container
+ * is thrown away again, the VD API offers no way to move an opened image into
+ * another container.
+ */
+static DECLCALLBACK(int) drvvdPreOpenParent(PPDMDRVINS pDrvIns, void *pvUser)
+{
+    PDRVVDPREOPEN pPreOpen = (PDRVVDPREOPEN)pvUser;
+    NOREF(pDrvIns);
+
+    uint64_t const tsStart = RTTimeNanoTS();
+    PVBOXHDD pDisk;
+    int rc = VDCreate(NULL, pPreOpen->enmType, &pDisk);
+    if (RT_SUCCESS(rc))
+    {
+        rc = VDOpen(pDisk, pPreOpen->pszFormat, pPreOpen->szPath, VD_OPEN_FLAGS_READONLY, NULL);
+        VDDestroy(pDisk);
+    }
+    LogFlowFunc(("'%s' -> %Rrc (%'RU64 ns)\n", pPreOpen->szPath, rc, RTTimeNanoTS() - tsStart));
+
+    /* Failures are left to the driver's own VDOpen to report. */
+    RTMemFree(pPreOpen);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Queues the pre-opening of the read-only images above the base image.
+ *
+ * @param   pDrvIns     The driver instance.
+ * @param   pCfg        The top level configuration node (the writable image,
+ *                      which is not pre-opened).
+ * @param   pBaseNode   The configuration node of the base image, which the
+ *                      driver opens first.
+ * @param   enmType     The disk type.
+ */
+static void drvvdQueuePreOpenParents(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, PCFGMNODE pBaseNode, VDTYPE enmType)
+{
+    for (PCFGMNODE pNode = CFGMR3GetParent(pBaseNode); pNode && pNode != pCfg; pNode = CFGMR3GetParent(pNode))
+    {
+        char *pszPath   = NULL;
+        char *pszFormat = NULL;
+        int rc = CFGMR3QueryStringAlloc(pNode, "Path", &pszPath);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3QueryStringAlloc(pNode, "Format", &pszFormat);
+        if (RT_SUCCESS(rc))
+        {
+            /* Only plain file based backends, anything talking to the network
+               or needing configuration is opened by the driver alone. */
+            VDBACKENDINFO BackendInfo;
+            rc = VDBackendInfoOne(pszFormat, &BackendInfo);
+            if (   RT_SUCCESS(rc)
+                && (BackendInfo.uBackendCaps & (VD_CAP_FILE | VD_CAP_TCPNET | VD_CAP_CONFIG)) == VD_CAP_FILE)
+            {
+                size_t cchPath   = strlen(pszPath);
+                size_t cchFormat = strlen(pszFormat);
+                PDRVVDPREOPEN pPreOpen = (PDRVVDPREOPEN)RTMemAlloc(RT_OFFSETOF(DRVVDPREOPEN, szPath[cchPath + 1 + cchFormat + 1]));
+                if (pPreOpen)
+                {
+                    pPreOpen->enmType   = enmType;
+                    memcpy(pPreOpen->szPath, pszPath, cchPath + 1);
+                    pPreOpen->pszFormat = &pPreOpen->szPath[cchPath + 1];
+                    memcpy(pPreOpen->pszFormat, pszFormat, cchFormat + 1);
+                    rc = PDMDrvHlpConstructWorkQueue(pDrvIns, drvvdPreOpenParent, pPreOpen,
+                                                     PDM_CONSTRUCT_WORK_F_PARALLEL_ONLY);
+                    if (RT_FAILURE(rc))
+                        RTMemFree(pPreOpen);
+                }
+                else
+                    rc = VERR_NO_MEMORY;
+            }
+            else
+                rc = VINF_SUCCESS;
+        }
+        MMR3HeapFree(pszFormat);
+        MMR3HeapFree(pszPath);
+
+        /* Without the pool there is nothing to be gained (VERR_NOT_SUPPORTED),
+           and the rest is only an optimization. */
+        if (RT_FAILURE(rc))
+            break;
+    }
+}
+
 /**
  * @copydoc FNPDMDRVDESTRUCT
  */
@@ -2105,6 +2224,10 @@ static DECLCALLBACK(void) drvvdDestruct(PPDMDRVINS pDrvIns)
         pThis->pBlkCache = NULL;
     }
 
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReadLatency);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatWriteLatency);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatFlushLatency);
+
     if (RT_VALID_PTR(pThis->pDisk))
     {
         VDDestroy(pThis->pDisk);
@@ -2215,6 +2338,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     bool        fDiscard = false;
     bool        fInformAboutZeroBlocks = false;
     bool        fSkipConsistencyChecks = false;
+    bool        fParentPreOpen = true;
     unsigned    iLevel = 0;
     PCFGMNODE   pCurNode = pCfg;
     VDTYPE      enmType = VDTYPE_HDD;
@@ -2233,7 +2357,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                                           "HostIPStack\0UseNewIo\0BootAcceleration\0BootAccelerationBuffer\0"
                                           "SetupMerge\0MergeSource\0MergeTarget\0BwGroup\0Type\0BlockCache\0"
                                           "CachePath\0CacheFormat\0Discard\0InformAboutZeroBlocks\0"
-                                          "SkipConsistencyChecks\0");
+                                          "SkipConsistencyChecks\0ParentPreOpen\0");
         }
         else
         {
@@ -2339,6 +2463,13 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
                                       N_("DrvVD: Configuration error: Querying \"BootAccelerationBuffer\" as integer failed"));
                 break;
             }
+            rc = CFGMR3QueryBoolDef(pCurNode, "ParentPreOpen", &fParentPreOpen, true);
+            if (RT_FAILURE(rc))
+            {
+                rc = PDMDRV_SET_ERROR(pDrvIns, rc,
+                                      N_("DrvVD: Configuration error: Querying \"ParentPreOpen\" as boolean failed"));
+                break;
+            }
             rc = CFGMR3QueryBoolDef(pCurNode, "BlockCache", &fUseBlockCache, false);
             if (RT_FAILURE(rc))
             {
@@ -2487,6 +2618,18 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     if (pThis->pDrvMediaAsyncPort && fUseNewIo)
         pThis->fAsyncIOSupported = true;
 
+    /*
+     * The images are opened starting with the base image, so have the
+     * read-only images above it opened in parallel meanwhile.  This only does
+     * anything when PDM executes the work in parallel (PDM/ParallelConstruct,
+     * off by default).
+     */
+    if (   RT_SUCCESS(rc)
+        && fParentPreOpen
+        && !fHostIP
+        && pCurNode != pCfg)
+        drvvdQueuePreOpenParents(pDrvIns, pCfg, pCurNode, enmType);
+
     uint64_t tsStart = RTTimeNanoTS();
 
     unsigned iImageIdx = 0;
@@ -2878,6 +3021,16 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
             LogRel(("VD: Boot acceleration, out of memory, disabled\n"));
     }
 
+    if (RT_SUCCESS(rc))
+    {
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatReadLatency,  STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,
+                               "Latency distribution of synchronous reads.",   "/Drivers/VD%d/ReadLatency", pDrvIns->iInstance);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatWriteLatency, STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,
+                               "Latency distribution of synchronous writes.",  "/Drivers/VD%d/WriteLatency", pDrvIns->iInstance);
+        PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatFlushLatency, STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,
+                               "Latency distribution of synchronous flushes.", "/Drivers/VD%d/FlushLatency", pDrvIns->iInstance);
+    }
+
     if (RT_FAILURE(rc))
     {
         if (RT_VALID_PTR(pszName))
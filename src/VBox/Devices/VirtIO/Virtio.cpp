@@ -49,6 +49,8 @@ static void vqueueReset(PVQUEUE pQueue)
     pQueue->uNextAvailIndex       = 0;
     pQueue->uNextUsedIndex        = 0;
     pQueue->uPageNumber           = 0;
+    pQueue->fSignalledUsedValid   = false;
+    pQueue->fNotificationDisabled = false;
 }
 
 static void vqueueInit(PVQUEUE pQueue, uint32_t uPageNumber)
@@ -57,10 +59,24 @@ static void vqueueInit(PVQUEUE pQueue, uint32_t uPageNumber)
     pQueue->VRing.addrAvail       = pQueue->VRing.addrDescriptors
         + sizeof(VRINGDESC) * pQueue->VRing.uSize;
     pQueue->VRing.addrUsed        = RT_ALIGN(
-        pQueue->VRing.addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pQueue->VRing.uSize]),
+        pQueue->VRing.addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pQueue->VRing.uSize])
+        + sizeof(uint16_t) /* used_event */,
         PAGE_SIZE); /* The used ring must start from the next page. */
     pQueue->uNextAvailIndex       = 0;
     pQueue->uNextUsedIndex        = 0;
+    pQueue->fSignalledUsedValid   = false;
+    pQueue->fNotificationDisabled = false;
+}
+
+/**
+ * Checks whether an event index has been crossed, see VIRTIO_RING_F_EVENT_IDX.
+ *
+ * @returns true if the index moving from @a uOldIdx to @a uNewIdx went past
+ *          @a uEventIdx, i.e. the other side asked to be notified.
+ */
+DECLINLINE(bool) vringNeedEvent(uint16_t uEventIdx, uint16_t uNewIdx, uint16_t uOldIdx)
+{
+    return (uint16_t)(uNewIdx - uEventIdx - 1) < (uint16_t)(uNewIdx - uOldIdx);
 }
 
 // void vqueueElemFree(PVQUEUEELEM pElem)
@@ -95,6 +111,30 @@ uint16_t vringReadAvailFlags(PVPCISTATE pState, PVRING pVRing)
     return tmp;
 }
 
+/**
+ * Reads the used_event field the guest places after the available ring.
+ */
+static uint16_t vringReadUsedEvent(PVPCISTATE pState, PVRING pVRing)
+{
+    uint16_t tmp;
+
+    PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns),
+                      pVRing->addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pVRing->uSize]),
+                      &tmp, sizeof(tmp));
+    return tmp;
+}
+
+/**
+ * Writes the avail_event field placed after the used ring, telling the guest
+ * to kick us once it makes the buffer with index @a u16Value available.
+ */
+static void vringWriteAvailEvent(PVPCISTATE pState, PVRING pVRing, uint16_t u16Value)
+{
+    PDMDevHlpPCIPhysWrite(pState->CTX_SUFF(pDevIns),
+                          pVRing->addrUsed + RT_OFFSETOF(VRINGUSED, aRing[pVRing->uSize]),
+                          &u16Value, sizeof(u16Value));
+}
+
 void vringSetNotification(PVPCISTATE pState, PVRING pVRing, bool fEnabled)
 {
     uint16_t tmp;
@@ -113,6 +153,42 @@ void vringSetNotification(PVPCISTATE pState, PVRING pVRing, bool fEnabled)
                           &tmp, sizeof(tmp));
 }
 
+/**
+ * Enables or disables guest notifications (kicks) for a queue.
+ *
+ * Without VIRTIO_RING_F_EVENT_IDX this just toggles VRINGUSED_F_NO_NOTIFY.
+ * With it the guest ignores the flag and kicks only when it makes the entry
+ * named by avail_event available, so enabling notifications re-arms
+ * avail_event at the current available index; vqueueGet and vqueueSkip keep
+ * moving it forward while notifications stay enabled.
+ *
+ * @param   pState      The device state structure.
+ * @param   pQueue      The queue.
+ * @param   fEnabled    Whether the guest should kick us on new buffers.
+ */
+void vqueueSetNotification(PVPCISTATE pState, PVQUEUE pQueue, bool fEnabled)
+{
+    pQueue->fNotificationDisabled = !fEnabled;
+    if (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+    {
+        if (fEnabled)
+            vringWriteAvailEvent(pState, &pQueue->VRing, vringReadAvailIndex(pState, &pQueue->VRing));
+    }
+    else
+        vringSetNotification(pState, &pQueue->VRing, fEnabled);
+}
+
+/**
+ * Moves avail_event past the entries consumed so far so that the next buffer
+ * the guest makes available gets a kick, unless notifications are disabled.
+ */
+DECLINLINE(void) vqueueUpdateAvailEvent(PVPCISTATE pState, PVQUEUE pQueue)
+{
+    if (   (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+        && !pQueue->fNotificationDisabled)
+        vringWriteAvailEvent(pState, &pQueue->VRing, pQueue->uNextAvailIndex);
+}
+
 bool vqueueSkip(PVPCISTATE pState, PVQUEUE pQueue)
 {
     if (vqueueIsEmpty(pState, pQueue))
@@ -121,6 +197,7 @@ bool vqueueSkip(PVPCISTATE pState, PVQUEUE pQueue)
     Log2(("%s vqueueSkip: %s avail_idx=%u\n", INSTANCE(pState),
           QUEUENAME(pState, pQueue), pQueue->uNextAvailIndex));
     pQueue->uNextAvailIndex++;
+    vqueueUpdateAvailEvent(pState, pQueue);
     return true;
 }
 
@@ -135,15 +212,59 @@ bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, bool fRemov
           QUEUENAME(pState, pQueue), pQueue->uNextAvailIndex));
 
     VRINGDESC desc;
+    RTGCPHYS  addrIndirect = 0;
+    uint32_t  cIndirect = 0;
     uint16_t  idx = vringReadAvail(pState, &pQueue->VRing, pQueue->uNextAvailIndex);
     if (fRemove)
+    {
         pQueue->uNextAvailIndex++;
+        vqueueUpdateAvailEvent(pState, pQueue);
+    }
     pElem->uIndex = idx;
-    do
+    for (;;)
     {
         VQUEUESEG *pSeg;
 
-        vringReadDesc(pState, &pQueue->VRing, idx, &desc);
+        if (addrIndirect)
+        {
+            if (idx >= cIndirect)
+            {
+                Log(("%s vqueueGet: %s indirect desc_idx=%u out of range (%u)\n", INSTANCE(pState),
+                     QUEUENAME(pState, pQueue), idx, cIndirect));
+                break;
+            }
+            PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns), addrIndirect + sizeof(VRINGDESC) * idx,
+                              &desc, sizeof(desc));
+        }
+        else
+            vringReadDesc(pState, &pQueue->VRing, idx, &desc);
+
+        if (desc.u16Flags & VRINGDESC_F_INDIRECT)
+        {
+            /* Only a top-level descriptor may refer to a table, tables do not nest. */
+            cIndirect = desc.uLen / sizeof(VRINGDESC);
+            if (addrIndirect || !cIndirect || cIndirect > VRING_MAX_SIZE)
+            {
+                Log(("%s vqueueGet: %s bad indirect descriptor desc_idx=%u cb=%u\n", INSTANCE(pState),
+                     QUEUENAME(pState, pQueue), idx, desc.uLen));
+                break;
+            }
+            Log2(("%s vqueueGet: %s indirect table addr=%p entries=%u\n", INSTANCE(pState),
+                  QUEUENAME(pState, pQueue), desc.u64Addr, cIndirect));
+            STAM_COUNTER_INC(&pState->StatDescIndirect);
+            addrIndirect = desc.u64Addr;
+            idx = 0;
+            continue;
+        }
+
+        /* Guard the segment arrays against looped or overlong chains. */
+        if (pElem->nIn + pElem->nOut >= VRING_MAX_SIZE)
+        {
+            Log(("%s vqueueGet: %s descriptor chain is too long\n", INSTANCE(pState),
+                 QUEUENAME(pState, pQueue)));
+            break;
+        }
+
         if (desc.u16Flags & VRINGDESC_F_WRITE)
         {
             Log2(("%s vqueueGet: %s IN  seg=%u desc_idx=%u addr=%p cb=%u\n", INSTANCE(pState),
@@ -161,8 +282,10 @@ bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, bool fRemov
         pSeg->cb   = desc.uLen;
         pSeg->pv   = NULL;
 
+        if (!(desc.u16Flags & VRINGDESC_F_NEXT))
+            break;
         idx = desc.u16Next;
-    } while (desc.u16Flags & VRINGDESC_F_NEXT);
+    }
 
     Log2(("%s vqueueGet: %s head_desc_idx=%u nIn=%u nOut=%u\n", INSTANCE(pState),
           QUEUENAME(pState, pQueue), pElem->uIndex, pElem->nIn, pElem->nOut));
@@ -228,16 +351,31 @@ void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue)
              INSTANCE(pState), QUEUENAME(pState, pQueue),
              vringReadAvailFlags(pState, &pQueue->VRing),
              pState->uGuestFeatures, vqueueIsEmpty(pState, pQueue)?"":"not "));
-    if (!(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT)
-        || ((pState->uGuestFeatures & VPCI_F_NOTIFY_ON_EMPTY) && vqueueIsEmpty(pState, pQueue)))
+    bool fNotify;
+    if (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
     {
-        int rc = vpciRaiseInterrupt(pState, VERR_INTERNAL_ERROR, VPCI_ISR_QUEUE);
-        if (RT_FAILURE(rc))
-            Log(("%s vqueueNotify: Failed to raise an interrupt (%Rrc).\n", INSTANCE(pState), rc));
+        /* Interrupt only if the used index went past the guest's used_event. */
+        uint16_t uOld = pQueue->uSignalledUsedIndex;
+        uint16_t uNew = pQueue->uNextUsedIndex;
+        bool     fValid = pQueue->fSignalledUsedValid;
+        pQueue->uSignalledUsedIndex = uNew;
+        pQueue->fSignalledUsedValid = true;
+        fNotify = !fValid || vringNeedEvent(vringReadUsedEvent(pState, &pQueue->VRing), uNew, uOld);
+        if (!fNotify)
+            STAM_COUNTER_INC(&pState->StatIntsSuppressed);
     }
     else
     {
-        STAM_COUNTER_INC(&pState->StatIntsSkipped);
+        fNotify = !(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT);
+        if (!fNotify)
+            STAM_COUNTER_INC(&pState->StatIntsSkipped);
+    }
+    if (   fNotify
+        || ((pState->uGuestFeatures & VPCI_F_NOTIFY_ON_EMPTY) && vqueueIsEmpty(pState, pQueue)))
+    {
+        int rc = vpciRaiseQueueInterrupt(pState, VERR_INTERNAL_ERROR, pQueue);
+        if (RT_FAILURE(rc))
+            Log(("%s vqueueNotify: Failed to raise an interrupt (%Rrc).\n", INSTANCE(pState), rc));
     }
 
 }
@@ -256,9 +394,13 @@ void vpciReset(PVPCISTATE pState)
     pState->uQueueSelector = 0;
     pState->uStatus        = 0;
     pState->uISR           = 0;
+    pState->uConfigVector  = VPCI_NO_VECTOR;
 
     for (unsigned i = 0; i < pState->nQueues; i++)
+    {
         vqueueReset(&pState->Queues[i]);
+        pState->Queues[i].uVector = VPCI_NO_VECTOR;
+    }
 }
 
 
@@ -280,11 +422,40 @@ int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause)
              INSTANCE(pState), u8IntCause));
 
     pState->uISR |= u8IntCause;
-    PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 1);
+    if (!vpciIsMsixEnabled(pState))
+        PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 1);
+    else if (pState->uConfigVector != VPCI_NO_VECTOR)
+        PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), pState->uConfigVector, 1);
     // vpciCsLeave(pState);
     return VINF_SUCCESS;
 }
 
+/**
+ * Raise the interrupt associated with a queue.
+ *
+ * With MSI-X enabled the vector assigned to the queue by the guest is
+ * signalled and the ISR is left alone, otherwise this is the same as
+ * raising a VPCI_ISR_QUEUE interrupt.
+ *
+ * @param   pState      The device state structure.
+ * @param   rcBusy      Status code to return when the critical section is busy.
+ * @param   pQueue      The queue the guest should be notified about.
+ */
+int vpciRaiseQueueInterrupt(VPCISTATE *pState, int rcBusy, PVQUEUE pQueue)
+{
+    if (!vpciIsMsixEnabled(pState))
+        return vpciRaiseInterrupt(pState, rcBusy, VPCI_ISR_QUEUE);
+
+    if (pQueue->uVector != VPCI_NO_VECTOR)
+    {
+        STAM_COUNTER_INC(&pState->StatIntsRaised);
+        LogFlow(("%s vpciRaiseQueueInterrupt: %s vector=%u\n",
+                 INSTANCE(pState), QUEUENAME(pState, pQueue), pQueue->uVector));
+        PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), pQueue->uVector, 1);
+    }
+    return VINF_SUCCESS;
+}
+
 /**
  * Lower interrupt.
  *
@@ -300,7 +471,9 @@ DECLINLINE(uint32_t) vpciGetHostFeatures(PVPCISTATE pState,
                                          PFNGETHOSTFEATURES pfnGetHostFeatures)
 {
     return pfnGetHostFeatures(pState)
-        | VPCI_F_NOTIFY_ON_EMPTY;
+        | VPCI_F_NOTIFY_ON_EMPTY
+        | VPCI_F_RING_INDIRECT_DESC
+        | VPCI_F_RING_EVENT_IDX;
 }
 
 /**
@@ -325,6 +498,7 @@ int vpciIOPortIn(PPDMDEVINS         pDevIns,
 {
     VPCISTATE  *pState = PDMINS_2_DATA(pDevIns, VPCISTATE *);
     int         rc     = VINF_SUCCESS;
+    uint32_t    offConfig;
     STAM_PROFILE_ADV_START(&pState->CTXSUFF(StatIORead), a);
 
     /*
@@ -383,8 +557,19 @@ int vpciIOPortIn(PPDMDEVINS         pDevIns,
             break;
 
         default:
-            if (Port >= VPCI_CONFIG)
-                rc = pCallbacks->pfnGetConfig(pState, Port - VPCI_CONFIG, cb, pu32);
+            offConfig = vpciIsMsixEnabled(pState) ? VPCI_CONFIG_MSIX : VPCI_CONFIG;
+            if (Port >= offConfig)
+                rc = pCallbacks->pfnGetConfig(pState, Port - offConfig, cb, pu32);
+            else if (Port == VPCI_MSIX_CONFIG_VECTOR)
+            {
+                Assert(cb == 2);
+                *(uint16_t*)pu32 = pState->uConfigVector;
+            }
+            else if (Port == VPCI_MSIX_QUEUE_VECTOR)
+            {
+                Assert(cb == 2);
+                *(uint16_t*)pu32 = pState->Queues[pState->uQueueSelector].uVector;
+            }
             else
             {
                 *pu32 = 0xFFFFFFFF;
@@ -423,6 +608,7 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
     VPCISTATE  *pState = PDMINS_2_DATA(pDevIns, VPCISTATE *);
     int         rc     = VINF_SUCCESS;
     bool        fHasBecomeReady;
+    uint32_t    offConfig;
     STAM_PROFILE_ADV_START(&pState->CTXSUFF(StatIOWrite), a);
 
     Port -= pState->IOPortBase;
@@ -482,6 +668,7 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
             if (u32 < pState->nQueues)
                 if (pState->Queues[u32].VRing.addrDescriptors)
                 {
+                    STAM_COUNTER_INC(&pState->StatKicks);
                     // rc = vpciCsEnter(pState, VERR_SEM_BUSY);
                     // if (RT_LIKELY(rc == VINF_SUCCESS))
                     // {
@@ -512,8 +699,22 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
             break;
 
         default:
-            if (Port >= VPCI_CONFIG)
-                rc = pCallbacks->pfnSetConfig(pState, Port - VPCI_CONFIG, cb, &u32);
+            offConfig = vpciIsMsixEnabled(pState) ? VPCI_CONFIG_MSIX : VPCI_CONFIG;
+            if (Port >= offConfig)
+                rc = pCallbacks->pfnSetConfig(pState, Port - offConfig, cb, &u32);
+            else if (Port == VPCI_MSIX_CONFIG_VECTOR)
+            {
+                Assert(cb == 2);
+                u32 &= 0xFFFF;
+                /* Vectors we do not have read back as VPCI_NO_VECTOR, telling the guest to try something else. */
+                pState->uConfigVector = u32 < pState->cMsixVectors ? (uint16_t)u32 : VPCI_NO_VECTOR;
+            }
+            else if (Port == VPCI_MSIX_QUEUE_VECTOR)
+            {
+                Assert(cb == 2);
+                u32 &= 0xFFFF;
+                pState->Queues[pState->uQueueSelector].uVector = u32 < pState->cMsixVectors ? (uint16_t)u32 : VPCI_NO_VECTOR;
+            }
             else
                 rc = PDMDevHlpDBGFStop(pDevIns, RT_SRC_POS, "%s vpciIOPortOut: no valid port at offset Port=%RTiop cb=%08x\n",
                                        INSTANCE(pState), Port, cb);
@@ -690,6 +891,8 @@ int vpciSaveExec(PVPCISTATE pState, PSSMHANDLE pSSM)
     AssertRCReturn(rc, rc);
     rc = SSMR3PutU8( pSSM, pState->uISR);
     AssertRCReturn(rc, rc);
+    rc = SSMR3PutU16(pSSM, pState->uConfigVector);
+    AssertRCReturn(rc, rc);
 
     /* Save queue states */
     rc = SSMR3PutU32(pSSM, pState->nQueues);
@@ -704,6 +907,8 @@ int vpciSaveExec(PVPCISTATE pState, PSSMHANDLE pSSM)
         AssertRCReturn(rc, rc);
         rc = SSMR3PutU16(pSSM, pState->Queues[i].uNextUsedIndex);
         AssertRCReturn(rc, rc);
+        rc = SSMR3PutU16(pSSM, pState->Queues[i].uVector);
+        AssertRCReturn(rc, rc);
     }
 
     return VINF_SUCCESS;
@@ -733,15 +938,25 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
         AssertRCReturn(rc, rc);
         rc = SSMR3GetU8( pSSM, &pState->uISR);
         AssertRCReturn(rc, rc);
+        if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX)
+        {
+            rc = SSMR3GetU16(pSSM, &pState->uConfigVector);
+            AssertRCReturn(rc, rc);
+        }
+        else
+            pState->uConfigVector = VPCI_NO_VECTOR;
 
         /* Restore queues */
         if (uVersion > VIRTIO_SAVEDSTATE_VERSION_3_1_BETA1)
         {
-            rc = SSMR3GetU32(pSSM, &pState->nQueues);
+            uint32_t nSavedQueues;
+            rc = SSMR3GetU32(pSSM, &nSavedQueues);
             AssertRCReturn(rc, rc);
+            if (nSavedQueues != nQueues)
+                return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Number of queues differs: saved=%u config=%u"),
+                                        nSavedQueues, nQueues);
         }
-        else
-            pState->nQueues = nQueues;
+        pState->nQueues = nQueues;
         for (unsigned i = 0; i < pState->nQueues; i++)
         {
             rc = SSMR3GetU16(pSSM, &pState->Queues[i].VRing.uSize);
@@ -756,6 +971,13 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             AssertRCReturn(rc, rc);
             rc = SSMR3GetU16(pSSM, &pState->Queues[i].uNextUsedIndex);
             AssertRCReturn(rc, rc);
+            if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX)
+            {
+                rc = SSMR3GetU16(pSSM, &pState->Queues[i].uVector);
+                AssertRCReturn(rc, rc);
+            }
+            else
+                pState->Queues[i].uVector = VPCI_NO_VECTOR;
         }
     }
 
@@ -791,7 +1013,7 @@ static DECLCALLBACK(void) vpciConfigure(PCIDEVICE& pci,
     vpciCfgSetU8( pci, VBOX_PCI_INTERRUPT_PIN,        0x01);
 
 #ifdef VBOX_WITH_MSI_DEVICES
-    PCIDevSetCapabilityList     (&pci, 0x80);
+    PCIDevSetCapabilityList     (&pci, VPCI_MSIX_CAP_OFFSET);
     PCIDevSetStatus             (&pci, VBOX_PCI_STATUS_CAP_LIST);
 #endif
 }
@@ -812,7 +1034,7 @@ static const char *vpciCounter(const char *pszDevFmt,
 DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
                                 int iInstance, const char *pcszNameFmt,
                                 uint16_t uSubsystemId, uint16_t uClass,
-                                uint32_t nQueues)
+                                uint32_t nQueues, uint16_t cMsixVectors)
 {
     /* Init handles and log related stuff. */
     RTStrPrintf(pState->szInstance, sizeof(pState->szInstance),
@@ -838,20 +1060,28 @@ DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
         return rc;
 
 #ifdef VBOX_WITH_MSI_DEVICES
-#if 0
+    if (cMsixVectors)
     {
         PDMMSIREG aMsiReg;
 
         RT_ZERO(aMsiReg);
-        aMsiReg.cMsixVectors = 1;
-        aMsiReg.iMsixCapOffset = 0x80;
+        aMsiReg.cMsixVectors = cMsixVectors;
+        aMsiReg.iMsixCapOffset = VPCI_MSIX_CAP_OFFSET;
         aMsiReg.iMsixNextOffset = 0x0;
-        aMsiReg.iMsixBar = 0;
+        aMsiReg.iMsixBar = VPCI_MSIX_BAR;
         rc = PDMDevHlpPCIRegisterMsi(pDevIns, &aMsiReg);
         if (RT_FAILURE (rc))
+        {
+            /* That's OK, the guest will have to share INTx between all queues. */
+            LogRel(("%s: Chipset cannot do MSI-X: %Rrc\n", INSTANCE(pState), rc));
             PCIDevSetCapabilityList(&pState->pciDevice, 0x0);
+            cMsixVectors = 0;
+        }
+        else
+            pState->cMsixVectors = cMsixVectors;
     }
-#endif
+#else
+    NOREF(cMsixVectors);
 #endif
 
     /* Status driver */
@@ -861,7 +1091,8 @@ DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
         return PDMDEV_SET_ERROR(pDevIns, rc, N_("Failed to attach the status LUN"));
     pState->pLedsConnector = PDMIBASE_QUERY_INTERFACE(pBase, PDMILEDCONNECTORS);
 
-    pState->nQueues = nQueues;
+    pState->nQueues       = nQueues;
+    pState->uConfigVector = VPCI_NO_VECTOR;
 
 #if defined(VBOX_WITH_STATISTICS)
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIOReadGC,           STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling IO reads in GC",      vpciCounter(pcszNameFmt, "IO/ReadGC"), iInstance);
@@ -870,6 +1101,9 @@ DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIOWriteHC,          STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling IO writes in HC",     vpciCounter(pcszNameFmt, "IO/WriteHC"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIntsRaised,         STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of raised interrupts",   vpciCounter(pcszNameFmt, "Interrupts/Raised"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIntsSkipped,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of skipped interrupts",   vpciCounter(pcszNameFmt, "Interrupts/Skipped"), iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIntsSuppressed,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of interrupts suppressed by used_event", vpciCounter(pcszNameFmt, "Interrupts/Suppressed"), iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatKicks,              STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of queue notifications by the guest", vpciCounter(pcszNameFmt, "Queues/Kicks"), iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatDescIndirect,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of indirect descriptor tables", vpciCounter(pcszNameFmt, "Queues/DescIndirect"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatCsGC,               STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling CS wait in GC",      vpciCounter(pcszNameFmt, "Cs/CsGC"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatCsHC,               STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling CS wait in HC",      vpciCounter(pcszNameFmt, "Cs/CsHC"), iInstance);
 #endif /* VBOX_WITH_STATISTICS */
@@ -940,6 +1174,9 @@ PVQUEUE vpciAddQueue(VPCISTATE* pState, unsigned uSize, PFNVPCIQUEUECALLBACK pfn
         pQueue->VRing.uSize = uSize;
         pQueue->VRing.addrDescriptors = 0;
         pQueue->uPageNumber = 0;
+        pQueue->uVector = VPCI_NO_VECTOR;
+        pQueue->fSignalledUsedValid = false;
+        pQueue->fNotificationDisabled = false;
         pQueue->pfnCallback = pfnCallback;
         pQueue->pcszName = pcszName;
     }
@@ -28,14 +28,16 @@
  * for example.
  */
 #define VIRTIO_SAVEDSTATE_VERSION_3_1_BETA1 1
-#define VIRTIO_SAVEDSTATE_VERSION           2
+#define VIRTIO_SAVEDSTATE_VERSION_PRE_MSIX  2
+#define VIRTIO_SAVEDSTATE_VERSION           3
 /** @} */
 
 #define DEVICE_PCI_VENDOR_ID                0x1AF4
 #define DEVICE_PCI_DEVICE_ID                0x1000
 #define DEVICE_PCI_SUBSYSTEM_VENDOR_ID      0x1AF4
 
-#define VIRTIO_MAX_NQUEUES                  3
+/** Enough for 8 RX/TX queue pairs plus the control queue of virtio-net. */
+#define VIRTIO_MAX_NQUEUES                  17
 
 #define VPCI_HOST_FEATURES                  0x0
 #define VPCI_GUEST_FEATURES                 0x4
@@ -46,6 +48,17 @@
 #define VPCI_STATUS                         0x12
 #define VPCI_ISR                            0x13
 #define VPCI_CONFIG                         0x14
+/* The following two registers are only present if MSI-X is enabled. */
+#define VPCI_MSIX_CONFIG_VECTOR             0x14
+#define VPCI_MSIX_QUEUE_VECTOR              0x16
+#define VPCI_CONFIG_MSIX                    0x18
+
+/** Vector value meaning "do not signal this event via MSI-X". */
+#define VPCI_NO_VECTOR                      0xFFFF
+/** The offset of the MSI-X capability in PCI configuration space. */
+#define VPCI_MSIX_CAP_OFFSET                0x80
+/** The BAR used for the MSI-X table (BAR 0 is the I/O port region). */
+#define VPCI_MSIX_BAR                       1
 
 #define VPCI_ISR_QUEUE                      0x1
 #define VPCI_ISR_CONFIG                     0x3
@@ -56,11 +69,14 @@
 #define VPCI_STATUS_FAILED                  0x80
 
 #define VPCI_F_NOTIFY_ON_EMPTY              0x01000000
+#define VPCI_F_RING_INDIRECT_DESC           0x10000000
+#define VPCI_F_RING_EVENT_IDX               0x20000000
 #define VPCI_F_BAD_FEATURE                  0x40000000
 
 #define VRINGDESC_MAX_SIZE                  (2 * 1024 * 1024)
 #define VRINGDESC_F_NEXT                    0x01
 #define VRINGDESC_F_WRITE                   0x02
+#define VRINGDESC_F_INDIRECT                0x04
 
 typedef struct VRingDesc
 {
@@ -124,6 +140,11 @@ typedef struct VQueue
     uint16_t uNextAvailIndex;
     uint16_t uNextUsedIndex;
     uint32_t uPageNumber;
+    uint16_t uVector;                   /**< MSI-X vector or VPCI_NO_VECTOR. */
+    uint16_t uSignalledUsedIndex;       /**< Used index at the last interrupt decision (EVENT_IDX). */
+    bool     fSignalledUsedValid;       /**< Whether uSignalledUsedIndex may be relied upon. */
+    bool     fNotificationDisabled;     /**< The device asked the guest not to kick this queue. */
+    uint16_t padding;
     R3PTRTYPE(PFNVPCIQUEUECALLBACK) pfnCallback;
     R3PTRTYPE(const char *)         pcszName;
 } VQUEUE;
@@ -198,10 +219,8 @@ typedef struct VPCIState_st
     uint16_t               uQueueSelector;         /**< An index in aQueues array. */
     uint8_t                uStatus; /**< Device Status (bits are device-specific). */
     uint8_t                uISR;                   /**< Interrupt Status Register. */
-
-#if HC_ARCH_BITS != 64
-    uint32_t               padding3;
-#endif
+    uint16_t               uConfigVector;          /**< MSI-X vector for config changes. */
+    uint16_t               cMsixVectors;           /**< Number of MSI-X vectors, 0 if none. */
 
     uint32_t               nQueues;       /**< Actual number of queues used. */
     VQUEUE                 Queues[VIRTIO_MAX_NQUEUES];
@@ -213,6 +232,9 @@ typedef struct VPCIState_st
     STAMPROFILEADV         StatIOWriteHC;
     STAMCOUNTER            StatIntsRaised;
     STAMCOUNTER            StatIntsSkipped;
+    STAMCOUNTER            StatIntsSuppressed;
+    STAMCOUNTER            StatKicks;
+    STAMCOUNTER            StatDescIndirect;
     STAMPROFILE            StatCsGC;
     STAMPROFILE            StatCsHC;
 #endif /* VBOX_WITH_STATISTICS */
@@ -240,6 +262,7 @@ typedef const VPCIIOCALLBACKS *PCVPCIIOCALLBACKS;
 /** @} */
 
 int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause);
+int vpciRaiseQueueInterrupt(VPCISTATE *pState, int rcBusy, struct VQueue *pQueue);
 int vpciIOPortIn(PPDMDEVINS         pDevIns,
                  void              *pvUser,
                  RTIOPORT           port,
@@ -259,7 +282,7 @@ void  vpciSetReadLed(PVPCISTATE pState, bool fOn);
 int   vpciSaveExec(PVPCISTATE pState, PSSMHANDLE pSSM);
 int   vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass, uint32_t nQueues);
 int   vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState, int iInstance, const char *pcszNameFmt,
-                    uint16_t uSubsystemId, uint16_t uClass, uint32_t nQueues);
+                    uint16_t uSubsystemId, uint16_t uClass, uint32_t nQueues, uint16_t cMsixVectors = 0);
 int   vpciDestruct(VPCISTATE* pState);
 void  vpciRelocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta);
 void  vpciReset(PVPCISTATE pState);
@@ -279,6 +302,17 @@ DECLINLINE(int) vpciCsEnter(VPCISTATE *pState, int rcBusy)
 #endif
 }
 
+/**
+ * Checks whether the guest has enabled MSI-X for the device.
+ *
+ * The layout of the I/O port region depends on it, see VPCI_CONFIG_MSIX.
+ */
+DECLINLINE(bool) vpciIsMsixEnabled(VPCISTATE *pState)
+{
+    return pState->cMsixVectors
+        && (PCIDevGetWord(&pState->pciDevice, VPCI_MSIX_CAP_OFFSET + 2 /* message control */) & VBOX_PCI_MSIX_FLAGS_ENABLE);
+}
+
 DECLINLINE(void) vpciCsLeave(VPCISTATE *pState)
 {
 #ifdef VPCI_CS
@@ -287,6 +321,7 @@ DECLINLINE(void) vpciCsLeave(VPCISTATE *pState)
 }
 
 void vringSetNotification(PVPCISTATE pState, PVRING pVRing, bool fEnabled);
+void vqueueSetNotification(PVPCISTATE pState, PVQUEUE pQueue, bool fEnabled);
 
 DECLINLINE(uint16_t) vringReadAvailIndex(PVPCISTATE pState, PVRING pVRing)
 {
@@ -1401,8 +1401,16 @@ int main()
     GEN_CHECK_OFF(VPCISTATE, uQueueSelector);
     GEN_CHECK_OFF(VPCISTATE, uStatus);
     GEN_CHECK_OFF(VPCISTATE, uISR);
+    GEN_CHECK_OFF(VPCISTATE, uConfigVector);
+    GEN_CHECK_OFF(VPCISTATE, cMsixVectors);
+    GEN_CHECK_OFF(VPCISTATE, nQueues);
     GEN_CHECK_OFF(VPCISTATE, Queues);
     GEN_CHECK_OFF(VPCISTATE, Queues[VIRTIO_MAX_NQUEUES]);
+    GEN_CHECK_OFF(VQUEUE, uVector);
+    GEN_CHECK_OFF(VQUEUE, uSignalledUsedIndex);
+    GEN_CHECK_OFF(VQUEUE, fSignalledUsedValid);
+    GEN_CHECK_OFF(VQUEUE, fNotificationDisabled);
+    GEN_CHECK_OFF(VQUEUE, pfnCallback);
     GEN_CHECK_OFF(VNETSTATE, VPCI);
     GEN_CHECK_OFF(VNETSTATE, INetworkDown);
     GEN_CHECK_OFF(VNETSTATE, INetworkConfig);
@@ -1422,8 +1430,11 @@ int main()
     GEN_CHECK_OFF(VNETSTATE, u32PktNo);
     GEN_CHECK_OFF(VNETSTATE, fPromiscuous);
     GEN_CHECK_OFF(VNETSTATE, fAllMulti);
-    GEN_CHECK_OFF(VNETSTATE, pRxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pTxQueue);
+    GEN_CHECK_OFF(VNETSTATE, cMaxQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, cCurQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1]);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[VNET_MAX_QUEUE_PAIRS - 1].hTxEvent);
     GEN_CHECK_OFF(VNETSTATE, pCtlQueue);
     GEN_CHECK_OFF(VNETSTATE, fMaybeOutOfSpace);
     GEN_CHECK_OFF(VNETSTATE, hEventMoreRxDescAvail);
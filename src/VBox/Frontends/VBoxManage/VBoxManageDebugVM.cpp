@@ -285,6 +285,77 @@ static RTEXITCODE handleDebugVM_DumpVMCore(HandlerArg *pArgs, IMachineDebugger *
     return RTEXITCODE_SUCCESS;
 }
 
+/**
+ * Handles the exitprofile sub-command.
+ *
+ * This is a thin wrapper around the 'exitprof' info item which produces
+ * folded stacks suitable for flame graph tools.
+ *
+ * @returns Suitable exit code.
+ * @param   pArgs               The handler arguments.
+ * @param   pDebugger           Pointer to the debugger interface.
+ */
+static RTEXITCODE handleDebugVM_ExitProfile(HandlerArg *pArgs, IMachineDebugger *pDebugger)
+{
+    /*
+     * Parse arguments.
+     */
+    uint32_t                    idCpu   = UINT32_MAX; /* all */
+    bool                        fCount  = false;
+    bool                        fReset  = false;
+
+    RTGETOPTSTATE               GetState;
+    RTGETOPTUNION               ValueUnion;
+    static const RTGETOPTDEF    s_aOptions[] =
+    {
+        { "--cpu",      'c', RTGETOPT_REQ_UINT32  },
+        { "--count",    'n', RTGETOPT_REQ_NOTHING },
+        { "--reset",    'r', RTGETOPT_REQ_NOTHING },
+    };
+    int rc = RTGetOptInit(&GetState, pArgs->argc, pArgs->argv, s_aOptions, RT_ELEMENTS(s_aOptions), 2, 0 /*fFlags*/);
+    AssertRCReturn(rc, RTEXITCODE_FAILURE);
+
+    while ((rc = RTGetOpt(&GetState, &ValueUnion)) != 0)
+    {
+        switch (rc)
+        {
+            case 'c':
+                idCpu = ValueUnion.u32;
+                break;
+
+            case 'n':
+                fCount = true;
+                break;
+
+            case 'r':
+                fReset = true;
+                break;
+
+            default:
+                return errorGetOpt(USAGE_DEBUGVM, rc, &ValueUnion);
+        }
+    }
+
+    /*
+     * Execute the order.
+     */
+    char szArgs[64];
+    size_t off = 0;
+    if (idCpu != UINT32_MAX)
+        off += RTStrPrintf(&szArgs[off], sizeof(szArgs) - off, "cpu=%u ", idCpu);
+    if (fCount)
+        off += RTStrPrintf(&szArgs[off], sizeof(szArgs) - off, "count ");
+    if (fReset)
+        off += RTStrPrintf(&szArgs[off], sizeof(szArgs) - off, "reset ");
+    szArgs[off] = '\0';
+
+    com::Bstr bstrInfo;
+    CHECK_ERROR2_RET(pDebugger, Info(com::Bstr("exitprof").raw(), com::Bstr(szArgs).raw(), bstrInfo.asOutParam()),
+                     RTEXITCODE_FAILURE);
+    RTPrintf("%ls", bstrInfo.raw());
+    return RTEXITCODE_SUCCESS;
+}
+
 /**
  * Handles the os sub-command.
  *
@@ -658,6 +729,8 @@ int handleDebugVM(HandlerArg *pArgs)
             const char *pszSubCmd = pArgs->argv[1];
             if (!strcmp(pszSubCmd, "dumpguestcore"))
                 rcExit = handleDebugVM_DumpVMCore(pArgs, ptrDebugger);
+            else if (!strcmp(pszSubCmd, "exitprofile"))
+                rcExit = handleDebugVM_ExitProfile(pArgs, ptrDebugger);
             else if (!strcmp(pszSubCmd, "getregisters"))
                 rcExit = handleDebugVM_GetRegisters(pArgs, ptrDebugger);
             else if (!strcmp(pszSubCmd, "info"))
@@ -709,6 +709,7 @@ void printUsage(USAGECATEGORY u64Cmd, PRTSTREAM pStrm)
         RTStrmPrintf(pStrm,
                            "%s debugvm %s         <uuid|vmname>\n"
                      "                            dumpguestcore --filename <name> |\n"
+                     "                            exitprofile [--cpu <id>] [--count] [--reset] |\n"
                      "                            info <item> [args] |\n"
                      "                            injectnmi |\n"
                      "                            log [--release|--debug] <settings> ...|\n"
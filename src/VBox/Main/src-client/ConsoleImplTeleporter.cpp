@@ -29,12 +29,14 @@
 
 #include <iprt/asm.h>
 #include <iprt/err.h>
+#include <iprt/mem.h>
 #include <iprt/rand.h>
 #include <iprt/socket.h>
 #include <iprt/tcp.h>
 #include <iprt/timer.h>
 
 #include <VBox/vmm/vmapi.h>
+#include <VBox/vmm/pgm.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/err.h>
 #include <VBox/version.h>
@@ -42,6 +44,15 @@
 #include "VBox/com/ErrorInfo.h"
 
 
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The max number of parallel data streams (TCP connections). */
+#define TELEPORTER_MAX_STREAMS          8
+/** The max data block size (see TELEPORTERTCPHDR). */
+#define TELEPORTERTCPHDR_MAX_SIZE       UINT32_C(0x00fffff8)
+
+
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
 *******************************************************************************/
@@ -62,6 +73,16 @@ public:
     /** @name stream stuff
      * @{  */
     RTSOCKET            mhSocket;
+    /** Additional data connections, mahStreams[0] is unused as stream 0 is
+     * always mhSocket.  The SSM data blocks are striped round-robin across
+     * all the streams while commands and ACKs only go over mhSocket. */
+    RTSOCKET            mahStreams[TELEPORTER_MAX_STREAMS];
+    /** The number of data streams (1 means mhSocket only). */
+    uint32_t            mcStreams;
+    /** The stream the next data block is written to / read from. */
+    uint32_t            miStream;
+    /** The stream the current block is being read from (target only). */
+    RTSOCKET            mhReadStream;
     uint64_t            moffStream;
     uint32_t            mcbReadBlock;
     bool volatile       mfStopReading;
@@ -69,18 +90,40 @@ public:
     bool volatile       mfIOError;
     /** @} */
 
+    /** @name bandwidth control (source only)
+     * @{  */
+    /** The max transfer rate in bytes per second, 0 if unlimited. */
+    uint64_t            mcbMaxBandwidth;
+    /** The max data block size, smaller than TELEPORTERTCPHDR_MAX_SIZE when
+     * capped so that the pacing doesn't become too bursty. */
+    uint32_t            mcbMaxBlock;
+    /** The start of the current rate window (RTTimeNanoTS). */
+    uint64_t            mnsRateWindow;
+    /** The number of bytes written in the current rate window. */
+    uint64_t            mcbRateWindow;
+    /** @} */
+
     TeleporterState(Console *pConsole, PUVM pUVM, Progress *pProgress, bool fIsSource)
         : mptrConsole(pConsole)
         , mpUVM(pUVM)
         , mptrProgress(pProgress)
         , mfIsSource(fIsSource)
         , mhSocket(NIL_RTSOCKET)
+        , mcStreams(1)
+        , miStream(0)
+        , mhReadStream(NIL_RTSOCKET)
         , moffStream(UINT64_MAX / 2)
         , mcbReadBlock(0)
         , mfStopReading(false)
         , mfEndOfStream(false)
         , mfIOError(false)
+        , mcbMaxBandwidth(0)
+        , mcbMaxBlock(TELEPORTERTCPHDR_MAX_SIZE)
+        , mnsRateWindow(0)
+        , mcbRateWindow(0)
     {
+        for (unsigned i = 0; i < RT_ELEMENTS(mahStreams); i++)
+            mahStreams[i] = NIL_RTSOCKET;
         VMR3RetainUVM(mpUVM);
     }
 
@@ -102,16 +145,27 @@ public:
     uint32_t            muPort;
     uint32_t            mcMsMaxDowntime;
     MachineState_T      menmOldMachineState;
+    /** The number of data streams to set up. */
+    uint32_t            mcStreamsWanted;
+    /** The number of live passes before switching to post-copy, 0 if
+     * post-copy is disabled. */
+    uint32_t            mcPostCopyPrePasses;
     bool                mfSuspendedByUs;
     bool                mfUnlockedMedia;
+    /** Set once the target has acknowledged the hand-over, i.e. when the
+     * target owns the VM and the source must never run it again. */
+    bool                mfHandedOver;
 
     TeleporterStateSrc(Console *pConsole, PUVM pUVM, Progress *pProgress, MachineState_T enmOldMachineState)
         : TeleporterState(pConsole, pUVM, pProgress, true /*fIsSource*/)
         , muPort(UINT32_MAX)
         , mcMsMaxDowntime(250)
+        , mcStreamsWanted(1)
+        , mcPostCopyPrePasses(0)
         , menmOldMachineState(enmOldMachineState)
         , mfSuspendedByUs(false)
         , mfUnlockedMedia(false)
+        , mfHandedOver(false)
     {
     }
 };
@@ -127,6 +181,9 @@ public:
     IInternalMachineControl    *mpControl;
     PRTTCPSERVER                mhServer;
     PRTTIMERLR                  mphTimerLR;
+    /** The address and port we're listening on (for additional streams). */
+    Utf8Str                     mstrAddress;
+    uint32_t                    muPort;
     bool                        mfLockedMedia;
     int                         mRc;
     Utf8Str                     mErrorText;
@@ -139,6 +196,7 @@ public:
         , mpControl(pControl)
         , mhServer(NULL)
         , mphTimerLR(phTimerLR)
+        , muPort(0)
         , mfLockedMedia(false)
         , mRc(VINF_SUCCESS)
         , mErrorText()
@@ -164,8 +222,44 @@ typedef struct TELEPORTERTCPHDR
 } TELEPORTERTCPHDR;
 /** Magic value for TELEPORTERTCPHDR::u32Magic. (Egberto Gismonti Amin) */
 #define TELEPORTERTCPHDR_MAGIC       UINT32_C(0x19471205)
-/** The max block size. */
-#define TELEPORTERTCPHDR_MAX_SIZE    UINT32_C(0x00fffff8)
+
+
+/**
+ * Post-copy chunk header.
+ *
+ * Sent by the source after the hand-over, followed by the contents of the
+ * pages set in the bitmap.
+ */
+typedef struct TELEPORTERPOSTCOPYHDR
+{
+    /** Magic value. */
+    uint32_t    u32Magic;
+    /** The number of pages following this header, 0 for the end marker. */
+    uint32_t    cPages;
+    /** The chunk address. */
+    RTGCPHYS    GCPhys;
+    /** The pages that follow. */
+    uint64_t    bmPages[PGM_POSTCOPY_CHUNK_PAGES / 64];
+} TELEPORTERPOSTCOPYHDR;
+/** Magic value for TELEPORTERPOSTCOPYHDR::u32Magic. (Hermeto Pascoal) */
+#define TELEPORTERPOSTCOPYHDR_MAGIC  UINT32_C(0x19360622)
+
+
+/**
+ * Post-copy request, sent by the target.
+ */
+typedef struct TELEPORTERPOSTCOPYREQ
+{
+    /** Magic value. */
+    uint32_t    u32Magic;
+    /** Reserved, MBZ. */
+    uint32_t    u32Reserved;
+    /** The chunk the target is waiting for, NIL_RTGCPHYS when the target has
+     * received the end marker. */
+    RTGCPHYS    GCPhys;
+} TELEPORTERPOSTCOPYREQ;
+/** Magic value for TELEPORTERPOSTCOPYREQ::u32Magic. (Nana Vasconcelos) */
+#define TELEPORTERPOSTCOPYREQ_MAGIC  UINT32_C(0x19440802)
 
 
 /*******************************************************************************
@@ -174,6 +268,37 @@ typedef struct TELEPORTERTCPHDR
 static const char g_szWelcome[] = "VirtualBox-Teleporter-1.0\n";
 
 
+/**
+ * Reads the password from the socket and checks it.
+ *
+ * @returns VBox status code, VERR_AUTHENTICATION_FAILURE on mismatch.
+ * @param   Sock        The socket.
+ * @param   pszPassword The expected password (includes '\n', see
+ *                      teleporterTrg).
+ */
+static int teleporterTcpReadPassword(RTSOCKET Sock, const char *pszPassword)
+{
+    unsigned off = 0;
+    while (pszPassword[off])
+    {
+        char ch;
+        int rc = RTTcpRead(Sock, &ch, sizeof(ch), NULL);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("Teleporter: Password read failure (off=%u): %Rrc\n", off, rc));
+            return rc;
+        }
+        if (pszPassword[off] != ch)
+        {
+            LogRel(("Teleporter: Invalid password (off=%u)\n", off));
+            return VERR_AUTHENTICATION_FAILURE;
+        }
+        off++;
+    }
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Reads a string from the socket.
  *
@@ -304,6 +429,101 @@ Console::teleporterSrcSubmitCommand(TeleporterStateSrc *pState, const char *pszC
 }
 
 
+/**
+ * Gets the socket of the stream the next data block goes over.
+ *
+ * @returns Socket handle.
+ * @param   pState          The teleporter state data.
+ */
+DECLINLINE(RTSOCKET) teleporterTcpCurStream(TeleporterState *pState)
+{
+    return pState->miStream == 0 ? pState->mhSocket : pState->mahStreams[pState->miStream];
+}
+
+
+/**
+ * Advances to the next data stream after a block header has been
+ * written or read.
+ *
+ * @param   pState          The teleporter state data.
+ */
+DECLINLINE(void) teleporterTcpAdvanceStream(TeleporterState *pState)
+{
+    if (++pState->miStream >= pState->mcStreams)
+        pState->miStream = 0;
+}
+
+
+/**
+ * Closes the additional data streams.
+ *
+ * @param   pState          The teleporter state data.
+ */
+static void teleporterTcpCloseStreams(TeleporterState *pState)
+{
+    for (unsigned i = 1; i < RT_ELEMENTS(pState->mahStreams); i++)
+        if (pState->mahStreams[i] != NIL_RTSOCKET)
+        {
+            if (pState->mfIsSource)
+                RTTcpClientClose(pState->mahStreams[i]);
+            else
+                RTTcpServerDisconnectClient2(pState->mahStreams[i]);
+            pState->mahStreams[i] = NIL_RTSOCKET;
+        }
+    pState->mcStreams = 1;
+    pState->miStream  = 0;
+}
+
+
+/**
+ * Sets the bandwidth cap of the source.
+ *
+ * @param   pState          The teleporter state data.
+ * @param   cbMaxBandwidth  The max number of bytes per second, 0 for no limit.
+ */
+static void teleporterTcpSetBandwidth(TeleporterState *pState, uint64_t cbMaxBandwidth)
+{
+    pState->mcbMaxBandwidth = cbMaxBandwidth;
+    if (cbMaxBandwidth)
+        /* Aim at roughly 8 blocks per second so the pacing stays smooth. */
+        pState->mcbMaxBlock = (uint32_t)RT_MIN(RT_MAX(cbMaxBandwidth / 8, _64K), TELEPORTERTCPHDR_MAX_SIZE);
+    else
+        pState->mcbMaxBlock = TELEPORTERTCPHDR_MAX_SIZE;
+    pState->mnsRateWindow = RTTimeNanoTS();
+    pState->mcbRateWindow = 0;
+}
+
+
+/**
+ * Enforces the bandwidth cap after writing a data block.
+ *
+ * This sleeps until the average rate of the current one second window is
+ * back below the cap.  The window is restarted every second so that idle
+ * periods (e.g. the VM scanning for dirty pages) do not accumulate credit
+ * which could be spent in one big burst later.
+ *
+ * @param   pState          The teleporter state data.
+ * @param   cbWritten       The number of bytes just written.
+ */
+static void teleporterTcpThrottle(TeleporterState *pState, uint32_t cbWritten)
+{
+    if (!pState->mcbMaxBandwidth)
+        return;
+
+    pState->mcbRateWindow += cbWritten;
+    uint64_t const cNsElapsed = RTTimeNanoTS() - pState->mnsRateWindow;
+    uint64_t const cNsDue     = pState->mcbRateWindow * RT_NS_1SEC_64 / pState->mcbMaxBandwidth;
+    if (cNsDue > cNsElapsed + RT_NS_1MS)
+        RTThreadSleep((RTMSINTERVAL)((cNsDue - cNsElapsed) / RT_NS_1MS));
+
+    if (RT_MAX(cNsElapsed, cNsDue) >= RT_NS_1SEC_64)
+    {
+        pState->mnsRateWindow = RTTimeNanoTS();
+        pState->mcbRateWindow = 0;
+    }
+}
+
+
 /**
  * @copydoc SSMSTRMOPS::pfnWrite
  */
@@ -319,14 +539,16 @@ static DECLCALLBACK(int) teleporterTcpOpWrite(void *pvUser, uint64_t offStream,
     {
         TELEPORTERTCPHDR Hdr;
         Hdr.u32Magic = TELEPORTERTCPHDR_MAGIC;
-        Hdr.cb       = RT_MIN((uint32_t)cbToWrite, TELEPORTERTCPHDR_MAX_SIZE);
-        int rc = RTTcpSgWriteL(pState->mhSocket, 2, &Hdr, sizeof(Hdr), pvBuf, (size_t)Hdr.cb);
+        Hdr.cb       = RT_MIN((uint32_t)cbToWrite, pState->mcbMaxBlock);
+        int rc = RTTcpSgWriteL(teleporterTcpCurStream(pState), 2, &Hdr, sizeof(Hdr), pvBuf, (size_t)Hdr.cb);
         if (RT_FAILURE(rc))
         {
-            LogRel(("Teleporter/TCP: Write error: %Rrc (cb=%#x)\n", rc, Hdr.cb));
+            LogRel(("Teleporter/TCP: Write error: %Rrc (cb=%#x stream=%u)\n", rc, Hdr.cb, pState->miStream));
             return rc;
         }
+        teleporterTcpAdvanceStream(pState);
         pState->moffStream += Hdr.cb;
+        teleporterTcpThrottle(pState, Hdr.cb);
         if (Hdr.cb == cbToWrite)
             return VINF_SUCCESS;
 
@@ -353,7 +575,7 @@ static int teleporterTcpReadSelect(TeleporterState *pState)
     int rc;
     do
     {
-        rc = RTTcpSelectOne(pState->mhSocket, 1000);
+        rc = RTTcpSelectOne(pState->mcbReadBlock ? pState->mhReadStream : teleporterTcpCurStream(pState), 1000);
         if (RT_FAILURE(rc) && rc != VERR_TIMEOUT)
         {
             pState->mfIOError = true;
@@ -402,13 +624,15 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
             if (RT_FAILURE(rc))
                 return rc;
             TELEPORTERTCPHDR Hdr;
-            rc = RTTcpRead(pState->mhSocket, &Hdr, sizeof(Hdr), NULL);
+            pState->mhReadStream = teleporterTcpCurStream(pState);
+            rc = RTTcpRead(pState->mhReadStream, &Hdr, sizeof(Hdr), NULL);
             if (RT_FAILURE(rc))
             {
                 pState->mfIOError = true;
-                LogRel(("Teleporter/TCP: Header read error: %Rrc\n", rc));
+                LogRel(("Teleporter/TCP: Header read error: %Rrc (stream=%u)\n", rc, pState->miStream));
                 return rc;
             }
+            teleporterTcpAdvanceStream(pState);
 
             if (RT_UNLIKELY(   Hdr.u32Magic != TELEPORTERTCPHDR_MAGIC
                             || Hdr.cb > TELEPORTERTCPHDR_MAX_SIZE
@@ -440,7 +664,7 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
         if (RT_FAILURE(rc))
             return rc;
         uint32_t cb = (uint32_t)RT_MIN(pState->mcbReadBlock, cbToRead);
-        rc = RTTcpRead(pState->mhSocket, pvBuf, cb, pcbRead);
+        rc = RTTcpRead(pState->mhReadStream, pvBuf, cb, pcbRead);
         if (RT_FAILURE(rc))
         {
             pState->mfIOError = true;
@@ -534,7 +758,8 @@ static DECLCALLBACK(int) teleporterTcpOpClose(void *pvUser, bool fCanceled)
         TELEPORTERTCPHDR EofHdr;
         EofHdr.u32Magic = TELEPORTERTCPHDR_MAGIC;
         EofHdr.cb       = fCanceled ? UINT32_MAX : 0;
-        int rc = RTTcpWrite(pState->mhSocket, &EofHdr, sizeof(EofHdr));
+        /* The reader expects the next header on the next stream in the rotation. */
+        int rc = RTTcpWrite(teleporterTcpCurStream(pState), &EofHdr, sizeof(EofHdr));
         if (RT_FAILURE(rc))
         {
             LogRel(("Teleporter/TCP: EOF Header write error: %Rrc\n", rc));
@@ -618,6 +843,196 @@ static DECLCALLBACK(void) teleporterDstTimeout(RTTIMERLR hTimerLR, void *pvUser,
 }
 
 
+/**
+ * Connects an additional data stream to the destination.
+ *
+ * The additional connections go through the same welcome + password
+ * handshake as the main one, but no commands are ever sent over them.
+ *
+ * @returns VBox status code.
+ * @param   pState              The teleporter source state.
+ * @param   iStream             The stream number (1 and up).
+ */
+static int teleporterSrcConnectStream(TeleporterStateSrc *pState, uint32_t iStream)
+{
+    Assert(iStream > 0 && iStream < RT_ELEMENTS(pState->mahStreams));
+    Assert(pState->mahStreams[iStream] == NIL_RTSOCKET);
+
+    RTSOCKET hSocket;
+    int vrc = RTTcpClientConnect(pState->mstrHostname.c_str(), pState->muPort, &hSocket);
+    if (RT_FAILURE(vrc))
+        return vrc;
+    pState->mahStreams[iStream] = hSocket; /* (teleporterTcpCloseStreams cleans up) */
+    vrc = RTTcpSetSendCoalescing(hSocket, false /*fEnable*/);
+    AssertRC(vrc);
+
+    char szLine[RT_MAX(128, sizeof(g_szWelcome))];
+    RT_ZERO(szLine);
+    vrc = RTTcpRead(hSocket, szLine, sizeof(g_szWelcome) - 1, NULL);
+    if (RT_FAILURE(vrc))
+        return vrc;
+    if (strcmp(szLine, g_szWelcome))
+        return VERR_INVALID_MAGIC;
+
+    /* (mstrPassword has the '\n' appended by teleporterSrc.) */
+    vrc = RTTcpWrite(hSocket, pState->mstrPassword.c_str(), pState->mstrPassword.length());
+    if (RT_FAILURE(vrc))
+        return vrc;
+
+    RT_ZERO(szLine);
+    vrc = RTTcpRead(hSocket, szLine, sizeof("ACK\n") - 1, NULL);
+    if (RT_FAILURE(vrc))
+        return vrc;
+    if (strcmp(szLine, "ACK\n"))
+        return VERR_AUTHENTICATION_FAILURE;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Asks the target whether it can do post-copy (source side).
+ *
+ * Targets predating post-copy NACK the unknown command and drop the
+ * connection, so a decline ends the teleportation before any state is sent.
+ *
+ * @returns VINF_SUCCESS if the target agreed, VERR_NOT_SUPPORTED if it
+ *          declined, other status codes on connection trouble.
+ * @param   pState              The teleporter source state.
+ */
+static int teleporterSrcNegotiatePostCopy(TeleporterStateSrc *pState)
+{
+    int vrc = RTTcpWrite(pState->mhSocket, RT_STR_TUPLE("post-copy\n"));
+    if (RT_FAILURE(vrc))
+        return vrc;
+
+    char szMsg[256];
+    vrc = teleporterTcpReadLine(pState, szMsg, sizeof(szMsg));
+    if (RT_FAILURE(vrc))
+        return vrc;
+    if (!strcmp(szMsg, "ACK"))
+        return VINF_SUCCESS;
+    if (!strncmp(szMsg, RT_STR_TUPLE("NACK=")))
+    {
+        LogRel(("Teleporter: The target declined post-copy (%s)\n", szMsg));
+        return VERR_NOT_SUPPORTED;
+    }
+    LogRel(("Teleporter: post-copy: Expected ACK or NACK, got '%s'\n", szMsg));
+    return VERR_INTERNAL_ERROR_3;
+}
+
+
+/**
+ * Transfers the memory left behind by the final pass to the target (source
+ * side of post-copy).
+ *
+ * The chunks are pushed in address order, except that chunks the target is
+ * blocked on are sent first.
+ *
+ * @returns VBox status code.
+ * @param   pState              The teleporter source state.
+ */
+static int teleporterSrcPostCopy(TeleporterStateSrc *pState)
+{
+    uint32_t const cChunks   = PGMR3PostCopyPendingChunks(pState->mpUVM);
+    uint32_t       cDemand   = 0;
+    uint64_t       cbSent    = 0;
+    uint64_t const nsStart   = RTTimeNanoTS();
+    LogRel(("Teleporter: Post-copy: Sending %u chunks\n", cChunks));
+
+    void *pvPages = RTMemPageAlloc(PGM_POSTCOPY_CHUNK_SIZE);
+    if (!pvPages)
+        return VERR_NO_MEMORY;
+
+    int vrc;
+    for (;;)
+    {
+        /*
+         * Requests for chunks the target is blocked on come first.
+         */
+        RTGCPHYS GCPhys = NIL_RTGCPHYS;
+        vrc = RTTcpSelectOne(pState->mhSocket, 0);
+        if (RT_SUCCESS(vrc))
+        {
+            TELEPORTERPOSTCOPYREQ Req;
+            vrc = RTTcpRead(pState->mhSocket, &Req, sizeof(Req), NULL);
+            if (RT_FAILURE(vrc))
+                break;
+            if (   Req.u32Magic != TELEPORTERPOSTCOPYREQ_MAGIC
+                || Req.GCPhys   == NIL_RTGCPHYS)
+            {
+                vrc = VERR_INVALID_MAGIC;
+                break;
+            }
+            GCPhys = Req.GCPhys;
+            cDemand++;
+        }
+        else if (vrc != VERR_TIMEOUT)
+            break;
+
+        if (GCPhys == NIL_RTGCPHYS)
+        {
+            vrc = PGMR3PostCopyNextChunk(pState->mpUVM, &GCPhys);
+            if (vrc == VERR_NOT_FOUND)
+            {
+                vrc = VINF_SUCCESS;
+                break;
+            }
+            if (RT_FAILURE(vrc))
+                break;
+        }
+
+        /*
+         * Send it, unless it already was.
+         */
+        TELEPORTERPOSTCOPYHDR Hdr;
+        Hdr.u32Magic = TELEPORTERPOSTCOPYHDR_MAGIC;
+        Hdr.GCPhys   = GCPhys;
+        vrc = PGMR3PostCopyReadChunk(pState->mpUVM, GCPhys, Hdr.bmPages, pvPages, &Hdr.cPages);
+        if (vrc == VERR_NOT_FOUND)
+            continue;
+        if (RT_FAILURE(vrc))
+            break;
+        size_t const cbPages = (size_t)Hdr.cPages << PAGE_SHIFT;
+        vrc = RTTcpWrite(pState->mhSocket, &Hdr, sizeof(Hdr));
+        if (RT_SUCCESS(vrc))
+            vrc = RTTcpWrite(pState->mhSocket, pvPages, cbPages);
+        if (RT_FAILURE(vrc))
+            break;
+        cbSent += sizeof(Hdr) + cbPages;
+        teleporterTcpThrottle(pState, (uint32_t)(sizeof(Hdr) + cbPages));
+    }
+
+    /*
+     * Send the end marker and wait for the target to confirm it, dropping
+     * requests for chunks that are already on their way.
+     */
+    if (RT_SUCCESS(vrc))
+    {
+        TELEPORTERPOSTCOPYHDR Hdr;
+        RT_ZERO(Hdr);
+        Hdr.u32Magic = TELEPORTERPOSTCOPYHDR_MAGIC;
+        Hdr.GCPhys   = NIL_RTGCPHYS;
+        vrc = RTTcpWrite(pState->mhSocket, &Hdr, sizeof(Hdr));
+        while (RT_SUCCESS(vrc))
+        {
+            TELEPORTERPOSTCOPYREQ Req;
+            vrc = RTTcpRead(pState->mhSocket, &Req, sizeof(Req), NULL);
+            if (RT_FAILURE(vrc))
+                break;
+            if (Req.u32Magic != TELEPORTERPOSTCOPYREQ_MAGIC)
+                vrc = VERR_INVALID_MAGIC;
+            else if (Req.GCPhys == NIL_RTGCPHYS)
+                break;
+        }
+    }
+
+    RTMemPageFree(pvPages, PGM_POSTCOPY_CHUNK_SIZE);
+    LogRel(("Teleporter: Post-copy: %Rrc - sent %RU64 bytes in %RU64 ms, %u demand requests\n",
+            vrc, cbSent, (RTTimeNanoTS() - nsStart) / RT_NS_1MS, cDemand));
+    return vrc;
+}
+
+
 /**
  * Do the teleporter.
  *
@@ -673,6 +1088,48 @@ Console::teleporterSrc(TeleporterStateSrc *pState)
     if (FAILED(hrc))
         return hrc;
 
+    /*
+     * Set up the additional data streams, if requested.  The SSM data blocks
+     * will be striped across these and the main connection.
+     */
+    if (pState->mcStreamsWanted > 1)
+    {
+        char szCmd[32];
+        RTStrPrintf(szCmd, sizeof(szCmd), "streams=%u", pState->mcStreamsWanted);
+        hrc = teleporterSrcSubmitCommand(pState, szCmd);
+        if (FAILED(hrc))
+            return hrc;
+
+        for (uint32_t iStream = 1; iStream < pState->mcStreamsWanted; iStream++)
+        {
+            vrc = teleporterSrcConnectStream(pState, iStream);
+            if (RT_FAILURE(vrc))
+                return setError(E_FAIL, tr("Failed to set up data stream #%u: %Rrc"), iStream, vrc);
+        }
+        pState->mcStreams = pState->mcStreamsWanted;
+        pState->miStream  = 0;
+        LogRel(("Teleporter: Using %u data streams\n", pState->mcStreams));
+    }
+    if (pState->mcbMaxBandwidth)
+        LogRel(("Teleporter: Bandwidth capped at %RU64 bytes/s\n", pState->mcbMaxBandwidth));
+
+    /*
+     * Post-copy: cut the live phase short and send the remaining dirty
+     * memory after the target has taken over.  The target must agree to it
+     * before it gets to see any deferred pages.
+     */
+    if (pState->mcPostCopyPrePasses)
+    {
+        vrc = teleporterSrcNegotiatePostCopy(pState);
+        if (vrc == VERR_NOT_SUPPORTED)
+            return setError(E_FAIL, tr("The target does not support post-copy teleportation"));
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("Failed to negotiate post-copy: %Rrc"), vrc);
+        vrc = PGMR3PostCopyEnable(pState->mpUVM, pState->mcPostCopyPrePasses);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("PGMR3PostCopyEnable -> %Rrc"), vrc);
+    }
+
     /*
      * Start loading the state.
      *
@@ -742,6 +1199,17 @@ Console::teleporterSrc(TeleporterStateSrc *pState)
         hrc = teleporterSrcSubmitCommand(pState, "hand-over-resume");
     if (FAILED(hrc))
         return hrc;
+    pState->mfHandedOver = true;
+
+    /*
+     * The target is running, give it the rest of the memory.
+     */
+    if (PGMR3PostCopyPendingChunks(pState->mpUVM))
+    {
+        vrc = teleporterSrcPostCopy(pState);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("Post-copy memory transfer failed: %Rrc"), vrc);
+    }
 
     /*
      * teleporterSrcThreadWrapper will do the automatic power off because it
@@ -771,9 +1239,18 @@ Console::teleporterSrcThreadWrapper(RTTHREAD hThread, void *pvUser)
     HRESULT hrc = ptrVM.rc();
 
     if (SUCCEEDED(hrc))
+    {
         hrc = pState->mptrConsole->teleporterSrc(pState);
 
+        /* Post-copy: before the hand-over this just drops the tracking
+           state so that the VM carries on as usual. */
+        if (pState->mcPostCopyPrePasses)
+            PGMR3PostCopyEnd(pState->mpUVM,
+                             !pState->mfHandedOver || SUCCEEDED(hrc) ? VINF_SUCCESS : VERR_CANCELLED);
+    }
+
     /* Close the connection ASAP on so that the other side can complete. */
+    teleporterTcpCloseStreams(pState);
     if (pState->mhSocket != NIL_RTSOCKET)
     {
         RTTcpClientClose(pState->mhSocket);
@@ -797,11 +1274,16 @@ Console::teleporterSrcThreadWrapper(RTTHREAD hThread, void *pvUser)
 
     VMSTATE const        enmVMState      = VMR3GetStateU(pState->mpUVM);
     MachineState_T const enmMachineState = pState->mptrConsole->mMachineState;
-    if (SUCCEEDED(hrc))
+    if (   SUCCEEDED(hrc)
+        || pState->mfHandedOver)
     {
         /*
          * Automatically shut down the VM on success.
          *
+         * This is also done when something fails after the hand-over (i.e.
+         * post-copy), since the target is running the VM by now.  The source
+         * must not be resumed, and its media locks belong to the target.
+         *
          * Note! We have to release the VM caller object or we'll deadlock in
          *       powerDown.
          */
@@ -813,12 +1295,15 @@ Console::teleporterSrcThreadWrapper(RTTHREAD hThread, void *pvUser)
         pState->mptrConsole->mVMIsAlreadyPoweringOff = true; /* (Make sure we stick in the TeleportingPausedVM state.) */
         autoLock.release();
 
-        hrc = pState->mptrConsole->powerDown();
+        HRESULT hrc2 = pState->mptrConsole->powerDown();
 
         autoLock.acquire();
         pState->mptrConsole->mVMIsAlreadyPoweringOff = false;
 
-        pState->mptrProgress->notifyComplete(hrc);
+        if (SUCCEEDED(hrc))
+            pState->mptrProgress->notifyComplete(hrc2);
+        else
+            LogRel(("Teleporter: Failed after the hand-over (%Rhrc), powered off the source (%Rhrc)\n", hrc, hrc2));
     }
     else
     {
@@ -989,6 +1474,26 @@ Console::Teleport(IN_BSTR aHostname, ULONG aPort, IN_BSTR aPassword, ULONG aMaxD
     pState->muPort          = aPort;
     pState->mcMsMaxDowntime = aMaxDowntime;
 
+    /*
+     * Transfer tweaks: the bandwidth cap in MB/s and the number of parallel
+     * TCP connections to stripe the state over.
+     */
+    Bstr bstrValue;
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterMaxBandwidth").raw(), bstrValue.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrValue.isEmpty())
+        teleporterTcpSetBandwidth(pState, (uint64_t)Utf8Str(bstrValue).toUInt32() * _1M);
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterStreams").raw(), bstrValue.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrValue.isEmpty())
+        pState->mcStreamsWanted = RT_MIN(RT_MAX(Utf8Str(bstrValue).toUInt32(), 1), TELEPORTER_MAX_STREAMS);
+
+    /*
+     * Post-copy: the number of live passes to do before handing over, with
+     * the remaining dirty memory following after the target has resumed.
+     */
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterPostCopy").raw(), bstrValue.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrValue.isEmpty())
+        pState->mcPostCopyPrePasses = Utf8Str(bstrValue).toUInt32();
+
     void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(pState));
     ptrProgress->setCancelCallback(teleporterProgressCancelCallback, pvUser);
 
@@ -1112,6 +1617,8 @@ Console::teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorMsg, bool f
             TeleporterStateTrg theState(this, pUVM, pProgress, pMachine, mControl, &hTimerLR, fStartPaused);
             theState.mstrPassword      = strPassword;
             theState.mhServer          = hServer;
+            theState.mstrAddress       = strAddress;
+            theState.muPort            = uPort;
 
             void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(&theState));
             if (pProgress->setCancelCallback(teleporterProgressCancelCallback, pvUser))
@@ -1249,6 +1756,163 @@ static int teleporterTcpWriteNACK(TeleporterStateTrg *pState, int32_t rc2, const
 }
 
 
+/**
+ * Accepts the additional data streams requested by the source ("streams=N").
+ *
+ * The main server has been shut down at this point, so we create a new one on
+ * the same address and port and accept N-1 connections from it, each of
+ * which must pass the password check.
+ *
+ * @returns VBox status code.
+ * @param   pState          The teleporter target state.
+ * @param   pszCount        The stream count part of the command.
+ */
+static int teleporterTrgAcceptStreams(TeleporterStateTrg *pState, const char *pszCount)
+{
+    uint32_t cStreams;
+    int vrc = RTStrToUInt32Full(pszCount, 10, &cStreams);
+    if (   vrc != VINF_SUCCESS
+        || cStreams < 2
+        || cStreams > TELEPORTER_MAX_STREAMS
+        || pState->mcStreams != 1)
+    {
+        vrc = RT_FAILURE(vrc) ? vrc : VERR_OUT_OF_RANGE;
+        LogRel(("Teleporter: Invalid stream count '%s'\n", pszCount));
+        teleporterTcpWriteNACK(pState, vrc);
+        return vrc;
+    }
+
+    PRTTCPSERVER hServer;
+    vrc = RTTcpServerCreateEx(pState->mstrAddress.isEmpty() ? NULL : pState->mstrAddress.c_str(), pState->muPort, &hServer);
+    if (RT_FAILURE(vrc))
+    {
+        LogRel(("Teleporter: RTTcpServerCreateEx -> %Rrc (streams)\n", vrc));
+        teleporterTcpWriteNACK(pState, vrc);
+        return vrc;
+    }
+
+    /* Don't wait forever for the source to connect. */
+    RTTIMERLR hTimerLR;
+    vrc = RTTimerLRCreateEx(&hTimerLR, 0 /*ns*/, RTTIMER_FLAGS_CPU_ANY, teleporterDstTimeout, hServer);
+    if (RT_SUCCESS(vrc))
+    {
+        vrc = RTTimerLRStart(hTimerLR, 30*UINT64_C(1000000000) /*ns*/);
+        if (RT_SUCCESS(vrc))
+            vrc = teleporterTcpWriteACK(pState);
+
+        for (uint32_t iStream = 1; iStream < cStreams && RT_SUCCESS(vrc); iStream++)
+        {
+            RTSOCKET hSocket;
+            vrc = RTTcpServerListen2(hServer, &hSocket);
+            if (RT_FAILURE(vrc))
+                break;
+            pState->mahStreams[iStream] = hSocket;
+            vrc = RTTcpSetSendCoalescing(hSocket, false /*fEnable*/);
+            AssertRC(vrc);
+
+            vrc = RTTcpWrite(hSocket, g_szWelcome, sizeof(g_szWelcome) - 1);
+            if (RT_SUCCESS(vrc))
+                vrc = teleporterTcpReadPassword(hSocket, pState->mstrPassword.c_str());
+            if (RT_SUCCESS(vrc))
+                vrc = RTTcpWrite(hSocket, "ACK\n", sizeof("ACK\n") - 1);
+        }
+
+        RTTimerLRDestroy(hTimerLR);
+    }
+    RTTcpServerDestroy(hServer);
+
+    if (RT_FAILURE(vrc))
+    {
+        LogRel(("Teleporter: Failed to set up %u data streams: %Rrc\n", cStreams, vrc));
+        teleporterTcpCloseStreams(pState);
+        return vrc;
+    }
+
+    pState->mcStreams = cStreams;
+    pState->miStream  = 0;
+    LogRel(("Teleporter: Using %u data streams\n", cStreams));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPOSTCOPYFETCH,
+ *      Asks the source to send a chunk ahead of the others.}
+ */
+static DECLCALLBACK(int) teleporterTrgPostCopyFetch(PUVM pUVM, RTGCPHYS GCPhysChunk, void *pvUser)
+{
+    TeleporterStateTrg *pState = (TeleporterStateTrg *)pvUser;
+    NOREF(pUVM);
+
+    TELEPORTERPOSTCOPYREQ Req;
+    Req.u32Magic    = TELEPORTERPOSTCOPYREQ_MAGIC;
+    Req.u32Reserved = 0;
+    Req.GCPhys      = GCPhysChunk;
+    return RTTcpWrite(pState->mhSocket, &Req, sizeof(Req));
+}
+
+
+/**
+ * Receives the memory left behind by the final pass (target side of
+ * post-copy).
+ *
+ * The VM is already running at this point.  Should this fail, the caller
+ * ends post-copy with the failure status and PGM puts the VM into a fatal
+ * error state since part of the guest memory is lost.
+ *
+ * @returns VBox status code.
+ * @param   pState              The teleporter target state.
+ */
+static int teleporterTrgPostCopy(TeleporterStateTrg *pState)
+{
+    LogRel(("Teleporter: Post-copy: Receiving %u chunks\n", PGMR3PostCopyPendingChunks(pState->mpUVM)));
+
+    void *pvPages = RTMemPageAlloc(PGM_POSTCOPY_CHUNK_SIZE);
+    if (!pvPages)
+        return VERR_NO_MEMORY;
+
+    RTSocketRetain(pState->mhSocket); /* For concurrent access by the fetcher. */
+    int vrc = PGMR3PostCopySetFetcher(pState->mpUVM, teleporterTrgPostCopyFetch, pState);
+    while (RT_SUCCESS(vrc))
+    {
+        TELEPORTERPOSTCOPYHDR Hdr;
+        vrc = RTTcpRead(pState->mhSocket, &Hdr, sizeof(Hdr), NULL);
+        if (RT_FAILURE(vrc))
+            break;
+        if (   Hdr.u32Magic != TELEPORTERPOSTCOPYHDR_MAGIC
+            || Hdr.cPages > PGM_POSTCOPY_CHUNK_PAGES)
+        {
+            LogRel(("Teleporter: Post-copy: Bad chunk header: %.*Rhxs\n", sizeof(Hdr), &Hdr));
+            vrc = VERR_INVALID_MAGIC;
+            break;
+        }
+        if (!Hdr.cPages)
+            break;                      /* end marker */
+
+        vrc = RTTcpRead(pState->mhSocket, pvPages, (size_t)Hdr.cPages << PAGE_SHIFT, NULL);
+        if (RT_SUCCESS(vrc))
+            vrc = PGMR3PostCopyDeliverChunk(pState->mpUVM, Hdr.GCPhys, Hdr.bmPages, pvPages, Hdr.cPages);
+    }
+    PGMR3PostCopySetFetcher(pState->mpUVM, NULL, NULL);
+
+    if (RT_SUCCESS(vrc) && PGMR3PostCopyPendingChunks(pState->mpUVM))
+        vrc = VERR_WRONG_ORDER;
+    if (RT_SUCCESS(vrc))
+    {
+        TELEPORTERPOSTCOPYREQ Req;
+        Req.u32Magic    = TELEPORTERPOSTCOPYREQ_MAGIC;
+        Req.u32Reserved = 0;
+        Req.GCPhys      = NIL_RTGCPHYS;
+        vrc = RTTcpWrite(pState->mhSocket, &Req, sizeof(Req));
+    }
+    RTSocketRelease(pState->mhSocket);
+
+    RTMemPageFree(pvPages, PGM_POSTCOPY_CHUNK_SIZE);
+    LogRel(("Teleporter: Post-copy: %Rrc\n", vrc));
+    return vrc;
+}
+
+
 /**
  * @copydoc FNRTTCPSERVE
  *
@@ -1275,23 +1939,11 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
     /*
      * Password (includes '\n', see teleporterTrg).
      */
-    const char *pszPassword = pState->mstrPassword.c_str();
-    unsigned    off = 0;
-    while (pszPassword[off])
+    vrc = teleporterTcpReadPassword(Sock, pState->mstrPassword.c_str());
+    if (RT_FAILURE(vrc))
     {
-        char ch;
-        vrc = RTTcpRead(Sock, &ch, sizeof(ch), NULL);
-        if (    RT_FAILURE(vrc)
-            ||  pszPassword[off] != ch)
-        {
-            if (RT_FAILURE(vrc))
-                LogRel(("Teleporter: Password read failure (off=%u): %Rrc\n", off, vrc));
-            else
-                LogRel(("Teleporter: Invalid password (off=%u)\n", off));
-            teleporterTcpWriteNACK(pState, VERR_AUTHENTICATION_FAILURE);
-            return VINF_SUCCESS;
-        }
-        off++;
+        teleporterTcpWriteNACK(pState, VERR_AUTHENTICATION_FAILURE);
+        return VINF_SUCCESS;
     }
     vrc = teleporterTcpWriteACK(pState);
     if (RT_FAILURE(vrc))
@@ -1375,6 +2027,20 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
 
             vrc = teleporterTcpWriteACK(pState);
         }
+        else if (!strncmp(szCmd, RT_STR_TUPLE("streams=")))
+            vrc = teleporterTrgAcceptStreams(pState, &szCmd[sizeof("streams=") - 1]);
+        else if (!strcmp(szCmd, "post-copy"))
+        {
+            /* Must come before "load" so PGM accepts the deferred pages. */
+            vrc = PGMR3PostCopyAccept(pState->mpUVM);
+            if (RT_SUCCESS(vrc))
+                vrc = teleporterTcpWriteACK(pState);
+            else
+            {
+                LogRel(("Teleporter: PGMR3PostCopyAccept -> %Rrc\n", vrc));
+                teleporterTcpWriteNACK(pState, vrc);
+            }
+        }
         else if (!strcmp(szCmd, "cancel"))
         {
             /* Don't ACK this. */
@@ -1419,6 +2085,11 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
                         vrc = VMR3Resume(pState->mpUVM, VMRESUMEREASON_TELEPORTED);
                     else
                         pState->mptrConsole->setMachineState(MachineState_Paused);
+
+                    /* Post-copy: pull over the memory that was left behind. */
+                    if (   RT_SUCCESS(vrc)
+                        && PGMR3PostCopyPendingChunks(pState->mpUVM))
+                        vrc = teleporterTrgPostCopy(pState);
                     fDone = true;
                     break;
                 }
@@ -1442,9 +2113,19 @@ Console::teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
 
     if (RT_SUCCESS(vrc) && !fDone)
         vrc = VERR_WRONG_ORDER;
+
+    /*
+     * Post-copy: unless all the memory arrived, accesses to the missing pages
+     * must fail from now on instead of waiting for them forever.  This covers
+     * failures before the hand-over and VMR3Resume failures as well.
+     */
+    if (PGMR3PostCopyPendingChunks(pState->mpUVM))
+        PGMR3PostCopyEnd(pState->mpUVM, RT_FAILURE(vrc) ? vrc : VERR_WRONG_ORDER);
+
     if (RT_FAILURE(vrc))
         teleporterTrgUnlockMedia(pState);
 
+    teleporterTcpCloseStreams(pState);
     pState->mRc = vrc;
     pState->mhSocket = NIL_RTSOCKET;
     LogFlowFunc(("returns mRc=%Rrc\n", vrc));
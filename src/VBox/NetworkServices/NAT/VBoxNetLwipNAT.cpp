@@ -46,6 +46,7 @@
 #include <iprt/message.h>
 #include <iprt/req.h>
 #include <iprt/file.h>
+#include <iprt/mp.h>
 #include <iprt/semaphore.h>
 #include <iprt/cpp/utils.h>
 #define LOG_GROUP LOG_GROUP_NAT_SERVICE
@@ -97,6 +98,7 @@ extern "C"
 #include "netif/etharp.h"
 
 #include "proxytest.h"
+#include "proxy_pollmgr.h"
 #include "pxremap.h"
 #include "portfwd.h"
 }
@@ -720,6 +722,8 @@ VBoxNetLwipNAT::VBoxNetLwipNAT()
     m_ProxyOptions.tftp_root = NULL;
     m_ProxyOptions.src4 = NULL;
     m_ProxyOptions.src6 = NULL;
+    /* spread proxied flows over a few poll threads, but don't overdo it */
+    m_ProxyOptions.pollmgr_threads = RT_MIN(RTMpGetOnlineCount(), 4);
     memset(&m_src4, 0, sizeof(m_src4));
     memset(&m_src6, 0, sizeof(m_src6));
     m_src4.sin_family = AF_INET;
@@ -886,6 +890,19 @@ int VBoxNetLwipNAT::init()
         }
     }
 
+    com::Bstr bstrPollThreadsKey = com::BstrFmt("NAT/%s/PollThreads", m_Network.c_str());
+    com::Bstr bstrPollThreads;
+    hrc = virtualbox->GetExtraData(bstrPollThreadsKey.raw(), bstrPollThreads.asOutParam());
+    if (SUCCEEDED(hrc) && !bstrPollThreads.isEmpty())
+    {
+        uint32_t cThreads;
+        rc = RTStrToUInt32Full(com::Utf8Str(bstrPollThreads).c_str(), 10, &cThreads);
+        if (rc == VINF_SUCCESS && cThreads >= 1)
+            m_ProxyOptions.pollmgr_threads = RT_MIN(cThreads, POLLMGR_MAX_SHARDS);
+        else
+            LogRel(("NAT: ignoring invalid %ls value\n", bstrPollThreadsKey.raw()));
+    }
+
     if (!fDontLoadRulesOnStartup)
     {
         /* XXX: extract function and do not duplicate */
@@ -4,6 +4,8 @@
 #include "proxy_pollmgr.h"
 #include "proxytest.h"
 
+#include <iprt/thread.h>
+
 #ifndef RT_OS_WINDOWS
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -24,6 +26,14 @@
 
 #define POLLMGR_GARBAGE (-1)
 
+/*
+ * One poll manager shard.  Each shard has its own thread, poll set
+ * and instance of every channel, so proxied flows spread over shards
+ * don't contend for a single poll loop.  Flows created by the lwip
+ * thread are placed by pollmgr_flow_shard(); sockets registered from
+ * a poll manager callback (e.g. accepted port-forwarded connections)
+ * stay on the shard that registered them.
+ */
 struct pollmgr {
     struct pollfd *fds;
     struct pollmgr_handler **handlers;
@@ -34,31 +44,92 @@ struct pollmgr {
     SOCKET chan[POLLMGR_SLOT_STATIC_COUNT][2];
 #define POLLMGR_CHFD_RD 0       /* - pollmgr side */
 #define POLLMGR_CHFD_WR 1       /* - client side */
-} pollmgr;
 
+    int shard;                  /* index in pollmgr_shards[] */
 
-static void pollmgr_loop(void);
+    /*
+     * We cannot portably peek at the length of the incoming datagram
+     * and pre-allocate pbuf chain to recvmsg() directly to it.  On
+     * Linux it's possible to recv with MSG_PEEK|MSG_TRUC, but extra
+     * syscall is probably more expensive (haven't measured) than
+     * doing an extra copy of data, since typical UDP datagrams are
+     * small enough to avoid fragmentation.
+     *
+     * We can use shared buffer here since each shard reads from
+     * sockets sequentially in a loop over pollfd.
+     */
+    pollmgr_udpbuf_t udpbuf;
+};
 
-static void pollmgr_add_at(int, struct pollmgr_handler *, SOCKET, int);
-static void pollmgr_refptr_delete(struct pollmgr_refptr *);
+static struct pollmgr *pollmgr_shards[POLLMGR_MAX_SHARDS];
+static int pollmgr_nshards;
 
+/* shard served by the current thread (unset for non-pollmgr threads) */
+static RTTLS pollmgr_tls = NIL_RTTLS;
 
-/*
- * We cannot portably peek at the length of the incoming datagram and
- * pre-allocate pbuf chain to recvmsg() directly to it.  On Linux it's
- * possible to recv with MSG_PEEK|MSG_TRUC, but extra syscall is
- * probably more expensive (haven't measured) than doing an extra copy
- * of data, since typical UDP datagrams are small enough to avoid
- * fragmentation.
- *
- * We can use shared buffer here since we read from sockets
- * sequentially in a loop over pollfd.
- */
-u8_t pollmgr_udpbuf[64 * 1024];
+
+static int pollmgr_shard_init(struct pollmgr *, int);
+static void pollmgr_shard_term(struct pollmgr *);
+static struct pollmgr *pollmgr_self(void);
+static void pollmgr_loop(struct pollmgr *);
+
+static void pollmgr_add_at(struct pollmgr *, int, struct pollmgr_handler *, SOCKET, int);
+static void pollmgr_refptr_delete(struct pollmgr_refptr *);
 
 
 int
-pollmgr_init(void)
+pollmgr_init(int nshards)
+{
+    int status;
+    int i;
+
+    if (nshards < 1) {
+        nshards = 1;
+    }
+    else if (nshards > POLLMGR_MAX_SHARDS) {
+        nshards = POLLMGR_MAX_SHARDS;
+    }
+
+    if (pollmgr_tls == NIL_RTTLS) {
+        status = RTTlsAllocEx(&pollmgr_tls, NULL);
+        if (RT_FAILURE(status)) {
+            pollmgr_tls = NIL_RTTLS;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < nshards; ++i) {
+        /* heap allocated b/c of the large udp buffer */
+        struct pollmgr *pm = (struct pollmgr *)malloc(sizeof(*pm));
+        if (pm == NULL) {
+            perror("malloc");
+            goto cleanup;
+        }
+
+        status = pollmgr_shard_init(pm, i);
+        if (status < 0) {
+            free(pm);
+            goto cleanup;
+        }
+
+        pollmgr_shards[i] = pm;
+    }
+
+    pollmgr_nshards = nshards;
+    return 0;
+
+  cleanup:
+    while (--i >= 0) {
+        pollmgr_shard_term(pollmgr_shards[i]);
+        free(pollmgr_shards[i]);
+        pollmgr_shards[i] = NULL;
+    }
+    return -1;
+}
+
+
+static int
+pollmgr_shard_init(struct pollmgr *pm, int shard)
 {
     struct pollfd *newfds;
     struct pollmgr_handler **newhdls;
@@ -66,25 +137,26 @@ pollmgr_init(void)
     int status;
     nfds_t i;
 
-    pollmgr.fds = NULL;
-    pollmgr.handlers = NULL;
-    pollmgr.capacity = 0;
-    pollmgr.nfds = 0;
+    pm->fds = NULL;
+    pm->handlers = NULL;
+    pm->capacity = 0;
+    pm->nfds = 0;
+    pm->shard = shard;
 
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
-        pollmgr.chan[i][POLLMGR_CHFD_RD] = -1;
-        pollmgr.chan[i][POLLMGR_CHFD_WR] = -1;
+        pm->chan[i][POLLMGR_CHFD_RD] = -1;
+        pm->chan[i][POLLMGR_CHFD_WR] = -1;
     }
 
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
 #ifndef RT_OS_WINDOWS
-        status = socketpair(PF_LOCAL, SOCK_DGRAM, 0, pollmgr.chan[i]);
+        status = socketpair(PF_LOCAL, SOCK_DGRAM, 0, pm->chan[i]);
         if (status < 0) {
             perror("socketpair");
             goto cleanup_close;
         }
 #else
-        status = RTWinSocketPair(PF_INET, SOCK_DGRAM, 0, pollmgr.chan[i]);
+        status = RTWinSocketPair(PF_INET, SOCK_DGRAM, 0, pm->chan[i]);
         AssertRCReturn(status, -1);
 
         if (RT_FAILURE(status)) {
@@ -99,94 +171,184 @@ pollmgr_init(void)
     LWIP_ASSERT1(newcap >= POLLMGR_SLOT_STATIC_COUNT);
 
     newfds = (struct pollfd *)
-        malloc(newcap * sizeof(*pollmgr.fds));
+        malloc(newcap * sizeof(*pm->fds));
     if (newfds == NULL) {
         perror("calloc");
         goto cleanup_close;
     }
 
     newhdls = (struct pollmgr_handler **)
-        malloc(newcap * sizeof(*pollmgr.handlers));
+        malloc(newcap * sizeof(*pm->handlers));
     if (newhdls == NULL) {
         perror("malloc");
         free(newfds);
         goto cleanup_close;
     }
 
-    pollmgr.capacity = newcap;
-    pollmgr.fds = newfds;
-    pollmgr.handlers = newhdls;
+    pm->capacity = newcap;
+    pm->fds = newfds;
+    pm->handlers = newhdls;
 
-    pollmgr.nfds = POLLMGR_SLOT_STATIC_COUNT;
+    pm->nfds = POLLMGR_SLOT_STATIC_COUNT;
 
-    for (i = 0; i < pollmgr.capacity; ++i) {
-        pollmgr.fds[i].fd = -1;
-        pollmgr.fds[i].events = 0;
-        pollmgr.fds[i].revents = 0;
+    for (i = 0; i < pm->capacity; ++i) {
+        pm->fds[i].fd = -1;
+        pm->fds[i].events = 0;
+        pm->fds[i].revents = 0;
     }
 
     return 0;
 
   cleanup_close:
+    pollmgr_shard_term(pm);
+    return -1;
+}
+
+
+/*
+ * Undo pollmgr_shard_init().  Only used on init failure, the running
+ * poll manager is never torn down.
+ */
+static void
+pollmgr_shard_term(struct pollmgr *pm)
+{
+    nfds_t i;
+
     for (i = 0; i < POLLMGR_SLOT_STATIC_COUNT; ++i) {
-        SOCKET *chan = pollmgr.chan[i];
+        SOCKET *chan = pm->chan[i];
         if (chan[POLLMGR_CHFD_RD] >= 0) {
             closesocket(chan[POLLMGR_CHFD_RD]);
             closesocket(chan[POLLMGR_CHFD_WR]);
         }
     }
 
-    return -1;
+    free(pm->fds);
+    free(pm->handlers);
+}
+
+
+/*
+ * The shard served by the calling thread.  Threads that are not poll
+ * manager threads (init code) get shard 0.
+ */
+static struct pollmgr *
+pollmgr_self(void)
+{
+    struct pollmgr *pm = NULL;
+
+    if (pollmgr_tls != NIL_RTTLS) {
+        pm = (struct pollmgr *)RTTlsGet(pollmgr_tls);
+    }
+
+    return pm != NULL ? pm : pollmgr_shards[0];
+}
+
+
+int
+pollmgr_shard_count(void)
+{
+    return pollmgr_nshards;
+}
+
+
+/**
+ * Pick the shard for a new flow by hashing its 5-tuple (FNV-1a).
+ * Addresses are opaque byte strings of "addrlen" bytes.
+ */
+int
+pollmgr_flow_shard(int proto,
+                   const void *src, const void *dst, size_t addrlen,
+                   u16_t sport, u16_t dport)
+{
+    const u8_t *pb;
+    u32_t hash = 2166136261U;
+    size_t i;
+
+    if (pollmgr_nshards <= 1) {
+        return 0;
+    }
+
+#define POLLMGR_FNV(b) do { hash ^= (u8_t)(b); hash *= 16777619U; } while (0)
+    POLLMGR_FNV(proto);
+    for (pb = (const u8_t *)src, i = 0; i < addrlen; ++i) {
+        POLLMGR_FNV(pb[i]);
+    }
+    for (pb = (const u8_t *)dst, i = 0; i < addrlen; ++i) {
+        POLLMGR_FNV(pb[i]);
+    }
+    POLLMGR_FNV(sport >> 8);
+    POLLMGR_FNV(sport);
+    POLLMGR_FNV(dport >> 8);
+    POLLMGR_FNV(dport);
+#undef POLLMGR_FNV
+
+    return (int)(hash % (u32_t)pollmgr_nshards);
+}
+
+
+pollmgr_udpbuf_t *
+pollmgr_udpbuf_self(void)
+{
+    return &pollmgr_self()->udpbuf;
 }
 
 
 /*
  * Must be called before pollmgr loop is started, so no locking.
+ * Channel handlers are registered with every shard; the returned
+ * client side descriptor is that of shard 0.
  */
 SOCKET
 pollmgr_add_chan(int slot, struct pollmgr_handler *handler)
 {
+    int i;
+
     if (slot >= POLLMGR_SLOT_FIRST_DYNAMIC) {
         handler->slot = -1;
         return -1;
     }
 
-    pollmgr_add_at(slot, handler, pollmgr.chan[slot][POLLMGR_CHFD_RD], POLLIN);
-    return pollmgr.chan[slot][POLLMGR_CHFD_WR];
+    for (i = 0; i < pollmgr_nshards; ++i) {
+        struct pollmgr *pm = pollmgr_shards[i];
+        pollmgr_add_at(pm, slot, handler, pm->chan[slot][POLLMGR_CHFD_RD], POLLIN);
+    }
+    return pollmgr_shards[0]->chan[slot][POLLMGR_CHFD_WR];
 }
 
 
 /*
  * Must be called from pollmgr loop (via callbacks), so no locking.
+ * The handler is registered with the calling thread's shard.
  */
 int
 pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
 {
+    struct pollmgr *pm = pollmgr_self();
     int slot;
 
-    DPRINTF2(("%s: new fd %d\n", __func__, fd));
+    DPRINTF2(("%s: new fd %d (shard %d)\n", __func__, fd, pm->shard));
 
-    if (pollmgr.nfds == pollmgr.capacity) {
+    if (pm->nfds == pm->capacity) {
         struct pollfd *newfds;
         struct pollmgr_handler **newhdls;
         nfds_t newcap;
         nfds_t i;
 
-        newcap = pollmgr.capacity * 2;
+        newcap = pm->capacity * 2;
 
         newfds = (struct pollfd *)
-            realloc(pollmgr.fds, newcap * sizeof(*pollmgr.fds));
+            realloc(pm->fds, newcap * sizeof(*pm->fds));
         if (newfds == NULL) {
             perror("realloc");
             handler->slot = -1;
             return -1;
         }
 
-        pollmgr.fds = newfds; /* don't crash/leak if realloc(handlers) fails */
+        pm->fds = newfds; /* don't crash/leak if realloc(handlers) fails */
         /* but don't update capacity yet! */
 
         newhdls = (struct pollmgr_handler **)
-            realloc(pollmgr.handlers, newcap * sizeof(*pollmgr.handlers));
+            realloc(pm->handlers, newcap * sizeof(*pm->handlers));
         if (newhdls == NULL) {
             perror("realloc");
             /* if we failed to realloc here, then fds points to the
@@ -195,10 +357,10 @@ pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
             return -1;
         }
 
-        pollmgr.handlers = newhdls;
-        pollmgr.capacity = newcap;
+        pm->handlers = newhdls;
+        pm->capacity = newcap;
 
-        for (i = pollmgr.nfds; i < newcap; ++i) {
+        for (i = pm->nfds; i < newcap; ++i) {
             newfds[i].fd = -1;
             newfds[i].events = 0;
             newfds[i].revents = 0;
@@ -206,28 +368,34 @@ pollmgr_add(struct pollmgr_handler *handler, SOCKET fd, int events)
         }
     }
 
-    slot = pollmgr.nfds;
-    ++pollmgr.nfds;
+    slot = pm->nfds;
+    ++pm->nfds;
 
-    pollmgr_add_at(slot, handler, fd, events);
+    pollmgr_add_at(pm, slot, handler, fd, events);
+    handler->shard = pm->shard;
     return slot;
 }
 
 
 static void
-pollmgr_add_at(int slot, struct pollmgr_handler *handler, SOCKET fd, int events)
+pollmgr_add_at(struct pollmgr *pm, int slot, struct pollmgr_handler *handler,
+               SOCKET fd, int events)
 {
-    pollmgr.fds[slot].fd = fd;
-    pollmgr.fds[slot].events = events;
-    pollmgr.fds[slot].revents = 0;
-    pollmgr.handlers[slot] = handler;
+    pm->fds[slot].fd = fd;
+    pm->fds[slot].events = events;
+    pm->fds[slot].revents = 0;
+    pm->handlers[slot] = handler;
 
     handler->slot = slot;
 }
 
 
+/**
+ * Send to a channel of the given shard.  Flows must always use the
+ * shard they were placed on (pollmgr_handler::shard).
+ */
 ssize_t
-pollmgr_chan_send(int slot, void *buf, size_t nbytes)
+pollmgr_shard_chan_send(int shard, int slot, void *buf, size_t nbytes)
 {
     SOCKET fd;
     ssize_t nsent;
@@ -236,15 +404,17 @@ pollmgr_chan_send(int slot, void *buf, size_t nbytes)
         return -1;
     }
 
-    fd = pollmgr.chan[slot][POLLMGR_CHFD_WR];
+    LWIP_ASSERT1(shard >= 0 && shard < pollmgr_nshards);
+
+    fd = pollmgr_shards[shard]->chan[slot][POLLMGR_CHFD_WR];
     nsent = send(fd, buf, (int)nbytes, 0);
     if (nsent == SOCKET_ERROR) {
-        warn("send on chan %d", slot);
+        warn("send on chan %d (shard %d)", slot, shard);
         return -1;
     }
     else if ((size_t)nsent != nbytes) {
-        warnx("send on chan %d: datagram truncated to %u bytes",
-              slot, (unsigned int)nsent);
+        warnx("send on chan %d (shard %d): datagram truncated to %u bytes",
+              slot, shard, (unsigned int)nsent);
         return -1;
     }
 
@@ -252,6 +422,17 @@ pollmgr_chan_send(int slot, void *buf, size_t nbytes)
 }
 
 
+/**
+ * Send to a channel of shard 0, where global objects (port-forwarding
+ * rules) live.
+ */
+ssize_t
+pollmgr_chan_send(int slot, void *buf, size_t nbytes)
+{
+    return pollmgr_shard_chan_send(0, slot, buf, nbytes);
+}
+
+
 /**
  * Receive a pointer sent over poll manager channel.
  */
@@ -291,35 +472,48 @@ pollmgr_chan_recv_ptr(struct pollmgr_handler *handler, SOCKET fd, int revents)
 void
 pollmgr_update_events(int slot, int events)
 {
+    struct pollmgr *pm = pollmgr_self();
+
     LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
-    LWIP_ASSERT1((nfds_t)slot < pollmgr.nfds);
+    LWIP_ASSERT1((nfds_t)slot < pm->nfds);
 
-    pollmgr.fds[slot].events = events;
+    pm->fds[slot].events = events;
 }
 
 
 void
 pollmgr_del_slot(int slot)
 {
+    struct pollmgr *pm = pollmgr_self();
+
     LWIP_ASSERT1(slot >= POLLMGR_SLOT_FIRST_DYNAMIC);
 
     DPRINTF2(("%s(%d): fd %d ! DELETED\n",
-              __func__, slot, pollmgr.fds[slot].fd));
+              __func__, slot, pm->fds[slot].fd));
 
-    pollmgr.fds[slot].fd = INVALID_SOCKET; /* see poll loop */
+    pm->fds[slot].fd = INVALID_SOCKET; /* see poll loop */
 }
 
 
+/**
+ * Poll manager thread for shard number "arg" (cast to intptr_t).
+ */
 void
-pollmgr_thread(void *ignored)
+pollmgr_thread(void *arg)
 {
-    LWIP_UNUSED_ARG(ignored);
-    pollmgr_loop();
+    struct pollmgr *pm;
+    int shard = (int)(intptr_t)arg;
+
+    LWIP_ASSERT1(shard >= 0 && shard < pollmgr_nshards);
+    pm = pollmgr_shards[shard];
+
+    RTTlsSet(pollmgr_tls, pm);
+    pollmgr_loop(pm);
 }
 
 
 static void
-pollmgr_loop(void)
+pollmgr_loop(struct pollmgr *pm)
 {
     int nready;
     SOCKET delfirst;
@@ -328,9 +522,9 @@ pollmgr_loop(void)
 
     for (;;) {
 #ifndef RT_OS_WINDOWS
-        nready = poll(pollmgr.fds, pollmgr.nfds, -1);
+        nready = poll(pm->fds, pm->nfds, -1);
 #else
-        int rc = RTWinPoll(pollmgr.fds, pollmgr.nfds,RT_INDEFINITE_WAIT, &nready);
+        int rc = RTWinPoll(pm->fds, pm->nfds,RT_INDEFINITE_WAIT, &nready);
         if (RT_FAILURE(rc)) {
             err(EXIT_FAILURE, "poll"); /* XXX: what to do on error? */
             /* NOTREACHED*/
@@ -356,13 +550,13 @@ pollmgr_loop(void)
         delfirst = INVALID_SOCKET;
         pdelprev = &delfirst;
 
-        for (i = 0; (nfds_t)i < pollmgr.nfds && nready > 0; ++i) {
+        for (i = 0; (nfds_t)i < pm->nfds && nready > 0; ++i) {
             struct pollmgr_handler *handler;
             SOCKET fd;
             int revents, nevents;
 
-            fd = pollmgr.fds[i].fd;
-            revents = pollmgr.fds[i].revents;
+            fd = pm->fds[i].fd;
+            revents = pm->fds[i].revents;
 
             /*
              * Channel handlers can request deletion of dynamic slots
@@ -384,7 +578,7 @@ pollmgr_loop(void)
             }
             --nready;
 
-            handler = pollmgr.handlers[i];
+            handler = pm->handlers[i];
 
             if (handler != NULL && handler->callback != NULL) {
 #if LWIP_PROXY_DEBUG /* DEBUG */
@@ -417,32 +611,32 @@ pollmgr_loop(void)
 
           update_events:
             if (nevents >= 0) {
-                if (nevents != pollmgr.fds[i].events) {
+                if (nevents != pm->fds[i].events) {
                     DPRINTF2(("%s: fd %d ! nevents 0x%x\n",
                               __func__, fd, nevents));
                 }
-                pollmgr.fds[i].events = nevents;
+                pm->fds[i].events = nevents;
             }
             else if (i < POLLMGR_SLOT_FIRST_DYNAMIC) {
                 /* Don't garbage-collect channels. */
                 DPRINTF2(("%s: fd %d ! DELETED (channel %d)\n",
                           __func__, fd, i));
-                pollmgr.fds[i].fd = INVALID_SOCKET;
-                pollmgr.fds[i].events = 0;
-                pollmgr.fds[i].revents = 0;
-                pollmgr.handlers[i] = NULL;
+                pm->fds[i].fd = INVALID_SOCKET;
+                pm->fds[i].events = 0;
+                pm->fds[i].revents = 0;
+                pm->handlers[i] = NULL;
             }
             else {
                 DPRINTF2(("%s: fd %d ! DELETED\n", __func__, fd));
 
                 /* schedule for deletion (see g/c loop for details) */
                 *pdelprev = i;  /* make previous entry point to us */
-                pdelprev = &pollmgr.fds[i].fd;
+                pdelprev = &pm->fds[i].fd;
 
-                pollmgr.fds[i].fd = INVALID_SOCKET; /* end of list (for now) */
-                pollmgr.fds[i].events = POLLMGR_GARBAGE;
-                pollmgr.fds[i].revents = 0;
-                pollmgr.handlers[i] = NULL;
+                pm->fds[i].fd = INVALID_SOCKET; /* end of list (for now) */
+                pm->fds[i].events = POLLMGR_GARBAGE;
+                pm->fds[i].revents = 0;
+                pm->handlers[i] = NULL;
             }
         } /* processing loop */
 
@@ -460,33 +654,33 @@ pollmgr_loop(void)
          * processing loop above.
          */
         while (delfirst != INVALID_SOCKET) {
-            const int last = pollmgr.nfds - 1;
+            const int last = pm->nfds - 1;
 
             /*
              * We want a live entry in the last slot to swap into the
              * freed slot, so make sure we have one.
              */
-            if (pollmgr.fds[last].events == POLLMGR_GARBAGE /* garbage */
-                || pollmgr.fds[last].fd == INVALID_SOCKET)  /* or killed */
+            if (pm->fds[last].events == POLLMGR_GARBAGE /* garbage */
+                || pm->fds[last].fd == INVALID_SOCKET)  /* or killed */
             {
                 /* drop garbage entry at the end of the array */
-                --pollmgr.nfds;
+                --pm->nfds;
 
                 if (delfirst == last) {
-                    /* congruent to delnext >= pollmgr.nfds test below */
+                    /* congruent to delnext >= pm->nfds test below */
                     delfirst = INVALID_SOCKET; /* done */
                 }
             }
             else {
-                const SOCKET delnext = pollmgr.fds[delfirst].fd;
+                const SOCKET delnext = pm->fds[delfirst].fd;
 
                 /* copy live entry at the end to the first slot being freed */
-                pollmgr.fds[delfirst] = pollmgr.fds[last]; /* struct copy */
-                pollmgr.handlers[delfirst] = pollmgr.handlers[last];
-                pollmgr.handlers[delfirst]->slot = (int)delfirst;
-                --pollmgr.nfds;
+                pm->fds[delfirst] = pm->fds[last]; /* struct copy */
+                pm->handlers[delfirst] = pm->handlers[last];
+                pm->handlers[delfirst]->slot = (int)delfirst;
+                --pm->nfds;
 
-                if ((nfds_t)delnext >= pollmgr.nfds) {
+                if ((nfds_t)delnext >= pm->nfds) {
                     delfirst = INVALID_SOCKET; /* done */
                 }
                 else {
@@ -494,10 +688,10 @@ pollmgr_loop(void)
                 }
             }
 
-            pollmgr.fds[last].fd = INVALID_SOCKET;
-            pollmgr.fds[last].events = 0;
-            pollmgr.fds[last].revents = 0;
-            pollmgr.handlers[last] = NULL;
+            pm->fds[last].fd = INVALID_SOCKET;
+            pm->fds[last].events = 0;
+            pm->fds[last].revents = 0;
+            pm->handlers[last] = NULL;
         }
     } /* poll loop */
 }
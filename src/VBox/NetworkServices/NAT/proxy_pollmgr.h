@@ -23,6 +23,9 @@ enum pollmgr_slot_t {
     POLLMGR_SLOT_FIRST_DYNAMIC = POLLMGR_SLOT_STATIC_COUNT
 };
 
+/* upper limit for the number of poll manager threads (shards) */
+#define POLLMGR_MAX_SHARDS 16
+
 
 struct pollmgr_handler;         /* forward */
 typedef int (*pollmgr_callback)(struct pollmgr_handler *, SOCKET, int);
@@ -31,6 +34,7 @@ struct pollmgr_handler {
     pollmgr_callback callback;
     void *data;
     int slot;
+    int shard;                  /* poll manager shard we live on */
 };
 
 struct pollmgr_refptr {
@@ -40,11 +44,15 @@ struct pollmgr_refptr {
     size_t weak;
 };
 
-int pollmgr_init(void);
+int pollmgr_init(int nshards);
+int pollmgr_shard_count(void);
+int pollmgr_flow_shard(int proto, const void *src, const void *dst,
+                       size_t addrlen, u16_t sport, u16_t dport);
 
 /* static named slots (aka "channels") */
 SOCKET pollmgr_add_chan(int, struct pollmgr_handler *);
 ssize_t pollmgr_chan_send(int, void *buf, size_t nbytes);
+ssize_t pollmgr_shard_chan_send(int shard, int, void *buf, size_t nbytes);
 void *pollmgr_chan_recv_ptr(struct pollmgr_handler *, SOCKET, int);
 
 /* dynamic slots */
@@ -61,7 +69,13 @@ void pollmgr_del_slot(int);
 
 void pollmgr_thread(void *);
 
-/* buffer for callbacks to receive udp without worrying about truncation */
-extern u8_t pollmgr_udpbuf[64 * 1024];
+/*
+ * Buffer for callbacks to receive udp without worrying about
+ * truncation.  Each shard has its own, so only use it from poll
+ * manager callbacks.
+ */
+typedef u8_t pollmgr_udpbuf_t[64 * 1024];
+pollmgr_udpbuf_t *pollmgr_udpbuf_self(void);
+#define pollmgr_udpbuf (*pollmgr_udpbuf_self())
 
 #endif /* _PROXY_POLLMGR_H_ */
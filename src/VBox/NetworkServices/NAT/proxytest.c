@@ -35,7 +35,7 @@
 static SOCKET proxy_create_socket(int, int);
 
 volatile const struct proxy_options *g_proxy_options;
-static sys_thread_t pollmgr_tid;
+static sys_thread_t pollmgr_tid[POLLMGR_MAX_SHARDS];
 
 /* XXX: for mapping loopbacks to addresses in our network (ip4) */
 struct netif *g_proxy_netif;
@@ -48,6 +48,7 @@ void
 proxy_init(struct netif *proxy_netif, const struct proxy_options *opts)
 {
     int status;
+    int i;
 
     LWIP_ASSERT1(opts != NULL);
     LWIP_UNUSED_ARG(proxy_netif);
@@ -72,7 +73,7 @@ proxy_init(struct netif *proxy_netif, const struct proxy_options *opts)
         tftpd_init(proxy_netif, opts->tftp_root);
     }
 
-    status = pollmgr_init();
+    status = pollmgr_init(opts->pollmgr_threads);
     if (status < 0) {
         errx(EXIT_FAILURE, "failed to initialize poll manager");
         /* NOTREACHED */
@@ -83,13 +84,19 @@ proxy_init(struct netif *proxy_netif, const struct proxy_options *opts)
 
     portfwd_init();
 
-    pollmgr_tid = sys_thread_new("pollmgr_thread",
-                                 pollmgr_thread, NULL,
-                                 DEFAULT_THREAD_STACKSIZE,
-                                 DEFAULT_THREAD_PRIO);
-    if (!pollmgr_tid) {
-        errx(EXIT_FAILURE, "failed to create poll manager thread");
-        /* NOTREACHED */
+    /*
+     * One thread per poll manager shard.  Proxied flows are spread
+     * over the shards, lwip itself still runs on the tcpip thread.
+     */
+    for (i = 0; i < pollmgr_shard_count(); ++i) {
+        pollmgr_tid[i] = sys_thread_new("pollmgr_thread",
+                                        pollmgr_thread, (void *)(intptr_t)i,
+                                        DEFAULT_THREAD_STACKSIZE,
+                                        DEFAULT_THREAD_PRIO);
+        if (!pollmgr_tid[i]) {
+            errx(EXIT_FAILURE, "failed to create poll manager thread %d", i);
+            /* NOTREACHED */
+        }
     }
 }
 
@@ -34,6 +34,7 @@ struct proxy_options {
     const struct sockaddr_in *src4;
     const struct sockaddr_in6 *src6;
     const struct ip4_lomap_desc *lomap_desc;
+    int pollmgr_threads;        /* number of poll manager shards */
 };
 
 extern volatile const struct proxy_options *g_proxy_options;
@@ -17,6 +17,7 @@
 #endif
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>             /* IOV_MAX */
 #include <stdio.h>
 #include <string.h>
 #include <poll.h>
@@ -31,6 +32,8 @@
 #include "winpoll.h"
 #endif
 
+#include <iprt/asm.h>
+
 #include "lwip/opt.h"
 
 #include "lwip/sys.h"
@@ -47,6 +50,18 @@
 # define HAVE_TCP_POLLHUP 1
 #endif
 
+/*
+ * Max number of pbufs of the outbound chain we pass to a single
+ * sendmsg(2).  Guest data arrive as a chain of MSS-sized pbufs, so
+ * this should be large enough for the whole TCP_WND to go out in
+ * one call.
+ */
+#define PXTCP_SEND_IOV_MAX 64
+#if defined(IOV_MAX) && IOV_MAX < PXTCP_SEND_IOV_MAX
+# undef PXTCP_SEND_IOV_MAX
+# define PXTCP_SEND_IOV_MAX IOV_MAX
+#endif
+
 
 /**
  * Ring buffer for inbound data.  Filled with data from the host
@@ -175,6 +190,14 @@ struct pxtcp {
      */
     int deferred_delete;
 
+    /**
+     * Set by poll manager when msg_inbound is posted, cleared by the
+     * lwip thread before it looks at the ring buffer.  Poll manager
+     * doesn't post another msg_inbound while the previous one is
+     * still pending since that one will pick up the new data anyway.
+     */
+    volatile uint32_t inbound_posted;
+
     /**
      * Ring-buffer for inbound data.
      */
@@ -308,12 +331,14 @@ pxtcp_init(void)
 
 /**
  * Syntactic sugar for sending pxtcp pointer over poll manager
- * channel.  Used by lwip thread functions.
+ * channel of the shard pxtcp lives on.  Used by lwip thread
+ * functions.
  */
 static ssize_t
 pxtcp_chan_send(enum pollmgr_slot_t slot, struct pxtcp *pxtcp)
 {
-    return pollmgr_chan_send(slot, &pxtcp, sizeof(pxtcp));
+    return pollmgr_shard_chan_send(pxtcp->pmhdl.shard, slot,
+                                   &pxtcp, sizeof(pxtcp));
 }
 
 
@@ -325,7 +350,8 @@ static ssize_t
 pxtcp_chan_send_weak(enum pollmgr_slot_t slot, struct pxtcp *pxtcp)
 {
     pollmgr_refptr_weak_ref(pxtcp->rp);
-    return pollmgr_chan_send(slot, &pxtcp->rp, sizeof(pxtcp->rp));
+    return pollmgr_shard_chan_send(pxtcp->pmhdl.shard, slot,
+                                   &pxtcp->rp, sizeof(pxtcp->rp));
 }
 
 
@@ -555,6 +581,7 @@ pxtcp_allocate(void)
     pxtcp->pmhdl.callback = NULL;
     pxtcp->pmhdl.data = (void *)pxtcp;
     pxtcp->pmhdl.slot = -1;
+    pxtcp->pmhdl.shard = 0;
 
     pxtcp->pcb = NULL;
     pxtcp->sock = INVALID_SOCKET;
@@ -568,6 +595,7 @@ pxtcp_allocate(void)
     pxtcp->inbound_close_done = 0;
     pxtcp->inbound_pull = 0;
     pxtcp->deferred_delete = 0;
+    pxtcp->inbound_posted = 0;
 
     pxtcp->inbuf.bufsize = 64 * 1024;
     pxtcp->inbuf.buf = (char *)malloc(pxtcp->inbuf.bufsize);
@@ -1016,6 +1044,10 @@ pxtcp_pcb_heard(void *arg, struct tcp_pcb *newpcb, err_t error)
     pxtcp->sock = sock;
 
     pxtcp->pmhdl.callback = pxtcp_pmgr_connect;
+    pxtcp->pmhdl.shard = pollmgr_flow_shard(IP_PROTO_TCP,
+        &newpcb->remote_ip, &newpcb->local_ip,
+        PCB_ISIPV6(newpcb) ? sizeof(ip6_addr_t) : sizeof(ip_addr_t),
+        newpcb->remote_port, newpcb->local_port);
     pxtcp->events = POLLOUT;
 
     nsent = pxtcp_chan_send(POLLMGR_CHAN_PXTCP_ADD, pxtcp);
@@ -1446,7 +1478,7 @@ pxtcp_pcb_forward_outbound(struct pxtcp *pxtcp, struct pbuf *p)
 #else
         int rc;
 #endif
-        IOVEC iov[8];
+        IOVEC iov[PXTCP_SEND_IOV_MAX];
         const size_t iovsize = sizeof(iov)/sizeof(iov[0]);
         size_t fwd1;
         ssize_t nsent;
@@ -1652,7 +1684,9 @@ pxtcp_pmgr_pump(struct pollmgr_handler *handler, SOCKET fd, int revents)
         }
 
         if (nread > 0) {
-            proxy_lwip_post(&pxtcp->msg_inbound);
+            if (!ASMAtomicXchgU32(&pxtcp->inbound_posted, 1)) {
+                proxy_lwip_post(&pxtcp->msg_inbound);
+            }
 #if !HAVE_TCP_POLLHUP
             /*
              * If host does not report POLLHUP for closed sockets
@@ -1894,6 +1928,9 @@ pxtcp_pcb_write_inbound(void *ctx)
     struct pxtcp *pxtcp = (struct pxtcp *)ctx;
     LWIP_ASSERT1(pxtcp != NULL);
 
+    /* must be cleared before we look at inbuf::vacant */
+    ASMAtomicWriteU32(&pxtcp->inbound_posted, 0);
+
     if (pxtcp->pcb == NULL) {
         return;
     }
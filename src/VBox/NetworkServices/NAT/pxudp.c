@@ -132,12 +132,14 @@ pxudp_init(void)
 
 /**
  * Syntactic sugar for sending pxudp pointer over poll manager
- * channel.  Used by lwip thread functions.
+ * channel of the shard pxudp lives on.  Used by lwip thread
+ * functions.
  */
 static ssize_t
 pxudp_chan_send(enum pollmgr_slot_t chan, struct pxudp *pxudp)
 {
-    return pollmgr_chan_send(chan, &pxudp, sizeof(pxudp));
+    return pollmgr_shard_chan_send(pxudp->pmhdl.shard, chan,
+                                   &pxudp, sizeof(pxudp));
 }
 
 
@@ -149,7 +151,8 @@ static ssize_t
 pxudp_chan_send_weak(enum pollmgr_slot_t chan, struct pxudp *pxudp)
 {
     pollmgr_refptr_weak_ref(pxudp->rp);
-    return pollmgr_chan_send(chan, &pxudp->rp, sizeof(pxudp->rp));
+    return pollmgr_shard_chan_send(pxudp->pmhdl.shard, chan,
+                                   &pxudp->rp, sizeof(pxudp->rp));
 }
 
 
@@ -255,6 +258,7 @@ pxudp_allocate(void)
     pxudp->pmhdl.callback = NULL;
     pxudp->pmhdl.data = (void *)pxudp;
     pxudp->pmhdl.slot = -1;
+    pxudp->pmhdl.shard = 0;
 
     pxudp->pcb = NULL;
     pxudp->sock = INVALID_SOCKET;
@@ -460,6 +464,10 @@ pxudp_pcb_accept(void *arg, struct udp_pcb *newpcb, struct pbuf *p,
     udp_recv(newpcb, pxudp_pcb_recv, pxudp);
 
     pxudp->pmhdl.callback = pxudp_pmgr_pump;
+    pxudp->pmhdl.shard = pollmgr_flow_shard(IP_PROTO_UDP,
+        &newpcb->remote_ip, &newpcb->local_ip,
+        PCB_ISIPV6(newpcb) ? sizeof(ip6_addr_t) : sizeof(ip_addr_t),
+        newpcb->remote_port, newpcb->local_port);
     pxudp_chan_send(POLLMGR_CHAN_PXUDP_ADD, pxudp);
 
     /* dispatch directly instead of calling pxudp_pcb_recv() */
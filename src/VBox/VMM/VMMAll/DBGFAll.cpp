@@ -25,6 +25,7 @@
 #include <VBox/vmm/vm.h>
 #include <VBox/err.h>
 #include <iprt/assert.h>
+#include <iprt/asm-amd64-x86.h>
 
 
 /**
@@ -265,3 +266,28 @@ VMM_INT_DECL(bool) DBGFIsStepping(PVMCPU pVCpu)
     return pVCpu->dbgf.s.fSingleSteppingRaw;
 }
 
+
+
+/**
+ * Adds a completed event to the calling VCPU's binary trace ring.
+ *
+ * This is a no-op when the rings weren't enabled at VM creation time.
+ *
+ * @param   pVCpu       Pointer to the VMCPU of the calling EMT.
+ * @param   enmEvt      The event type.
+ * @param   uTscStart   The TSC when the event started (ASMReadTSC).
+ * @param   uAddr       The port, address or other object identifier.
+ * @param   uValue      The value transferred.
+ * @param   cbAccess    The access size, 0 if not applicable.
+ * @param   rc          The status of the operation.
+ */
+VMM_INT_DECL(void) DBGFTraceRingAdd(PVMCPU pVCpu, DBGFTRACEEVT enmEvt, uint64_t uTscStart, uint64_t uAddr,
+                                    uint64_t uValue, uint8_t cbAccess, int rc)
+{
+    PDBGFTRACERING pRing = pVCpu->dbgf.s.CTX_SUFF(pTraceRing);
+    if (pRing)
+    {
+        VMCPU_ASSERT_EMT(pVCpu);
+        dbgfTraceRingWrite(pRing, enmEvt, uTscStart, ASMReadTSC() - uTscStart, uAddr, uValue, cbAccess, rc);
+    }
+}
@@ -283,6 +283,20 @@ VMM_INT_DECL(bool) HMIsNestedPagingActive(PVM pVM)
     return HMIsEnabled(pVM) && pVM->hm.s.fNestedPaging;
 }
 
+/**
+ * Gets the number of times the VCPU has exited guest execution.
+ *
+ * This changes whenever the guest got to run natively, so callers can tell if
+ * it might have changed state without the VMM noticing.
+ *
+ * @returns The world switch exit counter.
+ * @param   pVCpu       Pointer to the VMCPU.
+ */
+VMM_INT_DECL(uint32_t) HMGetWorldSwitchExits(PVMCPU pVCpu)
+{
+    return ASMAtomicUoReadU32(&pVCpu->hm.s.cWorldSwitchExits);
+}
+
 /**
  * Return the shadow paging mode for nested paging/ept
  *
@@ -773,6 +773,122 @@ static int iemSetPassUpStatus(PIEMCPU pIemCpu, VBOXSTRICTRC rcPassUp)
 }
 
 
+/**
+ * Invalidates all the entries of an IEM TLB.
+ *
+ * @param   pTlb                The TLB.
+ */
+DECLINLINE(void) iemTlbInvalidateAllWorker(PIEMTLB pTlb)
+{
+    pTlb->uTlbRevision += IEMTLB_REVISION_INCR;
+    if (RT_UNLIKELY(!pTlb->uTlbRevision))
+    {
+        /* Wrapped around, so clear the tags to prevent false hits. */
+        pTlb->uTlbRevision = IEMTLB_REVISION_INCR;
+        for (unsigned i = 0; i < RT_ELEMENTS(pTlb->aEntries); i++)
+            pTlb->aEntries[i].uTag = 0;
+    }
+}
+
+
+/**
+ * Looks up the IEM TLB entry for a guest virtual address.
+ *
+ * @returns Pointer to the entry the address maps to (may be a miss).
+ * @param   pTlb                The TLB.
+ * @param   GCPtr               The guest virtual address.
+ * @param   puTag               Where to return the tag the entry must have
+ *                              for a hit.
+ */
+DECLINLINE(PIEMTLBENTRY) iemTlbGetEntry(PIEMTLB pTlb, RTGCPTR GCPtr, uint64_t *puTag)
+{
+    uint64_t const uPage = (uint64_t)GCPtr >> PAGE_SHIFT;
+    *puTag = uPage | pTlb->uTlbRevision;
+    return &pTlb->aEntries[(uint32_t)uPage & (IEMTLB_ENTRIES - 1)];
+}
+
+
+/**
+ * Invalidates the translation of a guest page in an IEM TLB.
+ *
+ * @param   pTlb                The TLB.
+ * @param   GCPtr               The guest virtual address.
+ */
+DECLINLINE(void) iemTlbInvalidatePageWorker(PIEMTLB pTlb, RTGCPTR GCPtr)
+{
+    uint64_t     uTag;
+    PIEMTLBENTRY pEntry = iemTlbGetEntry(pTlb, GCPtr, &uTag);
+    if (pEntry->uTag == uTag)
+        pEntry->uTag = 0;
+}
+
+
+/**
+ * Translates a guest virtual address, consulting the IEM TLB before walking
+ * the guest page tables.
+ *
+ * @returns VBox status code (see PGMGstGetPage).  Failures are not cached.
+ * @param   pIemCpu             The per CPU IEM state.
+ * @param   pTlb                The TLB to use.
+ * @param   GCPtr               The guest virtual address.
+ * @param   pfFlags             Where to return the page table flags
+ *                              (IEMTLBE_F_MASK).
+ * @param   pGCPhys             Where to return the guest physical address of
+ *                              the page.
+ */
+DECLINLINE(int) iemTlbTranslate(PIEMCPU pIemCpu, PIEMTLB pTlb, RTGCPTR GCPtr, uint64_t *pfFlags, PRTGCPHYS pGCPhys)
+{
+    uint64_t     uTag;
+    PIEMTLBENTRY pEntry = iemTlbGetEntry(pTlb, GCPtr, &uTag);
+    if (pEntry->uTag == uTag)
+    {
+        pTlb->cTlbHits++;
+        *pfFlags = pEntry->uPhysAndFlags & IEMTLBE_F_MASK;
+        *pGCPhys = pEntry->uPhysAndFlags & X86_PTE_PAE_PG_MASK;
+        return VINF_SUCCESS;
+    }
+
+    pTlb->cTlbMisses++;
+    uint64_t fFlags;
+    RTGCPHYS GCPhys;
+    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtr, &fFlags, &GCPhys);
+    if (RT_SUCCESS(rc))
+    {
+        pEntry->uTag          = uTag;
+        pEntry->uPhysAndFlags = (GCPhys & X86_PTE_PAE_PG_MASK) | (fFlags & IEMTLBE_F_MASK);
+    }
+    *pfFlags = fFlags & IEMTLBE_F_MASK;
+    *pGCPhys = GCPhys;
+    return rc;
+}
+
+
+/**
+ * Invalidates both IEM TLBs if the guest may have changed its page tables
+ * behind our back.
+ *
+ * With nested paging the guest executes INVLPG and loads CR3 without PGM
+ * being told, so translations cannot be trusted once the guest has been
+ * running in HM since our last look.  Back-to-back calls into IEM without
+ * guest execution in between keep the TLBs.
+ *
+ * @param   pIemCpu             The per CPU IEM state.
+ */
+DECLINLINE(void) iemTlbInvalidateIfUnsynced(PIEMCPU pIemCpu)
+{
+    if (HMIsNestedPagingActive(IEMCPU_TO_VM(pIemCpu)))
+    {
+        uint32_t const cExits = HMGetWorldSwitchExits(IEMCPU_TO_VMCPU(pIemCpu));
+        if (cExits != pIemCpu->cTlbWorldSwitchExits)
+        {
+            pIemCpu->cTlbWorldSwitchExits = cExits;
+            iemTlbInvalidateAllWorker(&pIemCpu->CodeTlb);
+            iemTlbInvalidateAllWorker(&pIemCpu->DataTlb);
+        }
+    }
+}
+
+
 /**
  * Initializes the execution state.
  *
@@ -823,6 +939,7 @@ DECLINLINE(void) iemInitExec(PIEMCPU pIemCpu, bool fBypassHandlers)
     pIemCpu->iNextMapping       = 0;
     pIemCpu->rcPassUp           = VINF_SUCCESS;
     pIemCpu->fBypassHandlers    = fBypassHandlers;
+    iemTlbInvalidateIfUnsynced(pIemCpu);
 #ifdef VBOX_WITH_RAW_MODE_NOT_R0
     pIemCpu->fInPatchCode       = pIemCpu->uCpl == 0
                                && pCtx->cs.u64Base == 0
@@ -893,6 +1010,7 @@ DECLINLINE(void) iemInitDecoder(PIEMCPU pIemCpu, bool fBypassHandlers)
     pIemCpu->iNextMapping       = 0;
     pIemCpu->rcPassUp           = VINF_SUCCESS;
     pIemCpu->fBypassHandlers    = fBypassHandlers;
+    iemTlbInvalidateIfUnsynced(pIemCpu);
 #ifdef VBOX_WITH_RAW_MODE_NOT_R0
     pIemCpu->fInPatchCode       = pIemCpu->uCpl == 0
                                && pCtx->cs.u64Base == 0
@@ -979,7 +1097,7 @@ static VBOXSTRICTRC iemInitDecoderAndPrefetchOpcodes(PIEMCPU pIemCpu, bool fBypa
 
     RTGCPHYS    GCPhys;
     uint64_t    fFlags;
-    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrPC, &fFlags, &GCPhys);
+    int rc = iemTlbTranslate(pIemCpu, &pIemCpu->CodeTlb, GCPtrPC, &fFlags, &GCPhys);
     if (RT_FAILURE(rc))
     {
         Log(("iemInitDecoderAndPrefetchOpcodes: %RGv - rc=%Rrc\n", GCPtrPC, rc));
@@ -997,8 +1115,7 @@ static VBOXSTRICTRC iemInitDecoderAndPrefetchOpcodes(PIEMCPU pIemCpu, bool fBypa
     }
     GCPhys |= GCPtrPC & PAGE_OFFSET_MASK;
     /** @todo Check reserved bits and such stuff. PGM is better at doing
-     *        that, so do it when implementing the guest virtual address
-     *        TLB... */
+     *        that, so do it on TLB misses... */
 
 #ifdef IEM_VERIFICATION_MODE_FULL
     /*
@@ -1128,7 +1245,7 @@ static VBOXSTRICTRC iemOpcodeFetchMoreBytes(PIEMCPU pIemCpu, size_t cbMin)
 
     RTGCPHYS    GCPhys;
     uint64_t    fFlags;
-    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrNext, &fFlags, &GCPhys);
+    int rc = iemTlbTranslate(pIemCpu, &pIemCpu->CodeTlb, GCPtrNext, &fFlags, &GCPhys);
     if (RT_FAILURE(rc))
     {
         Log(("iemOpcodeFetchMoreBytes: %RGv - rc=%Rrc\n", GCPtrNext, rc));
@@ -1147,8 +1264,7 @@ static VBOXSTRICTRC iemOpcodeFetchMoreBytes(PIEMCPU pIemCpu, size_t cbMin)
     GCPhys |= GCPtrNext & PAGE_OFFSET_MASK;
     Log5(("GCPtrNext=%RGv GCPhys=%RGp cbOpcodes=%#x\n",  GCPtrNext,  GCPhys,  pIemCpu->cbOpcode));
     /** @todo Check reserved bits and such stuff. PGM is better at doing
-     *        that, so do it when implementing the guest virtual address
-     *        TLB... */
+     *        that, so do it on TLB misses... */
 
     /*
      * Read the bytes at this address.
@@ -3194,6 +3310,11 @@ DECL_NO_INLINE(static, VBOXSTRICTRC) iemRaiseSelectorInvalidAccess(PIEMCPU pIemC
 /** \#PF(n) - 0e.  */
 DECL_NO_INLINE(static, VBOXSTRICTRC) iemRaisePageFault(PIEMCPU pIemCpu, RTGCPTR GCPtrWhere, uint32_t fAccess, int rc)
 {
+    /* Like the real thing, drop the translation so the guest's fault handler
+       can fix up the page tables without having to execute INVLPG. */
+    iemTlbInvalidatePageWorker(&pIemCpu->CodeTlb, GCPtrWhere);
+    iemTlbInvalidatePageWorker(&pIemCpu->DataTlb, GCPtrWhere);
+
     uint16_t uErr;
     switch (rc)
     {
@@ -5308,7 +5429,7 @@ static VBOXSTRICTRC iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR G
      *        generic / REM interfaces. this won't cut it for R0 & RC. */
     RTGCPHYS    GCPhys;
     uint64_t    fFlags;
-    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrMem, &fFlags, &GCPhys);
+    int rc = iemTlbTranslate(pIemCpu, &pIemCpu->DataTlb, GCPtrMem, &fFlags, &GCPhys);
     if (RT_FAILURE(rc))
     {
         /** @todo Check unassigned memory in unpaged mode. */
@@ -5364,6 +5485,12 @@ static VBOXSTRICTRC iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR G
     {
         int rc2 = PGMGstModifyPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrMem, 1, fAccessedDirty, ~(uint64_t)fAccessedDirty);
         AssertRC(rc2);
+
+        /* Remember it so we don't have to do this again for the next access. */
+        uint64_t     uTag;
+        PIEMTLBENTRY pEntry = iemTlbGetEntry(&pIemCpu->DataTlb, GCPtrMem, &uTag);
+        if (pEntry->uTag == uTag)
+            pEntry->uPhysAndFlags |= fAccessedDirty;
     }
 
     GCPhys |= GCPtrMem & PAGE_OFFSET_MASK;
@@ -9965,6 +10092,35 @@ VMM_INT_DECL(VBOXSTRICTRC) IEMInjectTrap(PVMCPU pVCpu, uint8_t u8TrapNo, TRPMEVE
 }
 
 
+/**
+ * Invalidates all the guest virtual address translations cached by IEM.
+ *
+ * Called by PGM on CR3 loads and paging mode changes.
+ *
+ * @param   pVCpu               The current virtual CPU.
+ * @thread  EMT(pVCpu)
+ */
+VMM_INT_DECL(void) IEMTlbInvalidateAll(PVMCPU pVCpu)
+{
+    iemTlbInvalidateAllWorker(&pVCpu->iem.s.CodeTlb);
+    iemTlbInvalidateAllWorker(&pVCpu->iem.s.DataTlb);
+}
+
+
+/**
+ * Invalidates the IEM translation of a guest page (INVLPG).
+ *
+ * @param   pVCpu               The current virtual CPU.
+ * @param   GCPtr               The guest virtual address of the page.
+ * @thread  EMT(pVCpu)
+ */
+VMM_INT_DECL(void) IEMTlbInvalidatePage(PVMCPU pVCpu, RTGCPTR GCPtr)
+{
+    iemTlbInvalidatePageWorker(&pVCpu->iem.s.CodeTlb, GCPtr);
+    iemTlbInvalidatePageWorker(&pVCpu->iem.s.DataTlb, GCPtr);
+}
+
+
 VMM_INT_DECL(int) IEMBreakpointSet(PVM pVM, RTGCPTR GCPtrBp)
 {
     return VERR_NOT_IMPLEMENTED;
@@ -754,6 +754,12 @@ IEM_CIMPL_DEF_1(RT_CONCAT4(iemCImpl_rep_movs_op,OP_SIZE,_addr,ADDR_SIZE), uint8_
          * Fallback - slow processing till the end of the current page.
          * In the cross page boundrary case we will end up here with cLeftPage
          * as 0, we execute one loop then.
+         *
+         * @todo MMIO source or destination pages also end up here and cost
+         *       one MMIO access per unit.  Unlike REP INS/OUTS there are no
+         *       buffered MMIO callbacks to hand the page to, and the MOVS
+         *       interpreter in IOMAllMMIO.cpp (IOM_WITH_MOVS_SUPPORT) is
+         *       disabled.
          */
         do
         {
@@ -1121,6 +1127,12 @@ IEM_CIMPL_DEF_1(RT_CONCAT4(iemCImpl_rep_ins_op,OP_SIZE,_addr,ADDR_SIZE), bool, f
         return VERR_IEM_ASPECT_NOT_IMPLEMENTED;
     }
 
+#ifndef IN_RC
+    /* Only bother IOM with buffered string I/O until the device declines
+       it, there is no point in asking again for each page. */
+    bool            fStrBuf     = !IEM_VERIFICATION_ENABLED(pIemCpu);
+#endif
+
     /*
      * The loop.
      */
@@ -1147,20 +1159,41 @@ IEM_CIMPL_DEF_1(RT_CONCAT4(iemCImpl_rep_ins_op,OP_SIZE,_addr,ADDR_SIZE), bool, f
                 return rcStrict;
 
             /*
-             * If we can map the page without trouble, we would've liked to use
-             * an string I/O method to do the work, but the current IOM
-             * interface doesn't match our current approach. So, do a regular
-             * loop instead.
+             * If we can map the page without trouble, let the device fill it
+             * directly if it does buffered string I/O, and do whatever it
+             * leaves behind using a regular loop.
              */
-            /** @todo Change the I/O manager interface to make use of
-             *        mapped buffers instead of leaving those bits to the
-             *        device implementation! */
             PGMPAGEMAPLOCK PgLockMem;
             OP_TYPE *puMem;
             rcStrict = iemMemPageMap(pIemCpu, GCPhysMem, IEM_ACCESS_DATA_W, (void **)&puMem, &PgLockMem);
             if (rcStrict == VINF_SUCCESS)
             {
                 uint32_t off = 0;
+#ifndef IN_RC
+                if (fStrBuf)
+                {
+                    uint32_t cTransfers = cLeftPage;
+                    rcStrict = IOMIOPortReadStringBuf(pVM, pVCpu, u16Port, puMem, &cTransfers, OP_SIZE / 8);
+                    if (IOM_SUCCESS(rcStrict))
+                    {
+                        off = cLeftPage - cTransfers;
+                        fStrBuf = off != 0;
+                        pCtx->ADDR_rDI = uAddrReg += off * (OP_SIZE / 8);
+                        pCtx->ADDR_rCX = uCounterReg -= off;
+                    }
+                    if (rcStrict != VINF_SUCCESS)
+                    {
+                        if (IOM_SUCCESS(rcStrict))
+                        {
+                            rcStrict = iemSetPassUpStatus(pIemCpu, rcStrict);
+                            if (uCounterReg == 0)
+                                iemRegAddToRipAndClearRF(pIemCpu, cbInstr);
+                        }
+                        iemMemPageUnmap(pIemCpu, GCPhysMem, IEM_ACCESS_DATA_W, puMem, &PgLockMem);
+                        return rcStrict;
+                    }
+                }
+#endif
                 while (off < cLeftPage)
                 {
                     uint32_t u32Value;
@@ -1331,6 +1364,12 @@ IEM_CIMPL_DEF_2(RT_CONCAT4(iemCImpl_rep_outs_op,OP_SIZE,_addr,ADDR_SIZE), uint8_
     int8_t const    cbIncr      = pCtx->eflags.Bits.u1DF ? -(OP_SIZE / 8) : (OP_SIZE / 8);
     ADDR_TYPE       uAddrReg    = pCtx->ADDR_rSI;
 
+#ifndef IN_RC
+    /* Only bother IOM with buffered string I/O until the device declines
+       it, there is no point in asking again for each page. */
+    bool            fStrBuf     = !IEM_VERIFICATION_ENABLED(pIemCpu);
+#endif
+
     /*
      * The loop.
      */
@@ -1357,20 +1396,42 @@ IEM_CIMPL_DEF_2(RT_CONCAT4(iemCImpl_rep_outs_op,OP_SIZE,_addr,ADDR_SIZE), uint8_
                 return rcStrict;
 
             /*
-             * If we can map the page without trouble, we would've liked to use
-             * an string I/O method to do the work, but the current IOM
-             * interface doesn't match our current approach. So, do a regular
-             * loop instead.
+             * If we can map the page without trouble, hand it to the device
+             * if it does buffered string I/O, and do whatever it leaves behind
+             * using a regular loop.
              */
-            /** @todo Change the I/O manager interface to make use of
-             *        mapped buffers instead of leaving those bits to the
-             *        device implementation? */
             PGMPAGEMAPLOCK PgLockMem;
             OP_TYPE const *puMem;
             rcStrict = iemMemPageMap(pIemCpu, GCPhysMem, IEM_ACCESS_DATA_R, (void **)&puMem, &PgLockMem);
             if (rcStrict == VINF_SUCCESS)
             {
                 uint32_t off = 0;
+#ifndef IN_RC
+                if (fStrBuf)
+                {
+                    uint32_t cTransfers = cLeftPage;
+                    rcStrict = IOMIOPortWriteStringBuf(pVM, pVCpu, u16Port, puMem, &cTransfers, OP_SIZE / 8);
+                    if (IOM_SUCCESS(rcStrict))
+                    {
+                        off = cLeftPage - cTransfers;
+                        fStrBuf = off != 0;
+                        puMem += off;
+                        pCtx->ADDR_rSI = uAddrReg += off * (OP_SIZE / 8);
+                        pCtx->ADDR_rCX = uCounterReg -= off;
+                    }
+                    if (rcStrict != VINF_SUCCESS)
+                    {
+                        if (IOM_SUCCESS(rcStrict))
+                        {
+                            rcStrict = iemSetPassUpStatus(pIemCpu, rcStrict);
+                            if (uCounterReg == 0)
+                                iemRegAddToRipAndClearRF(pIemCpu, cbInstr);
+                        }
+                        iemMemPageUnmap(pIemCpu, GCPhysMem, IEM_ACCESS_DATA_R, puMem, &PgLockMem);
+                        return rcStrict;
+                    }
+                }
+#endif
                 while (off < cLeftPage)
                 {
                     uint32_t u32Value = *puMem++;
@@ -37,6 +37,7 @@
 #include <VBox/log.h>
 #include <iprt/assert.h>
 #include "IOMInline.h"
+#include "VMMTracing.h"
 
 
 /**
@@ -292,6 +293,7 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->InRZToR3); });
             return rcStrict;
         }
+        uint64_t const uTscTrace = TP_RING_START(pVCpu, IOM);
 #ifdef VBOX_WITH_STATISTICS
         if (pStats)
         {
@@ -303,6 +305,7 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
 #endif
             rcStrict = pfnInCallback(pDevIns, pvUser, Port, pu32Value, (unsigned)cbValue);
         PDMCritSectLeave(pDevIns->CTX_SUFF(pCritSectRo));
+        TP_RING_STOP(pVCpu, uTscTrace, DBGFTRACEEVT_IOPORT_READ, Port, *pu32Value, cbValue, VBOXSTRICTRC_VAL(rcStrict));
 
 #ifdef VBOX_WITH_STATISTICS
         if (rcStrict == VINF_SUCCESS && pStats)
@@ -513,6 +516,126 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT Port,
 }
 
 
+#ifndef IN_RC
+/**
+ * Reads a buffer from an I/O port register using the buffered string
+ * I/O callback of the device, if it has one.
+ *
+ * This is meant for callers that already have the guest memory mapped, like
+ * IEM doing REP INS.  Devices without a buffered string I/O callback are
+ * left alone and the caller must do the remaining units one by one using
+ * IOMIOPortRead().  Ports found without one are remembered per VCPU, so
+ * asking again is cheap.
+ *
+ * @returns Strict VBox status code. Informational status codes other than the one documented
+ *          here are to be treated as internal failure. Use IOM_SUCCESS() to check for success.
+ * @retval  VINF_SUCCESS                Success, check *pcTransfers for how much
+ *                                      was actually done.
+ * @retval  VINF_EM_FIRST-VINF_EM_LAST  Success with some exceptions (see IOM_SUCCESS()), the
+ *                                      status code must be passed on to EM.
+ * @retval  VINF_IOM_R3_IOPORT_READ     Defer the read to ring-3. (R0 only)
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pVCpu       Pointer to the virtual CPU structure of the caller.
+ * @param   Port        The port to read.
+ * @param   pvDst       Where to store the data.
+ * @param   pcTransfers Pointer to the number of transfer units to read, on return remaining transfer units.
+ * @param   cb          Size of the transfer unit (1, 2 or 4 bytes).
+ */
+VMMDECL(VBOXSTRICTRC) IOMIOPortReadStringBuf(PVM pVM, PVMCPU pVCpu, RTIOPORT Port,
+                                             void *pvDst, uint32_t *pcTransfers, unsigned cb)
+{
+    /*
+     * Most ports don't do buffered string I/O, so remember which ones we've
+     * already found without and leave them to the single unit path without
+     * taking the lock.  Same if the lock is busy.
+     */
+    if (iomIOPortIsNoStrBufCached(pVM, pVCpu, Port, IOMNOSTRBUF_READ))
+    {
+        STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
+        return VINF_SUCCESS;
+    }
+
+    int rc2 = IOM_LOCK_SHARED(pVM);
+#ifndef IN_RING3
+    if (rc2 == VERR_SEM_BUSY)
+    {
+        STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
+        return VINF_SUCCESS;
+    }
+#endif
+    AssertRC(rc2);
+
+    CTX_SUFF(PIOMIOPORTRANGE) pRange = pVCpu->iom.s.CTX_SUFF(pRangeLastRead);
+    if (    !pRange
+        ||   (unsigned)Port - (unsigned)pRange->Port >= (unsigned)pRange->cPorts)
+    {
+        pRange = iomIOPortGetRange(pVM, Port);
+        if (pRange)
+            pVCpu->iom.s.CTX_SUFF(pRangeLastRead) = pRange;
+    }
+    PFNIOMIOPORTINSTRBUF pfnInStrBufCallback = pRange ? pRange->pfnInStrBufCallback : NULL;
+    if (!pfnInStrBufCallback)
+    {
+        iomIOPortSetNoStrBufCache(pVM, pVCpu, Port, pRange, IOMNOSTRBUF_READ);
+        STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
+        IOM_UNLOCK_SHARED(pVM);
+        return VINF_SUCCESS;
+    }
+    void           *pvUser  = pRange->pvUser;
+    PPDMDEVINS      pDevIns = pRange->pDevIns;
+
+#ifdef VBOX_WITH_STATISTICS
+    PIOMIOPORTSTATS pStats = pVCpu->iom.s.CTX_SUFF(pStatsLastRead);
+    if (!pStats || pStats->Core.Key != Port)
+    {
+        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, Port);
+        if (pStats)
+            pVCpu->iom.s.CTX_SUFF(pStatsLastRead) = pStats;
+    }
+#endif
+    IOM_UNLOCK_SHARED(pVM);
+
+    /*
+     * Call the device.
+     */
+    VBOXSTRICTRC rcStrict = PDMCritSectEnter(pDevIns->CTX_SUFF(pCritSectRo), VINF_IOM_R3_IOPORT_READ);
+    if (rcStrict != VINF_SUCCESS)
+    {
+        STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->InRZToR3); });
+        return rcStrict;
+    }
+    uint32_t const cTransfers = *pcTransfers;
+#ifdef VBOX_WITH_STATISTICS
+    if (pStats)
+    {
+        STAM_PROFILE_START(&pStats->CTX_SUFF_Z(ProfIn), a);
+        rcStrict = pfnInStrBufCallback(pDevIns, pvUser, Port, pvDst, pcTransfers, cb);
+        STAM_PROFILE_STOP(&pStats->CTX_SUFF_Z(ProfIn), a);
+    }
+    else
+#endif
+        rcStrict = pfnInStrBufCallback(pDevIns, pvUser, Port, pvDst, pcTransfers, cb);
+    PDMCritSectLeave(pDevIns->CTX_SUFF(pCritSectRo));
+    Assert(*pcTransfers <= cTransfers);
+
+    STAM_COUNTER_INC(&pVM->iom.s.StatStrIoBuf);
+    STAM_COUNTER_ADD(&pVM->iom.s.StatStrIoBufUnits, cTransfers - *pcTransfers);
+#ifdef VBOX_WITH_STATISTICS
+    if (rcStrict == VINF_SUCCESS && pStats)
+        STAM_COUNTER_INC(&pStats->CTX_SUFF_Z(In));
+# ifndef IN_RING3
+    else if (rcStrict == VINF_IOM_R3_IOPORT_READ && pStats)
+        STAM_COUNTER_INC(&pStats->InRZToR3);
+# endif
+#endif
+    Log3(("IOMIOPortReadStrBuf: Port=%RTiop pvDst=%p cTransfers=%#x->%#x cb=%d rc=%Rrc\n",
+          Port, pvDst, cTransfers, *pcTransfers, cb, VBOXSTRICTRC_VAL(rcStrict)));
+    return rcStrict;
+}
+#endif /* !IN_RC */
+
+
 /**
  * Writes to an I/O port register.
  *
@@ -596,6 +719,7 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->OutRZToR3); });
             return rcStrict;
         }
+        uint64_t const uTscTrace = TP_RING_START(pVCpu, IOM);
 #ifdef VBOX_WITH_STATISTICS
         if (pStats)
         {
@@ -607,6 +731,7 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
 #endif
             rcStrict = pfnOutCallback(pDevIns, pvUser, Port, u32Value, (unsigned)cbValue);
         PDMCritSectLeave(pDevIns->CTX_SUFF(pCritSectRo));
+        TP_RING_STOP(pVCpu, uTscTrace, DBGFTRACEEVT_IOPORT_WRITE, Port, u32Value, cbValue, VBOXSTRICTRC_VAL(rcStrict));
 
 #ifdef VBOX_WITH_STATISTICS
         if (rcStrict == VINF_SUCCESS && pStats)
@@ -792,6 +917,126 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT Port,
 }
 
 
+#ifndef IN_RC
+/**
+ * Writes a buffer to an I/O port register using the buffered string
+ * I/O callback of the device, if it has one.
+ *
+ * This is meant for callers that already have the guest memory mapped, like
+ * IEM doing REP OUTS.  Devices without a buffered string I/O callback are
+ * left alone and the caller must do the remaining units one by one using
+ * IOMIOPortWrite().  Ports found without one are remembered per VCPU, so
+ * asking again is cheap.
+ *
+ * @returns Strict VBox status code. Informational status codes other than the one documented
+ *          here are to be treated as internal failure. Use IOM_SUCCESS() to check for success.
+ * @retval  VINF_SUCCESS                Success, check *pcTransfers for how much
+ *                                      was actually done.
+ * @retval  VINF_EM_FIRST-VINF_EM_LAST  Success with some exceptions (see IOM_SUCCESS()), the
+ *                                      status code must be passed on to EM.
+ * @retval  VINF_IOM_R3_IOPORT_WRITE    Defer the write to ring-3. (R0 only)
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pVCpu       Pointer to the virtual CPU structure of the caller.
+ * @param   Port        The port to write.
+ * @param   pvSrc       The data to write.
+ * @param   pcTransfers Pointer to the number of transfer units to write, on return remaining transfer units.
+ * @param   cb          Size of the transfer unit (1, 2 or 4 bytes).
+ */
+VMMDECL(VBOXSTRICTRC) IOMIOPortWriteStringBuf(PVM pVM, PVMCPU pVCpu, RTIOPORT Port,
+                                              void const *pvSrc, uint32_t *pcTransfers, unsigned cb)
+{
+    /*
+     * Most ports don't do buffered string I/O, so remember which ones we've
+     * already found without and leave them to the single unit path without
+     * taking the lock.  Same if the lock is busy.
+     */
+    if (iomIOPortIsNoStrBufCached(pVM, pVCpu, Port, IOMNOSTRBUF_WRITE))
+    {
+        STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
+        return VINF_SUCCESS;
+    }
+
+    int rc2 = IOM_LOCK_SHARED(pVM);
+#ifndef IN_RING3
+    if (rc2 == VERR_SEM_BUSY)
+    {
+        STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
+        return VINF_SUCCESS;
+    }
+#endif
+    AssertRC(rc2);
+
+    CTX_SUFF(PIOMIOPORTRANGE) pRange = pVCpu->iom.s.CTX_SUFF(pRangeLastWrite);
+    if (    !pRange
+        ||   (unsigned)Port - (unsigned)pRange->Port >= (unsigned)pRange->cPorts)
+    {
+        pRange = iomIOPortGetRange(pVM, Port);
+        if (pRange)
+            pVCpu->iom.s.CTX_SUFF(pRangeLastWrite) = pRange;
+    }
+    PFNIOMIOPORTOUTSTRBUF pfnOutStrBufCallback = pRange ? pRange->pfnOutStrBufCallback : NULL;
+    if (!pfnOutStrBufCallback)
+    {
+        iomIOPortSetNoStrBufCache(pVM, pVCpu, Port, pRange, IOMNOSTRBUF_WRITE);
+        STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
+        IOM_UNLOCK_SHARED(pVM);
+        return VINF_SUCCESS;
+    }
+    void           *pvUser  = pRange->pvUser;
+    PPDMDEVINS      pDevIns = pRange->pDevIns;
+
+#ifdef VBOX_WITH_STATISTICS
+    PIOMIOPORTSTATS pStats = pVCpu->iom.s.CTX_SUFF(pStatsLastWrite);
+    if (!pStats || pStats->Core.Key != Port)
+    {
+        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, Port);
+        if (pStats)
+            pVCpu->iom.s.CTX_SUFF(pStatsLastWrite) = pStats;
+    }
+#endif
+    IOM_UNLOCK_SHARED(pVM);
+
+    /*
+     * Call the device.
+     */
+    VBOXSTRICTRC rcStrict = PDMCritSectEnter(pDevIns->CTX_SUFF(pCritSectRo), VINF_IOM_R3_IOPORT_WRITE);
+    if (rcStrict != VINF_SUCCESS)
+    {
+        STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->OutRZToR3); });
+        return rcStrict;
+    }
+    uint32_t const cTransfers = *pcTransfers;
+#ifdef VBOX_WITH_STATISTICS
+    if (pStats)
+    {
+        STAM_PROFILE_START(&pStats->CTX_SUFF_Z(ProfOut), a);
+        rcStrict = pfnOutStrBufCallback(pDevIns, pvUser, Port, pvSrc, pcTransfers, cb);
+        STAM_PROFILE_STOP(&pStats->CTX_SUFF_Z(ProfOut), a);
+    }
+    else
+#endif
+        rcStrict = pfnOutStrBufCallback(pDevIns, pvUser, Port, pvSrc, pcTransfers, cb);
+    PDMCritSectLeave(pDevIns->CTX_SUFF(pCritSectRo));
+    Assert(*pcTransfers <= cTransfers);
+
+    STAM_COUNTER_INC(&pVM->iom.s.StatStrIoBuf);
+    STAM_COUNTER_ADD(&pVM->iom.s.StatStrIoBufUnits, cTransfers - *pcTransfers);
+#ifdef VBOX_WITH_STATISTICS
+    if (rcStrict == VINF_SUCCESS && pStats)
+        STAM_COUNTER_INC(&pStats->CTX_SUFF_Z(Out));
+# ifndef IN_RING3
+    else if (rcStrict == VINF_IOM_R3_IOPORT_WRITE && pStats)
+        STAM_COUNTER_INC(&pStats->OutRZToR3);
+# endif
+#endif
+    Log3(("IOMIOPortWriteStrBuf: Port=%RTiop pvSrc=%p cTransfers=%#x->%#x cb=%d rc=%Rrc\n",
+          Port, pvSrc, cTransfers, *pcTransfers, cb, VBOXSTRICTRC_VAL(rcStrict)));
+    return rcStrict;
+}
+#endif /* !IN_RC */
+
+
 /**
  * Checks that the operation is allowed according to the IOPL
  * level and I/O bitmap.
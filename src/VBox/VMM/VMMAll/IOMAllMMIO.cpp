@@ -36,6 +36,7 @@
 #include <VBox/vmm/vmm.h>
 #include <VBox/vmm/hm.h>
 #include "IOMInline.h"
+#include "VMMTracing.h"
 
 #include <VBox/dis.h>
 #include <VBox/disopcode.h>
@@ -269,6 +270,26 @@ static VBOXSTRICTRC iomMMIODoComplicatedWrite(PVM pVM, PIOMMMIORANGE pRange, RTG
 
 
 
+/**
+ * Gets the value of an MMIO access for the binary trace rings.
+ *
+ * @returns The value, zero extended.  Zero for odd sizes.
+ * @param   pv                  The value buffer.
+ * @param   cb                  The access size.
+ */
+DECLINLINE(uint64_t) iomMMIOTraceValue(void const *pv, unsigned cb)
+{
+    switch (cb)
+    {
+        case 1: return *(uint8_t const *)pv;
+        case 2: return *(uint16_t const *)pv;
+        case 4: return *(uint32_t const *)pv;
+        case 8: return *(uint64_t const *)pv;
+        default: return 0;
+    }
+}
+
+
 /**
  * Wrapper which does the write and updates range statistics when such are enabled.
  * @warning RT_SUCCESS(rc=VINF_IOM_R3_MMIO_WRITE) is TRUE!
@@ -287,8 +308,10 @@ static int iomMMIODoWrite(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRange, RTGCPHYS
         return VINF_IOM_R3_MMIO_WRITE;
 # endif
     STAM_PROFILE_START(&pStats->CTX_SUFF_Z(ProfWrite), a);
+    STAM_HISTOGRAM_START(&pVM->iom.s.CTX_SUFF(pTrees)->MmioWriteLatency, b);
 #endif
 
+    uint64_t const uTscTrace = TP_RING_START(pVCpu, IOM);
     VBOXSTRICTRC rc;
     if (RT_LIKELY(pRange->CTX_SUFF(pfnWriteCallback)))
     {
@@ -302,7 +325,10 @@ static int iomMMIODoWrite(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRange, RTGCPHYS
     }
     else
         rc = VINF_SUCCESS;
+    TP_RING_STOP(pVCpu, uTscTrace, DBGFTRACEEVT_MMIO_WRITE, GCPhysFault, iomMMIOTraceValue(pvData, cb), cb,
+                 VBOXSTRICTRC_VAL(rc));
 
+    STAM_HISTOGRAM_STOP(&pVM->iom.s.CTX_SUFF(pTrees)->MmioWriteLatency, b);
     STAM_PROFILE_STOP(&pStats->CTX_SUFF_Z(ProfWrite), a);
     STAM_COUNTER_INC(&pStats->Accesses);
     return VBOXSTRICTRC_TODO(rc);
@@ -503,8 +529,10 @@ DECLINLINE(int) iomMMIODoRead(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRange, RTGCP
         return VINF_IOM_R3_MMIO_READ;
 # endif
     STAM_PROFILE_START(&pStats->CTX_SUFF_Z(ProfRead), a);
+    STAM_HISTOGRAM_START(&pVM->iom.s.CTX_SUFF(pTrees)->MmioReadLatency, b);
 #endif
 
+    uint64_t const uTscTrace = TP_RING_START(pVCpu, IOM);
     VBOXSTRICTRC rc;
     if (RT_LIKELY(pRange->CTX_SUFF(pfnReadCallback)))
     {
@@ -528,7 +556,10 @@ DECLINLINE(int) iomMMIODoRead(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRange, RTGCP
             case VINF_IOM_MMIO_UNUSED_00: rc = iomMMIODoRead00s(pvValue, cbValue); break;
         }
     }
+    TP_RING_STOP(pVCpu, uTscTrace, DBGFTRACEEVT_MMIO_READ, GCPhys,
+                 rc == VINF_SUCCESS ? iomMMIOTraceValue(pvValue, cbValue) : 0, cbValue, VBOXSTRICTRC_VAL(rc));
 
+    STAM_HISTOGRAM_STOP(&pVM->iom.s.CTX_SUFF(pTrees)->MmioReadLatency, b);
     STAM_PROFILE_STOP(&pStats->CTX_SUFF_Z(ProfRead), a);
     STAM_COUNTER_INC(&pStats->Accesses);
     return VBOXSTRICTRC_VAL(rc);
@@ -1506,24 +1537,35 @@ static int iomInterpretXCHG(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pRegFrame, RTGCP
  */
 static int iomMMIOHandler(PVM pVM, PVMCPU pVCpu, uint32_t uErrorCode, PCPUMCTXCORE pCtxCore, RTGCPHYS GCPhysFault, void *pvUser)
 {
-    int rc = IOM_LOCK_SHARED(pVM);
+    PIOMMMIORANGE pRange = (PIOMMMIORANGE)pvUser;
+    Assert(pRange);
+
+    /*
+     * Retain the range, skipping the IOM lock if it's in our range cache.
+     */
+    int rc;
+    PIOMMMIORANGE pRangeCached = iomMmioGetRangeCachedWithRef(pVM, pVCpu, GCPhysFault);
+    if (RT_UNLIKELY(pRangeCached != pRange))
+    {
+        if (pRangeCached)
+            iomMmioReleaseRange(pVM, pRangeCached);
+        rc = IOM_LOCK_SHARED(pVM);
 #ifndef IN_RING3
-    if (rc == VERR_SEM_BUSY)
-        return VINF_IOM_R3_MMIO_READ_WRITE;
+        if (rc == VERR_SEM_BUSY)
+            return VINF_IOM_R3_MMIO_READ_WRITE;
 #endif
-    AssertRC(rc);
+        AssertRC(rc);
+        Assert(pRange == iomMmioGetRange(pVM, pVCpu, GCPhysFault));
+        iomMmioRetainRange(pRange);
+#ifndef VBOX_WITH_STATISTICS
+        IOM_UNLOCK_SHARED(pVM);
+#endif
+    }
 
     STAM_PROFILE_START(&pVM->iom.s.StatRZMMIOHandler, a);
     Log(("iomMMIOHandler: GCPhys=%RGp uErr=%#x rip=%RGv\n", GCPhysFault, uErrorCode, (RTGCPTR)pCtxCore->rip));
 
-    PIOMMMIORANGE pRange = (PIOMMMIORANGE)pvUser;
-    Assert(pRange);
-    Assert(pRange == iomMmioGetRange(pVM, pVCpu, GCPhysFault));
-    iomMmioRetainRange(pRange);
-#ifndef VBOX_WITH_STATISTICS
-    IOM_UNLOCK_SHARED(pVM);
-
-#else
+#ifdef VBOX_WITH_STATISTICS
     /*
      * Locate the statistics.
      */
@@ -1761,19 +1803,23 @@ VMMDECL(VBOXSTRICTRC) IOMMMIOPhysHandler(PVM pVM, PVMCPU pVCpu, RTGCUINT uErrorC
     /*
      * We don't have a range here, so look it up before calling the common function.
      */
-    int rc2 = IOM_LOCK_SHARED(pVM); NOREF(rc2);
+    PIOMMMIORANGE pRange = iomMmioGetRangeCachedWithRef(pVM, pVCpu, GCPhysFault);
+    if (!pRange)
+    {
+        int rc2 = IOM_LOCK_SHARED(pVM); NOREF(rc2);
 #ifndef IN_RING3
-    if (rc2 == VERR_SEM_BUSY)
-        return VINF_IOM_R3_MMIO_READ_WRITE;
+        if (rc2 == VERR_SEM_BUSY)
+            return VINF_IOM_R3_MMIO_READ_WRITE;
 #endif
-    PIOMMMIORANGE pRange = iomMmioGetRange(pVM, pVCpu, GCPhysFault);
-    if (RT_UNLIKELY(!pRange))
-    {
+        pRange = iomMmioGetRange(pVM, pVCpu, GCPhysFault);
+        if (RT_UNLIKELY(!pRange))
+        {
+            IOM_UNLOCK_SHARED(pVM);
+            return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+        }
+        iomMmioRetainRange(pRange);
         IOM_UNLOCK_SHARED(pVM);
-        return VERR_IOM_MMIO_RANGE_NOT_FOUND;
     }
-    iomMmioRetainRange(pRange);
-    IOM_UNLOCK_SHARED(pVM);
 
     VBOXSTRICTRC rcStrict = iomMMIOHandler(pVM, pVCpu, (uint32_t)uErrorCode, pCtxCore, GCPhysFault, pRange);
 
@@ -1808,18 +1854,26 @@ DECLCALLBACK(int) IOMR3MMIOHandler(PVM pVM, RTGCPHYS GCPhysFault, void *pvPhys,
     NOREF(pvPhys);
 
     /*
-     * Validate the range.
+     * Validate and retain the range, skipping the IOM lock if it's in our
+     * range cache.
      */
-    int rc = IOM_LOCK_SHARED(pVM);
-    AssertRC(rc);
-    Assert(pRange == iomMmioGetRange(pVM, pVCpu, GCPhysFault));
+    int rc;
+    PIOMMMIORANGE pRangeCached = iomMmioGetRangeCachedWithRef(pVM, pVCpu, GCPhysFault);
+    if (RT_UNLIKELY(pRangeCached != pRange))
+    {
+        if (pRangeCached)
+            iomMmioReleaseRange(pVM, pRangeCached);
+        rc = IOM_LOCK_SHARED(pVM);
+        AssertRC(rc);
+        Assert(pRange == iomMmioGetRange(pVM, pVCpu, GCPhysFault));
+        iomMmioRetainRange(pRange);
+        IOM_UNLOCK_SHARED(pVM);
+    }
 
     /*
      * Perform locking.
      */
-    iomMmioRetainRange(pRange);
     PPDMDEVINS pDevIns = pRange->CTX_SUFF(pDevIns);
-    IOM_UNLOCK_SHARED(pVM);
     rc = PDMCritSectEnter(pDevIns->CTX_SUFF(pCritSectRo), VINF_IOM_R3_MMIO_READ_WRITE);
     if (rc != VINF_SUCCESS)
     {
@@ -1856,32 +1910,40 @@ DECLCALLBACK(int) IOMR3MMIOHandler(PVM pVM, RTGCPHYS GCPhysFault, void *pvPhys,
  */
 VMMDECL(VBOXSTRICTRC) IOMMMIORead(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, uint32_t *pu32Value, size_t cbValue)
 {
-    /* Take the IOM lock before performing any MMIO. */
-    VBOXSTRICTRC rc = IOM_LOCK_SHARED(pVM);
-#ifndef IN_RING3
-    if (rc == VERR_SEM_BUSY)
-        return VINF_IOM_R3_MMIO_WRITE;
-#endif
-    AssertRC(VBOXSTRICTRC_VAL(rc));
+    VBOXSTRICTRC rc;
 #if defined(IEM_VERIFICATION_MODE) && defined(IN_RING3)
     IEMNotifyMMIORead(pVM, GCPhys, cbValue);
 #endif
 
     /*
-     * Lookup the current context range node and statistics.
+     * Lookup the current context range node and statistics.  The range cache of this
+     * VCPU is checked without the IOM lock first.
      */
-    PIOMMMIORANGE pRange = iomMmioGetRange(pVM, pVCpu, GCPhys);
+    PIOMMMIORANGE pRange = iomMmioGetRangeCachedWithRef(pVM, pVCpu, GCPhys);
     if (!pRange)
     {
-        AssertMsgFailed(("Handlers and page tables are out of sync or something! GCPhys=%RGp cbValue=%d\n", GCPhys, cbValue));
+        /* Take the IOM lock before performing any MMIO. */
+        rc = IOM_LOCK_SHARED(pVM);
+#ifndef IN_RING3
+        if (rc == VERR_SEM_BUSY)
+            return VINF_IOM_R3_MMIO_WRITE;
+#endif
+        AssertRC(VBOXSTRICTRC_VAL(rc));
+
+        pRange = iomMmioGetRange(pVM, pVCpu, GCPhys);
+        if (!pRange)
+        {
+            AssertMsgFailed(("Handlers and page tables are out of sync or something! GCPhys=%RGp cbValue=%d\n", GCPhys, cbValue));
+            IOM_UNLOCK_SHARED(pVM);
+            return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+        }
+        iomMmioRetainRange(pRange);
+#ifndef VBOX_WITH_STATISTICS
         IOM_UNLOCK_SHARED(pVM);
-        return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+#endif
     }
-    iomMmioRetainRange(pRange);
-#ifndef VBOX_WITH_STATISTICS
-    IOM_UNLOCK_SHARED(pVM);
 
-#else  /* VBOX_WITH_STATISTICS */
+#ifdef VBOX_WITH_STATISTICS
     PIOMMMIOSTATS pStats = iomMmioGetStats(pVM, pVCpu, GCPhys, pRange);
     if (!pStats)
     {
@@ -1988,32 +2050,40 @@ VMMDECL(VBOXSTRICTRC) IOMMMIORead(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, uint32
  */
 VMMDECL(VBOXSTRICTRC) IOMMMIOWrite(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, uint32_t u32Value, size_t cbValue)
 {
-    /* Take the IOM lock before performing any MMIO. */
-    VBOXSTRICTRC rc = IOM_LOCK_SHARED(pVM);
-#ifndef IN_RING3
-    if (rc == VERR_SEM_BUSY)
-        return VINF_IOM_R3_MMIO_WRITE;
-#endif
-    AssertRC(VBOXSTRICTRC_VAL(rc));
+    VBOXSTRICTRC rc;
 #if defined(IEM_VERIFICATION_MODE) && defined(IN_RING3)
     IEMNotifyMMIOWrite(pVM, GCPhys, u32Value, cbValue);
 #endif
 
     /*
-     * Lookup the current context range node.
+     * Lookup the current context range node.  The range cache of this
+     * VCPU is checked without the IOM lock first.
      */
-    PIOMMMIORANGE pRange = iomMmioGetRange(pVM, pVCpu, GCPhys);
+    PIOMMMIORANGE pRange = iomMmioGetRangeCachedWithRef(pVM, pVCpu, GCPhys);
     if (!pRange)
     {
-        AssertMsgFailed(("Handlers and page tables are out of sync or something! GCPhys=%RGp cbValue=%d\n", GCPhys, cbValue));
+        /* Take the IOM lock before performing any MMIO. */
+        rc = IOM_LOCK_SHARED(pVM);
+#ifndef IN_RING3
+        if (rc == VERR_SEM_BUSY)
+            return VINF_IOM_R3_MMIO_WRITE;
+#endif
+        AssertRC(VBOXSTRICTRC_VAL(rc));
+
+        pRange = iomMmioGetRange(pVM, pVCpu, GCPhys);
+        if (!pRange)
+        {
+            AssertMsgFailed(("Handlers and page tables are out of sync or something! GCPhys=%RGp cbValue=%d\n", GCPhys, cbValue));
+            IOM_UNLOCK_SHARED(pVM);
+            return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+        }
+        iomMmioRetainRange(pRange);
+#ifndef VBOX_WITH_STATISTICS
         IOM_UNLOCK_SHARED(pVM);
-        return VERR_IOM_MMIO_RANGE_NOT_FOUND;
+#endif
     }
-    iomMmioRetainRange(pRange);
-#ifndef VBOX_WITH_STATISTICS
-    IOM_UNLOCK_SHARED(pVM);
 
-#else  /* VBOX_WITH_STATISTICS */
+#ifdef VBOX_WITH_STATISTICS
     PIOMMMIOSTATS pStats = iomMmioGetStats(pVM, pVCpu, GCPhys, pRange);
     if (!pStats)
     {
@@ -2167,6 +2237,8 @@ VMMDECL(VBOXSTRICTRC) IOMInterpretINSEx(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pReg
         const RTGCUINTREG cTransfersOrg = cTransfers;
         rcStrict = IOMIOPortReadString(pVM, pVCpu, uPort, &GCPtrDst, &cTransfers, cbTransfer);
         AssertRC(VBOXSTRICTRC_VAL(rcStrict)); Assert(cTransfers <= cTransfersOrg);
+        if (cTransfers == cTransfersOrg)
+            STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
         pRegFrame->rdi  = ((pRegFrame->rdi + (cTransfersOrg - cTransfers) * cbTransfer) & fAddrMask)
                         | (pRegFrame->rdi & ~fAddrMask);
     }
@@ -2333,6 +2405,8 @@ VMMDECL(VBOXSTRICTRC) IOMInterpretOUTSEx(PVM pVM, PVMCPU pVCpu, PCPUMCTXCORE pRe
         const RTGCUINTREG cTransfersOrg = cTransfers;
         rcStrict = IOMIOPortWriteString(pVM, pVCpu, uPort, &GCPtrSrc, &cTransfers, cbTransfer);
         AssertRC(VBOXSTRICTRC_VAL(rcStrict)); Assert(cTransfers <= cTransfersOrg);
+        if (cTransfers == cTransfersOrg)
+            STAM_COUNTER_INC(&pVM->iom.s.StatStrIoSlowPath);
         pRegFrame->rsi  = ((pRegFrame->rsi + (cTransfersOrg - cTransfers) * cbTransfer) & fAddrMask)
                         | (pRegFrame->rsi & ~fAddrMask);
     }
@@ -32,8 +32,8 @@
 #include <iprt/asm.h>
 #include <iprt/asm-amd64-x86.h>
 #include <iprt/assert.h>
+#include <iprt/lockvalidator.h>
 #ifdef IN_RING3
-# include <iprt/lockvalidator.h>
 # include <iprt/semaphore.h>
 #endif
 #if defined(IN_RING3) || defined(IN_RING0)
@@ -108,12 +108,83 @@ DECL_FORCE_INLINE(int) pdmCritSectEnterFirst(PPDMCRITSECT pCritSect, RTNATIVETHR
 
 
 #if defined(IN_RING3) || defined(IN_RING0)
+/**
+ * Records a contended wait in the contention statistics of the section.
+ *
+ * This is called after the waiter has become the owner, so the updates are
+ * serialized by the critical section itself.
+ *
+ * @param   pCritSect           The critsect (owned by the caller).
+ * @param   pSrcPos             The source position of the waiter.
+ * @param   cTicks              The number of ticks spent waiting.
+ */
+static void pdmR3R0CritSectRecordContention(PPDMCRITSECT pCritSect, PCRTLOCKVALSRCPOS pSrcPos, uint64_t cTicks)
+{
+    uint32_t const idx = pCritSect->s.idxContention - 1;
+    PVM            pVM = pCritSect->s.CTX_SUFF(pVM);
+    AssertReturnVoid(idx < pVM->pdm.s.cCritSectContention);
+    PPDMCRITSECTCONTENTION pContention = &pVM->pdm.s.CTX_SUFF(paCritSectContention)[idx];
+
+# ifdef IN_RING3
+    STAM_REL_PROFILE_ADD_PERIOD(&pContention->StatWaitR3, cTicks);
+    bool const fRing0 = false;
+# else
+    STAM_REL_PROFILE_ADD_PERIOD(&pContention->StatWaitR0, cTicks);
+    bool const fRing0 = true;
+# endif
+
+    /*
+     * Find or add the caller.  The file and function strings are only kept
+     * for ring-3 callers since the ring-0 ones cannot be read from ring-3.
+     */
+    RTHCUINTPTR const uId   = pSrcPos ? pSrcPos->uId   : 0;
+    uint32_t const    uLine = pSrcPos ? pSrcPos->uLine : 0;
+    uint32_t const    cCallers = RT_MIN(pContention->cCallers, RT_ELEMENTS(pContention->aCallers));
+    for (uint32_t i = 0; i < cCallers; i++)
+    {
+        PPDMCRITSECTCALLER pCaller = &pContention->aCallers[i];
+        if (   pCaller->uId    == uId
+            && pCaller->uLine  == uLine
+            && pCaller->fRing0 == fRing0)
+        {
+            pCaller->cWaits++;
+            pCaller->cTicksWaited += cTicks;
+            return;
+        }
+    }
+
+    if (cCallers < RT_ELEMENTS(pContention->aCallers))
+    {
+        PPDMCRITSECTCALLER pCaller = &pContention->aCallers[cCallers];
+        pCaller->uId          = uId;
+        pCaller->uLine        = uLine;
+        pCaller->fRing0       = fRing0;
+# ifdef IN_RING3
+        pCaller->pszFile      = pSrcPos ? pSrcPos->pszFile     : NULL;
+        pCaller->pszFunction  = pSrcPos ? pSrcPos->pszFunction : NULL;
+# else
+        pCaller->pszFile      = NIL_RTR3PTR;
+        pCaller->pszFunction  = NIL_RTR3PTR;
+# endif
+        pCaller->cWaits       = 1;
+        pCaller->cTicksWaited = cTicks;
+        ASMAtomicWriteU32(&pContention->cCallers, cCallers + 1);
+    }
+    else
+    {
+        pContention->cOtherWaits++;
+        pContention->cTicksOtherWaited += cTicks;
+    }
+}
+
+
 /**
  * Deals with the contended case in ring-3 and ring-0.
  *
  * @returns VINF_SUCCESS or VERR_SEM_DESTROYED.
  * @param   pCritSect           The critsect.
  * @param   hNativeSelf         The native thread handle.
+ * @param   pSrcPos             The source position of the caller.
  */
 static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD hNativeSelf, PCRTLOCKVALSRCPOS pSrcPos)
 {
@@ -131,6 +202,7 @@ static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD
     /*
      * The wait loop.
      */
+    uint64_t const  uTscStart   = pCritSect->s.idxContention ? ASMReadTSC() : 0;
     PSUPDRVSESSION  pSession    = pCritSect->s.CTX_SUFF(pVM)->pSession;
     SUPSEMEVENT     hEvent      = (SUPSEMEVENT)pCritSect->s.Core.EventSem;
 # ifdef IN_RING3
@@ -162,7 +234,12 @@ static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD
         if (RT_UNLIKELY(pCritSect->s.Core.u32Magic != RTCRITSECT_MAGIC))
             return VERR_SEM_DESTROYED;
         if (rc == VINF_SUCCESS)
-            return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+        {
+            rc = pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+            if (pCritSect->s.idxContention)
+                pdmR3R0CritSectRecordContention(pCritSect, pSrcPos, ASMReadTSC() - uTscStart);
+            return rc;
+        }
         AssertMsg(rc == VERR_INTERRUPTED, ("rc=%Rrc\n", rc));
     }
     /* won't get here */
@@ -233,6 +310,16 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
            wanted. */
     }
 
+#if defined(IN_RING3) || defined(IN_RING0)
+    /*
+     * Identify the caller for the contention statistics if the API didn't.
+     * We're inlined into the API, so this gives us its return address.
+     */
+    RTLOCKVALSRCPOS SrcPosCaller = RTLOCKVALSRCPOS_INIT(NULL, 0, NULL, (uintptr_t)ASMReturnAddress());
+    if (!pSrcPos)
+        pSrcPos = &SrcPosCaller;
+#endif
+
 #ifdef IN_RING3
     /*
      * Take the slow path.
@@ -356,7 +443,8 @@ VMMDECL(int) PDMCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy)
  */
 VMMDECL(int) PDMCritSectEnterDebug(PPDMCRITSECT pCritSect, int rcBusy, RTHCUINTPTR uId, RT_SRC_POS_DECL)
 {
-#ifdef PDMCRITSECT_STRICT
+#if defined(PDMCRITSECT_STRICT) || !defined(IN_RC)
+    /* Always pass the position along, the contention statistics use it. */
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
     return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos);
 #else
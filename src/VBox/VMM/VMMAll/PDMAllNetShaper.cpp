@@ -28,6 +28,79 @@
 #include "PDMNetShaperInternal.h"
 
 
+/**
+ * Calculates the number of tokens in a bucket.
+ *
+ * @returns Number of tokens available now.
+ * @param   cNsElapsed      Nanoseconds elapsed since the last update.
+ * @param   cbPerSec        The fill rate of the bucket.
+ * @param   cbBucket        The size of the bucket.
+ * @param   cbTokensLast    The number of tokens at the last update.
+ */
+DECLINLINE(uint32_t) pdmNsBucketTokens(uint64_t cNsElapsed, uint64_t cbPerSec, uint32_t cbBucket, uint32_t cbTokensLast)
+{
+    uint64_t cbAdded;
+    if (cNsElapsed < RT_NS_1SEC)
+        cbAdded = cNsElapsed * cbPerSec / RT_NS_1SEC;
+    else /* Don't overflow after long idle periods. */
+        cbAdded = cNsElapsed / RT_NS_1MS * cbPerSec / RT_MS_1SEC;
+    return (uint32_t)RT_MIN(cbBucket, cbAdded + cbTokensLast);
+}
+
+
+/**
+ * Takes bandwidth from a bandwidth group and its ancestors.
+ *
+ * A group transferring within its guaranteed rate does not need permission
+ * from its parent, but the parent is still charged so that the siblings
+ * borrowing bandwidth get correspondingly less of it.
+ *
+ * @returns True if bandwidth was allocated, false if not.
+ * @param   pBwGroup        The bandwidth group, the caller owns its lock.
+ * @param   cbTransfer      Number of bytes to allocate.
+ * @param   tsNow           The current timestamp.
+ * @param   fForce          Take the tokens even if there are not enough.
+ */
+static bool pdmNsBwGroupAllocate(PPDMNSBWGROUP pBwGroup, uint32_t cbTransfer, uint64_t tsNow, bool fForce)
+{
+    uint64_t const cNsElapsed = tsNow - pBwGroup->tsUpdatedLast;
+    uint32_t const cbTokens   = pdmNsBucketTokens(cNsElapsed, pBwGroup->cbPerSecMax,
+                                                  pBwGroup->cbBucket, pBwGroup->cbTokensLast);
+    if (   !fForce
+        && pBwGroup->cbPerSecMax
+        && cbTransfer > cbTokens)
+        return false;
+
+    uint32_t const cbTokensMin = pBwGroup->cbPerSecMin
+                               ? pdmNsBucketTokens(cNsElapsed, pBwGroup->cbPerSecMin,
+                                                   pBwGroup->cbBucketMin, pBwGroup->cbTokensMinLast)
+                               : 0;
+    bool const fGuaranteed = cbTransfer <= cbTokensMin;
+
+    PPDMNSBWGROUP pParent = pBwGroup->CTX_SUFF(pParent);
+    if (pParent)
+    {
+        /*
+         * Lock order is always child before parent.  If the parent is busy
+         * (ring-0 doesn't wait) the transfer is denied, the filter is choked
+         * and the TX thread gets it going again from ring-3.
+         */
+        int rc = PDMCritSectEnter(&pParent->Lock, VERR_SEM_BUSY);
+        if (RT_FAILURE(rc))
+            return false;
+        bool fAllowed = pdmNsBwGroupAllocate(pParent, cbTransfer, tsNow, fForce || fGuaranteed);
+        rc = PDMCritSectLeave(&pParent->Lock); AssertRC(rc);
+        if (!fAllowed)
+            return false;
+    }
+
+    pBwGroup->tsUpdatedLast   = tsNow;
+    pBwGroup->cbTokensLast    = cbTokens    > cbTransfer ? cbTokens    - cbTransfer : 0;
+    pBwGroup->cbTokensMinLast = cbTokensMin > cbTransfer ? cbTokensMin - cbTransfer : 0;
+    return true;
+}
+
+
 /**
  * Obtain bandwidth in a bandwidth group.
  *
@@ -47,25 +120,42 @@ VMMDECL(bool) PDMNsAllocateBandwidth(PPDMNSFILTER pFilter, size_t cbTransfer)
         return true;
 
     bool fAllowed = true;
-    if (pBwGroup->cbPerSecMax)
+    if (pBwGroup->cbPerSecMax || pBwGroup->CTX_SUFF(pParent))
     {
-        /* Re-fill the bucket first */
-        uint64_t tsNow        = RTTimeSystemNanoTS();
-        uint32_t uTokensAdded = (tsNow - pBwGroup->tsUpdatedLast) * pBwGroup->cbPerSecMax / (1000 * 1000 * 1000);
-        uint32_t uTokens      = RT_MIN(pBwGroup->cbBucket, uTokensAdded + pBwGroup->cbTokensLast);
+        uint64_t tsNow = RTTimeSystemNanoTS();
 
-        if (cbTransfer > uTokens)
+        /*
+         * While the group is contended each filter may only use up its
+         * deficit, which the TX thread replenishes in equal shares, so a
+         * single busy filter cannot starve the others.
+         */
+        bool const fFair = pBwGroup->cFiltersActive > 0;
+        if (fFair && cbTransfer > pFilter->cbDeficit)
         {
             fAllowed = false;
-            ASMAtomicWriteBool(&pFilter->fChoked, true);
+            STAM_REL_COUNTER_INC(&pFilter->StatDeniedFairness);
         }
         else
+            fAllowed = pdmNsBwGroupAllocate(pBwGroup, (uint32_t)cbTransfer, tsNow, false /*fForce*/);
+
+        if (fAllowed)
         {
-            pBwGroup->tsUpdatedLast = tsNow;
-            pBwGroup->cbTokensLast = uTokens - (uint32_t)cbTransfer;
+            if (fFair)
+                pFilter->cbDeficit -= (uint32_t)cbTransfer;
+            if (pFilter->tsChoked)
+            {
+                STAM_REL_PROFILE_ADD_PERIOD(&pFilter->StatDelay, tsNow - pFilter->tsChoked);
+                pFilter->tsChoked = 0;
+            }
         }
-        Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} cbTransfer=%u uTokens=%u uTokensAdded=%u fAllowed=%RTbool\n",
-              pBwGroup, R3STRING(pBwGroup->pszNameR3), cbTransfer, uTokens, uTokensAdded, fAllowed));
+        else
+        {
+            if (!pFilter->tsChoked)
+                pFilter->tsChoked = tsNow;
+            ASMAtomicWriteBool(&pFilter->fChoked, true);
+        }
+        Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} cbTransfer=%u cbTokensLast=%u cbDeficit=%u fFair=%RTbool fAllowed=%RTbool\n",
+              pBwGroup, R3STRING(pBwGroup->pszNameR3), cbTransfer, pBwGroup->cbTokensLast, pFilter->cbDeficit, fFair, fAllowed));
     }
     else
         Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} disabled fAllowed=%RTbool\n",
@@ -74,4 +164,3 @@ VMMDECL(bool) PDMNsAllocateBandwidth(PPDMNSFILTER pFilter, size_t cbTransfer)
     rc = PDMCritSectLeave(&pBwGroup->Lock); AssertRC(rc);
     return fAllowed;
 }
-
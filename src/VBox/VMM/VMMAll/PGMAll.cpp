@@ -35,6 +35,7 @@
 #include <VBox/vmm/em.h>
 #include <VBox/vmm/hm.h>
 #include <VBox/vmm/hm_vmx.h>
+#include <VBox/vmm/iem.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
 #include "PGMInline.h"
@@ -723,6 +724,8 @@ VMMDECL(int) PGMInvalidatePage(PVMCPU pVCpu, RTGCPTR GCPtrPage)
     int rc;
     Log3(("PGMInvalidatePage: GCPtrPage=%RGv\n", GCPtrPage));
 
+    IEMTlbInvalidatePage(pVCpu, GCPtrPage);
+
 #if !defined(IN_RING3) && defined(VBOX_WITH_REM)
     /*
      * Notify the recompiler so it can record this instruction.
@@ -1943,6 +1946,7 @@ VMMDECL(int) PGMFlushTLB(PVMCPU pVCpu, uint64_t cr3, bool fGlobal)
      */
     /** @todo optimize this, it shouldn't always be necessary. */
     VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3_NON_GLOBAL);
+    IEMTlbInvalidateAll(pVCpu);
     if (fGlobal)
         VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3);
     LogFlow(("PGMFlushTLB: cr3=%RX64 OldCr3=%RX64 fGlobal=%d\n", cr3, pVCpu->pgm.s.GCPhysCR3, fGlobal));
@@ -2245,6 +2249,9 @@ VMMDECL(int) PGMChangeMode(PVMCPU pVCpu, uint64_t cr0, uint64_t cr4, uint64_t ef
 
     VMCPU_ASSERT_EMT(pVCpu);
 
+    /* CR0.WP, CR4.PSE and friends affect translations even without a mode change. */
+    IEMTlbInvalidateAll(pVCpu);
+
     /*
      * Calc the new guest mode.
      */
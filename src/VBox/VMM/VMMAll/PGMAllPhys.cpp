@@ -1541,6 +1541,39 @@ int pgmPhysGCPhys2CCPtrInternalReadOnly(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys
 }
 
 
+/**
+ * Deals with pages that may not have arrived yet on a post-copy teleportation
+ * target before they are mapped.
+ *
+ * In ring-3 the page is fetched (unless the caller owns the PGM lock, which
+ * the fetching must not be done under).  Elsewhere the pages still covered by
+ * the post-copy access handlers are refused, sending the caller to ring-3.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhys      The guest physical address.
+ * @param   pPage       The page, NULL when called in ring-3 before taking
+ *                      the PGM lock.
+ */
+DECLINLINE(int) pgmPhysPostCopyCheck(PVM pVM, RTGCPHYS GCPhys, PPGMPAGE pPage)
+{
+    if (RT_LIKELY(!ASMAtomicUoReadBool(&pVM->pgm.s.fPostCopyPending)))
+        return VINF_SUCCESS;
+#ifdef IN_RING3
+    NOREF(pPage);
+    if (PGMIsLockOwner(pVM))
+        return VINF_SUCCESS;
+    return pgmR3PostCopyFetchPage(pVM, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK);
+#else
+    NOREF(GCPhys);
+    if (   PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM
+        && PGM_PAGE_GET_HNDL_PHYS_STATE(pPage) == PGM_PAGE_HNDL_PHYS_STATE_ALL)
+        return VERR_PGM_PHYS_PAGE_RESERVED;
+    return VINF_SUCCESS;
+#endif
+}
+
+
 /**
  * Requests the mapping of a guest page into the current context.
  *
@@ -1576,7 +1609,14 @@ int pgmPhysGCPhys2CCPtrInternalReadOnly(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys
  */
 VMMDECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGMPAGEMAPLOCK pLock)
 {
+#ifdef IN_RING3
+    int rc = pgmPhysPostCopyCheck(pVM, GCPhys, NULL);
+    if (RT_FAILURE(rc))
+        return rc;
+    rc = pgmLock(pVM);
+#else
     int rc = pgmLock(pVM);
+#endif
     AssertRCReturn(rc, rc);
 
 #if defined(IN_RC) || defined(VBOX_WITH_2X_4GB_ADDR_SPACE_IN_R0)
@@ -1585,6 +1625,8 @@ VMMDECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGMPAGEM
      */
     PPGMPAGE pPage;
     rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+    if (RT_SUCCESS(rc))
+        rc = pgmPhysPostCopyCheck(pVM, GCPhys, pPage);
     if (RT_SUCCESS(rc))
     {
         if (RT_UNLIKELY(PGM_PAGE_GET_STATE(pPage) != PGM_PAGE_STATE_ALLOCATED))
@@ -1617,6 +1659,10 @@ VMMDECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGMPAGEM
      */
     PPGMPAGEMAPTLBE pTlbe;
     rc = pgmPhysPageQueryTlbe(pVM, GCPhys, &pTlbe);
+# ifdef IN_RING0
+    if (RT_SUCCESS(rc))
+        rc = pgmPhysPostCopyCheck(pVM, GCPhys, pTlbe->pPage);
+# endif
     if (RT_SUCCESS(rc))
     {
         /*
@@ -1679,7 +1725,14 @@ VMMDECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGMPAGEM
  */
 VMMDECL(int) PGMPhysGCPhys2CCPtrReadOnly(PVM pVM, RTGCPHYS GCPhys, void const **ppv, PPGMPAGEMAPLOCK pLock)
 {
+#ifdef IN_RING3
+    int rc = pgmPhysPostCopyCheck(pVM, GCPhys, NULL);
+    if (RT_FAILURE(rc))
+        return rc;
+    rc = pgmLock(pVM);
+#else
     int rc = pgmLock(pVM);
+#endif
     AssertRCReturn(rc, rc);
 
 #if defined(IN_RC) || defined(VBOX_WITH_2X_4GB_ADDR_SPACE_IN_R0)
@@ -1688,6 +1741,8 @@ VMMDECL(int) PGMPhysGCPhys2CCPtrReadOnly(PVM pVM, RTGCPHYS GCPhys, void const **
      */
     PPGMPAGE pPage;
     rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+    if (RT_SUCCESS(rc))
+        rc = pgmPhysPostCopyCheck(pVM, GCPhys, pPage);
     if (RT_SUCCESS(rc))
     {
         if (RT_UNLIKELY(PGM_PAGE_IS_MMIO_OR_SPECIAL_ALIAS(pPage)))
@@ -1718,6 +1773,10 @@ VMMDECL(int) PGMPhysGCPhys2CCPtrReadOnly(PVM pVM, RTGCPHYS GCPhys, void const **
      */
     PPGMPAGEMAPTLBE pTlbe;
     rc = pgmPhysPageQueryTlbe(pVM, GCPhys, &pTlbe);
+# ifdef IN_RING0
+    if (RT_SUCCESS(rc))
+        rc = pgmPhysPostCopyCheck(pVM, GCPhys, pTlbe->pPage);
+# endif
     if (RT_SUCCESS(rc))
     {
         /* MMIO pages doesn't have any readable backing. */
@@ -326,7 +326,57 @@ DECLINLINE(bool) tmTimerTryWithLink(PTMTIMER pTimer, TMTIMERSTATE enmStateNew, T
 
 
 /**
- * Links a timer into the active list of a timer queue.
+ * Melds a list of sibling heaps into one (the two pass pairing heap merge).
+ *
+ * @returns The root of the resulting heap.  Its sibling links are cleared.
+ * @param   pFirst          The first sibling.
+ *
+ * @remarks Called while owning the relevant queue lock.
+ */
+PTMTIMER tmTimerHeapMergePairs(PTMTIMER pFirst)
+{
+    /*
+     * Pass 1: Meld the siblings pairwise from left to right, collecting the
+     *         results on a list (via offNext) in reverse order.
+     */
+    PTMTIMER pPairs = NULL;
+    PTMTIMER pCur   = pFirst;
+    while (pCur)
+    {
+        PTMTIMER const pSecond = TMTIMER_GET_NEXT(pCur);
+        PTMTIMER const pNext   = pSecond ? TMTIMER_GET_NEXT(pSecond) : NULL;
+        pCur->offNext = 0;
+        pCur->offPrev = 0;
+        if (pSecond)
+        {
+            pSecond->offNext = 0;
+            pSecond->offPrev = 0;
+            pCur = tmTimerHeapMeld(pCur, pSecond);
+        }
+        TMTIMER_SET_NEXT(pCur, pPairs);
+        pPairs = pCur;
+        pCur   = pNext;
+    }
+
+    /*
+     * Pass 2: Meld the pairs from right to left, i.e. in list order.
+     */
+    PTMTIMER pRoot = pPairs;
+    pPairs = TMTIMER_GET_NEXT(pRoot);
+    pRoot->offNext = 0;
+    while (pPairs)
+    {
+        PTMTIMER const pNext = TMTIMER_GET_NEXT(pPairs);
+        pPairs->offNext = 0;
+        pRoot  = tmTimerHeapMeld(pRoot, pPairs);
+        pPairs = pNext;
+    }
+    return pRoot;
+}
+
+
+/**
+ * Links a timer into the active heap of a timer queue.
  *
  * @param   pQueue          The queue.
  * @param   pTimer          The timer.
@@ -338,36 +388,19 @@ DECL_FORCE_INLINE(void) tmTimerQueueLinkActive(PTMTIMERQUEUE pQueue, PTMTIMER pT
 {
     Assert(!pTimer->offNext);
     Assert(!pTimer->offPrev);
+    Assert(!pTimer->offChild);
     Assert(pTimer->enmState == TMTIMERSTATE_ACTIVE || pTimer->enmClock != TMCLOCK_VIRTUAL_SYNC); /* (active is not a stable state) */
 
-    PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue);
-    if (pCur)
+    PTMTIMER const pRoot = TMTIMER_GET_HEAD(pQueue);
+    if (pRoot)
     {
-        for (;; pCur = TMTIMER_GET_NEXT(pCur))
+        if (tmTimerHeapMeld(pRoot, pTimer) == pRoot)
+            DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive child", R3STRING(pTimer->pszDesc));
+        else
         {
-            if (pCur->u64Expire > u64Expire)
-            {
-                const PTMTIMER pPrev = TMTIMER_GET_PREV(pCur);
-                TMTIMER_SET_NEXT(pTimer, pCur);
-                TMTIMER_SET_PREV(pTimer, pPrev);
-                if (pPrev)
-                    TMTIMER_SET_NEXT(pPrev, pTimer);
-                else
-                {
-                    TMTIMER_SET_HEAD(pQueue, pTimer);
-                    ASMAtomicWriteU64(&pQueue->u64Expire, u64Expire);
-                    DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive head", R3STRING(pTimer->pszDesc));
-                }
-                TMTIMER_SET_PREV(pCur, pTimer);
-                return;
-            }
-            if (!pCur->offNext)
-            {
-                TMTIMER_SET_NEXT(pCur, pTimer);
-                TMTIMER_SET_PREV(pTimer, pCur);
-                DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive tail", R3STRING(pTimer->pszDesc));
-                return;
-            }
+            TMTIMER_SET_HEAD(pQueue, pTimer);
+            ASMAtomicWriteU64(&pQueue->u64Expire, u64Expire);
+            DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive head", R3STRING(pTimer->pszDesc));
         }
     }
     else
@@ -414,7 +447,7 @@ DECLINLINE(void) tmTimerQueueScheduleOne(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
              * Schedule timer (insert into the active list).
              */
             case TMTIMERSTATE_PENDING_SCHEDULE:
-                Assert(!pTimer->offNext); Assert(!pTimer->offPrev);
+                Assert(!pTimer->offNext); Assert(!pTimer->offPrev); Assert(!pTimer->offChild);
                 if (RT_UNLIKELY(!tmTimerTry(pTimer, TMTIMERSTATE_ACTIVE, TMTIMERSTATE_PENDING_SCHEDULE)))
                     break; /* retry */
                 tmTimerQueueLinkActive(pQueue, pTimer, pTimer->u64Expire);
@@ -433,7 +466,7 @@ DECLINLINE(void) tmTimerQueueScheduleOne(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
              * Stop the timer (not on the active list).
              */
             case TMTIMERSTATE_PENDING_STOP_SCHEDULE:
-                Assert(!pTimer->offNext); Assert(!pTimer->offPrev);
+                Assert(!pTimer->offNext); Assert(!pTimer->offPrev); Assert(!pTimer->offChild);
                 if (RT_UNLIKELY(!tmTimerTry(pTimer, TMTIMERSTATE_STOPPED, TMTIMERSTATE_PENDING_STOP_SCHEDULE)))
                     break;
                 return;
@@ -538,11 +571,19 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                 continue;
             fHaveVirtualSyncLock = true;
         }
-        PTMTIMER pPrev = NULL;
-        for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pPrev = pCur, pCur = TMTIMER_GET_NEXT(pCur))
+        AssertMsg(!TMTIMER_GET_HEAD(pQueue) || !TMTIMER_GET_HEAD(pQueue)->offPrev, ("%s\n", pszWhere));
+        for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pCur = tmTimerHeapWalkNext(pCur))
         {
             AssertMsg((int)pCur->enmClock == i, ("%s: %d != %d\n", pszWhere, pCur->enmClock, i));
-            AssertMsg(TMTIMER_GET_PREV(pCur) == pPrev, ("%s: %p != %p\n", pszWhere, TMTIMER_GET_PREV(pCur), pPrev));
+            PTMTIMER const pNext = TMTIMER_GET_NEXT(pCur);
+            AssertMsg(!pNext || TMTIMER_GET_PREV(pNext) == pCur, ("%s: %p != %p\n", pszWhere, TMTIMER_GET_PREV(pNext), pCur));
+            PTMTIMER const pChild = TMTIMER_GET_CHILD(pCur);
+            AssertMsg(!pChild || TMTIMER_GET_PREV(pChild) == pCur, ("%s: %p != %p\n", pszWhere, TMTIMER_GET_PREV(pChild), pCur));
+            AssertMsg(   !pChild
+                      || pChild->u64Expire >= pCur->u64Expire
+                      || pChild->enmState != TMTIMERSTATE_ACTIVE
+                      || pCur->enmState   != TMTIMERSTATE_ACTIVE,
+                      ("%s: %'RU64 < %'RU64\n", pszWhere, pChild->u64Expire, pCur->u64Expire));
             TMTIMERSTATE enmState = pCur->enmState;
             switch (enmState)
             {
@@ -585,7 +626,7 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                     PTMTIMERR3 pCurAct = TMTIMER_GET_HEAD(&pVM->tm.s.CTX_SUFF(paTimerQueues)[pCur->enmClock]);
                     Assert(pCur->offPrev || pCur == pCurAct);
                     while (pCurAct && pCurAct != pCur)
-                        pCurAct = TMTIMER_GET_NEXT(pCurAct);
+                        pCurAct = tmTimerHeapWalkNext(pCurAct);
                     Assert(pCurAct == pCur);
                 }
                 break;
@@ -598,13 +639,15 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                 {
                     Assert(!pCur->offNext);
                     Assert(!pCur->offPrev);
+                    Assert(!pCur->offChild);
                     for (PTMTIMERR3 pCurAct = TMTIMER_GET_HEAD(&pVM->tm.s.CTX_SUFF(paTimerQueues)[pCur->enmClock]);
                           pCurAct;
-                          pCurAct = TMTIMER_GET_NEXT(pCurAct))
+                          pCurAct = tmTimerHeapWalkNext(pCurAct))
                     {
                         Assert(pCurAct != pCur);
                         Assert(TMTIMER_GET_NEXT(pCurAct) != pCur);
                         Assert(TMTIMER_GET_PREV(pCurAct) != pCur);
+                        Assert(TMTIMER_GET_CHILD(pCurAct) != pCur);
                     }
                 }
                 break;
@@ -1085,6 +1128,7 @@ static int tmTimerSetOptimizedStart(PVM pVM, PTMTIMER pTimer, uint64_t u64Expire
 {
     Assert(!pTimer->offPrev);
     Assert(!pTimer->offNext);
+    Assert(!pTimer->offChild);
     Assert(pTimer->enmState == TMTIMERSTATE_ACTIVE);
 
     TMCLOCK const enmClock = pTimer->enmClock;
@@ -1389,6 +1433,7 @@ static int tmTimerSetRelativeOptimizedStart(PVM pVM, PTMTIMER pTimer, uint64_t c
 {
     Assert(!pTimer->offPrev);
     Assert(!pTimer->offNext);
+    Assert(!pTimer->offChild);
     Assert(pTimer->enmState == TMTIMERSTATE_ACTIVE);
 
     /*
@@ -2444,7 +2489,7 @@ static uint32_t tmGetFrequencyHint(PVM pVM)
             for (int i = 0; i < TMCLOCK_MAX; i++)
             {
                 PTMTIMERQUEUE pQueue = &pVM->tm.s.CTX_SUFF(paTimerQueues)[i];
-                for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pCur = TMTIMER_GET_NEXT(pCur))
+                for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pCur = tmTimerHeapWalkNext(pCur))
                 {
                     uint32_t uHzHint = ASMAtomicUoReadU32(&pCur->uHzHint);
                     if (uHzHint > uMaxHzHint)
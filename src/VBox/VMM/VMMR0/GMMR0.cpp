@@ -161,7 +161,7 @@
 #include <VBox/err.h>
 #include <iprt/asm.h>
 #include <iprt/avl.h>
-#ifdef VBOX_STRICT
+#if defined(VBOX_STRICT) || defined(VBOX_WITH_PAGE_SHARING)
 # include <iprt/crc.h>
 #endif
 #include <iprt/list.h>
@@ -496,6 +496,11 @@ typedef struct GMM
     PAVLLU32NODECORE    pGlobalSharedModuleTree;
     /** Sharable modules (count of nodes in pGlobalSharedModuleTree). */
     uint32_t            cShareableModules;
+    /** The page deduplication hash table (GMM_DEDUP_HASH_ENTRIES entries).
+     * Each entry holds the CRC32 of a page in the high dword and the ID of
+     * the page in the low one.  Entries are hints only and are always
+     * verified before use.  Allocated by the first GMMR0DedupScanReq call. */
+    uint64_t           *pau64DedupHashTab;
 
     /** The chunk list.  For simplifying the cleanup process. */
     RTLISTANCHOR        ChunkList;
@@ -596,6 +601,14 @@ typedef GMMR0CHUNKMTXSTATE *PGMMR0CHUNKMTXSTATE;
 #define GMM_MAX_SHARED_PER_VM_MODULES   2048
 /** The maximum number of shared modules GMM is allowed to track. */
 #define GMM_MAX_SHARED_GLOBAL_MODULES   16834
+/** The number of entries in the page deduplication hash table (power of two).
+ * Each entry takes 8 bytes, so this amounts to 8 MB. */
+#define GMM_DEDUP_HASH_ENTRIES          _1M
+/** The max number of pages the deduplication scanner examines per GMM
+ * semaphore hold. */
+#define GMM_DEDUP_PAGES_PER_LOCK        256
+/** The max number of chunks a deduplication scan keeps temporarily mapped. */
+#define GMM_DEDUP_MAX_TMP_CHUNKS        8
 
 
 /**
@@ -627,6 +640,23 @@ typedef struct GMMFINDDUPPAGEINFO
     bool                    fFoundDuplicate;
 } GMMFINDDUPPAGEINFO;
 
+/**
+ * Scan context for GMMR0DedupScanReq and GMMR0DedupCheckPage.
+ */
+typedef struct GMMDEDUPCTX
+{
+    PGMM                    pGMM;
+    PGVM                    pGVM;
+    /** The number of hash hits with different page content. */
+    uint32_t                cMismatches;
+    /** The next apTmpChunks entry to use. */
+    uint32_t                iNextTmpChunk;
+    /** IDs of the chunks we've mapped temporarily into the calling process
+     * (NIL_GMM_CHUNKID if unused).  IDs rather than pointers because freeing
+     * a page may free the chunk. */
+    uint32_t                aidTmpChunks[GMM_DEDUP_MAX_TMP_CHUNKS];
+} GMMDEDUPCTX;
+
 
 /*******************************************************************************
 *   Global Variables                                                           *
@@ -856,6 +886,10 @@ GMMR0DECL(void) GMMR0Term(void)
     /* Free any chunks still hanging around. */
     RTAvlU32Destroy(&pGMM->pChunks, gmmR0TermDestroyChunk, pGMM);
 
+    /* The page deduplication hash table. */
+    RTMemFree(pGMM->pau64DedupHashTab);
+    pGMM->pau64DedupHashTab = NULL;
+
     /* Destroy the chunk locks. */
     for (unsigned iMtx = 0; iMtx < RT_ELEMENTS(pGMM->aChunkMtx); iMtx++)
     {
@@ -2952,6 +2986,67 @@ GMMR0DECL(int) GMMR0AllocatePagesReq(PVM pVM, VMCPUID idCpu, PGMMALLOCATEPAGESRE
 }
 
 
+/**
+ * Allocates a new chunk and hands out all its pages to the VM so it can be
+ * used as one large page.
+ *
+ * @returns VBox status code.  On success, the giant GMM lock will be held,
+ *          on failure it will not.
+ * @param   pGMM            Pointer to the GMM instance data.
+ * @param   pGVM            Pointer to the GVM.
+ * @param   pIdPage         Where to return the ID of the first page.
+ * @param   pHCPhys         Where to return the host physical address.
+ *
+ * @remarks The caller must not own the giant GMM mutex as the allocation
+ *          might take a long time.  The caller is responsible for checking
+ *          the VM account limits.
+ */
+static int gmmR0AllocateLargePageChunk(PGMM pGMM, PGVM pGVM, uint32_t *pIdPage, RTHCPHYS *pHCPhys)
+{
+    AssertCompile(GMM_CHUNK_SIZE == _2M);
+    const unsigned cPages = (GMM_CHUNK_SIZE >> PAGE_SHIFT);
+
+    RTR0MEMOBJ hMemObj;
+    int rc = RTR0MemObjAllocPhysEx(&hMemObj, GMM_CHUNK_SIZE, NIL_RTHCPHYS, GMM_CHUNK_SIZE);
+    if (RT_SUCCESS(rc))
+    {
+        PGMMCHUNKFREESET pSet = pGMM->fBoundMemoryMode ? &pGVM->gmm.s.Private : &pGMM->PrivateX;
+        PGMMCHUNK pChunk;
+        rc = gmmR0RegisterChunk(pGMM, pSet, hMemObj, pGVM->hSelf, GMM_CHUNK_FLAGS_LARGE_PAGE, &pChunk);
+        if (RT_SUCCESS(rc))
+        {
+            /*
+             * Allocate all the pages in the chunk.
+             */
+            /* Unlink the new chunk from the free list. */
+            gmmR0UnlinkChunk(pChunk);
+
+            /** @todo rewrite this to skip the looping. */
+            /* Allocate all pages. */
+            GMMPAGEDESC PageDesc;
+            gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
+
+            /* Return the first page as we'll use the whole chunk as one big page. */
+            *pIdPage = PageDesc.idPage;
+            *pHCPhys = PageDesc.HCPhysGCPhys;
+
+            for (unsigned i = 1; i < cPages; i++)
+                gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
+
+            /* Update accounting. */
+            pGVM->gmm.s.Stats.Allocated.cBasePages += cPages;
+            pGVM->gmm.s.Stats.cPrivatePages        += cPages;
+            pGMM->cAllocatedPages                  += cPages;
+
+            gmmR0LinkChunk(pChunk, pSet);
+            return VINF_SUCCESS;
+        }
+        RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
+    }
+    return rc;
+}
+
+
 /**
  * Allocate a large page to represent guest RAM
  *
@@ -3013,47 +3108,10 @@ GMMR0DECL(int)  GMMR0AllocateLargePage(PVM pVM, VMCPUID idCpu, uint32_t cbPage,
          * Note! We leave the giant GMM lock temporarily as the allocation might
          *       take a long time.  gmmR0RegisterChunk will retake it (ugly).
          */
-        AssertCompile(GMM_CHUNK_SIZE == _2M);
         gmmR0MutexRelease(pGMM);
-
-        RTR0MEMOBJ hMemObj;
-        rc = RTR0MemObjAllocPhysEx(&hMemObj, GMM_CHUNK_SIZE, NIL_RTHCPHYS, GMM_CHUNK_SIZE);
+        rc = gmmR0AllocateLargePageChunk(pGMM, pGVM, pIdPage, pHCPhys);
         if (RT_SUCCESS(rc))
-        {
-            PGMMCHUNKFREESET pSet = pGMM->fBoundMemoryMode ? &pGVM->gmm.s.Private : &pGMM->PrivateX;
-            PGMMCHUNK pChunk;
-            rc = gmmR0RegisterChunk(pGMM, pSet, hMemObj, pGVM->hSelf, GMM_CHUNK_FLAGS_LARGE_PAGE, &pChunk);
-            if (RT_SUCCESS(rc))
-            {
-                /*
-                 * Allocate all the pages in the chunk.
-                 */
-                /* Unlink the new chunk from the free list. */
-                gmmR0UnlinkChunk(pChunk);
-
-                /** @todo rewrite this to skip the looping. */
-                /* Allocate all pages. */
-                GMMPAGEDESC PageDesc;
-                gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
-
-                /* Return the first page as we'll use the whole chunk as one big page. */
-                *pIdPage = PageDesc.idPage;
-                *pHCPhys = PageDesc.HCPhysGCPhys;
-
-                for (unsigned i = 1; i < cPages; i++)
-                    gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
-
-                /* Update accounting. */
-                pGVM->gmm.s.Stats.Allocated.cBasePages += cPages;
-                pGVM->gmm.s.Stats.cPrivatePages        += cPages;
-                pGMM->cAllocatedPages                  += cPages;
-
-                gmmR0LinkChunk(pChunk, pSet);
-                gmmR0MutexRelease(pGMM);
-            }
-            else
-                RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
-        }
+            gmmR0MutexRelease(pGMM);
     }
     else
     {
@@ -3571,6 +3629,126 @@ GMMR0DECL(int) GMMR0FreePagesReq(PVM pVM, VMCPUID idCpu, PGMMFREEPAGESREQ pReq)
 }
 
 
+/**
+ * Replaces a fully populated 2 MB range of private pages with a large page.
+ *
+ * A new large page chunk is allocated and the pages described by the request
+ * are freed in one go, so the VM account does not change.  The caller is
+ * responsible for copying the page content over and updating the guest
+ * physical mappings.
+ *
+ * @returns VBox status code:
+ * @retval  VINF_SUCCESS on success.
+ * @retval  VERR_NOT_SUPPORTED in legacy allocation mode.
+ * @retval  VERR_GMM_NOT_PAGE_OWNER if one of the pages isn't a private page
+ *          owned by the VM.  The large page is not allocated then.
+ * @retval  VERR_INVALID_PARAMETER if a page is listed more than once.
+ *
+ * @param   pVM             Pointer to the VM.
+ * @param   idCpu           The VCPU id.
+ * @param   pReq            Pointer to the request packet.
+ * @thread  EMT.
+ */
+GMMR0DECL(int) GMMR0PromoteLargePageReq(PVM pVM, VMCPUID idCpu, PGMMPROMOTELARGEPAGEREQ pReq)
+{
+    /*
+     * Validate input and get the basics.
+     */
+    AssertPtrReturn(pVM, VERR_INVALID_POINTER);
+    AssertPtrReturn(pReq, VERR_INVALID_POINTER);
+    AssertMsgReturn(pReq->Hdr.cbReq == sizeof(GMMPROMOTELARGEPAGEREQ),
+                    ("%#x != %#x\n", pReq->Hdr.cbReq, sizeof(GMMPROMOTELARGEPAGEREQ)),
+                    VERR_INVALID_PARAMETER);
+    LogFlow(("GMMR0PromoteLargePageReq: pVM=%p idPage[0]=%#x\n", pVM, pReq->aPages[0].idPage));
+
+    PGMM pGMM;
+    GMM_GET_VALID_INSTANCE(pGMM, VERR_GMM_INSTANCE);
+    PGVM pGVM;
+    int rc = GVMMR0ByVMAndEMT(pVM, idCpu, &pGVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Not supported in legacy mode where we allocate the memory in ring 3 and lock it in ring 0. */
+    if (pGMM->fLegacyAllocationMode)
+        return VERR_NOT_SUPPORTED;
+
+    const unsigned cPages = (GMM_CHUNK_SIZE >> PAGE_SHIFT);
+    AssertCompile(RT_ELEMENTS(pReq->aPages) == cPages);
+    for (unsigned iPage = 0; iPage < cPages; iPage++)
+    {
+        uint32_t const idPage = pReq->aPages[iPage].idPage;
+        AssertMsgReturn(idPage <= GMM_PAGEID_LAST, ("#%#x: %#x\n", iPage, idPage), VERR_INVALID_PARAMETER);
+
+        /* A page listed twice would make gmmR0FreePages fail half way through. */
+        for (unsigned iPrev = 0; iPrev < iPage; iPrev++)
+            AssertMsgReturn(pReq->aPages[iPrev].idPage != idPage,
+                            ("#%#x and #%#x: %#x\n", iPrev, iPage, idPage), VERR_INVALID_PARAMETER);
+    }
+
+    pReq->idLargePage     = NIL_GMM_PAGEID;
+    pReq->HCPhysLargePage = NIL_RTHCPHYS;
+
+    /*
+     * Allocate the large page first (without the giant lock), then check the
+     * small pages and free them while still holding the lock so the two steps
+     * appear atomic to everyone else.  No account limit check is needed since
+     * the result is a zero sum.
+     */
+    gmmR0MutexAcquire(pGMM);
+    if (!GMM_CHECK_SANITY_UPON_ENTERING(pGMM))
+    {
+        gmmR0MutexRelease(pGMM);
+        return VERR_GMM_IS_NOT_SANE;
+    }
+    gmmR0MutexRelease(pGMM);
+
+    uint32_t idLargePage;
+    RTHCPHYS HCPhysLargePage;
+    rc = gmmR0AllocateLargePageChunk(pGMM, pGVM, &idLargePage, &HCPhysLargePage);
+    if (RT_FAILURE(rc))
+    {
+        LogFlow(("GMMR0PromoteLargePageReq: returns %Rrc\n", rc));
+        return rc;
+    }
+
+    for (unsigned iPage = 0; iPage < cPages; iPage++)
+    {
+        PGMMPAGE pPage = gmmR0GetPage(pGMM, pReq->aPages[iPage].idPage);
+        if (RT_UNLIKELY(   !pPage
+                        || !GMM_PAGE_IS_PRIVATE(pPage)
+                        || pPage->Private.hGVM != pGVM->hSelf))
+        {
+            Log(("GMMR0PromoteLargePageReq: #%#x/%#x: not a private page of ours!\n", iPage, pReq->aPages[iPage].idPage));
+            rc = VERR_GMM_NOT_PAGE_OWNER;
+            break;
+        }
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        rc = gmmR0FreePages(pGMM, pGVM, cPages, &pReq->aPages[0], GMMACCOUNT_BASE);
+        AssertRC(rc); /* Can't fail after the checks above. */
+        pReq->idLargePage     = idLargePage;
+        pReq->HCPhysLargePage = HCPhysLargePage;
+    }
+    else
+    {
+        /* Back out the large page allocation again. */
+        PGMMCHUNK pChunk = gmmR0GetChunk(pGMM, idLargePage >> GMM_CHUNKID_SHIFT);
+        Assert(pChunk);
+        gmmR0FreeChunk(pGMM, NULL, pChunk, false /*fRelaxedSem*/);
+        pGVM->gmm.s.Stats.Allocated.cBasePages -= cPages;
+        pGVM->gmm.s.Stats.cPrivatePages        -= cPages;
+        pGMM->cAllocatedPages                  -= cPages;
+    }
+
+    GMM_CHECK_SANITY_UPON_LEAVING(pGMM);
+    gmmR0MutexRelease(pGMM);
+    LogFlow(("GMMR0PromoteLargePageReq: returns %Rrc\n", rc));
+    return rc;
+}
+
+
 /**
  * Report back on a memory ballooning request.
  *
@@ -5168,6 +5346,269 @@ GMMR0DECL(int) GMMR0CheckSharedModules(PVM pVM, PVMCPU pVCpu)
 #endif
 }
 
+#ifdef VBOX_WITH_PAGE_SHARING
+
+/**
+ * Gets the ring-3 address of a page for the page deduplication scanner.
+ *
+ * Chunks that aren't already mapped into the calling process are mapped
+ * temporarily and unmapped again by gmmR0DedupUnmapTmpChunks.  Only the two
+ * most recently returned addresses are guaranteed to stay valid.
+ *
+ * @returns Address of the page, NULL if not accessible.
+ * @param   pCtx        The scan context.
+ * @param   idPage      The page ID.
+ */
+static uint8_t *gmmR0DedupGetPageAddress(GMMDEDUPCTX *pCtx, uint32_t idPage)
+{
+    PGMMCHUNK pChunk = gmmR0GetChunk(pCtx->pGMM, idPage >> GMM_CHUNKID_SHIFT);
+    if (!pChunk)
+        return NULL;
+
+    uint8_t *pbChunk;
+    if (!gmmR0IsChunkMapped(pCtx->pGMM, pCtx->pGVM, pChunk, (PRTR3PTR)&pbChunk))
+    {
+        /* Recycle the oldest temporary mapping slot. */
+        uint32_t const iSlot = pCtx->iNextTmpChunk++ % RT_ELEMENTS(pCtx->aidTmpChunks);
+        if (pCtx->aidTmpChunks[iSlot] != NIL_GMM_CHUNKID)
+        {
+            PGMMCHUNK pOldChunk = gmmR0GetChunk(pCtx->pGMM, pCtx->aidTmpChunks[iSlot]);
+            if (pOldChunk)
+                gmmR0UnmapChunk(pCtx->pGMM, pCtx->pGVM, pOldChunk, false /*fRelaxedSem*/);
+            pCtx->aidTmpChunks[iSlot] = NIL_GMM_CHUNKID;
+        }
+
+        int rc = gmmR0MapChunk(pCtx->pGMM, pCtx->pGVM, pChunk, false /*fRelaxedSem*/, (PRTR3PTR)&pbChunk);
+        if (RT_FAILURE(rc))
+            return NULL;
+        pCtx->aidTmpChunks[iSlot] = pChunk->Core.Key;
+    }
+    return pbChunk + ((idPage & GMM_PAGEID_IDX_MASK) << PAGE_SHIFT);
+}
+
+
+/**
+ * Undoes the temporary chunk mappings made by gmmR0DedupGetPageAddress.
+ *
+ * @param   pCtx        The scan context.
+ */
+static void gmmR0DedupUnmapTmpChunks(GMMDEDUPCTX *pCtx)
+{
+    for (uint32_t i = 0; i < RT_ELEMENTS(pCtx->aidTmpChunks); i++)
+        if (pCtx->aidTmpChunks[i] != NIL_GMM_CHUNKID)
+        {
+            /* The chunk may have been freed (and unmapped) in the meantime. */
+            PGMMCHUNK pChunk = gmmR0GetChunk(pCtx->pGMM, pCtx->aidTmpChunks[i]);
+            if (pChunk)
+                gmmR0UnmapChunk(pCtx->pGMM, pCtx->pGVM, pChunk, false /*fRelaxedSem*/);
+            pCtx->aidTmpChunks[i] = NIL_GMM_CHUNKID;
+        }
+}
+
+#endif /* VBOX_WITH_PAGE_SHARING */
+
+/**
+ * Checks a private page of the calling VM against the content hash table of
+ * the page deduplication scanner.
+ *
+ * Performs the following tasks:
+ *  - If an identical shared page is known, then it frees the VM page and
+ *    returns the shared page in pPageDesc.
+ *  - If an identical private page is known (owned by this or any other VM),
+ *    then it converts the VM page into a shared page and returns it in
+ *    pPageDesc.  The other page is merged into it when its VM scans it.
+ *  - Otherwise it records the page in the hash table and sets
+ *    pPageDesc->idPage to NIL_GMM_PAGEID to indicate that nothing changed.
+ *
+ * Unlike GMMR0SharedModuleCheckPage this doesn't need any guest cooperation;
+ * the page content is the only thing that matters.
+ *
+ * @remarks Only to be called by PGMR0DedupScan on behalf of GMMR0DedupScanReq,
+ *          i.e. with the GMM semaphore held.
+ *
+ * @returns VBox status code.
+ * @param   pGVM                Pointer to the GVM instance data.
+ * @param   pPageDesc           Page descriptor (in/out).
+ */
+GMMR0DECL(int) GMMR0DedupCheckPage(PGVM pGVM, PGMMSHAREDPAGEDESC pPageDesc)
+{
+#ifdef VBOX_WITH_PAGE_SHARING
+    PGMM pGMM;
+    GMM_GET_VALID_INSTANCE(pGMM, VERR_GMM_INSTANCE);
+    GMMDEDUPCTX *pCtx = pGVM->gmm.s.pDedupCtx;
+    AssertPtrReturn(pCtx, VERR_WRONG_ORDER);
+
+    uint32_t const idPage = pPageDesc->idPage;
+    pPageDesc->idPage = NIL_GMM_PAGEID;
+    pPageDesc->u32StrictChecksum = 0;
+
+    PGMMPAGE pPage = gmmR0GetPage(pGMM, idPage);
+    AssertMsgReturn(pPage, ("idPage=%#x (GCPhys=%RGp HCPhys=%RHp)\n", idPage, pPageDesc->GCPhys, pPageDesc->HCPhys),
+                    VERR_PGM_PHYS_INVALID_PAGE_ID);
+    AssertMsgReturn(GMM_PAGE_IS_PRIVATE(pPage) && pPage->Private.hGVM == pGVM->hSelf,
+                    ("idPage=%#x (GCPhys=%RGp) u2State=%d\n", idPage, pPageDesc->GCPhys, pPage->Common.u2State),
+                    VERR_GMM_NOT_PAGE_OWNER);
+
+    uint8_t const *pbLocalPage = gmmR0DedupGetPageAddress(pCtx, idPage);
+    if (!pbLocalPage)
+        return VINF_SUCCESS;
+    uint32_t const uHash = RTCrc32(pbLocalPage, PAGE_SIZE);
+
+    uint64_t      *pu64Entry   = &pGMM->pau64DedupHashTab[uHash & (GMM_DEDUP_HASH_ENTRIES - 1)];
+    uint64_t const u64Entry    = *pu64Entry;
+    uint32_t const idCandidate = RT_LO_U32(u64Entry);
+    if (   idCandidate != NIL_GMM_PAGEID
+        && idCandidate != idPage
+        && RT_HI_U32(u64Entry) == uHash)
+    {
+        PGMMPAGE pCandidate = gmmR0GetPage(pGMM, idCandidate);
+        if (pCandidate && !GMM_PAGE_IS_FREE(pCandidate))
+        {
+            uint8_t const *pbCandidate = gmmR0DedupGetPageAddress(pCtx, idCandidate);
+            /** @todo write ASMMemComparePage. */
+            if (pbCandidate && !memcmp(pbCandidate, pbLocalPage, PAGE_SIZE))
+            {
+                if (GMM_PAGE_IS_SHARED(pCandidate))
+                {
+                    Log(("GMMR0DedupCheckPage: GCPhys=%RGp id %#x -> shared id %#x\n", pPageDesc->GCPhys, idPage, idCandidate));
+                    GMMFREEPAGEDESC FreeDesc;
+                    FreeDesc.idPage = idPage;
+                    int rc = gmmR0FreePages(pGMM, pGVM, 1, &FreeDesc, GMMACCOUNT_BASE);
+                    AssertRCReturn(rc, rc);
+
+                    gmmR0UseSharedPage(pGMM, pGVM, pCandidate);
+
+                    pPageDesc->HCPhys = ((uint64_t)pCandidate->Shared.pfn) << PAGE_SHIFT;
+                    pPageDesc->idPage = idCandidate;
+                    return VINF_SUCCESS;
+                }
+
+                /* Identical private page; ours becomes the shared copy the
+                   other one(s) will be merged into. */
+                Log(("GMMR0DedupCheckPage: GCPhys=%RGp id %#x -> new shared page (dup of %#x)\n",
+                     pPageDesc->GCPhys, idPage, idCandidate));
+                gmmR0ConvertToSharedPage(pGMM, pGVM, pPageDesc->HCPhys, idPage, pPage, pPageDesc);
+                *pu64Entry = RT_MAKE_U64(idPage, uHash);
+                pPageDesc->idPage = idPage;
+                return VINF_SUCCESS;
+            }
+
+            /* Hash collision.  Don't evict a shared page in favour of a
+               private one since it is the more valuable entry. */
+            pCtx->cMismatches++;
+            if (GMM_PAGE_IS_SHARED(pCandidate))
+                return VINF_SUCCESS;
+        }
+    }
+
+    *pu64Entry = RT_MAKE_U64(idPage, uHash);
+    return VINF_SUCCESS;
+#else
+    NOREF(pGVM); NOREF(pPageDesc);
+    return VERR_NOT_IMPLEMENTED;
+#endif
+}
+
+
+/**
+ * Scans a range of the VM's RAM for pages with content identical to pages
+ * of this or other VMs and merges them (page deduplication).
+ *
+ * This is driven by a ring-3 timer at a configurable rate and is independent
+ * of the guest additions' shared module registrations.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED in bound memory mode.
+ * @param   pVM                 Pointer to the VM.
+ * @param   idCpu               The VCPU id of the calling EMT.
+ * @param   pReq                Pointer to the request packet.
+ * @thread  EMT(idCpu), the caller owns the PGM lock.
+ */
+GMMR0DECL(int) GMMR0DedupScanReq(PVM pVM, VMCPUID idCpu, PGMMDEDUPSCANREQ pReq)
+{
+#ifdef VBOX_WITH_PAGE_SHARING
+    /*
+     * Validate input and get the basics.
+     */
+    AssertPtrReturn(pVM, VERR_INVALID_POINTER);
+    AssertPtrReturn(pReq, VERR_INVALID_POINTER);
+    AssertMsgReturn(pReq->Hdr.cbReq == sizeof(*pReq), ("%#x != %#x\n", pReq->Hdr.cbReq, sizeof(*pReq)), VERR_INVALID_PARAMETER);
+    AssertMsgReturn(pReq->cPagesToScan <= GMM_DEDUP_MAX_PAGES_PER_SCAN, ("%#x\n", pReq->cPagesToScan), VERR_INVALID_PARAMETER);
+
+    PGMM pGMM;
+    GMM_GET_VALID_INSTANCE(pGMM, VERR_GMM_INSTANCE);
+    PGVM pGVM;
+    int rc = GVMMR0ByVMAndEMT(pVM, idCpu, &pGVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    pReq->cScannedPages   = 0;
+    pReq->cMergedPages    = 0;
+    pReq->cNewSharedPages = 0;
+    pReq->cMismatches     = 0;
+
+    /* Pages can't be shared between VMs when bound to them. */
+    if (pGMM->fBoundMemoryMode)
+        return VERR_NOT_SUPPORTED;
+
+    /*
+     * Do the scan in small batches, dropping the semaphore in between so the
+     * other VMs don't have to wait for all the hashing and comparing.  The
+     * temporary chunk mappings don't survive a batch since the chunks may be
+     * freed while we don't own the semaphore.
+     */
+    uint32_t const cPagesToScan = pReq->cPagesToScan;
+    uint32_t       cLeft        = cPagesToScan;
+    do
+    {
+        gmmR0MutexAcquire(pGMM);
+        if (GMM_CHECK_SANITY_UPON_ENTERING(pGMM))
+        {
+            if (!pGMM->pau64DedupHashTab)
+                pGMM->pau64DedupHashTab = (uint64_t *)RTMemAllocZ(GMM_DEDUP_HASH_ENTRIES * sizeof(pGMM->pau64DedupHashTab[0]));
+            if (pGMM->pau64DedupHashTab)
+            {
+                GMMDEDUPCTX Ctx;
+                RT_ZERO(Ctx);
+                Ctx.pGMM = pGMM;
+                Ctx.pGVM = pGVM;
+                Assert(!pGVM->gmm.s.pDedupCtx);
+                pGVM->gmm.s.pDedupCtx = &Ctx;
+
+                uint32_t const cScannedBefore = pReq->cScannedPages;
+                pReq->cPagesToScan = RT_MIN(cLeft, GMM_DEDUP_PAGES_PER_LOCK);
+                rc = PGMR0DedupScan(pVM, pGVM, idCpu, pReq);
+
+                /* Stop when wrapping around, leaving the rest for the next round. */
+                if (!pReq->GCPhysCursor || pReq->cScannedPages == cScannedBefore)
+                    cLeft = 0;
+                else
+                    cLeft -= RT_MIN(cLeft, pReq->cScannedPages - cScannedBefore);
+
+                pGVM->gmm.s.pDedupCtx = NULL;
+                gmmR0DedupUnmapTmpChunks(&Ctx);
+                pReq->cMismatches += Ctx.cMismatches;
+            }
+            else
+                rc = VERR_NO_MEMORY;
+
+            GMM_CHECK_SANITY_UPON_LEAVING(pGMM);
+        }
+        else
+            rc = VERR_GMM_IS_NOT_SANE;
+
+        gmmR0MutexRelease(pGMM);
+    } while (cLeft > 0 && RT_SUCCESS(rc));
+
+    pReq->cPagesToScan = cPagesToScan;
+    return rc;
+#else
+    NOREF(pVM); NOREF(idCpu); NOREF(pReq);
+    return VERR_NOT_IMPLEMENTED;
+#endif
+}
+
+
 #if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
 
 /**
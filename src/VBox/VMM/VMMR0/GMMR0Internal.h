@@ -81,6 +81,9 @@ typedef struct GMMPERVM
     PAVLGCPTRNODECORE   pSharedModuleTree;
     /** Hints at the last chunk we allocated some memory from. */
     uint32_t            idLastChunkHint;
+    /** The context of the page deduplication scan in progress, NULL if none.
+     * Only accessed by the EMT doing the scan while owning the GMM semaphore. */
+    struct GMMDEDUPCTX *pDedupCtx;
 } GMMPERVM;
 /** Pointer to the per-VM GMM data. */
 typedef GMMPERVM *PGMMPERVM;
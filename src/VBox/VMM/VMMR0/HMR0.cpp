@@ -1494,6 +1494,20 @@ VMMR0_INT_DECL(void) HMR0ThreadCtxCallback(RTTHREADCTXEVENT enmEvent, void *pvUs
 }
 
 
+/**
+ * Publishes the pending exit profiler record.
+ *
+ * @param   pBuf        The exit profiler ring buffer of the calling EMT.
+ */
+static void hmR0ExitProfCommit(PHMEXITPROFBUF pBuf)
+{
+    uint32_t const idx = pBuf->idxWrite;
+    pBuf->aRecs[idx & (HM_EXITPROF_RECS - 1)] = pBuf->Pending;
+    ASMAtomicWriteU32(&pBuf->idxWrite, idx + 1);
+    pBuf->fPending = false;
+}
+
+
 /**
  * Runs guest code in a hardware accelerated VM.
  *
@@ -1523,14 +1537,64 @@ VMMR0_INT_DECL(int) HMR0RunGuestCode(PVM pVM, PVMCPU pVCpu)
     PGMRZDynMapStartAutoSet(pVCpu);
 #endif
 
+    /*
+     * If the exit profiler is waiting for ring-3 to finish with an exit,
+     * we now know how long it took.
+     */
+    PHMEXITPROFBUF pExitProf = pVCpu->hm.s.pExitProfR0;
+    if (RT_UNLIKELY(pExitProf) && pExitProf->fPending)
+    {
+        pExitProf->Pending.cTicksRing3 = (uint32_t)RT_MIN(ASMReadTSC() - pExitProf->uTscLeave, UINT32_MAX);
+        pExitProf->Pending.fFlags     |= HM_EXITPROF_F_RING3;
+        hmR0ExitProfCommit(pExitProf);
+    }
+
     int rc = g_HvmR0.pfnRunGuestCode(pVM, pVCpu, CPUMQueryGuestCtxPtr(pVCpu));
 
+    if (RT_UNLIKELY(pExitProf) && pExitProf->fPending)
+        pExitProf->uTscLeave = ASMReadTSC();
+
 #ifdef VBOX_WITH_2X_4GB_ADDR_SPACE
     PGMRZDynMapReleaseAutoSet(pVCpu);
 #endif
     return rc;
 }
 
+
+/**
+ * Records a sampled VM-exit in the exit profiler ring buffer.
+ *
+ * Exits that are completed in ring-0 go straight into the ring buffer, the
+ * others are held back until HMR0RunGuestCode is re-entered so the time spent
+ * in ring-3 can be added.
+ *
+ * @param   pVCpu           Pointer to the VMCPU.
+ * @param   uExitReason     The VMX exit reason or SVM exit code.
+ * @param   uRip            The guest RIP of the exiting instruction.
+ * @param   uTscStart       The TSC before the exit handler was called.
+ * @param   rc              The exit handler status.
+ */
+VMMR0DECL(void) HMR0ExitProfRecord(PVMCPU pVCpu, uint32_t uExitReason, uint64_t uRip, uint64_t uTscStart, int rc)
+{
+    PHMEXITPROFBUF pBuf = pVCpu->hm.s.pExitProfR0;
+    AssertPtrReturnVoid(pBuf);
+    Assert(!pBuf->fPending);
+
+    pBuf->Pending.uRip        = uRip;
+    pBuf->Pending.uAddr       = pBuf->uCurAddr;
+    pBuf->Pending.cTicks      = (uint32_t)RT_MIN(ASMReadTSC() - uTscStart, UINT32_MAX);
+    pBuf->Pending.cTicksRing3 = 0;
+    pBuf->Pending.uExitReason = (uint16_t)uExitReason;
+    pBuf->Pending.fFlags      = pBuf->fCurFlags;
+
+    /* Halting in ring-3 is idle time, not work done on behalf of the exit. */
+    if (   rc == VINF_SUCCESS
+        || rc == VINF_EM_HALT)
+        hmR0ExitProfCommit(pBuf);
+    else
+        pBuf->fPending = true;
+}
+
 #if HC_ARCH_BITS == 32 && defined(VBOX_ENABLE_64_BITS_GUESTS) && !defined(VBOX_WITH_HYBRID_32BIT_KERNEL)
 
 /**
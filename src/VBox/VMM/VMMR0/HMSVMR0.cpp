@@ -3140,7 +3140,11 @@ VMMR0DECL(int) SVMR0RunGuestCode(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
         /* Handle the #VMEXIT. */
         HMSVM_EXITCODE_STAM_COUNTER_INC(SvmTransient.u64ExitCode);
         STAM_PROFILE_ADV_STOP_START(&pVCpu->hm.s.StatExit1, &pVCpu->hm.s.StatExit2, x);
+        uint64_t const uExitProfTsc = HMEXITPROF_SHOULD_SAMPLE(pVCpu) ? ASMReadTSC() : 0;
+        uint64_t const uExitProfRip = pCtx->rip;
         rc = hmR0SvmHandleExit(pVCpu, pCtx, &SvmTransient);
+        if (uExitProfTsc)
+            HMR0ExitProfRecord(pVCpu, (uint32_t)SvmTransient.u64ExitCode, uExitProfRip, uExitProfTsc, rc);
         STAM_PROFILE_ADV_STOP(&pVCpu->hm.s.StatExit2, x);
         if (rc != VINF_SUCCESS)
             break;
@@ -4378,6 +4382,7 @@ HMSVM_EXIT_DECL hmR0SvmExitIOInstr(PVMCPU pVCpu, PCPUMCTX pCtx, PSVMTRANSIENT pS
     /* Refer AMD spec. 15.10.2 "IN and OUT Behaviour" and Figure 15-2. "EXITINFO1 for IOIO Intercept" for the format. */
     SVMIOIOEXIT IoExitInfo;
     IoExitInfo.u       = (uint32_t)pVmcb->ctrl.u64ExitInfo1;
+    HMEXITPROF_NOTE_ACCESS(pVCpu, HM_EXITPROF_F_IOPORT, IoExitInfo.n.u16Port);
     uint32_t uIOWidth  = (IoExitInfo.u >> 4) & 0x7;
     uint32_t cbValue   = s_aIOSize[uIOWidth];
     uint32_t uAndVal   = s_aIOOpAnd[uIOWidth];
@@ -4530,6 +4535,7 @@ HMSVM_EXIT_DECL hmR0SvmExitNestedPF(PVMCPU pVCpu, PCPUMCTX pCtx, PSVMTRANSIENT p
     PSVMVMCB pVmcb           = (PSVMVMCB)pVCpu->hm.s.svm.pvVmcb;
     uint32_t u32ErrCode      = pVmcb->ctrl.u64ExitInfo1;
     RTGCPHYS GCPhysFaultAddr = pVmcb->ctrl.u64ExitInfo2;
+    HMEXITPROF_NOTE_ACCESS(pVCpu, HM_EXITPROF_F_MMIO, GCPhysFaultAddr);
 
     Log4(("#NPF at CS:RIP=%04x:%#RX64 faultaddr=%RGp errcode=%#x \n", pCtx->cs.Sel, pCtx->rip, GCPhysFaultAddr, u32ErrCode));
 
@@ -7878,11 +7878,22 @@ static int hmR0VmxRunGuestCodeNormal(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
         STAM_COUNTER_INC(&pVCpu->hm.s.paStatExitReasonR0[VmxTransient.uExitReason & MASK_EXITREASON_STAT]);
         STAM_PROFILE_ADV_STOP_START(&pVCpu->hm.s.StatExit1, &pVCpu->hm.s.StatExit2, x);
         HMVMX_START_EXIT_DISPATCH_PROF();
+        uint64_t uExitProfTsc = 0;
+        uint64_t uExitProfRip = 0;
+        if (HMEXITPROF_SHOULD_SAMPLE(pVCpu))
+        {
+            int rc2 = hmR0VmxSaveGuestRip(pVCpu, pCtx);
+            AssertRC(rc2);
+            uExitProfRip = pCtx->rip;
+            uExitProfTsc = ASMReadTSC();
+        }
 #ifdef HMVMX_USE_FUNCTION_TABLE
         rc = g_apfnVMExitHandlers[VmxTransient.uExitReason](pVCpu, pCtx, &VmxTransient);
 #else
         rc = hmR0VmxHandleExit(pVCpu, pCtx, &VmxTransient, VmxTransient.uExitReason);
 #endif
+        if (uExitProfTsc)
+            HMR0ExitProfRecord(pVCpu, VmxTransient.uExitReason, uExitProfRip, uExitProfTsc, rc);
         STAM_PROFILE_ADV_STOP(&pVCpu->hm.s.StatExit2, x);
         if (rc != VINF_SUCCESS)
             break;
@@ -7953,11 +7964,22 @@ static int hmR0VmxRunGuestCodeStep(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
         STAM_COUNTER_INC(&pVCpu->hm.s.paStatExitReasonR0[VmxTransient.uExitReason & MASK_EXITREASON_STAT]);
         STAM_PROFILE_ADV_STOP_START(&pVCpu->hm.s.StatExit1, &pVCpu->hm.s.StatExit2, x);
         HMVMX_START_EXIT_DISPATCH_PROF();
+        uint64_t uExitProfTsc = 0;
+        uint64_t uExitProfRip = 0;
+        if (HMEXITPROF_SHOULD_SAMPLE(pVCpu))
+        {
+            int rc2 = hmR0VmxSaveGuestRip(pVCpu, pCtx);
+            AssertRC(rc2);
+            uExitProfRip = pCtx->rip;
+            uExitProfTsc = ASMReadTSC();
+        }
 #ifdef HMVMX_USE_FUNCTION_TABLE
         rc = g_apfnVMExitHandlers[VmxTransient.uExitReason](pVCpu, pCtx, &VmxTransient);
 #else
         rc = hmR0VmxHandleExit(pVCpu, pCtx, &VmxTransient, VmxTransient.uExitReason);
 #endif
+        if (uExitProfTsc)
+            HMR0ExitProfRecord(pVCpu, VmxTransient.uExitReason, uExitProfRip, uExitProfTsc, rc);
         STAM_PROFILE_ADV_STOP(&pVCpu->hm.s.StatExit2, x);
         if (rc != VINF_SUCCESS)
             break;
@@ -9770,6 +9792,7 @@ HMVMX_EXIT_DECL hmR0VmxExitIoInstr(PVMCPU pVCpu, PCPUMCTX pMixedCtx, PVMXTRANSIE
 
     /* Refer Intel spec. 27-5. "Exit Qualifications for I/O Instructions" for the format. */
     uint32_t uIOPort   = VMX_EXIT_QUALIFICATION_IO_PORT(pVmxTransient->uExitQualification);
+    HMEXITPROF_NOTE_ACCESS(pVCpu, HM_EXITPROF_F_IOPORT, uIOPort);
     uint8_t  uIOWidth  = VMX_EXIT_QUALIFICATION_IO_WIDTH(pVmxTransient->uExitQualification);
     bool     fIOWrite  = (   VMX_EXIT_QUALIFICATION_IO_DIRECTION(pVmxTransient->uExitQualification)
                           == VMX_EXIT_QUALIFICATION_IO_DIRECTION_OUT);
@@ -10052,6 +10075,7 @@ HMVMX_EXIT_DECL hmR0VmxExitApicAccess(PVMCPU pVCpu, PCPUMCTX pMixedCtx, PVMXTRAN
             RTGCPHYS GCPhys = pMixedCtx->msrApicBase;   /* Always up-to-date, msrApicBase is not part of the VMCS. */
             GCPhys &= PAGE_BASE_GC_MASK;
             GCPhys += VMX_EXIT_QUALIFICATION_APIC_ACCESS_OFFSET(pVmxTransient->uExitQualification);
+            HMEXITPROF_NOTE_ACCESS(pVCpu, HM_EXITPROF_F_MMIO, GCPhys);
             PVM pVM = pVCpu->CTX_SUFF(pVM);
             Log4(("ApicAccess uAccessType=%#x GCPhys=%#RGv Off=%#x\n", uAccessType, GCPhys,
                  VMX_EXIT_QUALIFICATION_APIC_ACCESS_OFFSET(pVmxTransient->uExitQualification)));
@@ -10198,6 +10222,7 @@ HMVMX_EXIT_DECL hmR0VmxExitEptMisconfig(PVMCPU pVCpu, PCPUMCTX pMixedCtx, PVMXTR
 
     RTGCPHYS GCPhys = 0;
     rc = VMXReadVmcs64(VMX_VMCS64_EXIT_GUEST_PHYS_ADDR_FULL, &GCPhys);
+    HMEXITPROF_NOTE_ACCESS(pVCpu, HM_EXITPROF_F_MMIO, GCPhys);
 
 #if 0
     rc |= hmR0VmxSaveGuestState(pVCpu, pMixedCtx);     /** @todo Can we do better?  */
@@ -10254,6 +10279,7 @@ HMVMX_EXIT_DECL hmR0VmxExitEptViolation(PVMCPU pVCpu, PCPUMCTX pMixedCtx, PVMXTR
     RTGCPHYS GCPhys = 0;
     rc  = VMXReadVmcs64(VMX_VMCS64_EXIT_GUEST_PHYS_ADDR_FULL, &GCPhys);
     rc |= hmR0VmxReadExitQualificationVmcs(pVCpu, pVmxTransient);
+    HMEXITPROF_NOTE_ACCESS(pVCpu, HM_EXITPROF_F_MMIO, GCPhys);
 #if 0
     rc |= hmR0VmxSaveGuestState(pVCpu, pMixedCtx);     /** @todo Can we do better?  */
 #else
@@ -31,6 +31,55 @@
 
 
 #ifdef VBOX_WITH_PAGE_SHARING
+/**
+ * Updates a PGM page after GMM turned it into a shared page or replaced it by
+ * an existing shared page.
+ *
+ * @param   pVM                 Pointer to the VM.
+ * @param   pVCpu               Pointer to the VMCPU of the calling EMT.
+ * @param   pPage               The PGM page (ALLOCATED).
+ * @param   pPageDesc           The page descriptor returned by GMM.
+ * @param   pfFlushTLBs         Set if the TLBs of all VCPUs must be flushed.
+ */
+static void pgmR0SharedPageUpdate(PVM pVM, PVMCPU pVCpu, PPGMPAGE pPage, PGMMSHAREDPAGEDESC pPageDesc, bool *pfFlushTLBs)
+{
+    Assert(PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_ALLOCATED);
+
+    /* Page was either replaced by an existing shared version of it or
+       converted into a read-only shared page, so, clear all references. */
+    bool fFlush = false;
+    int rc = pgmPoolTrackUpdateGCPhys(pVM, pPageDesc->GCPhys, pPage, true /* clear the entries */, &fFlush);
+    Assert(   rc == VINF_SUCCESS
+           || (   VMCPU_FF_IS_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3)
+               && (pVCpu->pgm.s.fSyncFlags & PGM_SYNC_CLEAR_PGM_POOL)));
+    if (rc == VINF_SUCCESS)
+        *pfFlushTLBs |= fFlush;
+    NOREF(pVCpu);
+
+    if (pPageDesc->HCPhys != PGM_PAGE_GET_HCPHYS(pPage))
+    {
+        /* Update the physical address and page id now. */
+        PGM_PAGE_SET_HCPHYS(pVM, pPage, pPageDesc->HCPhys);
+        PGM_PAGE_SET_PAGEID(pVM, pPage, pPageDesc->idPage);
+
+        /* Invalidate page map TLB entry for this page too. */
+        pgmPhysInvalidatePageMapTLBEntry(pVM, pPageDesc->GCPhys);
+        pVM->pgm.s.cReusedSharedPages++;
+    }
+    /* else: nothing changed (== this page is now a shared
+       page), so no need to flush anything. */
+
+    pVM->pgm.s.cSharedPages++;
+    pVM->pgm.s.cPrivatePages--;
+    PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_SHARED);
+
+# ifdef VBOX_STRICT /* check sum hack */
+    pPage->s.u2Unused0 = pPageDesc->u32StrictChecksum        & 3;
+    pPage->s.u2Unused1 = (pPageDesc->u32StrictChecksum >> 8) & 3;
+# endif
+}
+
+
 /**
  * Check a registered module for shared page changes.
  *
@@ -96,44 +145,10 @@ VMMR0DECL(int) PGMR0SharedModuleCheck(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMSHA
                      */
                     if (PageDesc.idPage != NIL_GMM_PAGEID)
                     {
-                        Assert(PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_ALLOCATED);
-
                         Log(("PGMR0SharedModuleCheck: shared page gst virt=%RGv phys=%RGp host %RHp->%RHp\n",
                              GCPtrPage, PageDesc.GCPhys, PGM_PAGE_GET_HCPHYS(pPage), PageDesc.HCPhys));
-
-                        /* Page was either replaced by an existing shared
-                           version of it or converted into a read-only shared
-                           page, so, clear all references. */
-                        bool fFlush = false;
-                        rc = pgmPoolTrackUpdateGCPhys(pVM, PageDesc.GCPhys, pPage, true /* clear the entries */, &fFlush);
-                        Assert(   rc == VINF_SUCCESS
-                               || (   VMCPU_FF_IS_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3)
-                                   && (pVCpu->pgm.s.fSyncFlags & PGM_SYNC_CLEAR_PGM_POOL)));
-                        if (rc == VINF_SUCCESS)
-                            fFlushTLBs |= fFlush;
+                        pgmR0SharedPageUpdate(pVM, pVCpu, pPage, &PageDesc, &fFlushTLBs);
                         fFlushRemTLBs = true;
-
-                        if (PageDesc.HCPhys != PGM_PAGE_GET_HCPHYS(pPage))
-                        {
-                            /* Update the physical address and page id now. */
-                            PGM_PAGE_SET_HCPHYS(pVM, pPage, PageDesc.HCPhys);
-                            PGM_PAGE_SET_PAGEID(pVM, pPage, PageDesc.idPage);
-
-                            /* Invalidate page map TLB entry for this page too. */
-                            pgmPhysInvalidatePageMapTLBEntry(pVM, PageDesc.GCPhys);
-                            pVM->pgm.s.cReusedSharedPages++;
-                        }
-                        /* else: nothing changed (== this page is now a shared
-                           page), so no need to flush anything. */
-
-                        pVM->pgm.s.cSharedPages++;
-                        pVM->pgm.s.cPrivatePages--;
-                        PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_SHARED);
-
-# ifdef VBOX_STRICT /* check sum hack */
-                        pPage->s.u2Unused0 = PageDesc.u32StrictChecksum        & 3;
-                        pPage->s.u2Unused1 = (PageDesc.u32StrictChecksum >> 8) & 3;
-# endif
                     }
                 }
             }
@@ -165,5 +180,109 @@ VMMR0DECL(int) PGMR0SharedModuleCheck(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMSHA
 
     return rc;
 }
+
+/**
+ * Scans a slice of guest RAM for pages that can be deduplicated.
+ *
+ * Every allocated, unlocked and unmonitored RAM page in the slice is handed
+ * to GMMR0DedupCheckPage which merges it with an identical page of this or
+ * another VM if there is one.
+ *
+ * The PGM lock shall be taken prior to calling this method and the GMM
+ * semaphore is owned by the caller (GMMR0DedupScanReq).
+ *
+ * @returns VBox status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pGVM                Pointer to the GVM instance data.
+ * @param   idCpu               The ID of the calling virtual CPU.
+ * @param   pReq                The scan request.  GCPhysCursor is advanced
+ *                              (and reset to 0 at the end of RAM), the page
+ *                              counters are updated.
+ */
+VMMR0DECL(int) PGMR0DedupScan(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMDEDUPSCANREQ pReq)
+{
+    PVMCPU              pVCpu         = &pVM->aCpus[idCpu];
+    int                 rc            = VINF_SUCCESS;
+    bool                fFlushTLBs    = false;
+    bool                fFlushRemTLBs = false;
+    uint32_t            cLeft         = pReq->cPagesToScan;
+    RTGCPHYS            GCPhysCursor  = pReq->GCPhysCursor;
+    GMMSHAREDPAGEDESC   PageDesc;
+
+    PGM_LOCK_ASSERT_OWNER(pVM);     /* Taken by pgmR3PageDedupRendezvous. */
+
+    /*
+     * Find the RAM range containing the cursor, or the first one following it.
+     */
+    PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR0;
+    while (pRam && GCPhysCursor > pRam->GCPhysLast)
+        pRam = pRam->pNextR0;
+
+    while (pRam && cLeft > 0)
+    {
+        if (GCPhysCursor < pRam->GCPhys)
+            GCPhysCursor = pRam->GCPhys;
+        uint32_t const cPages = (uint32_t)(pRam->cb >> PAGE_SHIFT);
+        uint32_t       iPage  = (uint32_t)((GCPhysCursor - pRam->GCPhys) >> PAGE_SHIFT);
+        for (; iPage < cPages && cLeft > 0; iPage++, cLeft--)
+        {
+            PPGMPAGE pPage = &pRam->aPages[iPage];
+            pReq->cScannedPages++;
+
+            /* Large pages would have to be broken up first; leave them alone. */
+            if (   PGM_PAGE_GET_TYPE(pPage)        != PGMPAGETYPE_RAM
+                || PGM_PAGE_GET_STATE(pPage)       != PGM_PAGE_STATE_ALLOCATED
+                || PGM_PAGE_GET_READ_LOCKS(pPage)  != 0
+                || PGM_PAGE_GET_WRITE_LOCKS(pPage) != 0
+                || PGM_PAGE_HAS_ANY_HANDLERS(pPage)
+                || PGM_PAGE_GET_PDE_TYPE(pPage)    == PGM_PAGE_PDE_TYPE_PDE)
+                continue;
+
+            PageDesc.idPage = PGM_PAGE_GET_PAGEID(pPage);
+            PageDesc.HCPhys = PGM_PAGE_GET_HCPHYS(pPage);
+            PageDesc.GCPhys = pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+
+            rc = GMMR0DedupCheckPage(pGVM, &PageDesc);
+            if (RT_FAILURE(rc))
+                break;
+
+            if (PageDesc.idPage != NIL_GMM_PAGEID)
+            {
+                Log(("PGMR0DedupScan: shared page phys=%RGp host %RHp->%RHp\n",
+                     PageDesc.GCPhys, PGM_PAGE_GET_HCPHYS(pPage), PageDesc.HCPhys));
+                if (PageDesc.HCPhys != PGM_PAGE_GET_HCPHYS(pPage))
+                    pReq->cMergedPages++;
+                else
+                    pReq->cNewSharedPages++;
+                pgmR0SharedPageUpdate(pVM, pVCpu, pPage, &PageDesc, &fFlushTLBs);
+                fFlushRemTLBs = true;
+            }
+        }
+        if (RT_FAILURE(rc))
+            break;
+
+        /* Advance the cursor. */
+        if (iPage < cPages)
+            GCPhysCursor = pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+        else
+        {
+            pRam = pRam->pNextR0;
+            GCPhysCursor = pRam ? pRam->GCPhys : 0;
+        }
+    }
+    pReq->GCPhysCursor = pRam ? GCPhysCursor : 0;
+
+    /*
+     * Do TLB flushing if necessary.
+     */
+    if (fFlushTLBs)
+        PGM_INVL_ALL_VCPU_TLBS(pVM);
+
+    if (fFlushRemTLBs)
+        for (VMCPUID idCurCpu = 0; idCurCpu < pVM->cCpus; idCurCpu++)
+            CPUMSetChangedFlags(&pVM->aCpus[idCurCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
+
+    return rc;
+}
 #endif /* VBOX_WITH_PAGE_SHARING */
 
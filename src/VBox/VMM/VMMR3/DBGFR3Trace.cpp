@@ -20,20 +20,28 @@
 *   Header Files                                                               *
 *******************************************************************************/
 #define LOG_GROUP LOG_GROUP_DBGF
+#include <iprt/asm-amd64-x86.h> /* for SUPGetCpuHzFromGIP from sup.h  */
 #include <VBox/vmm/dbgftrace.h>
 #include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/iom.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/pdmapi.h>
 #include "DBGFInternal.h"
 #include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
 #include "VMMTracing.h"
 
 #include <VBox/err.h>
 #include <VBox/log.h>
 #include <VBox/param.h>
+#include <VBox/sup.h>
 
+#include <iprt/asm-math.h>
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
+#include <iprt/mem.h>
+#include <iprt/stream.h>
+#include <iprt/thread.h>
 #include <iprt/trace.h>
 
 
@@ -41,6 +49,7 @@
 *   Internal Functions                                                         *
 *******************************************************************************/
 static DECLCALLBACK(void) dbgfR3TraceInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
+static DECLCALLBACK(void) dbgfR3TraceRingInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 
 
 /*******************************************************************************
@@ -62,6 +71,7 @@ static const struct
     {  RT_STR_TUPLE("em"), VMMTPGROUP_EM },
     {  RT_STR_TUPLE("hm"), VMMTPGROUP_HM },
     {  RT_STR_TUPLE("tm"), VMMTPGROUP_TM },
+    {  RT_STR_TUPLE("iom"), VMMTPGROUP_IOM },
 };
 
 
@@ -129,6 +139,109 @@ static int dbgfR3TraceEnable(PVM pVM, uint32_t cbEntry, uint32_t cEntries)
 }
 
 
+/**
+ * Sets up the binary trace rings if configured.
+ *
+ * @returns VBox status code
+ * @param   pVM                 Pointer to the VM.
+ * @param   pDbgfNode           The DBGF CFGM node.  Can be NULL.
+ */
+static int dbgfR3TraceRingsInit(PVM pVM, PCFGMNODE pDbgfNode)
+{
+    pVM->dbgf.s.iTraceRingTls = NIL_RTTLS;
+
+    /** @cfgm{/DBGF/TraceRing, bool, false}
+     * Enables the lock-free binary trace rings, one per VCPU plus a number of
+     * rings for ring-3 I/O threads.  Events are recorded for the trace point
+     * groups enabled by TracingConfig, 'iom' is enabled by default. The rings
+     * can be exported in Chrome trace event format using the 'writetrace'
+     * debugger command. */
+    bool fEnabled;
+    int rc = CFGMR3QueryBoolDef(pDbgfNode, "TraceRing", &fEnabled, false);
+    AssertRCReturn(rc, rc);
+    if (!fEnabled)
+        return VINF_SUCCESS;
+
+    /** @cfgm{/DBGF/TraceRingEntries, uint32_t, 4096}
+     * The number of records in each binary trace ring.  Must be a power of two
+     * in the range 64 to 1048576.  Each record is 32 bytes. */
+    uint32_t cRecs;
+    rc = CFGMR3QueryU32Def(pDbgfNode, "TraceRingEntries", &cRecs, 4096);
+    AssertRCReturn(rc, rc);
+    if (   cRecs < 64
+        || cRecs > _1M
+        || !RT_IS_POWER_OF_TWO(cRecs))
+        return VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                          "Configuration error: TraceRingEntries=%u must be a power of two between 64 and 1048576", cRecs);
+
+    /** @cfgm{/DBGF/TraceRingIoThreads, uint32_t, 8}
+     * The number of binary trace rings available to ring-3 threads other than
+     * the EMTs.  Rings are handed out on first use and threads arriving after
+     * they have run out do not get traced. */
+    uint32_t cIoRings;
+    rc = CFGMR3QueryU32Def(pDbgfNode, "TraceRingIoThreads", &cIoRings, 8);
+    AssertRCReturn(rc, rc);
+    if (cIoRings > 64)
+        return VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                          "Configuration error: TraceRingIoThreads=%u is out of range (max 64)", cIoRings);
+
+    uint64_t u64TscHz = SUPGetCpuHzFromGIP(g_pSUPGlobalInfoPage);
+    if (!u64TscHz || u64TscHz == UINT64_MAX)
+    {
+        LogRel(("DBGF: No TSC frequency available, binary trace rings disabled\n"));
+        return VINF_SUCCESS;
+    }
+    pVM->dbgf.s.u64TraceRingTscHz = u64TscHz;
+
+    /*
+     * The per-VCPU rings live in hyper memory so they can be written from all contexts.
+     */
+    size_t const cbRing = RT_ALIGN_Z(DBGF_TRACE_RING_SIZE(cRecs), PAGE_SIZE);
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[idCpu];
+        void  *pv;
+        rc = MMR3HyperAllocOnceNoRelEx(pVM, cbRing, PAGE_SIZE, MM_TAG_DBGF, MMHYPER_AONR_FLAGS_KERNEL_MAPPING, &pv);
+        if (RT_FAILURE(rc))
+            return VMSetError(pVM, rc, RT_SRC_POS, "Failed to allocate %zu bytes for the trace ring of VCPU %u", cbRing, idCpu);
+        PDBGFTRACERING pRing = (PDBGFTRACERING)pv;
+        pRing->idxWrite = 0;
+        pRing->cRecs    = cRecs;
+        pRing->fMask    = cRecs - 1;
+        RTStrPrintf(pRing->szName, sizeof(pRing->szName), "EMT-%u", idCpu);
+
+        pVCpu->dbgf.s.pTraceRingR3 = pRing;
+        pVCpu->dbgf.s.pTraceRingR0 = MMHyperR3ToR0(pVM, pRing);
+        pVCpu->dbgf.s.pTraceRingRC = MMHyperR3ToRC(pVM, pRing);
+        pVCpu->fTraceGroups       |= VMMTPGROUP_IOM;
+    }
+
+    /*
+     * The I/O thread rings are only written in ring-3 and are handed out lazily.
+     */
+    if (cIoRings)
+    {
+        rc = RTTlsAllocEx(&pVM->dbgf.s.iTraceRingTls, NULL);
+        AssertRCReturn(rc, rc);
+        pVM->dbgf.s.pbTraceRingsIo = (uint8_t *)RTMemPageAllocZ(cbRing * cIoRings);
+        if (!pVM->dbgf.s.pbTraceRingsIo)
+            return VERR_NO_PAGE_MEMORY;
+        pVM->dbgf.s.cbTraceRingIo  = (uint32_t)cbRing;
+        pVM->dbgf.s.cTraceRingsIo  = cIoRings;
+        for (uint32_t i = 0; i < cIoRings; i++)
+        {
+            PDBGFTRACERING pRing = (PDBGFTRACERING)&pVM->dbgf.s.pbTraceRingsIo[cbRing * i];
+            pRing->cRecs = cRecs;
+            pRing->fMask = cRecs - 1;
+        }
+    }
+
+    LogRel(("DBGF: Binary trace rings enabled - %u records per ring, %u VCPU rings, %u I/O thread rings\n",
+            cRecs, pVM->cCpus, cIoRings));
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Initializes the tracing.
  *
@@ -185,11 +298,18 @@ int dbgfR3TraceInit(PVM pVM)
         }
     }
 
+    if (RT_SUCCESS(rc))
+        rc = dbgfR3TraceRingsInit(pVM, pDbgfNode);
+
     /*
-     * Register a debug info item that will dump the trace buffer content.
+     * Register debug info items that will dump the trace buffer content and
+     * summarize the binary trace rings.
      */
     if (RT_SUCCESS(rc))
         rc = DBGFR3InfoRegisterInternal(pVM, "tracebuf", "Display the trace buffer content. No arguments.", dbgfR3TraceInfo);
+    if (RT_SUCCESS(rc))
+        rc = DBGFR3InfoRegisterInternal(pVM, "tracering", "Display the binary trace ring state. No arguments.",
+                                        dbgfR3TraceRingInfo);
 
     return rc;
 }
@@ -202,8 +322,17 @@ int dbgfR3TraceInit(PVM pVM)
  */
 void dbgfR3TraceTerm(PVM pVM)
 {
-    /* nothing to do */
-    NOREF(pVM);
+    if (pVM->dbgf.s.pbTraceRingsIo)
+    {
+        RTMemPageFree(pVM->dbgf.s.pbTraceRingsIo, (size_t)pVM->dbgf.s.cbTraceRingIo * pVM->dbgf.s.cTraceRingsIo);
+        pVM->dbgf.s.pbTraceRingsIo = NULL;
+        pVM->dbgf.s.cTraceRingsIo  = 0;
+    }
+    if (pVM->dbgf.s.iTraceRingTls != NIL_RTTLS)
+    {
+        RTTlsFree(pVM->dbgf.s.iTraceRingTls);
+        pVM->dbgf.s.iTraceRingTls = NIL_RTTLS;
+    }
 }
 
 
@@ -216,6 +345,10 @@ void dbgfR3TraceRelocate(PVM pVM)
 {
     if (pVM->hTraceBufR3 != NIL_RTTRACEBUF)
         pVM->hTraceBufRC = MMHyperCCToRC(pVM, pVM->hTraceBufR3);
+
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        if (pVM->aCpus[idCpu].dbgf.s.pTraceRingR3)
+            pVM->aCpus[idCpu].dbgf.s.pTraceRingRC = MMHyperR3ToRC(pVM, pVM->aCpus[idCpu].dbgf.s.pTraceRingR3);
 }
 
 
@@ -445,3 +578,300 @@ static DECLCALLBACK(void) dbgfR3TraceInfo(PVM pVM, PCDBGFINFOHLP pHlp, const cha
     NOREF(pszArgs);
 }
 
+
+
+/**
+ * Gets the binary trace ring of the calling thread, handing out a new I/O
+ * thread ring if necessary.
+ *
+ * @returns Pointer to the ring, NULL if tracing is disabled or we've run out.
+ * @param   pVM                 Pointer to the VM.
+ */
+static PDBGFTRACERING dbgfR3TraceRingGetForCaller(PVM pVM)
+{
+    PVMCPU pVCpu = VMMGetCpu(pVM);
+    if (pVCpu)
+        return pVCpu->dbgf.s.pTraceRingR3;
+
+    if (!pVM->dbgf.s.pbTraceRingsIo)
+        return NULL;
+    PDBGFTRACERING pRing = (PDBGFTRACERING)RTTlsGet(pVM->dbgf.s.iTraceRingTls);
+    if (RT_LIKELY(pRing))
+        return pRing;
+
+    /* First event from this thread, claim a ring. */
+    if (ASMAtomicReadU32(&pVM->dbgf.s.cTraceRingsIoUsed) >= pVM->dbgf.s.cTraceRingsIo)
+        return NULL;
+    uint32_t const iRing = ASMAtomicIncU32(&pVM->dbgf.s.cTraceRingsIoUsed) - 1;
+    if (iRing >= pVM->dbgf.s.cTraceRingsIo)
+        return NULL;
+    pRing = (PDBGFTRACERING)&pVM->dbgf.s.pbTraceRingsIo[(size_t)pVM->dbgf.s.cbTraceRingIo * iRing];
+    const char *pszName = RTThreadSelfName();
+    RTStrCopy(pRing->szName, sizeof(pRing->szName), pszName ? pszName : "io-thread");
+    RTTlsSet(pVM->dbgf.s.iTraceRingTls, pRing);
+    return pRing;
+}
+
+
+/**
+ * Adds a completed event to the calling thread's binary trace ring.
+ *
+ * Unlike DBGFTraceRingAdd this can be called by any ring-3 thread, non-EMTs
+ * get an I/O thread ring on their first call.
+ *
+ * @param   pVM                 Pointer to the VM.
+ * @param   enmEvt              The event type.
+ * @param   cNsElapsed          How long ago the event started, in nanoseconds.
+ * @param   uAddr               The port, address or other object identifier.
+ * @param   uValue              The value transferred.
+ * @param   rc                  The status of the operation.
+ */
+VMMR3_INT_DECL(void) DBGFR3TraceRingAddSpan(PVM pVM, DBGFTRACEEVT enmEvt, uint64_t cNsElapsed, uint64_t uAddr,
+                                            uint64_t uValue, int rc)
+{
+    if (!pVM->dbgf.s.u64TraceRingTscHz)
+        return;
+    PDBGFTRACERING pRing = dbgfR3TraceRingGetForCaller(pVM);
+    if (pRing)
+    {
+        uint64_t const uTscNow = ASMReadTSC();
+        uint64_t const cTicks  = ASMMultU64ByU32DivByU32(cNsElapsed, (uint32_t)(pVM->dbgf.s.u64TraceRingTscHz / 1000),
+                                                         RT_NS_1MS);
+        dbgfTraceRingWrite(pRing, enmEvt, uTscNow - cTicks, cTicks, uAddr, uValue, 0 /*cbAccess*/, rc);
+    }
+}
+
+
+/**
+ * Copies the valid records out of a trace ring without disturbing the owner.
+ *
+ * @returns Number of records copied to @a paRecs.
+ * @param   pRing               The ring.
+ * @param   paRecs              Where to copy the records, must have room for
+ *                              pRing->cRecs entries.
+ */
+static uint32_t dbgfR3TraceRingSnapshot(PDBGFTRACERING pRing, PDBGFTRACEREC paRecs)
+{
+    uint32_t const cRecs    = pRing->cRecs;
+    uint64_t const idxEnd   = ASMAtomicReadU64(&pRing->idxWrite);
+    uint64_t       idxFirst = idxEnd > cRecs ? idxEnd - cRecs : 0;
+    for (uint64_t idx = idxFirst; idx < idxEnd; idx++)
+        paRecs[idx - idxFirst] = pRing->aRecs[idx & pRing->fMask];
+
+    /* Drop anything the owner may have overwritten while we were copying. */
+    ASMReadFence();
+    uint64_t const idxNow = ASMAtomicReadU64(&pRing->idxWrite);
+    uint32_t       iSkip  = 0;
+    if (idxNow - idxFirst > cRecs)
+        iSkip = (uint32_t)RT_MIN(idxNow - idxFirst - cRecs, idxEnd - idxFirst);
+    if (iSkip)
+        memmove(paRecs, &paRecs[iSkip], (size_t)(idxEnd - idxFirst - iSkip) * sizeof(paRecs[0]));
+    return (uint32_t)(idxEnd - idxFirst) - iSkip;
+}
+
+
+/**
+ * Writes a string as a JSON string literal body, escaping as needed.
+ *
+ * @param   pStrm               The output stream.
+ * @param   psz                 The string.
+ */
+static void dbgfR3TraceRingJsonStr(PRTSTREAM pStrm, const char *psz)
+{
+    char ch;
+    while ((ch = *psz++) != '\0')
+    {
+        if (ch == '"' || ch == '\\')
+            RTStrmPrintf(pStrm, "\\%c", ch);
+        else if ((unsigned char)ch < 0x20)
+            RTStrmPrintf(pStrm, "\\u%04x", (unsigned char)ch);
+        else
+            RTStrmPutCh(pStrm, ch);
+    }
+}
+
+
+/**
+ * Writes the records of one ring as Chrome trace events.
+ *
+ * @param   pVM                 Pointer to the VM.
+ * @param   pStrm               The output stream.
+ * @param   pRing               The ring.
+ * @param   tid                 The thread id to use for the ring.
+ * @param   paRecs              Scratch buffer with room for pRing->cRecs records.
+ * @param   uTscBase            The TSC value corresponding to time zero.
+ * @param   fFirst              Whether this is the first event in the file.
+ */
+static void dbgfR3TraceRingExportOne(PVM pVM, PRTSTREAM pStrm, PDBGFTRACERING pRing, uint32_t tid,
+                                     PDBGFTRACEREC paRecs, uint64_t uTscBase, bool fFirst)
+{
+    uint32_t const cRecs = dbgfR3TraceRingSnapshot(pRing, paRecs);
+    uint32_t const uKHz  = (uint32_t)(pVM->dbgf.s.u64TraceRingTscHz / 1000);
+
+    RTStrmPrintf(pStrm, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                 fFirst ? "" : ",", tid);
+    dbgfR3TraceRingJsonStr(pStrm, pRing->szName);
+    RTStrmPrintf(pStrm, "\"}}");
+
+    /* Cache the last range lookup, consecutive accesses usually hit the same device. */
+    uint8_t  u8EvtLast  = DBGFTRACEEVT_INVALID;
+    uint64_t uAddrLast  = 0;
+    char     szDesc[80] = "";
+
+    for (uint32_t i = 0; i < cRecs; i++)
+    {
+        PCDBGFTRACEREC pRec = &paRecs[i];
+        if (   pRec->u8Evt == DBGFTRACEEVT_INVALID
+            || pRec->u8Evt >= DBGFTRACEEVT_END
+            || pRec->uTsc < uTscBase)
+            continue;
+
+        const char *pszCat;
+        const char *pszOp;
+        bool        fMmio = false;
+        switch (pRec->u8Evt)
+        {
+            case DBGFTRACEEVT_IOPORT_READ:  pszCat = "ioport"; pszOp = "in"; break;
+            case DBGFTRACEEVT_IOPORT_WRITE: pszCat = "ioport"; pszOp = "out"; break;
+            case DBGFTRACEEVT_MMIO_READ:    pszCat = "mmio";   pszOp = "read";  fMmio = true; break;
+            case DBGFTRACEEVT_MMIO_WRITE:   pszCat = "mmio";   pszOp = "write"; fMmio = true; break;
+            default:                        pszCat = "aio";    pszOp = "async-io"; break;
+        }
+        if (   pRec->u8Evt != u8EvtLast
+            || pRec->uAddr != uAddrLast)
+        {
+            u8EvtLast = pRec->u8Evt;
+            uAddrLast = pRec->uAddr;
+            if (   pRec->u8Evt == DBGFTRACEEVT_ASYNC_IO
+                || RT_FAILURE(IOMR3QueryRangeDesc(pVM, fMmio, pRec->uAddr, szDesc, sizeof(szDesc))))
+                szDesc[0] = '\0';
+        }
+
+        uint64_t const cNsStart = ASMMultU64ByU32DivByU32(pRec->uTsc - uTscBase, RT_NS_1MS, uKHz);
+        uint64_t const cNsDur   = ASMMultU64ByU32DivByU32(pRec->cTicks, RT_NS_1MS, uKHz);
+        RTStrmPrintf(pStrm, ",\n{\"name\":\"%s", pszOp);
+        if (szDesc[0])
+        {
+            RTStrmPutCh(pStrm, ' ');
+            dbgfR3TraceRingJsonStr(pStrm, szDesc);
+        }
+        RTStrmPrintf(pStrm,
+                     "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%RU64.%03RU64,\"dur\":%RU64.%03RU64,"
+                     "\"args\":{\"addr\":\"%#RX64\",\"cb\":%u,\"value\":\"%#RX64\",\"rc\":%d}}",
+                     pszCat, tid, cNsStart / 1000, cNsStart % 1000, cNsDur / 1000, cNsDur % 1000,
+                     pRec->uAddr, pRec->cbAccess, pRec->uValue, pRec->i16Rc);
+    }
+}
+
+
+/**
+ * Exports the binary trace rings to a file in the Chrome trace event format.
+ *
+ * The resulting JSON file can be loaded into chrome://tracing or converted to
+ * other formats with the usual tools.  Each ring becomes a thread, each record
+ * a complete ("X") event with timestamps relative to the oldest record.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_DBGF_NO_TRACE_BUFFER if the rings weren't enabled.
+ * @param   pUVM                The user mode VM handle.
+ * @param   pszFilename         The output file, it is replaced if it exists.
+ */
+VMMR3DECL(int) DBGFR3TraceRingExport(PUVM pUVM, const char *pszFilename)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pszFilename, VERR_INVALID_POINTER);
+    PDBGFTRACERING pRing0 = pVM->aCpus[0].dbgf.s.pTraceRingR3;
+    if (!pRing0)
+        return VERR_DBGF_NO_TRACE_BUFFER;
+
+    /*
+     * Collect the rings; all have the same number of records.
+     */
+    uint32_t const  cIoRings = RT_MIN(ASMAtomicReadU32(&pVM->dbgf.s.cTraceRingsIoUsed), pVM->dbgf.s.cTraceRingsIo);
+    uint32_t const  cRings   = pVM->cCpus + cIoRings;
+    PDBGFTRACERING *papRings = (PDBGFTRACERING *)RTMemTmpAlloc(sizeof(papRings[0]) * cRings);
+    PDBGFTRACEREC   paRecs   = (PDBGFTRACEREC)RTMemAlloc(sizeof(paRecs[0]) * pRing0->cRecs);
+    if (!papRings || !paRecs)
+    {
+        RTMemTmpFree(papRings);
+        RTMemFree(paRecs);
+        return VERR_NO_MEMORY;
+    }
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        papRings[idCpu] = pVM->aCpus[idCpu].dbgf.s.pTraceRingR3;
+    for (uint32_t i = 0; i < cIoRings; i++)
+        papRings[pVM->cCpus + i] = (PDBGFTRACERING)&pVM->dbgf.s.pbTraceRingsIo[(size_t)pVM->dbgf.s.cbTraceRingIo * i];
+
+    /*
+     * Find the time base, i.e. the oldest record still around.
+     */
+    uint64_t uTscBase = UINT64_MAX;
+    for (uint32_t iRing = 0; iRing < cRings; iRing++)
+    {
+        PDBGFTRACERING pRing = papRings[iRing];
+        uint64_t const idxEnd = ASMAtomicReadU64(&pRing->idxWrite);
+        if (idxEnd)
+        {
+            uint64_t const idxFirst = idxEnd > pRing->cRecs ? idxEnd - pRing->cRecs + 1 : 0;
+            uint64_t const uTsc = pRing->aRecs[idxFirst & pRing->fMask].uTsc;
+            if (uTsc < uTscBase)
+                uTscBase = uTsc;
+        }
+    }
+    if (uTscBase == UINT64_MAX)
+        uTscBase = 0;
+
+    /*
+     * Write the file.
+     */
+    PRTSTREAM pStrm;
+    int rc = RTStrmOpen(pszFilename, "w", &pStrm);
+    if (RT_SUCCESS(rc))
+    {
+        RTStrmPrintf(pStrm, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"tscHz\":%RU64},\"traceEvents\":[",
+                     pVM->dbgf.s.u64TraceRingTscHz);
+        for (uint32_t iRing = 0; iRing < cRings; iRing++)
+            dbgfR3TraceRingExportOne(pVM, pStrm, papRings[iRing], iRing, paRecs, uTscBase, iRing == 0);
+        RTStrmPrintf(pStrm, "\n]}\n");
+
+        rc = RTStrmError(pStrm);
+        int rc2 = RTStrmClose(pStrm);
+        if (RT_SUCCESS(rc))
+            rc = rc2;
+    }
+
+    RTMemFree(paRecs);
+    RTMemTmpFree(papRings);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, Info handler for displaying the binary trace ring state.}
+ */
+static DECLCALLBACK(void) dbgfR3TraceRingInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    if (!pVM->aCpus[0].dbgf.s.pTraceRingR3)
+        pHlp->pfnPrintf(pHlp, "Binary trace rings are disabled\n");
+    else
+    {
+        pHlp->pfnPrintf(pHlp, "Binary trace rings - %u records each, TSC %'RU64 Hz\n",
+                        pVM->aCpus[0].dbgf.s.pTraceRingR3->cRecs, pVM->dbgf.s.u64TraceRingTscHz);
+        for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        {
+            PDBGFTRACERING pRing = pVM->aCpus[idCpu].dbgf.s.pTraceRingR3;
+            pHlp->pfnPrintf(pHlp, "  %-32s %'14RU64 events  groups=%#x\n",
+                            pRing->szName, ASMAtomicReadU64(&pRing->idxWrite), pVM->aCpus[idCpu].fTraceGroups);
+        }
+        uint32_t const cIoRings = RT_MIN(ASMAtomicReadU32(&pVM->dbgf.s.cTraceRingsIoUsed), pVM->dbgf.s.cTraceRingsIo);
+        for (uint32_t i = 0; i < cIoRings; i++)
+        {
+            PDBGFTRACERING pRing = (PDBGFTRACERING)&pVM->dbgf.s.pbTraceRingsIo[(size_t)pVM->dbgf.s.cbTraceRingIo * i];
+            pHlp->pfnPrintf(pHlp, "  %-32s %'14RU64 events\n", pRing->szName, ASMAtomicReadU64(&pRing->idxWrite));
+        }
+        pHlp->pfnPrintf(pHlp, "  %u of %u I/O thread rings in use\n", cIoRings, pVM->dbgf.s.cTraceRingsIo);
+    }
+    NOREF(pszArgs);
+}
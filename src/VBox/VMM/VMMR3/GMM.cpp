@@ -376,6 +376,17 @@ GMMR3DECL(int)  GMMR3FreeLargePage(PVM pVM,  uint32_t idPage)
 }
 
 
+/**
+ * @see GMMR0PromoteLargePageReq
+ */
+GMMR3DECL(int)  GMMR3PromoteLargePage(PVM pVM, PGMMPROMOTELARGEPAGEREQ pReq)
+{
+    pReq->Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
+    pReq->Hdr.cbReq    = sizeof(*pReq);
+    return VMMR3CallR0(pVM, VMMR0_DO_GMM_PROMOTE_LARGE_PAGE, 0, &pReq->Hdr);
+}
+
+
 /**
  * @see GMMR0SeedChunk
  */
@@ -428,6 +439,17 @@ GMMR3DECL(int)  GMMR3CheckSharedModules(PVM pVM)
 }
 
 
+/**
+ * @see GMMR0DedupScanReq
+ */
+GMMR3DECL(int)  GMMR3DedupScan(PVM pVM, PGMMDEDUPSCANREQ pReq)
+{
+    pReq->Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
+    pReq->Hdr.cbReq    = sizeof(*pReq);
+    return VMMR3CallR0(pVM, VMMR0_DO_GMM_DEDUP_SCAN, 0, &pReq->Hdr);
+}
+
+
 #if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
 /**
  * @see GMMR0FindDuplicatePage
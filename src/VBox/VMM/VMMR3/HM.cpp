@@ -20,6 +20,7 @@
 *   Header Files                                                               *
 *******************************************************************************/
 #define LOG_GROUP LOG_GROUP_HM
+#include <iprt/asm-amd64-x86.h> /* for SUPGetCpuHzFromGIP from sup.h  */
 #include <VBox/vmm/cpum.h>
 #include <VBox/vmm/stam.h>
 #include <VBox/vmm/mm.h>
@@ -42,6 +43,7 @@
 #include <VBox/vmm/uvm.h>
 #include <VBox/err.h>
 #include <VBox/param.h>
+#include <VBox/sup.h>
 
 #include <iprt/assert.h>
 #include <VBox/log.h>
@@ -49,6 +51,8 @@
 #include <iprt/asm-amd64-x86.h>
 #include <iprt/string.h>
 #include <iprt/env.h>
+#include <iprt/mem.h>
+#include <iprt/sort.h>
 #include <iprt/thread.h>
 
 
@@ -304,6 +308,8 @@ static const char * const g_apszAmdVExitReasons[MAX_EXITREASON_STAT] =
 static DECLCALLBACK(int) hmR3Save(PVM pVM, PSSMHANDLE pSSM);
 static DECLCALLBACK(int) hmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass);
 static int hmR3InitCPU(PVM pVM);
+static int hmR3InitExitProf(PVM pVM);
+static DECLCALLBACK(void) hmR3InfoExitProf(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 static int hmR3InitFinalizeR0(PVM pVM);
 static int hmR3InitFinalizeR0Intel(PVM pVM);
 static int hmR3InitFinalizeR0Amd(PVM pVM);
@@ -830,7 +836,246 @@ static int hmR3InitCPU(PVM pVM)
     }
 #endif
 
-    return VINF_SUCCESS;
+    return hmR3InitExitProf(pVM);
+}
+
+
+/**
+ * Sets up the exit profiler if configured.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+static int hmR3InitExitProf(PVM pVM)
+{
+    PCFGMNODE pCfgHM = CFGMR3GetChild(CFGMR3GetRoot(pVM), "HM/");
+
+    /** @cfgm{/HM/ExitProfiling, bool, false}
+     * Enables the sampling VM-exit profiler.  It records the exit reason, guest
+     * RIP, the I/O port or MMIO address being accessed and the time spent in
+     * ring-0 and ring-3 for every sampled exit.  See the 'exitprof' info item. */
+    bool fEnabled;
+    int rc = CFGMR3QueryBoolDef(pCfgHM, "ExitProfiling", &fEnabled, false);
+    AssertLogRelRCReturn(rc, rc);
+
+    /** @cfgm{/HM/ExitProfilingInterval, uint32_t, 1}
+     * Record every Nth VM-exit.  Must be non-zero. */
+    uint32_t cInterval;
+    rc = CFGMR3QueryU32Def(pCfgHM, "ExitProfilingInterval", &cInterval, 1);
+    AssertLogRelRCReturn(rc, rc);
+    if (!cInterval)
+        return VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS, "/HM/ExitProfilingInterval must not be zero");
+
+    if (fEnabled)
+    {
+        for (VMCPUID i = 0; i < pVM->cCpus; i++)
+        {
+            PVMCPU         pVCpu = &pVM->aCpus[i];
+            PHMEXITPROFBUF pBuf;
+            rc = MMR3HyperAllocOnceNoRelEx(pVM, sizeof(*pBuf), PAGE_SIZE, MM_TAG_HM, MMHYPER_AONR_FLAGS_KERNEL_MAPPING,
+                                           (void **)&pBuf);
+            AssertLogRelRCReturn(rc, rc);
+            pBuf->cSampleInterval = cInterval;
+            pBuf->cUntilSample    = cInterval;
+            pVCpu->hm.s.pExitProfR3 = pBuf;
+            pVCpu->hm.s.pExitProfR0 = MMHyperR3ToR0(pVM, pBuf);
+            AssertLogRelReturn(pVCpu->hm.s.pExitProfR0 != NIL_RTR0PTR, VERR_HM_IPE_1);
+        }
+        LogRel(("HM: Exit profiling enabled, recording every %u exit(s) into %u entry ring buffers\n",
+                cInterval, HM_EXITPROF_RECS));
+    }
+
+    return DBGFR3InfoRegisterInternal(pVM, "exitprof",
+                                      "Dumps the sampled VM-exits as folded stacks for flame graphs. "
+                                      "Arguments: [cpu=<id>] [count] [reset]",
+                                      hmR3InfoExitProf);
+}
+
+
+/**
+ * @callback_method_impl{FNRTSORTCMP, Orders exit profiler records by exit
+ *      reason, accessed address and RIP.}
+ */
+static DECLCALLBACK(int) hmR3ExitProfRecCompare(void const *pvElement1, void const *pvElement2, void *pvUser)
+{
+    PCHMEXITPROFREC pRec1 = (PCHMEXITPROFREC)pvElement1;
+    PCHMEXITPROFREC pRec2 = (PCHMEXITPROFREC)pvElement2;
+    NOREF(pvUser);
+    if (pRec1->uExitReason != pRec2->uExitReason)
+        return pRec1->uExitReason < pRec2->uExitReason ? -1 : 1;
+    uint8_t const fKind1 = pRec1->fFlags & (HM_EXITPROF_F_IOPORT | HM_EXITPROF_F_MMIO);
+    uint8_t const fKind2 = pRec2->fFlags & (HM_EXITPROF_F_IOPORT | HM_EXITPROF_F_MMIO);
+    if (fKind1 != fKind2)
+        return fKind1 < fKind2 ? -1 : 1;
+    if (fKind1 && pRec1->uAddr != pRec2->uAddr)
+        return pRec1->uAddr < pRec2->uAddr ? -1 : 1;
+    if (pRec1->uRip != pRec2->uRip)
+        return pRec1->uRip < pRec2->uRip ? -1 : 1;
+    return 0;
+}
+
+
+/**
+ * Formats the exit reason frame for the exit profiler.
+ *
+ * @returns pszBuf.
+ * @param   uExitReason     The VMX exit reason or SVM exit code.
+ * @param   pszBuf          The output buffer.
+ * @param   cbBuf           The size of the output buffer.
+ */
+static const char *hmR3ExitProfFormatReason(uint16_t uExitReason, char *pszBuf, size_t cbBuf)
+{
+#ifdef VBOX_WITH_STATISTICS
+    const char * const *papszDesc = ASMIsIntelCpu() ? &g_apszVTxExitReasons[0] : &g_apszAmdVExitReasons[0];
+    if (uExitReason < MAX_EXITREASON_STAT && papszDesc[uExitReason])
+    {
+        /* Just the define name, i.e. up to the first space. */
+        const char *pszDesc = papszDesc[uExitReason];
+        size_t      cchName = strcspn(pszDesc, " ");
+        RTStrCopyEx(pszBuf, cbBuf, pszDesc, cchName);
+        return pszBuf;
+    }
+#endif
+    if (!ASMIsIntelCpu() && uExitReason == SVM_EXIT_NPF)
+        RTStrCopy(pszBuf, cbBuf, "SVM_EXIT_NPF");
+    else
+        RTStrPrintf(pszBuf, cbBuf, "exit_%#x", uExitReason);
+    return pszBuf;
+}
+
+
+/**
+ * Display the sampled VM-exits in the folded stack format used by
+ * flamegraph.pl and friends.
+ *
+ * Each line is 'CPU;exit reason[;device;address];rip weight', with a
+ * ';ring-3' child frame carrying the time spent completing the exit in
+ * ring-3.  The weight is nanoseconds, or the number of samples when the
+ * 'count' argument is given.  The 'reset' argument discards what has been
+ * recorded so far instead of displaying it.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pHlp        The info helper functions.
+ * @param   pszArgs     Arguments, see above.
+ */
+static DECLCALLBACK(void) hmR3InfoExitProf(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    if (!pVM->aCpus[0].hm.s.pExitProfR3)
+    {
+        pHlp->pfnPrintf(pHlp, "The exit profiler is not enabled, see /HM/ExitProfiling.\n");
+        return;
+    }
+
+    /*
+     * Parse the arguments.
+     */
+    bool    fCount    = false;
+    bool    fReset    = false;
+    VMCPUID idCpuOnly = NIL_VMCPUID;
+    if (pszArgs)
+    {
+        fCount = strstr(pszArgs, "count") != NULL;
+        fReset = strstr(pszArgs, "reset") != NULL;
+        const char *pszCpu = strstr(pszArgs, "cpu=");
+        if (pszCpu)
+            idCpuOnly = RTStrToUInt32(pszCpu + 4);
+    }
+
+    uint64_t       uCpuMHz = SUPGetCpuHzFromGIP(g_pSUPGlobalInfoPage);
+    uCpuMHz = uCpuMHz != UINT64_MAX ? uCpuMHz / UINT32_C(1000000) : 0;
+    PHMEXITPROFREC paRecs  = NULL;
+    if (!fReset)
+    {
+        paRecs = (PHMEXITPROFREC)RTMemAlloc(sizeof(paRecs[0]) * HM_EXITPROF_RECS);
+        if (!paRecs)
+        {
+            pHlp->pfnPrintf(pHlp, "Out of memory!\n");
+            return;
+        }
+    }
+
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        if (idCpuOnly != NIL_VMCPUID && idCpuOnly != idCpu)
+            continue;
+        PHMEXITPROFBUF pBuf   = pVM->aCpus[idCpu].hm.s.pExitProfR3;
+        uint32_t const idxEnd = ASMAtomicReadU32(&pBuf->idxWrite);
+        if (fReset)
+        {
+            pBuf->idxRead = idxEnd;
+            continue;
+        }
+
+        /*
+         * Copy out the records and drop those the EMT may have overwritten
+         * while we were at it.
+         */
+        uint32_t idxStart = pBuf->idxRead;
+        if (idxEnd - idxStart > HM_EXITPROF_RECS)
+            idxStart = idxEnd - HM_EXITPROF_RECS;
+        uint32_t const cRecs = idxEnd - idxStart;
+        for (uint32_t i = 0; i < cRecs; i++)
+            paRecs[i] = pBuf->aRecs[(idxStart + i) & (HM_EXITPROF_RECS - 1)];
+        ASMReadFence();
+        uint32_t const idxEndNow = ASMAtomicReadU32(&pBuf->idxWrite);
+        uint32_t       iFirst    = 0;
+        if (idxEndNow - idxStart > HM_EXITPROF_RECS)
+            iFirst = RT_MIN(idxEndNow - idxStart - HM_EXITPROF_RECS, cRecs);
+
+        RTSortShell(&paRecs[iFirst], cRecs - iFirst, sizeof(paRecs[0]), hmR3ExitProfRecCompare, NULL);
+
+        /*
+         * Aggregate identical stacks and print them.
+         */
+        uint32_t i = iFirst;
+        while (i < cRecs)
+        {
+            uint64_t cTicks      = 0;
+            uint64_t cTicksRing3 = 0;
+            uint64_t cSamples    = 0;
+            uint32_t j           = i;
+            do
+            {
+                cTicks      += paRecs[j].cTicks;
+                cTicksRing3 += paRecs[j].cTicksRing3;
+                cSamples++;
+                j++;
+            } while (j < cRecs && !hmR3ExitProfRecCompare(&paRecs[i], &paRecs[j], NULL));
+
+            char szReason[64];
+            char szStack[256];
+            size_t off = RTStrPrintf(szStack, sizeof(szStack), "CPU%u;%s", idCpu,
+                                     hmR3ExitProfFormatReason(paRecs[i].uExitReason, szReason, sizeof(szReason)));
+            bool const fMmio = RT_BOOL(paRecs[i].fFlags & HM_EXITPROF_F_MMIO);
+            if (paRecs[i].fFlags & (HM_EXITPROF_F_IOPORT | HM_EXITPROF_F_MMIO))
+            {
+                char szDesc[80];
+                if (RT_FAILURE(IOMR3QueryRangeDesc(pVM, fMmio, paRecs[i].uAddr, szDesc, sizeof(szDesc))))
+                    RTStrCopy(szDesc, sizeof(szDesc), "unassigned");
+                for (char *psz = szDesc; *psz; psz++)
+                    if (*psz == ';')
+                        *psz = ',';
+                off += RTStrPrintf(&szStack[off], sizeof(szStack) - off, fMmio ? ";%s;mmio %RGp" : ";%s;port %#06RX64",
+                                   szDesc, paRecs[i].uAddr);
+            }
+            RTStrPrintf(&szStack[off], sizeof(szStack) - off, ";rip %RX64", paRecs[i].uRip);
+
+            if (fCount)
+                pHlp->pfnPrintf(pHlp, "%s %RU64\n", szStack, cSamples);
+            else
+            {
+                uint64_t const cNs      = uCpuMHz ? cTicks      * RT_NS_1US / uCpuMHz : cTicks;
+                uint64_t const cNsRing3 = uCpuMHz ? cTicksRing3 * RT_NS_1US / uCpuMHz : cTicksRing3;
+                if (cNs)
+                    pHlp->pfnPrintf(pHlp, "%s %RU64\n", szStack, cNs);
+                if (cNsRing3)
+                    pHlp->pfnPrintf(pHlp, "%s;ring-3 %RU64\n", szStack, cNsRing3);
+            }
+            i = j;
+        }
+    }
+
+    RTMemFree(paRecs);
 }
 
 
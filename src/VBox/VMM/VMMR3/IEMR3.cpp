@@ -64,6 +64,14 @@ VMMR3DECL(int)      IEMR3Init(PVM pVM)
                         "Error statuses returned",           "/IEM/CPU%u/cRetErrStatuses", idCpu);
         STAMR3RegisterF(pVM, &pVCpu->iem.s.cbWritten,                 STAMTYPE_U32,       STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
                         "Approx bytes written",              "/IEM/CPU%u/cbWritten", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbHits,          STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Code TLB hits",                     "/IEM/CPU%u/CodeTlb/Hits", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbMisses,        STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Code TLB misses",                   "/IEM/CPU%u/CodeTlb/Misses", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbHits,          STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Data TLB hits",                     "/IEM/CPU%u/DataTlb/Hits", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbMisses,        STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Data TLB misses",                   "/IEM/CPU%u/DataTlb/Misses", idCpu);
 
         /*
          * Host and guest CPU information.
@@ -88,6 +96,13 @@ VMMR3DECL(int)      IEMR3Init(PVM pVM)
             pVCpu->iem.s.enmHostCpuVendor         = pVM->aCpus[0].iem.s.enmHostCpuVendor;
         }
 
+        /*
+         * Start out with empty TLBs.  The revision must never be zero as
+         * that's what unused entries are tagged with.
+         */
+        pVCpu->iem.s.CodeTlb.uTlbRevision = IEMTLB_REVISION_INCR;
+        pVCpu->iem.s.DataTlb.uTlbRevision = IEMTLB_REVISION_INCR;
+
         /*
          * Mark all buffers free.
          */
@@ -86,6 +86,23 @@
  * mapped into the physical memory address space, it can be accessed in a number
  * of ways thru PGM.
  *
+ *
+ * @section sec_iom_locking     Locking
+ *
+ * The range trees are protected by a read/write critical section, which EMTs
+ * enter shared for lookups and registration code enters exclusively.  On SMP
+ * guests even the shared enter means bouncing a cache line between all the
+ * EMTs doing MMIO, so the common case of hitting the per-VCPU MMIO range cache
+ * is done without the lock in non-statistics builds: the EMT flags that it's
+ * doing a lockless lookup, checks the cache generation and retains the range.
+ * Invalidating the caches bumps the generation and waits for the flagged EMTs,
+ * which is cheap since it only happens when ranges are (de)registered.
+ *
+ * The access is then dispatched under the device critical section.  Devices
+ * that are thread-safe by themselves can declare so by using the NOP critical
+ * section (PDMDevHlpCritSectGetNop), in which case no lock is taken at all on
+ * the way from the VM exit to the device callback.
+ *
  */
 
 /** @todo MMIO - simplifying the device end.
@@ -117,6 +134,7 @@
 #include <iprt/assert.h>
 #include <iprt/alloc.h>
 #include <iprt/string.h>
+#include <iprt/thread.h>
 #include <VBox/log.h>
 #include <VBox/err.h>
 
@@ -217,10 +235,17 @@ VMMR3_INT_DECL(int) IOMR3Init(PVM pVM)
 #endif
         STAM_REG(pVM, &pVM->iom.s.StatRZInstOther,        STAMTYPE_COUNTER, "/IOM/RZ-MMIOHandler/Inst/Other",           STAMUNIT_OCCURENCES,     "Other instructions counter.");
         STAM_REG(pVM, &pVM->iom.s.StatR3MMIOHandler,      STAMTYPE_COUNTER, "/IOM/R3-MMIOHandler",                      STAMUNIT_OCCURENCES,     "Number of calls to IOMR3MMIOHandler.");
+#ifdef VBOX_WITH_STATISTICS
+        STAM_REG(pVM, &pVM->iom.s.pTreesR3->MmioReadLatency,  STAMTYPE_HISTOGRAM, "/IOM/MMIO-ReadLatency",        STAMUNIT_TICKS,          "Latency distribution of the MMIO read callbacks.");
+        STAM_REG(pVM, &pVM->iom.s.pTreesR3->MmioWriteLatency, STAMTYPE_HISTOGRAM, "/IOM/MMIO-WriteLatency",       STAMUNIT_TICKS,          "Latency distribution of the MMIO write callbacks.");
+#endif
         STAM_REG(pVM, &pVM->iom.s.StatInstIn,             STAMTYPE_COUNTER, "/IOM/IOWork/In",                           STAMUNIT_OCCURENCES,     "Counter of any IN instructions.");
         STAM_REG(pVM, &pVM->iom.s.StatInstOut,            STAMTYPE_COUNTER, "/IOM/IOWork/Out",                          STAMUNIT_OCCURENCES,     "Counter of any OUT instructions.");
         STAM_REG(pVM, &pVM->iom.s.StatInstIns,            STAMTYPE_COUNTER, "/IOM/IOWork/Ins",                          STAMUNIT_OCCURENCES,     "Counter of any INS instructions.");
         STAM_REG(pVM, &pVM->iom.s.StatInstOuts,           STAMTYPE_COUNTER, "/IOM/IOWork/Outs",                         STAMUNIT_OCCURENCES,     "Counter of any OUTS instructions.");
+        STAM_REG(pVM, &pVM->iom.s.StatStrIoBuf,           STAMTYPE_COUNTER, "/IOM/IOWork/StrBuf",                       STAMUNIT_OCCURENCES,     "String I/O requests passed to the device as one buffer.");
+        STAM_REG(pVM, &pVM->iom.s.StatStrIoBufUnits,      STAMTYPE_COUNTER, "/IOM/IOWork/StrBufUnits",                  STAMUNIT_OCCURENCES,     "Transfer units moved by the buffered string I/O callbacks.");
+        STAM_REG(pVM, &pVM->iom.s.StatStrIoSlowPath,      STAMTYPE_COUNTER, "/IOM/IOWork/StrSlowPath",                  STAMUNIT_OCCURENCES,     "String I/O requests done one unit at a time because the device doesn't batch them.");
     }
 
     /* Redundant, but just in case we change something in the future */
@@ -244,9 +269,19 @@ static void iomR3FlushCache(PVM pVM)
      * access to the critical section and then safely update the caches of
      * other EMTs.
      * (1) The irrelvant access not holding the lock is in assertion code.
+     *
+     * The exception is the lockless MMIO range lookup, which we get out of
+     * the way by bumping the generation and waiting for EMTs still in the
+     * middle of one (see iomMmioGetRangeCachedWithRef).
      */
     IOM_LOCK_EXCL(pVM);
+    ASMAtomicIncU32(&pVM->iom.s.uMmioGen);
     VMCPUID iCpu = pVM->cCpus;
+    while (iCpu-- > 0)
+        while (ASMAtomicReadBool(&pVM->aCpus[iCpu].iom.s.fMmioLockless))
+            RTThreadYield();
+
+    iCpu = pVM->cCpus;
     while (iCpu-- > 0)
     {
         PVMCPU pVCpu = &pVM->aCpus[iCpu];
@@ -847,6 +882,172 @@ VMMR3_INT_DECL(int) IOMR3IOPortRegisterR0(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
 }
 
 
+/**
+ * Adds buffered string I/O callbacks to already registered R3 I/O port ranges.
+ *
+ * This API is called by PDM on behalf of a device.  The ports must already be
+ * covered by ranges registered by the same device using
+ * IOMR3IOPortRegisterR3(), and the ranges must lie entirely within the
+ * specified port range.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pVM                     Pointer to the VM.
+ * @param   pDevIns                 PDM device instance owning the port range.
+ * @param   PortStart               First port number in the range.
+ * @param   cPorts                  Number of ports.
+ * @param   pfnOutStrBufCallback    Pointer to function which is gonna handle
+ *                                  buffered string OUT operations in R3.
+ *                                  Optional.
+ * @param   pfnInStrBufCallback     Pointer to function which is gonna handle
+ *                                  buffered string IN operations in R3.
+ *                                  Optional.
+ */
+VMMR3_INT_DECL(int) IOMR3IOPortRegisterStrBufR3(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT PortStart, RTUINT cPorts,
+                                                R3PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnOutStrBufCallback,
+                                                R3PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnInStrBufCallback)
+{
+    LogFlow(("IOMR3IOPortRegisterStrBufR3: pDevIns=%p PortStart=%#x cPorts=%#x pfnOutStrBufCallback=%p pfnInStrBufCallback=%p\n",
+             pDevIns, PortStart, cPorts, pfnOutStrBufCallback, pfnInStrBufCallback));
+
+    /*
+     * Validate input.
+     */
+    if (    (RTUINT)PortStart + cPorts <= (RTUINT)PortStart
+        ||  (RTUINT)PortStart + cPorts > 0x10000)
+    {
+        AssertMsgFailed(("Invalid port range %#x-%#x!\n", PortStart, (RTUINT)PortStart + (cPorts - 1)));
+        return VERR_IOM_INVALID_IOPORT_RANGE;
+    }
+    RTIOPORT const PortLast = PortStart + (cPorts - 1);
+
+    IOM_LOCK_EXCL(pVM);
+
+    /*
+     * Check all the ranges first so we don't end up with a half done job.
+     */
+    RTIOPORT Port = PortStart;
+    while (Port <= PortLast && Port >= PortStart)
+    {
+        PIOMIOPORTRANGER3 pRange = (PIOMIOPORTRANGER3)RTAvlroIOPortRangeGet(&pVM->iom.s.pTreesR3->IOPortTreeR3, Port);
+        if (!pRange || pRange->Core.Key < PortStart || pRange->Core.KeyLast > PortLast)
+        {
+            AssertMsgFailed(("No matching R3 range! Port=%#x %#x-%#x\n", Port, PortStart, PortLast));
+            IOM_UNLOCK_EXCL(pVM);
+            return VERR_IOM_NO_R3_IOPORT_RANGE;
+        }
+        if (pRange->pDevIns != pDevIns)
+        {
+            AssertMsgFailed(("Not owner! Port=%#x %#x-%#x! (%s)\n", Port, PortStart, PortLast, pRange->pszDesc));
+            IOM_UNLOCK_EXCL(pVM);
+            return VERR_IOM_NOT_IOPORT_RANGE_OWNER;
+        }
+        Port = pRange->Core.KeyLast + 1;
+    }
+
+    /*
+     * Install the callbacks.
+     */
+    Port = PortStart;
+    while (Port <= PortLast && Port >= PortStart)
+    {
+        PIOMIOPORTRANGER3 pRange = (PIOMIOPORTRANGER3)RTAvlroIOPortRangeGet(&pVM->iom.s.pTreesR3->IOPortTreeR3, Port);
+        pRange->pfnOutStrBufCallback = pfnOutStrBufCallback;
+        pRange->pfnInStrBufCallback  = pfnInStrBufCallback;
+        Port = pRange->Core.KeyLast + 1;
+    }
+
+    /* The EMTs may have these ports cached as lacking the callbacks. */
+    iomR3FlushCache(pVM);
+
+    IOM_UNLOCK_EXCL(pVM);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Adds buffered string I/O callbacks to already registered R0 I/O port ranges.
+ *
+ * This API is called by PDM on behalf of a device.  The ports must already be
+ * covered by ranges registered by the same device using
+ * IOMR3IOPortRegisterR0(), and the ranges must lie entirely within the
+ * specified port range.
+ *
+ * @returns VBox status code.
+ *
+ * @param   pVM                     Pointer to the VM.
+ * @param   pDevIns                 PDM device instance owning the port range.
+ * @param   PortStart               First port number in the range.
+ * @param   cPorts                  Number of ports.
+ * @param   pfnOutStrBufCallback    Pointer to function which is gonna handle
+ *                                  buffered string OUT operations in R0.
+ *                                  Optional.
+ * @param   pfnInStrBufCallback     Pointer to function which is gonna handle
+ *                                  buffered string IN operations in R0.
+ *                                  Optional.
+ */
+VMMR3_INT_DECL(int) IOMR3IOPortRegisterStrBufR0(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT PortStart, RTUINT cPorts,
+                                                R0PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnOutStrBufCallback,
+                                                R0PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnInStrBufCallback)
+{
+    LogFlow(("IOMR3IOPortRegisterStrBufR0: pDevIns=%p PortStart=%#x cPorts=%#x pfnOutStrBufCallback=%RHv pfnInStrBufCallback=%RHv\n",
+             pDevIns, PortStart, cPorts, pfnOutStrBufCallback, pfnInStrBufCallback));
+
+    /*
+     * Validate input.
+     */
+    if (    (RTUINT)PortStart + cPorts <= (RTUINT)PortStart
+        ||  (RTUINT)PortStart + cPorts > 0x10000)
+    {
+        AssertMsgFailed(("Invalid port range %#x-%#x!\n", PortStart, (RTUINT)PortStart + (cPorts - 1)));
+        return VERR_IOM_INVALID_IOPORT_RANGE;
+    }
+    RTIOPORT const PortLast = PortStart + (cPorts - 1);
+
+    IOM_LOCK_EXCL(pVM);
+
+    /*
+     * Check all the ranges first so we don't end up with a half done job.
+     */
+    RTIOPORT Port = PortStart;
+    while (Port <= PortLast && Port >= PortStart)
+    {
+        PIOMIOPORTRANGER0 pRange = (PIOMIOPORTRANGER0)RTAvlroIOPortRangeGet(&pVM->iom.s.pTreesR3->IOPortTreeR0, Port);
+        if (!pRange || pRange->Core.Key < PortStart || pRange->Core.KeyLast > PortLast)
+        {
+            AssertMsgFailed(("No matching R0 range! Port=%#x %#x-%#x\n", Port, PortStart, PortLast));
+            IOM_UNLOCK_EXCL(pVM);
+            return VERR_IOM_IOPORT_RANGE_NOT_FOUND;
+        }
+        if (pRange->pDevIns != MMHyperR3ToR0(pVM, pDevIns))
+        {
+            AssertMsgFailed(("Not owner! Port=%#x %#x-%#x! (%s)\n", Port, PortStart, PortLast, pRange->pszDesc));
+            IOM_UNLOCK_EXCL(pVM);
+            return VERR_IOM_NOT_IOPORT_RANGE_OWNER;
+        }
+        Port = pRange->Core.KeyLast + 1;
+    }
+
+    /*
+     * Install the callbacks.
+     */
+    Port = PortStart;
+    while (Port <= PortLast && Port >= PortStart)
+    {
+        PIOMIOPORTRANGER0 pRange = (PIOMIOPORTRANGER0)RTAvlroIOPortRangeGet(&pVM->iom.s.pTreesR3->IOPortTreeR0, Port);
+        pRange->pfnOutStrBufCallback = pfnOutStrBufCallback;
+        pRange->pfnInStrBufCallback  = pfnInStrBufCallback;
+        Port = pRange->Core.KeyLast + 1;
+    }
+
+    /* The EMTs may have these ports cached as lacking the callbacks. */
+    iomR3FlushCache(pVM);
+
+    IOM_UNLOCK_EXCL(pVM);
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Deregisters a I/O Port range.
  *
@@ -1667,6 +1868,53 @@ VMMR3_INT_DECL(int) IOMR3MmioDeregister(PVM pVM, PPDMDEVINS pDevIns, RTGCPHYS GC
 }
 
 
+/**
+ * Gets the description of the I/O port or MMIO range covering an address.
+ *
+ * This is for attributing things like VM-exits to devices.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_FOUND if no range covers the address.
+ * @param   pVM         Pointer to the VM.
+ * @param   fMmio       Set if @a uAddr is a guest physical MMIO address, clear
+ *                      if it is an I/O port.
+ * @param   uAddr       The I/O port or guest physical address.
+ * @param   pszDesc     Where to return the description.
+ * @param   cbDesc      The size of the buffer @a pszDesc points to.
+ */
+VMMR3_INT_DECL(int) IOMR3QueryRangeDesc(PVM pVM, bool fMmio, RTGCPHYS uAddr, char *pszDesc, size_t cbDesc)
+{
+    AssertReturn(cbDesc, VERR_BUFFER_OVERFLOW);
+    *pszDesc = '\0';
+    if (!fMmio && uAddr > UINT16_MAX)
+        return VERR_NOT_FOUND;
+
+    int rc = IOM_LOCK_SHARED(pVM);
+    AssertRCReturn(rc, rc);
+
+    const char *pszRangeDesc = NULL;
+    if (fMmio)
+    {
+        PIOMMMIORANGE pRange = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.pTreesR3->MMIOTree, uAddr);
+        if (pRange)
+            pszRangeDesc = pRange->pszDesc;
+    }
+    else
+    {
+        PIOMIOPORTRANGER3 pRange = iomIOPortGetRangeR3(pVM, (RTIOPORT)uAddr);
+        if (pRange)
+            pszRangeDesc = pRange->pszDesc;
+    }
+    if (pszRangeDesc)
+        rc = RTStrCopy(pszDesc, cbDesc, pszRangeDesc);
+    else
+        rc = VERR_NOT_FOUND;
+
+    IOM_UNLOCK_SHARED(pVM);
+    return rc;
+}
+
+
 /**
  * Display a single MMIO range.
  *
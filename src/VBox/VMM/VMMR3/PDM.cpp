@@ -344,6 +344,8 @@ VMMR3_INT_DECL(int) PDMR3InitUVM(PUVM pUVM)
     pUVM->pdm.s.pModules   = NULL;
     pUVM->pdm.s.pCritSects = NULL;
     pUVM->pdm.s.pRwCritSects = NULL;
+    pUVM->pdm.s.hConstructPool = NIL_RTREQPOOL;
+    pUVM->pdm.s.pConstructWork = NULL;
     return RTCritSectInit(&pUVM->pdm.s.ListCritSect);
 }
 
@@ -357,6 +359,7 @@ VMMR3_INT_DECL(int) PDMR3InitUVM(PUVM pUVM)
 VMMR3_INT_DECL(int) PDMR3Init(PVM pVM)
 {
     LogFlow(("PDMR3Init\n"));
+    uint64_t const u64StartTS = RTTimeNanoTS();
 
     /*
      * Assert alignment and sizes.
@@ -400,12 +403,18 @@ VMMR3_INT_DECL(int) PDMR3Init(PVM pVM)
 #endif
     if (RT_SUCCESS(rc))
         rc = pdmR3BlkCacheInit(pVM);
+    uint64_t const u64DrvInitTS = RTTimeNanoTS();
     if (RT_SUCCESS(rc))
         rc = pdmR3DrvInit(pVM);
+    uint64_t const u64DevInitTS = RTTimeNanoTS();
     if (RT_SUCCESS(rc))
         rc = pdmR3DevInit(pVM);
     if (RT_SUCCESS(rc))
     {
+        uint64_t const u64DoneTS = RTTimeNanoTS();
+        LogRel(("PDM: Init took %'llu ns: subsystems %'llu ns, driver modules %'llu ns, devices %'llu ns\n",
+                u64DoneTS - u64StartTS, u64DrvInitTS - u64StartTS, u64DevInitTS - u64DrvInitTS, u64DoneTS - u64DevInitTS));
+
         /*
          * Register the saved state data unit.
          */
@@ -630,6 +639,11 @@ VMMR3_INT_DECL(int) PDMR3Term(PVM pVM)
     LogFlow(("PDMR3Term:\n"));
     AssertMsg(PDMCritSectIsInitialized(&pVM->pdm.s.CritSect), ("bad init order!\n"));
 
+    /*
+     * Construction work might still be executing if VM creation failed.
+     */
+    pdmR3DrvConstructWorkTerm(pVM);
+
     /*
      * Iterate the device instances and attach drivers, doing
      * relevant destruction processing.
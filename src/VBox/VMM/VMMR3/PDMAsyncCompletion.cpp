@@ -23,6 +23,7 @@
 #include "PDMInternal.h"
 #include <VBox/vmm/pdm.h>
 #include <VBox/vmm/mm.h>
+#include <VBox/vmm/dbgftrace.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
 #endif
@@ -780,6 +781,9 @@ void pdmR3AsyncCompletionCompleteTask(PPDMASYNCCOMPLETIONTASK pTask, int rc, boo
 {
     LogFlow(("%s: pTask=%#p fCallCompletionHandler=%RTbool\n", __FUNCTION__, pTask, fCallCompletionHandler));
 
+    DBGFR3TraceRingAddSpan(pTask->pEndpoint->pEpClass->pVM, DBGFTRACEEVT_ASYNC_IO, RTTimeNanoTS() - pTask->tsNsStart,
+                           (uintptr_t)pTask->pEndpoint, 0 /*uValue*/, rc);
+
     if (fCallCompletionHandler)
     {
         PPDMASYNCCOMPLETIONTEMPLATE pTemplate = pTask->pEndpoint->pTemplate;
@@ -23,7 +23,10 @@
 #include "PDMInternal.h"
 #include <VBox/vmm/pdmcritsect.h>
 #include <VBox/vmm/pdmcritsectrw.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/dbgf.h>
 #include <VBox/vmm/mm.h>
+#include <VBox/vmm/tm.h>
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
 
@@ -32,7 +35,10 @@
 #include <VBox/sup.h>
 #include <iprt/asm.h>
 #include <iprt/assert.h>
+#include <iprt/ctype.h>
 #include <iprt/lockvalidator.h>
+#include <iprt/mem.h>
+#include <iprt/sort.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
 
@@ -42,6 +48,7 @@
 *******************************************************************************/
 static int pdmR3CritSectDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTINT pCritSect, PPDMCRITSECTINT pPrev, bool fFinal);
 static int pdmR3CritSectRwDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTRWINT pCritSect, PPDMCRITSECTRWINT pPrev, bool fFinal);
+static DECLCALLBACK(void) pdmR3CritSectInfoContention(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 
 
 
@@ -55,10 +62,71 @@ int pdmR3CritSectBothInitStats(PVM pVM)
 {
     STAM_REG(pVM, &pVM->pdm.s.StatQueuedCritSectLeaves, STAMTYPE_COUNTER, "/PDM/QueuedCritSectLeaves", STAMUNIT_OCCURENCES,
              "Number of times a critical section leave request needed to be queued for ring-3 execution.");
+    DBGFR3InfoRegisterInternal(pVM, "critsectcontention",
+                               "Displays critical section contention statistics. Arguments: [all] [name-pattern]",
+                               pdmR3CritSectInfoContention);
     return VINF_SUCCESS;
 }
 
 
+/**
+ * Assigns a contention statistics entry to a critical section.
+ *
+ * The table is allocated from the hyper heap on the first call.  Running out of
+ * entries isn't fatal, the critical section just won't be profiled then.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pCritSect   The critical section.
+ *
+ * @remarks Caller must have entered the ListCritSect.
+ */
+static void pdmR3CritSectContentionAlloc(PVM pVM, PPDMCRITSECTINT pCritSect)
+{
+    pCritSect->idxContention = 0;
+
+    if (!pVM->pdm.s.fCritSectContentionInited)
+    {
+        pVM->pdm.s.fCritSectContentionInited = true;
+
+        /** @cfgm{/PDM/CritSectContentionEntries, uint32_t, 128 for SMP; 0 for UP}
+         * The number of critical sections which can have contention statistics
+         * (wait profiles and top contending callers).  Each entry costs about half
+         * a KB of hyper heap, so this is disabled by default for uniprocessor VMs
+         * where there is little to be learned.  Max 4096. */
+        uint32_t cEntries;
+        int rc = CFGMR3QueryU32Def(CFGMR3GetChild(CFGMR3GetRoot(pVM), "PDM"), "CritSectContentionEntries", &cEntries,
+                                   pVM->cCpus > 1 ? 128 : 0);
+        AssertLogRelMsgStmt(RT_SUCCESS(rc), ("%Rrc\n", rc), cEntries = 0);
+        cEntries = RT_MIN(cEntries, 4096);
+        if (cEntries)
+        {
+            void *pv;
+            rc = MMHyperAlloc(pVM, sizeof(PDMCRITSECTCONTENTION) * cEntries, 0, MM_TAG_PDM, &pv);
+            if (RT_SUCCESS(rc))
+            {
+                pVM->pdm.s.paCritSectContentionR3 = (PPDMCRITSECTCONTENTION)pv;
+                pVM->pdm.s.paCritSectContentionR0 = MMHyperR3ToR0(pVM, pv);
+                pVM->pdm.s.cCritSectContention    = cEntries;
+            }
+            else
+                LogRel(("PDM: Failed to allocate %u critical section contention entries: %Rrc\n", cEntries, rc));
+        }
+    }
+
+    PPDMCRITSECTCONTENTION paEntries = pVM->pdm.s.paCritSectContentionR3;
+    for (uint32_t i = 0; i < pVM->pdm.s.cCritSectContention; i++)
+        if (!paEntries[i].pCritSect)
+        {
+            RT_ZERO(paEntries[i]);
+            paEntries[i].StatWaitR3.cTicksMin = UINT64_MAX;
+            paEntries[i].StatWaitR0.cTicksMin = UINT64_MAX;
+            paEntries[i].pCritSect = pCritSect;
+            pCritSect->idxContention = (uint16_t)(i + 1);
+            break;
+        }
+}
+
+
 /**
  * Relocates all the critical sections.
  *
@@ -185,15 +253,23 @@ static int pdmR3CritSectInitOne(PVM pVM, PPDMCRITSECTINT pCritSect, void *pvKey,
                 pCritSect->EventToSignal             = NIL_RTSEMEVENT;
                 pCritSect->pszName                   = pszName;
 
+                PUVM pUVM = pVM->pUVM;
+                RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
+                pdmR3CritSectContentionAlloc(pVM, pCritSect);
+
                 STAMR3RegisterF(pVM, &pCritSect->StatContentionRZLock,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSects/%s/ContentionRZLock", pCritSect->pszName);
                 STAMR3RegisterF(pVM, &pCritSect->StatContentionRZUnlock,STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSects/%s/ContentionRZUnlock", pCritSect->pszName);
                 STAMR3RegisterF(pVM, &pCritSect->StatContentionR3,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSects/%s/ContentionR3", pCritSect->pszName);
 #ifdef VBOX_WITH_STATISTICS
                 STAMR3RegisterF(pVM, &pCritSect->StatLocked,        STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_OCCURENCE, NULL, "/PDM/CritSects/%s/Locked", pCritSect->pszName);
 #endif
+                if (pCritSect->idxContention)
+                {
+                    PPDMCRITSECTCONTENTION pContention = &pVM->pdm.s.paCritSectContentionR3[pCritSect->idxContention - 1];
+                    STAMR3RegisterF(pVM, &pContention->StatWaitR3,  STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,      "Blocking waits in ring-3.", "/PDM/CritSects/%s/WaitR3", pCritSect->pszName);
+                    STAMR3RegisterF(pVM, &pContention->StatWaitR0,  STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,      "Blocking waits in ring-0.", "/PDM/CritSects/%s/WaitR0", pCritSect->pszName);
+                }
 
-                PUVM pUVM = pVM->pUVM;
-                RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
                 pCritSect->pNext = pUVM->pdm.s.pCritSects;
                 pUVM->pdm.s.pCritSects = pCritSect;
                 RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
@@ -519,6 +595,12 @@ static int pdmR3CritSectDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTINT pCritSect,
     int rc = SUPSemEventClose(pVM->pSession, hEvent);
     AssertRC(rc);
     RTLockValidatorRecExclDestroy(&pCritSect->Core.pValidatorRec);
+    if (pCritSect->idxContention)
+    {
+        Assert(pVM->pdm.s.paCritSectContentionR3[pCritSect->idxContention - 1].pCritSect == pCritSect);
+        pVM->pdm.s.paCritSectContentionR3[pCritSect->idxContention - 1].pCritSect = NULL;
+        pCritSect->idxContention = 0;
+    }
     pCritSect->pNext   = NULL;
     pCritSect->pvKey   = NULL;
     pCritSect->pVMR3   = NULL;
@@ -1095,3 +1177,147 @@ VMMR3DECL(RCPTRTYPE(PPDMCRITSECT))  PDMR3CritSectGetNopRC(PVM pVM)
     return MMHyperR3ToRC(pVM, &pVM->pdm.s.NopCritSect);
 }
 
+
+
+/**
+ * @callback_method_impl{FNRTSORTCMP, Sorts contention entries by total wait
+ *                      time, busiest first.}
+ */
+static DECLCALLBACK(int) pdmR3CritSectContentionCompare(void const *pvElement1, void const *pvElement2, void *pvUser)
+{
+    PPDMCRITSECTCONTENTION pEntry1 = (PPDMCRITSECTCONTENTION)pvElement1;
+    PPDMCRITSECTCONTENTION pEntry2 = (PPDMCRITSECTCONTENTION)pvElement2;
+    uint64_t const cTicks1 = pEntry1->StatWaitR3.cTicks + pEntry1->StatWaitR0.cTicks;
+    uint64_t const cTicks2 = pEntry2->StatWaitR3.cTicks + pEntry2->StatWaitR0.cTicks;
+    NOREF(pvUser);
+    return cTicks1 > cTicks2 ? -1 : cTicks1 < cTicks2 ? 1 : 0;
+}
+
+
+/**
+ * Displays the wait profile of one context.
+ *
+ * @param   pHlp            The info helpers.
+ * @param   pszCtx          The context name.
+ * @param   pProfile        The wait profile.
+ * @param   cTicksPerUs     The number of ticks per microsecond.
+ */
+static void pdmR3CritSectInfoWaitProfile(PCDBGFINFOHLP pHlp, const char *pszCtx, PCSTAMPROFILE pProfile, uint64_t cTicksPerUs)
+{
+    uint64_t const cPeriods = pProfile->cPeriods;
+    if (cPeriods)
+        pHlp->pfnPrintf(pHlp, "  %s: %RU64 waits, %RU64 us total, %RU64 us avg, %RU64 us max\n",
+                        pszCtx, cPeriods, pProfile->cTicks / cTicksPerUs, pProfile->cTicks / cPeriods / cTicksPerUs,
+                        pProfile->cTicksMax / cTicksPerUs);
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, critsectcontention}
+ */
+static DECLCALLBACK(void) pdmR3CritSectInfoContention(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    /*
+     * Parse the arguments: [all] [name-pattern]
+     */
+    bool        fAll       = false;
+    const char *pszPattern = NULL;
+    if (pszArgs)
+    {
+        pszArgs = RTStrStripL(pszArgs);
+        if (!strncmp(pszArgs, "all", 3) && (!pszArgs[3] || RT_C_IS_SPACE(pszArgs[3])))
+        {
+            fAll = true;
+            pszArgs = RTStrStripL(pszArgs + 3);
+        }
+        if (*pszArgs)
+            pszPattern = pszArgs;
+    }
+
+    uint32_t const cEntries = pVM->pdm.s.cCritSectContention;
+    if (!cEntries)
+    {
+        pHlp->pfnPrintf(pHlp, "Critical section contention statistics are disabled (see /PDM/CritSectContentionEntries).\n");
+        return;
+    }
+
+    PPDMCRITSECTCONTENTION *papEntries = (PPDMCRITSECTCONTENTION *)RTMemTmpAlloc(sizeof(papEntries[0]) * cEntries);
+    if (!papEntries)
+    {
+        pHlp->pfnPrintf(pHlp, "Out of memory!\n");
+        return;
+    }
+
+    /*
+     * Collect the matching entries and sort them, busiest first.
+     */
+    PUVM pUVM = pVM->pUVM;
+    RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
+
+    uint32_t cFound = 0;
+    for (uint32_t i = 0; i < cEntries; i++)
+    {
+        PPDMCRITSECTCONTENTION pEntry = &pVM->pdm.s.paCritSectContentionR3[i];
+        if (   pEntry->pCritSect
+            && (fAll || pEntry->StatWaitR3.cPeriods || pEntry->StatWaitR0.cPeriods)
+            && (!pszPattern || RTStrSimplePatternMatch(pszPattern, pEntry->pCritSect->pszName)))
+            papEntries[cFound++] = pEntry;
+    }
+    RTSortApvShell((void **)papEntries, cFound, pdmR3CritSectContentionCompare, NULL);
+
+    /*
+     * Display them with the top contending callers of each.
+     */
+    uint64_t const cTicksPerUs = RT_MAX(TMCpuTicksPerSecond(pVM) / RT_US_1SEC, 1);
+    pHlp->pfnPrintf(pHlp, "%u critical section(s) (%s):\n", cFound, fAll ? "all profiled" : "contended");
+    for (uint32_t i = 0; i < cFound; i++)
+    {
+        PPDMCRITSECTCONTENTION pEntry = papEntries[i];
+        pHlp->pfnPrintf(pHlp, "%s:\n", pEntry->pCritSect->pszName);
+        pdmR3CritSectInfoWaitProfile(pHlp, "ring-3", &pEntry->StatWaitR3, cTicksPerUs);
+        pdmR3CritSectInfoWaitProfile(pHlp, "ring-0", &pEntry->StatWaitR0, cTicksPerUs);
+
+        /* Order the callers by time spent waiting (it's a short list). */
+        uint32_t const cCallers = RT_MIN(pEntry->cCallers, RT_ELEMENTS(pEntry->aCallers));
+        uint32_t       aiCallers[RT_ELEMENTS(pEntry->aCallers)];
+        for (uint32_t j = 0; j < cCallers; j++)
+        {
+            uint32_t k = j;
+            while (k > 0 && pEntry->aCallers[aiCallers[k - 1]].cTicksWaited < pEntry->aCallers[j].cTicksWaited)
+            {
+                aiCallers[k] = aiCallers[k - 1];
+                k--;
+            }
+            aiCallers[k] = j;
+        }
+
+        for (uint32_t j = 0; j < cCallers; j++)
+        {
+            PPDMCRITSECTCALLER pCaller = &pEntry->aCallers[aiCallers[j]];
+            pHlp->pfnPrintf(pHlp, "    %10RU64 waits %12RU64 us  %s %RHv",
+                            pCaller->cWaits, pCaller->cTicksWaited / cTicksPerUs, pCaller->fRing0 ? "R0" : "R3", pCaller->uId);
+
+            RTDBGSYMBOL Sym;
+            RTGCINTPTR  offDisp;
+            DBGFADDRESS Addr;
+            if (   pCaller->fRing0
+                && pCaller->uId
+                && RT_SUCCESS(DBGFR3AsSymbolByAddr(pUVM, DBGF_AS_R0, DBGFR3AddrFromFlat(pUVM, &Addr, pCaller->uId),
+                                                   RTDBGSYMADDR_FLAGS_LESS_OR_EQUAL, &offDisp, &Sym, NULL /*phMod*/)))
+                pHlp->pfnPrintf(pHlp, " %s+%#RX64", Sym.szName, (uint64_t)offDisp);
+            if (pCaller->pszFunction)
+                pHlp->pfnPrintf(pHlp, " %s", pCaller->pszFunction);
+            if (pCaller->pszFile)
+                pHlp->pfnPrintf(pHlp, " (%s:%u)", pCaller->pszFile, pCaller->uLine);
+            else if (pCaller->uLine)
+                pHlp->pfnPrintf(pHlp, " (line %u)", pCaller->uLine);
+            pHlp->pfnPrintf(pHlp, "\n");
+        }
+        if (pEntry->cOtherWaits)
+            pHlp->pfnPrintf(pHlp, "    %10RU64 waits %12RU64 us  (other callers)\n",
+                            pEntry->cOtherWaits, pEntry->cTicksOtherWaited / cTicksPerUs);
+    }
+
+    RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+    RTMemTmpFree(papEntries);
+}
@@ -257,6 +257,65 @@ static DECLCALLBACK(int) pdmR3DevHlp_IOPortRegisterR0(PPDMDEVINS pDevIns, RTIOPO
 }
 
 
+/** @interface_method_impl{PDMDEVHLPR3,pfnIOPortRegisterStrBuf} */
+static DECLCALLBACK(int) pdmR3DevHlp_IOPortRegisterStrBuf(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts,
+                                                          PFNIOMIOPORTOUTSTRBUF pfnOutStrBuf, PFNIOMIOPORTINSTRBUF pfnInStrBuf)
+{
+    PDMDEV_ASSERT_DEVINS(pDevIns);
+    VM_ASSERT_EMT(pDevIns->Internal.s.pVMR3);
+    LogFlow(("pdmR3DevHlp_IOPortRegisterStrBuf: caller='%s'/%d: Port=%#x cPorts=%#x pfnOutStrBuf=%p pfnInStrBuf=%p\n",
+             pDevIns->pReg->szName, pDevIns->iInstance, Port, cPorts, pfnOutStrBuf, pfnInStrBuf));
+
+    int rc = IOMR3IOPortRegisterStrBufR3(pDevIns->Internal.s.pVMR3, pDevIns, Port, cPorts, pfnOutStrBuf, pfnInStrBuf);
+
+    LogFlow(("pdmR3DevHlp_IOPortRegisterStrBuf: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
+    return rc;
+}
+
+
+/** @interface_method_impl{PDMDEVHLPR3,pfnIOPortRegisterStrBufR0} */
+static DECLCALLBACK(int) pdmR3DevHlp_IOPortRegisterStrBufR0(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts,
+                                                            const char *pszOutStrBuf, const char *pszInStrBuf)
+{
+    PDMDEV_ASSERT_DEVINS(pDevIns);
+    VM_ASSERT_EMT(pDevIns->Internal.s.pVMR3);
+    LogFlow(("pdmR3DevHlp_IOPortRegisterStrBufR0: caller='%s'/%d: Port=%#x cPorts=%#x pszOutStrBuf=%p:{%s} pszInStrBuf=%p:{%s}\n",
+             pDevIns->pReg->szName, pDevIns->iInstance, Port, cPorts, pszOutStrBuf, pszOutStrBuf, pszInStrBuf, pszInStrBuf));
+
+    /*
+     * Resolve the functions (both can be NULL).
+     */
+    int rc = VINF_SUCCESS;
+    if (    pDevIns->pReg->szR0Mod[0]
+        &&  (pDevIns->pReg->fFlags & PDM_DEVREG_FLAGS_R0))
+    {
+        R0PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnR0PtrInStrBuf = 0;
+        if (pszInStrBuf)
+        {
+            rc = pdmR3DevGetSymbolR0Lazy(pDevIns, pszInStrBuf, &pfnR0PtrInStrBuf);
+            AssertMsgRC(rc, ("Failed to resolve %s.%s (pszInStrBuf)\n", pDevIns->pReg->szR0Mod, pszInStrBuf));
+        }
+        R0PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnR0PtrOutStrBuf = 0;
+        if (pszOutStrBuf && RT_SUCCESS(rc))
+        {
+            rc = pdmR3DevGetSymbolR0Lazy(pDevIns, pszOutStrBuf, &pfnR0PtrOutStrBuf);
+            AssertMsgRC(rc, ("Failed to resolve %s.%s (pszOutStrBuf)\n", pDevIns->pReg->szR0Mod, pszOutStrBuf));
+        }
+
+        if (RT_SUCCESS(rc))
+            rc = IOMR3IOPortRegisterStrBufR0(pDevIns->Internal.s.pVMR3, pDevIns, Port, cPorts, pfnR0PtrOutStrBuf, pfnR0PtrInStrBuf);
+    }
+    else
+    {
+        AssertMsgFailed(("No R0 module for this driver!\n"));
+        rc = VERR_INVALID_PARAMETER;
+    }
+
+    LogFlow(("pdmR3DevHlp_IOPortRegisterStrBufR0: caller='%s'/%d: returns %Rrc\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
+    return rc;
+}
+
+
 /** @interface_method_impl{PDMDEVHLPR3,pfnIOPortDeregister} */
 static DECLCALLBACK(int) pdmR3DevHlp_IOPortDeregister(PPDMDEVINS pDevIns, RTIOPORT Port, RTIOPORT cPorts)
 {
@@ -3521,8 +3580,8 @@ const PDMDEVHLPR3 g_pdmR3DevHlpTrusted =
     pdmR3DevHlp_CallR0,
     pdmR3DevHlp_VMGetSuspendReason,
     pdmR3DevHlp_VMGetResumeReason,
-    0,
-    0,
+    pdmR3DevHlp_IOPortRegisterStrBuf,
+    pdmR3DevHlp_IOPortRegisterStrBufR0,
     0,
     0,
     0,
@@ -3762,8 +3821,8 @@ const PDMDEVHLPR3 g_pdmR3DevHlpUnTrusted =
     pdmR3DevHlp_CallR0,
     pdmR3DevHlp_VMGetSuspendReason,
     pdmR3DevHlp_VMGetResumeReason,
-    0,
-    0,
+    pdmR3DevHlp_IOPortRegisterStrBuf,
+    pdmR3DevHlp_IOPortRegisterStrBufR0,
     0,
     0,
     0,
@@ -46,6 +46,7 @@
 #include <iprt/semaphore.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -112,6 +113,7 @@ int pdmR3DevInit(PVM pVM)
 
     AssertRelease(!(RT_OFFSETOF(PDMDEVINS, achInstanceData) & 15));
     AssertRelease(sizeof(pVM->pdm.s.pDevInstances->Internal.s) <= sizeof(pVM->pdm.s.pDevInstances->Internal.padding));
+    uint64_t const u64StartTS = RTTimeNanoTS();
 
     /*
      * Load device modules.
@@ -146,6 +148,7 @@ int pdmR3DevInit(PVM pVM)
     AssertRCReturn(rc, rc);
     pVM->pdm.s.pDevHlpQueueR0 = PDMQueueR0Ptr(pVM->pdm.s.pDevHlpQueueR3);
     pVM->pdm.s.pDevHlpQueueRC = PDMQueueRCPtr(pVM->pdm.s.pDevHlpQueueR3);
+    uint64_t const u64ModulesTS = RTTimeNanoTS();
 
 
     /*
@@ -169,7 +172,7 @@ int pdmR3DevInit(PVM pVM)
     if (!cDevs)
     {
         Log(("PDM: No devices were configured!\n"));
-        return VINF_SUCCESS;
+        return pdmR3DrvConstructWorkWaitAll(pVM);
     }
     Log2(("PDM: cDevs=%d!\n", cDevs));
 
@@ -390,7 +393,11 @@ int pdmR3DevInit(PVM pVM)
          */
         paDevs[i].pDev->cInstances++;
         Log(("PDM: Constructing device '%s' instance %d...\n", pDevIns->pReg->szName, pDevIns->iInstance));
+        uint64_t cNsElapsed = RTTimeNanoTS();
         rc = pDevIns->pReg->pfnConstruct(pDevIns, pDevIns->iInstance, pDevIns->pCfg);
+        cNsElapsed = RTTimeNanoTS() - cNsElapsed;
+        if (cNsElapsed >= PDMCONSTRUCT_LOG_AT_NS)
+            LogRel(("PDM: Device '%s'/%d took %'llu ns to construct\n", pDevIns->pReg->szName, pDevIns->iInstance, cNsElapsed));
         if (RT_FAILURE(rc))
         {
             LogRel(("PDM: Failed to construct '%s'/%d! %Rra\n", pDevIns->pReg->szName, pDevIns->iInstance, rc));
@@ -407,6 +414,18 @@ int pdmR3DevInit(PVM pVM)
     if (RT_FAILURE(rc))
         return rc;
 #endif
+    uint64_t const u64ConstructTS = RTTimeNanoTS();
+
+    /*
+     * Wait for the construction work the drivers queued.
+     */
+    rc = pdmR3DrvConstructWorkWaitAll(pVM);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("PDM: Driver construction work failed: %Rrc\n", rc));
+        return rc;
+    }
+    uint64_t const u64ConstructWorkTS = RTTimeNanoTS();
 
 
     /*
@@ -449,6 +468,11 @@ int pdmR3DevInit(PVM pVM)
         return rc;
 #endif
 
+    uint64_t const u64DoneTS = RTTimeNanoTS();
+    LogRel(("PDM: Device init took %'llu ns: modules %'llu ns, construction %'llu ns (%u devices), construction work %'llu ns, init complete %'llu ns\n",
+            u64DoneTS - u64StartTS, u64ModulesTS - u64StartTS, u64ConstructTS - u64ModulesTS, cDevs,
+            u64ConstructWorkTS - u64ConstructTS, u64DoneTS - u64ConstructWorkTS));
+
     LogFlow(("pdmR3DevInit: returns %Rrc\n", VINF_SUCCESS));
     return VINF_SUCCESS;
 }
@@ -28,6 +28,7 @@
 #include <VBox/vmm/vmm.h>
 #include <VBox/sup.h>
 #include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
 #include <VBox/version.h>
 #include <VBox/err.h>
 
@@ -36,9 +37,12 @@
 #include <iprt/asm.h>
 #include <iprt/ctype.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
 #include <iprt/thread.h>
 #include <iprt/path.h>
+#include <iprt/req.h>
 #include <iprt/string.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -64,12 +68,39 @@ typedef struct PDMDRVREGCBINT
 } PDMDRVREGCBINT, *PPDMDRVREGCBINT;
 typedef const PDMDRVREGCBINT *PCPDMDRVREGCBINT;
 
+/**
+ * Construction work queued by a driver, see PDMDRVHLPR3::pfnConstructWorkQueue.
+ */
+typedef struct PDMCONSTRUCTWORK
+{
+    /** Pointer to the next work item (LIFO). */
+    struct PDMCONSTRUCTWORK    *pNext;
+    /** The driver instance which queued the work. */
+    PPDMDRVINS                  pDrvIns;
+    /** The work callback. */
+    PFNPDMDRVCONSTRUCTWORK      pfnWork;
+    /** The user argument for the callback. */
+    void                       *pvUser;
+    /** RTTimeNanoTS() when the work was queued. */
+    uint64_t                    u64QueuedTS;
+    /** The number of nanoseconds the callback took to execute. */
+    uint64_t volatile           cNsRun;
+    /** The status returned by the callback. */
+    int32_t volatile            rc;
+    /** Set when the callback has returned. */
+    bool volatile               fDone;
+} PDMCONSTRUCTWORK;
+/** Pointer to driver construction work. */
+typedef PDMCONSTRUCTWORK *PPDMCONSTRUCTWORK;
+
 
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
 static DECLCALLBACK(int) pdmR3DrvRegister(PCPDMDRVREGCB pCallbacks, PCPDMDRVREG pReg);
 static int pdmR3DrvLoad(PVM pVM, PPDMDRVREGCBINT pRegCB, const char *pszFilename, const char *pszName);
+static int pdmR3DrvConstructWorkInit(PVM pVM);
+static int pdmR3DrvConstructWorkWaitDriver(PVM pVM, PPDMDRVINS pDrvIns);
 
 
 /**
@@ -209,8 +240,9 @@ int pdmR3DrvInit(PVM pVM)
             return rc;
     }
 
-    LogFlow(("pdmR3DrvInit: returns VINF_SUCCESS\n"));
-    return VINF_SUCCESS;
+    rc = pdmR3DrvConstructWorkInit(pVM);
+    LogFlow(("pdmR3DrvInit: returns %Rrc\n", rc));
+    return rc;
 }
 
 
@@ -750,7 +782,16 @@ int pdmR3DrvInstantiate(PVM pVM, PCFGMNODE pNode, PPDMIBASE pBaseInterface, PPDM
                     /*
                      * Invoke the constructor.
                      */
+                    uint64_t cNsElapsed = RTTimeNanoTS();
                     rc = pDrv->pReg->pfnConstruct(pNew, pNew->pCfg, 0 /*fFlags*/);
+                    cNsElapsed = RTTimeNanoTS() - cNsElapsed;
+                    if (cNsElapsed >= PDMCONSTRUCT_LOG_AT_NS)
+                        LogRel(("PDM: Driver '%s'/%d on LUN#%d of device '%s'/%d took %'llu ns to construct\n",
+                                pDrv->pReg->szName, pNew->iInstance,
+                                pLun ? (int)pLun->iLun : -1,
+                                !pLun ? "" : pLun->pDevIns ? pLun->pDevIns->pReg->szName : pLun->pUsbIns->pReg->szName,
+                                !pLun ? -1 : pLun->pDevIns ? pLun->pDevIns->iInstance    : pLun->pUsbIns->iInstance,
+                                cNsElapsed));
                     if (RT_SUCCESS(rc))
                     {
                         AssertPtr(pNew->IBase.pfnQueryInterface);
@@ -931,8 +972,10 @@ void pdmR3DrvDestroyChain(PPDMDRVINS pDrvIns, uint32_t fFlags)
         }
 
         /*
-         * Call destructor.
+         * Wait for construction work still executing on behalf of the driver
+         * and call the destructor.
          */
+        pdmR3DrvConstructWorkWaitDriver(pVM, pCur);
         pCur->pUpBase = NULL;
         if (pCur->pReg->pfnDestruct)
             pCur->pReg->pfnDestruct(pCur);
@@ -985,6 +1028,176 @@ void pdmR3DrvDestroyChain(PPDMDRVINS pDrvIns, uint32_t fFlags)
 }
 
 
+/**
+ * Creates the worker pool for parallel construction if configured.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+static int pdmR3DrvConstructWorkInit(PVM pVM)
+{
+    PUVM      pUVM    = pVM->pUVM;
+    PCFGMNODE pCfgPdm = CFGMR3GetChild(CFGMR3GetRoot(pVM), "PDM");
+    pUVM->pdm.s.hConstructPool  = NIL_RTREQPOOL;
+    pUVM->pdm.s.pConstructWork  = NULL;
+
+    /** @cfgm{PDM/ParallelConstruct, bool, false}
+     * Whether the construction work queued by drivers (opening images,
+     * connecting to host backends and such) is executed by a worker pool while
+     * EMT(0) continues constructing the other devices and drivers.  When
+     * disabled, the work is executed synchronously when queued. */
+    bool fParallel;
+    int rc = CFGMR3QueryBoolDef(pCfgPdm, "ParallelConstruct", &fParallel, false);
+    AssertLogRelRCReturn(rc, rc);
+    if (!fParallel)
+        return VINF_SUCCESS;
+
+    /** @cfgm{PDM/ParallelConstructThreads, uint32_t, online host CPUs up to 8}
+     * The max number of worker threads used for parallel construction. */
+    uint32_t cThreads;
+    rc = CFGMR3QueryU32Def(pCfgPdm, "ParallelConstructThreads", &cThreads, RT_MIN(RTMpGetOnlineCount(), 8));
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(cThreads >= 1 && cThreads <= 64,
+                          ("Configuration error: PDM/ParallelConstructThreads=%u is out of range (1..64)\n", cThreads),
+                          VERR_OUT_OF_RANGE);
+
+    rc = RTReqPoolCreate(cThreads, 1000 /*cMsMinIdle*/, UINT32_MAX /*cThreadsPushBackThreshold*/, 0 /*cMsMaxPushBack*/,
+                         "PDMCtor", &pUVM->pdm.s.hConstructPool);
+    AssertLogRelRCReturn(rc, rc);
+    LogRel(("PDM: Parallel construction enabled, up to %u worker threads\n", cThreads));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Executes construction work on a pool thread.
+ *
+ * @param   pWork       The work item.
+ */
+static DECLCALLBACK(void) pdmR3DrvConstructWorkThread(PPDMCONSTRUCTWORK pWork)
+{
+    PUVM     pUVM     = pWork->pDrvIns->Internal.s.pVMR3->pUVM;
+    uint64_t u64Start = RTTimeNanoTS();
+    int rc = pWork->pfnWork(pWork->pDrvIns, pWork->pvUser);
+    pWork->cNsRun = RTTimeNanoTS() - u64Start;
+    ASMAtomicWriteS32(&pWork->rc, rc);
+    ASMAtomicWriteBool(&pWork->fDone, true);
+
+    /* The work item may be freed now, so only use the UVM. */
+    VMR3AsyncPdmNotificationWakeupU(pUVM);
+}
+
+
+/**
+ * Waits for the given construction work to complete and frees it.
+ *
+ * Priority requests are serviced while waiting since the work may need EMT(0)
+ * for things like setting the VM error.
+ *
+ * @returns The status of the work callback.
+ * @param   pVM         Pointer to the VM.
+ * @param   pWork       The work item, unlinked.
+ */
+static int pdmR3DrvConstructWorkComplete(PVM pVM, PPDMCONSTRUCTWORK pWork)
+{
+    VM_ASSERT_EMT0(pVM);
+    while (!ASMAtomicReadBool(&pWork->fDone))
+    {
+        int rc2 = VMR3AsyncPdmNotificationWaitU(&pVM->pUVM->aCpus[0]);
+        AssertReleaseMsgRC(rc2, ("%Rrc - '%s'/%d\n", rc2, pWork->pDrvIns->pReg->szName, pWork->pDrvIns->iInstance));
+        rc2 = VMR3ReqProcessU(pVM->pUVM, VMCPUID_ANY, true /*fPriorityOnly*/);
+        AssertReleaseMsgRC(rc2, ("%Rrc - '%s'/%d\n", rc2, pWork->pDrvIns->pReg->szName, pWork->pDrvIns->iInstance));
+        rc2 = VMR3ReqProcessU(pVM->pUVM, 0/*idDstCpu*/, true /*fPriorityOnly*/);
+        AssertReleaseMsgRC(rc2, ("%Rrc - '%s'/%d\n", rc2, pWork->pDrvIns->pReg->szName, pWork->pDrvIns->iInstance));
+    }
+
+    int      rc      = ASMAtomicReadS32(&pWork->rc);
+    uint64_t cNsWall = RTTimeNanoTS() - pWork->u64QueuedTS;
+    if (RT_FAILURE(rc) || pWork->cNsRun >= PDMCONSTRUCT_LOG_AT_NS)
+        LogRel(("PDM: Construction work of driver '%s'/%d took %'llu ns (%'llu ns after queueing) -> %Rrc\n",
+                pWork->pDrvIns->pReg->szName, pWork->pDrvIns->iInstance, pWork->cNsRun, cNsWall, rc));
+    MMR3HeapFree(pWork);
+    return rc;
+}
+
+
+/**
+ * Waits for all the construction work queued by a driver instance.
+ *
+ * @returns The first failure status of the work callbacks, VINF_SUCCESS if none.
+ * @param   pVM         Pointer to the VM.
+ * @param   pDrvIns     The driver instance.
+ */
+static int pdmR3DrvConstructWorkWaitDriver(PVM pVM, PPDMDRVINS pDrvIns)
+{
+    int                 rc     = VINF_SUCCESS;
+    PPDMCONSTRUCTWORK  *ppPrev = &pVM->pUVM->pdm.s.pConstructWork;
+    PPDMCONSTRUCTWORK   pWork  = *ppPrev;
+    while (pWork)
+    {
+        PPDMCONSTRUCTWORK pNext = pWork->pNext;
+        if (pWork->pDrvIns == pDrvIns)
+        {
+            *ppPrev = pNext;
+            int rc2 = pdmR3DrvConstructWorkComplete(pVM, pWork);
+            if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+                rc = rc2;
+        }
+        else
+            ppPrev = &pWork->pNext;
+        pWork = pNext;
+    }
+    return rc;
+}
+
+
+/**
+ * Waits for all outstanding construction work and shuts down the worker pool.
+ *
+ * This is called by pdmR3DevInit once all devices and drivers have been
+ * constructed, so the work completes before the init complete notifications.
+ *
+ * @returns The first failure status of the work callbacks, VINF_SUCCESS if none.
+ * @param   pVM         Pointer to the VM.
+ */
+int pdmR3DrvConstructWorkWaitAll(PVM pVM)
+{
+    PUVM     pUVM       = pVM->pUVM;
+    int      rc         = VINF_SUCCESS;
+    unsigned cWork      = 0;
+    uint64_t cNsElapsed = RTTimeNanoTS();
+    PPDMCONSTRUCTWORK pWork;
+    while ((pWork = pUVM->pdm.s.pConstructWork) != NULL)
+    {
+        pUVM->pdm.s.pConstructWork = pWork->pNext;
+        int rc2 = pdmR3DrvConstructWorkComplete(pVM, pWork);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+        cWork++;
+    }
+
+    if (pUVM->pdm.s.hConstructPool != NIL_RTREQPOOL)
+    {
+        cNsElapsed = RTTimeNanoTS() - cNsElapsed;
+        LogRel(("PDM: Parallel construction: waited %'llu ns for %u outstanding work items\n", cNsElapsed, cWork));
+        RTReqPoolRelease(pUVM->pdm.s.hConstructPool);
+        pUVM->pdm.s.hConstructPool = NIL_RTREQPOOL;
+    }
+    return rc;
+}
+
+
+/**
+ * Makes sure no construction work is outstanding when terminating.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+void pdmR3DrvConstructWorkTerm(PVM pVM)
+{
+    pdmR3DrvConstructWorkWaitAll(pVM);
+}
+
+
 
 
 /** @name Driver Helpers
@@ -1784,6 +1997,64 @@ static DECLCALLBACK(VMRESUMEREASON) pdmR3DrvHlp_VMGetResumeReason(PPDMDRVINS pDr
 }
 
 
+/** @interface_method_impl{PDMDRVHLP,pfnConstructWorkQueue} */
+static DECLCALLBACK(int) pdmR3DrvHlp_ConstructWorkQueue(PPDMDRVINS pDrvIns, PFNPDMDRVCONSTRUCTWORK pfnWork, void *pvUser,
+                                                        uint32_t fFlags)
+{
+    PDMDRV_ASSERT_DRVINS(pDrvIns);
+    PVM pVM = pDrvIns->Internal.s.pVMR3;
+    VM_ASSERT_EMT0(pVM);
+    LogFlow(("pdmR3DrvHlp_ConstructWorkQueue: caller='%s'/%d: pfnWork=%p pvUser=%p fFlags=%#x\n",
+             pDrvIns->pReg->szName, pDrvIns->iInstance, pfnWork, pvUser, fFlags));
+    AssertPtrReturn(pfnWork, VERR_INVALID_POINTER);
+    AssertReturn(!(fFlags & ~PDM_CONSTRUCT_WORK_F_VALID_MASK), VERR_INVALID_FLAGS);
+
+    int  rc;
+    PUVM pUVM = pVM->pUVM;
+    if (pUVM->pdm.s.hConstructPool == NIL_RTREQPOOL)
+        rc = fFlags & PDM_CONSTRUCT_WORK_F_PARALLEL_ONLY ? VERR_NOT_AVAILABLE : pfnWork(pDrvIns, pvUser);
+    else
+    {
+        PPDMCONSTRUCTWORK pWork = (PPDMCONSTRUCTWORK)MMR3HeapAllocZ(pVM, MM_TAG_PDM_DRIVER, sizeof(*pWork));
+        if (pWork)
+        {
+            pWork->pDrvIns      = pDrvIns;
+            pWork->pfnWork      = pfnWork;
+            pWork->pvUser       = pvUser;
+            pWork->u64QueuedTS  = RTTimeNanoTS();
+            pWork->rc           = VERR_INTERNAL_ERROR;
+            rc = RTReqPoolCallVoidNoWait(pUVM->pdm.s.hConstructPool, (PFNRT)pdmR3DrvConstructWorkThread, 1, pWork);
+            if (RT_SUCCESS(rc))
+            {
+                pWork->pNext = pUVM->pdm.s.pConstructWork;
+                pUVM->pdm.s.pConstructWork = pWork;
+            }
+            else
+                MMR3HeapFree(pWork);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    LogFlow(("pdmR3DrvHlp_ConstructWorkQueue: caller='%s'/%d: returns %Rrc\n", pDrvIns->pReg->szName, pDrvIns->iInstance, rc));
+    return rc;
+}
+
+
+/** @interface_method_impl{PDMDRVHLP,pfnConstructWorkWait} */
+static DECLCALLBACK(int) pdmR3DrvHlp_ConstructWorkWait(PPDMDRVINS pDrvIns)
+{
+    PDMDRV_ASSERT_DRVINS(pDrvIns);
+    PVM pVM = pDrvIns->Internal.s.pVMR3;
+    VM_ASSERT_EMT0(pVM);
+
+    int rc = pdmR3DrvConstructWorkWaitDriver(pVM, pDrvIns);
+
+    LogFlow(("pdmR3DrvHlp_ConstructWorkWait: caller='%s'/%d: returns %Rrc\n", pDrvIns->pReg->szName, pDrvIns->iInstance, rc));
+    return rc;
+}
+
+
 /**
  * The driver helper structure.
  */
@@ -1833,8 +2104,8 @@ const PDMDRVHLPR3 g_pdmR3DrvHlp =
     pdmR3DrvHlp_BlkCacheRetain,
     pdmR3DrvHlp_VMGetSuspendReason,
     pdmR3DrvHlp_VMGetResumeReason,
-    NULL,
-    NULL,
+    pdmR3DrvHlp_ConstructWorkQueue,
+    pdmR3DrvHlp_ConstructWorkWait,
     NULL,
     NULL,
     NULL,
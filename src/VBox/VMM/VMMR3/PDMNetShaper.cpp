@@ -137,15 +137,28 @@ static void pdmNsBwGroupUnlink(PPDMNSBWGROUP pBwGroup)
 static void pdmNsBwGroupSetLimit(PPDMNSBWGROUP pBwGroup, uint64_t cbPerSecMax)
 {
     pBwGroup->cbPerSecMax = cbPerSecMax;
-    pBwGroup->cbBucket    = RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, cbPerSecMax * PDM_NETSHAPER_MAX_LATENCY / 1000);
+    pBwGroup->cbBucket    = pBwGroup->cbBurst
+                          ? pBwGroup->cbBurst
+                          : RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, cbPerSecMax * PDM_NETSHAPER_MAX_LATENCY / 1000);
     LogFlow(("pdmNsBwGroupSetLimit: New rate limit is %llu bytes per second, adjusted bucket size to %u bytes\n",
              pBwGroup->cbPerSecMax, pBwGroup->cbBucket));
 }
 
 
-static int pdmNsBwGroupCreate(PPDMNETSHAPER pShaper, const char *pszBwGroup, uint64_t cbPerSecMax)
+static void pdmNsBwGroupSetGuarantee(PPDMNSBWGROUP pBwGroup, uint64_t cbPerSecMin)
 {
-    LogFlow(("pdmNsBwGroupCreate: pShaper=%#p pszBwGroup=%#p{%s} cbPerSecMax=%llu\n", pShaper, pszBwGroup, pszBwGroup, cbPerSecMax));
+    pBwGroup->cbPerSecMin = cbPerSecMin;
+    pBwGroup->cbBucketMin = RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, cbPerSecMin * PDM_NETSHAPER_MAX_LATENCY / 1000);
+    LogFlow(("pdmNsBwGroupSetGuarantee: Guaranteed rate is %llu bytes per second, bucket size %u bytes\n",
+             pBwGroup->cbPerSecMin, pBwGroup->cbBucketMin));
+}
+
+
+static int pdmNsBwGroupCreate(PPDMNETSHAPER pShaper, const char *pszBwGroup, uint64_t cbPerSecMax,
+                              uint64_t cbPerSecMin, uint32_t cbBurst)
+{
+    LogFlow(("pdmNsBwGroupCreate: pShaper=%#p pszBwGroup=%#p{%s} cbPerSecMax=%llu cbPerSecMin=%llu cbBurst=%u\n",
+             pShaper, pszBwGroup, pszBwGroup, cbPerSecMax, cbPerSecMin, cbBurst));
 
     AssertPtrReturn(pShaper, VERR_INVALID_POINTER);
     AssertPtrReturn(pszBwGroup, VERR_INVALID_POINTER);
@@ -167,10 +180,13 @@ static int pdmNsBwGroupCreate(PPDMNETSHAPER pShaper, const char *pszBwGroup, uin
                 {
                     pBwGroup->pShaperR3             = pShaper;
                     pBwGroup->cRefs                 = 0;
+                    pBwGroup->cbBurst               = cbBurst;
 
                     pdmNsBwGroupSetLimit(pBwGroup, cbPerSecMax);
+                    pdmNsBwGroupSetGuarantee(pBwGroup, cbPerSecMin);
 
                     pBwGroup->cbTokensLast          = pBwGroup->cbBucket;
+                    pBwGroup->cbTokensMinLast       = pBwGroup->cbBucketMin;
                     pBwGroup->tsUpdatedLast         = RTTimeSystemNanoTS();
 
                     LogFlowFunc(("pszBwGroup={%s} cbBucket=%u\n",
@@ -193,6 +209,39 @@ static int pdmNsBwGroupCreate(PPDMNETSHAPER pShaper, const char *pszBwGroup, uin
 }
 
 
+/**
+ * Makes a bandwidth group a child of another one.
+ *
+ * @returns VBox status code.
+ * @param   pShaper         The network shaper.
+ * @param   pszBwGroup      Name of the child group.
+ * @param   pszParent       Name of the parent group.
+ */
+static int pdmNsBwGroupSetParent(PPDMNETSHAPER pShaper, const char *pszBwGroup, const char *pszParent)
+{
+    PPDMNSBWGROUP pBwGroup = pdmNsBwGroupFindById(pShaper, pszBwGroup);
+    PPDMNSBWGROUP pParent  = pdmNsBwGroupFindById(pShaper, pszParent);
+    if (!pBwGroup || !pParent)
+    {
+        LogRel(("NetShaper: Parent group '%s' of '%s' does not exist\n", pszParent, pszBwGroup));
+        return VERR_NOT_FOUND;
+    }
+
+    /* The lock order relies on the hierarchy being a tree. */
+    for (PPDMNSBWGROUP pCur = pParent; pCur; pCur = pCur->pParentR3)
+        if (pCur == pBwGroup)
+        {
+            LogRel(("NetShaper: Making '%s' the parent of '%s' creates a loop\n", pszParent, pszBwGroup));
+            return VERR_INVALID_PARAMETER;
+        }
+
+    pBwGroup->pParentR3 = pParent;
+    pBwGroup->pParentR0 = MMHyperR3ToR0(pShaper->pVM, pParent);
+    LogFlow(("pdmNsBwGroupSetParent: '%s' -> '%s'\n", pszBwGroup, pszParent));
+    return VINF_SUCCESS;
+}
+
+
 static void pdmNsBwGroupTerminate(PPDMNSBWGROUP pBwGroup)
 {
     Assert(pBwGroup->cRefs == 0);
@@ -227,21 +276,59 @@ static void pdmNsBwGroupXmitPending(PPDMNSBWGROUP pBwGroup)
     //LOCK_NETSHAPER(pShaper);
 
     /* Check if the group is disabled. */
-    if (pBwGroup->cbPerSecMax == 0)
+    if (   pBwGroup->cbPerSecMax == 0
+        && !pBwGroup->pParentR3)
+        return;
+
+    /*
+     * Start a new deficit round robin round. Each filter which got choked
+     * since the last round gets an equal share of the group's burst added
+     * to its deficit, the others have nothing queued and lose theirs.
+     */
+    int rc = PDMCritSectEnter(&pBwGroup->Lock, VERR_SEM_BUSY); AssertRC(rc);
+
+    uint32_t     cFilters = 0;
+    uint32_t     cChoked  = 0;
+    PPDMNSFILTER pFilter;
+    for (pFilter = pBwGroup->pFiltersHeadR3; pFilter; pFilter = pFilter->pNextR3)
+    {
+        cFilters++;
+        if (ASMAtomicReadBool(&pFilter->fChoked))
+            cChoked++;
+    }
+
+    uint32_t const cbQuantum = cChoked ? RT_MAX(pBwGroup->cbBucket / cChoked, 1) : 0;
+    for (pFilter = pBwGroup->pFiltersHeadR3; pFilter; pFilter = pFilter->pNextR3)
+        if (ASMAtomicReadBool(&pFilter->fChoked))
+            pFilter->cbDeficit = (uint32_t)RT_MIN((uint64_t)pFilter->cbDeficit + cbQuantum, pBwGroup->cbBucket);
+        else
+            pFilter->cbDeficit = 0;
+    ASMAtomicWriteU32(&pBwGroup->cFiltersActive, cChoked);
+
+    rc = PDMCritSectLeave(&pBwGroup->Lock); AssertRC(rc);
+
+    if (!cChoked)
         return;
 
-    PPDMNSFILTER pFilter = pBwGroup->pFiltersHeadR3;
-    while (pFilter)
+    /*
+     * Wake up the choked filters, starting with a different one each round
+     * so that none of them is always first in line for the fresh tokens.
+     */
+    uint32_t const iStart = pBwGroup->iFilterNext++ % cFilters;
+    pFilter = pBwGroup->pFiltersHeadR3;
+    for (uint32_t i = 0; i < iStart; i++)
+        pFilter = pFilter->pNextR3;
+    for (uint32_t i = 0; i < cFilters; i++)
     {
         bool fChoked = ASMAtomicXchgBool(&pFilter->fChoked, false);
-        Log3((LOG_FN_FMT ": pFilter=%#p fChoked=%RTbool\n", __PRETTY_FUNCTION__, pFilter, fChoked));
+        Log3((LOG_FN_FMT ": pFilter=%#p fChoked=%RTbool cbDeficit=%u\n", __PRETTY_FUNCTION__, pFilter, fChoked, pFilter->cbDeficit));
         if (fChoked && pFilter->pIDrvNetR3)
         {
             LogFlowFunc(("Calling pfnXmitPending for pFilter=%#p\n", pFilter));
             pFilter->pIDrvNetR3->pfnXmitPending(pFilter->pIDrvNetR3);
         }
 
-        pFilter = pFilter->pNextR3;
+        pFilter = pFilter->pNextR3 ? pFilter->pNextR3 : pBwGroup->pFiltersHeadR3;
     }
 
     //UNLOCK_NETSHAPER(pShaper);
@@ -299,7 +386,7 @@ static void pdmNsFilterUnlink(PPDMNSFILTER pFilter)
  * @param   pszBwGroup     Name of the bandwidth group to attach to.
  * @param   pFilter         Pointer to the filter we attach.
  */
-VMMR3_INT_DECL(int) PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *pszBwGroup, PPDMNSFILTER pFilter)
+VMMR3DECL(int) PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *pszBwGroup, PPDMNSFILTER pFilter)
 {
     VM_ASSERT_EMT(pUVM->pVM);
     AssertPtrReturn(pFilter, VERR_INVALID_POINTER);
@@ -321,6 +408,8 @@ VMMR3_INT_DECL(int) PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *psz
 
     if (RT_SUCCESS(rc))
     {
+        pFilter->cbDeficit = 0;
+        pFilter->tsChoked  = 0;
         PPDMNSBWGROUP pBwGroupOld = ASMAtomicXchgPtrT(&pFilter->pBwGroupR3, pBwGroupNew, PPDMNSBWGROUP);
         ASMAtomicWritePtr(&pFilter->pBwGroupR0, MMHyperR3ToR0(pUVM->pVM, pBwGroupNew));
         if (pBwGroupOld)
@@ -341,7 +430,7 @@ VMMR3_INT_DECL(int) PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *psz
  * @param   pDrvIns         The driver instance.
  * @param   pFilter         Pointer to the filter we detach.
  */
-VMMR3_INT_DECL(int) PDMR3NsDetach(PUVM pUVM, PPDMDRVINS pDrvIns, PPDMNSFILTER pFilter)
+VMMR3DECL(int) PDMR3NsDetach(PUVM pUVM, PPDMDRVINS pDrvIns, PPDMNSFILTER pFilter)
 {
     VM_ASSERT_EMT(pUVM->pVM);
     AssertPtrReturn(pFilter, VERR_INVALID_POINTER);
@@ -504,6 +593,8 @@ int pdmR3NetShaperInit(PVM pVM)
                 for (PCFGMNODE pCur = CFGMR3GetFirstChild(pCfgBwGrp); pCur; pCur = CFGMR3GetNextChild(pCur))
                 {
                     uint64_t cbMax;
+                    uint64_t cbMin;
+                    uint32_t cbBurst;
                     size_t cbName = CFGMR3GetNameLen(pCur) + 1;
                     char *pszBwGrpId = (char *)RTMemAllocZ(cbName);
 
@@ -519,13 +610,51 @@ int pdmR3NetShaperInit(PVM pVM)
                     if (RT_SUCCESS(rc))
                         rc = CFGMR3QueryU64(pCur, "Max", &cbMax);
                     if (RT_SUCCESS(rc))
-                        rc = pdmNsBwGroupCreate(pShaper, pszBwGrpId, cbMax);
+                        rc = CFGMR3QueryU64Def(pCur, "Min", &cbMin, 0);
+                    if (RT_SUCCESS(rc))
+                        rc = CFGMR3QueryU32Def(pCur, "Burst", &cbBurst, 0);
+                    if (RT_SUCCESS(rc))
+                    {
+                        if (cbMax && cbMin > cbMax)
+                            cbMin = cbMax;
+                        if (cbBurst && cbBurst < PDM_NETSHAPER_MIN_BUCKET_SIZE)
+                            cbBurst = PDM_NETSHAPER_MIN_BUCKET_SIZE;
+                        rc = pdmNsBwGroupCreate(pShaper, pszBwGrpId, cbMax, cbMin, cbBurst);
+                    }
 
                     RTMemFree(pszBwGrpId);
 
                     if (RT_FAILURE(rc))
                         break;
                 }
+
+                /* Link the groups into a hierarchy once they all exist. */
+                for (PCFGMNODE pCur = CFGMR3GetFirstChild(pCfgBwGrp); pCur && RT_SUCCESS(rc); pCur = CFGMR3GetNextChild(pCur))
+                {
+                    char *pszParent;
+                    rc = CFGMR3QueryStringAlloc(pCur, "Parent", &pszParent);
+                    if (rc == VERR_CFGM_VALUE_NOT_FOUND)
+                    {
+                        rc = VINF_SUCCESS;
+                        continue;
+                    }
+                    if (RT_FAILURE(rc))
+                        break;
+
+                    size_t cbName = CFGMR3GetNameLen(pCur) + 1;
+                    char *pszBwGrpId = (char *)RTMemAllocZ(cbName);
+                    if (pszBwGrpId)
+                    {
+                        rc = CFGMR3GetName(pCur, pszBwGrpId, cbName);
+                        AssertRC(rc);
+                        if (RT_SUCCESS(rc))
+                            rc = pdmNsBwGroupSetParent(pShaper, pszBwGrpId, pszParent);
+                        RTMemFree(pszBwGrpId);
+                    }
+                    else
+                        rc = VERR_NO_MEMORY;
+                    MMR3HeapFree(pszParent);
+                }
             }
 
             if (RT_SUCCESS(rc))
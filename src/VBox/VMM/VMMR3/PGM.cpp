@@ -628,6 +628,7 @@
 #include <VBox/vmm/selm.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/hm.h>
+#include <VBox/vmm/iem.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
@@ -1707,12 +1708,27 @@ static int pgmR3InitStats(PVM pVM)
 
     STAM_REL_REG(pVM, &pPGM->StatShModCheck,                     STAMTYPE_PROFILE, "/PGM/ShMod/Check",                   STAMUNIT_TICKS_PER_CALL, "Profiles the shared module checking.");
 
+    STAM_REL_REG(pVM, &pPGM->PageDedup.StatScannedPages,         STAMTYPE_COUNTER, "/PGM/PageDedup/ScannedPages",        STAMUNIT_PAGES,     "The number of pages examined by the deduplication scanner.");
+    STAM_REL_REG(pVM, &pPGM->PageDedup.StatMergedPages,          STAMTYPE_COUNTER, "/PGM/PageDedup/MergedPages",         STAMUNIT_PAGES,     "The number of pages replaced by an identical shared page.");
+    STAM_REL_REG(pVM, &pPGM->PageDedup.StatNewSharedPages,       STAMTYPE_COUNTER, "/PGM/PageDedup/NewSharedPages",      STAMUNIT_PAGES,     "The number of pages converted into new shared pages.");
+    STAM_REL_REG(pVM, &pPGM->PageDedup.StatMismatches,           STAMTYPE_COUNTER, "/PGM/PageDedup/Mismatches",          STAMUNIT_OCCURENCES, "The number of hash hits with different page content.");
+    STAM_REL_REG(pVM, &pPGM->PageDedup.StatPasses,               STAMTYPE_COUNTER, "/PGM/PageDedup/Passes",              STAMUNIT_OCCURENCES, "The number of completed passes over guest RAM.");
+    STAM_REL_REG(pVM, &pPGM->PageDedup.StatScan,                 STAMTYPE_PROFILE, "/PGM/PageDedup/Scan",                STAMUNIT_TICKS_PER_CALL, "Profiles the deduplication scan steps.");
+
+    STAM_REL_REG(pVM, &pPGM->LargePagePromotion.StatPromoted,    STAMTYPE_COUNTER, "/PGM/LargePage/Promoted",            STAMUNIT_OCCURENCES, "The number of 2 MB ranges promoted to a new large page.");
+    STAM_REL_REG(pVM, &pPGM->LargePagePromotion.StatReenabled,   STAMTYPE_COUNTER, "/PGM/LargePage/Reenabled",           STAMUNIT_OCCURENCES, "The number of disabled large pages the promotion scanner enabled again.");
+    STAM_REL_REG(pVM, &pPGM->LargePagePromotion.StatRefused,     STAMTYPE_COUNTER, "/PGM/LargePage/PromoteRefused",      STAMUNIT_OCCURENCES, "The number of 2 MB ranges which didn't qualify for promotion.");
+    STAM_REL_REG(pVM, &pPGM->LargePagePromotion.StatFailed,      STAMTYPE_COUNTER, "/PGM/LargePage/PromoteFailed",       STAMUNIT_OCCURENCES, "The number of failed large page promotions.");
+    STAM_REL_REG(pVM, &pPGM->LargePagePromotion.StatScan,        STAMTYPE_PROFILE, "/PGM/LargePage/PromoteScan",         STAMUNIT_TICKS_PER_CALL, "Profiles the large page promotion scan steps.");
+
     /* Live save */
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.fActive,              STAMTYPE_U8,      "/PGM/LiveSave/fActive",              STAMUNIT_COUNT,     "Active or not.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cIgnoredPages,        STAMTYPE_U32,     "/PGM/LiveSave/cIgnoredPages",        STAMUNIT_COUNT,     "The number of ignored pages in the RAM ranges (i.e. MMIO, MMIO2 and ROM).");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cDirtyPagesLong,      STAMTYPE_U32,     "/PGM/LiveSave/cDirtyPagesLong",      STAMUNIT_COUNT,     "Longer term dirty page average.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cDirtyPagesShort,     STAMTYPE_U32,     "/PGM/LiveSave/cDirtyPagesShort",     STAMUNIT_COUNT,     "Short term dirty page average.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cPagesPerSecond,      STAMTYPE_U32,     "/PGM/LiveSave/cPagesPerSecond",      STAMUNIT_COUNT,     "Pages per second.");
+    STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cDirtyPagesPerSecond, STAMTYPE_U32,     "/PGM/LiveSave/cDirtyPagesPerSecond", STAMUNIT_COUNT,     "Pages dirtied per second during the last pass.");
+    STAM_REL_REG_USED(pVM, &pPGM->LiveSave.uAutoConvergeCap,     STAMTYPE_U32,     "/PGM/LiveSave/uAutoConvergeCap",     STAMUNIT_PCT,       "The CPU execution cap imposed by auto-converge (0 if not throttling).");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cSavedPages,          STAMTYPE_U64,     "/PGM/LiveSave/cSavedPages",          STAMUNIT_COUNT,     "The total number of saved pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Ram.cReadyPages,      STAMTYPE_U32,     "/PGM/LiveSave/Ram/cReadPages",       STAMUNIT_COUNT,     "RAM: Ready pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Ram.cDirtyPages,      STAMTYPE_U32,     "/PGM/LiveSave/Ram/cDirtyPages",      STAMUNIT_COUNT,     "RAM: Dirty pages.");
@@ -2224,6 +2240,20 @@ VMMR3DECL(int) PGMR3InitFinalize(PVM pVM)
     if (pVM->pgm.s.fRamPreAlloc)
         rc = pgmR3PhysRamPreAllocate(pVM);
 
+#ifdef VBOX_WITH_PAGE_SHARING
+    /*
+     * Start the page deduplication scanner if configured.
+     */
+    if (RT_SUCCESS(rc))
+        rc = pgmR3PageDedupInit(pVM);
+#endif
+
+    /*
+     * Start the large page promotion scanner if configured.
+     */
+    if (RT_SUCCESS(rc))
+        rc = pgmR3PhysLargePagePromotionInit(pVM);
+
     LogRel(("PGMR3InitFinalize: 4 MB PSE mask %RGp\n", pVM->pgm.s.GCPhys4MBPSEMask));
     return rc;
 }
@@ -2242,6 +2272,9 @@ VMMR3_INT_DECL(int) PGMR3InitCompleted(PVM pVM, VMINITCOMPLETED enmWhat)
     switch (enmWhat)
     {
         case VMINITCOMPLETED_HM:
+        {
+            int rc = pgmR3PhysLargePagePromotionStart(pVM);
+            AssertRCReturn(rc, rc);
 #ifdef VBOX_WITH_PCI_PASSTHROUGH
             if (pVM->pgm.s.fPciPassthrough)
             {
@@ -2254,7 +2287,7 @@ VMMR3_INT_DECL(int) PGMR3InitCompleted(PVM pVM, VMINITCOMPLETED enmWhat)
                  */
                 if (pVM->pgm.s.fPciPassthrough)
                 {
-                    int rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_PHYS_SETUP_IOMMU, 0, NULL);
+                    rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_PHYS_SETUP_IOMMU, 0, NULL);
                     AssertRCReturn(rc, rc);
                 }
             }
@@ -2262,6 +2295,7 @@ VMMR3_INT_DECL(int) PGMR3InitCompleted(PVM pVM, VMINITCOMPLETED enmWhat)
             AssertLogRelReturn(!pVM->pgm.s.fPciPassthrough, VERR_PGM_PCI_PASSTHRU_MISCONFIG);
 #endif
             break;
+        }
 
         default:
             /* shut up gcc */
@@ -2647,6 +2681,7 @@ VMMR3DECL(int) PGMR3Term(PVM pVM)
     pgmR3PhysRomTerm(pVM);
     pgmUnlock(pVM);
 
+    pgmR3PostCopyTerm(pVM);
     PGMDeregisterStringFormatTypes();
     return PDMR3CritSectDelete(&pVM->pgm.s.CritSectX);
 }
@@ -3374,6 +3409,7 @@ VMMR3DECL(int) PGMR3ChangeMode(PVM pVM, PVMCPU pVCpu, PGMMODE enmGuestMode)
 
     Log(("PGMR3ChangeMode: Guest mode: %s -> %s\n", PGMGetModeName(pVCpu->pgm.s.enmGuestMode), PGMGetModeName(enmGuestMode)));
     STAM_REL_COUNTER_INC(&pVCpu->pgm.s.cGuestModeChanges);
+    IEMTlbInvalidateAll(pVCpu);
 
     /*
      * Calc the shadow mode and switcher.
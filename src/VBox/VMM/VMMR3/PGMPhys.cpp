@@ -24,10 +24,13 @@
 #include <VBox/vmm/iom.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/stam.h>
+#include <VBox/vmm/tm.h>
+#include <VBox/vmm/cfgm.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
 #endif
 #include <VBox/vmm/pdmdev.h>
+#include <VBox/vmm/iem.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
@@ -439,7 +442,16 @@ VMMR3DECL(int) PGMR3PhysGCPhys2CCPtrExternal(PVM pVM, RTGCPHYS GCPhys, void **pp
 
     Assert(VM_IS_EMT(pVM) || !PGMIsLockOwner(pVM));
 
-    int rc = pgmLock(pVM);
+    /* Post-copy: the page may not have arrived yet. */
+    int rc;
+    if (RT_UNLIKELY(pgmR3PostCopyIsPending(pVM)))
+    {
+        rc = pgmR3PostCopyFetchPage(pVM, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
     /*
@@ -540,7 +552,16 @@ VMMR3DECL(int) PGMR3PhysGCPhys2CCPtrExternal(PVM pVM, RTGCPHYS GCPhys, void **pp
  */
 VMMR3DECL(int) PGMR3PhysGCPhys2CCPtrReadOnlyExternal(PVM pVM, RTGCPHYS GCPhys, void const **ppv, PPGMPAGEMAPLOCK pLock)
 {
-    int rc = pgmLock(pVM);
+    /* Post-copy: the page may not have arrived yet. */
+    int rc;
+    if (RT_UNLIKELY(pgmR3PostCopyIsPending(pVM)))
+    {
+        rc = pgmR3PostCopyFetchPage(pVM, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
     /*
@@ -3861,6 +3882,7 @@ VMMDECL(void) PGMR3PhysSetA20(PVMCPU pVCpu, bool fEnable)
         VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3);
         pgmR3RefreshShadowModeAfterA20Change(pVCpu);
         HMFlushTLB(pVCpu);
+        IEMTlbInvalidateAll(pVCpu);
 #endif
         STAM_REL_COUNTER_INC(&pVCpu->pgm.s.cA20Changes);
     }
@@ -4376,6 +4398,413 @@ VMMR3DECL(int) PGMR3PhysAllocateLargeHandyPage(PVM pVM, RTGCPHYS GCPhys)
 }
 
 
+#ifdef PGM_WITH_LARGE_PAGES
+
+/**
+ * Checks whether a 2 MB range of small pages qualifies for promotion.
+ *
+ * @returns true if it does, false if not.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhysBase  The 2 MB aligned start address of the range.
+ */
+static bool pgmR3PhysLargePageCanPromote(PVM pVM, RTGCPHYS GCPhysBase)
+{
+    RTGCPHYS GCPhys = GCPhysBase;
+    for (unsigned iPage = 0; iPage < _2M/PAGE_SIZE; iPage++, GCPhys += PAGE_SIZE)
+    {
+        PPGMPAGE pPage;
+        int rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+        if (    RT_FAILURE(rc)
+            ||  PGM_PAGE_GET_TYPE(pPage)  != PGMPAGETYPE_RAM
+            ||  PGM_PAGE_GET_STATE(pPage) != PGM_PAGE_STATE_ALLOCATED /* Zero, monitored, shared or ballooned. */
+            ||  PGM_PAGE_HAS_ANY_HANDLERS(pPage)
+            ||  PGM_PAGE_GET_READ_LOCKS(pPage)
+            ||  PGM_PAGE_GET_WRITE_LOCKS(pPage))
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * Replaces the small pages of a 2 MB range with a newly allocated large page.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhysBase  The 2 MB aligned start address of the range.
+ * @param   pBasePage   The page structure of the first page in the range.
+ *
+ * @remarks Must be called from within the PGM critical section with all other
+ *          EMTs stopped.
+ */
+static int pgmR3PhysLargePagePromote(PVM pVM, RTGCPHYS GCPhysBase, PPGMPAGE pBasePage)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    PGMMPROMOTELARGEPAGEREQ pReq     = pVM->pgm.s.LargePagePromotion.pReqR3;
+    uint8_t                *pbBounce = pVM->pgm.s.LargePagePromotion.pbBounceR3;
+
+    /*
+     * Save the page content, we can't access the old pages once ring-0 has
+     * freed them.
+     */
+    RTGCPHYS GCPhys = GCPhysBase;
+    for (unsigned iPage = 0; iPage < _2M/PAGE_SIZE; iPage++, GCPhys += PAGE_SIZE)
+    {
+        PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhys);
+        AssertReturn(pPage, VERR_PGM_PHYS_PAGE_RESERVED);
+        void const *pvSrc;
+        int rc = pgmPhysPageMapReadOnly(pVM, pPage, GCPhys, &pvSrc);
+        AssertRCReturn(rc, rc);
+        memcpy(&pbBounce[iPage << PAGE_SHIFT], pvSrc, PAGE_SIZE);
+        pReq->aPages[iPage].idPage = PGM_PAGE_GET_PAGEID(pPage);
+    }
+
+    /*
+     * Let ring-0 allocate the large page and free the small ones.
+     */
+    int rc = GMMR3PromoteLargePage(pVM, pReq);
+    if (RT_FAILURE(rc))
+    {
+        Log(("pgmR3PhysLargePagePromote: %RGp failed with %Rrc\n", GCPhysBase, rc));
+        return rc;
+    }
+
+    /*
+     * Restore the content and update the page structures.  Like
+     * PGMR3PhysAllocateLargeHandyPage, this assumes the page IDs and host
+     * addresses within the chunk are contiguous.
+     */
+    uint32_t idPage = pReq->idLargePage;
+    RTHCPHYS HCPhys = pReq->HCPhysLargePage;
+    void    *pv;
+    rc = pgmPhysPageMapByPageID(pVM, idPage, HCPhys, &pv);
+    AssertLogRelMsgRCReturn(rc, ("idPage=%#x HCPhys=%RHp rc=%Rrc\n", idPage, HCPhys, rc), rc);
+    memcpy(pv, pbBounce, _2M);
+
+    if (PGM_PAGE_GET_PDE_TYPE(pBasePage) == PGM_PAGE_PDE_TYPE_PDE_DISABLED)
+    {
+        /* The old large page is gone for good now. */
+        Assert(pVM->pgm.s.cLargePagesDisabled > 0);
+        pVM->pgm.s.cLargePagesDisabled--;
+        pVM->pgm.s.cLargePages--;
+    }
+
+    GCPhys = GCPhysBase;
+    for (unsigned iPage = 0; iPage < _2M/PAGE_SIZE; iPage++)
+    {
+        PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhys);
+        PGM_PAGE_SET_HCPHYS(pVM, pPage, HCPhys);
+        PGM_PAGE_SET_PAGEID(pVM, pPage, idPage);
+        PGM_PAGE_SET_PDE_TYPE(pVM, pPage, PGM_PAGE_PDE_TYPE_PDE);
+        PGM_PAGE_SET_PTE_INDEX(pVM, pPage, 0);
+        PGM_PAGE_SET_TRACKING(pVM, pPage, 0);
+
+        idPage++;
+        HCPhys += PAGE_SIZE;
+        GCPhys += PAGE_SIZE;
+    }
+    pVM->pgm.s.cLargePages++;
+
+    Log(("pgmR3PhysLargePagePromote: %RGp -> idPage=%#x HCPhys=%RHp\n", GCPhysBase, pReq->idLargePage, pReq->HCPhysLargePage));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Updates the large page coverage statistics.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @remarks The caller must own the PGM lock.
+ */
+static void pgmR3PhysLargePageUpdateCoverage(PVM pVM)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    uint32_t cPrivate = pVM->pgm.s.cPrivatePages;
+    uint32_t cCovered = (pVM->pgm.s.cLargePages - pVM->pgm.s.cLargePagesDisabled) * (_2M/PAGE_SIZE);
+    cCovered = RT_MIN(cCovered, cPrivate);
+    pVM->pgm.s.LargePagePromotion.cCoveredPages = cCovered;
+    pVM->pgm.s.LargePagePromotion.cSmallPages   = cPrivate - cCovered;
+    pVM->pgm.s.LargePagePromotion.uCoveragePct  = cPrivate ? (uint32_t)((uint64_t)cCovered * 100 / cPrivate) : 0;
+}
+
+
+/**
+ * @callback_method_impl{FNSTAMR3CALLBACKPRINT, Computes the large page
+ *                      coverage statistics when they are queried.}
+ *
+ * The statistics lock is held while this is called and the PGM lock owner may
+ * be registering statistics, so we only try to get the PGM lock and print the
+ * previous values if it's busy.
+ */
+static DECLCALLBACK(void) pgmR3PhysLargePageCoveragePrint(PVM pVM, void *pvSample, char *pszBuf, size_t cchBuf)
+{
+    if (RT_SUCCESS(PDMCritSectTryEnter(&pVM->pgm.s.CritSectX)))
+    {
+        pgmR3PhysLargePageUpdateCoverage(pVM);
+        PDMCritSectLeave(&pVM->pgm.s.CritSectX);
+    }
+    RTStrPrintf(pszBuf, cchBuf, "%u", *(uint32_t const *)pvSample);
+}
+
+
+/**
+ * Rendezvous callback doing a large page promotion scan step.
+ *
+ * Walks the RAM ranges from the cursor and promotes fully populated 2 MB
+ * ranges of small pages to large pages until the per interval budget of
+ * examined ranges is used up.  Disabled large pages are rechecked and enabled again when
+ * possible, which is a lot cheaper.
+ *
+ * @returns VBox strict status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pVCpu               Pointer to the VMCPU of the calling EMT.
+ * @param   pvUser              Not used.
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysLargePagePromoteRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    NOREF(pvUser);
+
+    /* Flush all pending handy page operations before changing any page assignments. */
+    int rc = PGMR3PhysAllocateHandyPages(pVM);
+    AssertRC(rc);
+
+    pgmLock(pVM);
+
+    uint32_t    cLeft     = pVM->pgm.s.LargePagePromotion.cRangesPerScan;
+    uint32_t    cChanged  = 0;
+    RTGCPHYS    GCPhys    = pVM->pgm.s.LargePagePromotion.GCPhysCursor;
+    RTGCPHYS    GCPhysEnd = NIL_RTGCPHYS;
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam && cLeft > 0; pRam = pRam->pNextR3)
+    {
+        if (pRam->GCPhysLast < GCPhys)
+            continue;
+        if (PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            continue;
+
+        RTGCPHYS GCPhysBase = RT_ALIGN_T(RT_MAX(GCPhys, pRam->GCPhys), _2M, RTGCPHYS);
+        for (; GCPhysBase + _2M - 1 <= pRam->GCPhysLast && cLeft > 0; GCPhysBase += _2M)
+        {
+            GCPhysEnd = GCPhysBase + _2M;
+            cLeft--;
+
+            PPGMPAGE pBasePage = &pRam->aPages[(GCPhysBase - pRam->GCPhys) >> PAGE_SHIFT];
+            if (PGM_PAGE_GET_TYPE(pBasePage) != PGMPAGETYPE_RAM)
+                continue;
+            unsigned uPDEType = PGM_PAGE_GET_PDE_TYPE(pBasePage);
+            if (uPDEType == PGM_PAGE_PDE_TYPE_PDE)
+                continue;
+            if (   uPDEType == PGM_PAGE_PDE_TYPE_PDE_DISABLED
+                && RT_SUCCESS(pgmPhysRecheckLargePage(pVM, GCPhysBase, pBasePage)))
+            {
+                STAM_REL_COUNTER_INC(&pVM->pgm.s.LargePagePromotion.StatReenabled);
+                cChanged++;
+                continue;
+            }
+
+            if (!pgmR3PhysLargePageCanPromote(pVM, GCPhysBase))
+            {
+                STAM_REL_COUNTER_INC(&pVM->pgm.s.LargePagePromotion.StatRefused);
+                continue;
+            }
+
+            rc = pgmR3PhysLargePagePromote(pVM, GCPhysBase, pBasePage);
+            if (RT_FAILURE(rc))
+            {
+                /* Most likely the host is out of contiguous memory; try again next time. */
+                STAM_REL_COUNTER_INC(&pVM->pgm.s.LargePagePromotion.StatFailed);
+                cLeft = 0;
+                GCPhysEnd = GCPhysBase;
+                break;
+            }
+            STAM_REL_COUNTER_INC(&pVM->pgm.s.LargePagePromotion.StatPromoted);
+            cChanged++;
+        }
+    }
+
+    /* Continue where we left off next time, wrapping around at the end. */
+    pVM->pgm.s.LargePagePromotion.GCPhysCursor = cLeft > 0 || GCPhysEnd == NIL_RTGCPHYS ? 0 : GCPhysEnd;
+
+    if (cChanged)
+    {
+        /*
+         * Nested paging only uses a large page for a PDE which isn't present,
+         * so flush the shadow page tables for the new large pages to be picked up.
+         * This also drops all references to the host pages we just replaced.
+         */
+        pgmR3PoolClearAllRendezvous(pVM, pVCpu, (void *)(uintptr_t)true /* flush the REM TLB */);
+        pgmPhysInvalidatePageMapTLB(pVM);
+        PGM_INVL_ALL_VCPU_TLBS(pVM);
+    }
+
+    pgmUnlock(pVM);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * EMT worker queued by pgmR3PhysLargePagePromoteTimer.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+static DECLCALLBACK(void) pgmR3PhysLargePagePromoteHelper(PVM pVM)
+{
+    VMSTATE enmState = VMR3GetState(pVM);
+    if (   pVM->pgm.s.LargePagePromotion.fEnabled
+        && PGMIsUsingLargePages(pVM)
+        && HMIsNestedPagingActive(pVM)
+        && !pVM->pgm.s.LiveSave.fActive
+        && !pVM->pgm.s.pPostCopyR3
+        && (   enmState == VMSTATE_RUNNING
+            || enmState == VMSTATE_SUSPENDED))
+    {
+        STAM_REL_PROFILE_START(&pVM->pgm.s.LargePagePromotion.StatScan, a);
+        int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PhysLargePagePromoteRendezvous, NULL);
+        AssertRCSuccess(rc);
+        STAM_REL_PROFILE_STOP(&pVM->pgm.s.LargePagePromotion.StatScan, a);
+    }
+    ASMAtomicWriteBool(&pVM->pgm.s.LargePagePromotion.fScanPending, false);
+}
+
+
+/**
+ * @callback_method_impl{FNTMTIMERINT, Paces the large page promotion scanner.}
+ */
+static DECLCALLBACK(void) pgmR3PhysLargePagePromoteTimer(PVM pVM, PTMTIMER pTimer, void *pvUser)
+{
+    NOREF(pvUser);
+
+    /* Don't do the work in the timer callback, queue it for an EMT. */
+    if (   pVM->pgm.s.LargePagePromotion.fEnabled
+        && ASMAtomicCmpXchgBool(&pVM->pgm.s.LargePagePromotion.fScanPending, true, false))
+    {
+        int rc = VMR3ReqCallVoidNoWait(pVM, VMCPUID_ANY_QUEUE, (PFNRT)pgmR3PhysLargePagePromoteHelper, 1, pVM);
+        if (RT_FAILURE(rc))
+            ASMAtomicWriteBool(&pVM->pgm.s.LargePagePromotion.fScanPending, false);
+    }
+    TMTimerSetMillies(pTimer, pVM->pgm.s.LargePagePromotion.cMsInterval);
+}
+
+#endif /* PGM_WITH_LARGE_PAGES */
+
+/**
+ * Initializes the large page promotion scanner.
+ *
+ * Large pages are only used when the whole 2 MB range can be allocated up
+ * front and they are disabled once a page in the range gets monitored,
+ * shared or ballooned.  The promotion scanner periodically looks for 2 MB
+ * ranges which are fully populated with ordinary private pages again, copies
+ * them into a fresh large page and hands the small pages back to GMM, so
+ * nested paging can map the range with a single PDE.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+int pgmR3PhysLargePagePromotionInit(PVM pVM)
+{
+    /*
+     * Read the configuration.
+     */
+    PCFGMNODE pCfg = CFGMR3GetChild(CFGMR3GetRoot(pVM), "/PGM/LargePagePromotion");
+
+    /** @cfgm{/PGM/LargePagePromotion/Enabled, bool, false}
+     * Whether to periodically promote fully populated 2 MB ranges of guest RAM
+     * to large pages.  Only effective with nested paging and large pages. */
+    bool fEnabled;
+    int rc = CFGMR3QueryBoolDef(pCfg, "Enabled", &fEnabled, false);
+    AssertLogRelRCReturn(rc, rc);
+
+    /** @cfgm{/PGM/LargePagePromotion/RangesPerScan, uint32_t, 64, 1, 16384}
+     * The number of 2 MB ranges to examine per scan interval. */
+    rc = CFGMR3QueryU32Def(pCfg, "RangesPerScan", &pVM->pgm.s.LargePagePromotion.cRangesPerScan, 64);
+    AssertLogRelRCReturn(rc, rc);
+    if (pVM->pgm.s.LargePagePromotion.cRangesPerScan < 1 || pVM->pgm.s.LargePagePromotion.cRangesPerScan > 16384)
+        return VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                          N_("Configuration error: /PGM/LargePagePromotion/RangesPerScan=%u is out of range (1..16384)"),
+                          pVM->pgm.s.LargePagePromotion.cRangesPerScan);
+
+    /** @cfgm{/PGM/LargePagePromotion/Interval, uint32_t, 1000, 10, 600000}
+     * The scan interval in milliseconds. */
+    rc = CFGMR3QueryU32Def(pCfg, "Interval", &pVM->pgm.s.LargePagePromotion.cMsInterval, 1000);
+    AssertLogRelRCReturn(rc, rc);
+    if (pVM->pgm.s.LargePagePromotion.cMsInterval < 10 || pVM->pgm.s.LargePagePromotion.cMsInterval > 600000)
+        return VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                          N_("Configuration error: /PGM/LargePagePromotion/Interval=%u is out of range (10..600000)"),
+                          pVM->pgm.s.LargePagePromotion.cMsInterval);
+
+#ifdef PGM_WITH_LARGE_PAGES
+    if (fEnabled && pVM->pgm.s.fPciPassthrough)
+    {
+        LogRel(("PGM: Large page promotion is not available with PCI pass-through\n"));
+        fEnabled = false;
+    }
+    pVM->pgm.s.LargePagePromotion.fEnabled = fEnabled;
+
+    /*
+     * The coverage statistics are computed when queried.
+     */
+    STAMR3RegisterCallback(pVM, &pVM->pgm.s.LargePagePromotion.cCoveredPages, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                           NULL, pgmR3PhysLargePageCoveragePrint, "The number of guest pages backed by enabled large pages.",
+                           "/PGM/LargePage/cCoveredPages");
+    STAMR3RegisterCallback(pVM, &pVM->pgm.s.LargePagePromotion.cSmallPages, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                           NULL, pgmR3PhysLargePageCoveragePrint, "The number of private guest pages not backed by enabled large pages.",
+                           "/PGM/LargePage/cSmallPages");
+    STAMR3RegisterCallback(pVM, &pVM->pgm.s.LargePagePromotion.uCoveragePct, STAMVISIBILITY_ALWAYS, STAMUNIT_PCT,
+                           NULL, pgmR3PhysLargePageCoveragePrint, "Large page coverage of the private guest pages.",
+                           "/PGM/LargePage/CoveragePct");
+#else
+    if (fEnabled)
+        LogRel(("PGM: Large page promotion is not supported on this host\n"));
+#endif
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Starts the large page promotion scanner once HM has decided on nested
+ * paging and large pages.
+ *
+ * Nothing is allocated and no timer is created unless the scanner can
+ * actually do something.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+int pgmR3PhysLargePagePromotionStart(PVM pVM)
+{
+#ifdef PGM_WITH_LARGE_PAGES
+    if (!pVM->pgm.s.LargePagePromotion.fEnabled)
+        return VINF_SUCCESS;
+    if (   !PGMIsUsingLargePages(pVM)
+        || !HMIsNestedPagingActive(pVM))
+    {
+        LogRel(("PGM: Large page promotion requires nested paging and large pages, disabled\n"));
+        pVM->pgm.s.LargePagePromotion.fEnabled = false;
+        return VINF_SUCCESS;
+    }
+
+    int rc = MMR3HeapAllocZEx(pVM, MM_TAG_PGM, sizeof(GMMPROMOTELARGEPAGEREQ), (void **)&pVM->pgm.s.LargePagePromotion.pReqR3);
+    AssertLogRelRCReturn(rc, rc);
+    rc = MMR3HeapAllocEx(pVM, MM_TAG_PGM, _2M, (void **)&pVM->pgm.s.LargePagePromotion.pbBounceR3);
+    AssertLogRelRCReturn(rc, rc);
+
+    /*
+     * Create and arm the timer.
+     */
+    rc = TMR3TimerCreateInternal(pVM, TMCLOCK_REAL, pgmR3PhysLargePagePromoteTimer, NULL, "PGM Large Page Promotion",
+                                 &pVM->pgm.s.LargePagePromotion.pTimerR3);
+    AssertLogRelRCReturn(rc, rc);
+    rc = TMTimerSetMillies(pVM->pgm.s.LargePagePromotion.pTimerR3, pVM->pgm.s.LargePagePromotion.cMsInterval);
+    AssertLogRelRCReturn(rc, rc);
+
+    LogRel(("PGM: Large page promotion enabled: %u ranges every %u ms\n",
+            pVM->pgm.s.LargePagePromotion.cRangesPerScan, pVM->pgm.s.LargePagePromotion.cMsInterval));
+#else
+    NOREF(pVM);
+#endif
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Response to VM_FF_PGM_NEED_HANDY_PAGES and VMMCALLRING3_PGM_ALLOCATE_HANDY_PAGES.
  *
@@ -0,0 +1,951 @@
+/* $Id$ */
+/** @file
+ * PGM - Page Manager and Monitor, Post-copy teleportation.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_pgm_postcopy   PGM Post-Copy Teleportation
+ *
+ * Regular teleportation keeps doing live passes until the dirty memory can be
+ * sent within the max downtime, which a guest dirtying memory faster than the
+ * link can carry it will never allow.  Post-copy cuts the live phase short:
+ * after a given number of passes the source votes for the final pass, and that
+ * pass only records which RAM pages are still dirty (PGM_STATE_REC_RAM_DEFERRED
+ * records) instead of sending their contents.
+ *
+ * The target has to agree to this before the state is sent (the teleporter
+ * negotiates it, the target calling PGMR3PostCopyAccept), a VM that didn't
+ * refuses to load deferred records.  The records also came with a saved state
+ * version bump, so older targets reject such a stream outright.
+ *
+ * The target resumes the VM straight away with PHYSICAL_ALL access handlers
+ * covering the deferred pages.  The teleporter then streams the missing pages
+ * over in PGM_POSTCOPY_CHUNK_SIZE units in address order, while an access to a
+ * chunk that hasn't arrived yet asks for it ahead of the rest (see
+ * FNPGMPOSTCOPYFETCH) and blocks until it does.  Arrived chunks are served out
+ * of a buffer until an EMT gets around to writing them into guest memory and
+ * deregistering the handlers.
+ *
+ * Code mapping guest pages directly must not get hold of a page that hasn't
+ * arrived yet.  In ring-3 the mapping APIs fetch it first (see
+ * pgmR3PostCopyFetchPage), in ring-0 and raw-mode they refuse such pages while
+ * PGM::fPostCopyPending is set, so the caller falls back on ring-3.
+ *
+ * Should the connection to the source be lost before all chunks have arrived,
+ * the guest memory is incomplete and the VM is put into a fatal error state.
+ *
+ * Lock order: PGMPOSTCOPY::CritSect is taken before the PGM lock, access
+ * handlers are called without the PGM lock held.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_PGM
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/uvm.h>
+#include "PGMInternal.h"
+#include <VBox/vmm/vm.h>
+#include <VBox/param.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/avl.h>
+#include <iprt/critsect.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/time.h>
+
+#include "PGMInline.h"
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Post-copy chunk state.
+ */
+typedef enum PGMPOSTCOPYCHUNKSTATE
+{
+    /** The usual invalid zero entry. */
+    PGMPOSTCOPYCHUNKSTATE_INVALID = 0,
+    /** The contents are still on the source only. */
+    PGMPOSTCOPYCHUNKSTATE_MISSING,
+    /** Source: The contents have been sent. */
+    PGMPOSTCOPYCHUNKSTATE_SENT,
+    /** Target: The chunk has been demand fetched. */
+    PGMPOSTCOPYCHUNKSTATE_REQUESTED,
+    /** Target: The contents have arrived and are buffered in pbData. */
+    PGMPOSTCOPYCHUNKSTATE_RECEIVED,
+    /** Target: The contents have been written to guest memory. */
+    PGMPOSTCOPYCHUNKSTATE_INSTALLED
+} PGMPOSTCOPYCHUNKSTATE;
+
+
+/**
+ * A post-copy chunk, i.e. a PGM_POSTCOPY_CHUNK_SIZE aligned area with one or
+ * more deferred pages in it.
+ */
+typedef struct PGMPOSTCOPYCHUNK
+{
+    /** The AVL node core, the key is the chunk address. */
+    AVLGCPHYSNODECORE       Core;
+    /** The chunk state. */
+    PGMPOSTCOPYCHUNKSTATE   enmState;
+    /** The number of deferred pages in the chunk. */
+    uint32_t                cPages;
+    /** Bitmap of the deferred pages. */
+    uint64_t                bmPages[PGM_POSTCOPY_CHUNK_PAGES / 64];
+    /** Target: The number of access handlers covering the chunk. */
+    uint32_t                cHandlers;
+    /** Target: The start addresses of the access handlers. */
+    RTGCPHYS               *paHandlers;
+    /** Target: The received contents, indexed by page (RECEIVED only). */
+    uint8_t                *pbData;
+} PGMPOSTCOPYCHUNK;
+/** Pointer to a post-copy chunk. */
+typedef PGMPOSTCOPYCHUNK *PPGMPOSTCOPYCHUNK;
+
+
+/**
+ * The post-copy state (PGM::pPostCopyR3).
+ */
+typedef struct PGMPOSTCOPY
+{
+    /** Protects the chunks. */
+    RTCRITSECT              CritSect;
+    /** Serializes the pfnFetch calls. */
+    RTCRITSECT              CritSectFetch;
+    /** Signalled when a chunk is received or the transfer fails. */
+    RTSEMEVENTMULTI         hEvtReceived;
+    /** The chunks, keyed by address. */
+    AVLGCPHYSTREE           Tree;
+    /** Set if this is the source VM. */
+    bool                    fSource;
+    /** Source: The number of live passes before voting for the final one. */
+    uint32_t                cPrePasses;
+    /** The number of chunks. */
+    uint32_t                cChunks;
+    /** The number of chunks not yet sent (source) / received (target). */
+    uint32_t volatile       cPendingChunks;
+    /** Target: The number of chunks installed. */
+    uint32_t                cInstalledChunks;
+    /** Target: The number of demand fetches. */
+    uint32_t                cDemandFetches;
+    /** The number of deferred pages. */
+    uint64_t                cPages;
+    /** Source: Where PGMR3PostCopyNextChunk continues. */
+    RTGCPHYS                GCPhysNext;
+    /** Target: The start of the transfer (RTTimeNanoTS). */
+    uint64_t                nsStart;
+    /** Target: The demand fetch callback. */
+    PFNPGMPOSTCOPYFETCH     pfnFetch;
+    /** Target: The user argument of pfnFetch. */
+    void                   *pvFetchUser;
+    /** Target: VINF_SUCCESS or the status the transfer failed with. */
+    int32_t volatile        rcFailed;
+} PGMPOSTCOPY;
+/** Pointer to the post-copy state. */
+typedef PGMPOSTCOPY *PPGMPOSTCOPY;
+
+AssertCompile(PGM_POSTCOPY_CHUNK_PAGES % 64 == 0);
+
+
+/**
+ * Creates the post-copy state.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   fSource     Whether this is the source VM.
+ */
+static int pgmR3PostCopyCreate(PVM pVM, bool fSource)
+{
+    AssertReturn(!pVM->pgm.s.pPostCopyR3, VERR_WRONG_ORDER);
+
+    PPGMPOSTCOPY pPostCopy = (PPGMPOSTCOPY)RTMemAllocZ(sizeof(*pPostCopy));
+    if (!pPostCopy)
+        return VERR_NO_MEMORY;
+    pPostCopy->fSource    = fSource;
+    pPostCopy->cPrePasses = 1;
+    pPostCopy->rcFailed   = VINF_SUCCESS;
+
+    int rc = RTCritSectInit(&pPostCopy->CritSect);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTCritSectInit(&pPostCopy->CritSectFetch);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTSemEventMultiCreate(&pPostCopy->hEvtReceived);
+            if (RT_SUCCESS(rc))
+            {
+                pVM->pgm.s.pPostCopyR3 = pPostCopy;
+                return VINF_SUCCESS;
+            }
+            RTCritSectDelete(&pPostCopy->CritSectFetch);
+        }
+        RTCritSectDelete(&pPostCopy->CritSect);
+    }
+    RTMemFree(pPostCopy);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{AVLGCPHYSCALLBACK, Frees a chunk.}
+ */
+static DECLCALLBACK(int) pgmR3PostCopyFreeChunk(PAVLGCPHYSNODECORE pNode, void *pvUser)
+{
+    PPGMPOSTCOPYCHUNK pChunk = (PPGMPOSTCOPYCHUNK)pNode;
+    RTMemFree(pChunk->paHandlers);
+    RTMemFree(pChunk->pbData);
+    RTMemFree(pChunk);
+    NOREF(pvUser);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys the post-copy state.
+ *
+ * The caller makes sure nobody is using it any longer.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+static void pgmR3PostCopyDestroy(PVM pVM)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    if (!pPostCopy)
+        return;
+    pVM->pgm.s.pPostCopyR3 = NULL;
+
+    RTAvlGCPhysDestroy(&pPostCopy->Tree, pgmR3PostCopyFreeChunk, NULL);
+    RTSemEventMultiDestroy(pPostCopy->hEvtReceived);
+    RTCritSectDelete(&pPostCopy->CritSectFetch);
+    RTCritSectDelete(&pPostCopy->CritSect);
+    RTMemFree(pPostCopy);
+}
+
+
+/**
+ * Terminates the post-copy code, called by PGMR3Term.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+void pgmR3PostCopyTerm(PVM pVM)
+{
+    pgmR3PostCopyDestroy(pVM);
+}
+
+
+/**
+ * Checks whether the source is done with the pre-copy passes.
+ *
+ * @returns true if pgmR3LiveVote should vote for the final pass.
+ * @param   pVM         Pointer to the VM.
+ * @param   uPass       The data pass.
+ */
+bool pgmR3PostCopyVote(PVM pVM, uint32_t uPass)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    return pPostCopy
+        && pPostCopy->fSource
+        && uPass >= pPostCopy->cPrePasses;
+}
+
+
+/**
+ * Checks whether the final save pass should defer dirty RAM pages.
+ *
+ * @returns true if it should, false if not.
+ * @param   pVM         Pointer to the VM.
+ */
+bool pgmR3PostCopyIsDeferring(PVM pVM)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    return pPostCopy
+        && pPostCopy->fSource;
+}
+
+
+/**
+ * Checks whether the target agreed to post-copy, i.e. whether the state being
+ * loaded may contain deferred pages.
+ *
+ * @returns true if it did, false if not.
+ * @param   pVM         Pointer to the VM.
+ */
+bool pgmR3PostCopyIsAccepting(PVM pVM)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    return pPostCopy
+        && !pPostCopy->fSource;
+}
+
+
+/**
+ * Checks whether the guest memory is still incomplete on the target.
+ *
+ * @returns true if it is, false if not.
+ * @param   pVM         Pointer to the VM.
+ */
+bool pgmR3PostCopyIsPending(PVM pVM)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    return pPostCopy
+        && !pPostCopy->fSource
+        && ASMAtomicReadU32(&pPostCopy->cInstalledChunks) != pPostCopy->cChunks;
+}
+
+
+/**
+ * Records a deferred page.
+ *
+ * This is called by the final save pass on the source and when loading a
+ * PGM_STATE_REC_RAM_DEFERRED record on the target, both of which are single
+ * threaded as far as the post-copy state is concerned.  The target must have
+ * called PGMR3PostCopyAccept.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhys      The page address.
+ */
+int pgmR3PostCopyDeferPage(PVM pVM, RTGCPHYS GCPhys)
+{
+    Assert(!(GCPhys & PAGE_OFFSET_MASK));
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertPtrReturn(pPostCopy, VERR_PGM_POST_COPY_NOT_ACCEPTED);
+
+    RTGCPHYS const    GCPhysChunk = GCPhys & ~(RTGCPHYS)(PGM_POSTCOPY_CHUNK_SIZE - 1);
+    PPGMPOSTCOPYCHUNK pChunk      = (PPGMPOSTCOPYCHUNK)RTAvlGCPhysGet(&pPostCopy->Tree, GCPhysChunk);
+    if (!pChunk)
+    {
+        pChunk = (PPGMPOSTCOPYCHUNK)RTMemAllocZ(sizeof(*pChunk));
+        if (!pChunk)
+            return VERR_NO_MEMORY;
+        pChunk->Core.Key = GCPhysChunk;
+        pChunk->enmState = PGMPOSTCOPYCHUNKSTATE_MISSING;
+        bool fRc = RTAvlGCPhysInsert(&pPostCopy->Tree, &pChunk->Core);
+        Assert(fRc); NOREF(fRc);
+        pPostCopy->cChunks++;
+        pPostCopy->cPendingChunks++;
+    }
+
+    uint32_t const iPage = (uint32_t)((GCPhys - GCPhysChunk) >> PAGE_SHIFT);
+    if (!ASMBitTestAndSet(pChunk->bmPages, iPage))
+    {
+        pChunk->cPages++;
+        pPostCopy->cPages++;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Waits for a chunk to be received, requesting it from the source if that
+ * hasn't already been done.
+ *
+ * @returns VINF_SUCCESS or the status code the transfer failed with.
+ * @param   pVM         Pointer to the VM.
+ * @param   pPostCopy   The post-copy state.  The caller owns the critsect,
+ *                      which is left while waiting.
+ * @param   pChunk      The chunk.
+ */
+static int pgmR3PostCopyWaitForChunk(PVM pVM, PPGMPOSTCOPY pPostCopy, PPGMPOSTCOPYCHUNK pChunk)
+{
+    for (;;)
+    {
+        int rc = ASMAtomicReadS32(&pPostCopy->rcFailed);
+        if (RT_FAILURE(rc))
+            return rc;
+        if (pChunk->enmState >= PGMPOSTCOPYCHUNKSTATE_RECEIVED)
+            return VINF_SUCCESS;
+
+        if (pChunk->enmState == PGMPOSTCOPYCHUNKSTATE_MISSING)
+        {
+            pChunk->enmState = PGMPOSTCOPYCHUNKSTATE_REQUESTED;
+            pPostCopy->cDemandFetches++;
+            RTGCPHYS const GCPhysChunk = pChunk->Core.Key;
+            RTCritSectLeave(&pPostCopy->CritSect);
+
+            RTCritSectEnter(&pPostCopy->CritSectFetch);
+            if (pPostCopy->pfnFetch)
+            {
+                rc = pPostCopy->pfnFetch(pVM->pUVM, GCPhysChunk, pPostCopy->pvFetchUser);
+                if (RT_FAILURE(rc))
+                    LogRel(("PGM: Post-copy: Demand fetch of %RGp failed: %Rrc\n", GCPhysChunk, rc));
+            }
+            RTCritSectLeave(&pPostCopy->CritSectFetch);
+        }
+        else
+        {
+            /* Another waiter may reset the event after the chunk we want was
+               signalled but before we got around to waiting, so don't wait
+               for too long before rechecking. */
+            RTSemEventMultiReset(pPostCopy->hEvtReceived);
+            RTCritSectLeave(&pPostCopy->CritSect);
+            RTSemEventMultiWait(pPostCopy->hEvtReceived, 50);
+        }
+        RTCritSectEnter(&pPostCopy->CritSect);
+    }
+}
+
+
+/**
+ * @callback_method_impl{FNPGMR3PHYSHANDLER,
+ *      Access handler for the deferred pages.}
+ */
+static DECLCALLBACK(int) pgmR3PostCopyHandler(PVM pVM, RTGCPHYS GCPhys, void *pvPhys, void *pvBuf, size_t cbBuf,
+                                              PGMACCESSTYPE enmAccessType, void *pvUser)
+{
+    PPGMPOSTCOPY      pPostCopy = pVM->pgm.s.pPostCopyR3;
+    PPGMPOSTCOPYCHUNK pChunk    = (PPGMPOSTCOPYCHUNK)pvUser;
+    uint32_t const    iPage     = (uint32_t)((GCPhys - pChunk->Core.Key) >> PAGE_SHIFT);
+    Assert(iPage < PGM_POSTCOPY_CHUNK_PAGES);
+    Assert((GCPhys & PAGE_OFFSET_MASK) + cbBuf <= PAGE_SIZE);
+    NOREF(pvPhys);
+
+    /* The pages in the gaps between the deferred ones are ordinary RAM. */
+    if (!ASMBitTest(pChunk->bmPages, iPage))
+        return VINF_PGM_HANDLER_DO_DEFAULT;
+
+    RTCritSectEnter(&pPostCopy->CritSect);
+    int rc = pgmR3PostCopyWaitForChunk(pVM, pPostCopy, pChunk);
+    if (   RT_SUCCESS(rc)
+        && pChunk->enmState == PGMPOSTCOPYCHUNKSTATE_RECEIVED)
+    {
+        uint8_t *pbPage = &pChunk->pbData[((size_t)iPage << PAGE_SHIFT) | (GCPhys & PAGE_OFFSET_MASK)];
+        if (enmAccessType == PGMACCESSTYPE_READ)
+            memcpy(pvBuf, pbPage, cbBuf);
+        else
+            memcpy(pbPage, pvBuf, cbBuf);
+        RTCritSectLeave(&pPostCopy->CritSect);
+        return VINF_SUCCESS;
+    }
+    RTCritSectLeave(&pPostCopy->CritSect);
+
+    if (RT_FAILURE(rc))
+    {
+        /* The memory is lost, the VM is going down. */
+        if (enmAccessType == PGMACCESSTYPE_READ)
+            memset(pvBuf, 0xff, cbBuf);
+        return VINF_SUCCESS;
+    }
+
+    /*
+     * Installed while we were waiting.  The mapping we were given may refer
+     * to the page that was replaced, so go via the guest physical address.
+     */
+    if (enmAccessType == PGMACCESSTYPE_READ)
+        rc = PGMPhysSimpleReadGCPhys(pVM, pvBuf, GCPhys, cbBuf);
+    else
+        rc = PGMPhysSimpleWriteGCPhys(pVM, GCPhys, pvBuf, cbBuf);
+    AssertLogRelMsgRC(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Checks whether the run of deferred pages ending at @a iLast can be extended
+ * to the deferred page @a iNext so they can share an access handler.
+ *
+ * @returns true if it can, false if not.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhysChunk The chunk address.
+ * @param   iLast       The last page of the run.
+ * @param   iNext       The next deferred page.
+ */
+static bool pgmR3PostCopyCanExtendRun(PVM pVM, RTGCPHYS GCPhysChunk, uint32_t iLast, uint32_t iNext)
+{
+    bool fRc = true;
+    pgmLock(pVM);
+    PPGMRAMRANGE pRam = pgmPhysGetRange(pVM, GCPhysChunk + ((RTGCPHYS)iLast << PAGE_SHIFT));
+    if (pRam != pgmPhysGetRange(pVM, GCPhysChunk + ((RTGCPHYS)iNext << PAGE_SHIFT)))
+        fRc = false;
+    for (uint32_t iPage = iLast + 1; iPage < iNext && fRc; iPage++)
+    {
+        PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhysChunk + ((RTGCPHYS)iPage << PAGE_SHIFT));
+        if (   !pPage
+            || PGM_PAGE_GET_TYPE(pPage) != PGMPAGETYPE_RAM
+            || PGM_PAGE_HAS_ANY_HANDLERS(pPage))
+            fRc = false;
+    }
+    pgmUnlock(pVM);
+    return fRc;
+}
+
+
+/**
+ * @callback_method_impl{AVLGCPHYSCALLBACK,
+ *      Registers the access handlers for a chunk.}
+ */
+static DECLCALLBACK(int) pgmR3PostCopyProtectChunk(PAVLGCPHYSNODECORE pNode, void *pvUser)
+{
+    PVM               pVM    = (PVM)pvUser;
+    PPGMPOSTCOPYCHUNK pChunk = (PPGMPOSTCOPYCHUNK)pNode;
+
+    /*
+     * Cover each run of deferred pages with one handler, joining runs across
+     * gaps of plain RAM to save handler records (they come off the hyper heap).
+     */
+    int32_t iFirst = ASMBitFirstSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES);
+    while (iFirst >= 0)
+    {
+        int32_t iLast = iFirst;
+        int32_t iNext = ASMBitNextSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES, iLast);
+        while (   iNext >= 0
+               && pgmR3PostCopyCanExtendRun(pVM, pChunk->Core.Key, iLast, iNext))
+        {
+            iLast = iNext;
+            iNext = ASMBitNextSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES, iLast);
+        }
+
+        if (!(pChunk->cHandlers % 8))
+        {
+            void *pvNew = RTMemRealloc(pChunk->paHandlers, (pChunk->cHandlers + 8) * sizeof(pChunk->paHandlers[0]));
+            if (!pvNew)
+                return VERR_NO_MEMORY;
+            pChunk->paHandlers = (RTGCPHYS *)pvNew;
+        }
+
+        RTGCPHYS const GCPhysFirst = pChunk->Core.Key + ((RTGCPHYS)iFirst << PAGE_SHIFT);
+        RTGCPHYS const GCPhysLast  = pChunk->Core.Key + ((RTGCPHYS)iLast << PAGE_SHIFT) + PAGE_OFFSET_MASK;
+        int rc = PGMR3HandlerPhysicalRegister(pVM, PGMPHYSHANDLERTYPE_PHYSICAL_ALL, GCPhysFirst, GCPhysLast,
+                                              pgmR3PostCopyHandler, pChunk,
+                                              NULL /*pszModR0*/, NULL /*pszHandlerR0*/, NIL_RTR0PTR,
+                                              NULL /*pszModRC*/, NULL /*pszHandlerRC*/, NIL_RTRCPTR,
+                                              "Post-copy");
+        AssertLogRelMsgRCReturn(rc, ("%RGp-%RGp: %Rrc\n", GCPhysFirst, GCPhysLast, rc), rc);
+        pChunk->paHandlers[pChunk->cHandlers++] = GCPhysFirst;
+
+        iFirst = iNext;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Protects the deferred pages after loading the state on the target.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+int pgmR3PostCopyLoadDone(PVM pVM)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    if (   !pPostCopy
+        || pPostCopy->fSource)
+        return VINF_SUCCESS;
+
+    /* The source had nothing left over, forget about it. */
+    if (!pPostCopy->cChunks)
+    {
+        pgmR3PostCopyDestroy(pVM);
+        return VINF_SUCCESS;
+    }
+
+    int rc = RTAvlGCPhysDoWithAll(&pPostCopy->Tree, true /*fFromLeft*/, pgmR3PostCopyProtectChunk, pVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    pPostCopy->nsStart = RTTimeNanoTS();
+    ASMAtomicWriteBool(&pVM->pgm.s.fPostCopyPending, true);
+    LogRel(("PGM: Post-copy: %RU64 pages in %u chunks are still on the source\n",
+            pPostCopy->cPages, pPostCopy->cChunks));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Writes a received chunk into guest memory and drops the access handlers.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   pChunk      The chunk.
+ * @thread  EMT
+ */
+static DECLCALLBACK(void) pgmR3PostCopyInstallChunk(PVM pVM, PPGMPOSTCOPYCHUNK pChunk)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertPtrReturnVoid(pPostCopy);
+
+    RTCritSectEnter(&pPostCopy->CritSect);
+    if (pChunk->enmState == PGMPOSTCOPYCHUNKSTATE_RECEIVED)
+    {
+        for (int32_t iPage = ASMBitFirstSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES);
+             iPage >= 0;
+             iPage = ASMBitNextSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES, iPage))
+        {
+            RTGCPHYS const GCPhys = pChunk->Core.Key + ((RTGCPHYS)iPage << PAGE_SHIFT);
+            int rc = PGMPhysSimpleWriteGCPhys(pVM, GCPhys, &pChunk->pbData[(size_t)iPage << PAGE_SHIFT], PAGE_SIZE);
+            AssertLogRelMsgRC(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc));
+        }
+
+        for (uint32_t i = 0; i < pChunk->cHandlers; i++)
+        {
+            int rc = PGMHandlerPhysicalDeregister(pVM, pChunk->paHandlers[i]);
+            AssertLogRelMsgRC(rc, ("GCPhys=%RGp rc=%Rrc\n", pChunk->paHandlers[i], rc));
+        }
+        RTMemFree(pChunk->paHandlers);
+        pChunk->paHandlers = NULL;
+        pChunk->cHandlers  = 0;
+        RTMemFree(pChunk->pbData);
+        pChunk->pbData     = NULL;
+        pChunk->enmState   = PGMPOSTCOPYCHUNKSTATE_INSTALLED;
+
+        if (ASMAtomicIncU32(&pPostCopy->cInstalledChunks) == pPostCopy->cChunks)
+        {
+            ASMAtomicWriteBool(&pVM->pgm.s.fPostCopyPending, false);
+            LogRel(("PGM: Post-copy: All %u chunks installed after %RU64 ms, %u demand fetches\n",
+                    pPostCopy->cChunks, (RTTimeNanoTS() - pPostCopy->nsStart) / RT_NS_1MS, pPostCopy->cDemandFetches));
+        }
+    }
+    RTCritSectLeave(&pPostCopy->CritSect);
+}
+
+
+/**
+ * Makes sure a deferred page is in guest memory before it is mapped
+ * (PGMPhysGCPhys2CCPtr, PGMR3PhysGCPhys2CCPtrExternal and friends).
+ *
+ * Unlike the access handler, which can serve a received chunk out of its
+ * buffer, a mapping must refer to the actual guest page.  So the chunk is
+ * requested from the source if necessary, and installed once it arrives.
+ *
+ * @returns VINF_SUCCESS or the status code the transfer failed with.
+ * @param   pVM         Pointer to the VM.
+ * @param   GCPhys      The guest physical address.
+ * @thread  Any, but not the PGM lock owner.
+ */
+int pgmR3PostCopyFetchPage(PVM pVM, RTGCPHYS GCPhys)
+{
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertPtrReturn(pPostCopy, VINF_SUCCESS);
+
+    /* pgmR3PostCopyInstallChunk writing the contents into guest memory. */
+    if (RTCritSectIsOwner(&pPostCopy->CritSect))
+        return VINF_SUCCESS;
+
+    RTGCPHYS const GCPhysChunk = GCPhys & ~(RTGCPHYS)(PGM_POSTCOPY_CHUNK_SIZE - 1);
+    RTCritSectEnter(&pPostCopy->CritSect);
+    PPGMPOSTCOPYCHUNK pChunk = (PPGMPOSTCOPYCHUNK)RTAvlGCPhysGet(&pPostCopy->Tree, GCPhysChunk);
+    if (   !pChunk
+        || pChunk->enmState == PGMPOSTCOPYCHUNKSTATE_INSTALLED
+        || !ASMBitTest(pChunk->bmPages, (int32_t)((GCPhys - GCPhysChunk) >> PAGE_SHIFT)))
+    {
+        RTCritSectLeave(&pPostCopy->CritSect);
+        return VINF_SUCCESS;
+    }
+    int rc = pgmR3PostCopyWaitForChunk(pVM, pPostCopy, pChunk);
+    RTCritSectLeave(&pPostCopy->CritSect);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Don't wait for the request queued by PGMR3PostCopyDeliverChunk, it may
+       be stuck behind whatever the caller is holding up. */
+    if (VM_IS_EMT(pVM))
+        pgmR3PostCopyInstallChunk(pVM, pChunk);
+    else
+        rc = VMR3ReqPriorityCallVoidWaitU(pVM->pUVM, VMCPUID_ANY, (PFNRT)pgmR3PostCopyInstallChunk, 2, pVM, pChunk);
+    return rc;
+}
+
+
+/**
+ * Enables post-copy on the source VM.
+ *
+ * Must be called before starting the live save (VMR3Teleport).  The final pass
+ * will then skip the contents of the dirty RAM pages, leaving them to be
+ * transferred using PGMR3PostCopyNextChunk and PGMR3PostCopyReadChunk after
+ * the target has taken over.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   cPrePasses  The number of live passes to do before voting for the
+ *                      final one.
+ */
+VMMR3DECL(int) PGMR3PostCopyEnable(PUVM pUVM, uint32_t cPrePasses)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertReturn(cPrePasses > 0, VERR_INVALID_PARAMETER);
+
+    int rc = pgmR3PostCopyCreate(pVM, true /*fSource*/);
+    if (RT_SUCCESS(rc))
+    {
+        pVM->pgm.s.pPostCopyR3->cPrePasses = cPrePasses;
+        LogRel(("PGM: Post-copy enabled, final pass after %u live passes\n", cPrePasses));
+    }
+    return rc;
+}
+
+
+/**
+ * Agrees to post-copy on the target VM.
+ *
+ * Must be called before loading the state (VMR3LoadFromStream), a state with
+ * deferred pages is refused otherwise.  If the source doesn't defer anything
+ * after all, the post-copy state is dropped again when the load completes.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ */
+VMMR3DECL(int) PGMR3PostCopyAccept(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    if (pPostCopy)
+    {
+        /* Left over from a completed transfer into this VM, start afresh. */
+        AssertReturn(!pPostCopy->fSource, VERR_WRONG_ORDER);
+        if (pgmR3PostCopyIsPending(pVM))
+            return VERR_PGM_POST_COPY_ACTIVE;
+        pgmR3PostCopyDestroy(pVM);
+    }
+
+    int rc = pgmR3PostCopyCreate(pVM, false /*fSource*/);
+    if (RT_SUCCESS(rc))
+        LogRel(("PGM: Post-copy accepted\n"));
+    return rc;
+}
+
+
+/**
+ * Ends post-copy.
+ *
+ * On the source this frees the tracking state.  On the target a failure status
+ * means the remaining memory will never arrive: blocked accesses are failed and
+ * the VM is put into a fatal error state.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   rcStatus    The transfer status.
+ */
+VMMR3DECL(int) PGMR3PostCopyEnd(PUVM pUVM, int rcStatus)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    if (!pPostCopy)
+        return VINF_SUCCESS;
+
+    if (pPostCopy->fSource)
+        pgmR3PostCopyDestroy(pVM);
+    else if (   RT_FAILURE(rcStatus)
+             && ASMAtomicReadU32(&pPostCopy->cPendingChunks) > 0)
+    {
+        LogRel(("PGM: Post-copy failed with %Rrc, %u chunks missing\n", rcStatus, pPostCopy->cPendingChunks));
+        RTCritSectEnter(&pPostCopy->CritSect);
+        ASMAtomicWriteS32(&pPostCopy->rcFailed, rcStatus);
+        RTSemEventMultiSignal(pPostCopy->hEvtReceived);
+        RTCritSectLeave(&pPostCopy->CritSect);
+        VMSetRuntimeError(pVM, VMSETRTERR_FLAGS_FATAL | VMSETRTERR_FLAGS_NO_WAIT, "PostCopyFailed",
+                          N_("The connection to the source was lost before all the guest memory was transferred (%Rrc)"),
+                          rcStatus);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the number of chunks not yet sent (source) or received (target).
+ *
+ * @returns Chunk count, 0 if post-copy isn't active.
+ * @param   pUVM        The user mode VM handle.
+ */
+VMMR3DECL(uint32_t) PGMR3PostCopyPendingChunks(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, 0);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, 0);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    return pPostCopy ? ASMAtomicReadU32(&pPostCopy->cPendingChunks) : 0;
+}
+
+
+/**
+ * Gets the next chunk to send, source only.
+ *
+ * The chunks are handed out in address order, skipping any that were already
+ * sent on demand.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_FOUND when all chunks have been sent.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pGCPhysChunk    Where to return the chunk address.
+ */
+VMMR3DECL(int) PGMR3PostCopyNextChunk(PUVM pUVM, PRTGCPHYS pGCPhysChunk)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertReturn(pPostCopy && pPostCopy->fSource, VERR_WRONG_ORDER);
+
+    int rc = VERR_NOT_FOUND;
+    RTCritSectEnter(&pPostCopy->CritSect);
+    RTGCPHYS GCPhys = pPostCopy->GCPhysNext;
+    for (;;)
+    {
+        PPGMPOSTCOPYCHUNK pChunk = (PPGMPOSTCOPYCHUNK)RTAvlGCPhysGetBestFit(&pPostCopy->Tree, GCPhys, true /*fAbove*/);
+        if (!pChunk)
+            break;
+        if (pChunk->enmState == PGMPOSTCOPYCHUNKSTATE_MISSING)
+        {
+            *pGCPhysChunk = pChunk->Core.Key;
+            pPostCopy->GCPhysNext = pChunk->Core.Key + PGM_POSTCOPY_CHUNK_SIZE;
+            rc = VINF_SUCCESS;
+            break;
+        }
+        GCPhys = pChunk->Core.Key + PGM_POSTCOPY_CHUNK_SIZE;
+    }
+    RTCritSectLeave(&pPostCopy->CritSect);
+    return rc;
+}
+
+
+/**
+ * Reads the deferred pages of a chunk for sending, source only.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_FOUND if the chunk isn't pending (unknown or already sent).
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhysChunk     The chunk address.
+ * @param   pbmPages        Where to return the bitmap of the pages read,
+ *                          PGM_POSTCOPY_CHUNK_PAGES bits.
+ * @param   pvPages         Where to return the contents of the pages, packed
+ *                          in bitmap order.  PGM_POSTCOPY_CHUNK_SIZE bytes.
+ * @param   pcPages         Where to return the number of pages read.
+ */
+VMMR3DECL(int) PGMR3PostCopyReadChunk(PUVM pUVM, RTGCPHYS GCPhysChunk, uint64_t *pbmPages, void *pvPages, uint32_t *pcPages)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertReturn(pPostCopy && pPostCopy->fSource, VERR_WRONG_ORDER);
+
+    int rc = VERR_NOT_FOUND;
+    RTCritSectEnter(&pPostCopy->CritSect);
+    PPGMPOSTCOPYCHUNK pChunk = (PPGMPOSTCOPYCHUNK)RTAvlGCPhysGet(&pPostCopy->Tree, GCPhysChunk);
+    if (   pChunk
+        && pChunk->enmState == PGMPOSTCOPYCHUNKSTATE_MISSING)
+    {
+        uint8_t *pbDst = (uint8_t *)pvPages;
+        rc = VINF_SUCCESS;
+        for (int32_t iPage = ASMBitFirstSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES);
+             iPage >= 0 && RT_SUCCESS(rc);
+             iPage = ASMBitNextSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES, iPage))
+        {
+            rc = PGMR3PhysReadExternal(pVM, GCPhysChunk + ((RTGCPHYS)iPage << PAGE_SHIFT), pbDst, PAGE_SIZE);
+            pbDst += PAGE_SIZE;
+        }
+        if (RT_SUCCESS(rc))
+        {
+            memcpy(pbmPages, pChunk->bmPages, sizeof(pChunk->bmPages));
+            *pcPages = pChunk->cPages;
+            pChunk->enmState = PGMPOSTCOPYCHUNKSTATE_SENT;
+            ASMAtomicDecU32(&pPostCopy->cPendingChunks);
+        }
+    }
+    RTCritSectLeave(&pPostCopy->CritSect);
+    return rc;
+}
+
+
+/**
+ * Sets the demand fetch callback, target only.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pfnFetch    The callback, NULL to unset.
+ * @param   pvUser      The callback argument.
+ */
+VMMR3DECL(int) PGMR3PostCopySetFetcher(PUVM pUVM, PFNPGMPOSTCOPYFETCH pfnFetch, void *pvUser)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertReturn(pPostCopy && !pPostCopy->fSource, VERR_WRONG_ORDER);
+
+    RTCritSectEnter(&pPostCopy->CritSectFetch);
+    pPostCopy->pfnFetch    = pfnFetch;
+    pPostCopy->pvFetchUser = pvUser;
+    RTCritSectLeave(&pPostCopy->CritSectFetch);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Delivers a chunk received from the source, target only.
+ *
+ * The contents are buffered and served to accesses right away, while writing
+ * them to guest memory is left to an EMT.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhysChunk     The chunk address.
+ * @param   pbmPages        The bitmap of pages, as returned by
+ *                          PGMR3PostCopyReadChunk on the source.
+ * @param   pvPages         The contents of the pages, packed in bitmap order.
+ * @param   cPages          The number of pages.
+ */
+VMMR3DECL(int) PGMR3PostCopyDeliverChunk(PUVM pUVM, RTGCPHYS GCPhysChunk, uint64_t const *pbmPages,
+                                         void const *pvPages, uint32_t cPages)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    PPGMPOSTCOPY pPostCopy = pVM->pgm.s.pPostCopyR3;
+    AssertReturn(pPostCopy && !pPostCopy->fSource, VERR_WRONG_ORDER);
+
+    RTCritSectEnter(&pPostCopy->CritSect);
+    PPGMPOSTCOPYCHUNK pChunk = (PPGMPOSTCOPYCHUNK)RTAvlGCPhysGet(&pPostCopy->Tree, GCPhysChunk);
+    AssertLogRelMsgReturnStmt(   pChunk
+                              && pChunk->enmState < PGMPOSTCOPYCHUNKSTATE_RECEIVED
+                              && pChunk->cPages == cPages
+                              && !memcmp(pChunk->bmPages, pbmPages, sizeof(pChunk->bmPages)),
+                              ("GCPhysChunk=%RGp cPages=%u\n", GCPhysChunk, cPages),
+                              RTCritSectLeave(&pPostCopy->CritSect), VERR_INVALID_PARAMETER);
+
+    pChunk->pbData = (uint8_t *)RTMemAlloc(PGM_POSTCOPY_CHUNK_SIZE);
+    if (!pChunk->pbData)
+    {
+        RTCritSectLeave(&pPostCopy->CritSect);
+        return VERR_NO_MEMORY;
+    }
+    uint8_t const *pbSrc = (uint8_t const *)pvPages;
+    for (int32_t iPage = ASMBitFirstSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES);
+         iPage >= 0;
+         iPage = ASMBitNextSet(pChunk->bmPages, PGM_POSTCOPY_CHUNK_PAGES, iPage))
+    {
+        memcpy(&pChunk->pbData[(size_t)iPage << PAGE_SHIFT], pbSrc, PAGE_SIZE);
+        pbSrc += PAGE_SIZE;
+    }
+    pChunk->enmState = PGMPOSTCOPYCHUNKSTATE_RECEIVED;
+    ASMAtomicDecU32(&pPostCopy->cPendingChunks);
+    RTSemEventMultiSignal(pPostCopy->hEvtReceived);
+    RTCritSectLeave(&pPostCopy->CritSect);
+
+    int rc = VMR3ReqCallVoidNoWait(pVM, VMCPUID_ANY, (PFNRT)pgmR3PostCopyInstallChunk, 2, pVM, pChunk);
+    AssertLogRelRC(rc);
+    return VINF_SUCCESS;
+}
@@ -46,7 +46,10 @@
 *   Defined Constants And Macros                                               *
 *******************************************************************************/
 /** Saved state data unit version.  */
-#define PGM_SAVED_STATE_VERSION                 14
+#define PGM_SAVED_STATE_VERSION                 15
+/** Saved state data unit version before the post-copy records
+ *  (PGM_STATE_REC_RAM_DEFERRED). */
+#define PGM_SAVED_STATE_VERSION_PRE_POST_COPY   14
 /** Saved state data unit version before the PAE PDPE registers. */
 #define PGM_SAVED_STATE_VERSION_PRE_PAE         13
 /** Saved state data unit version after this includes ballooned page flags in
@@ -87,8 +90,10 @@
 #define PGM_STATE_REC_ROM_PROT          UINT8_C(0x07)
 /** Ballooned page. No data. */
 #define PGM_STATE_REC_RAM_BALLOONED     UINT8_C(0x08)
+/** RAM page left for post-copy - no data. */
+#define PGM_STATE_REC_RAM_DEFERRED      UINT8_C(0x09)
 /** The last record type. */
-#define PGM_STATE_REC_LAST              PGM_STATE_REC_RAM_BALLOONED
+#define PGM_STATE_REC_LAST              PGM_STATE_REC_RAM_DEFERRED
 /** End marker. */
 #define PGM_STATE_REC_END               UINT8_C(0xff)
 /** Flag indicating that the data is preceded by the page address.
@@ -1556,6 +1561,7 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
     RTGCPHYS GCPhysCur = 0;
     PPGMRAMRANGE pCur;
     bool fFTMDeltaSaveActive = FTMIsDeltaLoadSaveActive(pVM);
+    bool const fPostCopy = fLiveSave && uPass == SSM_PASS_FINAL && pgmR3PostCopyIsDeferring(pVM);
 
     pgmLock(pVM);
     do
@@ -1633,7 +1639,25 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                     bool        fBallooned = PGM_PAGE_IS_BALLOONED(pCurPage);
                     bool        fSkipped = false;
 
-                    if (!fZero && !fBallooned)
+                    if (!fZero && !fBallooned && fPostCopy)
+                    {
+                        /*
+                         * Post-copy: Just record the page, the target will
+                         * get the contents after it has taken over.
+                         */
+                        rc = pgmR3PostCopyDeferPage(pVM, GCPhys);
+                        pgmUnlock(pVM);
+                        AssertLogRelMsgRCReturn(rc, ("rc=%Rrc GCPhys=%RGp\n", rc, GCPhys), rc);
+
+                        if (GCPhys == GCPhysLast + PAGE_SIZE)
+                            rc = SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_DEFERRED);
+                        else
+                        {
+                            SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_DEFERRED | PGM_STATE_REC_FLAG_ADDR);
+                            rc = SSMR3PutGCPhys(pSSM, GCPhys);
+                        }
+                    }
+                    else if (!fZero && !fBallooned)
                     {
                         /*
                          * Copy the page and then save it outside the lock (since any
@@ -1888,6 +1912,58 @@ static DECLCALLBACK(int) pgmR3LiveExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
 }
 
 
+/**
+ * Auto-converge worker for pgmR3LiveVote.
+ *
+ * When enabled, this progressively lowers the CPU execution cap of the VM
+ * while the guest dirties pages faster than they are being saved, so that
+ * write-heavy guests eventually converge instead of voting for another pass
+ * forever.  The original cap is restored by pgmR3SaveDone.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @param   cDirtyNow   The number of pages dirtied since the previous vote.
+ * @param   uPass       The data pass.
+ */
+static void pgmR3LiveAutoConverge(PVM pVM, uint32_t cDirtyNow, uint32_t uPass)
+{
+    uint64_t const uNowNS     = RTTimeNanoTS();
+    uint64_t const cNsElapsed = uNowNS - pVM->pgm.s.LiveSave.uLastVoteNS;
+    pVM->pgm.s.LiveSave.uLastVoteNS = uNowNS;
+    if (!cNsElapsed)
+        return;
+    uint32_t const cDirtyPagesPerSecond = (uint32_t)RT_MIN((uint64_t)cDirtyNow * RT_NS_1SEC / cNsElapsed, UINT32_MAX);
+    pVM->pgm.s.LiveSave.cDirtyPagesPerSecond = cDirtyPagesPerSecond;
+
+    /* The speed estimate is bogus before pass 8, see pgmR3LiveExec. */
+    if (   !pVM->pgm.s.LiveSave.fAutoConverge
+        || uPass < 8
+        || cDirtyPagesPerSecond <= pVM->pgm.s.LiveSave.cPagesPerSecond)
+        return;
+
+    uint32_t uCap = pVM->pgm.s.LiveSave.uAutoConvergeCap;
+    if (!uCap)
+    {
+        pVM->pgm.s.LiveSave.uAutoConvergeCapOrg = pVM->uCpuExecutionCap;
+        uCap = pVM->uCpuExecutionCap;
+    }
+    if (uCap <= pVM->pgm.s.LiveSave.uAutoConvergeCapMin)
+        return;
+    uCap = uCap > pVM->pgm.s.LiveSave.uAutoConvergeCapMin + pVM->pgm.s.LiveSave.uAutoConvergeCapStep
+         ? uCap - pVM->pgm.s.LiveSave.uAutoConvergeCapStep
+         : pVM->pgm.s.LiveSave.uAutoConvergeCapMin;
+
+    int rc = VMR3SetCpuExecutionCap(pVM->pUVM, uCap);
+    if (RT_SUCCESS(rc))
+    {
+        LogRel(("PGM: Auto-converge: pass %u: %u dirty pages/s vs. %u saved pages/s - lowering CPU execution cap to %u%%\n",
+                uPass, cDirtyPagesPerSecond, pVM->pgm.s.LiveSave.cPagesPerSecond, uCap));
+        pVM->pgm.s.LiveSave.uAutoConvergeCap = uCap;
+    }
+    else
+        LogRel(("PGM: Auto-converge: VMR3SetCpuExecutionCap(,%u) -> %Rrc\n", uCap, rc));
+}
+
+
 /**
  * Votes on whether the live save phase is done or not.
  *
@@ -1942,6 +2018,16 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
                                           / ((long double)cNsElapsed / 1000000000.0) );
     pVM->pgm.s.LiveSave.cPagesPerSecond = cPagesPerSecond;
 
+    /*
+     * With post-copy we only do a few passes to get the bulk of the memory
+     * over, whatever is still dirty is transferred after the hand-over.
+     */
+    if (pgmR3PostCopyVote(pVM, uPass))
+    {
+        LogRel(("PGM: Post-copy: pass %u: voting for the final pass with %u dirty pages\n", uPass, cDirtyNow));
+        return VINF_SUCCESS;
+    }
+
     /*
      * Try make a decision.
      */
@@ -1981,6 +2067,12 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
         }
     }
 
+    /*
+     * Throttle the guest if it keeps dirtying memory faster than we can save
+     * it, otherwise we'll never get anywhere.
+     */
+    pgmR3LiveAutoConverge(pVM, cDirtyNow, uPass);
+
     /*
      * Come up with a completion percentage.  Currently this is a simple
      * dirty page (long term) vs. total pages ratio + some pass trickery.
@@ -2011,6 +2103,15 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
  */
 static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
 {
+    /*
+     * We cannot save memory we don't have yet.
+     */
+    if (pgmR3PostCopyIsPending(pVM))
+    {
+        LogRel(("PGM: Cannot save the state while post-copy is still in progress\n"));
+        return VERR_PGM_POST_COPY_ACTIVE;
+    }
+
     /*
      * Indicate that we will be using the write monitoring.
      */
@@ -2041,11 +2142,37 @@ static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
     pVM->pgm.s.LiveSave.cSavedPages       = 0;
     pVM->pgm.s.LiveSave.uSaveStartNS      = RTTimeNanoTS();
     pVM->pgm.s.LiveSave.cPagesPerSecond   = 8192;
+    pVM->pgm.s.LiveSave.cDirtyPagesPerSecond = 0;
+    pVM->pgm.s.LiveSave.uLastVoteNS       = pVM->pgm.s.LiveSave.uSaveStartNS;
+
+    /*
+     * Auto-converge configuration.
+     */
+    /** @cfgm{/PGM/LiveSave/AutoConverge, boolean, false}
+     * Whether to throttle the vCPUs (by lowering the CPU execution cap) when
+     * the guest dirties memory faster than the live save can transfer it. */
+    PCFGMNODE pCfgLiveSave = CFGMR3GetChild(CFGMR3GetRoot(pVM), "/PGM/LiveSave");
+    int rc = CFGMR3QueryBoolDef(pCfgLiveSave, "AutoConverge", &pVM->pgm.s.LiveSave.fAutoConverge, false);
+    AssertLogRelRCReturn(rc, rc);
+    /** @cfgm{/PGM/LiveSave/AutoConvergeMinCap, uint32_t, 1-100, 20}
+     * The lowest CPU execution cap auto-converge will go to. */
+    rc = CFGMR3QueryU32Def(pCfgLiveSave, "AutoConvergeMinCap", &pVM->pgm.s.LiveSave.uAutoConvergeCapMin, 20);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(pVM->pgm.s.LiveSave.uAutoConvergeCapMin >= 1 && pVM->pgm.s.LiveSave.uAutoConvergeCapMin <= 100,
+                          ("AutoConvergeMinCap=%u\n", pVM->pgm.s.LiveSave.uAutoConvergeCapMin), VERR_OUT_OF_RANGE);
+    /** @cfgm{/PGM/LiveSave/AutoConvergeStep, uint32_t, 1-99, 10}
+     * How much to lower the CPU execution cap per pass while not converging. */
+    rc = CFGMR3QueryU32Def(pCfgLiveSave, "AutoConvergeStep", &pVM->pgm.s.LiveSave.uAutoConvergeCapStep, 10);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(pVM->pgm.s.LiveSave.uAutoConvergeCapStep >= 1 && pVM->pgm.s.LiveSave.uAutoConvergeCapStep <= 99,
+                          ("AutoConvergeStep=%u\n", pVM->pgm.s.LiveSave.uAutoConvergeCapStep), VERR_OUT_OF_RANGE);
+    pVM->pgm.s.LiveSave.uAutoConvergeCap    = 0;
+    pVM->pgm.s.LiveSave.uAutoConvergeCapOrg = 0;
 
     /*
      * Per page type.
      */
-    int rc = pgmR3PrepRomPages(pVM);
+    rc = pgmR3PrepRomPages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepMmio2Pages(pVM);
     if (RT_SUCCESS(rc))
@@ -2068,6 +2195,12 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
     int     rc   = VINF_SUCCESS;
     PPGM    pPGM = &pVM->pgm.s;
 
+    if (pgmR3PostCopyIsPending(pVM))
+    {
+        LogRel(("PGM: Cannot save the state while post-copy is still in progress\n"));
+        return VERR_PGM_POST_COPY_ACTIVE;
+    }
+
     /*
      * Lock PGM and set the no-more-writes indicator.
      */
@@ -2155,6 +2288,18 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
     pVM->pgm.s.fPhysWriteMonitoringEngaged = false;
     pgmUnlock(pVM);
 
+    /*
+     * Lift the auto-converge throttling.
+     */
+    if (pVM->pgm.s.LiveSave.uAutoConvergeCap)
+    {
+        LogRel(("PGM: Auto-converge: restoring CPU execution cap to %u%%\n", pVM->pgm.s.LiveSave.uAutoConvergeCapOrg));
+        int rc = VMR3SetCpuExecutionCap(pVM->pUVM, pVM->pgm.s.LiveSave.uAutoConvergeCapOrg);
+        AssertLogRelRC(rc);
+        pVM->pgm.s.LiveSave.uAutoConvergeCap    = 0;
+        pVM->pgm.s.LiveSave.uAutoConvergeCapOrg = 0;
+    }
+
     NOREF(pSSM);
     return VINF_SUCCESS;
 }
@@ -2689,6 +2834,7 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             case PGM_STATE_REC_RAM_ZERO:
             case PGM_STATE_REC_RAM_RAW:
             case PGM_STATE_REC_RAM_BALLOONED:
+            case PGM_STATE_REC_RAM_DEFERRED:
             {
                 /*
                  * Get the address and resolve it into a page descriptor.
@@ -2794,6 +2940,25 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
                         break;
                     }
 
+                    case PGM_STATE_REC_RAM_DEFERRED:
+                    {
+                        /* The contents arrive after the VM has been resumed,
+                           pgmR3LoadDone protects the page until then.  Only
+                           a target that agreed to post-copy can do that. */
+                        AssertLogRelMsgReturn(uVersion > PGM_SAVED_STATE_VERSION_PRE_POST_COPY, ("uVersion=%u\n", uVersion),
+                                              VERR_PGM_SAVED_REC_TYPE);
+                        if (!pgmR3PostCopyIsAccepting(pVM))
+                        {
+                            LogRel(("PGM: The saved state contains post-copy records, but post-copy was not negotiated\n"));
+                            return VERR_PGM_POST_COPY_NOT_ACCEPTED;
+                        }
+                        AssertLogRelMsgReturn(PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM, ("GCPhys=%RGp %R[pgmpage]\n", GCPhys, pPage),
+                                              VERR_PGM_LOAD_UNEXPECTED_PAGE_TYPE);
+                        rc = pgmR3PostCopyDeferPage(pVM, GCPhys);
+                        AssertLogRelRCReturn(rc, rc);
+                        break;
+                    }
+
                     default:
                         AssertMsgFailedReturn(("%#x\n", u8), VERR_PGM_SAVED_REC_TYPE);
                 }
@@ -3157,11 +3322,13 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
      */
     if (   (   uPass != SSM_PASS_FINAL
             && uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_POST_COPY
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
             && uVersion != PGM_SAVED_STATE_VERSION_NO_RAM_CFG)
         || (   uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_POST_COPY
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
@@ -3325,6 +3492,20 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
 }
 
 
+/**
+ * @callback_method_impl{FNSSMINTLOADDONE}
+ */
+static DECLCALLBACK(int) pgmR3LoadDone(PVM pVM, PSSMHANDLE pSSM)
+{
+    NOREF(pSSM);
+
+    /*
+     * Protect the pages that are still on the source (post-copy).
+     */
+    return pgmR3PostCopyLoadDone(pVM);
+}
+
+
 /**
  * Registers the saved state callbacks with SSM.
  *
@@ -3337,6 +3518,6 @@ int pgmR3InitSavedState(PVM pVM, uint64_t cbRam)
     return SSMR3RegisterInternal(pVM, "pgm", 1, PGM_SAVED_STATE_VERSION, (size_t)cbRam + sizeof(PGM),
                                  pgmR3LivePrep, pgmR3LiveExec, pgmR3LiveVote,
                                  NULL,          pgmR3SaveExec, pgmR3SaveDone,
-                                 pgmR3LoadPrep, pgmR3Load,     NULL);
+                                 pgmR3LoadPrep, pgmR3Load,     pgmR3LoadDone);
 }
 
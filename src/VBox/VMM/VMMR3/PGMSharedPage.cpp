@@ -22,9 +22,11 @@
 #define LOG_GROUP LOG_GROUP_PGM_SHARED
 #include <VBox/vmm/pgm.h>
 #include <VBox/vmm/stam.h>
+#include <VBox/vmm/tm.h>
 #include <VBox/vmm/uvm.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
+#include <VBox/vmm/cfgm.h>
 #include <VBox/sup.h>
 #include <VBox/param.h>
 #include <VBox/err.h>
@@ -264,6 +266,179 @@ VMMR3DECL(int) PGMR3SharedModuleCheckAll(PVM pVM)
 }
 
 
+/**
+ * Rendezvous callback doing a page deduplication scan step.
+ *
+ * @returns VBox strict status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pVCpu               Pointer to the VMCPU of the calling EMT.
+ * @param   pvUser              Not used.
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PageDedupRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    NOREF(pVCpu); NOREF(pvUser);
+
+    /* Flush all pending handy page operations before changing any shared page assignments. */
+    int rc = PGMR3PhysAllocateHandyPages(pVM);
+    AssertRC(rc);
+
+    /*
+     * Feed the configured number of pages to ring-0 in slices it accepts.
+     */
+    uint32_t cLeft = pVM->pgm.s.PageDedup.cPagesPerScan;
+    while (cLeft > 0)
+    {
+        GMMDEDUPSCANREQ Req;
+        Req.GCPhysCursor = pVM->pgm.s.PageDedup.GCPhysCursor;
+        Req.cPagesToScan = RT_MIN(cLeft, GMM_DEDUP_MAX_PAGES_PER_SCAN);
+
+        /* Lock it here as we can't deal with busy locks in this ring-0 path. */
+        pgmLock(pVM);
+        pgmR3PhysAssertSharedPageChecksums(pVM);
+        rc = GMMR3DedupScan(pVM, &Req);
+        pgmR3PhysAssertSharedPageChecksums(pVM);
+        pgmUnlock(pVM);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("PGM: Page deduplication failed with %Rrc, disabling it\n", rc));
+            ASMAtomicWriteBool(&pVM->pgm.s.PageDedup.fEnabled, false);
+            break;
+        }
+
+        STAM_REL_COUNTER_ADD(&pVM->pgm.s.PageDedup.StatScannedPages,   Req.cScannedPages);
+        STAM_REL_COUNTER_ADD(&pVM->pgm.s.PageDedup.StatMergedPages,    Req.cMergedPages);
+        STAM_REL_COUNTER_ADD(&pVM->pgm.s.PageDedup.StatNewSharedPages, Req.cNewSharedPages);
+        STAM_REL_COUNTER_ADD(&pVM->pgm.s.PageDedup.StatMismatches,     Req.cMismatches);
+
+        pVM->pgm.s.PageDedup.GCPhysCursor = Req.GCPhysCursor;
+        if (!Req.GCPhysCursor)
+        {
+            /* Wrapped around; leave the rest of the budget for the next round. */
+            STAM_REL_COUNTER_INC(&pVM->pgm.s.PageDedup.StatPasses);
+            break;
+        }
+        cLeft -= Req.cPagesToScan;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * EMT worker queued by pgmR3PageDedupTimer.
+ *
+ * @param   pVM         Pointer to the VM.
+ */
+static DECLCALLBACK(void) pgmR3PageDedupHelper(PVM pVM)
+{
+    /*
+     * Don't mess with the page states while they're being saved or teleported,
+     * nor when the VM isn't running any more.
+     */
+    VMSTATE enmState = VMR3GetState(pVM);
+    if (   pVM->pgm.s.PageDedup.fEnabled
+        && !pVM->pgm.s.LiveSave.fActive
+        && !pVM->pgm.s.pPostCopyR3
+        && (   enmState == VMSTATE_RUNNING
+            || enmState == VMSTATE_SUSPENDED))
+    {
+        /* We must stall other VCPUs as we'd otherwise have to send IPI flush commands for every single change we make. */
+        STAM_REL_PROFILE_START(&pVM->pgm.s.PageDedup.StatScan, a);
+        int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PageDedupRendezvous, NULL);
+        AssertRCSuccess(rc);
+        STAM_REL_PROFILE_STOP(&pVM->pgm.s.PageDedup.StatScan, a);
+    }
+    ASMAtomicWriteBool(&pVM->pgm.s.PageDedup.fScanPending, false);
+}
+
+
+/**
+ * @callback_method_impl{FNTMTIMERINT, Paces the page deduplication scanner.}
+ */
+static DECLCALLBACK(void) pgmR3PageDedupTimer(PVM pVM, PTMTIMER pTimer, void *pvUser)
+{
+    NOREF(pvUser);
+    if (!pVM->pgm.s.PageDedup.fEnabled)
+        return;
+
+    /* Don't do the work in the timer callback, queue it for an EMT. */
+    if (ASMAtomicCmpXchgBool(&pVM->pgm.s.PageDedup.fScanPending, true, false))
+    {
+        int rc = VMR3ReqCallVoidNoWait(pVM, VMCPUID_ANY_QUEUE, (PFNRT)pgmR3PageDedupHelper, 1, pVM);
+        if (RT_FAILURE(rc))
+            ASMAtomicWriteBool(&pVM->pgm.s.PageDedup.fScanPending, false);
+    }
+    TMTimerSetMillies(pTimer, pVM->pgm.s.PageDedup.cMsInterval);
+}
+
+
+/**
+ * Initializes the page deduplication scanner.
+ *
+ * The scanner looks for guest pages with identical content in this and all
+ * other VMs on the host and merges them into copy-on-write shared pages.
+ * Unlike the shared module approach it requires no guest cooperation, so it
+ * works for all guest types.  It is paced by a timer and examines a
+ * configurable number of pages per interval.
+ *
+ * @returns VBox status code.
+ * @param   pVM         Pointer to the VM.
+ */
+int pgmR3PageDedupInit(PVM pVM)
+{
+    /*
+     * Read the configuration.
+     */
+    PCFGMNODE pCfg = CFGMR3GetChild(CFGMR3GetRoot(pVM), "/PGM/PageDedup");
+
+    /** @cfgm{/PGM/PageDedup/Enabled, bool, false}
+     * Whether to scan guest RAM for pages which can be shared with identical
+     * pages of this or other VMs. */
+    bool fEnabled;
+    int rc = CFGMR3QueryBoolDef(pCfg, "Enabled", &fEnabled, false);
+    AssertLogRelRCReturn(rc, rc);
+
+    /** @cfgm{/PGM/PageDedup/PagesPerScan, uint32_t, 4096, 1, 1M}
+     * The number of guest pages to examine per scan interval. */
+    rc = CFGMR3QueryU32Def(pCfg, "PagesPerScan", &pVM->pgm.s.PageDedup.cPagesPerScan, 4096);
+    AssertLogRelRCReturn(rc, rc);
+    if (pVM->pgm.s.PageDedup.cPagesPerScan < 1 || pVM->pgm.s.PageDedup.cPagesPerScan > _1M)
+        return VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                          N_("Configuration error: /PGM/PageDedup/PagesPerScan=%u is out of range (1..1M)"),
+                          pVM->pgm.s.PageDedup.cPagesPerScan);
+
+    /** @cfgm{/PGM/PageDedup/Interval, uint32_t, 2000, 10, 60000}
+     * The scan interval in milliseconds.  Each scan stalls all the VCPUs, so
+     * keep this well above the scheduling latencies the guest notices. */
+    rc = CFGMR3QueryU32Def(pCfg, "Interval", &pVM->pgm.s.PageDedup.cMsInterval, 2000);
+    AssertLogRelRCReturn(rc, rc);
+    if (pVM->pgm.s.PageDedup.cMsInterval < 10 || pVM->pgm.s.PageDedup.cMsInterval > 60000)
+        return VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                          N_("Configuration error: /PGM/PageDedup/Interval=%u is out of range (10..60000)"),
+                          pVM->pgm.s.PageDedup.cMsInterval);
+
+    if (!fEnabled)
+        return VINF_SUCCESS;
+    if (pVM->pgm.s.fPciPassthrough)
+    {
+        LogRel(("PGM: Page deduplication is not available with PCI pass-through\n"));
+        return VINF_SUCCESS;
+    }
+
+    /*
+     * Create and arm the timer.
+     */
+    rc = TMR3TimerCreateInternal(pVM, TMCLOCK_REAL, pgmR3PageDedupTimer, NULL, "PGM Page Dedup", &pVM->pgm.s.PageDedup.pTimerR3);
+    AssertLogRelRCReturn(rc, rc);
+    pVM->pgm.s.PageDedup.fEnabled = true;
+    rc = TMTimerSetMillies(pVM->pgm.s.PageDedup.pTimerR3, pVM->pgm.s.PageDedup.cMsInterval);
+    AssertLogRelRCReturn(rc, rc);
+
+    LogRel(("PGM: Page deduplication enabled: %u pages every %u ms\n",
+            pVM->pgm.s.PageDedup.cPagesPerScan, pVM->pgm.s.PageDedup.cMsInterval));
+    return VINF_SUCCESS;
+}
+
+
 # ifdef DEBUG
 /**
  * Query the state of a page in a shared module
@@ -61,6 +61,7 @@
 #include <iprt/mem.h>
 #include <iprt/stream.h>
 #include <iprt/string.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -118,6 +119,53 @@ typedef struct STAMR3SNAPSHOTONE
 } STAMR3SNAPSHOTONE, *PSTAMR3SNAPSHOTONE;
 
 
+/**
+ * Binary delta cursor (STAMR3DeltaCreate).
+ */
+typedef struct STAMDELTA
+{
+    /** The user mode VM handle. */
+    PUVM            pUVM;
+    /** The sample pattern, NULL for all. */
+    char           *pszPat;
+    /** The number of sample slots (multiple of 64). */
+    uint32_t        cSlots;
+    /** The number of records in the current packet. */
+    uint32_t        cRecords;
+    /** The previously sent values, STAMDELTA_MAX_VALUES per slot. */
+    uint64_t       *pau64Prev;
+    /** Bitmap of samples the consumer has been sent a definition of. */
+    uint32_t       *pbmDefined;
+    /** Bitmap of samples enumerated by the current collection pass. */
+    uint32_t       *pbmSeen;
+    /** The packet buffer. */
+    uint8_t        *pbBuf;
+    /** The size of the packet buffer. */
+    size_t          cbBuf;
+    /** The current packet size. */
+    size_t          offBuf;
+    /** The status of the current collection pass. */
+    int             rc;
+    /** Set when papDescs holds the matching samples of uGeneration. */
+    bool            fDescsValid;
+    /** The STAMUSERPERVM::uGeneration papDescs reflects. */
+    uint32_t        uGeneration;
+    /** The number of matching samples in papDescs. */
+    uint32_t        cDescs;
+    /** The number of entries allocated for papDescs. */
+    uint32_t        cDescsAlloc;
+    /** The samples matching the pattern, valid only while the generation is
+     * unchanged and the STAM lock is held. */
+    PSTAMDESC      *papDescs;
+    /** The expressions of a multi expression pattern, NULL if not. */
+    char          **papszExpressions;
+    /** The number of expressions in papszExpressions. */
+    unsigned        cExpressions;
+    /** The string papszExpressions points into. */
+    char           *pszExprCopy;
+} STAMDELTA;
+
+
 /**
  * Init record for a ring-0 statistic sample.
  */
@@ -150,6 +198,8 @@ static DECLCALLBACK(void)   stamR3EnumRelLogPrintf(PSTAMR3PRINTONEARGS pvArg, co
 static DECLCALLBACK(void)   stamR3EnumPrintf(PSTAMR3PRINTONEARGS pvArg, const char *pszFormat, ...);
 static int                  stamR3SnapshotOne(PSTAMDESC pDesc, void *pvArg);
 static int                  stamR3SnapshotPrintf(PSTAMR3SNAPSHOTONE pThis, const char *pszFormat, ...);
+static int                  stamR3DeltaOne(PSTAMDESC pDesc, void *pvArg);
+static int                  stamR3DeltaRebuildOne(PSTAMDESC pDesc, void *pvArg);
 static int                  stamR3PrintOne(PSTAMDESC pDesc, void *pvArg);
 static int                  stamR3EnumOne(PSTAMDESC pDesc, void *pvArg);
 static bool                 stamR3MultiMatch(const char * const *papszExpressions, unsigned cExpressions, unsigned *piExpression, const char *pszName);
@@ -359,6 +409,8 @@ VMMR3DECL(void) STAMR3TermUVM(PUVM pUVM)
     pUVM->stam.s.pRoot = NULL;
 #endif
 
+    Assert(!pUVM->stam.s.pStream);
+
     Assert(pUVM->stam.s.RWSem != NIL_RTSEMRW);
     RTSemRWDestroy(pUVM->stam.s.RWSem);
     pUVM->stam.s.RWSem = NIL_RTSEMRW;
@@ -1356,6 +1408,7 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
         case STAMTYPE_COUNTER:
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             AssertMsg(!((uintptr_t)pvSample & 7), ("%p - %s\n", pvSample, pszName));
             break;
 
@@ -1393,6 +1446,14 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
     }
 #endif /* VBOX_STRICT */
 
+    /*
+     * Histograms live in zero initialized instance data more often than not,
+     * which would pin uMin at zero.  Get them into shape before anyone can
+     * see them.
+     */
+    if (enmType == STAMTYPE_HISTOGRAM)
+        STAMHistogramInit((PSTAMHISTOGRAM)pvSample);
+
     /*
      * Create a new node and insert it at the current location.
      */
@@ -1404,6 +1465,8 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
         pNew->pszName       = (char *)memcpy((char *)(pNew + 1), pszName, cchName + 1);
         pNew->enmType       = enmType;
         pNew->enmVisibility = enmVisibility;
+        pNew->iSample       = pUVM->stam.s.iNextSample++;
+        pUVM->stam.s.uGeneration++;
         if (enmType != STAMTYPE_CALLBACK)
             pNew->u.pv      = pvSample;
         else
@@ -1449,6 +1512,7 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
 static int stamR3DestroyDesc(PUVM pUVM, PSTAMDESC pCur)
 {
     RTListNodeRemove(&pCur->ListEntry);
+    pUVM->stam.s.uGeneration++;
 #ifdef STAM_WITH_LOOKUP_TREE
     pCur->pLookup->pDesc = NULL; /** @todo free lookup nodes once it's working. */
     stamR3LookupDecUsage(pCur->pLookup);
@@ -1722,6 +1786,10 @@ static int stamR3ResetOne(PSTAMDESC pDesc, void *pvArg)
             ASMAtomicXchgU64(&pDesc->u.pProfile->cTicksMin, ~0);
             break;
 
+        case STAMTYPE_HISTOGRAM:
+            STAMHistogramInit(pDesc->u.pHistogram);
+            break;
+
         case STAMTYPE_RATIO_U32_RESET:
             ASMAtomicXchgU32(&pDesc->u.pRatioU32->u32A, 0);
             ASMAtomicXchgU32(&pDesc->u.pRatioU32->u32B, 0);
@@ -1868,6 +1936,19 @@ static int stamR3SnapshotOne(PSTAMDESC pDesc, void *pvArg)
                                  pDesc->u.pRatioU32->u32A, pDesc->u.pRatioU32->u32B);
             break;
 
+        case STAMTYPE_HISTOGRAM:
+        {
+            PCSTAMHISTOGRAM pHist = pDesc->u.pHistogram;
+            if (pDesc->enmVisibility == STAMVISIBILITY_USED && pHist->cValues == 0)
+                return VINF_SUCCESS;
+            stamR3SnapshotPrintf(pThis, "<Histogram cValues=\"%lld\" uTotal=\"%lld\" uMin=\"%lld\" uMax=\"%lld\""
+                                 " p50=\"%lld\" p90=\"%lld\" p99=\"%lld\" p999=\"%lld\"",
+                                 pHist->cValues, pHist->uTotal, pHist->cValues ? pHist->uMin : 0, pHist->uMax,
+                                 STAMR3HistogramPercentile(pHist, 500), STAMR3HistogramPercentile(pHist, 900),
+                                 STAMR3HistogramPercentile(pHist, 990), STAMR3HistogramPercentile(pHist, 999));
+            break;
+        }
+
         case STAMTYPE_CALLBACK:
         {
             char szBuf[512];
@@ -2084,6 +2165,427 @@ VMMR3DECL(int)  STAMR3SnapshotFree(PUVM pUVM, char *pszSnapshot)
 }
 
 
+/**
+ * Creates a binary delta cursor.
+ *
+ * The cursor remembers what it has sent, so each STAMR3DeltaCollect call only
+ * produces records for samples which were added, changed or removed since
+ * the previous call.  A cursor must only be used by one thread at a time.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pszPat      The name matching pattern. NULL for all samples.
+ * @param   ppDelta     Where to return the cursor.
+ */
+VMMR3DECL(int) STAMR3DeltaCreate(PUVM pUVM, const char *pszPat, PSTAMDELTA *ppDelta)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_VALID_EXT_RETURN(pUVM->pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(ppDelta, VERR_INVALID_POINTER);
+    AssertCompileSize(STAMDELTAHDR, 24);
+    AssertCompileSize(STAMDELTAREC, 8);
+    AssertCompileSize(STAMDELTADEF, 8);
+
+    PSTAMDELTA pDelta = (PSTAMDELTA)RTMemAllocZ(sizeof(*pDelta));
+    if (!pDelta)
+        return VERR_NO_MEMORY;
+    pDelta->pUVM = pUVM;
+    if (pszPat && *pszPat && strcmp(pszPat, "*"))
+    {
+        pDelta->pszPat = RTStrDup(pszPat);
+        if (!pDelta->pszPat)
+        {
+            RTMemFree(pDelta);
+            return VERR_NO_STR_MEMORY;
+        }
+
+        /* Split multi expression patterns once, for the ring-0 updates. */
+        if (strchr(pszPat, '|'))
+        {
+            pDelta->papszExpressions = stamR3SplitPattern(pszPat, &pDelta->cExpressions, &pDelta->pszExprCopy);
+            if (!pDelta->papszExpressions)
+            {
+                RTStrFree(pDelta->pszPat);
+                RTMemFree(pDelta);
+                return VERR_NO_MEMORY;
+            }
+        }
+    }
+
+    *ppDelta = pDelta;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys a binary delta cursor.
+ *
+ * @param   pDelta      The cursor. NULL is ignored.
+ */
+VMMR3DECL(void) STAMR3DeltaDestroy(PSTAMDELTA pDelta)
+{
+    if (!pDelta)
+        return;
+    RTStrFree(pDelta->pszPat);
+    RTMemTmpFree(pDelta->papszExpressions);
+    RTStrFree(pDelta->pszExprCopy);
+    RTMemFree(pDelta->papDescs);
+    RTMemFree(pDelta->pau64Prev);
+    RTMemFree(pDelta->pbmDefined);
+    RTMemFree(pDelta->pbmSeen);
+    RTMemFree(pDelta->pbBuf);
+    RTMemFree(pDelta);
+}
+
+
+/**
+ * Makes sure the cursor has a slot for the given sample index.
+ *
+ * @returns VBox status code.
+ * @param   pDelta      The cursor.
+ * @param   iSample     The sample index.
+ */
+static int stamR3DeltaEnsureSlot(PSTAMDELTA pDelta, uint32_t iSample)
+{
+    if (RT_LIKELY(iSample < pDelta->cSlots))
+        return VINF_SUCCESS;
+
+    uint32_t const cOld = pDelta->cSlots;
+    uint32_t const cNew = RT_ALIGN_32(RT_MAX(iSample + 1, cOld * 2), 64);
+    uint64_t *pau64Prev  = (uint64_t *)RTMemRealloc(pDelta->pau64Prev, cNew * STAMDELTA_MAX_VALUES * sizeof(uint64_t));
+    if (pau64Prev)
+        pDelta->pau64Prev = pau64Prev;
+    uint32_t *pbmDefined = (uint32_t *)RTMemRealloc(pDelta->pbmDefined, cNew / 8);
+    if (pbmDefined)
+        pDelta->pbmDefined = pbmDefined;
+    uint32_t *pbmSeen    = (uint32_t *)RTMemRealloc(pDelta->pbmSeen, cNew / 8);
+    if (pbmSeen)
+        pDelta->pbmSeen = pbmSeen;
+    if (!pau64Prev || !pbmDefined || !pbmSeen)
+        return VERR_NO_MEMORY;
+
+    RT_BZERO(&pau64Prev[cOld * STAMDELTA_MAX_VALUES], (cNew - cOld) * STAMDELTA_MAX_VALUES * sizeof(uint64_t));
+    RT_BZERO((uint8_t *)pbmDefined + cOld / 8, (cNew - cOld) / 8);
+    RT_BZERO((uint8_t *)pbmSeen + cOld / 8, (cNew - cOld) / 8);
+    pDelta->cSlots = cNew;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Appends a record to the packet being assembled.
+ *
+ * @returns Pointer to the payload, NULL on failure (pDelta->rc is set).
+ * @param   pDelta      The cursor.
+ * @param   iSample     The sample index.
+ * @param   enmKind     The record kind.
+ * @param   cValues     The value count (STAMDELTAKIND_VALUES).
+ * @param   cbData      The payload size, will be aligned.
+ */
+static void *stamR3DeltaAppend(PSTAMDELTA pDelta, uint32_t iSample, STAMDELTAKIND enmKind, uint8_t cValues, size_t cbData)
+{
+    cbData = RT_ALIGN_Z(cbData, 8);
+    Assert(cbData <= UINT16_MAX - 7);
+
+    size_t const cbRec = sizeof(STAMDELTAREC) + cbData;
+    if (pDelta->cbBuf - pDelta->offBuf < cbRec)
+    {
+        size_t  cbNew = RT_ALIGN_Z(RT_MAX(pDelta->cbBuf * 2, pDelta->offBuf + cbRec), _4K);
+        uint8_t *pbNew = (uint8_t *)RTMemRealloc(pDelta->pbBuf, cbNew);
+        if (!pbNew)
+        {
+            pDelta->rc = VERR_NO_MEMORY;
+            return NULL;
+        }
+        pDelta->pbBuf = pbNew;
+        pDelta->cbBuf = cbNew;
+    }
+
+    PSTAMDELTAREC pRec = (PSTAMDELTAREC)&pDelta->pbBuf[pDelta->offBuf];
+    pRec->iSample = iSample;
+    pRec->u8Kind  = (uint8_t)enmKind;
+    pRec->cValues = cValues;
+    pRec->cbData  = (uint16_t)cbData;
+    RT_BZERO(pRec + 1, cbData);
+    pDelta->offBuf += cbRec;
+    pDelta->cRecords++;
+    return pRec + 1;
+}
+
+
+/**
+ * Gets the delta encoding values of a sample.
+ *
+ * @returns Number of values.
+ * @param   pDesc       The sample.
+ * @param   pau64       Where to return the values (STAMDELTA_MAX_VALUES).
+ */
+static unsigned stamR3DeltaGetValues(PSTAMDESC pDesc, uint64_t *pau64)
+{
+    switch (pDesc->enmType)
+    {
+        case STAMTYPE_COUNTER:
+            pau64[0] = pDesc->u.pCounter->c;
+            return 1;
+
+        case STAMTYPE_PROFILE:
+        case STAMTYPE_PROFILE_ADV:
+            pau64[0] = pDesc->u.pProfile->cPeriods;
+            pau64[1] = pDesc->u.pProfile->cTicks;
+            pau64[2] = pDesc->u.pProfile->cTicksMax;
+            pau64[3] = pDesc->u.pProfile->cTicksMin;
+            return 4;
+
+        case STAMTYPE_RATIO_U32:
+        case STAMTYPE_RATIO_U32_RESET:
+            pau64[0] = pDesc->u.pRatioU32->u32A;
+            pau64[1] = pDesc->u.pRatioU32->u32B;
+            return 2;
+
+        case STAMTYPE_HISTOGRAM:
+            pau64[0] = pDesc->u.pHistogram->cValues;
+            pau64[1] = STAMR3HistogramPercentile(pDesc->u.pHistogram, 500);
+            pau64[2] = STAMR3HistogramPercentile(pDesc->u.pHistogram, 990);
+            pau64[3] = pDesc->u.pHistogram->uMax;
+            return 4;
+
+        case STAMTYPE_U8:
+        case STAMTYPE_U8_RESET:
+        case STAMTYPE_X8:
+        case STAMTYPE_X8_RESET:
+            pau64[0] = *pDesc->u.pu8;
+            return 1;
+
+        case STAMTYPE_U16:
+        case STAMTYPE_U16_RESET:
+        case STAMTYPE_X16:
+        case STAMTYPE_X16_RESET:
+            pau64[0] = *pDesc->u.pu16;
+            return 1;
+
+        case STAMTYPE_U32:
+        case STAMTYPE_U32_RESET:
+        case STAMTYPE_X32:
+        case STAMTYPE_X32_RESET:
+            pau64[0] = *pDesc->u.pu32;
+            return 1;
+
+        case STAMTYPE_U64:
+        case STAMTYPE_U64_RESET:
+        case STAMTYPE_X64:
+        case STAMTYPE_X64_RESET:
+            pau64[0] = *pDesc->u.pu64;
+            return 1;
+
+        case STAMTYPE_BOOL:
+        case STAMTYPE_BOOL_RESET:
+            pau64[0] = *pDesc->u.pf;
+            return 1;
+
+        case STAMTYPE_CALLBACK:
+            return 0;
+
+        default:
+            AssertMsgFailed(("%d\n", pDesc->enmType));
+            return 0;
+    }
+}
+
+
+/**
+ * Collects the changes since the previous call into a binary delta packet.
+ *
+ * The first call returns definitions and values of all matching samples.
+ * Samples with STAMVISIBILITY_USED are not defined until they become
+ * non-zero.
+ *
+ * @returns VBox status code.
+ * @param   pDelta      The cursor.
+ * @param   ppvPacket   Where to return the packet pointer.  The packet is
+ *                      owned by the cursor and is valid till the next call.
+ * @param   pcbPacket   Where to return the packet size.
+ */
+VMMR3DECL(int) STAMR3DeltaCollect(PSTAMDELTA pDelta, void const **ppvPacket, size_t *pcbPacket)
+{
+    AssertPtrReturn(pDelta, VERR_INVALID_POINTER);
+    AssertPtrReturn(ppvPacket, VERR_INVALID_POINTER);
+    AssertPtrReturn(pcbPacket, VERR_INVALID_POINTER);
+    PUVM pUVM = pDelta->pUVM;
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    *ppvPacket = NULL;
+    *pcbPacket = 0;
+
+    /*
+     * Reset the packet and make room for the header.
+     */
+    int rc = stamR3DeltaEnsureSlot(pDelta, RT_MAX(ASMAtomicReadU32(&pUVM->stam.s.iNextSample), 1) - 1);
+    if (RT_FAILURE(rc))
+        return rc;
+    pDelta->offBuf   = 0;
+    pDelta->cRecords = 0;
+    pDelta->rc       = VINF_SUCCESS;
+    if (!stamR3DeltaAppend(pDelta, UINT32_MAX, STAMDELTAKIND_INVALID, 0, sizeof(STAMDELTAHDR) - sizeof(STAMDELTAREC)))
+        return pDelta->rc;
+    pDelta->cRecords = 0;
+    uint64_t const u64NanoTS = RTTimeNanoTS();
+
+    /*
+     * If nothing was registered or deregistered since the previous pass, the
+     * samples matching the pattern are the ones we cached and none of them
+     * can have gone away, so there is no need to walk the whole list.
+     */
+    uint32_t const uGeneration = ASMAtomicReadU32(&pUVM->stam.s.uGeneration);
+    bool           fDone       = false;
+    if (pDelta->fDescsValid && pDelta->uGeneration == uGeneration)
+    {
+        if (pDelta->cExpressions)
+            stamR3Ring0StatsUpdateMultiU(pUVM, pDelta->papszExpressions, pDelta->cExpressions);
+        else
+            stamR3Ring0StatsUpdateU(pUVM, pDelta->pszPat ? pDelta->pszPat : "*");
+
+        STAM_LOCK_RD(pUVM);
+        if (pUVM->stam.s.uGeneration == uGeneration)
+        {
+            for (uint32_t i = 0; i < pDelta->cDescs && RT_SUCCESS(rc); i++)
+                rc = stamR3DeltaOne(pDelta->papDescs[i], pDelta);
+            fDone = true;
+        }
+        STAM_UNLOCK_RD(pUVM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    /*
+     * Otherwise enumerate the samples, rebuilding the cache, then report the
+     * ones which went away.
+     */
+    if (!fDone)
+    {
+        pDelta->fDescsValid = false;
+        pDelta->cDescs      = 0;
+        RT_BZERO(pDelta->pbmSeen, pDelta->cSlots / 8);
+        rc = stamR3EnumU(pUVM, pDelta->pszPat, true /* fUpdateRing0 */, stamR3DeltaRebuildOne, pDelta);
+        if (RT_SUCCESS(rc))
+            rc = pDelta->rc;
+        if (RT_FAILURE(rc))
+            return rc;
+
+        for (uint32_t iSample = 0; iSample < pDelta->cSlots; iSample++)
+            if (   ASMBitTest(pDelta->pbmDefined, iSample)
+                && !ASMBitTest(pDelta->pbmSeen, iSample))
+            {
+                ASMBitClear(pDelta->pbmDefined, iSample);
+                if (!stamR3DeltaAppend(pDelta, iSample, STAMDELTAKIND_REMOVE, 0, 0))
+                    return pDelta->rc;
+            }
+
+        /* A (de)registration racing the enumeration just costs another rebuild. */
+        pDelta->uGeneration = uGeneration;
+        pDelta->fDescsValid = true;
+    }
+
+    /*
+     * Complete the header.
+     */
+    PSTAMDELTAHDR pHdr = (PSTAMDELTAHDR)pDelta->pbBuf;
+    pHdr->u32Magic    = STAMDELTA_MAGIC;
+    pHdr->u16Version  = STAMDELTA_VERSION;
+    pHdr->u16Reserved = 0;
+    pHdr->cbPacket    = (uint32_t)pDelta->offBuf;
+    pHdr->cRecords    = pDelta->cRecords;
+    pHdr->u64NanoTS   = u64NanoTS;
+
+    *ppvPacket = pDelta->pbBuf;
+    *pcbPacket = pDelta->offBuf;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * stamR3EnumU callback employed by STAMR3DeltaCollect when rebuilding the
+ * sample cache.
+ *
+ * @returns VBox status code, but it's interpreted as 0 == success / !0 == failure by enmR3Enum.
+ * @param   pDesc       The sample.
+ * @param   pvArg       The delta cursor.
+ */
+static int stamR3DeltaRebuildOne(PSTAMDESC pDesc, void *pvArg)
+{
+    PSTAMDELTA pDelta = (PSTAMDELTA)pvArg;
+    if (pDelta->cDescs >= pDelta->cDescsAlloc)
+    {
+        uint32_t const cNew = RT_MAX(pDelta->cDescsAlloc * 2, 64);
+        PSTAMDESC *papNew = (PSTAMDESC *)RTMemRealloc(pDelta->papDescs, cNew * sizeof(papNew[0]));
+        if (!papNew)
+            return pDelta->rc = VERR_NO_MEMORY;
+        pDelta->papDescs    = papNew;
+        pDelta->cDescsAlloc = cNew;
+    }
+    pDelta->papDescs[pDelta->cDescs++] = pDesc;
+    return stamR3DeltaOne(pDesc, pvArg);
+}
+
+
+/**
+ * stamR3EnumU callback employed by STAMR3DeltaCollect.
+ *
+ * @returns VBox status code, but it's interpreted as 0 == success / !0 == failure by enmR3Enum.
+ * @param   pDesc       The sample.
+ * @param   pvArg       The delta cursor.
+ */
+static int stamR3DeltaOne(PSTAMDESC pDesc, void *pvArg)
+{
+    PSTAMDELTA pDelta = (PSTAMDELTA)pvArg;
+    uint32_t const iSample = pDesc->iSample;
+    int rc = stamR3DeltaEnsureSlot(pDelta, iSample);
+    if (RT_FAILURE(rc))
+        return pDelta->rc = rc;
+
+    uint64_t au64[STAMDELTA_MAX_VALUES] = { 0, 0, 0, 0 };
+    unsigned const cValues = stamR3DeltaGetValues(pDesc, au64);
+    uint64_t *pau64Prev = &pDelta->pau64Prev[iSample * STAMDELTA_MAX_VALUES];
+
+    if (!ASMBitTest(pDelta->pbmDefined, iSample))
+    {
+        if (   pDesc->enmVisibility == STAMVISIBILITY_USED
+            && cValues > 0
+            && !(au64[0] | au64[1] | au64[2] | au64[3]))
+            return VINF_SUCCESS;
+
+        size_t const cchName = strlen(pDesc->pszName);
+        size_t const cchDesc = pDesc->pszDesc ? RT_MIN(strlen(pDesc->pszDesc), _16K) : 0;
+        PSTAMDELTADEF pDef = (PSTAMDELTADEF)stamR3DeltaAppend(pDelta, iSample, STAMDELTAKIND_DEFINE, 0,
+                                                              sizeof(*pDef) + cchName + 1 + cchDesc + 1);
+        if (!pDef)
+            return pDelta->rc;
+        pDef->u8Type  = (uint8_t)pDesc->enmType;
+        pDef->u8Unit  = (uint8_t)pDesc->enmUnit;
+        pDef->cchName = (uint16_t)cchName;
+        pDef->cchDesc = (uint16_t)cchDesc;
+        char *psz = (char *)(pDef + 1);
+        memcpy(psz, pDesc->pszName, cchName);
+        if (cchDesc)
+            memcpy(psz + cchName + 1, pDesc->pszDesc, cchDesc);
+
+        ASMBitSet(pDelta->pbmDefined, iSample);
+        pau64Prev[0] = ~au64[0]; /* force the values out */
+    }
+    ASMBitSet(pDelta->pbmSeen, iSample);
+
+    if (   cValues > 0
+        && memcmp(pau64Prev, au64, sizeof(au64)))
+    {
+        uint64_t *pau64 = (uint64_t *)stamR3DeltaAppend(pDelta, iSample, STAMDELTAKIND_VALUES, (uint8_t)cValues,
+                                                        cValues * sizeof(uint64_t));
+        if (!pau64)
+            return pDelta->rc;
+        memcpy(pau64, au64, cValues * sizeof(uint64_t));
+        memcpy(pau64Prev, au64, sizeof(au64));
+    }
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Dumps the selected statistics to the log.
  *
@@ -2245,6 +2747,21 @@ static int stamR3PrintOne(PSTAMDESC pDesc, void *pvArg)
                              pDesc->u.pRatioU32->u32A, pDesc->u.pRatioU32->u32B, STAMR3GetUnit(pDesc->enmUnit));
             break;
 
+        case STAMTYPE_HISTOGRAM:
+        {
+            PCSTAMHISTOGRAM pHist = pDesc->u.pHistogram;
+            if (pDesc->enmVisibility == STAMVISIBILITY_USED && pHist->cValues == 0)
+                return VINF_SUCCESS;
+
+            uint64_t u64 = pHist->cValues ? pHist->cValues : 1;
+            pArgs->pfnPrintf(pArgs, "%-32s %8llu %s (%7llu times, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu, min %llu)\n",
+                             pDesc->pszName, pHist->uTotal / u64, STAMR3GetUnit(pDesc->enmUnit), pHist->cValues,
+                             STAMR3HistogramPercentile(pHist, 500), STAMR3HistogramPercentile(pHist, 900),
+                             STAMR3HistogramPercentile(pHist, 990), STAMR3HistogramPercentile(pHist, 999),
+                             pHist->uMax, pHist->cValues ? pHist->uMin : 0);
+            break;
+        }
+
         case STAMTYPE_CALLBACK:
         {
             char szBuf[512];
@@ -2772,6 +3289,63 @@ VMMR3DECL(const char *) STAMR3GetUnit(STAMUNIT enmUnit)
     }
 }
 
+
+/**
+ * Estimates a percentile of the values recorded in a histogram sample.
+ *
+ * The estimate is the middle of the bucket the percentile falls into, clamped
+ * to the recorded min and max values, so the relative error is at most 12.5%.
+ *
+ * @returns The estimated value, 0 if the histogram is empty.
+ * @param   pHist       The histogram sample.
+ * @param   uPerMille   The percentile in per mille (e.g. 990 for the 99th).
+ */
+VMMR3DECL(uint64_t) STAMR3HistogramPercentile(PCSTAMHISTOGRAM pHist, unsigned uPerMille)
+{
+    AssertPtrReturn(pHist, 0);
+    AssertReturn(uPerMille <= 1000, 0);
+
+    /* The buckets aren't updated together with cValues, so count them ourselves. */
+    uint64_t cValues = 0;
+    for (unsigned i = 0; i < RT_ELEMENTS(pHist->acBuckets); i++)
+        cValues += pHist->acBuckets[i];
+    if (!cValues)
+        return 0;
+
+    uint64_t const iRank = RT_MAX((cValues * uPerMille + 999) / 1000, 1);
+    uint64_t       cSeen = 0;
+    unsigned       iBucket;
+    for (iBucket = 0; iBucket < RT_ELEMENTS(pHist->acBuckets) - 1; iBucket++)
+    {
+        cSeen += pHist->acBuckets[iBucket];
+        if (cSeen >= iRank)
+            break;
+    }
+
+    uint64_t uValue;
+    if (iBucket < STAMHISTOGRAM_SUB_BUCKETS)
+        uValue = iBucket;
+    else
+    {
+        unsigned const iBit   = iBucket / STAMHISTOGRAM_SUB_BUCKETS + 1;
+        uint64_t const cbStep = RT_BIT_64(iBit - 2);
+        uValue = (STAMHISTOGRAM_SUB_BUCKETS + iBucket % STAMHISTOGRAM_SUB_BUCKETS) * cbStep + cbStep / 2;
+    }
+
+    /* A value being recorded concurrently may have made it into the buckets
+       but not yet into uMin/uMax, only clamp to a consistent pair. */
+    uint64_t const uMax = pHist->uMax;
+    uint64_t const uMin = pHist->uMin;
+    if (uMin <= uMax)
+    {
+        if (uValue > uMax)
+            uValue = uMax;
+        if (uValue < uMin)
+            uValue = uMin;
+    }
+    return uValue;
+}
+
 #ifdef VBOX_WITH_DEBUGGER
 
 /**
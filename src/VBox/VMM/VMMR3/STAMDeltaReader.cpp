@@ -0,0 +1,361 @@
+/* $Id$ */
+/** @file
+ * STAM - The Statistics Manager, Binary Delta Reader.
+ */
+
+/*
+ * Copyright (C) 2006-2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*
+ * The reader is the consumer side of the packets STAMR3DeltaCollect
+ * produces (see grp_stam_delta).  It does not touch the VM and can be used
+ * by anything reading the packets of the streaming service.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_STAM
+#include <VBox/vmm/stam.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/mem.h>
+#include <iprt/string.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The highest sample index + 1 we accept, guards the index table size
+ * against garbage. */
+#define STAMDELTAREADER_MAX_SAMPLES     _4M
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Binary delta reader (STAMR3DeltaReaderCreate).
+ */
+typedef struct STAMDELTAREADER
+{
+    /** The number of entries in papSamples. */
+    uint32_t            cSamples;
+    /** The samples indexed by sample index, NULL entries for unknown ones.
+     * Name and description are allocated together with the entry. */
+    STAMDELTASAMPLE   **papSamples;
+} STAMDELTAREADER;
+
+
+/**
+ * Creates a binary delta reader.
+ *
+ * @returns VBox status code.
+ * @param   ppReader    Where to return the reader.
+ */
+VMMR3DECL(int) STAMR3DeltaReaderCreate(PSTAMDELTAREADER *ppReader)
+{
+    AssertPtrReturn(ppReader, VERR_INVALID_POINTER);
+    PSTAMDELTAREADER pReader = (PSTAMDELTAREADER)RTMemAllocZ(sizeof(*pReader));
+    if (!pReader)
+        return VERR_NO_MEMORY;
+    *ppReader = pReader;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys a binary delta reader.
+ *
+ * @param   pReader     The reader. NULL is ignored.
+ */
+VMMR3DECL(void) STAMR3DeltaReaderDestroy(PSTAMDELTAREADER pReader)
+{
+    if (!pReader)
+        return;
+    for (uint32_t i = 0; i < pReader->cSamples; i++)
+        RTMemFree(pReader->papSamples[i]);
+    RTMemFree(pReader->papSamples);
+    RTMemFree(pReader);
+}
+
+
+/**
+ * Makes sure the reader has room for the given sample index.
+ *
+ * @returns VBox status code.
+ * @param   pReader     The reader.
+ * @param   iSample     The sample index.
+ */
+static int stamR3DeltaReaderEnsureSlot(PSTAMDELTAREADER pReader, uint32_t iSample)
+{
+    if (iSample < pReader->cSamples)
+        return VINF_SUCCESS;
+
+    uint32_t const cNew = RT_ALIGN_32(RT_MAX(iSample + 1, pReader->cSamples * 2), 64);
+    STAMDELTASAMPLE **papNew = (STAMDELTASAMPLE **)RTMemRealloc(pReader->papSamples, cNew * sizeof(papNew[0]));
+    if (!papNew)
+        return VERR_NO_MEMORY;
+    RT_BZERO(&papNew[pReader->cSamples], (cNew - pReader->cSamples) * sizeof(papNew[0]));
+    pReader->papSamples = papNew;
+    pReader->cSamples   = cNew;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Validates the framing of a packet.
+ *
+ * @returns VBox status code.
+ * @param   pHdr        The packet.
+ * @param   cbPacket    The packet size.
+ * @param   piMaxDef    Where to return the highest sample index defined by
+ *                      the packet, UINT32_MAX if none.
+ */
+static int stamR3DeltaReaderValidate(PCSTAMDELTAHDR pHdr, size_t cbPacket, uint32_t *piMaxDef)
+{
+    *piMaxDef = UINT32_MAX;
+    if (cbPacket < sizeof(*pHdr))
+        return VERR_BUFFER_UNDERFLOW;
+    if (pHdr->u32Magic != STAMDELTA_MAGIC)
+        return VERR_INVALID_MAGIC;
+    if (pHdr->u16Version != STAMDELTA_VERSION)
+        return VERR_VERSION_MISMATCH;
+    if (pHdr->cbPacket != cbPacket)
+        return VERR_BUFFER_UNDERFLOW;
+
+    uint8_t const *pb    = (uint8_t const *)(pHdr + 1);
+    uint8_t const *pbEnd = (uint8_t const *)pHdr + cbPacket;
+    for (uint32_t iRec = 0; iRec < pHdr->cRecords; iRec++)
+    {
+        if ((size_t)(pbEnd - pb) < sizeof(STAMDELTAREC))
+            return VERR_BUFFER_UNDERFLOW;
+        PCSTAMDELTAREC pRec = (PCSTAMDELTAREC)pb;
+        if (   (pRec->cbData & 7)
+            || (size_t)(pbEnd - pb) - sizeof(*pRec) < pRec->cbData)
+            return VERR_BUFFER_UNDERFLOW;
+        if (pRec->iSample >= STAMDELTAREADER_MAX_SAMPLES)
+            return VERR_OUT_OF_RANGE;
+
+        if (pRec->u8Kind == STAMDELTAKIND_DEFINE)
+        {
+            PCSTAMDELTADEF pDef = (PCSTAMDELTADEF)(pRec + 1);
+            if (   pRec->cbData < sizeof(*pDef)
+                || pRec->cbData - sizeof(*pDef) < (size_t)pDef->cchName + 1 + pDef->cchDesc + 1)
+                return VERR_BUFFER_UNDERFLOW;
+            char const *pszName = (char const *)(pDef + 1);
+            if (   !pDef->cchName
+                || pszName[pDef->cchName] != '\0'
+                || pszName[pDef->cchName + 1 + pDef->cchDesc] != '\0'
+                || pDef->u8Type >= STAMTYPE_END)
+                return VERR_INVALID_PARAMETER;
+            if (*piMaxDef == UINT32_MAX || pRec->iSample > *piMaxDef)
+                *piMaxDef = pRec->iSample;
+        }
+        else if (pRec->u8Kind == STAMDELTAKIND_VALUES)
+        {
+            if (   pRec->cValues > STAMDELTA_MAX_VALUES
+                || pRec->cbData < pRec->cValues * sizeof(uint64_t))
+                return VERR_INVALID_PARAMETER;
+        }
+        else if (pRec->u8Kind != STAMDELTAKIND_REMOVE)
+            return VERR_INVALID_PARAMETER;
+        pb += sizeof(*pRec) + pRec->cbData;
+    }
+    if (pb != pbEnd)
+        return VERR_BUFFER_OVERFLOW;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Checks that the packet only refers to samples which are defined at the
+ * time the record is applied.
+ *
+ * @returns VBox status code.
+ * @param   pReader     The reader, with room for all samples the packet defines.
+ * @param   pHdr        The validated packet.
+ */
+static int stamR3DeltaReaderCheckRefs(PSTAMDELTAREADER pReader, PCSTAMDELTAHDR pHdr)
+{
+    uint32_t *pbmDefined = (uint32_t *)RTMemTmpAllocZ(RT_ALIGN_32(pReader->cSamples, 64) / 8);
+    if (!pbmDefined)
+        return VERR_NO_TMP_MEMORY;
+    for (uint32_t i = 0; i < pReader->cSamples; i++)
+        if (pReader->papSamples[i])
+            ASMBitSet(pbmDefined, i);
+
+    int            rc = VINF_SUCCESS;
+    uint8_t const *pb = (uint8_t const *)(pHdr + 1);
+    for (uint32_t iRec = 0; iRec < pHdr->cRecords; iRec++)
+    {
+        PCSTAMDELTAREC pRec = (PCSTAMDELTAREC)pb;
+        pb += sizeof(*pRec) + pRec->cbData;
+        if (pRec->u8Kind == STAMDELTAKIND_DEFINE)
+            ASMBitSet(pbmDefined, pRec->iSample);
+        else if (   pRec->iSample >= pReader->cSamples
+                 || !ASMBitTest(pbmDefined, pRec->iSample))
+        {
+            rc = VERR_INVALID_STATE;
+            break;
+        }
+        else if (pRec->u8Kind == STAMDELTAKIND_REMOVE)
+            ASMBitClear(pbmDefined, pRec->iSample);
+    }
+
+    RTMemTmpFree(pbmDefined);
+    return rc;
+}
+
+
+/**
+ * Applies a packet to the reader state.
+ *
+ * The packet is validated before anything is changed, so a malformed packet
+ * leaves the samples alone.  Running out of memory half way may leave some
+ * definitions missing though, after which the reader should be recreated.
+ * Packets must be applied in the order the cursor produced them.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_INVALID_MAGIC if it isn't a delta packet.
+ * @retval  VERR_VERSION_MISMATCH if the packet format is unknown.
+ * @retval  VERR_BUFFER_UNDERFLOW or VERR_BUFFER_OVERFLOW if the sizes
+ *          don't add up.
+ * @retval  VERR_INVALID_STATE if the packet refers to a sample which wasn't
+ *          defined, i.e. a packet was skipped.
+ * @param   pReader     The reader.
+ * @param   pvPacket    The packet.
+ * @param   cbPacket    The packet size.
+ */
+VMMR3DECL(int) STAMR3DeltaReaderApply(PSTAMDELTAREADER pReader, void const *pvPacket, size_t cbPacket)
+{
+    AssertPtrReturn(pReader, VERR_INVALID_POINTER);
+    AssertPtrReturn(pvPacket, VERR_INVALID_POINTER);
+    PCSTAMDELTAHDR pHdr = (PCSTAMDELTAHDR)pvPacket;
+    uint32_t       iMaxDef;
+    int rc = stamR3DeltaReaderValidate(pHdr, cbPacket, &iMaxDef);
+    if (RT_SUCCESS(rc) && iMaxDef != UINT32_MAX)
+        rc = stamR3DeltaReaderEnsureSlot(pReader, iMaxDef);
+    if (RT_SUCCESS(rc))
+        rc = stamR3DeltaReaderCheckRefs(pReader, pHdr);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint8_t const *pb = (uint8_t const *)(pHdr + 1);
+    for (uint32_t iRec = 0; iRec < pHdr->cRecords; iRec++)
+    {
+        PCSTAMDELTAREC pRec = (PCSTAMDELTAREC)pb;
+        pb += sizeof(*pRec) + pRec->cbData;
+        switch (pRec->u8Kind)
+        {
+            case STAMDELTAKIND_DEFINE:
+            {
+                PCSTAMDELTADEF pDef = (PCSTAMDELTADEF)(pRec + 1);
+                size_t const cbStrings = (size_t)pDef->cchName + 1 + pDef->cchDesc + 1;
+                STAMDELTASAMPLE *pSample = (STAMDELTASAMPLE *)RTMemAllocZ(sizeof(*pSample) + cbStrings);
+                if (!pSample)
+                    return VERR_NO_MEMORY;
+                pSample->iSample = pRec->iSample;
+                pSample->enmType = (STAMTYPE)pDef->u8Type;
+                pSample->enmUnit = (STAMUNIT)pDef->u8Unit;
+                pSample->pszName = (const char *)memcpy(pSample + 1, pDef + 1, cbStrings);
+                pSample->pszDesc = pSample->pszName + pDef->cchName + 1;
+
+                RTMemFree(pReader->papSamples[pRec->iSample]);
+                pReader->papSamples[pRec->iSample] = pSample;
+                break;
+            }
+
+            case STAMDELTAKIND_VALUES:
+            {
+                STAMDELTASAMPLE *pSample = pReader->papSamples[pRec->iSample];
+                pSample->cValues   = pRec->cValues;
+                pSample->u64NanoTS = pHdr->u64NanoTS;
+                memcpy(pSample->au64Values, pRec + 1, pRec->cValues * sizeof(uint64_t));
+                break;
+            }
+
+            case STAMDELTAKIND_REMOVE:
+                RTMemFree(pReader->papSamples[pRec->iSample]);
+                pReader->papSamples[pRec->iSample] = NULL;
+                break;
+        }
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets a sample by index.
+ *
+ * @returns The sample, NULL if not currently defined.  Valid till the next
+ *          STAMR3DeltaReaderApply call.
+ * @param   pReader     The reader.
+ * @param   iSample     The sample index.
+ */
+VMMR3DECL(PCSTAMDELTASAMPLE) STAMR3DeltaReaderGetSample(PSTAMDELTAREADER pReader, uint32_t iSample)
+{
+    AssertPtrReturn(pReader, NULL);
+    if (iSample < pReader->cSamples)
+        return pReader->papSamples[iSample];
+    return NULL;
+}
+
+
+/**
+ * Looks up a sample by name.
+ *
+ * This is a linear search, use STAMR3DeltaReaderGetSample with the index if
+ * it is done often.
+ *
+ * @returns The sample, NULL if not found.  Valid till the next
+ *          STAMR3DeltaReaderApply call.
+ * @param   pReader     The reader.
+ * @param   pszName     The sample name.
+ */
+VMMR3DECL(PCSTAMDELTASAMPLE) STAMR3DeltaReaderFindSample(PSTAMDELTAREADER pReader, const char *pszName)
+{
+    AssertPtrReturn(pReader, NULL);
+    AssertPtrReturn(pszName, NULL);
+    for (uint32_t i = 0; i < pReader->cSamples; i++)
+        if (   pReader->papSamples[i]
+            && !strcmp(pReader->papSamples[i]->pszName, pszName))
+            return pReader->papSamples[i];
+    return NULL;
+}
+
+
+/**
+ * Enumerates the samples currently defined, in sample index order.
+ *
+ * @returns VINF_SUCCESS or whatever the callback returned to stop.
+ * @param   pReader     The reader.
+ * @param   pfnEnum     The callback.
+ * @param   pvUser      The user argument for the callback.
+ */
+VMMR3DECL(int) STAMR3DeltaReaderEnum(PSTAMDELTAREADER pReader, PFNSTAMDELTAREADERENUM pfnEnum, void *pvUser)
+{
+    AssertPtrReturn(pReader, VERR_INVALID_POINTER);
+    AssertPtrReturn(pfnEnum, VERR_INVALID_POINTER);
+    for (uint32_t i = 0; i < pReader->cSamples; i++)
+        if (pReader->papSamples[i])
+        {
+            int rc = pfnEnum(pReader->papSamples[i], pvUser);
+            if (rc != VINF_SUCCESS)
+                return rc;
+        }
+    return VINF_SUCCESS;
+}
@@ -0,0 +1,837 @@
+/* $Id$ */
+/** @file
+ * STAM - The Statistics Manager, Delta Streaming Service.
+ */
+
+/*
+ * Copyright (C) 2006-2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_stam_stream   STAM - Delta Streaming Service
+ *
+ * The streaming service lets external monitoring tools follow the statistics
+ * of a running VM without the cost of full XML snapshots.  It is a TCP server,
+ * by default only listening on the loopback interface.  Each client is served
+ * by a thread of its own, so a binary consumer doesn't keep scrapers out.
+ * What a client gets depends on what it sends first:
+ *
+ *      - A client sending a HTTP GET request gets a single response in the
+ *        Prometheus text exposition format containing all matching samples,
+ *        after which the connection is closed.  This allows pointing a scraper
+ *        directly at the VM.  All scrapers share one delta cursor feeding a
+ *        delta reader, so a scrape only costs a full enumeration when samples
+ *        were registered or deregistered since the previous one.
+ *
+ *      - A client not sending anything gets a stream of binary delta packets
+ *        (see grp_stam_delta), one every interval.  The first packet defines
+ *        all samples, the following ones only carry what changed.  The
+ *        STAMR3DeltaReader API turns the packets back into samples.
+ *
+ * The service is configured by the keys in the /STAM/Stream CFGM node.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_STAM
+#include <VBox/vmm/stam.h>
+#include "STAMInternal.h"
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/socket.h>
+#include <iprt/string.h>
+#include <iprt/tcp.h>
+#include <iprt/thread.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** How long to wait for a client to reveal itself as a HTTP client. */
+#define STAMSTREAM_SNIFF_MS         250
+/** The max size of a HTTP request we're willing to read. */
+#define STAMSTREAM_MAX_REQUEST      _8K
+/** How long to wait for the service threads when terminating. */
+#define STAMSTREAM_TERM_WAIT_MS     (10 * RT_MS_1SEC)
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Prometheus metric families.
+ */
+typedef enum STAMSTREAMFAMILY
+{
+    STAMSTREAMFAMILY_COUNTER = 0,
+    STAMSTREAMFAMILY_PROFILE_PERIODS,
+    STAMSTREAMFAMILY_PROFILE_TICKS,
+    STAMSTREAMFAMILY_PROFILE_TICKS_MAX,
+    STAMSTREAMFAMILY_PROFILE_TICKS_MIN,
+    STAMSTREAMFAMILY_RATIO_A,
+    STAMSTREAMFAMILY_RATIO_B,
+    STAMSTREAMFAMILY_HISTOGRAM_VALUES,
+    STAMSTREAMFAMILY_HISTOGRAM_P50,
+    STAMSTREAMFAMILY_HISTOGRAM_P99,
+    STAMSTREAMFAMILY_HISTOGRAM_MAX,
+    STAMSTREAMFAMILY_VALUE,
+    STAMSTREAMFAMILY_END
+} STAMSTREAMFAMILY;
+
+/**
+ * Prometheus metric family descriptor.
+ */
+typedef struct STAMSTREAMFAMILYDESC
+{
+    /** The metric name. */
+    const char     *pszName;
+    /** The metric type. */
+    const char     *pszType;
+    /** The help text. */
+    const char     *pszHelp;
+    /** The value index within the STAMDELTAKIND_VALUES record. */
+    uint8_t         iValue;
+} STAMSTREAMFAMILYDESC;
+
+/**
+ * A client of the streaming service.
+ */
+typedef struct STAMSTREAMCLIENT
+{
+    /** Entry in STAMSTREAM::ClientList. */
+    RTLISTNODE          ListEntry;
+    /** The service. */
+    struct STAMSTREAM  *pStream;
+    /** The client socket, closed by whoever reaps the client. */
+    RTSOCKET            hSocket;
+    /** The thread serving the client. */
+    RTTHREAD            hThread;
+    /** Set by the thread when it is done and can be reaped. */
+    bool volatile       fDone;
+} STAMSTREAMCLIENT;
+/** Pointer to a streaming service client. */
+typedef STAMSTREAMCLIENT *PSTAMSTREAMCLIENT;
+
+/**
+ * The streaming service instance (STAMUSERPERVM::pStream).
+ */
+typedef struct STAMSTREAM
+{
+    /** The user mode VM handle. */
+    PUVM                pUVM;
+    /** The TCP server. */
+    PRTTCPSERVER        pServer;
+    /** The thread accepting connections. */
+    RTTHREAD            hListenThread;
+    /** Set when the service is being terminated. */
+    bool volatile       fShutdown;
+    /** The sample pattern, NULL for all. */
+    char               *pszPat;
+    /** The interval between binary delta packets in milliseconds. */
+    uint32_t            cMsInterval;
+    /** The max number of clients served at the same time. */
+    uint32_t            cMaxClients;
+    /** The number of clients in ClientList. */
+    uint32_t            cClients;
+    /** The number of connections so far, for naming the threads. */
+    uint32_t            cConnections;
+    /** The clients (STAMSTREAMCLIENT). */
+    RTLISTANCHOR        ClientList;
+    /** Protects ClientList and cClients. */
+    RTSEMFASTMUTEX      hClientMtx;
+    /** Serializes the HTTP clients and protects the members below. */
+    RTSEMFASTMUTEX      hHttpMtx;
+    /** The delta cursor shared by the HTTP clients, NULL till the first. */
+    PSTAMDELTA          pHttpDelta;
+    /** The reader the HTTP cursor packets are applied to. */
+    PSTAMDELTAREADER    pHttpReader;
+} STAMSTREAM;
+/** Pointer to the streaming service instance. */
+typedef STAMSTREAM *PSTAMSTREAM;
+
+/**
+ * Growing text buffer for assembling a HTTP response.
+ */
+typedef struct STAMSTREAMBUF
+{
+    /** The buffer. */
+    char               *pch;
+    /** The number of chars in the buffer. */
+    size_t              cch;
+    /** The size of the buffer. */
+    size_t              cbAlloc;
+    /** VERR_NO_MEMORY if something didn't fit. */
+    int                 rc;
+} STAMSTREAMBUF;
+/** Pointer to a text buffer. */
+typedef STAMSTREAMBUF *PSTAMSTREAMBUF;
+
+/**
+ * Argument package for stamR3StreamRenderOne.
+ */
+typedef struct STAMSTREAMRENDER
+{
+    /** The output buffer. */
+    PSTAMSTREAMBUF      pBuf;
+    /** The family being rendered. */
+    STAMSTREAMFAMILY    enmFamily;
+    /** Whether the HELP and TYPE lines of the family have been written. */
+    bool                fHeader;
+} STAMSTREAMRENDER;
+/** Pointer to a stamR3StreamRenderOne argument package. */
+typedef STAMSTREAMRENDER *PSTAMSTREAMRENDER;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The Prometheus metric families, indexed by STAMSTREAMFAMILY. */
+static const STAMSTREAMFAMILYDESC g_aFamilies[STAMSTREAMFAMILY_END] =
+{
+    { "vbox_stam_counter",                "counter", "STAM counter samples.",                   0 },
+    { "vbox_stam_profile_periods_total",  "counter", "STAM profile sample periods.",            0 },
+    { "vbox_stam_profile_ticks_total",    "counter", "STAM profile sample ticks.",              1 },
+    { "vbox_stam_profile_ticks_max",      "gauge",   "STAM profile sample max ticks/period.",   2 },
+    { "vbox_stam_profile_ticks_min",      "gauge",   "STAM profile sample min ticks/period.",   3 },
+    { "vbox_stam_ratio_a",                "gauge",   "STAM ratio sample numerator.",            0 },
+    { "vbox_stam_ratio_b",                "gauge",   "STAM ratio sample denominator.",          1 },
+    { "vbox_stam_histogram_values_total", "counter", "STAM histogram sample value count.",      0 },
+    { "vbox_stam_histogram_p50",          "gauge",   "STAM histogram sample median.",           1 },
+    { "vbox_stam_histogram_p99",          "gauge",   "STAM histogram sample 99th percentile.",  2 },
+    { "vbox_stam_histogram_max",          "gauge",   "STAM histogram sample max value.",        3 },
+    { "vbox_stam_value",                  "gauge",   "STAM plain value samples.",               0 },
+};
+
+
+/**
+ * Gets the first Prometheus family for a sample type.
+ *
+ * @returns The family, STAMSTREAMFAMILY_END if the type isn't exported.
+ * @param   enmType     The sample type.
+ * @param   pcFamilies  Where to return the number of consecutive families.
+ */
+static STAMSTREAMFAMILY stamR3StreamTypeToFamily(STAMTYPE enmType, unsigned *pcFamilies)
+{
+    *pcFamilies = 1;
+    switch (enmType)
+    {
+        case STAMTYPE_COUNTER:
+            return STAMSTREAMFAMILY_COUNTER;
+        case STAMTYPE_PROFILE:
+        case STAMTYPE_PROFILE_ADV:
+            *pcFamilies = 4;
+            return STAMSTREAMFAMILY_PROFILE_PERIODS;
+        case STAMTYPE_RATIO_U32:
+        case STAMTYPE_RATIO_U32_RESET:
+            *pcFamilies = 2;
+            return STAMSTREAMFAMILY_RATIO_A;
+        case STAMTYPE_HISTOGRAM:
+            *pcFamilies = 4;
+            return STAMSTREAMFAMILY_HISTOGRAM_VALUES;
+        case STAMTYPE_CALLBACK:
+            *pcFamilies = 0;
+            return STAMSTREAMFAMILY_END;
+        default:
+            return STAMSTREAMFAMILY_VALUE;
+    }
+}
+
+
+/**
+ * @callback_method_impl{FNRTSTROUTPUT, Appends to a STAMSTREAMBUF.}
+ */
+static DECLCALLBACK(size_t) stamR3StreamBufOutput(void *pvArg, const char *pachChars, size_t cbChars)
+{
+    PSTAMSTREAMBUF pBuf = (PSTAMSTREAMBUF)pvArg;
+    if (!cbChars || RT_FAILURE(pBuf->rc))
+        return cbChars;
+    if (pBuf->cbAlloc - pBuf->cch < cbChars)
+    {
+        size_t cbNew = RT_ALIGN_Z(RT_MAX(pBuf->cbAlloc * 2, pBuf->cch + cbChars), _4K);
+        char  *pchNew = (char *)RTMemRealloc(pBuf->pch, cbNew);
+        if (!pchNew)
+        {
+            pBuf->rc = VERR_NO_MEMORY;
+            return cbChars;
+        }
+        pBuf->pch     = pchNew;
+        pBuf->cbAlloc = cbNew;
+    }
+    memcpy(&pBuf->pch[pBuf->cch], pachChars, cbChars);
+    pBuf->cch += cbChars;
+    return cbChars;
+}
+
+
+/**
+ * Formatted append to a text buffer.
+ *
+ * @param   pBuf        The buffer.
+ * @param   pszFormat   The format string.
+ * @param   ...         Format arguments.
+ */
+static void stamR3StreamBufPrintf(PSTAMSTREAMBUF pBuf, const char *pszFormat, ...)
+{
+    va_list va;
+    va_start(va, pszFormat);
+    RTStrFormatV(stamR3StreamBufOutput, pBuf, NULL, NULL, pszFormat, va);
+    va_end(va);
+}
+
+
+/**
+ * Appends a Prometheus label value, escaping backslashes, quotes and
+ * newlines.
+ *
+ * @param   pBuf        The buffer.
+ * @param   psz         The label value.
+ */
+static void stamR3StreamBufLabelValue(PSTAMSTREAMBUF pBuf, const char *psz)
+{
+    for (;;)
+    {
+        size_t cch = strcspn(psz, "\\\"\n");
+        stamR3StreamBufOutput(pBuf, psz, cch);
+        if (!psz[cch])
+            return;
+        stamR3StreamBufOutput(pBuf, psz[cch] == '\n' ? "\\n" : psz[cch] == '"' ? "\\\"" : "\\\\", 2);
+        psz += cch + 1;
+    }
+}
+
+
+/**
+ * @callback_method_impl{FNSTAMDELTAREADERENUM,
+ *      Renders the sample if it belongs to the current family.}
+ */
+static DECLCALLBACK(int) stamR3StreamRenderOne(PCSTAMDELTASAMPLE pSample, void *pvUser)
+{
+    PSTAMSTREAMRENDER           pArgs   = (PSTAMSTREAMRENDER)pvUser;
+    STAMSTREAMFAMILYDESC const *pFamily = &g_aFamilies[pArgs->enmFamily];
+    unsigned cFamilies;
+    STAMSTREAMFAMILY enmFirst = stamR3StreamTypeToFamily(pSample->enmType, &cFamilies);
+    if (   (unsigned)pArgs->enmFamily < (unsigned)enmFirst
+        || (unsigned)pArgs->enmFamily >= (unsigned)enmFirst + cFamilies
+        || pFamily->iValue >= pSample->cValues)
+        return VINF_SUCCESS;
+
+    if (!pArgs->fHeader)
+    {
+        stamR3StreamBufPrintf(pArgs->pBuf, "# HELP %s %s\n# TYPE %s %s\n",
+                              pFamily->pszName, pFamily->pszHelp, pFamily->pszName, pFamily->pszType);
+        pArgs->fHeader = true;
+    }
+    stamR3StreamBufPrintf(pArgs->pBuf, "%s{name=\"", pFamily->pszName);
+    stamR3StreamBufLabelValue(pArgs->pBuf, pSample->pszName);
+    stamR3StreamBufPrintf(pArgs->pBuf, "\",unit=\"");
+    stamR3StreamBufLabelValue(pArgs->pBuf, STAMR3GetUnit(pSample->enmUnit));
+    stamR3StreamBufPrintf(pArgs->pBuf, "\"} %RU64\n", pSample->au64Values[pFamily->iValue]);
+    return pArgs->pBuf->rc;
+}
+
+
+/**
+ * Renders the samples known to a delta reader in the Prometheus text
+ * exposition format.
+ *
+ * @returns VBox status code.
+ * @param   pReader     The reader.
+ * @param   pBuf        The buffer to append to.
+ */
+static int stamR3StreamRenderPrometheus(PSTAMDELTAREADER pReader, PSTAMSTREAMBUF pBuf)
+{
+    /* The format wants the samples of a family together. */
+    for (unsigned iFamily = 0; iFamily < STAMSTREAMFAMILY_END && RT_SUCCESS(pBuf->rc); iFamily++)
+    {
+        STAMSTREAMRENDER Args;
+        Args.pBuf      = pBuf;
+        Args.enmFamily = (STAMSTREAMFAMILY)iFamily;
+        Args.fHeader   = false;
+        STAMR3DeltaReaderEnum(pReader, stamR3StreamRenderOne, &Args);
+    }
+    return pBuf->rc;
+}
+
+
+/**
+ * Brings the shared HTTP reader up to date and renders it.
+ *
+ * @returns VBox status code.
+ * @param   pStream     The service.
+ * @param   pBuf        The buffer to render the samples to.
+ */
+static int stamR3StreamHttpRender(PSTAMSTREAM pStream, PSTAMSTREAMBUF pBuf)
+{
+    RTSemFastMutexRequest(pStream->hHttpMtx);
+
+    int rc = VINF_SUCCESS;
+    if (!pStream->pHttpDelta)
+    {
+        rc = STAMR3DeltaCreate(pStream->pUVM, pStream->pszPat, &pStream->pHttpDelta);
+        if (RT_SUCCESS(rc))
+        {
+            rc = STAMR3DeltaReaderCreate(&pStream->pHttpReader);
+            if (RT_FAILURE(rc))
+            {
+                STAMR3DeltaDestroy(pStream->pHttpDelta);
+                pStream->pHttpDelta = NULL;
+            }
+        }
+    }
+    if (RT_SUCCESS(rc))
+    {
+        void const *pvPacket;
+        size_t      cbPacket;
+        rc = STAMR3DeltaCollect(pStream->pHttpDelta, &pvPacket, &cbPacket);
+        if (RT_SUCCESS(rc))
+            rc = STAMR3DeltaReaderApply(pStream->pHttpReader, pvPacket, cbPacket);
+        if (RT_SUCCESS(rc))
+            rc = stamR3StreamRenderPrometheus(pStream->pHttpReader, pBuf);
+        else
+        {
+            /* Cursor and reader are out of sync now, start over next time. */
+            STAMR3DeltaReaderDestroy(pStream->pHttpReader);
+            pStream->pHttpReader = NULL;
+            STAMR3DeltaDestroy(pStream->pHttpDelta);
+            pStream->pHttpDelta = NULL;
+        }
+    }
+
+    RTSemFastMutexRelease(pStream->hHttpMtx);
+    return rc;
+}
+
+
+/**
+ * Serves a HTTP client with a Prometheus text exposition of the samples.
+ *
+ * @returns IPRT status code.
+ * @param   pStream     The service.
+ * @param   hSocket     The client socket.
+ * @param   pszRequest  The (partial) HTTP request read so far.
+ * @param   cchRequest  The length of what was read so far.
+ */
+static int stamR3StreamServeHttp(PSTAMSTREAM pStream, RTSOCKET hSocket, char *pszRequest, size_t cchRequest)
+{
+    /*
+     * Consume the request headers so closing the socket doesn't reset the
+     * connection on the client.  We don't care what the path is.
+     */
+    while (   !strstr(pszRequest, "\r\n\r\n")
+           && cchRequest < STAMSTREAM_MAX_REQUEST - 1)
+    {
+        int rc = RTTcpSelectOne(hSocket, 5 * RT_MS_1SEC);
+        if (RT_FAILURE(rc))
+            return rc;
+        size_t cbRead = 0;
+        rc = RTTcpRead(hSocket, &pszRequest[cchRequest], STAMSTREAM_MAX_REQUEST - 1 - cchRequest, &cbRead);
+        if (RT_FAILURE(rc) || !cbRead)
+            return RT_FAILURE(rc) ? rc : VERR_NET_SHUTDOWN;
+        cchRequest += cbRead;
+        pszRequest[cchRequest] = '\0';
+    }
+
+    /*
+     * Render the response into memory so a slow client doesn't hold up the
+     * others, then write it.
+     */
+    STAMSTREAMBUF Buf = { NULL, 0, 0, VINF_SUCCESS };
+    stamR3StreamBufPrintf(&Buf, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n");
+    int rc = stamR3StreamHttpRender(pStream, &Buf);
+    if (RT_SUCCESS(rc))
+        rc = RTTcpWrite(hSocket, Buf.pch, Buf.cch);
+    else
+    {
+        Buf.cch = 0;
+        Buf.rc  = VINF_SUCCESS;
+        stamR3StreamBufPrintf(&Buf, "HTTP/1.0 503 Service Unavailable\r\nContent-Type: text/plain\r\n\r\n%Rrc\n", rc);
+        if (RT_SUCCESS(Buf.rc))
+            RTTcpWrite(hSocket, Buf.pch, Buf.cch);
+    }
+    RTMemFree(Buf.pch);
+    return rc;
+}
+
+
+/**
+ * Serves a binary client with a delta packet every interval.
+ *
+ * @returns IPRT status code.
+ * @param   pStream     The service.
+ * @param   hSocket     The client socket.
+ */
+static int stamR3StreamServeBinary(PSTAMSTREAM pStream, RTSOCKET hSocket)
+{
+    PSTAMDELTA pDelta;
+    int rc = STAMR3DeltaCreate(pStream->pUVM, pStream->pszPat, &pDelta);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    while (!ASMAtomicReadBool(&pStream->fShutdown))
+    {
+        void const *pvPacket;
+        size_t      cbPacket;
+        rc = STAMR3DeltaCollect(pDelta, &pvPacket, &cbPacket);
+        if (RT_SUCCESS(rc))
+            rc = RTTcpWrite(hSocket, pvPacket, cbPacket);
+        if (RT_FAILURE(rc))
+            break;
+
+        /*
+         * Wait for the next interval, watching the socket for the client
+         * going away.  Anything the client sends is ignored.
+         */
+        rc = RTTcpSelectOne(hSocket, pStream->cMsInterval);
+        if (RT_SUCCESS(rc))
+        {
+            char   abIgn[64];
+            size_t cbRead = 0;
+            rc = RTTcpRead(hSocket, abIgn, sizeof(abIgn), &cbRead);
+            if (RT_SUCCESS(rc) && !cbRead)
+                rc = VERR_NET_SHUTDOWN;
+            if (RT_FAILURE(rc))
+                break;
+        }
+        else if (rc != VERR_TIMEOUT)
+            break;
+    }
+
+    STAMR3DeltaDestroy(pDelta);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD, Serves one client.}
+ */
+static DECLCALLBACK(int) stamR3StreamClientThread(RTTHREAD hThread, void *pvUser)
+{
+    PSTAMSTREAMCLIENT pClient = (PSTAMSTREAMCLIENT)pvUser;
+    PSTAMSTREAM       pStream = pClient->pStream;
+    RTSOCKET          hSocket = pClient->hSocket;
+    NOREF(hThread);
+    LogFlow(("stamR3StreamClientThread: connection! hSocket=%p\n", hSocket));
+
+    /*
+     * Scrapers talk first, binary consumers just listen.
+     */
+    int    rc         = VINF_SUCCESS;
+    char  *pszRequest = (char *)RTMemAllocZ(STAMSTREAM_MAX_REQUEST);
+    size_t cbRead     = 0;
+    if (   pszRequest
+        && RT_SUCCESS(RTTcpSelectOne(hSocket, STAMSTREAM_SNIFF_MS)))
+        rc = RTTcpRead(hSocket, pszRequest, STAMSTREAM_MAX_REQUEST - 1, &cbRead);
+    if (RT_SUCCESS(rc) && pszRequest)
+    {
+        if (cbRead >= 4 && !memcmp(pszRequest, "GET ", 4))
+            rc = stamR3StreamServeHttp(pStream, hSocket, pszRequest, cbRead);
+        else if (!cbRead)
+            rc = stamR3StreamServeBinary(pStream, hSocket);
+    }
+    LogFlow(("stamR3StreamClientThread: disconnect rc=%Rrc\n", rc));
+
+    RTMemFree(pszRequest);
+    ASMAtomicWriteBool(&pClient->fDone, true);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Waits for client threads and frees the clients.
+ *
+ * @returns false if a client thread didn't terminate and was leaked, true
+ *          otherwise.
+ * @param   pStream     The service.
+ * @param   fAll        Whether to shut down and reap all clients, otherwise
+ *                      only those which are done are reaped.
+ */
+static bool stamR3StreamReapClients(PSTAMSTREAM pStream, bool fAll)
+{
+    bool fAllReaped = true;
+    RTSemFastMutexRequest(pStream->hClientMtx);
+
+    PSTAMSTREAMCLIENT pClient, pNext;
+    if (fAll)
+        RTListForEach(&pStream->ClientList, pClient, STAMSTREAMCLIENT, ListEntry)
+            RTSocketShutdown(pClient->hSocket, true /*fRead*/, true /*fWrite*/);
+
+    RTListForEachSafe(&pStream->ClientList, pClient, pNext, STAMSTREAMCLIENT, ListEntry)
+    {
+        if (!fAll && !ASMAtomicReadBool(&pClient->fDone))
+            continue;
+        int rc = RTThreadWait(pClient->hThread, fAll ? STAMSTREAM_TERM_WAIT_MS : RT_INDEFINITE_WAIT, NULL);
+        if (RT_FAILURE(rc))
+        {
+            /* Leak it rather than pulling the socket from under the thread. */
+            LogRel(("STAM: Streaming client thread didn't terminate: %Rrc\n", rc));
+            RTListNodeRemove(&pClient->ListEntry);
+            pStream->cClients--;
+            fAllReaped = false;
+            continue;
+        }
+        RTTcpServerDisconnectClient2(pClient->hSocket);
+        RTListNodeRemove(&pClient->ListEntry);
+        pStream->cClients--;
+        RTMemFree(pClient);
+    }
+
+    RTSemFastMutexRelease(pStream->hClientMtx);
+    return fAllReaped;
+}
+
+
+/**
+ * Starts a thread serving a new client.
+ *
+ * @param   pStream     The service.
+ * @param   hSocket     The client socket, consumed.
+ */
+static void stamR3StreamStartClient(PSTAMSTREAM pStream, RTSOCKET hSocket)
+{
+    RTSemFastMutexRequest(pStream->hClientMtx);
+
+    int rc = VERR_TOO_MANY_OPEN_FILES;
+    if (pStream->cClients < pStream->cMaxClients)
+    {
+        PSTAMSTREAMCLIENT pClient = (PSTAMSTREAMCLIENT)RTMemAllocZ(sizeof(*pClient));
+        if (pClient)
+        {
+            pClient->pStream = pStream;
+            pClient->hSocket = hSocket;
+            pClient->fDone   = false;
+            rc = RTThreadCreateF(&pClient->hThread, stamR3StreamClientThread, pClient, 0 /*cbStack*/,
+                                 RTTHREADTYPE_DEBUGGER, RTTHREADFLAGS_WAITABLE, "STAMStrm%u", pStream->cConnections++);
+            if (RT_SUCCESS(rc))
+            {
+                RTListAppend(&pStream->ClientList, &pClient->ListEntry);
+                pStream->cClients++;
+            }
+            else
+                RTMemFree(pClient);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    RTSemFastMutexRelease(pStream->hClientMtx);
+
+    if (RT_FAILURE(rc))
+    {
+        LogFlow(("stamR3StreamStartClient: rejecting client: %Rrc\n", rc));
+        RTTcpServerDisconnectClient2(hSocket);
+    }
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD, Accepts connections for the service.}
+ */
+static DECLCALLBACK(int) stamR3StreamListenThread(RTTHREAD hThread, void *pvUser)
+{
+    PSTAMSTREAM pStream = (PSTAMSTREAM)pvUser;
+    NOREF(hThread);
+
+    while (!ASMAtomicReadBool(&pStream->fShutdown))
+    {
+        RTSOCKET hSocket;
+        int rc = RTTcpServerListen2(pStream->pServer, &hSocket);
+        if (RT_FAILURE(rc))
+        {
+            if (   rc == VERR_TCP_SERVER_STOP
+                || rc == VERR_TCP_SERVER_SHUTDOWN
+                || rc == VERR_TCP_SERVER_DESTROYED
+                || ASMAtomicReadBool(&pStream->fShutdown))
+                break;
+            RTThreadSleep(100); /* don't spin on persistent accept failures */
+            continue;
+        }
+
+        stamR3StreamReapClients(pStream, false /*fAll*/);
+        stamR3StreamStartClient(pStream, hSocket);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Frees the service instance, the threads must be gone.
+ *
+ * @param   pStream     The service.
+ */
+static void stamR3StreamDestroy(PSTAMSTREAM pStream)
+{
+    if (pStream->pServer)
+    {
+        int rc = RTTcpServerDestroy(pStream->pServer);
+        AssertRC(rc);
+    }
+    STAMR3DeltaReaderDestroy(pStream->pHttpReader);
+    STAMR3DeltaDestroy(pStream->pHttpDelta);
+    RTSemFastMutexDestroy(pStream->hHttpMtx);
+    RTSemFastMutexDestroy(pStream->hClientMtx);
+    RTStrFree(pStream->pszPat);
+    RTMemFree(pStream);
+}
+
+
+/**
+ * Starts the statistics streaming service if configured.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ */
+VMMR3_INT_DECL(int) STAMR3StreamInit(PUVM pUVM)
+{
+    /*
+     * Check what the configuration says.
+     */
+    PCFGMNODE pCfg = CFGMR3GetChild(CFGMR3GetRootU(pUVM), "STAM/Stream");
+
+    /** @cfgm{/STAM/Stream/Enabled, bool, false}
+     * Whether to start the statistics streaming service. */
+    bool fEnabled;
+    int rc = CFGMR3QueryBoolDef(pCfg, "Enabled", &fEnabled, false);
+    if (RT_FAILURE(rc))
+        return VM_SET_ERROR_U(pUVM, rc, "Configuration error: Failed querying \"STAM/Stream/Enabled\"");
+    if (!fEnabled)
+        return VINF_SUCCESS;
+
+    /** @cfgm{/STAM/Stream/Port, uint16_t, 5050}
+     * The TCP port the streaming service listens on. */
+    uint16_t uPort;
+    rc = CFGMR3QueryU16Def(pCfg, "Port", &uPort, 5050);
+    if (RT_FAILURE(rc))
+        return VM_SET_ERROR_U(pUVM, rc, "Configuration error: Failed querying \"STAM/Stream/Port\"");
+
+    /** @cfgm{/STAM/Stream/Address, string, 127.0.0.1}
+     * The address the streaming service listens on.  Only loopback by default
+     * as the statistics reveal a fair bit about the guest. */
+    char szAddress[256];
+    rc = CFGMR3QueryStringDef(pCfg, "Address", szAddress, sizeof(szAddress), "127.0.0.1");
+    if (RT_FAILURE(rc))
+        return VM_SET_ERROR_U(pUVM, rc, "Configuration error: Failed querying \"STAM/Stream/Address\"");
+
+    /** @cfgm{/STAM/Stream/IntervalMs, uint32_t, 1000, 10, 3600000}
+     * The interval between binary delta packets in milliseconds. */
+    uint32_t cMsInterval;
+    rc = CFGMR3QueryU32Def(pCfg, "IntervalMs", &cMsInterval, 1000);
+    if (RT_FAILURE(rc))
+        return VM_SET_ERROR_U(pUVM, rc, "Configuration error: Failed querying \"STAM/Stream/IntervalMs\"");
+    if (cMsInterval < 10 || cMsInterval > RT_MS_1HOUR)
+        return VM_SET_ERROR_U(pUVM, VERR_OUT_OF_RANGE,
+                              "Configuration error: \"STAM/Stream/IntervalMs\" must be between 10 and 3600000");
+
+    /** @cfgm{/STAM/Stream/Pattern, string, *}
+     * The STAM pattern selecting the samples to serve. */
+    char szPat[1024];
+    rc = CFGMR3QueryStringDef(pCfg, "Pattern", szPat, sizeof(szPat), "");
+    if (RT_FAILURE(rc))
+        return VM_SET_ERROR_U(pUVM, rc, "Configuration error: Failed querying \"STAM/Stream/Pattern\"");
+
+    /** @cfgm{/STAM/Stream/MaxClients, uint32_t, 8, 1, 64}
+     * The max number of clients served at the same time, each one costs a
+     * thread.  Further connections are closed right away. */
+    uint32_t cMaxClients;
+    rc = CFGMR3QueryU32Def(pCfg, "MaxClients", &cMaxClients, 8);
+    if (RT_FAILURE(rc))
+        return VM_SET_ERROR_U(pUVM, rc, "Configuration error: Failed querying \"STAM/Stream/MaxClients\"");
+    if (cMaxClients < 1 || cMaxClients > 64)
+        return VM_SET_ERROR_U(pUVM, VERR_OUT_OF_RANGE,
+                              "Configuration error: \"STAM/Stream/MaxClients\" must be between 1 and 64");
+
+    /*
+     * Create the instance.
+     */
+    PSTAMSTREAM pStream = (PSTAMSTREAM)RTMemAllocZ(sizeof(*pStream));
+    if (!pStream)
+        return VERR_NO_MEMORY;
+    pStream->pUVM          = pUVM;
+    pStream->cMsInterval   = cMsInterval;
+    pStream->cMaxClients   = cMaxClients;
+    pStream->hListenThread = NIL_RTTHREAD;
+    pStream->hClientMtx    = NIL_RTSEMFASTMUTEX;
+    pStream->hHttpMtx      = NIL_RTSEMFASTMUTEX;
+    RTListInit(&pStream->ClientList);
+    if (szPat[0])
+    {
+        pStream->pszPat = RTStrDup(szPat);
+        if (!pStream->pszPat)
+            rc = VERR_NO_STR_MEMORY;
+    }
+    if (RT_SUCCESS(rc))
+        rc = RTSemFastMutexCreate(&pStream->hClientMtx);
+    if (RT_SUCCESS(rc))
+        rc = RTSemFastMutexCreate(&pStream->hHttpMtx);
+
+    /*
+     * Create the server and the thread accepting the clients.
+     */
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTTcpServerCreateEx(szAddress, uPort, &pStream->pServer);
+        if (RT_FAILURE(rc))
+            pStream->pServer = NULL;
+    }
+    if (RT_SUCCESS(rc))
+        rc = RTThreadCreate(&pStream->hListenThread, stamR3StreamListenThread, pStream, 0 /*cbStack*/,
+                            RTTHREADTYPE_DEBUGGER, RTTHREADFLAGS_WAITABLE, "STAMStream");
+    if (RT_FAILURE(rc))
+    {
+        stamR3StreamDestroy(pStream);
+        return VM_SET_ERROR_U(pUVM, rc, "Cannot start the statistics streaming service");
+    }
+    pUVM->stam.s.pStream = pStream;
+
+    LogRel(("STAM: Streaming service listening on %s:%u (interval %u ms, max %u clients, pattern '%s')\n",
+            szAddress, uPort, cMsInterval, cMaxClients, pStream->pszPat ? pStream->pszPat : "*"));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Stops the statistics streaming service.
+ *
+ * Must be called before the VM is destroyed as the client threads enumerate
+ * the samples.
+ *
+ * @param   pUVM        The user mode VM handle.
+ */
+VMMR3_INT_DECL(void) STAMR3StreamTerm(PUVM pUVM)
+{
+    PSTAMSTREAM pStream = pUVM->stam.s.pStream;
+    if (!pStream)
+        return;
+    pUVM->stam.s.pStream = NULL;
+
+    /*
+     * Stop accepting, then kick the clients off and wait for them.
+     */
+    ASMAtomicWriteBool(&pStream->fShutdown, true);
+    RTTcpServerShutdown(pStream->pServer);
+    int rc = RTThreadWait(pStream->hListenThread, STAMSTREAM_TERM_WAIT_MS, NULL);
+    AssertLogRelRC(rc);
+    bool fAllReaped = stamR3StreamReapClients(pStream, true /*fAll*/);
+
+    /* A thread that is still around owns the instance now. */
+    if (RT_SUCCESS(rc) && fAllReaped)
+        stamR3StreamDestroy(pStream);
+}
+
@@ -1334,6 +1334,7 @@ static int tmr3TimerCreate(PVM pVM, TMCLOCK enmClock, const char *pszDesc, PPTMT
     pTimer->offScheduleNext = 0;
     pTimer->offNext         = 0;
     pTimer->offPrev         = 0;
+    pTimer->offChild        = 0;
     pTimer->pvUser          = NULL;
     pTimer->pCritSect       = NULL;
     pTimer->pszDesc         = pszDesc;
@@ -1643,24 +1644,10 @@ VMMR3DECL(int) TMR3TimerDestroy(PTMTIMER pTimer)
     }
 
     /*
-     * Unlink from the active list.
+     * Unlink from the active heap.
      */
     if (fActive)
-    {
-        const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
-        const PTMTIMER pNext = TMTIMER_GET_NEXT(pTimer);
-        if (pPrev)
-            TMTIMER_SET_NEXT(pPrev, pNext);
-        else
-        {
-            TMTIMER_SET_HEAD(pQueue, pNext);
-            pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
-        }
-        if (pNext)
-            TMTIMER_SET_PREV(pNext, pPrev);
-        pTimer->offNext = 0;
-        pTimer->offPrev = 0;
-    }
+        tmTimerQueueHeapRemove(pQueue, pTimer);
 
     /*
      * Unlink from the schedule list by running it.
@@ -1677,7 +1664,7 @@ VMMR3DECL(int) TMR3TimerDestroy(PTMTIMER pTimer)
     /*
      * Read to move the timer from the created list and onto the free list.
      */
-    Assert(!pTimer->offNext); Assert(!pTimer->offPrev); Assert(!pTimer->offScheduleNext);
+    Assert(!pTimer->offNext); Assert(!pTimer->offPrev); Assert(!pTimer->offChild); Assert(!pTimer->offScheduleNext);
 
     /* unlink from created list */
     if (pTimer->pBigPrev)
@@ -2022,15 +2009,30 @@ static void tmR3TimerQueueRun(PVM pVM, PTMTIMERQUEUE pQueue)
      *      However, we only allow EMT to handle EXPIRED_PENDING
      *      timers, thus enabling the timer handler function to
      *      arm the timer again.
+     *
+     * N.B. The timers are taken off the root of the heap one by one.  If the
+     *      root is busy being changed by another thread, we process the
+     *      schedule once to get it out of the way.  Should that not help, or
+     *      should a timer rearm itself into the past, we leave the rest for
+     *      the next run.  Timers rearming each other into the past are dealt
+     *      with by the TM_MAX_CALLBACKS_PER_RUN limit.
      */
     PTMTIMER pNext = TMTIMER_GET_HEAD(pQueue);
     if (!pNext)
         return;
     const uint64_t u64Now = tmClock(pVM, pQueue->enmClock);
-    while (pNext && pNext->u64Expire <= u64Now)
+    PTMTIMER pBusy      = NULL;
+    PTMTIMER pPrevFired = NULL;
+    uint32_t cCallbacks = 0;
+    while (pNext && pNext->u64Expire <= u64Now && pNext != pPrevFired)
     {
+        if (RT_UNLIKELY(cCallbacks >= TM_MAX_CALLBACKS_PER_RUN))
+        {
+            Log(("tmR3TimerQueueRun: enmClock=%d: callback limit reached, leaving the rest for the next run\n", pQueue->enmClock));
+            break;
+        }
+
         PTMTIMER        pTimer    = pNext;
-        pNext = TMTIMER_GET_NEXT(pTimer);
         PPDMCRITSECT    pCritSect = pTimer->pCritSect;
         if (pCritSect)
             PDMCritSectEnter(pCritSect, VERR_IGNORED);
@@ -2043,18 +2045,7 @@ static void tmR3TimerQueueRun(PVM pVM, PTMTIMERQUEUE pQueue)
             Assert(!pTimer->offScheduleNext); /* this can trigger falsely */
 
             /* unlink */
-            const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
-            if (pPrev)
-                TMTIMER_SET_NEXT(pPrev, pNext);
-            else
-            {
-                TMTIMER_SET_HEAD(pQueue, pNext);
-                pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
-            }
-            if (pNext)
-                TMTIMER_SET_PREV(pNext, pPrev);
-            pTimer->offNext = 0;
-            pTimer->offPrev = 0;
+            tmTimerQueueHeapRemove(pQueue, pTimer);
 
             /* fire */
             TM_SET_STATE(pTimer, TMTIMERSTATE_EXPIRED_DELIVER);
@@ -2073,9 +2064,20 @@ static void tmR3TimerQueueRun(PVM pVM, PTMTIMERQUEUE pQueue)
             /* change the state if it wasn't changed already in the handler. */
             TM_TRY_SET_STATE(pTimer, TMTIMERSTATE_STOPPED, TMTIMERSTATE_EXPIRED_DELIVER, fRc);
             Log2(("tmR3TimerQueueRun: new state %s\n", tmTimerState(pTimer->enmState)));
+            pPrevFired = pTimer;
+            cCallbacks++;
         }
         if (pCritSect)
             PDMCritSectLeave(pCritSect);
+
+        if (pTimer != pPrevFired)
+        {
+            if (pTimer == pBusy)
+                break;
+            pBusy = pTimer;
+            tmTimerQueueSchedule(pVM, pQueue);
+        }
+        pNext = TMTIMER_GET_HEAD(pQueue);
     } /* run loop */
 }
 
@@ -2211,11 +2213,13 @@ static void tmR3TimerQueueRunVirtualSync(PVM pVM)
 #ifdef VBOX_STRICT
     uint64_t u64Prev = u64Now; NOREF(u64Prev);
 #endif
-    while (pNext && pNext->u64Expire <= u64Max)
+    uint32_t cCallbacks = 0;
+    while (   pNext
+           && pNext->u64Expire <= u64Max
+           && cCallbacks++ < TM_MAX_CALLBACKS_PER_RUN)
     {
         /* Advance */
         PTMTIMER pTimer = pNext;
-        pNext = TMTIMER_GET_NEXT(pTimer);
 
         /* Take the associated lock. */
         PPDMCRITSECT pCritSect = pTimer->pCritSect;
@@ -2264,6 +2268,12 @@ static void tmR3TimerQueueRunVirtualSync(PVM pVM)
         /* Leave the associated lock. */
         if (pCritSect)
             PDMCritSectLeave(pCritSect);
+
+        /* Next is the new root, unless the timer rearmed itself to expire
+           before all the others - leave that for the next run. */
+        pNext = TMTIMER_GET_HEAD(pQueue);
+        if (pNext == pTimer)
+            break;
     } /* run loop */
 
 
@@ -3083,7 +3093,7 @@ static DECLCALLBACK(void) tmR3TimerInfoActive(PVM pVM, PCDBGFINFOHLP pHlp, const
         TM_LOCK_TIMERS(pVM);
         for (PTMTIMERR3 pTimer = TMTIMER_GET_HEAD(&pVM->tm.s.paTimerQueuesR3[iQueue]);
              pTimer;
-             pTimer = TMTIMER_GET_NEXT(pTimer))
+             pTimer = tmTimerHeapWalkNext(pTimer))
         {
             pHlp->pfnPrintf(pHlp,
                             "%p %08RX32 %08RX32 %08RX32 %s %18RU64 %18RU64 %6RU32 %-25s %s\n",
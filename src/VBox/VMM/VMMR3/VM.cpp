@@ -476,6 +476,7 @@ static int vmR3CreateUVM(uint32_t cCpus, PCVMM2USERMETHODS pVmm2UserMethods, PUV
     pUVM->pVmm2UserMethods  = pVmm2UserMethods;
 
     AssertCompile(sizeof(pUVM->vm.s) <= sizeof(pUVM->vm.padding));
+    AssertCompile(sizeof(pUVM->aCpus[0].vm.s) <= sizeof(pUVM->aCpus[0].vm.padding));
 
     pUVM->vm.s.cUvmRefs      = 1;
     pUVM->vm.s.ppAtStateNext = &pUVM->vm.s.pAtState;
@@ -581,6 +582,8 @@ static int vmR3CreateUVM(uint32_t cCpus, PCVMM2USERMETHODS pVmm2UserMethods, PUV
  */
 static int vmR3CreateU(PUVM pUVM, uint32_t cCpus, PFNCFGMCONSTRUCTOR pfnCFGMConstructor, void *pvUserCFGM)
 {
+    uint64_t const u64StartTS = RTTimeNanoTS();
+
     /*
      * Load the VMMR0.r0 module so that we can call GVMMR0CreateVM.
      */
@@ -641,6 +644,7 @@ static int vmR3CreateU(PUVM pUVM, uint32_t cCpus, PFNCFGMCONSTRUCTOR pfnCFGMCons
         /*
          * Init the configuration.
          */
+        uint64_t const u64CfgmTS = RTTimeNanoTS();
         rc = CFGMR3Init(pVM, pfnCFGMConstructor, pvUserCFGM);
         if (RT_SUCCESS(rc))
         {
@@ -651,6 +655,7 @@ static int vmR3CreateU(PUVM pUVM, uint32_t cCpus, PFNCFGMCONSTRUCTOR pfnCFGMCons
                  * Init the ring-3 components and ring-3 per cpu data, finishing it off
                  * by a relocation round (intermediate context finalization will do this).
                  */
+                uint64_t const u64Ring3TS = RTTimeNanoTS();
                 rc = vmR3InitRing3(pVM, pUVM);
                 if (RT_SUCCESS(rc))
                 {
@@ -663,9 +668,12 @@ static int vmR3CreateU(PUVM pUVM, uint32_t cCpus, PFNCFGMCONSTRUCTOR pfnCFGMCons
                         /*
                          * Init the Ring-0 components.
                          */
+                        uint64_t const u64Ring0TS = RTTimeNanoTS();
                         rc = vmR3InitRing0(pVM);
                         if (RT_SUCCESS(rc))
                         {
+                            uint64_t const u64RestTS = RTTimeNanoTS();
+
                             /* Relocate again, because some switcher fixups depends on R0 init results. */
                             VMR3Relocate(pVM, 0);
 
@@ -700,6 +708,11 @@ static int vmR3CreateU(PUVM pUVM, uint32_t cCpus, PFNCFGMCONSTRUCTOR pfnCFGMCons
                                          */
                                         vmR3SetState(pVM, VMSTATE_CREATED, VMSTATE_CREATING);
 
+                                        uint64_t const u64DoneTS = RTTimeNanoTS();
+                                        LogRel(("VM: Created in %'llu ns: GVMM %'llu ns, config %'llu ns, ring-3 init %'llu ns, ring-0 init %'llu ns, rest %'llu ns\n",
+                                                u64DoneTS - u64StartTS, u64CfgmTS - u64StartTS, u64Ring3TS - u64CfgmTS,
+                                                u64Ring0TS - u64Ring3TS, u64RestTS - u64Ring0TS, u64DoneTS - u64RestTS));
+
 #ifdef LOG_ENABLED
                                         RTLogSetCustomPrefixCallback(NULL, vmR3LogPrefixCallback, pUVM);
 #endif
@@ -915,6 +928,18 @@ static int vmR3InitRing3(PVM pVM, PUVM pUVM)
         AssertRC(rc);
         rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltTimers,          STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL, "Profiling halted state timer tasks.", "/PROF/CPU%d/VM/Halt/Timers", idCpu);
         AssertRC(rc);
+        rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltPoll,            STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL, "Profiling halted state polling.",   "/PROF/CPU%d/VM/Halt/Poll", idCpu);
+        AssertRC(rc);
+        rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltPollHit,         STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES,  "Wakeups caught while polling.",     "/VM/CPU%d/Halt/PollHit", idCpu);
+        AssertRC(rc);
+        rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltPollMiss,        STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES,  "Wakeups after giving up polling.",  "/VM/CPU%d/Halt/PollMiss", idCpu);
+        AssertRC(rc);
+        rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltPollGrow,        STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES,  "Poll window increases.",            "/VM/CPU%d/Halt/PollGrow", idCpu);
+        AssertRC(rc);
+        rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltPollShrink,      STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES,  "Poll window decreases.",            "/VM/CPU%d/Halt/PollShrink", idCpu);
+        AssertRC(rc);
+        rc = STAMR3RegisterF(pVM, &pUVM->aCpus[idCpu].vm.s.StatHaltWakeupLatency,   STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,     "Halt wakeup latency, notification to resume.", "/VM/CPU%d/Halt/WakeupLatency", idCpu);
+        AssertRC(rc);
     }
 
     STAM_REG(pVM, &pUVM->vm.s.StatReqAllocNew,   STAMTYPE_COUNTER,     "/VM/Req/AllocNew",       STAMUNIT_OCCURENCES,        "Number of VMR3ReqAlloc returning a new packet.");
@@ -1009,6 +1034,8 @@ static int vmR3InitRing3(PVM pVM, PUVM pUVM)
                                                                             PGMR3MemSetup(pVM, false /*fAtReset*/);
                                                                             PDMR3MemSetup(pVM, false /*fAtReset*/);
                                                                         }
+                                                                        if (RT_SUCCESS(rc))
+                                                                            rc = STAMR3StreamInit(pUVM);
                                                                         if (RT_SUCCESS(rc))
                                                                             rc = vmR3InitDoCompleted(pVM, VMINITCOMPLETED_RING3);
                                                                         if (RT_SUCCESS(rc))
@@ -1017,6 +1044,7 @@ static int vmR3InitRing3(PVM pVM, PUVM pUVM)
                                                                             return VINF_SUCCESS;
                                                                         }
 
+                                                                        STAMR3StreamTerm(pUVM);
                                                                         int rc2 = PDMR3Term(pVM);
                                                                         AssertRC(rc2);
                                                                     }
@@ -2482,6 +2510,7 @@ DECLCALLBACK(int) vmR3Destroy(PVM pVM)
         /*
          * Destroy the VM components.
          */
+        STAMR3StreamTerm(pUVM);
         int rc = TMR3Term(pVM);
         AssertRC(rc);
 #ifdef VBOX_WITH_DEBUGGER
@@ -286,6 +286,7 @@ static const char *vmR3GetHaltMethodName(VMHALTMETHOD enmMethod)
         case VMHALTMETHOD_1:            return "method1";
         //case VMHALTMETHOD_2:            return "method2";
         case VMHALTMETHOD_GLOBAL_1:     return "global1";
+        case VMHALTMETHOD_POLL_1:       return "poll1";
         default:                        return "unknown";
     }
 }
@@ -832,6 +833,262 @@ static DECLCALLBACK(void) vmR3HaltGlobal1NotifyCpuFF(PUVMCPU pUVCpu, uint32_t fF
     }
 }
 
+/**
+ * Initialize the poll 1 halt method.
+ *
+ * @return VBox status code.
+ * @param   pUVM            Pointer to the user mode VM structure.
+ */
+static DECLCALLBACK(int) vmR3HaltPoll1Init(PUVM pUVM)
+{
+    /*
+     * The defaults.  The spin/block threshold is the same as for global 1.
+     */
+    uint32_t cNsResolution = SUPSemEventMultiGetResolution(pUVM->vm.s.pSession);
+    if (cNsResolution > 5*RT_NS_100US)
+        pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg = 50000;
+    else if (cNsResolution > RT_NS_100US)
+        pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg = cNsResolution / 4;
+    else
+        pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg = 2000;
+    pUVM->vm.s.Halt.Poll1.cNsStartPollCfg   = 10000;
+    pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg     = 200000;
+    pUVM->vm.s.Halt.Poll1.cGrowFactorCfg    = 2;
+    pUVM->vm.s.Halt.Poll1.cShrinkDivisorCfg = 2;
+
+    /*
+     * Query overrides.
+     */
+    PCFGMNODE pCfg = CFGMR3GetChild(CFGMR3GetRoot(pUVM->pVM), "/VMM/HaltedPoll1");
+    if (pCfg)
+    {
+        uint32_t u32;
+        if (RT_SUCCESS(CFGMR3QueryU32(pCfg, "SpinBlockThreshold", &u32)))
+            pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg = u32;
+        if (RT_SUCCESS(CFGMR3QueryU32(pCfg, "StartPollNs", &u32)))
+            pUVM->vm.s.Halt.Poll1.cNsStartPollCfg = u32;
+        if (RT_SUCCESS(CFGMR3QueryU32(pCfg, "MaxPollNs", &u32)))
+            pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg = RT_MIN(u32, RT_NS_100MS);
+        if (RT_SUCCESS(CFGMR3QueryU32(pCfg, "GrowFactor", &u32)))
+            pUVM->vm.s.Halt.Poll1.cGrowFactorCfg = RT_MAX(u32, 1);
+        if (RT_SUCCESS(CFGMR3QueryU32(pCfg, "ShrinkDivisor", &u32)))
+            pUVM->vm.s.Halt.Poll1.cShrinkDivisorCfg = RT_MAX(u32, 1);
+    }
+    if (pUVM->vm.s.Halt.Poll1.cNsStartPollCfg > pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg)
+        pUVM->vm.s.Halt.Poll1.cNsStartPollCfg = pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg;
+    LogRel(("HaltedPoll1 config: cNsSpinBlockThresholdCfg=%u cNsStartPollCfg=%u cNsMaxPollCfg=%u cGrowFactorCfg=%u cShrinkDivisorCfg=%u\n",
+            pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg, pUVM->vm.s.Halt.Poll1.cNsStartPollCfg,
+            pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg, pUVM->vm.s.Halt.Poll1.cGrowFactorCfg,
+            pUVM->vm.s.Halt.Poll1.cShrinkDivisorCfg));
+
+    /*
+     * Everyone starts out with the initial poll window.
+     */
+    for (VMCPUID idCpu = 0; idCpu < pUVM->cCpus; idCpu++)
+    {
+        ASMAtomicWriteU64(&pUVM->aCpus[idCpu].vm.s.Halt.Poll1.u64NotifyTS, 0);
+        pUVM->aCpus[idCpu].vm.s.Halt.Poll1.cNsPollWindow = pUVM->vm.s.Halt.Poll1.cNsStartPollCfg;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * The poll 1 halt method - Busy poll the force action flags for a learned
+ * interval and then block in GVMM like global 1.
+ *
+ * The poll window grows when a notification arrives shortly after we gave up
+ * polling and shrinks when we end up blocking for a long time anyway, so
+ * guests with frequent short halts (typically waiting for the next network
+ * interrupt) are woken up without the ring-0 round trip and scheduler latency,
+ * while idle guests quickly go back to plain blocking.
+ */
+static DECLCALLBACK(int) vmR3HaltPoll1Halt(PUVMCPU pUVCpu, const uint32_t fMask, uint64_t u64Now)
+{
+    PUVM    pUVM  = pUVCpu->pUVM;
+    PVMCPU  pVCpu = pUVCpu->pVCpu;
+    PVM     pVM   = pUVCpu->pVM;
+    Assert(VMMGetCpu(pVM) == pVCpu);
+    NOREF(u64Now);
+
+    /*
+     * Halt loop.
+     */
+    ASMAtomicWriteU64(&pUVCpu->vm.s.Halt.Poll1.u64NotifyTS, 0);
+    uint64_t const u64HaltStart = RTTimeNanoTS();
+    uint64_t const u64PollEnd   = u64HaltStart + pUVCpu->vm.s.Halt.Poll1.cNsPollWindow;
+    uint64_t       u64WakeupTS  = 0;
+    bool           fBlocked     = false;
+    int            rc           = VINF_SUCCESS;
+    for (;;)
+    {
+        /*
+         * Work the timers and check if we can exit.
+         */
+        uint64_t const u64StartTimers   = RTTimeNanoTS();
+        TMR3TimerQueuesDo(pVM);
+        uint64_t const cNsElapsedTimers = RTTimeNanoTS() - u64StartTimers;
+        STAM_REL_PROFILE_ADD_PERIOD(&pUVCpu->vm.s.StatHaltTimers, cNsElapsedTimers);
+        if (    VM_FF_IS_PENDING(pVM, VM_FF_EXTERNAL_HALTED_MASK)
+            ||  VMCPU_FF_IS_PENDING(pVCpu, fMask))
+            break;
+
+        /*
+         * Estimate time left to the next event.
+         */
+        uint64_t u64Delta;
+        uint64_t u64GipTime = TMTimerPollGIP(pVM, pVCpu, &u64Delta);
+        if (    VM_FF_IS_PENDING(pVM, VM_FF_EXTERNAL_HALTED_MASK)
+            ||  VMCPU_FF_IS_PENDING(pVCpu, fMask))
+            break;
+
+        /*
+         * Poll while we're inside the window or the next timer is too close
+         * for blocking to make sense.  fWait is clear, so nobody will bother
+         * ring-0 on our behalf, they just set the FF and we pick it up here.
+         */
+        uint64_t const u64StartPoll = RTTimeNanoTS();
+        if (    u64StartPoll < u64PollEnd
+            ||  u64Delta < pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg)
+        {
+            uint64_t u64StopPoll = u64StartPoll + u64Delta;
+            if (    u64Delta >= pUVM->vm.s.Halt.Poll1.cNsSpinBlockThresholdCfg
+                &&  u64StopPoll > u64PollEnd)
+                u64StopPoll = u64PollEnd;
+            uint32_t cSpins = 0;
+            while (     !VM_FF_IS_PENDING(pVM, VM_FF_EXTERNAL_HALTED_MASK)
+                   &&   !VMCPU_FF_IS_PENDING(pVCpu, fMask))
+            {
+                ASMNopPause();
+                if (    !(++cSpins & 0x3f)
+                    &&  RTTimeNanoTS() >= u64StopPoll)
+                    break;
+            }
+            uint64_t const cNsElapsedPoll = RTTimeNanoTS() - u64StartPoll;
+            STAM_REL_PROFILE_ADD_PERIOD(&pUVCpu->vm.s.StatHaltPoll, cNsElapsedPoll);
+            continue;
+        }
+
+        /*
+         * Block.  Raise fWait before the final FF check so a notification
+         * racing us either sees it or leaves an FF for us to find.
+         */
+        ASMAtomicWriteBool(&pUVCpu->vm.s.fWait, true);
+        VMMR3YieldStop(pVM);
+        if (    VM_FF_IS_PENDING(pVM, VM_FF_EXTERNAL_HALTED_MASK)
+            ||  VMCPU_FF_IS_PENDING(pVCpu, fMask))
+        {
+            ASMAtomicUoWriteBool(&pUVCpu->vm.s.fWait, false);
+            break;
+        }
+
+        fBlocked = true;
+        uint64_t const u64StartSchedHalt   = RTTimeNanoTS();
+        rc = SUPR3CallVMMR0Ex(pVM->pVMR0, pVCpu->idCpu, VMMR0_DO_GVMM_SCHED_HALT, u64GipTime, NULL);
+        uint64_t const u64EndSchedHalt     = RTTimeNanoTS();
+        uint64_t const cNsElapsedSchedHalt = u64EndSchedHalt - u64StartSchedHalt;
+        STAM_REL_PROFILE_ADD_PERIOD(&pUVCpu->vm.s.StatHaltBlock, cNsElapsedSchedHalt);
+        ASMAtomicUoWriteBool(&pUVCpu->vm.s.fWait, false);
+
+        if (rc == VERR_INTERRUPTED)
+            rc = VINF_SUCCESS;
+        else if (RT_FAILURE(rc))
+        {
+            rc = vmR3FatalWaitError(pUVCpu, "VMMR0_DO_GVMM_SCHED_HALT->%Rrc\n", rc);
+            break;
+        }
+        else
+        {
+            int64_t const cNsOverslept = u64EndSchedHalt - u64GipTime;
+            if (cNsOverslept > 50000)
+                STAM_PROFILE_ADD_PERIOD(&pUVCpu->vm.s.StatHaltBlockOverslept, cNsOverslept);
+            else if (cNsOverslept < -50000)
+            {
+                STAM_PROFILE_ADD_PERIOD(&pUVCpu->vm.s.StatHaltBlockInsomnia,  cNsElapsedSchedHalt);
+                /* Woken up well before the deadline, by ring-3 or ring-0. */
+                u64WakeupTS = u64EndSchedHalt;
+            }
+            else
+                STAM_PROFILE_ADD_PERIOD(&pUVCpu->vm.s.StatHaltBlockOnTime,    cNsElapsedSchedHalt);
+        }
+    }
+
+    /*
+     * Record the notification to wakeup latency and adjust the poll window.
+     * Timer driven wakeups are left alone as we know the deadline up front.
+     *
+     * Wakeups from ring-0 (device interrupts, other EMTs) don't go thru
+     * VMR3NotifyCpuFF and thus carry no notification timestamp.  For those
+     * the return from the early ended block serves as the notification time,
+     * which is good enough for sizing the window but says nothing about the
+     * latency.
+     */
+    uint64_t const u64Resume   = RTTimeNanoTS();
+    uint64_t       u64NotifyTS = ASMAtomicXchgU64(&pUVCpu->vm.s.Halt.Poll1.u64NotifyTS, 0);
+    if (u64NotifyTS && u64NotifyTS <= u64Resume)
+        STAM_REL_HISTOGRAM_ADD(&pUVCpu->vm.s.StatHaltWakeupLatency, u64Resume - u64NotifyTS);
+    else
+        u64NotifyTS = u64WakeupTS;
+    if (u64NotifyTS)
+    {
+        if (!fBlocked)
+            STAM_REL_COUNTER_INC(&pUVCpu->vm.s.StatHaltPollHit);
+        else
+        {
+            STAM_REL_COUNTER_INC(&pUVCpu->vm.s.StatHaltPollMiss);
+            uint32_t       cNsWindow = pUVCpu->vm.s.Halt.Poll1.cNsPollWindow;
+            uint64_t const cNsHalted = u64NotifyTS > u64HaltStart ? u64NotifyTS - u64HaltStart : 0;
+            if (cNsHalted <= pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg)
+            {
+                /* A little more patience and we'd have caught it. */
+                if (cNsWindow < pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg)
+                {
+                    uint64_t cNsNew = (uint64_t)cNsWindow * pUVM->vm.s.Halt.Poll1.cGrowFactorCfg;
+                    cNsNew = RT_MAX(cNsNew, pUVM->vm.s.Halt.Poll1.cNsStartPollCfg);
+                    cNsNew = RT_MIN(cNsNew, pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg);
+                    pUVCpu->vm.s.Halt.Poll1.cNsPollWindow = (uint32_t)cNsNew;
+                    STAM_REL_COUNTER_INC(&pUVCpu->vm.s.StatHaltPollGrow);
+                }
+            }
+            else if (cNsWindow)
+            {
+                /* Out of reach, polling was just burning cycles. */
+                pUVCpu->vm.s.Halt.Poll1.cNsPollWindow = cNsWindow / pUVM->vm.s.Halt.Poll1.cShrinkDivisorCfg;
+                STAM_REL_COUNTER_INC(&pUVCpu->vm.s.StatHaltPollShrink);
+            }
+        }
+    }
+    else if (   fBlocked
+             && u64Resume - u64HaltStart > pUVM->vm.s.Halt.Poll1.cNsMaxPollCfg
+             && pUVCpu->vm.s.Halt.Poll1.cNsPollWindow)
+    {
+        /* Long idle stretch ending on a timer, back off the polling too. */
+        pUVCpu->vm.s.Halt.Poll1.cNsPollWindow /= pUVM->vm.s.Halt.Poll1.cShrinkDivisorCfg;
+        STAM_REL_COUNTER_INC(&pUVCpu->vm.s.StatHaltPollShrink);
+    }
+
+    return rc;
+}
+
+
+/**
+ * The poll 1 halt method - VMR3NotifyFF() worker.
+ *
+ * Timestamps the first notification of a halted EMT for the wakeup latency
+ * statistics and otherwise does what global 1 does.
+ *
+ * @param   pUVCpu          Pointer to the user mode VMCPU structure.
+ * @param   fFlags          Notification flags, VMNOTIFYFF_FLAGS_*.
+ */
+static DECLCALLBACK(void) vmR3HaltPoll1NotifyCpuFF(PUVMCPU pUVCpu, uint32_t fFlags)
+{
+    if (    pUVCpu->pVCpu
+        &&  VMCPU_GET_STATE(pUVCpu->pVCpu) == VMCPUSTATE_STARTED_HALTED)
+        ASMAtomicCmpXchgU64(&pUVCpu->vm.s.Halt.Poll1.u64NotifyTS, RTTimeNanoTS(), 0);
+    vmR3HaltGlobal1NotifyCpuFF(pUVCpu, fFlags);
+}
+
+
 
 /**
  * Bootstrap VMR3Wait() worker.
@@ -990,6 +1247,7 @@ static const struct VMHALTMETHODDESC
     { VMHALTMETHOD_OLD,       NULL,                NULL,   vmR3HaltOldDoHalt,   vmR3DefaultWait,     vmR3DefaultNotifyCpuFF,     NULL },
     { VMHALTMETHOD_1,         vmR3HaltMethod1Init, NULL,   vmR3HaltMethod1Halt, vmR3DefaultWait,     vmR3DefaultNotifyCpuFF,     NULL },
     { VMHALTMETHOD_GLOBAL_1,  vmR3HaltGlobal1Init, NULL,   vmR3HaltGlobal1Halt, vmR3HaltGlobal1Wait, vmR3HaltGlobal1NotifyCpuFF, NULL },
+    { VMHALTMETHOD_POLL_1,    vmR3HaltPoll1Init,   NULL,   vmR3HaltPoll1Halt,   vmR3HaltGlobal1Wait, vmR3HaltPoll1NotifyCpuFF,   NULL },
 };
 
 
@@ -26,6 +26,8 @@
 #include <iprt/avl.h>
 #include <iprt/dbg.h>
 #include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/dbgftrace.h>
+#include <iprt/asm.h>
 
 
 
@@ -190,6 +192,65 @@ typedef DBGFOS const *PCDBGFOS;
 #define DBGF2VM(pDBGF)  ( (PVM)((char*)pDBGF - pDBGF->offVM) )
 
 
+/**
+ * Binary trace ring.
+ *
+ * Each ring has exactly one producer, either an EMT or a ring-3 I/O thread,
+ * so adding a record is just a matter of filling in the slot and then
+ * publishing it by advancing idxWrite.  Readers copy out records without any
+ * locking and use idxWrite to tell which of them may have been overwritten
+ * while they were copying.
+ */
+typedef struct DBGFTRACERING
+{
+    /** The free running write index, only ever updated by the owner. */
+    uint64_t volatile           idxWrite;
+    /** Number of records in the ring (power of two). */
+    uint32_t                    cRecs;
+    /** Index mask (cRecs - 1). */
+    uint32_t                    fMask;
+    /** The ring name (EMT-x or the ring-3 thread name). */
+    char                        szName[48];
+    /** The records. */
+    DBGFTRACEREC                aRecs[1];
+} DBGFTRACERING;
+AssertCompileMemberAlignment(DBGFTRACERING, aRecs, 64);
+AssertCompileSize(DBGFTRACEREC, 32);
+/** Pointer to a binary trace ring. */
+typedef DBGFTRACERING *PDBGFTRACERING;
+
+/** Calculates the size of a trace ring with @a a_cRecs records. */
+#define DBGF_TRACE_RING_SIZE(a_cRecs)   RT_UOFFSETOF(DBGFTRACERING, aRecs[a_cRecs])
+
+
+/**
+ * Adds a record to a binary trace ring.
+ *
+ * @param   pRing       The ring, the caller must be its owner.
+ * @param   enmEvt      The event type.
+ * @param   uTscStart   The TSC when the event started.
+ * @param   cTicks      The event duration in TSC ticks.
+ * @param   uAddr       The port, address or other object identifier.
+ * @param   uValue      The value transferred.
+ * @param   cbAccess    The access size, 0 if not applicable.
+ * @param   rc          The status of the operation.
+ */
+DECLINLINE(void) dbgfTraceRingWrite(PDBGFTRACERING pRing, DBGFTRACEEVT enmEvt, uint64_t uTscStart, uint64_t cTicks,
+                                    uint64_t uAddr, uint64_t uValue, uint8_t cbAccess, int rc)
+{
+    uint64_t const idx  = pRing->idxWrite;
+    PDBGFTRACEREC  pRec = &pRing->aRecs[idx & pRing->fMask];
+    pRec->uTsc      = uTscStart;
+    pRec->uAddr     = uAddr;
+    pRec->uValue    = uValue;
+    pRec->cTicks    = cTicks < UINT32_MAX ? (uint32_t)cTicks : UINT32_MAX;
+    pRec->u8Evt     = (uint8_t)enmEvt;
+    pRec->cbAccess  = cbAccess;
+    pRec->i16Rc     = rc >= INT16_MIN && rc <= INT16_MAX ? (int16_t)rc : INT16_MIN;
+    ASMAtomicWriteU64(&pRing->idxWrite, idx + 1);
+}
+
+
 /**
  * DBGF Data (part of VM)
  */
@@ -243,6 +304,22 @@ typedef struct DBGF
     /** Array of int 3 and REM breakpoints. (4..)
      * @remark This is currently a fixed size array for reasons of simplicity. */
     DBGFBP                      aBreakpoints[32];
+
+    /** @name Binary trace rings.
+     * @{ */
+    /** The TSC frequency used for converting ring timestamps. */
+    uint64_t                    u64TraceRingTscHz;
+    /** The ring-3 I/O thread rings, NULL if tracing to rings is disabled. */
+    R3PTRTYPE(uint8_t *)        pbTraceRingsIo;
+    /** The size of each ring in pbTraceRingsIo. */
+    uint32_t                    cbTraceRingIo;
+    /** The number of rings in pbTraceRingsIo. */
+    uint32_t                    cTraceRingsIo;
+    /** The number of I/O thread rings handed out so far. */
+    uint32_t volatile           cTraceRingsIoUsed;
+    /** TLS entry for looking up the calling I/O thread's ring. */
+    RTTLS                       iTraceRingTls;
+    /** @} */
 } DBGF;
 /** Pointer to DBGF Data. */
 typedef DBGF *PDBGF;
@@ -272,6 +349,13 @@ typedef struct DBGFCPU
 
     /** Padding the structure to 16 bytes. */
     bool                    afReserved[7];
+
+    /** The binary trace ring of this VCPU (R3 Ptr), NULL if disabled. */
+    R3PTRTYPE(PDBGFTRACERING) pTraceRingR3;
+    /** The binary trace ring of this VCPU (R0 Ptr), NIL if disabled. */
+    R0PTRTYPE(PDBGFTRACERING) pTraceRingR0;
+    /** The binary trace ring of this VCPU (RC Ptr), NIL if disabled. */
+    RCPTRTYPE(PDBGFTRACERING) pTraceRingRC;
 } DBGFCPU;
 /** Pointer to DBGFCPU data. */
 typedef DBGFCPU *PDBGFCPU;
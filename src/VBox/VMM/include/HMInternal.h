@@ -495,6 +495,91 @@ typedef DECLCALLBACK(int) FNHMSVMVMRUN(RTHCPHYS pVmcbHostPhys, RTHCPHYS pVmcbPhy
 /** Pointer to a SVM VMRun function. */
 typedef R0PTRTYPE(FNHMSVMVMRUN *) PFNHMSVMVMRUN;
 
+
+/** @name Exit profiler.
+ * @{ */
+/** Number of records in each VCPU's exit profiler ring buffer (power of two). */
+#define HM_EXITPROF_RECS                4096
+/** The exit accessed an I/O port, uAddr is the port number. */
+#define HM_EXITPROF_F_IOPORT            RT_BIT(0)
+/** The exit accessed MMIO, uAddr is the guest physical address. */
+#define HM_EXITPROF_F_MMIO              RT_BIT(1)
+/** The exit was completed in ring-3, cTicksRing3 is valid. */
+#define HM_EXITPROF_F_RING3             RT_BIT(2)
+/** @} */
+
+/**
+ * A sampled VM-exit.
+ */
+typedef struct HMEXITPROFREC
+{
+    /** The guest RIP of the exiting instruction. */
+    uint64_t                    uRip;
+    /** The I/O port or guest physical address (see fFlags). */
+    uint64_t                    uAddr;
+    /** Host TSC ticks spent in the ring-0 exit handler. */
+    uint32_t                    cTicks;
+    /** Host TSC ticks spent in ring-3 before the VCPU got back into ring-0. */
+    uint32_t                    cTicksRing3;
+    /** The VMX exit reason or SVM exit code. */
+    uint16_t                    uExitReason;
+    /** HM_EXITPROF_F_XXX. */
+    uint8_t                     fFlags;
+    uint8_t                     abPadding[5];
+} HMEXITPROFREC;
+AssertCompileSize(HMEXITPROFREC, 32);
+/** Pointer to a sampled VM-exit. */
+typedef HMEXITPROFREC *PHMEXITPROFREC;
+/** Pointer to a const sampled VM-exit. */
+typedef HMEXITPROFREC const *PCHMEXITPROFREC;
+
+/**
+ * Per VCPU exit profiler ring buffer.
+ *
+ * There is a single producer, the EMT in ring-0, which fills in a record and
+ * then advances idxWrite.  The ring-3 reader copies what it wants and checks
+ * idxWrite again afterwards to discard records that may have been overwritten
+ * while it was copying, so no locking is required.
+ */
+typedef struct HMEXITPROFBUF
+{
+    /** The write index (free running). */
+    uint32_t volatile           idxWrite;
+    /** The read index (free running), only used by ring-3. */
+    uint32_t                    idxRead;
+    /** Record every Nth exit. */
+    uint32_t                    cSampleInterval;
+    /** Exits left until the next one is recorded. */
+    uint32_t                    cUntilSample;
+    /** The access noted by the exit handler for the exit being sampled. */
+    uint64_t                    uCurAddr;
+    /** HM_EXITPROF_F_IOPORT or HM_EXITPROF_F_MMIO if uCurAddr is valid. */
+    uint8_t                     fCurFlags;
+    /** Set if Pending is waiting for ring-3 to finish with the exit. */
+    bool                        fPending;
+    uint8_t                     abPadding[6];
+    /** The TSC when we returned to ring-3 with a pending record. */
+    uint64_t                    uTscLeave;
+    /** The record held back until we know how long ring-3 took. */
+    HMEXITPROFREC               Pending;
+    /** The ring buffer. */
+    HMEXITPROFREC               aRecs[HM_EXITPROF_RECS];
+} HMEXITPROFBUF;
+/** Pointer to an exit profiler ring buffer. */
+typedef HMEXITPROFBUF *PHMEXITPROFBUF;
+
+/** Notes the I/O port or MMIO address an exit handler is about to service
+ *  so the exit profiler can attribute the exit to a device. */
+#define HMEXITPROF_NOTE_ACCESS(a_pVCpu, a_fFlags, a_uAddr) \
+    do { \
+        PHMEXITPROFBUF const pExitProfNote = (a_pVCpu)->hm.s.CTX_SUFF(pExitProf); \
+        if (RT_UNLIKELY(pExitProfNote)) \
+        { \
+            pExitProfNote->uCurAddr  = (a_uAddr); \
+            pExitProfNote->fCurFlags = (a_fFlags); \
+        } \
+    } while (0)
+
 /**
  * HM VMCPU Instance data.
  */
@@ -880,6 +965,11 @@ typedef struct HMCPU
     STAMCOUNTER             StatDebug64SwitchBack;
 #endif
 
+    /** The exit profiler ring buffer, NULL if not enabled - R3 ptr. */
+    R3PTRTYPE(PHMEXITPROFBUF)   pExitProfR3;
+    /** The exit profiler ring buffer, NULL if not enabled - R0 ptr. */
+    R0PTRTYPE(PHMEXITPROFBUF)   pExitProfR0;
+
 #ifdef VBOX_WITH_STATISTICS
     R3PTRTYPE(PSTAMCOUNTER) paStatExitReason;
     R0PTRTYPE(PSTAMCOUNTER) paStatExitReasonR0;
@@ -898,6 +988,28 @@ typedef HMCPU *PHMCPU;
 
 VMMR0DECL(PHMGLOBALCPUINFO) HMR0GetCurrentCpu(void);
 VMMR0DECL(PHMGLOBALCPUINFO) HMR0GetCurrentCpuEx(RTCPUID idCpu);
+VMMR0DECL(void) HMR0ExitProfRecord(PVMCPU pVCpu, uint32_t uExitReason, uint64_t uRip, uint64_t uTscStart, int rc);
+
+/**
+ * Checks whether the exit profiler wants this VM-exit recorded.
+ *
+ * @returns true if it should be recorded, false if not.
+ * @param   pBuf        The exit profiler ring buffer of the calling EMT.
+ */
+DECLINLINE(bool) hmR0ExitProfShouldSample(PHMEXITPROFBUF pBuf)
+{
+    if (--pBuf->cUntilSample)
+        return false;
+    pBuf->cUntilSample = pBuf->cSampleInterval;
+    pBuf->fCurFlags    = 0;
+    pBuf->uCurAddr     = 0;
+    return true;
+}
+
+/** Checks whether the exit profiler is enabled and wants this VM-exit. */
+#define HMEXITPROF_SHOULD_SAMPLE(a_pVCpu) \
+    (   RT_UNLIKELY((a_pVCpu)->hm.s.pExitProfR0 != NULL) \
+     && hmR0ExitProfShouldSample((a_pVCpu)->hm.s.pExitProfR0))
 
 
 #ifdef VBOX_STRICT
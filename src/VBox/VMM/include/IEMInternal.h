@@ -184,6 +184,53 @@ typedef IEMVERIFYEVTREC *PIEMVERIFYEVTREC;
 #endif /* IEM_VERIFICATION_MODE_FULL */
 
 
+/** The number of entries in each IEM TLB.  Must be a power of two. */
+#define IEMTLB_ENTRIES              32
+/** The TLB revision increment.  The revision lives in the bits of the tag
+ * above the guest virtual page number, so invalidating all entries is a
+ * matter of incrementing it. */
+#define IEMTLB_REVISION_INCR        RT_BIT_64(52)
+/** The guest page table flags kept in IEMTLBENTRY::uPhysAndFlags. */
+#define IEMTLBE_F_MASK              (X86_PTE_RW | X86_PTE_US | X86_PTE_A | X86_PTE_D | X86_PTE_PAE_NX)
+
+/**
+ * An IEM TLB entry caching a guest virtual to guest physical translation.
+ */
+typedef struct IEMTLBENTRY
+{
+    /** The guest virtual page number or'ed with the TLB revision.
+     * Zero if the entry is unused. */
+    uint64_t                uTag;
+    /** The guest physical page address with the IEMTLBE_F_MASK bits of the
+     * effective guest page table flags. */
+    uint64_t                uPhysAndFlags;
+} IEMTLBENTRY;
+AssertCompileSize(IEMTLBENTRY, 16);
+/** Pointer to an IEM TLB entry. */
+typedef IEMTLBENTRY *PIEMTLBENTRY;
+
+/**
+ * An IEM TLB.
+ *
+ * This is a direct mapped cache of guest page table walks.  It is invalidated
+ * by PGM on CR3 loads, INVLPG and paging mode changes, and by IEM itself when
+ * raising \#PF.
+ */
+typedef struct IEMTLB
+{
+    /** The current revision (IEMTLB_REVISION_INCR multiple, never zero). */
+    uint64_t                uTlbRevision;
+    /** Number of lookups hitting the TLB. */
+    uint32_t                cTlbHits;
+    /** Number of lookups requiring a page table walk. */
+    uint32_t                cTlbMisses;
+    /** The entries. */
+    IEMTLBENTRY             aEntries[IEMTLB_ENTRIES];
+} IEMTLB;
+/** Pointer to an IEM TLB. */
+typedef IEMTLB *PIEMTLB;
+
+
 /**
  * The per-CPU IEM state.
  */
@@ -392,6 +439,14 @@ typedef struct IEMCPU
     CPUMCPUVENDOR           enmHostCpuVendor;
     /** @} */
 
+    /** The HM world switch exit count when the TLBs were last known to be in
+     * sync with the guest page tables (nested paging only). */
+    uint32_t                cTlbWorldSwitchExits;
+    /** The TLB for opcode fetches. */
+    IEMTLB                  CodeTlb;
+    /** The TLB for data accesses. */
+    IEMTLB                  DataTlb;
+
 #ifdef IEM_VERIFICATION_MODE_FULL
     /** The event verification records for what IEM did (LIFO). */
     R3PTRTYPE(PIEMVERIFYEVTREC)     pIemEvtRecHead;
@@ -405,6 +460,7 @@ typedef struct IEMCPU
     R3PTRTYPE(PIEMVERIFYEVTREC)     pFreeEvtRec;
 #endif
 } IEMCPU;
+AssertCompileMemberAlignment(IEMCPU, CodeTlb, 8);
 /** Pointer to the per-CPU IEM state. */
 typedef IEMCPU *PIEMCPU;
 /** Pointer to the const per-CPU IEM state. */
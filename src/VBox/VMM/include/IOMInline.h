@@ -55,6 +55,51 @@ DECLINLINE(PIOMIOPORTRANGER3) iomIOPortGetRangeR3(PVM pVM, RTIOPORT Port)
 }
 
 
+#ifndef IN_RC
+/**
+ * Checks whether the calling VCPU has the port cached as lacking a buffered
+ * string I/O callback in the current context.
+ *
+ * This is done without the IOM lock.  A stale answer just sends the caller
+ * down the one unit at a time path, which is always correct, and
+ * iomR3FlushCache bumps IOM::uMmioGen whenever ranges or callbacks change.
+ *
+ * @returns true if known to be without, false if unknown.
+ * @param   pVM     Pointer to the VM.
+ * @param   pVCpu   Pointer to the virtual CPU structure of the caller.
+ * @param   Port    The I/O port.
+ * @param   iDir    IOMNOSTRBUF_READ or IOMNOSTRBUF_WRITE.
+ */
+DECLINLINE(bool) iomIOPortIsNoStrBufCached(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, unsigned iDir)
+{
+    IOMNOSTRBUFCACHE const *pEntry = &pVCpu->iom.s.CTX_SUFF(aNoStrBuf)[iDir];
+    return (unsigned)Port - (unsigned)pEntry->Port < (unsigned)pEntry->cPorts
+        && pEntry->uGen == ASMAtomicReadU32(&pVM->iom.s.uMmioGen);
+}
+
+
+/**
+ * Records that the port lacks a buffered string I/O callback in the current
+ * context, see iomIOPortIsNoStrBufCached.
+ *
+ * @param   pVM     Pointer to the VM.
+ * @param   pVCpu   Pointer to the virtual CPU structure of the caller.
+ * @param   Port    The I/O port.
+ * @param   pRange  The range of the port, NULL if unassigned.
+ * @param   iDir    IOMNOSTRBUF_READ or IOMNOSTRBUF_WRITE.
+ */
+DECLINLINE(void) iomIOPortSetNoStrBufCache(PVM pVM, PVMCPU pVCpu, RTIOPORT Port,
+                                           CTX_SUFF(PIOMIOPORTRANGE) pRange, unsigned iDir)
+{
+    Assert(IOM_IS_SHARED_LOCK_OWNER(pVM));
+    PIOMNOSTRBUFCACHE pEntry = &pVCpu->iom.s.CTX_SUFF(aNoStrBuf)[iDir];
+    pEntry->Port   = pRange ? pRange->Port   : Port;
+    pEntry->cPorts = pRange ? pRange->cPorts : 1;
+    pEntry->uGen   = pVM->iom.s.uMmioGen;
+}
+#endif /* !IN_RC */
+
+
 /**
  * Gets the MMIO range for the specified physical address in the current context.
  *
@@ -71,8 +116,11 @@ DECLINLINE(PIOMMMIORANGE) iomMmioGetRange(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys
     PIOMMMIORANGE pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
     if (    !pRange
         ||  GCPhys - pRange->GCPhys >= pRange->cb)
+    {
         pVCpu->iom.s.CTX_SUFF(pMMIORangeLast) = pRange
             = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
+        pVCpu->iom.s.uMmioGenCache = pVM->iom.s.uMmioGen;
+    }
     return pRange;
 }
 
@@ -90,6 +138,45 @@ DECLINLINE(void) iomMmioRetainRange(PIOMMMIORANGE pRange)
 }
 
 
+/**
+ * Gets the referenced MMIO range for the specified physical address from the
+ * range cache of the calling VCPU without taking the IOM lock.
+ *
+ * This works like a sequence lock: iomR3FlushCache bumps IOM::uMmioGen before
+ * invalidating the caches and then waits for EMTs with fMmioLockless set, so
+ * a range found here can be retained before it's released by deregistration.
+ *
+ * @returns Pointer to the retained MMIO range.
+ * @returns NULL if not in the cache, the cache is stale, or in statistics
+ *          builds where the callers need the IOM lock anyway.
+ *
+ * @param   pVM     Pointer to the VM.
+ * @param   pVCpu   Pointer to the virtual CPU structure of the caller.
+ * @param   GCPhys  Physical address to lookup.
+ */
+DECLINLINE(PIOMMMIORANGE) iomMmioGetRangeCachedWithRef(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys)
+{
+#ifndef VBOX_WITH_STATISTICS
+    PIOMMMIORANGE pRange = NULL;
+    ASMAtomicWriteBool(&pVCpu->iom.s.fMmioLockless, true); /* (full barrier) */
+    if (pVCpu->iom.s.uMmioGenCache == ASMAtomicReadU32(&pVM->iom.s.uMmioGen))
+    {
+        pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
+        if (   pRange
+            && GCPhys - pRange->GCPhys < pRange->cb)
+            iomMmioRetainRange(pRange);
+        else
+            pRange = NULL;
+    }
+    ASMAtomicWriteBool(&pVCpu->iom.s.fMmioLockless, false);
+    return pRange;
+#else
+    NOREF(pVM); NOREF(pVCpu); NOREF(GCPhys);
+    return NULL;
+#endif
+}
+
+
 /**
  * Gets the referenced MMIO range for the specified physical address in the
  * current context.
@@ -103,14 +190,14 @@ DECLINLINE(void) iomMmioRetainRange(PIOMMMIORANGE pRange)
  */
 DECLINLINE(PIOMMMIORANGE) iomMmioGetRangeWithRef(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys)
 {
+    PIOMMMIORANGE pRange = iomMmioGetRangeCachedWithRef(pVM, pVCpu, GCPhys);
+    if (pRange)
+        return pRange;
+
     int rc = IOM_LOCK_SHARED_EX(pVM, VINF_SUCCESS);
     AssertRCReturn(rc, NULL);
 
-    PIOMMMIORANGE pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
-    if (   !pRange
-        || GCPhys - pRange->GCPhys >= pRange->cb)
-        pVCpu->iom.s.CTX_SUFF(pMMIORangeLast) = pRange
-            = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
+    pRange = iomMmioGetRange(pVM, pVCpu, GCPhys);
     if (pRange)
         iomMmioRetainRange(pRange);
 
@@ -146,11 +233,11 @@ DECLINLINE(void) iomMmioReleaseRange(PVM pVM, PIOMMMIORANGE pRange)
  */
 DECLINLINE(PIOMMMIORANGE) iomMMIOGetRangeUnsafe(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys)
 {
+    /* Doesn't update the cache as that requires the lock (see iomMmioGetRangeCachedWithRef). */
     PIOMMMIORANGE pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
     if (    !pRange
         ||  GCPhys - pRange->GCPhys >= pRange->cb)
-        pVCpu->iom.s.CTX_SUFF(pMMIORangeLast) = pRange
-            = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
+        pRange = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
     return pRange;
 }
 #endif /* VBOX_STRICT */
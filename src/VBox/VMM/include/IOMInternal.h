@@ -158,6 +158,10 @@ typedef struct IOMIOPORTRANGER3
     R3PTRTYPE(PFNIOMIOPORTOUTSTRING) pfnOutStrCallback;
     /** Pointer to string IN callback function. */
     R3PTRTYPE(PFNIOMIOPORTINSTRING) pfnInStrCallback;
+    /** Pointer to buffered string OUT callback function, optional. */
+    R3PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnOutStrBufCallback;
+    /** Pointer to buffered string IN callback function, optional. */
+    R3PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnInStrBufCallback;
     /** Description / Name. For easing debugging. */
     R3PTRTYPE(const char *)     pszDesc;
 } IOMIOPORTRANGER3;
@@ -190,6 +194,10 @@ typedef struct IOMIOPORTRANGER0
     R0PTRTYPE(PFNIOMIOPORTOUTSTRING) pfnOutStrCallback;
     /** Pointer to string IN callback function. */
     R0PTRTYPE(PFNIOMIOPORTINSTRING) pfnInStrCallback;
+    /** Pointer to buffered string OUT callback function, optional. */
+    R0PTRTYPE(PFNIOMIOPORTOUTSTRBUF) pfnOutStrBufCallback;
+    /** Pointer to buffered string IN callback function, optional. */
+    R0PTRTYPE(PFNIOMIOPORTINSTRBUF) pfnInStrBufCallback;
     /** Description / Name. For easing debugging. */
     R3PTRTYPE(const char *)     pszDesc;
 } IOMIOPORTRANGER0;
@@ -292,6 +300,14 @@ typedef struct IOMTREES
     AVLOIOPORTTREE          IOPortStatTree;
     /** Tree containing MMIO statistics (IOMMMIOSTATS). */
     AVLOGCPHYSTREE          MmioStatTree;
+
+#ifdef VBOX_WITH_STATISTICS
+    /** Latency distribution of the MMIO read callbacks, all contexts.
+     * These live here rather than in IOM because of their size. */
+    STAMHISTOGRAM           MmioReadLatency;
+    /** Latency distribution of the MMIO write callbacks, all contexts. */
+    STAMHISTOGRAM           MmioWriteLatency;
+#endif
 } IOMTREES;
 /** Pointer to the IOM trees. */
 typedef IOMTREES *PIOMTREES;
@@ -340,6 +356,13 @@ typedef struct IOM
     STAMCOUNTER                     StatInstOut;
     STAMCOUNTER                     StatInstIns;
     STAMCOUNTER                     StatInstOuts;
+    /** Number of string I/O requests handed to a device as one buffer. */
+    STAMCOUNTER                     StatStrIoBuf;
+    /** Number of transfer units moved by the buffered string I/O callbacks. */
+    STAMCOUNTER                     StatStrIoBufUnits;
+    /** Number of string I/O requests left to the one unit at a time path
+     * because the device didn't take them. */
+    STAMCOUNTER                     StatStrIoSlowPath;
     /** @} */
 
     /** @name MMIO statistics.
@@ -375,11 +398,36 @@ typedef struct IOM
     RTUINT                          cMovsMaxBytes;
     RTUINT                          cStosMaxBytes;
     /** @} */
+
+    /** The lookup cache generation, incremented by iomR3FlushCache.
+     * See iomMmioGetRangeCachedWithRef and IOMIOPortReadStringBuf. */
+    uint32_t volatile               uMmioGen;
 } IOM;
 /** Pointer to IOM instance data. */
 typedef IOM *PIOM;
 
 
+/**
+ * A port range without buffered string I/O callbacks, cached per virtual CPU.
+ */
+typedef struct IOMNOSTRBUFCACHE
+{
+    /** First port of the range. */
+    RTIOPORT                        Port;
+    /** Number of ports in the range, 0 if the entry is unused. */
+    uint16_t                        cPorts;
+    /** The IOM::uMmioGen value the entry was filled in with.  The entry is
+     * stale when it no longer matches. */
+    uint32_t                        uGen;
+} IOMNOSTRBUFCACHE;
+/** Pointer to a cached port range without buffered string I/O callbacks. */
+typedef IOMNOSTRBUFCACHE *PIOMNOSTRBUFCACHE;
+/** Index of the IN entry in IOMCPU::aNoStrBufR3 and IOMCPU::aNoStrBufR0. */
+#define IOMNOSTRBUF_READ            0
+/** Index of the OUT entry in IOMCPU::aNoStrBufR3 and IOMCPU::aNoStrBufR0. */
+#define IOMNOSTRBUF_WRITE           1
+
+
 /**
  * IOM per virtual CPU instance data.
  */
@@ -412,6 +460,19 @@ typedef struct IOMCPU
     RCPTRTYPE(PIOMIOPORTSTATS)      pStatsLastWriteRC;
     RCPTRTYPE(PIOMMMIORANGE)        pMMIORangeLastRC;
     RCPTRTYPE(PIOMMMIOSTATS)        pMMIOStatsLastRC;
+    /** The IOM::uMmioGen value at the time pMMIORangeLast was filled in. */
+    uint32_t                        uMmioGenCache;
+    /** Set while looking up the MMIO range cache without the IOM lock. */
+    bool volatile                   fMmioLockless;
+    /** Alignment padding. */
+    bool                            afPadding[3];
+
+    /** Port ranges known to lack buffered string I/O callbacks, indexed by
+     * IOMNOSTRBUF_READ and IOMNOSTRBUF_WRITE.  Checked without the IOM lock,
+     * see IOMIOPortReadStringBuf. */
+    IOMNOSTRBUFCACHE                aNoStrBufR3[2];
+    /** Ditto for ring-0, where the callbacks are registered separately. */
+    IOMNOSTRBUFCACHE                aNoStrBufR0[2];
     /** @} */
 } IOMCPU;
 /** Pointer to IOM per virtual CPU instance data. */
@@ -35,6 +35,7 @@
 #include <VBox/sup.h>
 #include <iprt/assert.h>
 #include <iprt/critsect.h>
+#include <iprt/req.h>
 #ifdef IN_RING3
 # include <iprt/thread.h>
 #endif
@@ -267,6 +268,70 @@ typedef struct PDMDRVINSINT
 } PDMDRVINSINT;
 
 
+/** The number of distinct contending callers tracked per critical section. */
+#define PDMCRITSECT_CONTENTION_CALLERS      8
+
+/**
+ * A caller which had to wait for a critical section.
+ */
+typedef struct PDMCRITSECTCALLER
+{
+    /** Some location ID, typically the return address of the caller.  This is
+     * an address in the context given by fRing0. */
+    RTHCUINTPTR                     uId;
+    /** The source file of the caller.  Only recorded for ring-3 callers using
+     * the debug API variants. */
+    R3PTRTYPE(const char *)         pszFile;
+    /** The function of the caller.  Ring-3 only, see pszFile. */
+    R3PTRTYPE(const char *)         pszFunction;
+    /** The line number of the caller (optional). */
+    uint32_t                        uLine;
+    /** Set if the caller was waiting in ring-0. */
+    bool                            fRing0;
+    /** Alignment padding. */
+    bool                            afPadding[3];
+    /** Number of contended waits by this caller. */
+    uint64_t                        cWaits;
+    /** Total number of ticks this caller spent waiting. */
+    uint64_t                        cTicksWaited;
+} PDMCRITSECTCALLER;
+AssertCompileMemberAlignment(PDMCRITSECTCALLER, cWaits, 8);
+/** Pointer to a contending caller record. */
+typedef PDMCRITSECTCALLER *PPDMCRITSECTCALLER;
+
+
+/**
+ * Contention statistics of a critical section.
+ *
+ * These are kept in a hyper heap table (PDM::paCritSectContentionR3) so they
+ * are accessible from ring-0 as well.  All updates are done by the waiter
+ * after it has acquired the section, so the critical section itself
+ * serializes them.
+ */
+typedef struct PDMCRITSECTCONTENTION
+{
+    /** The critical section owning this entry, NULL if the entry is free. */
+    R3PTRTYPE(struct PDMCRITSECTINT *) pCritSect;
+    /** Profiling of blocking waits in ring-3. */
+    STAMPROFILE                     StatWaitR3;
+    /** Profiling of blocking waits in ring-0. */
+    STAMPROFILE                     StatWaitR0;
+    /** Waits by callers that didn't fit into aCallers. */
+    uint64_t                        cOtherWaits;
+    /** Ticks spent waiting by callers that didn't fit into aCallers. */
+    uint64_t                        cTicksOtherWaited;
+    /** Number of used entries in aCallers. */
+    uint32_t                        cCallers;
+    /** Alignment padding. */
+    uint32_t                        u32Padding;
+    /** The contending callers, in order of first appearance. */
+    PDMCRITSECTCALLER               aCallers[PDMCRITSECT_CONTENTION_CALLERS];
+} PDMCRITSECTCONTENTION;
+AssertCompileMemberAlignment(PDMCRITSECTCONTENTION, aCallers, 8);
+/** Pointer to the contention statistics of a critical section. */
+typedef PDMCRITSECTCONTENTION *PPDMCRITSECTCONTENTION;
+
+
 /**
  * Private critical section data.
  */
@@ -294,8 +359,9 @@ typedef struct PDMCRITSECTINT
     /** Set if the critical section is used by a timer or similar.
      * See PDMR3DevGetCritSect.  */
     bool                            fUsedByTimerOrSimilar;
-    /** Alignment padding. */
-    bool                            afPadding[2];
+    /** The index of the contention statistics entry in
+     * PDM::paCritSectContention plus one, 0 if not tracking contention. */
+    uint16_t                        idxContention;
     /** Event semaphore that is scheduled to be signaled upon leaving the
      * critical section. This is Ring-3 only of course. */
     RTSEMEVENT                      EventToSignal;
@@ -1131,6 +1197,20 @@ typedef struct PDM
     RTGCPHYS                        GCPhysVMMDevHeap;
     /** @} */
 
+    /** @name   Critical section contention statistics
+     * @{ */
+    /** The contention statistics table - R3 Ptr.  NULL if not allocated. */
+    R3PTRTYPE(PPDMCRITSECTCONTENTION) paCritSectContentionR3;
+    /** The contention statistics table - R0 Ptr. */
+    R0PTRTYPE(PPDMCRITSECTCONTENTION) paCritSectContentionR0;
+    /** Number of entries in the contention statistics table. */
+    uint32_t                        cCritSectContention;
+    /** Set when the table has been configured (it is allocated lazily). */
+    bool                            fCritSectContentionInited;
+    /** Alignment padding. */
+    bool                            afPadding1[3];
+    /** @} */
+
     /** Number of times a critical section leave request needed to be queued for ring-3 execution. */
     STAMCOUNTER                     StatQueuedCritSectLeaves;
 } PDM;
@@ -1184,6 +1264,15 @@ typedef struct PDMUSERPERVM
     R3PTRTYPE(PPDMNETSHAPER)        pNetShaper;
 #endif /* VBOX_WITH_NETSHAPER */
 
+    /** @name   Parallel construction
+     * @{ */
+    /** The worker pool executing driver construction work, NIL_RTREQPOOL if
+     * parallel construction is disabled or has completed. */
+    RTREQPOOL                       hConstructPool;
+    /** Outstanding driver construction work (LIFO).  Only accessed by EMT(0). */
+    R3PTRTYPE(struct PDMCONSTRUCTWORK *) pConstructWork;
+    /** @} */
+
 } PDMUSERPERVM;
 /** Pointer to the PDM data kept in the UVM. */
 typedef PDMUSERPERVM *PPDMUSERPERVM;
@@ -1239,6 +1328,10 @@ extern const PDMPCIRAWHLPR3 g_pdmR3DevPciRawHlp;
 # define PDMDRV_ASSERT_DRVINS(pDrvIns)   do { } while (0)
 #endif
 
+/** The number of nanoseconds a device or driver constructor (or driver
+ * construction work) needs to take before it is mentioned in the release log. */
+#define PDMCONSTRUCT_LOG_AT_NS              UINT64_C(50000000)
+
 
 /*******************************************************************************
 *   Internal Functions                                                         *
@@ -1280,6 +1373,8 @@ int         pdmR3DrvInstantiate(PVM pVM, PCFGMNODE pNode, PPDMIBASE pBaseInterfa
 int         pdmR3DrvDetach(PPDMDRVINS pDrvIns, uint32_t fFlags);
 void        pdmR3DrvDestroyChain(PPDMDRVINS pDrvIns, uint32_t fFlags);
 PPDMDRV     pdmR3DrvLookup(PVM pVM, const char *pszName);
+int         pdmR3DrvConstructWorkWaitAll(PVM pVM);
+void        pdmR3DrvConstructWorkTerm(PVM pVM);
 
 int         pdmR3LdrInitU(PUVM pUVM);
 void        pdmR3LdrTermU(PUVM pUVM);
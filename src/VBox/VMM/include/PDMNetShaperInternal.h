@@ -40,6 +40,26 @@ typedef struct PDMNSBWGROUP
     volatile uint64_t                           tsUpdatedLast;
     /** Reference counter - How many filters are associated with this group. */
     volatile uint32_t                           cRefs;
+    /** Pointer to the parent group (ring-3), NULL for a top level group. */
+    R3PTRTYPE(struct PDMNSBWGROUP *)            pParentR3;
+    /** Pointer to the parent group (ring-0), NIL for a top level group. */
+    R0PTRTYPE(struct PDMNSBWGROUP *)            pParentR0;
+    /** Guaranteed number of bytes per second. Traffic within this rate does
+     * not have to be backed by tokens of the parent group. 0 if none. */
+    volatile uint64_t                           cbPerSecMin;
+    /** Number of bytes we are allowed to transfer in one burst at the
+     * guaranteed rate. */
+    volatile uint32_t                           cbBucketMin;
+    /** Number of guaranteed bytes left at the last update. */
+    volatile uint32_t                           cbTokensMinLast;
+    /** Configured burst size, 0 to derive it from the maximum rate. */
+    volatile uint32_t                           cbBurst;
+    /** Deficit round robin: number of filters which were choked in the
+     * previous round. While non-zero every filter may only transmit as much
+     * as its deficit allows. */
+    volatile uint32_t                           cFiltersActive;
+    /** Deficit round robin: index of the filter to wake up first. */
+    uint32_t                                    iFilterNext;
 } PDMNSBWGROUP;
 /** Pointer to a bandwidth group. */
 typedef PDMNSBWGROUP *PPDMNSBWGROUP;
@@ -3132,8 +3132,11 @@ typedef struct PGM
     bool                            fPciPassthrough;
     /** The number of MMIO2 regions (serves as the next MMIO2 ID). */
     uint8_t                         cMmio2Regions;
+    /** Set while deferred pages are still missing on a post-copy target, so
+     * the mapping APIs know to check for them (see PGMPOSTCOPY). */
+    bool volatile                   fPostCopyPending;
     /** Alignment padding that makes the next member start on a 8 byte boundary. */
-    bool                            afAlignment1[2];
+    bool                            afAlignment1[1];
 
     /** Indicates that PGMR3FinalizeMappings has been called and that further
      * PGMR3MapIntermediate calls will be rejected. */
@@ -3188,7 +3191,8 @@ typedef struct PGM
     /** Pointer to SHW+GST mode data (function pointers).
      * The index into this table is made up from */
     R3PTRTYPE(PPGMMODEDATA)         paModeData;
-    RTR3PTR                         R3PtrAlignment0;
+    /** Post-copy teleportation state, NULL if not active. */
+    R3PTRTYPE(struct PGMPOSTCOPY *) pPostCopyR3;
     /** MMIO2 lookup array for ring-3.  Indexed by idMmio2 minus 1.  */
     R3PTRTYPE(PPGMMMIO2RANGE)       apMmio2RangesR3[PGM_MMIO2_MAX_RANGES];
 
@@ -3408,8 +3412,11 @@ typedef struct PGM
         uint32_t                    cIgnoredPages;
         /** Indicates that a live save operation is active.  */
         bool                        fActive;
+        /** Whether to throttle the vCPUs when the guest dirties memory faster
+         * than we can save it (CFGM: PGM/LiveSave/AutoConverge). */
+        bool                        fAutoConverge;
         /** Padding. */
-        bool                        afReserved[2];
+        bool                        afReserved[1];
         /** The next history index. */
         uint8_t                     iDirtyPagesHistory;
         /** History of the total amount of dirty pages. */
@@ -3427,7 +3434,19 @@ typedef struct PGM
         uint64_t                    uSaveStartNS;
         /** Pages per second (for statistics). */
         uint32_t                    cPagesPerSecond;
-        uint32_t                    cAlignment;
+        /** Pages dirtied per second during the last pass (for auto-converge). */
+        uint32_t                    cDirtyPagesPerSecond;
+        /** The nanosecond timestamp of the previous vote. */
+        uint64_t                    uLastVoteNS;
+        /** The CPU execution cap in effect before auto-converge started
+         * throttling, 0 if not throttling. */
+        uint32_t                    uAutoConvergeCapOrg;
+        /** The current auto-converge CPU execution cap (percent). */
+        uint32_t                    uAutoConvergeCap;
+        /** The lowest execution cap auto-converge may go to (percent). */
+        uint32_t                    uAutoConvergeCapMin;
+        /** How much to lower the execution cap each pass (percent). */
+        uint32_t                    uAutoConvergeCapStep;
     } LiveSave;
 
     /** @name   Error injection.
@@ -3468,6 +3487,82 @@ typedef struct PGM
     STAMPROFILE                     StatShModCheck;         /**< Profiles shared module checks. */
     /** @} */
 
+    /** @name   Page deduplication scanner (see PGMSharedPage.cpp).
+     * @{ */
+    struct
+    {
+        /** Where the next scan starts. */
+        RTGCPHYS                    GCPhysCursor;
+        /** The timer pacing the scanner, NULL if not enabled. */
+        PTMTIMERR3                  pTimerR3;
+#if HC_ARCH_BITS == 32
+        uint32_t                    u32Alignment0;
+#endif
+        /** The number of pages to examine per interval.
+         * @cfgm /PGM/PageDedup/PagesPerScan */
+        uint32_t                    cPagesPerScan;
+        /** The scan interval in milliseconds.
+         * @cfgm /PGM/PageDedup/Interval */
+        uint32_t                    cMsInterval;
+        /** Whether the scanner is enabled.
+         * @cfgm /PGM/PageDedup/Enabled */
+        bool volatile               fEnabled;
+        /** Set while a scan request is queued or running. */
+        bool volatile               fScanPending;
+        bool                        afAlignment1[6];
+
+        STAMCOUNTER                 StatScannedPages;       /**< Pages examined. */
+        STAMCOUNTER                 StatMergedPages;        /**< Pages replaced by an existing shared page. */
+        STAMCOUNTER                 StatNewSharedPages;     /**< Pages converted into new shared pages. */
+        STAMCOUNTER                 StatMismatches;         /**< Hash hits with different content. */
+        STAMCOUNTER                 StatPasses;             /**< Completed passes over guest RAM. */
+        STAMPROFILE                 StatScan;               /**< Profiles the scanning. */
+    } PageDedup;
+    /** @} */
+
+    /** @name   Large page promotion (see PGMPhys.cpp).
+     * @{ */
+    struct
+    {
+        /** Where the next scan starts (2 MB aligned). */
+        RTGCPHYS                    GCPhysCursor;
+        /** The timer pacing the promotion scanner and updating the coverage
+         * statistics, NULL if large pages aren't supported. */
+        PTMTIMERR3                  pTimerR3;
+        /** The ring-0 request buffer. */
+        R3PTRTYPE(PGMMPROMOTELARGEPAGEREQ) pReqR3;
+        /** 2 MB bounce buffer for the page content. */
+        R3PTRTYPE(uint8_t *)        pbBounceR3;
+#if HC_ARCH_BITS == 32
+        uint32_t                    u32Alignment0;
+#endif
+        /** The number of 2 MB ranges to examine per interval.
+         * @cfgm /PGM/LargePagePromotion/RangesPerScan */
+        uint32_t                    cRangesPerScan;
+        /** The scan interval in milliseconds.
+         * @cfgm /PGM/LargePagePromotion/Interval */
+        uint32_t                    cMsInterval;
+        /** The number of guest pages backed by enabled large pages. */
+        uint32_t                    cCoveredPages;
+        /** The number of private guest pages not backed by enabled large pages. */
+        uint32_t                    cSmallPages;
+        /** Large page coverage of the private guest pages in percent. */
+        uint32_t                    uCoveragePct;
+        /** Whether the promotion scanner is enabled.
+         * @cfgm /PGM/LargePagePromotion/Enabled */
+        bool volatile               fEnabled;
+        /** Set while a scan request is queued or running. */
+        bool volatile               fScanPending;
+        bool                        afAlignment1[2];
+
+        STAMCOUNTER                 StatPromoted;           /**< Ranges promoted to a new large page. */
+        STAMCOUNTER                 StatReenabled;          /**< Disabled large pages enabled again. */
+        STAMCOUNTER                 StatRefused;            /**< Ranges which didn't qualify. */
+        STAMCOUNTER                 StatFailed;             /**< Failed large page allocations. */
+        STAMPROFILE                 StatScan;               /**< Profiles the scanning. */
+    } LargePagePromotion;
+    /** @} */
+
 #ifdef VBOX_WITH_STATISTICS
     /** @name Statistics on the heap.
      * @{ */
@@ -3488,6 +3583,8 @@ AssertCompileMemberAlignment(PGM, PhysTlbHC, 8);
 AssertCompileMemberAlignment(PGM, HCPhysZeroPg, 8);
 AssertCompileMemberAlignment(PGM, aHandyPages, 8);
 AssertCompileMemberAlignment(PGM, cRelocations, 8);
+AssertCompileMemberAlignment(PGM, PageDedup.StatScannedPages, 8);
+AssertCompileMemberAlignment(PGM, LargePagePromotion.StatPromoted, 8);
 #endif /* !IN_TSTVMSTRUCTGC */
 /** Pointer to the PGM instance data. */
 typedef PGM *PPGM;
@@ -4066,6 +4163,9 @@ int             pgmR3PhysChunkMap(PVM pVM, uint32_t idChunk, PPPGMCHUNKR3MAP ppC
 int             pgmR3PhysRamTerm(PVM pVM);
 void            pgmR3PhysRomTerm(PVM pVM);
 void            pgmR3PhysAssertSharedPageChecksums(PVM pVM);
+int             pgmR3PageDedupInit(PVM pVM);
+int             pgmR3PhysLargePagePromotionInit(PVM pVM);
+int             pgmR3PhysLargePagePromotionStart(PVM pVM);
 
 int             pgmR3PoolInit(PVM pVM);
 void            pgmR3PoolRelocate(PVM pVM);
@@ -4075,6 +4175,15 @@ void            pgmR3PoolClearAll(PVM pVM, bool fFlushRemTlb);
 DECLCALLBACK(VBOXSTRICTRC) pgmR3PoolClearAllRendezvous(PVM pVM, PVMCPU pVCpu, void *fpvFlushRemTbl);
 void            pgmR3PoolWriteProtectPages(PVM pVM);
 
+bool            pgmR3PostCopyVote(PVM pVM, uint32_t uPass);
+bool            pgmR3PostCopyIsDeferring(PVM pVM);
+bool            pgmR3PostCopyIsAccepting(PVM pVM);
+bool            pgmR3PostCopyIsPending(PVM pVM);
+int             pgmR3PostCopyDeferPage(PVM pVM, RTGCPHYS GCPhys);
+int             pgmR3PostCopyFetchPage(PVM pVM, RTGCPHYS GCPhys);
+int             pgmR3PostCopyLoadDone(PVM pVM);
+void            pgmR3PostCopyTerm(PVM pVM);
+
 #endif /* IN_RING3 */
 #if defined(VBOX_WITH_2X_4GB_ADDR_SPACE_IN_R0) || defined(IN_RC)
 int             pgmRZDynMapHCPageCommon(PPGMMAPSET pSet, RTHCPHYS HCPhys, void **ppv RTLOG_COMMA_SRC_POS_DECL);
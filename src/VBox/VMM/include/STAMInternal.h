@@ -87,6 +87,8 @@ typedef struct STAMDESC
     STAMTYPE            enmType;
     /** Visibility type. */
     STAMVISIBILITY      enmVisibility;
+    /** The registration-stable sample index (see STAMR3DeltaCollect). */
+    uint32_t            iSample;
     /** Pointer to the sample data. */
     union STAMDESCSAMPLEDATA
     {
@@ -98,6 +100,8 @@ typedef struct STAMDESC
         PSTAMPROFILEADV pProfileAdv;
         /** Ratio, unsigned 32-bit. */
         PSTAMRATIOU32   pRatioU32;
+        /** Histogram. */
+        PSTAMHISTOGRAM  pHistogram;
         /** unsigned 8-bit. */
         uint8_t        *pu8;
         /** unsigned 16-bit. */
@@ -146,10 +150,16 @@ typedef struct STAMUSERPERVM
     /** The number of registered host CPU leaves. */
     uint32_t                cRegisteredHostCpus;
 
-    /** Explicit alignment padding. */
-    uint32_t                uAlignment;
+    /** The next sample index to hand out.  Indexes are never reused. */
+    uint32_t                iNextSample;
     /** The copy of the GMM statistics. */
     GMMSTATS                GMMStats;
+
+    /** The delta streaming service, NULL if not enabled. */
+    R3PTRTYPE(struct STAMSTREAM *) pStream;
+    /** Incremented on every registration and deregistration so delta cursors
+     * can tell whether the samples they cached are still valid. */
+    uint32_t volatile       uGeneration;
 } STAMUSERPERVM;
 #ifdef IN_RING3
 AssertCompileMemberAlignment(STAMUSERPERVM, GMMStats, 8);
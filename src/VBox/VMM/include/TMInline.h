@@ -19,6 +19,118 @@
 #define ___TMInline_h
 
 
+/**
+ * Melds two active timer heaps.
+ *
+ * The root with the later expire time becomes the first child of the other.
+ *
+ * @returns The root of the combined heap.
+ * @param   pRoot1      The root of the first heap.  Must not have siblings.
+ * @param   pRoot2      The root of the second heap.  Must not have siblings.
+ *                      Looses to @a pRoot1 if they expire at the same time.
+ */
+DECL_FORCE_INLINE(PTMTIMER) tmTimerHeapMeld(PTMTIMER pRoot1, PTMTIMER pRoot2)
+{
+    if (pRoot2->u64Expire < pRoot1->u64Expire)
+    {
+        PTMTIMER pTmp = pRoot1;
+        pRoot1 = pRoot2;
+        pRoot2 = pTmp;
+    }
+
+    PTMTIMER const pChild = TMTIMER_GET_CHILD(pRoot1);
+    TMTIMER_SET_NEXT(pRoot2, pChild);
+    if (pChild)
+        TMTIMER_SET_PREV(pChild, pRoot2);
+    TMTIMER_SET_PREV(pRoot2, pRoot1);
+    TMTIMER_SET_CHILD(pRoot1, pRoot2);
+    return pRoot1;
+}
+
+
+/**
+ * Gets the next timer when walking an active timer heap in pre-order.
+ *
+ * This is for debugging and statistics, the order has nothing to do with the
+ * expire times apart from the root coming first.
+ *
+ * @returns Pointer to the next timer, NULL when done.
+ * @param   pTimer      The current timer.
+ */
+DECLINLINE(PTMTIMER) tmTimerHeapWalkNext(PTMTIMER pTimer)
+{
+    PTMTIMER pNext = TMTIMER_GET_CHILD(pTimer);
+    if (pNext)
+        return pNext;
+    while (pTimer)
+    {
+        pNext = TMTIMER_GET_NEXT(pTimer);
+        if (pNext)
+            return pNext;
+
+        /* Up to the parent: back to the first sibling, its offPrev is the parent. */
+        PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
+        while (pPrev && TMTIMER_GET_CHILD(pPrev) != pTimer)
+        {
+            pTimer = pPrev;
+            pPrev  = TMTIMER_GET_PREV(pTimer);
+        }
+        pTimer = pPrev;
+    }
+    return NULL;
+}
+
+
+/**
+ * Removes a timer from the active timer heap without any state checks.
+ *
+ * @param   pQueue      The timer queue.
+ * @param   pTimer      The timer that needs unlinking.
+ *
+ * @remarks Called while owning the relevant queue lock.
+ */
+DECL_FORCE_INLINE(void) tmTimerQueueHeapRemove(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
+{
+    PTMTIMER const pSubHeap = pTimer->offChild ? tmTimerHeapMergePairs(TMTIMER_GET_CHILD(pTimer)) : NULL;
+    PTMTIMER const pPrev    = TMTIMER_GET_PREV(pTimer);
+    if (!pPrev)
+    {
+        /* The root, replace it by what's left of its children. */
+        Assert(TMTIMER_GET_HEAD(pQueue) == pTimer);
+        Assert(!pTimer->offNext);
+        TMTIMER_SET_HEAD(pQueue, pSubHeap);
+        ASMAtomicWriteU64(&pQueue->u64Expire, pSubHeap ? pSubHeap->u64Expire : INT64_MAX);
+        DBGFTRACE_U64_TAG(pTimer->CTX_SUFF(pVM), pQueue->u64Expire, "tmTimerQueueUnlinkActive");
+    }
+    else
+    {
+        /* Unlink it from its siblings and meld its children with the root. */
+        PTMTIMER const pNext = TMTIMER_GET_NEXT(pTimer);
+        if (TMTIMER_GET_CHILD(pPrev) == pTimer)
+            TMTIMER_SET_CHILD(pPrev, pNext);
+        else
+            TMTIMER_SET_NEXT(pPrev, pNext);
+        if (pNext)
+            TMTIMER_SET_PREV(pNext, pPrev);
+
+        if (pSubHeap)
+        {
+            /* The root only changes if an expire time was updated behind our back. */
+            PTMTIMER const pRoot    = TMTIMER_GET_HEAD(pQueue);
+            PTMTIMER const pNewRoot = tmTimerHeapMeld(pRoot, pSubHeap);
+            if (pNewRoot != pRoot)
+            {
+                TMTIMER_SET_HEAD(pQueue, pNewRoot);
+                ASMAtomicWriteU64(&pQueue->u64Expire, pNewRoot->u64Expire);
+            }
+        }
+    }
+    pTimer->offNext  = 0;
+    pTimer->offPrev  = 0;
+    pTimer->offChild = 0;
+}
+
+
 /**
  * Used to unlink a timer from the active list.
  *
@@ -35,21 +147,7 @@ DECL_FORCE_INLINE(void) tmTimerQueueUnlinkActive(PTMTIMERQUEUE pQueue, PTMTIMER
            ? enmState == TMTIMERSTATE_ACTIVE
            : enmState == TMTIMERSTATE_PENDING_SCHEDULE || enmState == TMTIMERSTATE_PENDING_STOP_SCHEDULE);
 #endif
-
-    const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
-    const PTMTIMER pNext = TMTIMER_GET_NEXT(pTimer);
-    if (pPrev)
-        TMTIMER_SET_NEXT(pPrev, pNext);
-    else
-    {
-        TMTIMER_SET_HEAD(pQueue, pNext);
-        pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
-        DBGFTRACE_U64_TAG(pTimer->CTX_SUFF(pVM), pQueue->u64Expire, "tmTimerQueueUnlinkActive");
-    }
-    if (pNext)
-        TMTIMER_SET_PREV(pNext, pPrev);
-    pTimer->offNext = 0;
-    pTimer->offPrev = 0;
+    tmTimerQueueHeapRemove(pQueue, pTimer);
 }
 
 #endif
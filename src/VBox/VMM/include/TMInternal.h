@@ -174,10 +174,15 @@ typedef struct TMTIMER
     /** Timer relative offset to the next timer in the schedule list. */
     int32_t volatile        offScheduleNext;
 
-    /** Timer relative offset to the next timer in the chain. */
+    /** Timer relative offset to the next sibling in the active timer heap. */
     int32_t                 offNext;
-    /** Timer relative offset to the previous timer in the chain. */
+    /** Timer relative offset to the previous sibling in the active timer heap,
+     * or to the parent if this is the first child. */
     int32_t                 offPrev;
+    /** Timer relative offset to the first child in the active timer heap. */
+    int32_t                 offChild;
+    /** Explicit alignment padding. */
+    uint32_t                u32Alignment1;
 
     /** Pointer to the VM the timer belongs to - R3 Ptr. */
     PVMR3                   pVMR3;
@@ -243,6 +248,10 @@ AssertCompileMemberSize(TMTIMER, enmState, sizeof(uint32_t));
 #define TMTIMER_SET_PREV(pTimer, pPrev) ((pTimer)->offPrev = (pPrev) ? (intptr_t)(pPrev) - (intptr_t)(pTimer) : 0)
 /** Set the next timer link. */
 #define TMTIMER_SET_NEXT(pTimer, pNext) ((pTimer)->offNext = (pNext) ? (intptr_t)(pNext) - (intptr_t)(pTimer) : 0)
+/** Get the first child timer. */
+#define TMTIMER_GET_CHILD(pTimer) ((PTMTIMER)((pTimer)->offChild ? (intptr_t)(pTimer) + (pTimer)->offChild : 0))
+/** Set the first child timer link. */
+#define TMTIMER_SET_CHILD(pTimer, pChild) ((pTimer)->offChild = (pChild) ? (intptr_t)(pChild) - (intptr_t)(pTimer) : 0)
 
 
 /**
@@ -256,10 +265,14 @@ typedef struct TMTIMERQUEUE
      * Updated by EMT when scheduling the queue or modifying the head timer.
      * Assigned UINT64_MAX when there is no head timer. */
     uint64_t                u64Expire;
-    /** Doubly linked list of active timers.
+    /** The root of the active timer heap.
      *
-     * When no scheduling is pending, this list is will be ordered by expire time (ascending).
-     * Access is serialized by only letting the emulation thread (EMT) do changes.
+     * This is a pairing heap ordered by expire time, so the root is always the
+     * timer expiring first and inserting is O(1) while removing is O(log n)
+     * amortized.  The children of a timer are linked via offNext and offPrev,
+     * with the first child's offPrev pointing back at the parent.  The order
+     * only holds while no scheduling is pending.  Access is serialized by only
+     * letting the emulation thread (EMT) do changes.
      *
      * The offset is relative to the queue structure.
      */
@@ -282,11 +295,16 @@ typedef struct TMTIMERQUEUE
 /** Pointer to a timer queue. */
 typedef TMTIMERQUEUE *PTMTIMERQUEUE;
 
-/** Get the head of the active timer list. */
+/** Get the head of the active timer heap. */
 #define TMTIMER_GET_HEAD(pQueue)        ((PTMTIMER)((pQueue)->offActive ? (intptr_t)(pQueue) + (pQueue)->offActive : 0))
-/** Set the head of the active timer list. */
+/** Set the head of the active timer heap. */
 #define TMTIMER_SET_HEAD(pQueue, pHead) ((pQueue)->offActive = pHead ? (intptr_t)pHead - (intptr_t)(pQueue) : 0)
 
+/** The max number of timer callbacks a single queue run makes.  This stops
+ * timers that keep rearming themselves into the expired window from starving
+ * the EMT; whatever is left over is served by the next run. */
+#define TM_MAX_CALLBACKS_PER_RUN        1024
+
 
 /**
  * CPU load data set.
@@ -723,6 +741,7 @@ typedef TMCPU *PTMCPU;
 
 const char             *tmTimerState(TMTIMERSTATE enmState);
 void                    tmTimerQueueSchedule(PVM pVM, PTMTIMERQUEUE pQueue);
+PTMTIMER                tmTimerHeapMergePairs(PTMTIMER pFirst);
 #ifdef VBOX_STRICT
 void                    tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere);
 #endif
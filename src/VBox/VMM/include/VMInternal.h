@@ -141,6 +141,9 @@ typedef enum
     VMHALTMETHOD_1,
     /** The first go at a more global approach. */
     VMHALTMETHOD_GLOBAL_1,
+    /** Adaptive polling on top of the global approach, for latency
+     * sensitive guests. */
+    VMHALTMETHOD_POLL_1,
     /** The end of valid methods. (not inclusive of course) */
     VMHALTMETHOD_END,
     /** The usual 32-bit max value. */
@@ -300,6 +303,24 @@ typedef struct VMINTUSERPERVM
             /** The threshold between spinning and blocking. */
             uint32_t                cNsSpinBlockThresholdCfg;
         }                           Global1;
+
+       /**
+        * Poll 1 - Like global 1, but busy poll for the force action flags for
+        * an adaptive interval before blocking in the GVMM.
+        */
+        struct
+        {
+            /** The threshold between spinning and blocking. */
+            uint32_t                cNsSpinBlockThresholdCfg;
+            /** The initial poll window (ns). */
+            uint32_t                cNsStartPollCfg;
+            /** The upper limit for the poll window (ns). */
+            uint32_t                cNsMaxPollCfg;
+            /** What to multiply the poll window by when a wakeup was missed. */
+            uint32_t                cGrowFactorCfg;
+            /** What to divide the poll window by when polling was a waste. */
+            uint32_t                cShrinkDivisorCfg;
+        }                           Poll1;
     }                               Halt;
 
     /** Pointer to the DBGC instance data. */
@@ -424,6 +445,20 @@ typedef struct VMINTUSERPERVMCPU
            uint64_t                 u64StartSpinTS;
        }                            Method34;
 # endif
+
+       /**
+        * Poll 1 - The learned poll window and the wakeup timestamp.
+        */
+        struct
+        {
+            /** When someone notified us from ring-3 while halted (RTTimeNanoTS),
+             * 0 if not. */
+            uint64_t volatile       u64NotifyTS;
+            /** The current poll window (ns). */
+            uint32_t                cNsPollWindow;
+            /** Align the next member. */
+            uint32_t                u32Alignment;
+        }                           Poll1;
     }                               Halt;
 
     /** Profiling the halted state; yielding vs blocking.
@@ -436,10 +471,26 @@ typedef struct VMINTUSERPERVMCPU
     STAMPROFILE                     StatHaltTimers;
     STAMPROFILE                     StatHaltPoll;
     /** @} */
+
+    /** Halt method poll 1 statistics.
+     * @{ */
+    /** Polling caught the wakeup. */
+    STAMCOUNTER                     StatHaltPollHit;
+    /** The wakeup came after we had given up polling and blocked. */
+    STAMCOUNTER                     StatHaltPollMiss;
+    /** Poll window increases. */
+    STAMCOUNTER                     StatHaltPollGrow;
+    /** Poll window decreases. */
+    STAMCOUNTER                     StatHaltPollShrink;
+    /** Notification to wakeup latency (ns).  Only covers the notifications
+     * made from ring-3 since ring-0 doesn't timestamp its wakeups. */
+    STAMHISTOGRAM                   StatHaltWakeupLatency;
+    /** @} */
 } VMINTUSERPERVMCPU;
 AssertCompileMemberAlignment(VMINTUSERPERVMCPU, u64HaltsStartTS, 8);
 AssertCompileMemberAlignment(VMINTUSERPERVMCPU, Halt.Method12.cNSBlockedTooLongAvg, 8);
 AssertCompileMemberAlignment(VMINTUSERPERVMCPU, StatHaltYield, 8);
+AssertCompileMemberAlignment(VMINTUSERPERVMCPU, Halt.Poll1.u64NotifyTS, 8);
 
 /** Pointer to the VM internal data kept in the UVM. */
 typedef VMINTUSERPERVMCPU *PVMINTUSERPERVMCPU;
@@ -31,6 +31,7 @@
 # define DBGFTRACE_ENABLED
 #endif
 #include <VBox/vmm/dbgftrace.h>
+#include <iprt/asm-amd64-x86.h>
 
 
 /*******************************************************************************
@@ -57,8 +58,21 @@
 #define VMMTPGROUP_EM       RT_BIT(0)
 #define VMMTPGROUP_HM       RT_BIT(1)
 #define VMMTPGROUP_TM       RT_BIT(2)
+#define VMMTPGROUP_IOM      RT_BIT(3)
 /** @}  */
 
+/** Starts a timed binary trace ring event.
+ * @returns The start TSC, or 0 if the trace point group is disabled. */
+#define TP_RING_START(a_pVCpu, a_GrpSuff) \
+    ( RT_UNLIKELY((a_pVCpu)->fTraceGroups & VMMTPGROUP_##a_GrpSuff) ? ASMReadTSC() : UINT64_C(0) )
+
+/** Completes a timed binary trace ring event started by TP_RING_START. */
+#define TP_RING_STOP(a_pVCpu, a_uTscStart, a_enmEvt, a_uAddr, a_uValue, a_cbAccess, a_rc) \
+    do { \
+        if (RT_UNLIKELY(a_uTscStart)) \
+            DBGFTraceRingAdd(a_pVCpu, a_enmEvt, a_uTscStart, a_uAddr, a_uValue, (uint8_t)(a_cbAccess), a_rc); \
+    } while (0)
+
 
 
 /** @name Ring-3 trace points.
@@ -0,0 +1,204 @@
+/* $Id$ */
+/** @file
+ * VMM Testcase - Buffered string I/O through IOM.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmapi.h>
+#include <VBox/vmm/vmm.h>
+#include <VBox/vmm/iom.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/assert.h>
+#include <iprt/initterm.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#define TESTCASE    "tstIOMStrBuf"
+
+#define TST_CHECK(expr) \
+    do { \
+        if (!(expr)) \
+        { \
+            RTPrintf(TESTCASE ": error: line %u: %s\n", __LINE__, #expr); \
+            g_cErrors++; \
+        } \
+    } while (0)
+
+/** The VGA sequencer index register, the VGA does buffered string I/O on it. */
+#define TST_PORT_STRBUF     0x3c4
+/** The PIT channel 0 data port, the PIT doesn't do buffered string I/O. */
+#define TST_PORT_NO_STRBUF  0x40
+/** A port nobody registers in the default configuration. */
+#define TST_PORT_UNUSED     0xe0
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The error count. */
+static int  g_cErrors = 0;
+
+
+static DECLCALLBACK(int)
+tstConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        /* Disable HM, see tstVMREQ. */
+        rc = CFGMR3InsertInteger(CFGMR3GetRoot(pVM), "HMEnabled", false);
+        if (RT_FAILURE(rc))
+            RTPrintf("CFGMR3InsertInteger(pRoot,\"HMEnabled\",) -> %Rrc\n", rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Checks that a port without buffered string I/O leaves the whole request to
+ * the caller, also when asking again and the answer comes from the cache.
+ */
+static void tstNoStrBuf(PVM pVM, PVMCPU pVCpu, RTIOPORT Port)
+{
+    for (unsigned iPass = 0; iPass < 2; iPass++)
+    {
+        uint8_t     ab[16];
+        uint32_t    cTransfers = sizeof(ab);
+        memset(ab, 0xcc, sizeof(ab));
+        VBOXSTRICTRC rcStrict = IOMIOPortReadStringBuf(pVM, pVCpu, Port, ab, &cTransfers, 1);
+        TST_CHECK(rcStrict == VINF_SUCCESS);
+        TST_CHECK(cTransfers == sizeof(ab));
+        TST_CHECK(ab[0] == 0xcc && ab[sizeof(ab) - 1] == 0xcc);
+
+        cTransfers = sizeof(ab) / 2;
+        rcStrict = IOMIOPortWriteStringBuf(pVM, pVCpu, Port, ab, &cTransfers, 2);
+        TST_CHECK(rcStrict == VINF_SUCCESS);
+        TST_CHECK(cTransfers == sizeof(ab) / 2);
+    }
+}
+
+
+/**
+ * Checks that the VGA takes the whole request in one go.
+ */
+static void tstStrBuf(PVM pVM, PVMCPU pVCpu)
+{
+    /* Byte OUTS leaves the last index written in the register. */
+    static uint8_t const s_abIndexes[] = { 0, 1, 2, 3 };
+    uint32_t cTransfers = RT_ELEMENTS(s_abIndexes);
+    VBOXSTRICTRC rcStrict = IOMIOPortWriteStringBuf(pVM, pVCpu, TST_PORT_STRBUF, s_abIndexes, &cTransfers, 1);
+    TST_CHECK(rcStrict == VINF_SUCCESS);
+    TST_CHECK(cTransfers == 0);
+
+    uint8_t ab[64];
+    memset(ab, 0xcc, sizeof(ab));
+    cTransfers = sizeof(ab);
+    rcStrict = IOMIOPortReadStringBuf(pVM, pVCpu, TST_PORT_STRBUF, ab, &cTransfers, 1);
+    TST_CHECK(rcStrict == VINF_SUCCESS);
+    TST_CHECK(cTransfers == 0);
+    TST_CHECK(ab[0] == 3 && ab[sizeof(ab) - 1] == 3);
+
+    /* Word OUTS writes the index and then the data register. */
+    static uint8_t const s_abMapMask[] = { 2, 0x0f };
+    cTransfers = 1;
+    rcStrict = IOMIOPortWriteStringBuf(pVM, pVCpu, TST_PORT_STRBUF, s_abMapMask, &cTransfers, 2);
+    TST_CHECK(rcStrict == VINF_SUCCESS);
+    TST_CHECK(cTransfers == 0);
+
+    memset(ab, 0xcc, sizeof(ab));
+    cTransfers = sizeof(ab) / 2;
+    rcStrict = IOMIOPortReadStringBuf(pVM, pVCpu, TST_PORT_STRBUF, ab, &cTransfers, 2);
+    TST_CHECK(rcStrict == VINF_SUCCESS);
+    TST_CHECK(cTransfers == 0);
+    TST_CHECK(ab[0] == 2 && ab[1] == 0x0f);
+    TST_CHECK(ab[sizeof(ab) - 2] == 2 && ab[sizeof(ab) - 1] == 0x0f);
+}
+
+
+/**
+ * The tests, run on EMT(0).
+ */
+static DECLCALLBACK(int) tstIOMStrBufWorker(PUVM pUVM)
+{
+    PVM     pVM   = VMR3GetVM(pUVM);
+    PVMCPU  pVCpu = VMMGetCpu(pVM);
+
+    RTPrintf(TESTCASE ": Buffered...\n");
+    tstStrBuf(pVM, pVCpu);
+
+    RTPrintf(TESTCASE ": Without...\n");
+    tstNoStrBuf(pVM, pVCpu, TST_PORT_NO_STRBUF);
+    tstNoStrBuf(pVM, pVCpu, TST_PORT_UNUSED);
+
+    /* The ports cached as lacking buffered string I/O must not get in the
+       way of the ones that do it. */
+    RTPrintf(TESTCASE ": Buffered after the cache was filled...\n");
+    tstStrBuf(pVM, pVCpu);
+    tstNoStrBuf(pVM, pVCpu, TST_PORT_NO_STRBUF);
+    return VINF_SUCCESS;
+}
+
+
+int main(int argc, char **argv)
+{
+    RTR3InitExe(argc, &argv, RTR3INIT_FLAGS_SUPLIB);
+    RTPrintf(TESTCASE ": TESTING...\n");
+    RTStrmFlush(g_pStdOut);
+
+    PUVM pUVM;
+    int rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, NULL, &pUVM);
+    if (RT_SUCCESS(rc))
+    {
+        rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstIOMStrBufWorker, 1, pUVM);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": error: the worker failed, rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+
+        rc = VMR3Destroy(pUVM);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": error: failed to destroy the vm! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+        VMR3ReleaseUVM(pUVM);
+    }
+    else
+    {
+        RTPrintf(TESTCASE ": fatal error: failed to create the vm! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+
+    /*
+     * Summary and return.
+     */
+    if (!g_cErrors)
+        RTPrintf(TESTCASE ": SUCCESS\n");
+    else
+        RTPrintf(TESTCASE ": FAILURE - %d errors\n", g_cErrors);
+
+    return !!g_cErrors;
+}
@@ -0,0 +1,288 @@
+/* $Id$ */
+/** @file
+ * VMM Testcase - Hierarchical bandwidth groups, guaranteed rates and DRR
+ *                fairness of the network shaper.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmapi.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/pdmnetshaper.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/assert.h>
+#include <iprt/initterm.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#define TESTCASE    "tstPDMNetShaper"
+
+/** The rate of the groups the test checks against (bytes/s). */
+#define TST_RATE            UINT64_C(1000000)
+/** The rate of the child groups, well above the one of their parent. */
+#define TST_RATE_CHILD      UINT64_C(10000000)
+/** The guaranteed rate of the one child that has one, well above the half
+ * of the parent it would get by racing its sibling. */
+#define TST_RATE_MIN        UINT64_C(750000)
+/** The burst size of the child with the guaranteed rate. */
+#define TST_BURST           UINT32_C(131072)
+/** How long to transmit (ms). */
+#define TST_DURATION_MS     2000
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The error count. */
+static int              g_cErrors = 0;
+/** The filters: two children of one parent, two members of a flat group and
+ * two children of another parent, one of them with a guaranteed rate. */
+static PDMNSFILTER      g_aFilters[6];
+/** The groups the filters attach to. */
+static const char      *g_apszGroups[6] = { "ChildA", "ChildB", "Fair", "Fair", "Guaranteed", "BestEffort" };
+
+
+/**
+ * Adds a bandwidth group to the configuration.
+ *
+ * @param   cbMin       The guaranteed rate, 0 for none.
+ * @param   cbBurst     The burst size, 0 for the default.
+ */
+static int tstInsertBwGroup(PCFGMNODE pBwGroups, const char *pszName, uint64_t cbMax, const char *pszParent,
+                            uint64_t cbMin = 0, uint32_t cbBurst = 0)
+{
+    PCFGMNODE pGroup;
+    int rc = CFGMR3InsertNode(pBwGroups, pszName, &pGroup);
+    if (RT_SUCCESS(rc))
+        rc = CFGMR3InsertInteger(pGroup, "Max", cbMax);
+    if (RT_SUCCESS(rc) && cbMin)
+        rc = CFGMR3InsertInteger(pGroup, "Min", cbMin);
+    if (RT_SUCCESS(rc) && cbBurst)
+        rc = CFGMR3InsertInteger(pGroup, "Burst", cbBurst);
+    if (RT_SUCCESS(rc) && pszParent)
+        rc = CFGMR3InsertString(pGroup, "Parent", pszParent);
+    return rc;
+}
+
+
+static DECLCALLBACK(int)
+tstConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        /* Disable HM, see tstVMREQ. */
+        PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+        rc = CFGMR3InsertInteger(pRoot, "HMEnabled", false);
+        if (RT_FAILURE(rc))
+            RTPrintf("CFGMR3InsertInteger(pRoot,\"HMEnabled\",) -> %Rrc\n", rc);
+
+        /*
+         * Two children with a generous limit under a parent with a tight
+         * one, a flat group shared by two filters, and two more children
+         * under a tight parent where one of them has a guaranteed rate.
+         */
+        PCFGMNODE pPdm = CFGMR3GetChild(pRoot, "PDM");
+        if (RT_SUCCESS(rc) && !pPdm)
+            rc = CFGMR3InsertNode(pRoot, "PDM", &pPdm);
+        PCFGMNODE pShaper = NULL;
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertNode(pPdm, "NetworkShaper", &pShaper);
+        PCFGMNODE pBwGroups = NULL;
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertNode(pShaper, "BwGroups", &pBwGroups);
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "Parent", TST_RATE, NULL);
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "ChildA", TST_RATE_CHILD, "Parent");
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "ChildB", TST_RATE_CHILD, "Parent");
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "Fair", TST_RATE, NULL);
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "Shared", TST_RATE, NULL);
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "Guaranteed", TST_RATE_CHILD, "Shared", TST_RATE_MIN, TST_BURST);
+        if (RT_SUCCESS(rc))
+            rc = tstInsertBwGroup(pBwGroups, "BestEffort", TST_RATE_CHILD, "Shared");
+        if (RT_FAILURE(rc))
+            RTPrintf(TESTCASE ": error: configuring the bandwidth groups failed, rc=%Rrc\n", rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Tries to transmit a number of frames through a filter.
+ *
+ * @returns Number of bytes the shaper let through.
+ */
+static uint64_t tstXmit(PPDMNSFILTER pFilter, unsigned cFrames, size_t cbFrame)
+{
+    uint64_t cb = 0;
+    for (unsigned i = 0; i < cFrames; i++)
+        if (PDMNsAllocateBandwidth(pFilter, cbFrame))
+            cb += cbFrame;
+    return cb;
+}
+
+
+/**
+ * Checks that a number lies within the given bounds.
+ */
+static void tstCheckRange(const char *pszWhat, uint64_t u64, uint64_t u64Min, uint64_t u64Max)
+{
+    RTPrintf(TESTCASE ": %s: %llu (expected %llu..%llu)\n", pszWhat, u64, u64Min, u64Max);
+    if (u64 < u64Min || u64 > u64Max)
+    {
+        RTPrintf(TESTCASE ": error: %s is out of range\n", pszWhat);
+        g_cErrors++;
+    }
+}
+
+
+/**
+ * Offers more traffic than the groups allow and checks what got through.
+ *
+ * The shaper's TX thread runs the DRR rounds meanwhile, the filters have no
+ * driver above them so it doesn't call anybody back.
+ */
+static void tstShape(void)
+{
+    uint64_t       acb[RT_ELEMENTS(g_aFilters)] = { 0, 0, 0, 0, 0, 0 };
+    uint64_t const tsStart = RTTimeSystemNanoTS();
+    uint64_t       tsNow;
+    do
+    {
+        /* Both children offer about 6 MB/s, together way above their parent. */
+        acb[0] += tstXmit(&g_aFilters[0], 4, 1514);
+        acb[1] += tstXmit(&g_aFilters[1], 4, 1514);
+        /* A greedy filter offering large frames and a modest one offering
+           small frames, each of them above its fair share. */
+        acb[2] += tstXmit(&g_aFilters[2], 8, 4000);
+        acb[3] += tstXmit(&g_aFilters[3], 4, 1000);
+        /* The guaranteed and the best effort child offer the same. */
+        acb[4] += tstXmit(&g_aFilters[4], 4, 1514);
+        acb[5] += tstXmit(&g_aFilters[5], 4, 1514);
+        RTThreadSleep(1);
+        tsNow = RTTimeSystemNanoTS();
+    } while (tsNow - tsStart < UINT64_C(1000000) * TST_DURATION_MS);
+
+    /*
+     * The children together must not exceed the rate of the parent plus its
+     * initial bucket, but should get reasonably close to it.
+     */
+    uint64_t const cbRate   = TST_RATE * ((tsNow - tsStart) / RT_NS_1MS) / RT_MS_1SEC;
+    uint64_t const cbBucket = RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, TST_RATE * PDM_NETSHAPER_MAX_LATENCY / RT_MS_1SEC);
+    tstCheckRange("Parent group bytes", acb[0] + acb[1], cbRate / 2, cbRate + cbBucket + 2 * 1514);
+
+    /*
+     * Neither member of the flat group may be starved by the other, each
+     * round gives both the same quantum.
+     */
+    uint64_t const cbFair = acb[2] + acb[3];
+    tstCheckRange("Fair group bytes", cbFair, cbRate / 2, cbRate + cbBucket + 4000);
+    tstCheckRange("Greedy filter share (%)", cbFair ? acb[2] * 100 / cbFair : 0, 40, 60);
+    tstCheckRange("Modest filter share (%)", cbFair ? acb[3] * 100 / cbFair : 0, 40, 60);
+
+    /*
+     * The guaranteed child must get its rate even though it races its sibling
+     * for the parent's tokens, which alone would give it about half of them.
+     * Only the guaranteed bytes may go beyond the parent's limit, those sent
+     * while the parent had no tokens left.
+     */
+    uint64_t const cbRateMin   = TST_RATE_MIN * ((tsNow - tsStart) / RT_NS_1MS) / RT_MS_1SEC;
+    uint64_t const cbBucketMin = RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, TST_RATE_MIN * PDM_NETSHAPER_MAX_LATENCY / RT_MS_1SEC);
+    tstCheckRange("Guaranteed child bytes", acb[4], cbRateMin * 9 / 10, cbRate + cbBucket + cbRateMin + cbBucketMin);
+    tstCheckRange("Shared group bytes", acb[4] + acb[5], cbRateMin * 9 / 10,
+                  cbRate + cbBucket + cbRateMin + cbBucketMin + 2 * 1514);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTR3InitExe(argc, &argv, RTR3INIT_FLAGS_SUPLIB);
+    RTPrintf(TESTCASE ": TESTING...\n");
+    RTStrmFlush(g_pStdOut);
+
+    PUVM pUVM;
+    int rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, NULL, &pUVM);
+    if (RT_SUCCESS(rc))
+    {
+        /* The shaper's TX thread only runs while the VM does. */
+        rc = VMR3PowerOn(pUVM);
+        if (RT_SUCCESS(rc))
+        {
+            unsigned cAttached = 0;
+            for (; cAttached < RT_ELEMENTS(g_aFilters); cAttached++)
+            {
+                rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)PDMR3NsAttach, 4,
+                                      pUVM, (PPDMDRVINS)NULL, g_apszGroups[cAttached], &g_aFilters[cAttached]);
+                if (RT_FAILURE(rc))
+                {
+                    RTPrintf(TESTCASE ": error: attaching to '%s' failed, rc=%Rrc\n", g_apszGroups[cAttached], rc);
+                    g_cErrors++;
+                    break;
+                }
+            }
+
+            if (cAttached == RT_ELEMENTS(g_aFilters))
+                tstShape();
+
+            while (cAttached-- > 0)
+                VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)PDMR3NsDetach, 3,
+                                 pUVM, (PPDMDRVINS)NULL, &g_aFilters[cAttached]);
+        }
+        else
+        {
+            RTPrintf(TESTCASE ": error: failed to power on the vm! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+
+        VMR3PowerOff(pUVM);
+        rc = VMR3Destroy(pUVM);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": error: failed to destroy the vm! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+        VMR3ReleaseUVM(pUVM);
+    }
+    else
+    {
+        RTPrintf(TESTCASE ": fatal error: failed to create the vm! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+
+    /*
+     * Summary and return.
+     */
+    if (!g_cErrors)
+        RTPrintf(TESTCASE ": SUCCESS\n");
+    else
+        RTPrintf(TESTCASE ": FAILURE - %d errors\n", g_cErrors);
+
+    return !!g_cErrors;
+}
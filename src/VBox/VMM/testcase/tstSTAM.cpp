@@ -0,0 +1,630 @@
+/* $Id$ */
+/** @file
+ * VMM Testcase - The STAM binary delta and Prometheus encoders.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmapi.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/stam.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/process.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/tcp.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#define TESTCASE    "tstSTAM"
+
+/** Checks a condition, complaining and counting the error if false. */
+#define TST_CHECK(expr) \
+    do { \
+        if (!(expr)) \
+        { \
+            RTPrintf(TESTCASE ": error: line %u: %s\n", __LINE__, #expr); \
+            g_cErrors++; \
+        } \
+    } while (0)
+
+/** Checks that a status code is the expected one. */
+#define TST_CHECK_RC(expr, rcExpect) \
+    do { \
+        int rcCheck = (expr); \
+        if (rcCheck != (rcExpect)) \
+        { \
+            RTPrintf(TESTCASE ": error: line %u: %s -> %Rrc, expected %Rrc\n", __LINE__, #expr, rcCheck, (rcExpect)); \
+            g_cErrors++; \
+        } \
+    } while (0)
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The error count. */
+static int              g_cErrors = 0;
+/** The port of the streaming service. */
+static uint16_t         g_uPort;
+
+/** The samples. */
+static STAMCOUNTER      g_Counter;
+static STAMPROFILE      g_Profile;
+static STAMRATIOU32     g_Ratio;
+static uint32_t         g_u32Used;
+static uint64_t         g_u64New;
+static uint64_t         g_u64Quote;
+/** A histogram sample, deliberately left zero initialized. */
+static STAMHISTOGRAM    g_Hist;
+
+
+static DECLCALLBACK(int)
+tstConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        /* Disable HM, see tstVMREQ. */
+        PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+        rc = CFGMR3InsertInteger(pRoot, "HMEnabled", false);
+        if (RT_FAILURE(rc))
+            RTPrintf("CFGMR3InsertInteger(pRoot,\"HMEnabled\",) -> %Rrc\n", rc);
+
+        /*
+         * The streaming service, serving our samples only.
+         */
+        PCFGMNODE pStam = CFGMR3GetChild(pRoot, "STAM");
+        if (RT_SUCCESS(rc) && !pStam)
+            rc = CFGMR3InsertNode(pRoot, "STAM", &pStam);
+        PCFGMNODE pStream = NULL;
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertNode(pStam, "Stream", &pStream);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertInteger(pStream, "Enabled", true);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertInteger(pStream, "Port", g_uPort);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertInteger(pStream, "IntervalMs", 50);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertString(pStream, "Pattern", "/tstSTAM/*");
+        if (RT_FAILURE(rc))
+            RTPrintf(TESTCASE ": error: configuring the streaming service failed, rc=%Rrc\n", rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Collects a packet and applies it to the reader.
+ *
+ * @returns The number of records in the packet.
+ */
+static uint32_t tstCollect(PSTAMDELTA pDelta, PSTAMDELTAREADER pReader)
+{
+    void const *pvPacket = NULL;
+    size_t      cbPacket = 0;
+    int rc = STAMR3DeltaCollect(pDelta, &pvPacket, &cbPacket);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf(TESTCASE ": error: STAMR3DeltaCollect -> %Rrc\n", rc);
+        g_cErrors++;
+        return 0;
+    }
+
+    PCSTAMDELTAHDR pHdr = (PCSTAMDELTAHDR)pvPacket;
+    TST_CHECK(cbPacket >= sizeof(*pHdr));
+    TST_CHECK(pHdr->u32Magic == STAMDELTA_MAGIC);
+    TST_CHECK(pHdr->u16Version == STAMDELTA_VERSION);
+    TST_CHECK(pHdr->cbPacket == cbPacket);
+    TST_CHECK_RC(STAMR3DeltaReaderApply(pReader, pvPacket, cbPacket), VINF_SUCCESS);
+    return pHdr->cRecords;
+}
+
+
+/**
+ * Checks the values the reader has for a sample.
+ */
+static void tstCheckSample(PSTAMDELTAREADER pReader, const char *pszName, STAMTYPE enmType, uint32_t cValues,
+                           uint64_t u64Value0, uint64_t u64Value1)
+{
+    PCSTAMDELTASAMPLE pSample = STAMR3DeltaReaderFindSample(pReader, pszName);
+    if (!pSample)
+    {
+        RTPrintf(TESTCASE ": error: sample '%s' not found\n", pszName);
+        g_cErrors++;
+        return;
+    }
+    if (   pSample->enmType != enmType
+        || pSample->cValues != cValues
+        || pSample->au64Values[0] != u64Value0
+        || (cValues > 1 && pSample->au64Values[1] != u64Value1))
+    {
+        RTPrintf(TESTCASE ": error: sample '%s': type=%d cValues=%u values=%RU64,%RU64, expected %d/%u/%RU64,%RU64\n",
+                 pszName, pSample->enmType, pSample->cValues, pSample->au64Values[0], pSample->au64Values[1],
+                 enmType, cValues, u64Value0, u64Value1);
+        g_cErrors++;
+    }
+    TST_CHECK(STAMR3DeltaReaderGetSample(pReader, pSample->iSample) == pSample);
+}
+
+
+/**
+ * Checks that a histogram percentile estimate is within the promised 12.5%
+ * of the exact value.
+ */
+static void tstCheckPercentile(PCSTAMHISTOGRAM pHist, unsigned uPerMille, uint64_t uExact)
+{
+    uint64_t const uEstimate = STAMR3HistogramPercentile(pHist, uPerMille);
+    if (   uEstimate * 8 < uExact * 7
+        || uEstimate * 8 > uExact * 9)
+    {
+        RTPrintf(TESTCASE ": error: percentile %u.%u: %RU64, expected %RU64 +/- 12.5%%\n",
+                 uPerMille / 10, uPerMille % 10, uEstimate, uExact);
+        g_cErrors++;
+    }
+}
+
+
+/**
+ * Tests the histogram bucket and percentile math.
+ */
+static void tstHistogram(PUVM pUVM)
+{
+    RTPrintf(TESTCASE ": Histograms...\n");
+
+    /*
+     * Bucket boundaries: small values are exact, then four sub-buckets per
+     * power of two all the way up.
+     */
+    static const struct { uint64_t uValue; unsigned iBucket; } s_aBuckets[] =
+    {
+        { 0, 0 }, { 1, 1 }, { 3, 3 }, { 4, 4 }, { 7, 7 }, { 8, 8 }, { 9, 8 }, { 10, 9 },
+        { 15, 11 }, { 16, 12 }, { 1000, 35 }, { UINT64_C(0xffffffff), 123 }, { UINT64_C(0x100000000), 124 },
+        { RT_BIT_64(63), 248 }, { UINT64_MAX, 251 },
+    };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aBuckets); i++)
+        if (STAMHistogramValueToBucket(s_aBuckets[i].uValue) != s_aBuckets[i].iBucket)
+        {
+            RTPrintf(TESTCASE ": error: bucket of %#RX64 is %u, expected %u\n", s_aBuckets[i].uValue,
+                     STAMHistogramValueToBucket(s_aBuckets[i].uValue), s_aBuckets[i].iBucket);
+            g_cErrors++;
+        }
+
+    unsigned iPrev = 0;
+    for (uint64_t uValue = 1; uValue < _1M; uValue++)
+    {
+        unsigned const iBucket = STAMHistogramValueToBucket(uValue);
+        if (iBucket != iPrev && iBucket != iPrev + 1)
+        {
+            RTPrintf(TESTCASE ": error: bucket of %RU64 is %u, the one before was %u\n", uValue, iBucket, iPrev);
+            g_cErrors++;
+            break;
+        }
+        iPrev = iBucket;
+    }
+
+    /*
+     * Percentiles.
+     */
+    STAMHISTOGRAM Hist;
+    STAMHistogramInit(&Hist);
+    TST_CHECK(Hist.uMin == UINT64_MAX);
+    TST_CHECK(STAMR3HistogramPercentile(&Hist, 500) == 0);
+
+    /* A single value comes back exactly thanks to the min/max clamping. */
+    for (unsigned i = 0; i < 10; i++)
+        STAMHistogramAdd(&Hist, 1000);
+    TST_CHECK(STAMR3HistogramPercentile(&Hist, 0) == 1000);
+    TST_CHECK(STAMR3HistogramPercentile(&Hist, 500) == 1000);
+    TST_CHECK(STAMR3HistogramPercentile(&Hist, 1000) == 1000);
+
+    /* 1..1000 once each. */
+    STAMHistogramInit(&Hist);
+    for (uint64_t uValue = 1; uValue <= 1000; uValue++)
+        STAMHistogramAdd(&Hist, uValue);
+    TST_CHECK(Hist.cValues == 1000);
+    TST_CHECK(Hist.uTotal == 500500);
+    TST_CHECK(Hist.uMin == 1);
+    TST_CHECK(Hist.uMax == 1000);
+    TST_CHECK(STAMR3HistogramPercentile(&Hist, 0) == 1);
+    tstCheckPercentile(&Hist, 100, 100);
+    tstCheckPercentile(&Hist, 500, 500);
+    tstCheckPercentile(&Hist, 900, 900);
+    tstCheckPercentile(&Hist, 990, 990);
+    tstCheckPercentile(&Hist, 999, 999);
+    TST_CHECK(STAMR3HistogramPercentile(&Hist, 1000) <= 1000);
+
+    /* Large values. */
+    STAMHistogramInit(&Hist);
+    STAMHistogramAdd(&Hist, UINT64_C(10000000000));
+    STAMHistogramAdd(&Hist, UINT64_C(30000000000));
+    tstCheckPercentile(&Hist, 500, UINT64_C(10000000000));
+    tstCheckPercentile(&Hist, 1000, UINT64_C(30000000000));
+
+    /* A value still being recorded: in the buckets, but not in min/max yet. */
+    STAMHistogramInit(&Hist);
+    ASMAtomicIncU32(&Hist.acBuckets[STAMHistogramValueToBucket(100)]);
+    tstCheckPercentile(&Hist, 500, 100);
+
+    /*
+     * Registering and resetting must leave the minimum above any value.
+     */
+    TST_CHECK(g_Hist.uMin == 0);
+    TST_CHECK_RC(STAMR3RegisterU(pUVM, &g_Hist, STAMTYPE_HISTOGRAM, STAMVISIBILITY_ALWAYS, "/tstSTAMHist/Latency",
+                                 STAMUNIT_NS, "A histogram."), VINF_SUCCESS);
+    TST_CHECK(g_Hist.uMin == UINT64_MAX);
+    STAMHistogramAdd(&g_Hist, 5);
+    STAMHistogramAdd(&g_Hist, 3);
+    TST_CHECK(g_Hist.uMin == 3 && g_Hist.uMax == 5);
+    TST_CHECK_RC(STAMR3Reset(pUVM, "/tstSTAMHist/*"), VINF_SUCCESS);
+    TST_CHECK(g_Hist.cValues == 0 && g_Hist.uMin == UINT64_MAX && g_Hist.uMax == 0);
+    STAMHistogramAdd(&g_Hist, 7);
+    TST_CHECK(g_Hist.uMin == 7 && g_Hist.uMax == 7);
+    TST_CHECK_RC(STAMR3Deregister(pUVM, "/tstSTAMHist/*"), VINF_SUCCESS);
+}
+
+
+/**
+ * Tests the binary delta encoder against the reader.
+ */
+static void tstDelta(PUVM pUVM)
+{
+    RTPrintf(TESTCASE ": Binary delta encoder...\n");
+    PSTAMDELTA       pDelta;
+    PSTAMDELTAREADER pReader;
+    TST_CHECK_RC(STAMR3DeltaCreate(pUVM, "/tstSTAM/*|/tstSTAMNone/*", &pDelta), VINF_SUCCESS);
+    TST_CHECK_RC(STAMR3DeltaReaderCreate(&pReader), VINF_SUCCESS);
+    if (g_cErrors)
+        return;
+
+    /*
+     * The first packet defines everything, except for unused samples.
+     */
+    tstCollect(pDelta, pReader);
+    tstCheckSample(pReader, "/tstSTAM/Counter", STAMTYPE_COUNTER, 1, 42, 0);
+    tstCheckSample(pReader, "/tstSTAM/Ratio", STAMTYPE_RATIO_U32, 2, 3, 4);
+    tstCheckSample(pReader, "/tstSTAM/Profile", STAMTYPE_PROFILE, 4, 10, 1000);
+    TST_CHECK(!STAMR3DeltaReaderFindSample(pReader, "/tstSTAM/Used"));
+    PCSTAMDELTASAMPLE pSample = STAMR3DeltaReaderFindSample(pReader, "/tstSTAM/Counter");
+    TST_CHECK(pSample && !strcmp(pSample->pszDesc, "A counter."));
+
+    /*
+     * Nothing changed, nothing sent.
+     */
+    TST_CHECK(tstCollect(pDelta, pReader) == 0);
+
+    /*
+     * One value changed and an unused sample became used.
+     */
+    g_Counter.c = 43;
+    g_u32Used   = 5;
+    TST_CHECK(tstCollect(pDelta, pReader) == 3);
+    tstCheckSample(pReader, "/tstSTAM/Counter", STAMTYPE_COUNTER, 1, 43, 0);
+    tstCheckSample(pReader, "/tstSTAM/Used", STAMTYPE_U32, 1, 5, 0);
+
+    /*
+     * A sample goes away and another one shows up.
+     */
+    TST_CHECK_RC(STAMR3Deregister(pUVM, "/tstSTAM/Ratio"), VINF_SUCCESS);
+    TST_CHECK_RC(STAMR3RegisterU(pUVM, &g_u64New, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, "/tstSTAM/New",
+                                 STAMUNIT_BYTES, NULL), VINF_SUCCESS);
+    g_u64New = 7;
+    TST_CHECK(tstCollect(pDelta, pReader) == 3);
+    TST_CHECK(!STAMR3DeltaReaderFindSample(pReader, "/tstSTAM/Ratio"));
+    tstCheckSample(pReader, "/tstSTAM/New", STAMTYPE_U64, 1, 7, 0);
+    pSample = STAMR3DeltaReaderFindSample(pReader, "/tstSTAM/New");
+    TST_CHECK(pSample && !*pSample->pszDesc);
+
+    /* The cache was rebuilt, changes must still get through. */
+    g_u64New = 8;
+    TST_CHECK(tstCollect(pDelta, pReader) == 1);
+    tstCheckSample(pReader, "/tstSTAM/New", STAMTYPE_U64, 1, 8, 0);
+
+    /*
+     * The reader must refuse what it can't make sense of and leave its
+     * state alone.
+     */
+    PSTAMDELTAREADER pReader2;
+    TST_CHECK_RC(STAMR3DeltaReaderCreate(&pReader2), VINF_SUCCESS);
+    g_u64New = 9;
+    void const *pvPacket;
+    size_t      cbPacket;
+    TST_CHECK_RC(STAMR3DeltaCollect(pDelta, &pvPacket, &cbPacket), VINF_SUCCESS);
+    TST_CHECK_RC(STAMR3DeltaReaderApply(pReader2, pvPacket, cbPacket), VERR_INVALID_STATE);   /* skipped the definitions */
+    TST_CHECK_RC(STAMR3DeltaReaderApply(pReader, pvPacket, cbPacket - 8), VERR_BUFFER_UNDERFLOW);
+    uint8_t *pbCopy = (uint8_t *)RTMemDup(pvPacket, cbPacket);
+    if (pbCopy)
+    {
+        ((PSTAMDELTAHDR)pbCopy)->u32Magic = ~STAMDELTA_MAGIC;
+        TST_CHECK_RC(STAMR3DeltaReaderApply(pReader, pbCopy, cbPacket), VERR_INVALID_MAGIC);
+        ((PSTAMDELTAHDR)pbCopy)->u32Magic = STAMDELTA_MAGIC;
+        ((PSTAMDELTAREC)((PSTAMDELTAHDR)pbCopy + 1))->u8Kind = STAMDELTAKIND_END;
+        TST_CHECK_RC(STAMR3DeltaReaderApply(pReader, pbCopy, cbPacket), VERR_INVALID_PARAMETER);
+        RTMemFree(pbCopy);
+    }
+    tstCheckSample(pReader, "/tstSTAM/New", STAMTYPE_U64, 1, 8, 0);
+    TST_CHECK_RC(STAMR3DeltaReaderApply(pReader, pvPacket, cbPacket), VINF_SUCCESS);
+    tstCheckSample(pReader, "/tstSTAM/New", STAMTYPE_U64, 1, 9, 0);
+
+    STAMR3DeltaReaderDestroy(pReader2);
+    STAMR3DeltaReaderDestroy(pReader);
+    STAMR3DeltaDestroy(pDelta);
+}
+
+
+/**
+ * Reads exactly the requested number of bytes.
+ */
+static int tstReadExact(RTSOCKET hSocket, void *pvBuf, size_t cb)
+{
+    uint8_t *pb = (uint8_t *)pvBuf;
+    while (cb > 0)
+    {
+        int rc = RTTcpSelectOne(hSocket, 10 * RT_MS_1SEC);
+        if (RT_FAILURE(rc))
+            return rc;
+        size_t cbRead = 0;
+        rc = RTTcpRead(hSocket, pb, cb, &cbRead);
+        if (RT_FAILURE(rc))
+            return rc;
+        if (!cbRead)
+            return VERR_NET_SHUTDOWN;
+        pb += cbRead;
+        cb -= cbRead;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads one packet from a binary client connection and applies it.
+ */
+static int tstReadPacket(RTSOCKET hSocket, PSTAMDELTAREADER pReader)
+{
+    STAMDELTAHDR Hdr;
+    int rc = tstReadExact(hSocket, &Hdr, sizeof(Hdr));
+    if (RT_FAILURE(rc))
+        return rc;
+    if (Hdr.cbPacket < sizeof(Hdr) || Hdr.cbPacket > _4M)
+        return VERR_INVALID_PARAMETER;
+    uint8_t *pbPacket = (uint8_t *)RTMemAlloc(Hdr.cbPacket);
+    if (!pbPacket)
+        return VERR_NO_MEMORY;
+    memcpy(pbPacket, &Hdr, sizeof(Hdr));
+    rc = tstReadExact(hSocket, pbPacket + sizeof(Hdr), Hdr.cbPacket - sizeof(Hdr));
+    if (RT_SUCCESS(rc))
+        rc = STAMR3DeltaReaderApply(pReader, pbPacket, Hdr.cbPacket);
+    RTMemFree(pbPacket);
+    return rc;
+}
+
+
+/**
+ * Scrapes the Prometheus endpoint.
+ *
+ * @returns The response (RTMemFree), NULL on failure.
+ */
+static char *tstScrape(void)
+{
+    RTSOCKET hSocket;
+    int rc = RTTcpClientConnect("127.0.0.1", g_uPort, &hSocket);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf(TESTCASE ": error: connecting to port %u failed, rc=%Rrc\n", g_uPort, rc);
+        g_cErrors++;
+        return NULL;
+    }
+
+    static const char s_szRequest[] = "GET /metrics HTTP/1.0\r\nHost: localhost\r\n\r\n";
+    rc = RTTcpWrite(hSocket, s_szRequest, sizeof(s_szRequest) - 1);
+    size_t const cbBuf = _256K;
+    size_t       cbResp = 0;
+    char        *pszResp = (char *)RTMemAllocZ(cbBuf);
+    while (RT_SUCCESS(rc) && pszResp && cbResp < cbBuf - 1)
+    {
+        rc = RTTcpSelectOne(hSocket, 10 * RT_MS_1SEC);
+        if (RT_FAILURE(rc))
+            break;
+        size_t cbRead = 0;
+        rc = RTTcpRead(hSocket, &pszResp[cbResp], cbBuf - 1 - cbResp, &cbRead);
+        if (RT_SUCCESS(rc) && !cbRead)
+            break;
+        cbResp += cbRead;
+    }
+    RTTcpClientClose(hSocket);
+    if (RT_FAILURE(rc) || !pszResp)
+    {
+        RTPrintf(TESTCASE ": error: reading the scrape response failed, rc=%Rrc\n", rc);
+        g_cErrors++;
+        RTMemFree(pszResp);
+        return NULL;
+    }
+    return pszResp;
+}
+
+
+/**
+ * Checks that a scrape response contains a line.
+ */
+static void tstCheckLine(const char *pszResp, const char *pszLine)
+{
+    const char *psz = strstr(pszResp, pszLine);
+    if (!psz || (psz != pszResp && psz[-1] != '\n') || psz[strlen(pszLine)] != '\n')
+    {
+        RTPrintf(TESTCASE ": error: line not found in scrape response: %s\n", pszLine);
+        g_cErrors++;
+    }
+}
+
+
+/**
+ * Tests the streaming service, the Prometheus encoder in particular, with a
+ * binary client connected at the same time.
+ */
+static void tstStream(void)
+{
+    RTPrintf(TESTCASE ": Streaming service on port %u...\n", g_uPort);
+
+    /*
+     * A binary client which stays connected for the whole test.
+     */
+    RTSOCKET         hBinary;
+    PSTAMDELTAREADER pReader;
+    TST_CHECK_RC(STAMR3DeltaReaderCreate(&pReader), VINF_SUCCESS);
+    int rc = RTTcpClientConnect("127.0.0.1", g_uPort, &hBinary);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf(TESTCASE ": error: connecting to port %u failed, rc=%Rrc\n", g_uPort, rc);
+        g_cErrors++;
+        STAMR3DeltaReaderDestroy(pReader);
+        return;
+    }
+    TST_CHECK_RC(tstReadPacket(hBinary, pReader), VINF_SUCCESS);
+    tstCheckSample(pReader, "/tstSTAM/Counter", STAMTYPE_COUNTER, 1, 43, 0);
+
+    /*
+     * Scrape while the binary client is being served.
+     */
+    char *pszResp = tstScrape();
+    if (pszResp)
+    {
+        TST_CHECK(!strncmp(pszResp, "HTTP/1.0 200 OK\r\n", sizeof("HTTP/1.0 200 OK\r\n") - 1));
+        tstCheckLine(pszResp, "# TYPE vbox_stam_counter counter");
+        tstCheckLine(pszResp, "vbox_stam_counter{name=\"/tstSTAM/Counter\",unit=\"times\"} 43");
+        tstCheckLine(pszResp, "vbox_stam_profile_periods_total{name=\"/tstSTAM/Profile\",unit=\"ticks/call\"} 10");
+        tstCheckLine(pszResp, "vbox_stam_profile_ticks_total{name=\"/tstSTAM/Profile\",unit=\"ticks/call\"} 1000");
+        tstCheckLine(pszResp, "vbox_stam_value{name=\"/tstSTAM/New\",unit=\"bytes\"} 9");
+        tstCheckLine(pszResp, "vbox_stam_value{name=\"/tstSTAM/Quote\\\"d\\\\\",unit=\"bytes\"} 1");
+        TST_CHECK(!strstr(pszResp, "/tstSTAM/Ratio"));
+        RTMemFree(pszResp);
+    }
+
+    /*
+     * The scrapers share a cursor, the next scrape must still be complete
+     * and see the changes.
+     */
+    g_Counter.c = 44;
+    pszResp = tstScrape();
+    if (pszResp)
+    {
+        tstCheckLine(pszResp, "vbox_stam_counter{name=\"/tstSTAM/Counter\",unit=\"times\"} 44");
+        tstCheckLine(pszResp, "vbox_stam_value{name=\"/tstSTAM/New\",unit=\"bytes\"} 9");
+        RTMemFree(pszResp);
+    }
+
+    /*
+     * The binary client must see the change too.
+     */
+    PCSTAMDELTASAMPLE pSample = NULL;
+    for (unsigned i = 0; i < 100 && RT_SUCCESS(rc); i++)
+    {
+        rc = tstReadPacket(hBinary, pReader);
+        pSample = STAMR3DeltaReaderFindSample(pReader, "/tstSTAM/Counter");
+        if (pSample && pSample->au64Values[0] == 44)
+            break;
+    }
+    TST_CHECK_RC(rc, VINF_SUCCESS);
+    TST_CHECK(pSample && pSample->au64Values[0] == 44);
+
+    RTTcpClientClose(hBinary);
+    STAMR3DeltaReaderDestroy(pReader);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTR3InitExe(argc, &argv, RTR3INIT_FLAGS_SUPLIB);
+    RTPrintf(TESTCASE ": TESTING...\n");
+    RTStrmFlush(g_pStdOut);
+
+    /* Somewhere in the dynamic port range, varying to let parallel runs be. */
+    g_uPort = (uint16_t)(49152 + RTProcSelf() % 8192);
+
+    PUVM pUVM;
+    int rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, NULL, &pUVM);
+    if (RT_SUCCESS(rc))
+    {
+        /*
+         * Register the samples; registration resets them.
+         */
+        rc = STAMR3RegisterU(pUVM, &g_Counter, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, "/tstSTAM/Counter",
+                             STAMUNIT_OCCURENCES, "A counter.");
+        if (RT_SUCCESS(rc))
+            rc = STAMR3RegisterU(pUVM, &g_Profile, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, "/tstSTAM/Profile",
+                                 STAMUNIT_TICKS_PER_CALL, "A profile.");
+        if (RT_SUCCESS(rc))
+            rc = STAMR3RegisterU(pUVM, &g_Ratio, STAMTYPE_RATIO_U32, STAMVISIBILITY_ALWAYS, "/tstSTAM/Ratio",
+                                 STAMUNIT_NONE, "A ratio.");
+        if (RT_SUCCESS(rc))
+            rc = STAMR3RegisterU(pUVM, &g_u32Used, STAMTYPE_U32, STAMVISIBILITY_USED, "/tstSTAM/Used",
+                                 STAMUNIT_COUNT, "Not shown before it is used.");
+        if (RT_SUCCESS(rc))
+            rc = STAMR3RegisterU(pUVM, &g_u64Quote, STAMTYPE_U64, STAMVISIBILITY_ALWAYS, "/tstSTAM/Quote\"d\\",
+                                 STAMUNIT_BYTES, "Needs escaping.");
+        if (RT_SUCCESS(rc))
+        {
+            g_Counter.c         = 42;
+            g_Profile.cPeriods  = 10;
+            g_Profile.cTicks    = 1000;
+            g_Ratio.u32A        = 3;
+            g_Ratio.u32B        = 4;
+            g_u64Quote          = 1;
+
+            tstHistogram(pUVM);
+            tstDelta(pUVM);
+            tstStream();
+        }
+        else
+        {
+            RTPrintf(TESTCASE ": error: registering the samples failed, rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+        STAMR3Deregister(pUVM, "/tstSTAM/*");
+
+        rc = VMR3Destroy(pUVM);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": error: failed to destroy the vm! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+        VMR3ReleaseUVM(pUVM);
+    }
+    else
+    {
+        RTPrintf(TESTCASE ": fatal error: failed to create the vm! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+
+    /*
+     * Summary and return.
+     */
+    if (!g_cErrors)
+        RTPrintf(TESTCASE ": SUCCESS\n");
+    else
+        RTPrintf(TESTCASE ": FAILURE - %d errors\n", g_cErrors);
+
+    return !!g_cErrors;
+}
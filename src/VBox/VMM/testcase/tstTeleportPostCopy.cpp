@@ -0,0 +1,536 @@
+/* $Id$ */
+/** @file
+ * VMM Testcase - Post-copy teleportation between two VMs in one process.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmapi.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/ssm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/pipe.h>
+#include <iprt/semaphore.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#define TESTCASE    "tstTeleportPostCopy"
+
+/** Checks if the address is in the legacy VGA/ROM hole, which isn't RAM. */
+#define TST_IS_IN_HOLE(GCPhys)  ((GCPhys) >= UINT32_C(0x000a0000) && (GCPhys) < _1M)
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/** One end of the loopback stream. */
+typedef struct TSTSTRM
+{
+    /** The pipe handle. */
+    RTPIPE      hPipe;
+    /** The stream offset. */
+    uint64_t    off;
+} TSTSTRM;
+typedef TSTSTRM *PTSTSTRM;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** The error count. */
+static int              g_cErrors = 0;
+/** The source VM. */
+static PUVM             g_pUVMSrc;
+/** The target VM. */
+static PUVM             g_pUVMTrg;
+/** The writing end of the stream (source). */
+static TSTSTRM          g_StrmSrc = { NIL_RTPIPE, 0 };
+/** The reading end of the stream (target). */
+static TSTSTRM          g_StrmTrg = { NIL_RTPIPE, 0 };
+/** Number of times the progress callback dirtied the source memory. */
+static uint32_t         g_cDirtied = 0;
+
+/** Protects the demand fetch queue. */
+static RTCRITSECT       g_CritSectDemand;
+/** Signalled when a chunk is queued for demand fetching. */
+static RTSEMEVENT       g_hEvtDemand = NIL_RTSEMEVENT;
+/** The demand fetch queue. */
+static RTGCPHYS         g_aGCPhysDemand[64];
+/** Number of entries in g_aGCPhysDemand. */
+static uint32_t volatile g_cDemand = 0;
+/** Number of chunks sent ahead of the others. */
+static uint32_t         g_cDemandSent = 0;
+/** Set when the reader thread should stop. */
+static bool volatile    g_fReaderStop = false;
+
+
+static DECLCALLBACK(int) tstStrmWrite(void *pvUser, uint64_t offStream, const void *pvBuf, size_t cbToWrite)
+{
+    PTSTSTRM pStrm = (PTSTSTRM)pvUser;
+    AssertReturn(offStream == pStrm->off, VERR_INVALID_PARAMETER);
+    int rc = RTPipeWriteBlocking(pStrm->hPipe, pvBuf, cbToWrite, NULL);
+    if (RT_SUCCESS(rc))
+        pStrm->off += cbToWrite;
+    return rc;
+}
+
+
+static DECLCALLBACK(int) tstStrmRead(void *pvUser, uint64_t offStream, void *pvBuf, size_t cbToRead, size_t *pcbRead)
+{
+    PTSTSTRM pStrm = (PTSTSTRM)pvUser;
+    AssertReturn(offStream == pStrm->off, VERR_INVALID_PARAMETER);
+    int rc;
+    if (pcbRead)
+    {
+        rc = RTPipeSelectOne(pStrm->hPipe, RT_INDEFINITE_WAIT);
+        if (RT_SUCCESS(rc))
+            rc = RTPipeRead(pStrm->hPipe, pvBuf, cbToRead, pcbRead);
+    }
+    else
+        rc = RTPipeReadBlocking(pStrm->hPipe, pvBuf, cbToRead, NULL);
+    if (rc == VERR_BROKEN_PIPE)
+        return VERR_EOF;
+    if (RT_SUCCESS(rc))
+        pStrm->off += pcbRead ? *pcbRead : cbToRead;
+    return rc;
+}
+
+
+static DECLCALLBACK(int) tstStrmSeek(void *pvUser, int64_t offSeek, unsigned uMethod, uint64_t *poffActual)
+{
+    NOREF(pvUser); NOREF(offSeek); NOREF(uMethod); NOREF(poffActual);
+    return VERR_NOT_SUPPORTED;
+}
+
+
+static DECLCALLBACK(uint64_t) tstStrmTell(void *pvUser)
+{
+    return ((PTSTSTRM)pvUser)->off;
+}
+
+
+static DECLCALLBACK(int) tstStrmSize(void *pvUser, uint64_t *pcb)
+{
+    NOREF(pvUser); NOREF(pcb);
+    return VERR_NOT_SUPPORTED;
+}
+
+
+static DECLCALLBACK(int) tstStrmIsOk(void *pvUser)
+{
+    NOREF(pvUser);
+    return VINF_SUCCESS;
+}
+
+
+static DECLCALLBACK(int) tstStrmClose(void *pvUser, bool fCancelled)
+{
+    NOREF(fCancelled);
+    PTSTSTRM pStrm = (PTSTSTRM)pvUser;
+    /* Only the source end is closed here, so the target sees EOF. */
+    if (pStrm == &g_StrmSrc)
+    {
+        RTPipeClose(pStrm->hPipe);
+        pStrm->hPipe = NIL_RTPIPE;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/** The loopback stream methods. */
+static SSMSTRMOPS const g_tstStrmOps =
+{
+    SSMSTRMOPS_VERSION,
+    tstStrmWrite,
+    tstStrmRead,
+    tstStrmSeek,
+    tstStrmTell,
+    tstStrmSize,
+    tstStrmIsOk,
+    tstStrmClose,
+    SSMSTRMOPS_VERSION
+};
+
+
+/**
+ * Source progress callback that keeps dirtying guest memory during the live
+ * passes, so the final pass has something to defer.
+ */
+static DECLCALLBACK(int) tstSrcProgress(PUVM pUVM, unsigned uPercent, void *pvUser)
+{
+    NOREF(uPercent); NOREF(pvUser);
+    if (VMR3GetStateU(pUVM) == VMSTATE_RUNNING_LS)
+    {
+        PVM      pVM    = VMR3GetVM(pUVM);
+        uint64_t cbRam  = MMR3PhysGetRamSize(pVM);
+        uint8_t  abPage[PAGE_SIZE];
+        for (uint32_t i = 0; i < 32; i++)
+        {
+            /* Spread the writes over the chunks above the first MB to stay clear of the BIOS. */
+            RTGCPHYS GCPhys = _1M + ((RTGCPHYS)(g_cDirtied * 32 + i) * (PGM_POSTCOPY_CHUNK_SIZE + PAGE_SIZE)) % (cbRam - _2M);
+            GCPhys &= ~(RTGCPHYS)PAGE_OFFSET_MASK;
+            memset(abPage, (int)(g_cDirtied + i), sizeof(abPage));
+            *(uint64_t *)&abPage[0] = GCPhys;
+            PGMR3PhysWriteExternal(pVM, GCPhys, abPage, sizeof(abPage), TESTCASE);
+        }
+        g_cDirtied++;
+    }
+    return VINF_SUCCESS;
+}
+
+
+static DECLCALLBACK(int) tstSrcThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    NOREF(hThreadSelf); NOREF(pvUser);
+    bool fSuspended = false;
+    int rc = VMR3Teleport(g_pUVMSrc, 250 /*cMsMaxDowntime*/, &g_tstStrmOps, &g_StrmSrc, tstSrcProgress, NULL, &fSuspended);
+    if (RT_FAILURE(rc))
+        RTPrintf(TESTCASE ": VMR3Teleport -> %Rrc\n", rc);
+    return rc;
+}
+
+
+static DECLCALLBACK(int) tstTrgThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    NOREF(hThreadSelf); NOREF(pvUser);
+    int rc = VMR3LoadFromStream(g_pUVMTrg, &g_tstStrmOps, &g_StrmTrg, NULL, NULL);
+    if (RT_FAILURE(rc))
+        RTPrintf(TESTCASE ": VMR3LoadFromStream -> %Rrc\n", rc);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPOSTCOPYFETCH, Queues the chunk for the pump.}
+ */
+static DECLCALLBACK(int) tstTrgFetch(PUVM pUVM, RTGCPHYS GCPhysChunk, void *pvUser)
+{
+    NOREF(pUVM); NOREF(pvUser);
+    RTCritSectEnter(&g_CritSectDemand);
+    if (g_cDemand < RT_ELEMENTS(g_aGCPhysDemand))
+        g_aGCPhysDemand[g_cDemand++] = GCPhysChunk;
+    RTCritSectLeave(&g_CritSectDemand);
+    return RTSemEventSignal(g_hEvtDemand);
+}
+
+
+/**
+ * Maps every target page through the external mapping API while the chunks are
+ * still arriving, exercising the demand fetch path.
+ */
+static DECLCALLBACK(int) tstReaderThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    NOREF(hThreadSelf); NOREF(pvUser);
+    PVM      pVM   = VMR3GetVM(g_pUVMTrg);
+    uint64_t cbRam = MMR3PhysGetRamSize(pVM);
+    int      rc    = VINF_SUCCESS;
+
+    /* Go backwards so we don't just trail the in-order transfer. */
+    for (RTGCPHYS GCPhys = cbRam - PAGE_SIZE; !g_fReaderStop; GCPhys -= PAGE_SIZE)
+    {
+        void const     *pv;
+        PGMPAGEMAPLOCK  Lock;
+        rc = PGMR3PhysGCPhys2CCPtrReadOnlyExternal(pVM, GCPhys, &pv, &Lock);
+        if (RT_SUCCESS(rc))
+            PGMPhysReleasePageMappingLock(pVM, &Lock);
+        else if (!TST_IS_IN_HOLE(GCPhys))
+        {
+            RTPrintf(TESTCASE ": PGMR3PhysGCPhys2CCPtrReadOnlyExternal(%RGp) -> %Rrc\n", GCPhys, rc);
+            g_cErrors++;
+            break;
+        }
+        rc = VINF_SUCCESS;
+        if (!GCPhys)
+            break;
+    }
+    return rc;
+}
+
+
+/**
+ * Sends one chunk from the source to the target.
+ */
+static int tstSendChunk(RTGCPHYS GCPhysChunk, uint64_t *pbmPages, void *pvPages)
+{
+    uint32_t cPages = 0;
+    int rc = PGMR3PostCopyReadChunk(g_pUVMSrc, GCPhysChunk, pbmPages, pvPages, &cPages);
+    if (rc == VERR_NOT_FOUND)
+        return VINF_SUCCESS; /* sent already */
+    if (RT_SUCCESS(rc))
+        rc = PGMR3PostCopyDeliverChunk(g_pUVMTrg, GCPhysChunk, pbmPages, pvPages, cPages);
+    if (RT_FAILURE(rc))
+        RTPrintf(TESTCASE ": Sending chunk %RGp failed: %Rrc\n", GCPhysChunk, rc);
+    return rc;
+}
+
+
+/**
+ * Does the post-copy phase, sending demand requests ahead of the rest like the
+ * teleporter does.
+ */
+static int tstPostCopy(void)
+{
+    RTPrintf(TESTCASE ": %u chunks deferred (%u dirtying rounds)\n", PGMR3PostCopyPendingChunks(g_pUVMSrc), g_cDirtied);
+
+    uint64_t bmPages[PGM_POSTCOPY_CHUNK_PAGES / 64];
+    void    *pvPages = RTMemAlloc(PGM_POSTCOPY_CHUNK_SIZE);
+    if (!pvPages)
+        return VERR_NO_MEMORY;
+
+    int rc = PGMR3PostCopySetFetcher(g_pUVMTrg, tstTrgFetch, NULL);
+    RTTHREAD hReader = NIL_RTTHREAD;
+    if (RT_SUCCESS(rc))
+        rc = RTThreadCreate(&hReader, tstReaderThread, NULL, 0, RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "READER");
+    while (RT_SUCCESS(rc))
+    {
+        RTGCPHYS GCPhys = NIL_RTGCPHYS;
+        RTCritSectEnter(&g_CritSectDemand);
+        if (g_cDemand)
+        {
+            GCPhys = g_aGCPhysDemand[0];
+            memmove(&g_aGCPhysDemand[0], &g_aGCPhysDemand[1], --g_cDemand * sizeof(g_aGCPhysDemand[0]));
+            g_cDemandSent++;
+        }
+        RTCritSectLeave(&g_CritSectDemand);
+        if (GCPhys == NIL_RTGCPHYS)
+        {
+            rc = PGMR3PostCopyNextChunk(g_pUVMSrc, &GCPhys);
+            if (rc == VERR_NOT_FOUND)
+            {
+                rc = VINF_SUCCESS;
+                break;
+            }
+            if (RT_FAILURE(rc))
+                break;
+            /* Give the reader a chance to get ahead of us. */
+            RTSemEventWait(g_hEvtDemand, 1);
+        }
+        rc = tstSendChunk(GCPhys, bmPages, pvPages);
+    }
+
+    ASMAtomicWriteBool(&g_fReaderStop, true);
+    if (hReader != NIL_RTTHREAD)
+    {
+        int rcThread;
+        RTThreadWait(hReader, RT_INDEFINITE_WAIT, &rcThread);
+        if (RT_SUCCESS(rc))
+            rc = rcThread;
+    }
+    PGMR3PostCopySetFetcher(g_pUVMTrg, NULL, NULL);
+    RTMemFree(pvPages);
+
+    if (RT_SUCCESS(rc) && PGMR3PostCopyPendingChunks(g_pUVMTrg))
+    {
+        RTPrintf(TESTCASE ": %u chunks still missing on the target\n", PGMR3PostCopyPendingChunks(g_pUVMTrg));
+        rc = VERR_INTERNAL_ERROR_2;
+    }
+    RTPrintf(TESTCASE ": %u chunks sent on demand\n", g_cDemandSent);
+    return rc;
+}
+
+
+/**
+ * Compares the RAM of the two VMs.
+ */
+static void tstCompareRam(void)
+{
+    PVM      pVMSrc = VMR3GetVM(g_pUVMSrc);
+    PVM      pVMTrg = VMR3GetVM(g_pUVMTrg);
+    uint64_t cbRam  = MMR3PhysGetRamSize(pVMSrc);
+    uint32_t cDiffs = 0;
+    uint8_t  abSrc[PAGE_SIZE];
+    uint8_t  abTrg[PAGE_SIZE];
+    for (RTGCPHYS GCPhys = 0; GCPhys < cbRam; GCPhys += PAGE_SIZE)
+    {
+        if (TST_IS_IN_HOLE(GCPhys))
+            continue;
+        int rc1 = PGMR3PhysReadExternal(pVMSrc, GCPhys, abSrc, PAGE_SIZE);
+        int rc2 = PGMR3PhysReadExternal(pVMTrg, GCPhys, abTrg, PAGE_SIZE);
+        if (RT_FAILURE(rc1) || RT_FAILURE(rc2) || memcmp(abSrc, abTrg, PAGE_SIZE))
+        {
+            if (cDiffs++ < 16)
+                RTPrintf(TESTCASE ": Page %RGp differs (rc1=%Rrc rc2=%Rrc)\n", GCPhys, rc1, rc2);
+        }
+    }
+    if (cDiffs)
+    {
+        RTPrintf(TESTCASE ": %u of %u pages differ\n", cDiffs, (uint32_t)(cbRam >> PAGE_SHIFT));
+        g_cErrors++;
+    }
+}
+
+
+static DECLCALLBACK(int)
+tstConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    NOREF(pUVM); NOREF(pvUser);
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        /* Disable HM, see tstVMREQ. */
+        PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+        rc = CFGMR3InsertInteger(pRoot, "HMEnabled", false);
+        if (RT_FAILURE(rc))
+            RTPrintf("CFGMR3InsertInteger(pRoot,\"HMEnabled\",) -> %Rrc\n", rc);
+    }
+    return rc;
+}
+
+
+int main(int argc, char **argv)
+{
+    RTR3InitExe(argc, &argv, RTR3INIT_FLAGS_SUPLIB);
+    RTPrintf(TESTCASE ": TESTING...\n");
+    RTStrmFlush(g_pStdOut);
+
+    int rc = RTCritSectInit(&g_CritSectDemand);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&g_hEvtDemand);
+    if (RT_SUCCESS(rc))
+        rc = RTPipeCreate(&g_StrmTrg.hPipe, &g_StrmSrc.hPipe, 0);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf(TESTCASE ": fatal error: setup failed, rc=%Rrc\n", rc);
+        return 1;
+    }
+
+    /*
+     * Create the two VMs, the source running the BIOS and the target waiting
+     * for the state.
+     */
+    rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, NULL, &g_pUVMSrc);
+    if (RT_SUCCESS(rc))
+    {
+        rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, NULL, &g_pUVMTrg);
+        if (RT_SUCCESS(rc))
+        {
+            rc = PGMR3PostCopyEnable(g_pUVMSrc, 2 /*cPrePasses*/);
+            if (RT_SUCCESS(rc))
+                rc = PGMR3PostCopyAccept(g_pUVMTrg);
+            if (RT_SUCCESS(rc))
+                rc = VMR3PowerOn(g_pUVMSrc);
+            if (RT_SUCCESS(rc))
+            {
+                /*
+                 * Teleport.
+                 */
+                RTTHREAD hThreadSrc;
+                RTTHREAD hThreadTrg;
+                rc = RTThreadCreate(&hThreadTrg, tstTrgThread, NULL, 0, RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "TRG");
+                if (RT_SUCCESS(rc))
+                {
+                    rc = RTThreadCreate(&hThreadSrc, tstSrcThread, NULL, 0, RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "SRC");
+                    if (RT_SUCCESS(rc))
+                    {
+                        int rcSrc = VERR_INTERNAL_ERROR;
+                        RTThreadWait(hThreadSrc, RT_INDEFINITE_WAIT, &rcSrc);
+                        if (RT_FAILURE(rcSrc))
+                        {
+                            /* Unblock the target. */
+                            RTPipeClose(g_StrmSrc.hPipe);
+                            g_StrmSrc.hPipe = NIL_RTPIPE;
+                        }
+                        rc = rcSrc;
+                    }
+                    int rcTrg = VERR_INTERNAL_ERROR;
+                    RTThreadWait(hThreadTrg, RT_INDEFINITE_WAIT, &rcTrg);
+                    if (RT_SUCCESS(rc))
+                        rc = rcTrg;
+                }
+
+                /*
+                 * Post-copy the rest.  The target is kept suspended so its
+                 * memory can be compared with the source afterwards, which
+                 * leaves the page installing to the EMT request queue.
+                 */
+                if (RT_SUCCESS(rc))
+                    rc = tstPostCopy();
+                PGMR3PostCopyEnd(g_pUVMSrc, rc);
+                PGMR3PostCopyEnd(g_pUVMTrg, rc);
+                if (RT_SUCCESS(rc))
+                    tstCompareRam();
+                else
+                {
+                    RTPrintf(TESTCASE ": error: teleportation failed, rc=%Rrc\n", rc);
+                    g_cErrors++;
+                }
+            }
+            else
+            {
+                RTPrintf(TESTCASE ": error: failed to start the source vm! rc=%Rrc\n", rc);
+                g_cErrors++;
+            }
+
+            VMR3PowerOff(g_pUVMTrg);
+            rc = VMR3Destroy(g_pUVMTrg);
+            if (RT_FAILURE(rc))
+            {
+                RTPrintf(TESTCASE ": error: failed to destroy the target vm! rc=%Rrc\n", rc);
+                g_cErrors++;
+            }
+            VMR3ReleaseUVM(g_pUVMTrg);
+        }
+        else
+        {
+            RTPrintf(TESTCASE ": fatal error: failed to create the target vm! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+
+        VMR3PowerOff(g_pUVMSrc);
+        rc = VMR3Destroy(g_pUVMSrc);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": error: failed to destroy the source vm! rc=%Rrc\n", rc);
+            g_cErrors++;
+        }
+        VMR3ReleaseUVM(g_pUVMSrc);
+    }
+    else
+    {
+        RTPrintf(TESTCASE ": fatal error: failed to create the source vm! rc=%Rrc\n", rc);
+        g_cErrors++;
+    }
+
+    RTPipeClose(g_StrmSrc.hPipe);
+    RTPipeClose(g_StrmTrg.hPipe);
+    RTSemEventDestroy(g_hEvtDemand);
+    RTCritSectDelete(&g_CritSectDemand);
+
+    /*
+     * Summary and return.
+     */
+    if (!g_cErrors)
+        RTPrintf(TESTCASE ": SUCCESS\n");
+    else
+        RTPrintf(TESTCASE ": FAILURE - %d errors\n", g_cErrors);
+
+    return !!g_cErrors;
+}
@@ -23,19 +23,24 @@
 #include <VBox/vmm/vmm.h>
 #include <VBox/vmm/cpum.h>
 #include <VBox/vmm/tm.h>
+#include <VBox/vmm/iom.h>
 #include <VBox/vmm/pdmapi.h>
 #include <VBox/err.h>
 #include <VBox/log.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
 #include <iprt/getopt.h>
 #include <iprt/initterm.h>
+#include <iprt/mem.h>
 #include <iprt/message.h>
+#include <iprt/rand.h>
 #include <iprt/semaphore.h>
 #include <iprt/stream.h>
 #include <iprt/string.h>
 #include <iprt/test.h>
 #include <iprt/thread.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -49,6 +54,18 @@
 *   Global Variables                                                           *
 *******************************************************************************/
 static uint32_t g_cCpus = 1;
+/** The number of timers for the TM benchmark. */
+static uint32_t g_cBenchTimers = 4096;
+/** The number of accesses each EMT does in the MMIO benchmark. */
+static uint32_t g_cMmioBenchAccesses = 1000000;
+/** The number of EMTs ready to start the MMIO benchmark. */
+static uint32_t volatile g_cMmioBenchReady = 0;
+/** The number of EMTs done with the MMIO benchmark. */
+static uint32_t volatile g_cMmioBenchDone = 0;
+/** The total MMIO benchmark runtime of all EMTs, in nanoseconds. */
+static uint64_t volatile g_cNsMmioBenchTotal = 0;
+/** The number of EMTs which actually ran the MMIO benchmark. */
+static uint32_t volatile g_cMmioBenchRan = 0;
 
 
 /*******************************************************************************
@@ -137,6 +154,123 @@ DECLCALLBACK(int) tstTMWorker(PVM pVM, RTTEST hTest)
 }
 
 
+/**
+ * Benchmarks arming, rearming and stopping timers while lots of other timers
+ * are active on the same queue.
+ *
+ * @returns VINF_SUCCESS, test failure is reported via RTTEST.
+ * @param   pVM         Pointer to the VM.
+ * @param   hTest       The test handle.
+ */
+DECLCALLBACK(int) tstTMBenchWorker(PVM pVM, RTTEST hTest)
+{
+    /*
+     * Create the timers and arm them all well into the future so they
+     * don't fire while we're measuring.
+     */
+    uint32_t const  cTimers   = g_cBenchTimers;
+    PTMTIMER       *papTimers = (PTMTIMER *)RTMemAllocZ(sizeof(papTimers[0]) * cTimers);
+    RTTEST_CHECK_RET(hTest, papTimers != NULL, VERR_NO_MEMORY);
+
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < cTimers && RT_SUCCESS(rc); i++)
+        rc = TMR3TimerCreateInternal(pVM, TMCLOCK_VIRTUAL, tstTMDummyCallback, NULL, "bench timer", &papTimers[i]);
+    RTTEST_CHECK_MSG(hTest, RT_SUCCESS(rc), (hTest, "TMR3TimerCreateInternal: %Rrc\n", rc));
+
+    uint32_t const  cMsBase     = 60000;
+    uint32_t const  cIterations = 100000;
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t nsStart = RTTimeNanoTS();
+        for (uint32_t i = 0; i < cTimers; i++)
+            TMTimerSetMillies(papTimers[i], cMsBase + RTRandU32Ex(0, 60000));
+        uint64_t cNsElapsed = RTTimeNanoTS() - nsStart;
+        RTTestValue(hTest, "Arm", cNsElapsed / cTimers, RTTESTUNIT_NS_PER_CALL);
+
+        /*
+         * Rearm random timers, the typical pattern of interrupt delay and
+         * periodic device timers.
+         */
+        nsStart = RTTimeNanoTS();
+        for (uint32_t i = 0; i < cIterations; i++)
+            TMTimerSetMillies(papTimers[RTRandU32Ex(0, cTimers - 1)], cMsBase + RTRandU32Ex(0, 60000));
+        cNsElapsed = RTTimeNanoTS() - nsStart;
+        RTTestValue(hTest, "Rearm", cNsElapsed / cIterations, RTTESTUNIT_NS_PER_CALL);
+
+        /*
+         * Stop and restart random timers.
+         */
+        nsStart = RTTimeNanoTS();
+        for (uint32_t i = 0; i < cIterations; i++)
+        {
+            PTMTIMER pTimer = papTimers[RTRandU32Ex(0, cTimers - 1)];
+            TMTimerStop(pTimer);
+            TMTimerSetMillies(pTimer, cMsBase + RTRandU32Ex(0, 60000));
+        }
+        cNsElapsed = RTTimeNanoTS() - nsStart;
+        RTTestValue(hTest, "StopAndArm", cNsElapsed / cIterations, RTTESTUNIT_NS_PER_CALL);
+
+        /*
+         * Running the queues with nothing expired should be cheap regardless
+         * of the number of active timers.
+         */
+        nsStart = RTTimeNanoTS();
+        for (uint32_t i = 0; i < cIterations; i++)
+            TMR3TimerQueuesDo(pVM);
+        cNsElapsed = RTTimeNanoTS() - nsStart;
+        RTTestValue(hTest, "QueuesDo", cNsElapsed / cIterations, RTTESTUNIT_NS_PER_CALL);
+    }
+
+    /*
+     * Cleanup.
+     */
+    for (uint32_t i = 0; i < cTimers; i++)
+        if (papTimers[i])
+            TMR3TimerDestroy(papTimers[i]);
+    RTMemFree(papTimers);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Hammers the legacy VGA MMIO range from each EMT to measure how MMIO
+ * dispatch scales with the number of VCPUs.
+ *
+ * @returns VINF_SUCCESS, test failure is reported via RTTEST.
+ * @param   pVM         Pointer to the VM.
+ * @param   hTest       The test handle.
+ */
+DECLCALLBACK(int) tstMmioBenchWorker(PVM pVM, RTTEST hTest)
+{
+    PVMCPU          pVCpu     = VMMGetCpu(pVM);
+    uint32_t const  cAccesses = g_cMmioBenchAccesses;
+
+    /* Line up all the EMTs so they hit IOM at the same time. */
+    ASMAtomicIncU32(&g_cMmioBenchReady);
+    while (ASMAtomicReadU32(&g_cMmioBenchReady) < pVM->cCpus)
+        ASMNopPause();
+
+    uint64_t nsStart = RTTimeNanoTS();
+    for (uint32_t i = 0; i < cAccesses; i++)
+    {
+        uint32_t u32Value;
+        VBOXSTRICTRC rcStrict = IOMMMIORead(pVM, pVCpu, 0xa0000 + (i & 0x7ffc), &u32Value, sizeof(u32Value));
+        if (RT_UNLIKELY(rcStrict != VINF_SUCCESS))
+        {
+            RTTestFailed(hTest, "idCpu=%u: IOMMMIORead -> %Rrc\n", pVCpu->idCpu, VBOXSTRICTRC_VAL(rcStrict));
+            break;
+        }
+    }
+    uint64_t cNsElapsed = RTTimeNanoTS() - nsStart;
+
+    RTTestValueF(hTest, cNsElapsed / cAccesses, RTTESTUNIT_NS_PER_CALL, "Read/CPU%u", pVCpu->idCpu);
+    ASMAtomicAddU64(&g_cNsMmioBenchTotal, cNsElapsed);
+    ASMAtomicIncU32(&g_cMmioBenchRan);
+    ASMAtomicIncU32(&g_cMmioBenchDone);
+    return VINF_SUCCESS;
+}
+
+
 /** PDMR3LdrEnumModules callback, see FNPDMR3ENUM. */
 static DECLCALLBACK(int)
 tstVMMLdrEnum(PVM pVM, const char *pszFilename, const char *pszName, RTUINTPTR ImageBase, size_t cbImage,
@@ -206,10 +340,11 @@ int main(int argc, char **argv)
     {
         { "--cpus",          'c', RTGETOPT_REQ_UINT8 },
         { "--test",          't', RTGETOPT_REQ_STRING },
+        { "--timers",        'n', RTGETOPT_REQ_UINT32 },
     };
     enum
     {
-        kTstVMMTest_VMM,  kTstVMMTest_TM
+        kTstVMMTest_VMM,  kTstVMMTest_TM, kTstVMMTest_TMBench, kTstVMMTest_MmioBench
     } enmTestOpt = kTstVMMTest_VMM;
 
     int ch;
@@ -229,6 +364,10 @@ int main(int argc, char **argv)
                     enmTestOpt = kTstVMMTest_VMM;
                 else if (!strcmp("tm", ValueUnion.psz))
                     enmTestOpt = kTstVMMTest_TM;
+                else if (!strcmp("tmbench", ValueUnion.psz))
+                    enmTestOpt = kTstVMMTest_TMBench;
+                else if (!strcmp("mmiobench", ValueUnion.psz))
+                    enmTestOpt = kTstVMMTest_MmioBench;
                 else
                 {
                     RTPrintf("tstVMM: unknown test: '%s'\n", ValueUnion.psz);
@@ -236,8 +375,17 @@ int main(int argc, char **argv)
                 }
                 break;
 
+            case 'n':
+                if (!ValueUnion.u32)
+                {
+                    RTPrintf("tstVMM: --timers must be at least 1\n");
+                    return 1;
+                }
+                g_cBenchTimers = ValueUnion.u32;
+                break;
+
             case 'h':
-                RTPrintf("usage: tstVMM [--cpus|-c cpus] [--test <vmm|tm>]\n");
+                RTPrintf("usage: tstVMM [--cpus|-c cpus] [--test <vmm|tm|tmbench|mmiobench>] [--timers|-n count]\n");
                 return 1;
 
             case 'V':
@@ -291,6 +439,50 @@ int main(int argc, char **argv)
                     RTTestFailed(hTest, "VMMDoTest failed: rc=%Rrc\n", rc);
                 break;
             }
+
+            case kTstVMMTest_TMBench:
+            {
+                RTTestSubF(hTest, "TM benchmark, %u timers", g_cBenchTimers);
+                rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstTMBenchWorker, 2, pVM, hTest);
+                if (RT_FAILURE(rc))
+                    RTTestFailed(hTest, "tstTMBenchWorker failed: rc=%Rrc\n", rc);
+                break;
+            }
+
+            case kTstVMMTest_MmioBench:
+            {
+                RTTestSubF(hTest, "MMIO benchmark, %u CPUs", g_cCpus);
+                /* A worker that couldn't be queued is counted as ready and done,
+                   so neither the other EMTs nor we wait for it forever. */
+                for (VMCPUID idCpu = 1; idCpu < g_cCpus; idCpu++)
+                {
+                    rc = VMR3ReqCallNoWaitU(pUVM, idCpu, (PFNRT)tstMmioBenchWorker, 2, pVM, hTest);
+                    if (RT_FAILURE(rc))
+                    {
+                        RTTestFailed(hTest, "VMR3ReqCall failed: rc=%Rrc\n", rc);
+                        ASMAtomicIncU32(&g_cMmioBenchReady);
+                        ASMAtomicIncU32(&g_cMmioBenchDone);
+                    }
+                }
+
+                rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstMmioBenchWorker, 2, pVM, hTest);
+                if (RT_FAILURE(rc))
+                {
+                    RTTestFailed(hTest, "tstMmioBenchWorker failed: rc=%Rrc\n", rc);
+                    ASMAtomicIncU32(&g_cMmioBenchReady);
+                    ASMAtomicIncU32(&g_cMmioBenchDone);
+                }
+                while (ASMAtomicReadU32(&g_cMmioBenchDone) < g_cCpus)
+                    RTThreadSleep(1);
+
+                /* Aggregate throughput, assuming the EMTs ran concurrently. */
+                uint32_t const cRan   = ASMAtomicReadU32(&g_cMmioBenchRan);
+                uint64_t const cNsAvg = cRan ? ASMAtomicReadU64(&g_cNsMmioBenchTotal) / cRan : 0;
+                if (cNsAvg)
+                    RTTestValue(hTest, "Throughput",
+                                (uint64_t)g_cMmioBenchAccesses * cRan * RT_NS_1SEC / cNsAvg, RTTESTUNIT_CALLS_PER_SEC);
+                break;
+            }
         }
 
         STAMR3Dump(pUVM, "*");
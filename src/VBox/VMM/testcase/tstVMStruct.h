@@ -273,6 +273,7 @@
     GEN_CHECK_OFF(IOM, pTreesRC);
     GEN_CHECK_OFF(IOM, pTreesR3);
     GEN_CHECK_OFF(IOM, pTreesR0);
+    GEN_CHECK_OFF(IOM, uMmioGen);
 
     GEN_CHECK_SIZE(IOMCPU);
     GEN_CHECK_OFF(IOMCPU, DisState);
@@ -282,6 +283,10 @@
     GEN_CHECK_OFF(IOMCPU, pMMIOStatsLastR0);
     GEN_CHECK_OFF(IOMCPU, pMMIORangeLastRC);
     GEN_CHECK_OFF(IOMCPU, pMMIOStatsLastRC);
+    GEN_CHECK_OFF(IOMCPU, uMmioGenCache);
+    GEN_CHECK_OFF(IOMCPU, fMmioLockless);
+    GEN_CHECK_OFF(IOMCPU, aNoStrBufR3);
+    GEN_CHECK_OFF(IOMCPU, aNoStrBufR0);
     GEN_CHECK_OFF(IOMCPU, pRangeLastReadR0);
     GEN_CHECK_OFF(IOMCPU, pRangeLastReadRC);
 
@@ -1093,6 +1098,7 @@
     GEN_CHECK_OFF(TMTIMER, offScheduleNext);
     GEN_CHECK_OFF(TMTIMER, offNext);
     GEN_CHECK_OFF(TMTIMER, offPrev);
+    GEN_CHECK_OFF(TMTIMER, offChild);
     GEN_CHECK_OFF(TMTIMER, pVMR0);
     GEN_CHECK_OFF(TMTIMER, pVMR3);
     GEN_CHECK_OFF(TMTIMER, pVMRC);